@@ -6,36 +6,64 @@ set -e
 CROSS_COMPILE=riscv64-unknown-elf-
 CC="${CROSS_COMPILE}gcc"
 LD="${CROSS_COMPILE}ld"
+AR="${CROSS_COMPILE}ar"
 OBJCOPY="${CROSS_COMPILE}objcopy"
 
-CFLAGS="-march=rv64gc -mabi=lp64d -nostdlib -nostartfiles -ffreestanding -fno-common -O2 -Wall"
-LDFLAGS="-nostdlib -static"
-
 USERLAND_DIR="$(cd "$(dirname "$0")" && pwd)/userland"
+LIB_DIR="${USERLAND_DIR}/lib"
+ML_DIR="${USERLAND_DIR}/ml"
 BUILD_DIR="${USERLAND_DIR}/build"
 
-# Create build directory
-mkdir -p "${BUILD_DIR}"
+CFLAGS="-march=rv64gc -mabi=lp64d -nostdlib -nostartfiles -ffreestanding -fno-common -O2 -Wall -I${LIB_DIR}/include"
+LDFLAGS="-nostdlib -static"
+
+PROGRAMS="ls cat hello defrag wc fork_test malloc_bench"
+BENCHES="bench_syscall bench_ctxsw bench_fault bench_spawn bench_file bench_dir bench_ml"
+
+# Create build directories
+mkdir -p "${BUILD_DIR}/lib" "${BUILD_DIR}/ml"
+
+# Build the runtime library every program links against
+# (-fno-builtin keeps the compiler from turning memset/memcpy loops
+# back into calls to themselves)
+echo "Building libc..."
+${CC} ${CFLAGS} -c "${LIB_DIR}/crt0.S" -o "${BUILD_DIR}/lib/crt0.o"
+LIB_OBJS=""
+for src in syscall string stdio printf stdlib malloc; do
+    ${CC} ${CFLAGS} -fno-builtin -c "${LIB_DIR}/${src}.c" -o "${BUILD_DIR}/lib/${src}.o"
+    LIB_OBJS="${LIB_OBJS} ${BUILD_DIR}/lib/${src}.o"
+done
+rm -f "${BUILD_DIR}/lib/libc.a"
+${AR} rcs "${BUILD_DIR}/lib/libc.a" ${LIB_OBJS}
+
+# Neural network kernels; only ml_rvv.c may use vector instructions, and
+# ml.c calls into it only when the kernel reports V
+# (-fno-math-errno lets sqrtf and friends stay single instructions)
+echo "Building libml..."
+ML_CFLAGS="${CFLAGS} -I${ML_DIR}/include -fno-math-errno"
+${CC} ${ML_CFLAGS} -c "${ML_DIR}/ml.c" -o "${BUILD_DIR}/ml/ml.o"
+${CC} ${ML_CFLAGS} -march=rv64gcv -c "${ML_DIR}/ml_rvv.c" -o "${BUILD_DIR}/ml/ml_rvv.o"
+rm -f "${BUILD_DIR}/ml/libml.a"
+${AR} rcs "${BUILD_DIR}/ml/libml.a" "${BUILD_DIR}/ml/ml.o" "${BUILD_DIR}/ml/ml_rvv.o"
 
 echo "Building userland programs..."
 
-# Build ls
-echo "Building ls..."
-${CC} ${CFLAGS} -c "${USERLAND_DIR}/ls.c" -o "${BUILD_DIR}/ls.o"
-${LD} ${LDFLAGS} -Ttext=0xf000 "${BUILD_DIR}/ls.o" -o "${BUILD_DIR}/ls"
-${OBJCOPY} -O binary "${BUILD_DIR}/ls" "${BUILD_DIR}/ls.bin"
-
-# Build cat
-echo "Building cat..."
-${CC} ${CFLAGS} -c "${USERLAND_DIR}/cat.c" -o "${BUILD_DIR}/cat.o"
-${LD} ${LDFLAGS} -Ttext=0xf000 "${BUILD_DIR}/cat.o" -o "${BUILD_DIR}/cat"
-${OBJCOPY} -O binary "${BUILD_DIR}/cat" "${BUILD_DIR}/cat.bin"
-
-# Build hello
-echo "Building hello..."
-${CC} ${CFLAGS} -c "${USERLAND_DIR}/hello.c" -o "${BUILD_DIR}/hello.o"
-${LD} ${LDFLAGS} -Ttext=0xf000 "${BUILD_DIR}/hello.o" -o "${BUILD_DIR}/hello"
-${OBJCOPY} -O binary "${BUILD_DIR}/hello" "${BUILD_DIR}/hello.bin"
+for prog in ${PROGRAMS}; do
+    echo "Building ${prog}..."
+    ${CC} ${CFLAGS} -c "${USERLAND_DIR}/${prog}.c" -o "${BUILD_DIR}/${prog}.o"
+    ${LD} ${LDFLAGS} -Ttext=0xf000 "${BUILD_DIR}/lib/crt0.o" "${BUILD_DIR}/${prog}.o" \
+        "${BUILD_DIR}/lib/libc.a" -o "${BUILD_DIR}/${prog}"
+    ${OBJCOPY} -O binary "${BUILD_DIR}/${prog}" "${BUILD_DIR}/${prog}.bin"
+done
+
+# Benchmarks in bench/ also link the shared reporting code and libml
+${CC} ${CFLAGS} -c "${USERLAND_DIR}/bench/bench.c" -o "${BUILD_DIR}/bench.o"
+for prog in ${BENCHES}; do
+    echo "Building ${prog}..."
+    ${CC} ${CFLAGS} -I${ML_DIR}/include -c "${USERLAND_DIR}/bench/${prog}.c" -o "${BUILD_DIR}/${prog}.o"
+    ${LD} ${LDFLAGS} -Ttext=0xf000 "${BUILD_DIR}/lib/crt0.o" "${BUILD_DIR}/${prog}.o" \
+        "${BUILD_DIR}/bench.o" "${BUILD_DIR}/ml/libml.a" "${BUILD_DIR}/lib/libc.a" -o "${BUILD_DIR}/${prog}"
+done
 
 echo "Userland programs built successfully!"
 ls -lh "${BUILD_DIR}/"
@@ -0,0 +1,60 @@
+/*
+ * Floating-Point and Vector State for RISC-V
+ * ThunderOS - RISC-V Operating System
+ *
+ * User processes may use the F/D registers and, when the hart has the V
+ * extension, the vector registers. The kernel itself uses neither, so the
+ * registers are switched lazily: they are saved only when sstatus says the
+ * running process changed them, and loaded only when the next process is
+ * not the one whose values they already hold.
+ */
+
+#ifndef ARCH_FPU_H
+#define ARCH_FPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* sstatus.FS and sstatus.VS: Off, Initial, Clean or Dirty */
+#define SSTATUS_FS          (3UL << 13)
+#define SSTATUS_FS_INITIAL  (1UL << 13)
+#define SSTATUS_FS_CLEAN    (2UL << 13)
+#define SSTATUS_FS_DIRTY    (3UL << 13)
+#define SSTATUS_VS          (3UL << 9)
+#define SSTATUS_VS_INITIAL  (1UL << 9)
+#define SSTATUS_VS_CLEAN    (2UL << 9)
+#define SSTATUS_VS_DIRTY    (3UL << 9)
+
+/* Extension bits reported by SYS_GETHWCAP, one per ISA letter */
+#define HWCAP_ISA(letter)   (1UL << ((letter) - 'a'))
+
+/* Vector save area header, followed by the 32 registers */
+#define FPU_VECTOR_HEADER   32
+
+/* Per-process floating-point and vector registers */
+struct fpu_state {
+    uint64_t f[32];                     /* f0-f31 */
+    uint64_t fcsr;
+    void *vector;                       /* vstart, vl, vtype, vcsr, v0-v31 */
+    int enabled;                        /* Process may use FP/V (user processes) */
+};
+
+struct process;
+
+/* Public API */
+void fpu_init(void);
+int fpu_has_vector(void);
+size_t fpu_vector_bytes(void);
+unsigned long fpu_hwcap(void);
+unsigned long fpu_user_sstatus(void);
+int fpu_state_init(struct fpu_state *state);
+void fpu_state_free(struct fpu_state *state);
+void fpu_switch(struct process *prev, struct process *next);
+
+/* Register save/restore (fpu.S); each sets sstatus.FS or VS to Dirty */
+void fpu_save_fp(struct fpu_state *state);
+void fpu_restore_fp(const struct fpu_state *state);
+void fpu_save_vector(void *area);
+void fpu_restore_vector(const void *area);
+
+#endif // ARCH_FPU_H
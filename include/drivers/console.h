@@ -0,0 +1,53 @@
+/**
+ * Console Input
+ * 
+ * Characters typed on the UART are collected by its receive interrupt
+ * into a small buffer, so a process can sleep until input arrives and
+ * poll the console like any other descriptor.
+ */
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+#include <kernel/poll.h>
+
+/* Characters buffered before further input is dropped */
+#define CONSOLE_INPUT_SIZE 256
+
+/**
+ * Start taking input by interrupt
+ * 
+ * Call once interrupts and the trap handler are set up.
+ */
+void console_init(void);
+
+/**
+ * Read typed characters
+ * 
+ * Waits until at least one character is buffered, then returns as many
+ * as are there, up to size.
+ * 
+ * @param buffer Buffer to fill
+ * @param size Size of buffer
+ * @param nonblock Fail with EAGAIN instead of waiting
+ * @return Number of characters read, or -1 on error
+ */
+int console_read(char *buffer, uint32_t size, int nonblock);
+
+/**
+ * Read one typed character, waiting for it
+ * 
+ * @return Character read
+ */
+char console_getc(void);
+
+/**
+ * Poll operation of the console input
+ * 
+ * @param pt Table to hook the input queue into, or NULL
+ * @return POLLIN when input is buffered, else 0
+ */
+uint32_t console_poll(poll_table_t *pt);
+
+#endif /* CONSOLE_H */
@@ -0,0 +1,203 @@
+/**
+ * VirtIO MMIO Transport and Split Virtqueues
+ * 
+ * Register layout of virtio-mmio devices and the virtqueue code shared by
+ * the block and network drivers. A driver owns its queues; these helpers
+ * only manage the rings and the free descriptor list.
+ * 
+ * Reference: VirtIO Specification 1.1
+ */
+
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* VirtIO MMIO Register Offsets (from base address) */
+#define VIRTIO_MMIO_MAGIC_VALUE         0x000  // Magic value ('virt')
+#define VIRTIO_MMIO_VERSION             0x004  // Device version
+#define VIRTIO_MMIO_DEVICE_ID           0x008  // Device type (2 = block)
+#define VIRTIO_MMIO_VENDOR_ID           0x00c  // Vendor ID
+#define VIRTIO_MMIO_DEVICE_FEATURES     0x010  // Device features
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014  // Device features selector
+#define VIRTIO_MMIO_DRIVER_FEATURES     0x020  // Driver features
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024  // Driver features selector
+#define VIRTIO_MMIO_QUEUE_SEL           0x030  // Queue selector
+#define VIRTIO_MMIO_QUEUE_NUM_MAX       0x034  // Maximum queue size
+#define VIRTIO_MMIO_QUEUE_NUM           0x038  // Queue size
+#define VIRTIO_MMIO_QUEUE_READY         0x044  // Queue ready
+#define VIRTIO_MMIO_QUEUE_NOTIFY        0x050  // Queue notify
+#define VIRTIO_MMIO_INTERRUPT_STATUS    0x060  // Interrupt status
+#define VIRTIO_MMIO_INTERRUPT_ACK       0x064  // Interrupt acknowledge
+#define VIRTIO_MMIO_STATUS              0x070  // Device status
+#define VIRTIO_MMIO_QUEUE_DESC_LOW      0x080  // Queue descriptor address (low)
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH     0x084  // Queue descriptor address (high)
+#define VIRTIO_MMIO_QUEUE_AVAIL_LOW     0x090  // Available ring address (low)
+#define VIRTIO_MMIO_QUEUE_AVAIL_HIGH    0x094  // Available ring address (high)
+#define VIRTIO_MMIO_QUEUE_USED_LOW      0x0a0  // Used ring address (low)
+#define VIRTIO_MMIO_QUEUE_USED_HIGH     0x0a4  // Used ring address (high)
+#define VIRTIO_MMIO_CONFIG_GENERATION   0x0fc  // Configuration generation
+#define VIRTIO_MMIO_CONFIG              0x100  // Device-specific configuration
+
+/* VirtIO Magic Value */
+#define VIRTIO_MAGIC                    0x74726976  // 'virt' in little-endian
+
+/* VirtIO Device IDs */
+#define VIRTIO_DEVICE_ID_NET            1
+#define VIRTIO_DEVICE_ID_BLOCK          2
+
+/* VirtIO Status Bits */
+#define VIRTIO_STATUS_ACKNOWLEDGE       (1 << 0)  // Guest OS has noticed device
+#define VIRTIO_STATUS_DRIVER            (1 << 1)  // Guest OS knows how to drive device
+#define VIRTIO_STATUS_DRIVER_OK         (1 << 2)  // Driver is ready
+#define VIRTIO_STATUS_FEATURES_OK       (1 << 3)  // Features negotiated successfully
+#define VIRTIO_STATUS_DEVICE_NEEDS_RESET (1 << 6) // Device experienced error
+#define VIRTIO_STATUS_FAILED            (1 << 7)  // Fatal error occurred
+
+/* Device-independent feature bits */
+#define VIRTIO_F_VERSION_1              (1ULL << 32) // Complies with VirtIO 1.0+
+
+/* VirtIO Descriptor Flags */
+#define VIRTQ_DESC_F_NEXT               1         // This descriptor continues
+#define VIRTQ_DESC_F_WRITE              2         // Write-only (device writes)
+#define VIRTQ_DESC_F_INDIRECT           4         // Indirect descriptor
+
+/* VirtIO Used Ring Flags */
+#define VIRTQ_USED_F_NO_NOTIFY          1         // Don't notify when buffer added
+
+/* VirtIO Available Ring Flags */
+#define VIRTQ_AVAIL_F_NO_INTERRUPT      1         // Don't interrupt when buffer used
+
+/**
+ * VirtQueue Descriptor
+ * Describes a single buffer in the virtqueue
+ */
+typedef struct {
+    uint64_t addr;              // Physical address
+    uint32_t len;               // Length
+    uint16_t flags;             // Flags (VIRTQ_DESC_F_*)
+    uint16_t next;              // Next descriptor index (if NEXT flag set)
+} __attribute__((packed)) virtq_desc_t;
+
+/**
+ * VirtQueue Available Ring
+ * Written by driver, read by device
+ */
+typedef struct {
+    uint16_t flags;             // Flags (VIRTQ_AVAIL_F_*)
+    uint16_t idx;               // Index of next available descriptor
+    uint16_t ring[];            // Available descriptor indices (size = queue_size)
+    // Note: 'used_event' follows ring[], at ring[queue_size]
+} __attribute__((packed)) virtq_avail_t;
+
+/**
+ * VirtQueue Used Element
+ * Single element in the used ring
+ */
+typedef struct {
+    uint32_t id;                // Descriptor chain head index
+    uint32_t len;               // Total bytes written to buffer
+} __attribute__((packed)) virtq_used_elem_t;
+
+/**
+ * VirtQueue Used Ring
+ * Written by device, read by driver
+ */
+typedef struct {
+    uint16_t flags;             // Flags (VIRTQ_USED_F_*)
+    uint16_t idx;               // Index of next used descriptor
+    virtq_used_elem_t ring[];   // Used descriptor elements (size = queue_size)
+    // Note: 'avail_event' follows ring[], at ring[queue_size]
+} __attribute__((packed)) virtq_used_t;
+
+/**
+ * VirtQueue
+ * Complete virtqueue structure with descriptor, available, and used rings
+ */
+typedef struct {
+    uint32_t queue_size;        // Number of descriptors
+    uint16_t last_seen_used;    // Last used index we've seen
+    
+    // DMA-allocated rings
+    virtq_desc_t *desc;         // Descriptor ring
+    virtq_avail_t *avail;       // Available ring
+    virtq_used_t *used;         // Used ring
+    
+    // Physical addresses for device
+    uintptr_t desc_phys;
+    uintptr_t avail_phys;
+    uintptr_t used_phys;
+    
+    // Free descriptor tracking
+    uint16_t free_head;         // Head of free descriptor list
+    uint16_t num_free;          // Number of free descriptors
+} virtqueue_t;
+
+/* Helper macros for MMIO register access */
+#define VIRTIO_READ32(dev, offset) \
+    (*((volatile uint32_t *)((dev)->base_addr + (offset))))
+
+#define VIRTIO_WRITE32(dev, offset, value) \
+    (*((volatile uint32_t *)((dev)->base_addr + (offset))) = (value))
+
+/**
+ * Allocate the rings of a virtqueue and hand them to the device
+ * @param base_addr MMIO base address of the device
+ * @param queue_idx Queue to set up
+ * @param vq Virtqueue to initialize
+ * @param queue_size Number of descriptors (power of 2)
+ * @return 0 on success, negative on error
+ */
+int virtqueue_init(uintptr_t base_addr, uint32_t queue_idx, virtqueue_t *vq,
+                   uint32_t queue_size);
+
+/**
+ * Allocate a chain of descriptors from the free list
+ * The descriptors stay linked through their next fields.
+ * @param vq Virtqueue
+ * @param desc_idx Output: first descriptor of the chain
+ * @param count Number of descriptors
+ * @return 0 on success, negative (EBUSY) if too few are free
+ */
+int virtqueue_alloc_desc_chain(virtqueue_t *vq, uint16_t *desc_idx, uint32_t count);
+
+/**
+ * Return a descriptor chain to the free list
+ * @param vq Virtqueue
+ * @param desc_idx First descriptor of the chain
+ */
+void virtqueue_free_desc_chain(virtqueue_t *vq, uint16_t desc_idx);
+
+/**
+ * Make a descriptor chain available to the device
+ * The device is not told; see virtqueue_notify().
+ * @param vq Virtqueue
+ * @param desc_idx First descriptor of the chain
+ */
+void virtqueue_add_to_avail(virtqueue_t *vq, uint16_t desc_idx);
+
+/**
+ * Take the next chain the device has finished with
+ * @param vq Virtqueue
+ * @param desc_idx Output: first descriptor of the chain
+ * @param len Output: bytes the device wrote
+ * @return 0 if a chain was taken, -1 if there is none
+ */
+int virtqueue_get_used_buf(virtqueue_t *vq, uint16_t *desc_idx, uint32_t *len);
+
+/**
+ * Check whether the device has finished with any chain not yet taken
+ * @param vq Virtqueue
+ * @return 1 if virtqueue_get_used_buf() would succeed, else 0
+ */
+int virtqueue_has_used(virtqueue_t *vq);
+
+/**
+ * Tell the device that a queue has new available chains
+ * @param base_addr MMIO base address of the device
+ * @param queue_idx Queue to notify
+ */
+void virtqueue_notify(uintptr_t base_addr, uint32_t queue_idx);
+
+#endif /* VIRTIO_H */
@@ -12,46 +12,8 @@
 
 #include <stdint.h>
 #include <stddef.h>
-
-/* VirtIO MMIO Register Offsets (from base address) */
-#define VIRTIO_MMIO_MAGIC_VALUE         0x000  // Magic value ('virt')
-#define VIRTIO_MMIO_VERSION             0x004  // Device version
-#define VIRTIO_MMIO_DEVICE_ID           0x008  // Device type (2 = block)
-#define VIRTIO_MMIO_VENDOR_ID           0x00c  // Vendor ID
-#define VIRTIO_MMIO_DEVICE_FEATURES     0x010  // Device features
-#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014  // Device features selector
-#define VIRTIO_MMIO_DRIVER_FEATURES     0x020  // Driver features
-#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024  // Driver features selector
-#define VIRTIO_MMIO_QUEUE_SEL           0x030  // Queue selector
-#define VIRTIO_MMIO_QUEUE_NUM_MAX       0x034  // Maximum queue size
-#define VIRTIO_MMIO_QUEUE_NUM           0x038  // Queue size
-#define VIRTIO_MMIO_QUEUE_READY         0x044  // Queue ready
-#define VIRTIO_MMIO_QUEUE_NOTIFY        0x050  // Queue notify
-#define VIRTIO_MMIO_INTERRUPT_STATUS    0x060  // Interrupt status
-#define VIRTIO_MMIO_INTERRUPT_ACK       0x064  // Interrupt acknowledge
-#define VIRTIO_MMIO_STATUS              0x070  // Device status
-#define VIRTIO_MMIO_QUEUE_DESC_LOW      0x080  // Queue descriptor address (low)
-#define VIRTIO_MMIO_QUEUE_DESC_HIGH     0x084  // Queue descriptor address (high)
-#define VIRTIO_MMIO_QUEUE_AVAIL_LOW     0x090  // Available ring address (low)
-#define VIRTIO_MMIO_QUEUE_AVAIL_HIGH    0x094  // Available ring address (high)
-#define VIRTIO_MMIO_QUEUE_USED_LOW      0x0a0  // Used ring address (low)
-#define VIRTIO_MMIO_QUEUE_USED_HIGH     0x0a4  // Used ring address (high)
-#define VIRTIO_MMIO_CONFIG_GENERATION   0x0fc  // Configuration generation
-#define VIRTIO_MMIO_CONFIG              0x100  // Device-specific configuration
-
-/* VirtIO Magic Value */
-#define VIRTIO_MAGIC                    0x74726976  // 'virt' in little-endian
-
-/* VirtIO Device IDs */
-#define VIRTIO_DEVICE_ID_BLOCK          2
-
-/* VirtIO Status Bits */
-#define VIRTIO_STATUS_ACKNOWLEDGE       (1 << 0)  // Guest OS has noticed device
-#define VIRTIO_STATUS_DRIVER            (1 << 1)  // Guest OS knows how to drive device
-#define VIRTIO_STATUS_DRIVER_OK         (1 << 2)  // Driver is ready
-#define VIRTIO_STATUS_FEATURES_OK       (1 << 3)  // Features negotiated successfully
-#define VIRTIO_STATUS_DEVICE_NEEDS_RESET (1 << 6) // Device experienced error
-#define VIRTIO_STATUS_FAILED            (1 << 7)  // Fatal error occurred
+#include <mm/dma.h>
+#include <drivers/virtio.h>
 
 /* VirtIO Block Device Features */
 #define VIRTIO_BLK_F_SIZE_MAX           (1 << 1)  // Maximum segment size
@@ -62,6 +24,8 @@
 #define VIRTIO_BLK_F_FLUSH              (1 << 9)  // Cache flush command
 #define VIRTIO_BLK_F_TOPOLOGY           (1 << 10) // Topology information
 #define VIRTIO_BLK_F_CONFIG_WCE         (1 << 11) // Write cache enable
+#define VIRTIO_BLK_F_DISCARD            (1 << 13) // Discard command
+#define VIRTIO_BLK_F_WRITE_ZEROES       (1 << 14) // Write zeroes command
 
 /* VirtIO Block Request Types */
 #define VIRTIO_BLK_T_IN                 0         // Read
@@ -75,23 +39,21 @@
 #define VIRTIO_BLK_S_IOERR              1         // I/O error
 #define VIRTIO_BLK_S_UNSUPP             2         // Unsupported operation
 
-/* VirtIO Descriptor Flags */
-#define VIRTQ_DESC_F_NEXT               1         // This descriptor continues
-#define VIRTQ_DESC_F_WRITE              2         // Write-only (device writes)
-#define VIRTQ_DESC_F_INDIRECT           4         // Indirect descriptor
-
-/* VirtIO Used Ring Flags */
-#define VIRTQ_USED_F_NO_NOTIFY          1         // Don't notify when buffer added
-
-/* VirtIO Available Ring Flags */
-#define VIRTQ_AVAIL_F_NO_INTERRUPT      1         // Don't interrupt when buffer used
-
 /* Block device sector size */
 #define VIRTIO_BLK_SECTOR_SIZE          512
 
 /* Default queue size (must be power of 2) */
 #define VIRTIO_BLK_QUEUE_SIZE           128
 
+/* Upper bound on discard/write-zeroes segments sent in one request */
+#define VIRTIO_BLK_MAX_DISCARD_SEG      32
+
+/* Upper bound on data segments sent in one read/write request */
+#define VIRTIO_BLK_MAX_SG               64
+
+/* Block devices the driver keeps track of */
+#define VIRTIO_BLK_MAX_DEVICES          8
+
 /**
  * VirtIO Block Device Configuration Space
  * Located at offset 0x100 from MMIO base
@@ -123,71 +85,6 @@ typedef struct {
     uint8_t unused1[3];
 } __attribute__((packed)) virtio_blk_config_t;
 
-/**
- * VirtQueue Descriptor
- * Describes a single buffer in the virtqueue
- */
-typedef struct {
-    uint64_t addr;              // Physical address
-    uint32_t len;               // Length
-    uint16_t flags;             // Flags (VIRTQ_DESC_F_*)
-    uint16_t next;              // Next descriptor index (if NEXT flag set)
-} __attribute__((packed)) virtq_desc_t;
-
-/**
- * VirtQueue Available Ring
- * Written by driver, read by device
- */
-typedef struct {
-    uint16_t flags;             // Flags (VIRTQ_AVAIL_F_*)
-    uint16_t idx;               // Index of next available descriptor
-    uint16_t ring[];            // Available descriptor indices (size = queue_size)
-    // Note: 'used_event' follows ring[], at ring[queue_size]
-} __attribute__((packed)) virtq_avail_t;
-
-/**
- * VirtQueue Used Element
- * Single element in the used ring
- */
-typedef struct {
-    uint32_t id;                // Descriptor chain head index
-    uint32_t len;               // Total bytes written to buffer
-} __attribute__((packed)) virtq_used_elem_t;
-
-/**
- * VirtQueue Used Ring
- * Written by device, read by driver
- */
-typedef struct {
-    uint16_t flags;             // Flags (VIRTQ_USED_F_*)
-    uint16_t idx;               // Index of next used descriptor
-    virtq_used_elem_t ring[];   // Used descriptor elements (size = queue_size)
-    // Note: 'avail_event' follows ring[], at ring[queue_size]
-} __attribute__((packed)) virtq_used_t;
-
-/**
- * VirtQueue
- * Complete virtqueue structure with descriptor, available, and used rings
- */
-typedef struct {
-    uint32_t queue_size;        // Number of descriptors
-    uint16_t last_seen_used;    // Last used index we've seen
-    
-    // DMA-allocated rings
-    virtq_desc_t *desc;         // Descriptor ring
-    virtq_avail_t *avail;       // Available ring
-    virtq_used_t *used;         // Used ring
-    
-    // Physical addresses for device
-    uintptr_t desc_phys;
-    uintptr_t avail_phys;
-    uintptr_t used_phys;
-    
-    // Free descriptor tracking
-    uint16_t free_head;         // Head of free descriptor list
-    uint16_t num_free;          // Number of free descriptors
-} virtqueue_t;
-
 /**
  * VirtIO Block Request Header
  * Sent to device for each I/O operation
@@ -198,6 +95,16 @@ typedef struct {
     uint64_t sector;            // First sector to read/write
 } __attribute__((packed)) virtio_blk_req_header_t;
 
+/**
+ * VirtIO Block Discard Segment
+ * Payload of VIRTIO_BLK_T_DISCARD and VIRTIO_BLK_T_WRITE_ZEROES requests
+ */
+typedef struct {
+    uint64_t sector;            // First sector of the range
+    uint32_t num_sectors;       // Number of sectors
+    uint32_t flags;             // Unmap flag (write zeroes only)
+} __attribute__((packed)) virtio_blk_discard_t;
+
 /**
  * VirtIO Block Request
  * Complete request structure including header, data buffer, and status
@@ -226,6 +133,11 @@ typedef struct {
     uint64_t capacity;          // Capacity in sectors
     uint32_t block_size;        // Block size in bytes
     uint8_t read_only;          // Read-only flag
+    uint32_t max_discard_sectors;   // Largest discard segment (0 if unsupported)
+    uint32_t max_discard_seg;       // Discard segments per request
+    uint32_t max_write_zeroes_sectors;  // Largest write-zeroes segment (0 if unsupported)
+    uint32_t max_write_zeroes_seg;      // Write-zeroes segments per request
+    uint32_t max_sg;            // Data segments per read/write request
     
     // VirtQueue
     virtqueue_t queue;
@@ -240,6 +152,8 @@ typedef struct {
 
 /**
  * Initialize VirtIO block device driver
+ * Each successful call adds a device. The first one becomes the default
+ * device used by the calls without a device argument.
  * @param base_addr MMIO base address of the device
  * @param irq Interrupt number
  * @return 0 on success, negative on error
@@ -255,6 +169,16 @@ int virtio_blk_init(uintptr_t base_addr, uint32_t irq);
  */
 int virtio_blk_read(uint64_t sector, void *buffer, uint32_t count);
 
+/**
+ * Read sectors from a given block device
+ * @param dev Device from virtio_blk_get_device_at()
+ * @param sector Starting sector number
+ * @param buffer Buffer to read into (must be DMA-capable)
+ * @param count Number of sectors to read
+ * @return Number of sectors read, negative on error
+ */
+int virtio_blk_read_dev(virtio_blk_device_t *dev, uint64_t sector, void *buffer, uint32_t count);
+
 /**
  * Write sectors to block device
  * @param sector Starting sector number
@@ -264,12 +188,56 @@ int virtio_blk_read(uint64_t sector, void *buffer, uint32_t count);
  */
 int virtio_blk_write(uint64_t sector, const void *buffer, uint32_t count);
 
+/**
+ * Read sectors into a scatter-gather list
+ * The segments are filled in order, so they may point straight at user
+ * pages (see dma_map_sg()). Their total length must be whole sectors.
+ * @param sector Starting sector number
+ * @param sg Segments to read into
+ * @param nr_sg Number of segments, at most virtio_blk_get_max_sg()
+ * @return Number of sectors read, negative on error
+ */
+int virtio_blk_read_sg(uint64_t sector, const dma_sg_t *sg, uint32_t nr_sg);
+
+/**
+ * Write sectors from a scatter-gather list
+ * @param sector Starting sector number
+ * @param sg Segments to write from
+ * @param nr_sg Number of segments, at most virtio_blk_get_max_sg()
+ * @return Number of sectors written, negative on error
+ */
+int virtio_blk_write_sg(uint64_t sector, const dma_sg_t *sg, uint32_t nr_sg);
+
+/**
+ * Get the number of data segments one read/write request can carry
+ * @return Segments per request, 0 if there is no device
+ */
+uint32_t virtio_blk_get_max_sg(void);
+
 /**
  * Flush device write cache
  * @return 0 on success, negative on error
  */
 int virtio_blk_flush(void);
 
+/**
+ * Discard sector ranges
+ * Ranges are packed into as few requests as the device allows.
+ * Does nothing if the device does not support discard.
+ * @param ranges Sector ranges to discard (flags ignored)
+ * @param count Number of ranges
+ * @return 0 on success, negative on error
+ */
+int virtio_blk_discard(const virtio_blk_discard_t *ranges, uint32_t count);
+
+/**
+ * Zero sectors without transferring data
+ * @param sector Starting sector number
+ * @param count Number of sectors to zero
+ * @return 0 on success, negative on error (EVIRTIO_BADREQ if unsupported)
+ */
+int virtio_blk_write_zeroes(uint64_t sector, uint32_t count);
+
 /**
  * Get device capacity in sectors
  * @return Capacity in 512-byte sectors
@@ -299,4 +267,16 @@ void virtio_blk_irq_handler(void);
  */
 virtio_blk_device_t *virtio_blk_get_device(void);
 
+/**
+ * Get the number of initialized block devices
+ */
+int virtio_blk_device_count(void);
+
+/**
+ * Get an initialized block device
+ * @param index 0 for the default device, then in probe order
+ * @return Pointer to device structure, or NULL if index is out of range
+ */
+virtio_blk_device_t *virtio_blk_get_device_at(int index);
+
 #endif /* VIRTIO_BLK_H */
@@ -0,0 +1,173 @@
+/**
+ * VirtIO Network Device Driver
+ *
+ * Ethernet frames over a virtio-net device (VirtIO 1.0+, MMIO). Receive
+ * buffers are posted ahead of time from a pool of DMA pages. Received
+ * frames are handled by the net-rx kernel process, which polls the device
+ * while frames keep coming and sleeps on the device interrupt when idle.
+ * Transmitted frames are queued without telling the device, which is
+ * notified once per batch.
+ *
+ * Reference: VirtIO Specification 1.1, section 5.1
+ */
+
+#ifndef VIRTIO_NET_H
+#define VIRTIO_NET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mm/dma.h>
+#include <drivers/virtio.h>
+#include <kernel/wait.h>
+
+/* VirtIO Network Device Features */
+#define VIRTIO_NET_F_CSUM               (1ULL << 0)  // Device completes partial checksums
+#define VIRTIO_NET_F_GUEST_CSUM         (1ULL << 1)  // Driver accepts partial checksums
+#define VIRTIO_NET_F_MAC                (1ULL << 5)  // Device has a MAC address
+#define VIRTIO_NET_F_STATUS             (1ULL << 16) // Link status in config space
+
+/* Network header flags */
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM     1         // Checksum at csum_start is partial
+#define VIRTIO_NET_HDR_F_DATA_VALID     2         // Device checked the checksums
+#define VIRTIO_NET_HDR_GSO_NONE         0         // Not a segmentation offload
+
+/* Link status bits */
+#define VIRTIO_NET_S_LINK_UP            1
+
+/* Queues */
+#define VIRTIO_NET_RX_QUEUE             0
+#define VIRTIO_NET_TX_QUEUE             1
+
+/* Default queue size (must be power of 2) */
+#define VIRTIO_NET_QUEUE_SIZE           128
+
+/* Buffer for one frame with its header; two fit in a DMA page */
+#define VIRTIO_NET_BUF_SIZE             2048
+
+/* Largest Ethernet frame without the FCS */
+#define VIRTIO_NET_MAX_FRAME            1514
+
+/* Frames handled per polling pass before other processes get to run */
+#define VIRTIO_NET_NAPI_BUDGET          64
+
+/**
+ * VirtIO Network Device Configuration Space
+ */
+typedef struct {
+    uint8_t mac[6];             // MAC address (VIRTIO_NET_F_MAC)
+    uint16_t status;            // VIRTIO_NET_S_* (VIRTIO_NET_F_STATUS)
+    uint16_t max_virtqueue_pairs;
+    uint16_t mtu;
+} __attribute__((packed)) virtio_net_config_t;
+
+/**
+ * VirtIO Network Header
+ * Precedes every frame in both directions (VirtIO 1.0 layout)
+ */
+typedef struct {
+    uint8_t flags;              // VIRTIO_NET_HDR_F_*
+    uint8_t gso_type;           // VIRTIO_NET_HDR_GSO_*
+    uint16_t hdr_len;           // Header bytes for segmentation offload
+    uint16_t gso_size;          // Segment size for segmentation offload
+    uint16_t csum_start;        // Where checksumming starts
+    uint16_t csum_offset;       // Where the checksum goes, from csum_start
+    uint16_t num_buffers;       // Buffers of a merged receive
+} __attribute__((packed)) virtio_net_hdr_t;
+
+/**
+ * Handler of received frames
+ * @param frame Ethernet frame, valid during the call
+ * @param len Frame length in bytes
+ * @param csum_ok 1 if the device has checked the transport checksum
+ */
+typedef void (*virtio_net_rx_t)(const uint8_t *frame, uint32_t len, int csum_ok);
+
+/**
+ * VirtIO Network Device
+ */
+typedef struct {
+    uintptr_t base_addr;        // MMIO base address
+    uint32_t irq;               // Interrupt number
+    uint64_t features;          // Negotiated features
+    uint8_t mac[6];             // MAC address
+
+    // Queues, with a DMA buffer per descriptor
+    virtqueue_t rx_queue;
+    virtqueue_t tx_queue;
+    uint8_t **rx_bufs;          // Receive buffers, by descriptor
+    uint8_t **tx_bufs;          // Transmit buffers, by descriptor
+    uintptr_t *rx_phys;         // Physical addresses of rx_bufs
+    uintptr_t *tx_phys;         // Physical addresses of tx_bufs
+    uint32_t tx_pending;        // Frames queued since the last notify
+
+    // Receive processing
+    virtio_net_rx_t rx_handler; // Called for each received frame
+    wait_queue_t rx_wait;       // net-rx process, woken by the interrupt
+    struct process *rx_worker;  // net-rx process
+
+    // Statistics
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+    uint64_t rx_interrupts;     // Interrupts that started a polling run
+    uint64_t tx_notifies;       // Device notifications for transmit
+} virtio_net_device_t;
+
+/* Function Prototypes */
+
+/**
+ * Initialize a VirtIO network device
+ * Only one device is supported; later ones are refused.
+ * @param base_addr MMIO base address of the device
+ * @param irq Interrupt number
+ * @return 0 on success, negative on error (EVIRTIO_BADDEV if the device is
+ *         not a network device)
+ */
+int virtio_net_init(uintptr_t base_addr, uint32_t irq);
+
+/**
+ * Start delivering received frames
+ * Creates the net-rx process and enables the receive interrupt.
+ * @param handler Called for each received frame, in the net-rx process
+ * @return 0 on success, negative on error
+ */
+int virtio_net_start(virtio_net_rx_t handler);
+
+/**
+ * Queue a frame for transmission
+ * The frame is copied, so the buffer may be reused at once. The device is
+ * not notified until virtio_net_flush().
+ * @param frame Ethernet frame
+ * @param len Frame length, at most VIRTIO_NET_MAX_FRAME
+ * @param csum_start Offset of the transport header when the device should
+ *                   fill in its checksum, or 0
+ * @param csum_offset Offset of the checksum field in the transport header
+ * @return 0 on success, negative on error (EAGAIN if the ring is full)
+ */
+int virtio_net_xmit(const void *frame, uint32_t len, uint16_t csum_start,
+                    uint16_t csum_offset);
+
+/**
+ * Notify the device of the frames queued since the last call
+ */
+void virtio_net_flush(void);
+
+/**
+ * Check whether the device computes transmit checksums
+ * @return 1 if VIRTIO_NET_F_CSUM was negotiated, else 0
+ */
+int virtio_net_tx_csum(void);
+
+/**
+ * VirtIO network device interrupt handler
+ */
+void virtio_net_irq_handler(void);
+
+/**
+ * Get the VirtIO network device
+ * @return Pointer to device structure, or NULL if not initialized
+ */
+virtio_net_device_t *virtio_net_get_device(void);
+
+#endif /* VIRTIO_NET_H */
@@ -0,0 +1,30 @@
+/*
+ * eventfd.h - Event counters
+ *
+ * An eventfd is a 64-bit counter behind a descriptor. Writing 8 bytes adds
+ * to it and reading 8 bytes takes it, so one process can wake another
+ * through poll() or epoll without a pipe.
+ */
+
+#ifndef EVENTFD_H
+#define EVENTFD_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+
+/* eventfd_open() flags */
+#define EFD_SEMAPHORE 0x1              /* Reads take 1 instead of the whole count */
+#define EFD_NONBLOCK  O_NONBLOCK
+#define EFD_CLOEXEC   O_CLOEXEC
+
+/* Largest value the counter can hold */
+#define EVENTFD_MAX 0xfffffffffffffffeULL
+
+/**
+ * Create an eventfd
+ * The node has type VFS_TYPE_EVENTFD and is freed with its last
+ * descriptor. Returns the descriptor, or -1 on error.
+ */
+int eventfd_open(uint64_t initval, uint32_t flags);
+
+#endif /* EVENTFD_H */
@@ -10,6 +10,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "drivers/virtio_blk.h"
+#include "fs/vfs.h"
+#include "kernel/lock.h"
 
 /* ext2 magic number */
 #define EXT2_SUPER_MAGIC 0xEF53
@@ -130,7 +133,7 @@ typedef struct {
     uint8_t  s_prealloc_dir_blocks; /* Number to preallocate for dirs */
     uint16_t s_padding1;
     
-    /* Journaling support (ext3) - we'll ignore these for now */
+    /* Journaling support (ext3) */
     uint8_t  s_journal_uuid[16];    /* UUID of journal superblock */
     uint32_t s_journal_inum;        /* Inode number of journal file */
     uint32_t s_journal_dev;         /* Device number of journal file */
@@ -174,7 +177,7 @@ typedef struct {
     uint32_t i_block[EXT2_N_BLOCKS]; /* Block pointers */
     uint32_t i_generation;          /* File version (for NFS) */
     uint32_t i_file_acl;            /* File ACL */
-    uint32_t i_dir_acl;             /* Directory ACL */
+    uint32_t i_size_high;           /* Upper 32 bits of i_size (regular files) */
     uint32_t i_faddr;               /* Fragment address */
     uint8_t  i_osd2[12];            /* OS-dependent 2 */
 } __attribute__((packed)) ext2_inode_t;
@@ -191,6 +194,134 @@ typedef struct {
     char     name[EXT2_NAME_LEN];   /* File name (not null-terminated) */
 } __attribute__((packed)) ext2_dirent_t;
 
+/* Read-only compatible feature: some file is 2 GiB or larger */
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE 0x0002
+
+/* Feature flags used by the journal */
+#define EXT3_FEATURE_COMPAT_HAS_JOURNAL 0x0004  /* Journal inode present */
+#define EXT3_FEATURE_INCOMPAT_RECOVER   0x0004  /* Journal may need replay */
+
+/*
+ * JBD journal format (ext3/ext4 compatible)
+ * Every field is stored big-endian. Only 32-bit block numbers and the
+ * CRC32 commit checksum are supported.
+ */
+#define JBD_MAGIC            0xC03B3998U
+#define JBD_DESCRIPTOR_BLOCK 1
+#define JBD_COMMIT_BLOCK     2
+#define JBD_SUPERBLOCK_V1    3
+#define JBD_SUPERBLOCK_V2    4
+#define JBD_REVOKE_BLOCK     5
+
+/* Descriptor tag flags */
+#define JBD_FLAG_ESCAPE    1  /* Block started with JBD_MAGIC, zeroed in the log */
+#define JBD_FLAG_SAME_UUID 2  /* No UUID follows this tag */
+#define JBD_FLAG_DELETED   4  /* Unused */
+#define JBD_FLAG_LAST_TAG  8  /* Last tag in the descriptor block */
+
+/* Journal superblock features */
+#define JBD_FEATURE_COMPAT_CHECKSUM      0x0001  /* CRC32 in commit blocks */
+#define JBD_FEATURE_INCOMPAT_REVOKE      0x0001  /* Revoke blocks in use */
+#define JBD_FEATURE_INCOMPAT_64BIT       0x0002
+#define JBD_FEATURE_INCOMPAT_ASYNC_COMMIT 0x0004 /* Commit block written without a barrier */
+#define JBD_FEATURE_INCOMPAT_CSUM_V2     0x0008
+#define JBD_FEATURE_INCOMPAT_CSUM_V3     0x0010
+
+/* Commit block checksum type */
+#define JBD_CRC32_CHKSUM      1
+#define JBD_CRC32_CHKSUM_SIZE 4
+
+/**
+ * Journal block header
+ * Starts every descriptor, commit, revoke and superblock block.
+ */
+typedef struct {
+    uint32_t h_magic;               /* JBD_MAGIC */
+    uint32_t h_blocktype;           /* JBD_*_BLOCK */
+    uint32_t h_sequence;            /* Transaction ID */
+} __attribute__((packed)) jbd_header_t;
+
+/**
+ * Journal superblock
+ * First block of the journal inode.
+ */
+typedef struct {
+    jbd_header_t s_header;
+    uint32_t s_blocksize;           /* Journal block size */
+    uint32_t s_maxlen;              /* Total journal blocks */
+    uint32_t s_first;               /* First log block */
+    uint32_t s_sequence;            /* First transaction expected in the log */
+    uint32_t s_start;               /* Log block of that transaction, 0 if clean */
+    uint32_t s_errno;               /* Error value set by the kernel */
+    uint32_t s_feature_compat;      /* Compatible features */
+    uint32_t s_feature_incompat;    /* Incompatible features */
+    uint32_t s_feature_ro_compat;   /* Read-only compatible features */
+    uint8_t  s_uuid[16];            /* Journal UUID */
+    uint32_t s_nr_users;            /* Filesystems sharing the journal */
+    uint32_t s_dynsuper;            /* Unused */
+    uint32_t s_max_transaction;     /* Unused */
+    uint32_t s_max_trans_data;      /* Unused */
+} __attribute__((packed)) jbd_superblock_t;
+
+/**
+ * Descriptor block tag
+ * Names the filesystem block that the next log block holds.
+ */
+typedef struct {
+    uint32_t t_blocknr;             /* Filesystem block number */
+    uint16_t t_checksum;            /* Unused without CSUM_V2 */
+    uint16_t t_flags;               /* JBD_FLAG_* */
+} __attribute__((packed)) jbd_block_tag_t;
+
+/**
+ * Commit block
+ */
+typedef struct {
+    jbd_header_t c_header;
+    uint8_t  h_chksum_type;         /* JBD_CRC32_CHKSUM or 0 */
+    uint8_t  h_chksum_size;         /* JBD_CRC32_CHKSUM_SIZE or 0 */
+    uint8_t  h_padding[2];
+    uint32_t h_chksum[8];           /* CRC32 of the transaction in h_chksum[0] */
+    uint64_t h_commit_sec;          /* Commit time */
+    uint32_t h_commit_nsec;
+} __attribute__((packed)) jbd_commit_header_t;
+
+/**
+ * Revoke block header
+ * Followed by 32-bit block numbers that must not be replayed from
+ * this or earlier transactions.
+ */
+typedef struct {
+    jbd_header_t r_header;
+    uint32_t r_count;               /* Bytes used in the block, header included */
+} __attribute__((packed)) jbd_revoke_header_t;
+
+/* Ticks between commits of the running transaction (10 ticks per second) */
+#define EXT2_COMMIT_INTERVAL 50
+
+/* A transaction with this many blocks is committed at the end of the operation */
+#define EXT2_COMMIT_MAX_BLOCKS 128
+
+/* Buffered blocks kept before the log is checkpointed */
+#define EXT2_JOURNAL_MAX_BUFFERS 256
+
+/* Discard ranges held back until the freeing transaction commits */
+#define EXT2_JOURNAL_MAX_DISCARDS 64
+
+struct ext2_journal;
+
+/* Inodes waiting for their blocks to be released by the reclaim worker */
+#define EXT2_RECLAIM_QUEUE_LEN 32
+
+/* Inodes with more blocks than this are released in the background */
+#define EXT2_RECLAIM_MIN_BLOCKS 256
+
+/* Hash buckets of the in-core inode table (power of two) */
+#define EXT2_ICACHE_BUCKETS 64
+
+struct process;
+struct ext2_inode_info;
+
 /**
  * ext2 filesystem context
  * Runtime information for mounted filesystem
@@ -202,9 +333,83 @@ typedef struct {
     uint32_t num_groups;            /* Number of block groups */
     uint32_t inodes_per_block;      /* Inodes that fit in one block */
     uint32_t desc_per_block;        /* Group descriptors per block */
+    uint64_t max_file_size;         /* Largest size a regular file can reach */
+    uint32_t orlov_rotor;           /* Start group for top-level directory search */
     void *device;                   /* Block device handle */
+    yield_lock_t lock;              /* Serializes filesystem operations */
+    struct process *reclaim_worker; /* Background block release, NULL if not started */
+    uint32_t reclaim_queue[EXT2_RECLAIM_QUEUE_LEN]; /* Deleted inodes still holding blocks */
+    volatile uint32_t reclaim_head; /* Next queue slot to release */
+    volatile uint32_t reclaim_tail; /* Next free queue slot */
+    int super_dirty;                /* Free counts changed since last written */
+    struct ext2_journal *journal;   /* Metadata journal, NULL if none */
+    struct process *commit_worker;  /* Periodic commit, NULL if not started */
+    struct ext2_inode_info *icache[EXT2_ICACHE_BUCKETS]; /* In-core inodes by number */
 } ext2_fs_t;
 
+/**
+ * Fragmentation of one file
+ * An extent is a run of data blocks that follow each other on disk.
+ */
+typedef struct {
+    uint32_t data_blocks;           /* Data blocks mapped by the file */
+    uint32_t meta_blocks;           /* Indirect blocks */
+    uint32_t extents;               /* Runs of consecutive data blocks */
+    uint32_t best_extents;          /* Fewest runs the data could fit in */
+} ext2_frag_info_t;
+
+/**
+ * Free space fragmentation of one block group
+ */
+typedef struct {
+    uint32_t group;                 /* Group to report (set by the caller) */
+    uint32_t groups;                /* Number of groups in the filesystem */
+    uint32_t free_blocks;           /* Free blocks in the group's bitmap */
+    uint32_t free_extents;          /* Runs of free blocks */
+    uint32_t largest_free;          /* Longest run of free blocks */
+} ext2_group_frag_t;
+
+/* ext2 ioctl requests */
+#define EXT2_IOC_GETFRAG    VFS_IOC(0x6601, sizeof(ext2_frag_info_t))   /* Report a file */
+#define EXT2_IOC_GROUPFRAG  VFS_IOC(0x6602, sizeof(ext2_group_frag_t))  /* Report a group */
+#define EXT2_IOC_DEFRAG     VFS_IOC(0x6603, sizeof(ext2_frag_info_t))   /* Move a file, report the result */
+
+/* Maximum number of dirty blocks buffered per file before write-back */
+#define EXT2_DELALLOC_MAX_BLOCKS 64
+
+/* Maximum number of consecutive blocks fetched by one file read request */
+#define EXT2_READ_CLUSTER_BLOCKS 64
+
+/**
+ * Delayed-allocation run
+ * Contiguous range of file blocks whose data is held in memory and has
+ * no disk blocks assigned yet. Blocks are allocated at write-back, when
+ * the final length of the run is known.
+ */
+typedef struct {
+    uint32_t first_block;           /* First file block in the run */
+    uint32_t nr_blocks;             /* Number of buffered blocks */
+    uint8_t *data;                  /* nr_blocks * block_size bytes, NULL if empty */
+} ext2_delalloc_t;
+
+/**
+ * In-core inode
+ * Pairs the on-disk inode with its number and state that has not been
+ * written back yet. There is one per inode number, found through
+ * fs->icache, and every lookup and open of the inode shares it with its
+ * VFS node, so buffered data and size changes are seen by all of them.
+ */
+typedef struct ext2_inode_info {
+    ext2_inode_t inode;             /* Copy of the on-disk inode */
+    uint32_t ino;                   /* Inode number */
+    int dirty;                      /* Inode needs writing back */
+    int deleted;                    /* Last link removed; on the orphan list */
+    uint32_t opens;                 /* Open files referring to this inode */
+    ext2_delalloc_t delalloc;       /* Buffered data without disk blocks */
+    struct ext2_inode_info *hash_next; /* Next in-core inode in the same bucket */
+    vfs_node_t node;                /* VFS node for the inode */
+} ext2_inode_info_t;
+
 /* Function declarations */
 
 /**
@@ -218,6 +423,17 @@ int ext2_mount(ext2_fs_t *fs, void *device);
  */
 void ext2_unmount(ext2_fs_t *fs);
 
+/**
+ * Acquire the filesystem lock
+ * Yields to other processes while the lock is held.
+ */
+void ext2_lock(ext2_fs_t *fs);
+
+/**
+ * Release the filesystem lock
+ */
+void ext2_unlock(ext2_fs_t *fs);
+
 /**
  * Read an inode from disk
  * Returns 0 on success, -1 on error
@@ -230,13 +446,64 @@ int ext2_read_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode);
  */
 int ext2_write_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode);
 
+/**
+ * Get the in-core inode for an inode number, reading it from disk if it
+ * is not in core yet
+ * Returns the shared in-core inode, or NULL on error
+ */
+ext2_inode_info_t *ext2_icache_get(ext2_fs_t *fs, uint32_t inode_num);
+
+/**
+ * Find the in-core inode for an inode number without reading the disk
+ * Returns NULL if the inode is not in core
+ */
+ext2_inode_info_t *ext2_icache_find(ext2_fs_t *fs, uint32_t inode_num);
+
+/**
+ * Take an in-core inode out of the table and free it, dropping buffered data
+ * No file may have it open.
+ */
+void ext2_icache_remove(ext2_fs_t *fs, ext2_inode_info_t *info);
+
+/**
+ * Size of a file in bytes
+ * Regular files keep the upper half in i_size_high.
+ */
+uint64_t ext2_inode_size(const ext2_inode_t *inode);
+
+/**
+ * Set the size of a file
+ * Sets the LARGE_FILE feature the first time a file reaches 2 GiB.
+ */
+void ext2_inode_set_size(ext2_fs_t *fs, ext2_inode_t *inode, uint64_t size);
+
 /**
  * Read data from a file
  * Returns number of bytes read, or -1 on error
  */
-int ext2_read_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset, 
+int ext2_read_file(ext2_fs_t *fs, ext2_inode_t *inode, uint64_t offset, 
                    void *buffer, uint32_t size);
 
+/**
+ * Read consecutive blocks from disk in a single request
+ * Returns 0 on success, -1 on error
+ */
+int ext2_read_blocks(ext2_fs_t *fs, uint32_t block_num, uint32_t count, void *buffer);
+
+/**
+ * Map a file block index to a disk block number
+ * Returns block number, or 0 for a hole or on error
+ */
+uint32_t ext2_bmap(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t file_block);
+
+/**
+ * Find the i_block[] tree that maps a file block
+ * Sets *depth to its levels of indirect blocks (0 for a direct block) and
+ * *index to the block's position inside the tree.
+ * Returns the i_block[] slot, or -1 if the block is past the triple-indirect tree
+ */
+int ext2_block_tree(ext2_fs_t *fs, uint32_t file_block, uint32_t *depth, uint32_t *index);
+
 /**
  * Lookup a file in a directory by name
  * Returns inode number on success, 0 if not found
@@ -251,6 +518,18 @@ uint32_t ext2_lookup(ext2_fs_t *fs, ext2_inode_t *dir_inode, const char *name);
 typedef void (*ext2_dir_callback_t)(const char *name, uint32_t inode, uint8_t type);
 int ext2_list_dir(ext2_fs_t *fs, ext2_inode_t *dir_inode, ext2_dir_callback_t callback);
 
+/**
+ * Read directory entries starting at a byte offset
+ * Reads one block at a time and calls fill for each entry; name is not
+ * NUL-terminated. fill returns non-zero to stop before an entry. On
+ * return *offset is where the next call resumes.
+ * Returns 0 on success, -1 on error
+ */
+typedef int (*ext2_dir_fill_t)(void *ctx, const char *name, uint32_t name_len,
+                               uint32_t inode, uint8_t type);
+int ext2_read_dir(ext2_fs_t *fs, ext2_inode_t *dir_inode, uint32_t *offset,
+                  ext2_dir_fill_t fill, void *ctx);
+
 /* Write operations */
 
 /**
@@ -259,6 +538,12 @@ int ext2_list_dir(ext2_fs_t *fs, ext2_inode_t *dir_inode, ext2_dir_callback_t ca
  */
 uint32_t ext2_alloc_block(ext2_fs_t *fs, uint32_t group);
 
+/**
+ * Allocate a contiguous run of up to count blocks, starting near goal
+ * Returns first block of the run (with *allocated set), or 0 on failure
+ */
+uint32_t ext2_alloc_blocks(ext2_fs_t *fs, uint32_t goal, uint32_t count, uint32_t *allocated);
+
 /**
  * Free a block to block bitmap
  * Returns 0 on success, -1 on error
@@ -271,6 +556,18 @@ int ext2_free_block(ext2_fs_t *fs, uint32_t block_num);
  */
 uint32_t ext2_alloc_inode(ext2_fs_t *fs, uint32_t group);
 
+/**
+ * Choose the block group for a new inode (Orlov-style placement)
+ * Returns group number
+ */
+uint32_t ext2_find_inode_group(ext2_fs_t *fs, uint32_t parent_inode_num, int is_dir);
+
+/**
+ * Allocation goal for data of an inode: first block of the inode's group
+ * Returns block number, or 0 if the inode number is invalid
+ */
+uint32_t ext2_inode_block_goal(ext2_fs_t *fs, uint32_t inode_num);
+
 /**
  * Free an inode to inode bitmap
  * Returns 0 on success, -1 on error
@@ -281,9 +578,234 @@ int ext2_free_inode(ext2_fs_t *fs, uint32_t inode_num);
  * Write data to a file
  * Returns number of bytes written, or -1 on error
  */
-int ext2_write_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset,
+int ext2_write_file(ext2_fs_t *fs, ext2_inode_t *inode, uint64_t offset,
                     const void *buffer, uint32_t size);
 
+/**
+ * Write consecutive blocks to disk in a single request
+ * Returns 0 on success, -1 on error
+ */
+int ext2_write_blocks(ext2_fs_t *fs, uint32_t block_num, uint32_t count, const void *buffer);
+
+/**
+ * Map count file blocks to already allocated consecutive disk blocks
+ * Each indirect block on the way is read and written once per call.
+ * *mapped is set to the number of blocks mapped, all of them on success.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_map_blocks(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t file_block,
+                    uint32_t block_num, uint32_t count, uint32_t *mapped);
+
+/* Metadata journal */
+
+/**
+ * Read a metadata block
+ * Returns the journal's copy if the block is buffered in the journal.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_meta_read(ext2_fs_t *fs, uint32_t block_num, void *buffer);
+
+/**
+ * Write a metadata block
+ * With a journal the block joins the running transaction and reaches its
+ * home location after commit; without one it is written in place.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_meta_write(ext2_fs_t *fs, uint32_t block_num, const void *buffer);
+
+/**
+ * Replace blocks just read from disk with their journal copies
+ */
+void ext2_journal_overlay(ext2_fs_t *fs, uint32_t block_num, uint32_t count, void *buffer);
+
+/**
+ * Drop a freed block from the journal so it is not written back or replayed
+ */
+void ext2_journal_forget(ext2_fs_t *fs, uint32_t block_num);
+
+/**
+ * Note that blocks are about to be freed in a block bitmap
+ * Blocks freed by the running transaction are not reused until it commits.
+ */
+void ext2_journal_freeing(ext2_fs_t *fs, uint32_t bitmap_block, const uint8_t *bitmap);
+
+/**
+ * Mark blocks freed by the running transaction as in use in a copy of
+ * their bitmap, for the allocator's search
+ * Returns 1 if bitmap was changed, 0 otherwise
+ */
+int ext2_journal_mask_freed(ext2_fs_t *fs, uint32_t bitmap_block, uint8_t *bitmap);
+
+/**
+ * Discard freed blocks, once the transaction that freed them has committed
+ */
+void ext2_discard(ext2_fs_t *fs, const virtio_blk_discard_t *ranges, uint32_t count);
+
+/**
+ * Load the journal named by the superblock, replaying it if needed
+ * Called by ext2_mount(). A filesystem without a journal is left as is.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_journal_load(ext2_fs_t *fs);
+
+/**
+ * Commit the running transaction and checkpoint the log
+ * Leaves the journal empty and marked clean. Called by ext2_unmount().
+ */
+void ext2_journal_destroy(ext2_fs_t *fs);
+
+/**
+ * Decide whether to commit at the end of a filesystem operation
+ * Commits, and checkpoints if needed, so the next operation has half the
+ * log to itself. Called with the filesystem lock held, from ext2_unlock().
+ */
+void ext2_journal_op_end(ext2_fs_t *fs);
+
+/**
+ * Make all completed operations durable
+ * Commits the running transaction, or writes the superblock and group
+ * descriptors in place when there is no journal. Lock must be held.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_commit(ext2_fs_t *fs);
+
+/**
+ * Lock the filesystem and make all completed operations durable
+ * Returns 0 on success, -1 on error
+ */
+int ext2_sync(ext2_fs_t *fs);
+
+/**
+ * Start the worker that commits the running transaction periodically
+ */
+void ext2_commit_start(ext2_fs_t *fs);
+
+/* Delayed allocation */
+
+/**
+ * Write data to a file, deferring block allocation for new blocks
+ * Returns number of bytes written, or -1 on error
+ */
+int ext2_delalloc_write(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t offset,
+                        const void *buffer, uint32_t size);
+
+/**
+ * Read data from a file, including data not yet written back
+ * Returns number of bytes read, or -1 on error
+ */
+int ext2_delalloc_read(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t offset,
+                       void *buffer, uint32_t size);
+
+/**
+ * Allocate blocks for buffered data, write it out and update the inode
+ * Blocks that could not be placed stay buffered for the next attempt.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_delalloc_flush(ext2_fs_t *fs, ext2_inode_info_t *info);
+
+/**
+ * Throw away buffered data without writing it
+ */
+void ext2_delalloc_drop(ext2_inode_info_t *info);
+
+/**
+ * Pick an allocation goal for a run of new blocks starting at file_block
+ * Returns the block after the previous file block, or a block in the
+ * inode's group.
+ */
+uint32_t ext2_delalloc_goal(ext2_fs_t *fs, ext2_inode_info_t *info, uint32_t file_block);
+
+/**
+ * Read (write == 0) or write whole blocks between a file and a buffer
+ * without copying through the kernel (O_DIRECT)
+ * offset and size must be multiples of the block size. Reads stop at the
+ * end of the file; writes into holes allocate blocks.
+ * Returns number of bytes transferred, or -1 on error
+ */
+int ext2_direct_io(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t offset,
+                   void *buffer, uint32_t size, int write);
+
+/**
+ * Reserve zeroed disk blocks for a byte range of a file
+ * Extends i_size to cover the range unless keep_size is set.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_fallocate(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t offset, uint64_t len,
+                   int keep_size);
+
+/* Block release */
+
+/**
+ * Change the size of a file, releasing blocks past the new end
+ * Returns 0 on success, -1 on error
+ */
+int ext2_truncate(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t size);
+
+/**
+ * Release all blocks of an inode from file block from onwards
+ * Updates i_block[] and i_blocks; the caller writes the inode.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_truncate_blocks(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t from);
+
+/**
+ * Release an inode whose link count has dropped to zero
+ * Large inodes are queued for the reclaim worker.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_release_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode);
+
+/**
+ * Drop the last link of an inode
+ * An inode that files still have open goes on the orphan list and keeps
+ * its blocks until ext2_orphan_release(); any other is released now.
+ * inode is the on-disk copy when the inode is not in core.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_unlink_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode);
+
+/**
+ * Release an orphan inode after its last open file is closed
+ * Frees the in-core inode as well.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_orphan_release(ext2_fs_t *fs, ext2_inode_info_t *info);
+
+/**
+ * Release the inodes left on the orphan list by an unclean shutdown
+ * Returns 0 on success, -1 on error
+ */
+int ext2_orphan_cleanup(ext2_fs_t *fs);
+
+/**
+ * Start the background worker that releases large deleted inodes
+ * Without it, all inodes are released inline.
+ */
+void ext2_reclaim_start(ext2_fs_t *fs);
+
+/* Defragmentation */
+
+/**
+ * Measure the fragmentation of a file's data
+ * Returns 0 on success, -1 on error
+ */
+int ext2_frag_info(ext2_fs_t *fs, ext2_inode_t *inode, ext2_frag_info_t *info);
+
+/**
+ * Measure the free space fragmentation of a block group
+ * Returns 0 on success, -1 on error
+ */
+int ext2_group_frag(ext2_fs_t *fs, uint32_t group, ext2_group_frag_t *frag);
+
+/**
+ * Move a regular file's data into as few runs of blocks as free space
+ * allows, swapping the block map in one inode write
+ * Files already in their fewest runs, or that no free space would
+ * improve, are left alone. *result describes the file afterwards.
+ * Returns 0 on success, -1 on error
+ */
+int ext2_defrag(ext2_fs_t *fs, ext2_inode_info_t *info, ext2_frag_info_t *result);
+
 /**
  * Create a new file in a directory
  * Returns inode number on success, 0 on error
@@ -0,0 +1,35 @@
+/*
+ * initramfs.h - Boot-time archive unpacker
+ *
+ * Unpacks a "newc" cpio archive (cpio -H newc, magic 070701) into the
+ * VFS, normally onto a tmpfs mounted as the root filesystem.
+ */
+
+#ifndef INITRAMFS_H
+#define INITRAMFS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Header magic of a newc archive member */
+#define INITRAMFS_MAGIC "070701"
+
+/* Name of the member that ends the archive */
+#define INITRAMFS_TRAILER "TRAILER!!!"
+
+/* File type bits of c_mode */
+#define INITRAMFS_S_IFMT  0170000
+#define INITRAMFS_S_IFDIR 0040000
+#define INITRAMFS_S_IFREG 0100000
+
+/**
+ * Unpack a newc cpio archive into the VFS
+ * Member names are taken relative to "/". Directories and regular files
+ * are created; other member types are skipped. Missing parent directories
+ * are created as needed and existing files are overwritten.
+ * Returns the number of members created, or -1 if the archive is
+ * malformed or a member could not be written.
+ */
+int initramfs_unpack(const void *archive, size_t size);
+
+#endif /* INITRAMFS_H */
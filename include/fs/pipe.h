@@ -0,0 +1,66 @@
+/*
+ * pipe.h - Pipes
+ *
+ * A pipe is a ring of page buffers between a read end and a write end.
+ * Readers sleep while it is empty and writers while it is full. Whole
+ * pages can be filled from a file, drained into a file or moved to another
+ * pipe without passing through user memory (splice).
+ */
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+
+/* Page buffers in a pipe's ring, so a pipe holds up to 64 KiB */
+#define PIPE_BUFFERS 16
+
+/* Writes of at most this many bytes are never interleaved with others */
+#define PIPE_BUF 4096
+
+/**
+ * Moves data between a pipe page and the other side of a splice
+ * Returns the bytes moved (a short count ends the splice), or -1 on error.
+ */
+typedef int (*pipe_actor_t)(void *ctx, void *data, uint32_t len);
+
+/**
+ * Create a pipe
+ * flags may contain O_NONBLOCK. On success *read_end and *write_end are
+ * nodes of type VFS_TYPE_PIPE; the pipe is freed when both have been
+ * closed through their close operation.
+ * Returns 0 on success, -1 on error.
+ */
+int pipe_create(vfs_node_t **read_end, vfs_node_t **write_end, uint32_t flags);
+
+/**
+ * Read from or write to a pipe through a buffer list
+ * Used by vmsplice, which chooses blocking per call. Returns the bytes
+ * transferred, 0 at end of file, or -1 on error.
+ */
+int pipe_readv(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, int nonblock);
+int pipe_writev(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, int nonblock);
+
+/**
+ * Hand up to len bytes of a pipe's buffers to actor, oldest first
+ * Returns the bytes consumed, 0 at end of file, or -1 on error.
+ */
+int pipe_splice_read(vfs_node_t *node, pipe_actor_t actor, void *ctx, uint32_t len,
+                     int nonblock);
+
+/**
+ * Append up to len bytes to a pipe in fresh pages that actor fills
+ * Returns the bytes added, 0 if actor had nothing, or -1 on error.
+ */
+int pipe_splice_write(vfs_node_t *node, pipe_actor_t actor, void *ctx, uint32_t len,
+                      int nonblock);
+
+/**
+ * Move up to len bytes from one pipe to another
+ * Whole buffers change hands without copying. Returns the bytes moved,
+ * 0 at end of file, or -1 on error.
+ */
+int pipe_splice_pipe(vfs_node_t *in, vfs_node_t *out, uint32_t len, int nonblock);
+
+#endif /* PIPE_H */
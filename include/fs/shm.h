@@ -0,0 +1,43 @@
+/*
+ * shm.h - Shared memory objects
+ *
+ * Named objects (shm_open) and anonymous ones (memfd_create) are files of
+ * a tmpfs that is not mounted anywhere. They are sized with ftruncate and
+ * mapped with mmap(MAP_SHARED); every mapping uses the file's own pages,
+ * so processes see each other's writes without any copy.
+ */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+#include "fs/tmpfs.h"
+
+/* Size limit of all shared memory objects together */
+#define SHM_SIZE (32 * 1024 * 1024)
+
+/* memfd_create flags */
+#define MFD_CLOEXEC 0x0001  /* Open the object with O_CLOEXEC */
+
+/**
+ * Open a named shared memory object
+ * name is one path component with an optional leading '/'. flags are
+ * open flags; O_CREAT makes an empty object. Returns a descriptor, or -1
+ * with errno set.
+ */
+int shm_open(const char *name, uint32_t flags);
+
+/**
+ * Remove the name of a shared memory object
+ * The object lives on while it is open or mapped.
+ */
+int shm_unlink(const char *name);
+
+/**
+ * Create an anonymous shared memory object opened read-write
+ * name is only a label. The object is freed once it is neither open nor
+ * mapped. Returns a descriptor, or -1 with errno set.
+ */
+int memfd_create(const char *name, uint32_t flags);
+
+#endif /* SHM_H */
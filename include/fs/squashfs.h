@@ -0,0 +1,186 @@
+/*
+ * squashfs.h - Read-only compressed filesystem
+ *
+ * Reads squashfs 4.0 images made with "mksquashfs -comp lz4". File data
+ * is stored in LZ4-compressed blocks, and inodes and directories are
+ * packed into compressed 8 KiB metadata blocks. Blocks are decompressed
+ * on demand into small caches.
+ */
+
+#ifndef SQUASHFS_H
+#define SQUASHFS_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+#include "drivers/virtio_blk.h"
+
+/* Superblock */
+#define SQUASHFS_MAGIC          0x73717368  /* "hsqs" */
+#define SQUASHFS_MAJOR          4
+#define SQUASHFS_MIN_BLOCK_LOG  12          /* 4 KiB */
+#define SQUASHFS_MAX_BLOCK_LOG  20          /* 1 MiB */
+
+/* Compressors */
+#define SQUASHFS_COMP_LZ4       5
+
+/* Superblock flags */
+#define SQUASHFS_FLAG_NO_FRAGMENTS  0x0010
+
+/* Metadata blocks: 2-byte header, then up to 8 KiB of data */
+#define SQUASHFS_METADATA_SIZE      8192
+#define SQUASHFS_META_UNCOMPRESSED  0x8000      /* Header flag */
+#define SQUASHFS_META_LENGTH(h)     ((h) & 0x7FFF)
+
+/* Data block sizes in inode block lists and fragment entries */
+#define SQUASHFS_DATA_UNCOMPRESSED  0x01000000
+#define SQUASHFS_DATA_LENGTH(s)     ((s) & 0x00FFFFFF)
+
+/* A regular file without a fragment */
+#define SQUASHFS_INVALID_FRAG   0xFFFFFFFF
+
+/* Inode types */
+#define SQUASHFS_DIR_TYPE       1
+#define SQUASHFS_REG_TYPE       2
+#define SQUASHFS_SYMLINK_TYPE   3
+#define SQUASHFS_LDIR_TYPE      8
+#define SQUASHFS_LREG_TYPE      9
+
+/* Inode references: metadata block offset << 16 | offset inside it */
+#define SQUASHFS_REF_BLOCK(r)   ((uint32_t)((r) >> 16))
+#define SQUASHFS_REF_OFFSET(r)  ((uint32_t)((r) & 0xFFFF))
+
+/* Decompressed blocks kept in memory */
+#define SQUASHFS_META_CACHE     8   /* Metadata blocks */
+#define SQUASHFS_DATA_CACHE     8   /* Data blocks and fragment blocks */
+
+/* Buckets in the table of looked-up inodes (power of two) */
+#define SQUASHFS_NODE_BUCKETS   64
+
+/* Directory the system image is mounted on at boot */
+#define SQUASHFS_MOUNT_POINT    "/usr"
+
+/**
+ * Superblock (at offset 0, 96 bytes)
+ */
+typedef struct {
+    uint32_t s_magic;                  /* SQUASHFS_MAGIC */
+    uint32_t inodes;                   /* Number of inodes */
+    uint32_t mkfs_time;                /* Creation time */
+    uint32_t block_size;               /* Data block size */
+    uint32_t fragments;                /* Number of fragment blocks */
+    uint16_t compression;              /* SQUASHFS_COMP_* */
+    uint16_t block_log;                /* log2(block_size) */
+    uint16_t flags;                    /* SQUASHFS_FLAG_* */
+    uint16_t no_ids;                   /* Entries in the uid/gid table */
+    uint16_t s_major;                  /* SQUASHFS_MAJOR */
+    uint16_t s_minor;
+    uint64_t root_inode;               /* Reference of the root directory */
+    uint64_t bytes_used;               /* Image size */
+    uint64_t id_table_start;
+    uint64_t xattr_id_table_start;
+    uint64_t inode_table_start;
+    uint64_t directory_table_start;
+    uint64_t fragment_table_start;
+    uint64_t lookup_table_start;
+} __attribute__((packed)) squashfs_super_t;
+
+/**
+ * Header common to all inodes
+ */
+typedef struct {
+    uint16_t inode_type;               /* SQUASHFS_*_TYPE */
+    uint16_t mode;
+    uint16_t uid;                      /* Index into the id table */
+    uint16_t guid;
+    uint32_t mtime;
+    uint32_t inode_number;
+} __attribute__((packed)) squashfs_base_inode_t;
+
+/**
+ * Directory inode
+ */
+typedef struct {
+    squashfs_base_inode_t base;
+    uint32_t start_block;              /* Listing block, from directory_table_start */
+    uint32_t nlink;
+    uint16_t file_size;                /* Listing size plus 3 */
+    uint16_t offset;                   /* Listing offset inside its block */
+    uint32_t parent_inode;
+} __attribute__((packed)) squashfs_dir_inode_t;
+
+/**
+ * Extended directory inode (large or indexed directories)
+ */
+typedef struct {
+    squashfs_base_inode_t base;
+    uint32_t nlink;
+    uint32_t file_size;                /* Listing size plus 3 */
+    uint32_t start_block;
+    uint32_t parent_inode;
+    uint16_t i_count;                  /* Index entries that follow */
+    uint16_t offset;
+    uint32_t xattr;
+} __attribute__((packed)) squashfs_ldir_inode_t;
+
+/**
+ * Regular file inode, followed by one size word per full block
+ */
+typedef struct {
+    squashfs_base_inode_t base;
+    uint32_t start_block;              /* Disk offset of the first data block */
+    uint32_t fragment;                 /* Fragment index or SQUASHFS_INVALID_FRAG */
+    uint32_t offset;                   /* Tail offset inside the fragment */
+    uint32_t file_size;
+} __attribute__((packed)) squashfs_reg_inode_t;
+
+/**
+ * Extended regular file inode
+ */
+typedef struct {
+    squashfs_base_inode_t base;
+    uint64_t start_block;
+    uint64_t file_size;
+    uint64_t sparse;                   /* Bytes saved by sparse blocks */
+    uint32_t nlink;
+    uint32_t fragment;
+    uint32_t offset;
+    uint32_t xattr;
+} __attribute__((packed)) squashfs_lreg_inode_t;
+
+/**
+ * Directory listing: a header for a run of entries whose inodes share a
+ * metadata block
+ */
+typedef struct {
+    uint32_t count;                    /* Entries that follow, minus one */
+    uint32_t start_block;              /* Inode block, from inode_table_start */
+    uint32_t inode_number;             /* Base for the entries' numbers */
+} __attribute__((packed)) squashfs_dir_header_t;
+
+/**
+ * Directory listing entry, followed by size + 1 name bytes
+ */
+typedef struct {
+    uint16_t offset;                   /* Inode offset inside its block */
+    int16_t inode_number;              /* Difference from the header's base */
+    uint16_t type;                     /* Basic SQUASHFS_*_TYPE */
+    uint16_t size;                     /* Name length minus one */
+} __attribute__((packed)) squashfs_dir_entry_t;
+
+/**
+ * Fragment table entry
+ */
+typedef struct {
+    uint64_t start_block;              /* Disk offset of the fragment block */
+    uint32_t size;                     /* On-disk size, with SQUASHFS_DATA_UNCOMPRESSED */
+    uint32_t unused;
+} __attribute__((packed)) squashfs_fragment_entry_t;
+
+/**
+ * Mount a squashfs image from a block device
+ * Only LZ4-compressed images are accepted.
+ * Returns a filesystem ready for vfs_mount(), or NULL on error.
+ */
+vfs_filesystem_t *squashfs_mount(virtio_blk_device_t *dev);
+
+#endif /* SQUASHFS_H */
@@ -0,0 +1,33 @@
+/*
+ * tmpfs.h - Memory-backed filesystem
+ *
+ * Files and directories live only in RAM and are lost at reboot. File data
+ * is held in whole pages from the physical memory manager.
+ */
+
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+
+/* Size limit of the tmpfs mounted on /tmp at boot */
+#define TMPFS_DEFAULT_SIZE (16 * 1024 * 1024)
+
+/* Buckets in a new directory hash table (power of two) */
+#define TMPFS_MIN_BUCKETS 8
+
+/* Longest file name */
+#define TMPFS_NAME_MAX 255
+
+/* Largest file size; a file's pages are indexed by one flat array */
+#define TMPFS_MAX_FILE_SIZE (4ULL * 1024 * 1024 * 1024)
+
+/**
+ * Create an empty tmpfs
+ * max_bytes limits file data plus one page per inode.
+ * Returns a filesystem ready for vfs_mount(), or NULL on error.
+ */
+vfs_filesystem_t *tmpfs_create(uint32_t max_bytes);
+
+#endif /* TMPFS_H */
@@ -11,12 +11,17 @@
 #include <stdint.h>
 #include <stddef.h>
 
-/* Maximum number of open files per process */
-#define VFS_MAX_OPEN_FILES 16
+/* File descriptor table sizes (multiples of 64, one bitmap word each) */
+#define VFS_FD_TABLE_INITIAL 64    /* Descriptors in a new table */
+#define VFS_FD_TABLE_MAX     4096  /* Per-process limit */
+#define VFS_FD_WORDS         (VFS_FD_TABLE_MAX / 64)
 
 /* Maximum path length */
 #define VFS_MAX_PATH 256
 
+/* Filesystems that can be mounted besides the root */
+#define VFS_MAX_MOUNTS 8
+
 /* File descriptor values */
 #define VFS_FD_STDIN  0
 #define VFS_FD_STDOUT 1
@@ -27,8 +32,31 @@
 #define O_WRONLY  0x0001  /* Write-only */
 #define O_RDWR    0x0002  /* Read-write */
 #define O_CREAT   0x0040  /* Create if not exists */
+#define O_EXCL    0x0080  /* With O_CREAT, fail if the file exists */
 #define O_TRUNC   0x0200  /* Truncate to zero length */
 #define O_APPEND  0x0400  /* Append mode */
+#define O_NONBLOCK 0x0800 /* Fail with EAGAIN instead of waiting (pipes) */
+#define O_DIRECT  0x4000  /* Transfer between user memory and disk directly */
+#define O_CLOEXEC 0x80000 /* Do not pass the descriptor to started programs */
+
+/* splice and vmsplice flags */
+#define SPLICE_F_MOVE     0x01  /* Move pages rather than copy (always done when possible) */
+#define SPLICE_F_NONBLOCK 0x02  /* Do not wait on the pipe */
+#define SPLICE_F_MORE     0x04  /* More data follows (ignored) */
+#define SPLICE_F_GIFT     0x08  /* vmsplice: pages are given away (ignored, data is copied) */
+
+/* fallocate mode flags */
+#define FALLOC_FL_KEEP_SIZE 0x01  /* Reserve blocks without changing size */
+
+/* ioctl requests carry the size of their argument in the upper 16 bits */
+#define VFS_IOC(nr, size)   (((uint32_t)(size) << 16) | (uint32_t)(nr))
+#define VFS_IOC_SIZE(cmd)   ((uint32_t)(cmd) >> 16)
+
+/* Succeeds only on the console; lets user programs implement isatty() */
+#define VFS_IOC_ISATTY      VFS_IOC(0x5401, 0)
+
+/* Maximum number of buffers in one vectored read or write */
+#define VFS_IOV_MAX 1024
 
 /* Seek whence values */
 #define SEEK_SET  0  /* Seek from beginning */
@@ -38,20 +66,75 @@
 /* File types */
 #define VFS_TYPE_FILE      1
 #define VFS_TYPE_DIRECTORY 2
+#define VFS_TYPE_PIPE      3
+#define VFS_TYPE_ENDPOINT  4
+#define VFS_TYPE_SOCKET    5
+#define VFS_TYPE_EVENTFD   6
+#define VFS_TYPE_EPOLL     7
+
+/**
+ * Directory entry as returned by vfs_getdents()
+ * Records are packed back to back. d_reclen covers the NUL-terminated name
+ * and is rounded up to a multiple of 8.
+ */
+typedef struct {
+    uint32_t d_ino;                    /* Inode number */
+    uint16_t d_reclen;                 /* Length of this record */
+    uint8_t d_type;                    /* VFS_TYPE_* or 0 if unknown */
+    char d_name[];                     /* NUL-terminated name */
+} vfs_dirent_t;
+
+/**
+ * One buffer of a vectored read or write
+ * Layout matches the user-space struct iovec.
+ */
+typedef struct {
+    void *iov_base;                    /* Start of the buffer */
+    size_t iov_len;                    /* Length in bytes */
+} vfs_iovec_t;
+
+/**
+ * Cursor over a buffer list, for filesystems that copy through a
+ * buffer of their own
+ */
+typedef struct {
+    const vfs_iovec_t *iov;            /* Buffer list */
+    int iovcnt;                        /* Entries in iov */
+    int index;                         /* Current entry */
+    size_t offset;                     /* Bytes used of the current entry */
+} vfs_iov_iter_t;
 
 /* Forward declarations */
 struct vfs_node;
 struct vfs_filesystem;
+struct poll_table;
+struct epoll_item;
 
 /**
  * Filesystem operations - implemented by each FS type (ext2, etc.)
  */
 typedef struct {
     /* Read from file */
-    int (*read)(struct vfs_node *node, uint32_t offset, void *buffer, uint32_t size);
+    int (*read)(struct vfs_node *node, uint64_t offset, void *buffer, uint32_t size);
     
     /* Write to file */
-    int (*write)(struct vfs_node *node, uint32_t offset, const void *buffer, uint32_t size);
+    int (*write)(struct vfs_node *node, uint64_t offset, const void *buffer, uint32_t size);
+    
+    /*
+     * Read into or write from a list of buffers at one offset, as if they
+     * were one contiguous buffer. Optional: without them the VFS calls
+     * read/write once per buffer.
+     */
+    int (*readv)(struct vfs_node *node, uint64_t offset, const vfs_iovec_t *iov, int iovcnt);
+    int (*writev)(struct vfs_node *node, uint64_t offset, const vfs_iovec_t *iov, int iovcnt);
+    
+    /*
+     * Read (write == 0) or write whole filesystem blocks straight between
+     * the disk and buffer, for files opened with O_DIRECT. Optional:
+     * without it O_DIRECT opens fail with EINVAL.
+     */
+    int (*direct_io)(struct vfs_node *node, uint64_t offset, void *buffer, uint32_t size,
+                     int write);
     
     /* Open file (optional setup) */
     int (*open)(struct vfs_node *node, uint32_t flags);
@@ -59,11 +142,21 @@ typedef struct {
     /* Close file (optional cleanup) */
     void (*close)(struct vfs_node *node);
     
+    /*
+     * Write back data the filesystem buffers for the file. Called for
+     * every close() of a descriptor and by fsync(), so their callers see
+     * a failure that close cannot report. Optional.
+     */
+    int (*flush)(struct vfs_node *node);
+    
     /* Lookup file in directory by name */
     struct vfs_node *(*lookup)(struct vfs_node *dir, const char *name);
     
-    /* List directory contents */
-    int (*readdir)(struct vfs_node *dir, uint32_t index, char *name, uint32_t *inode);
+    /*
+     * Fill buffer with vfs_dirent_t records starting at *cookie and advance
+     * it. Returns bytes stored, 0 at the end of the directory, -1 on error.
+     */
+    int (*getdents)(struct vfs_node *dir, uint64_t *cookie, void *buffer, uint32_t size);
     
     /* Create file */
     int (*create)(struct vfs_node *dir, const char *name, uint32_t mode);
@@ -76,6 +169,49 @@ typedef struct {
     
     /* Remove directory */
     int (*rmdir)(struct vfs_node *dir, const char *name);
+    
+    /*
+     * Copy len bytes between two files of this filesystem without going
+     * through user memory. Optional: without it the VFS copies through a
+     * kernel buffer with read/write.
+     */
+    int (*copy_range)(struct vfs_node *src, uint64_t src_offset,
+                      struct vfs_node *dst, uint64_t dst_offset, uint32_t len);
+    
+    /* Change file size, releasing storage past the new end */
+    int (*truncate)(struct vfs_node *node, uint64_t size);
+    
+    /* Reserve storage for a byte range */
+    int (*fallocate)(struct vfs_node *node, uint32_t mode, uint64_t offset, uint64_t len);
+    
+    /*
+     * Make completed changes durable. Optional: filesystems without it
+     * have nothing to write back.
+     */
+    int (*sync)(struct vfs_filesystem *fs);
+    
+    /*
+     * Filesystem-specific request on an open file. arg points to
+     * VFS_IOC_SIZE(cmd) bytes that the request reads or fills. Optional:
+     * without it every request fails with ENOTTY.
+     */
+    int (*ioctl)(struct vfs_node *node, uint32_t cmd, void *arg);
+    
+    /*
+     * Store the physical page holding file page index in *page, with a
+     * reference taken for the caller, allocating it if it is a hole. The
+     * page is the file's own, so every mapping of it sees the same data.
+     * Optional: without it MAP_SHARED mappings of the file fail with ENODEV.
+     */
+    int (*get_page)(struct vfs_node *node, uint64_t index, uintptr_t *page);
+    
+    /*
+     * Return the POLL* events the file is ready for. If pt is not NULL,
+     * first hook every wait queue woken when that changes with
+     * poll_wait(). Optional: without it the file is always readable and
+     * writable.
+     */
+    uint32_t (*poll)(struct vfs_node *node, struct poll_table *pt);
 } vfs_ops_t;
 
 /**
@@ -84,7 +220,7 @@ typedef struct {
 typedef struct vfs_node {
     char name[256];                    /* File/directory name */
     uint32_t inode;                    /* Inode number */
-    uint32_t size;                     /* File size in bytes */
+    uint64_t size;                     /* File size in bytes */
     uint32_t type;                     /* File type (file/dir) */
     uint32_t flags;                    /* Flags */
     struct vfs_filesystem *fs;         /* Filesystem this node belongs to */
@@ -100,36 +236,90 @@ typedef struct vfs_filesystem {
     void *fs_data;                     /* Filesystem-specific data (e.g., ext2_fs_t) */
     vfs_node_t *root;                  /* Root directory node */
     vfs_ops_t *ops;                    /* Default operations */
+    uint32_t open_files;               /* Open files on this filesystem */
 } vfs_filesystem_t;
 
 /**
- * File descriptor - tracks open file state
+ * Open file description - tracks open file state
+ *
+ * Shared by descriptors made with dup() and by descriptors a child process
+ * inherits, so they also share the file position.
  */
-typedef struct {
+typedef struct vfs_file {
     vfs_node_t *node;                  /* File node */
     uint32_t flags;                    /* Open flags */
-    uint32_t pos;                      /* Current file position */
-    int in_use;                        /* 1 if FD is allocated */
+    uint64_t pos;                      /* Current file position */
+    uint32_t refcount;                 /* Descriptors referring to this file */
+    struct epoll_item *epoll_items;    /* epoll watches on this file */
 } vfs_file_t;
 
+/**
+ * File descriptor table - one per process
+ *
+ * Bit n of used[] is set when descriptor n is taken, and bit w of full is
+ * set when used[w] has no free bit. The lowest free descriptor is found
+ * with two bit scans. stdin/stdout/stderr are always marked used; their
+ * files[] entries stay NULL, meaning the console, until dup2() puts a file
+ * there. Closing such a descriptor returns it to the console.
+ * Descriptors with their cloexec[] bit set are left out of the copy a new
+ * process gets.
+ */
+typedef struct vfs_fd_table {
+    vfs_file_t **files;                /* Open files, indexed by descriptor */
+    uint32_t capacity;                 /* Entries in files[] */
+    uint64_t full;                     /* Summary of full used[] words */
+    uint64_t used[VFS_FD_WORDS];       /* Descriptor allocation bitmap */
+    uint64_t cloexec[VFS_FD_WORDS];    /* Descriptors opened with O_CLOEXEC */
+} vfs_fd_table_t;
+
 /* VFS initialization */
 int vfs_init(void);
 
 /* Mount a filesystem at root */
 int vfs_mount_root(vfs_filesystem_t *fs);
 
+/* Mount a filesystem on a directory, or detach it again */
+int vfs_mount(const char *path, vfs_filesystem_t *fs);
+int vfs_unmount(const char *path);
+
+/* Write back all mounted filesystems */
+int vfs_sync(void);
+
 /* File operations */
 int vfs_open(const char *path, uint32_t flags);
+int vfs_open_at(vfs_node_t *dir, const char *name, uint32_t flags);
 int vfs_close(int fd);
 int vfs_read(int fd, void *buffer, uint32_t size);
 int vfs_write(int fd, const void *buffer, uint32_t size);
-int vfs_seek(int fd, int offset, int whence);
+int vfs_pread(int fd, void *buffer, uint32_t size, uint64_t offset);
+int vfs_pwrite(int fd, const void *buffer, uint32_t size, uint64_t offset);
+int vfs_readv(int fd, vfs_iovec_t *iov, int iovcnt);
+int vfs_writev(int fd, vfs_iovec_t *iov, int iovcnt);
+int vfs_copy_file_range(int fd_in, uint64_t *off_in, int fd_out, uint64_t *off_out, uint32_t len);
+int vfs_splice(int fd_in, uint64_t *off_in, int fd_out, uint64_t *off_out, uint32_t len,
+               uint32_t flags);
+int vfs_vmsplice(int fd, vfs_iovec_t *iov, int iovcnt, uint32_t flags);
+int64_t vfs_seek(int fd, int64_t offset, int whence);
+int vfs_ftruncate(int fd, uint64_t length);
+int vfs_fsync(int fd);
+int vfs_fallocate(int fd, uint32_t mode, uint64_t offset, uint64_t len);
+int vfs_getdents(int fd, void *buffer, uint32_t size);
+int vfs_ioctl(int fd, uint32_t cmd, void *arg);
+int vfs_get_page(int fd, uint64_t index, uintptr_t *page);
+
+/* Pipes */
+int vfs_pipe(int fds[2], uint32_t flags);
 
 /* Directory operations */
 int vfs_mkdir(const char *path, uint32_t mode);
 int vfs_rmdir(const char *path);
 int vfs_unlink(const char *path);
 
+/* Buffer lists */
+void vfs_iov_iter_init(vfs_iov_iter_t *iter, const vfs_iovec_t *iov, int iovcnt);
+uint32_t vfs_iov_copy_to(vfs_iov_iter_t *iter, const void *src, uint32_t len);
+uint32_t vfs_iov_copy_from(vfs_iov_iter_t *iter, void *dst, uint32_t len);
+
 /* Path resolution */
 vfs_node_t *vfs_resolve_path(const char *path);
 
@@ -137,9 +327,20 @@ vfs_node_t *vfs_resolve_path(const char *path);
 int vfs_alloc_fd(void);
 void vfs_free_fd(int fd);
 vfs_file_t *vfs_get_file(int fd);
+vfs_file_t *vfs_file_get(int fd);
+void vfs_file_put(vfs_file_t *file);
+int vfs_install_file(vfs_file_t *file, uint32_t flags);
+int vfs_dup(int fd);
+int vfs_dup2(int old_fd, int new_fd);
+int vfs_open_node(vfs_node_t *node, uint32_t flags);
+
+/* File descriptor tables */
+vfs_fd_table_t *vfs_current_fd_table(void);
+vfs_fd_table_t *vfs_fd_table_clone(vfs_fd_table_t *table);
+void vfs_fd_table_destroy(vfs_fd_table_t *table);
 
 /* Helper functions */
-int vfs_stat(const char *path, uint32_t *size, uint32_t *type);
+int vfs_stat(const char *path, uint64_t *size, uint32_t *type);
 int vfs_exists(const char *path);
 
 #endif /* VFS_H */
@@ -58,6 +58,25 @@ int hal_uart_write(const char *buffer, unsigned int count);
  */
 char hal_uart_getc(void);
 
+/**
+ * Read a character from UART if one has arrived
+ * 
+ * Never blocks.
+ * 
+ * @return Character received, or -1 if none is waiting
+ */
+int hal_uart_try_getc(void);
+
+/**
+ * Raise an interrupt whenever a character arrives
+ * 
+ * The handler must read the waiting characters with hal_uart_try_getc(),
+ * which clears the interrupt.
+ * 
+ * @return Interrupt number of the UART, for interrupt_register_handler()
+ */
+uint32_t hal_uart_enable_rx_interrupt(void);
+
 /**
  * Write a 32-bit unsigned integer as decimal to UART
  * 
@@ -18,4 +18,9 @@
 #define RAM_END_ADDRESS 0x88000000      // 128MB RAM end
 #define RAM_SIZE_MB 128                 // Total RAM size
 
+// Network configuration (QEMU user networking), host byte order
+#define NET_IP_ADDR 0x0A00020F          // 10.0.2.15
+#define NET_NETMASK 0xFFFFFF00          // 255.255.255.0
+#define NET_GATEWAY 0x0A000202          // 10.0.2.2
+
 #endif // KERNEL_CONFIG_H
@@ -0,0 +1,86 @@
+/*
+ * epoll
+ *
+ * An epoll instance watches a set of descriptors and keeps a list of the
+ * ones that may be ready. The list is filled by callbacks on the files'
+ * wait queues, so epoll_wait() only looks at files that have had a
+ * wakeup, however many are watched.
+ */
+
+#ifndef EPOLL_H
+#define EPOLL_H
+
+#include <stdint.h>
+#include "kernel/poll.h"
+#include "fs/vfs.h"
+
+// Events, as for poll()
+#define EPOLLIN      POLLIN
+#define EPOLLPRI     POLLPRI
+#define EPOLLOUT     POLLOUT
+#define EPOLLERR     POLLERR
+#define EPOLLHUP     POLLHUP
+
+// Modes
+#define EPOLLONESHOT (1u << 30)         // Disable the watch after one event
+#define EPOLLET      (1u << 31)         // Edge-triggered: report changes only
+
+// epoll_ctl() operations
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+// epoll_create() flags
+#define EPOLL_CLOEXEC O_CLOEXEC
+
+// Buckets of the per-instance table of watches
+#define EPOLL_HASH_SIZE 256
+
+/**
+ * Event as passed to epoll_ctl() and returned by epoll_wait()
+ */
+struct epoll_event {
+    uint32_t events;                    // EPOLL* events and modes
+    uint64_t data;                      // Returned with the events
+};
+
+/**
+ * Create an epoll instance
+ *
+ * @param flags EPOLL_CLOEXEC or 0
+ * @return Descriptor of the instance, or -1 on error
+ */
+int epoll_create(uint32_t flags);
+
+/**
+ * Add, change or remove the watch of a descriptor
+ *
+ * @param epfd epoll descriptor
+ * @param op EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL
+ * @param fd Descriptor to watch
+ * @param event Events and data, in kernel memory (unused for DEL)
+ * @return 0 on success, -1 on error
+ */
+int epoll_ctl(int epfd, int op, int fd, const struct epoll_event *event);
+
+/**
+ * Wait for events on the watched descriptors
+ *
+ * @param epfd epoll descriptor
+ * @param events Filled with up to maxevents events
+ * @param maxevents Size of events, greater than 0
+ * @param timeout_ms As for poll_fds()
+ * @return Number of events stored, 0 on timeout, -1 on error
+ */
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout_ms);
+
+/**
+ * Drop every watch of a file
+ *
+ * Called by the VFS before the file is closed for the last time.
+ *
+ * @param file File being closed
+ */
+void epoll_file_release(vfs_file_t *file);
+
+#endif // EPOLL_H
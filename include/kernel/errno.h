@@ -17,6 +17,7 @@
  * 70-89   : VirtIO/driver errors
  * 90-109  : Process/scheduler errors
  * 110-129 : Memory management errors
+ * 130-149 : IPC errors
  */
 
 /* ========== Success ========== */
@@ -65,6 +66,7 @@
 #define THUNDEROS_EFS_NOSPACE 39  /* Directory has no space for new entry */
 #define THUNDEROS_EFS_RDONLY  40  /* Filesystem is read-only */
 #define THUNDEROS_EFS_NOTMNT  41  /* Filesystem not mounted */
+#define THUNDEROS_EFS_NOTEMPTY 42 /* Directory not empty */
 
 /* ========== ELF Loader Errors (50-69) ========== */
 #define THUNDEROS_EELF_MAGIC  50  /* Invalid ELF magic number */
@@ -110,6 +112,22 @@
 #define THUNDEROS_EMEM_BADPTE  117 /* Invalid page table entry */
 #define THUNDEROS_EMEM_DMA     118 /* DMA allocation failed */
 
+/* ========== IPC Errors (130-149) ========== */
+#define THUNDEROS_EPIPE        130 /* Read end of pipe closed */
+#define THUNDEROS_ECONNREFUSED 131 /* Nobody serves the endpoint */
+#define THUNDEROS_ECONNRESET   132 /* Server went away during a call */
+#define THUNDEROS_EADDRINUSE   133 /* Address already in use */
+#define THUNDEROS_ENOTCONN     134 /* Socket is not connected */
+#define THUNDEROS_EISCONN      135 /* Socket is already connected */
+#define THUNDEROS_ENOTSOCK     136 /* Descriptor is not a socket */
+#define THUNDEROS_EAFNOSUPPORT 137 /* Address family not supported */
+#define THUNDEROS_EOPNOTSUPP   138 /* Operation not supported on socket */
+#define THUNDEROS_EMSGSIZE     139 /* Message too long */
+#define THUNDEROS_EPROTOTYPE   140 /* Wrong socket type for the address */
+#define THUNDEROS_EADDRNOTAVAIL 141 /* Address is not local */
+#define THUNDEROS_ENETDOWN     142 /* No network interface */
+#define THUNDEROS_EPROTONOSUPPORT 143 /* Protocol not supported */
+
 /* ========== Error Handling Functions ========== */
 
 /**
@@ -0,0 +1,30 @@
+/*
+ * Flattened Device Tree
+ * 
+ * Minimal reader for the device tree blob that firmware passes to the
+ * kernel in a1 at boot.
+ */
+
+#ifndef FDT_H
+#define FDT_H
+
+#include <stdint.h>
+
+#define FDT_MAGIC 0xd00dfeed
+
+/**
+ * Find the initrd placed in memory by the boot loader
+ * 
+ * Reads linux,initrd-start and linux,initrd-end from the /chosen node.
+ * Every read is bounded by the structure and strings blocks, which must
+ * lie within totalsize; a blob that breaks this is treated as having no
+ * initrd.
+ * 
+ * @param dtb Physical address of the device tree blob
+ * @param start Output: physical address of the first byte of the initrd
+ * @param end Output: physical address one past the last byte
+ * @return 0 if an initrd was found, -1 otherwise
+ */
+int fdt_find_initrd(uintptr_t dtb, uintptr_t *start, uintptr_t *end);
+
+#endif // FDT_H
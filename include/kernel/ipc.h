@@ -0,0 +1,114 @@
+/*
+ * Synchronous IPC
+ *
+ * L4-style request/response between a client and a server process
+ * through a named endpoint. A client's call blocks until a server has
+ * received the message and replied; a server's reply_wait answers the
+ * caller it received last and then waits for the next one.
+ *
+ * A message is a tag and five words, carried in registers a1-a6 of the
+ * system call, plus an optional long part that is copied once from the
+ * sender's IPC buffer to the receiver's. When the other side is already
+ * waiting, the kernel switches straight to it, so a round trip costs two
+ * context switches and never passes through the ready queue.
+ */
+
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct process;
+struct ipc_endpoint;
+
+// Longest endpoint name, including the terminating NUL
+#define IPC_NAME_MAX 32
+
+// Message words carried in registers (a2-a6)
+#define IPC_MSG_WORDS 5
+
+// Message tag (a1): a label for the receiver and the long part's length
+#define IPC_TAG(label, len)     (((uint64_t)(len) << 32) | (uint32_t)(label))
+#define IPC_TAG_LABEL(tag)      ((uint32_t)(tag))
+#define IPC_TAG_LEN(tag)        ((uint32_t)((uint64_t)(tag) >> 32))
+
+// Where a process is in an IPC operation
+#define IPC_IDLE        0   // Not blocked in IPC
+#define IPC_SEND        1   // Caller queued until a server receives it
+#define IPC_WAIT_REPLY  2   // Caller received, waiting for the reply
+#define IPC_RECEIVE     3   // Server waiting for a caller
+
+/**
+ * Per-process IPC state
+ */
+typedef struct ipc_thread {
+    int state;                          // IPC_* above
+    int status;                         // 0, or errno for a failed call
+    struct process *server;             // Server a call is waiting on
+    struct process *reply_to;           // Caller received and not yet answered
+    struct process *next;               // Next process queued on the endpoint
+    struct ipc_endpoint *queued_on;     // Endpoint whose queue this is on, or NULL
+    uintptr_t buffer;                   // User address of the IPC buffer
+    size_t buffer_size;                 // Size of the IPC buffer
+} ipc_thread_t;
+
+/**
+ * Open an endpoint by name
+ *
+ * With O_CREAT the caller serves the endpoint, creating it if it does
+ * not exist (O_EXCL makes an existing one an error); without it the
+ * caller is a client of an endpoint some process serves.
+ *
+ * @param name Endpoint name
+ * @param flags O_CREAT, O_EXCL and O_CLOEXEC
+ * @return File descriptor, or -1 on error
+ */
+int ipc_endpoint_open(const char *name, uint32_t flags);
+
+/**
+ * Set the current process's IPC buffer
+ *
+ * The long part of messages it sends is taken from here and the long
+ * part of messages it receives is stored here, truncated to fit.
+ *
+ * @param buffer User address of the buffer (0 for none), below USER_MMAP_END
+ * @param size Size of the buffer in bytes
+ * @return 0 on success, -1 on error (EFAULT outside user memory)
+ */
+int ipc_set_buffer(uintptr_t buffer, size_t size);
+
+/**
+ * Send a message to an endpoint and wait for the reply
+ *
+ * The message is taken from, and the reply left in, a1-a6 of the
+ * current system call and the IPC buffer.
+ *
+ * @param fd Endpoint opened as a client or a server
+ * @return 0 on success, -1 on error
+ */
+int ipc_call(int fd);
+
+/**
+ * Reply to the last caller received, if any, and wait for the next
+ *
+ * The reply is taken from a1-a6 of the current system call and the IPC
+ * buffer, which then receive the next caller's message.
+ *
+ * @param fd Endpoint opened as a server
+ * @return PID of the caller received, or -1 on error
+ */
+int ipc_reply_wait(int fd);
+
+/**
+ * Release an exiting process's IPC state
+ *
+ * A caller it received and never answered gets ECONNRESET. If it is
+ * still queued on an endpoint as a caller or receiver it is unlinked, so
+ * the endpoint never hands a message to a process that is gone.
+ *
+ * @param proc Exiting process
+ */
+void ipc_release(struct process *proc);
+
+#endif // IPC_H
@@ -0,0 +1,44 @@
+/*
+ * Yield Locks
+ * 
+ * Sleeping locks for code that runs in process context. A process that
+ * finds the lock taken yields the CPU instead of spinning, since the
+ * holder may be a preempted process that needs to run to release it.
+ * Not for use with interrupts disabled or from an interrupt handler.
+ */
+
+#ifndef LOCK_H
+#define LOCK_H
+
+/**
+ * A lock taken with yield_lock()
+ */
+typedef struct {
+    volatile int locked;                // Non-zero while held
+} yield_lock_t;
+
+/* Initializer for a lock that starts out free */
+#define YIELD_LOCK_INIT { 0 }
+
+/**
+ * Initialize a free lock
+ * 
+ * @param lock Lock to initialize
+ */
+void yield_lock_init(yield_lock_t *lock);
+
+/**
+ * Acquire a lock, yielding until it is free
+ * 
+ * @param lock Lock to acquire
+ */
+void yield_lock(yield_lock_t *lock);
+
+/**
+ * Release a lock taken with yield_lock()
+ * 
+ * @param lock Lock to release
+ */
+void yield_unlock(yield_lock_t *lock);
+
+#endif // LOCK_H
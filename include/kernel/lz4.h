@@ -0,0 +1,26 @@
+/*
+ * LZ4 Block Decompression
+ *
+ * Decoder for the LZ4 block format (no frame header), as used by
+ * squashfs. Malformed input is rejected, never read or written past
+ * the given buffers.
+ */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+
+/**
+ * Decompress one LZ4 block
+ *
+ * @param src Compressed data
+ * @param src_len Length of the compressed data
+ * @param dst Output buffer
+ * @param dst_cap Size of the output buffer
+ * @return Number of bytes produced, or -1 if the input is malformed or
+ *         does not fit in dst_cap
+ */
+int lz4_decompress(const void *src, uint32_t src_len, void *dst, uint32_t dst_cap);
+
+#endif /* LZ4_H */
@@ -0,0 +1,99 @@
+/*
+ * Readiness Polling
+ *
+ * A file that can make a process wait has a poll operation. It reports
+ * the POLL* events the file is ready for and, when asked, hooks the wait
+ * queues that are woken when that changes. poll() sleeps on those queues
+ * for one call; epoll keeps its hooks between calls.
+ */
+
+#ifndef POLL_H
+#define POLL_H
+
+#include <stdint.h>
+#include "kernel/wait.h"
+
+// Events
+#define POLLIN   0x0001     // Data to read, or a connection to accept
+#define POLLPRI  0x0002     // Urgent data (never reported)
+#define POLLOUT  0x0004     // Writing will not wait
+#define POLLERR  0x0008     // Error, or the read end is gone (always reported)
+#define POLLHUP  0x0010     // The other end has closed (always reported)
+#define POLLNVAL 0x0020     // Not an open descriptor (poll only)
+
+// Most descriptors one poll() call can watch
+#define POLL_MAX_FDS 4096
+
+/**
+ * One descriptor of a poll() call
+ * Layout matches the user-space struct pollfd.
+ */
+struct pollfd {
+    int fd;                             // Descriptor, ignored if negative
+    short events;                       // Events asked for
+    short revents;                      // Events that happened
+};
+
+/**
+ * How a poll operation hooks the wait queues of a file
+ *
+ * queue is called once for each wait queue that is woken when the file's
+ * readiness changes. The queues must live as long as the file is open.
+ */
+typedef struct poll_table {
+    void (*queue)(struct poll_table *pt, wait_queue_t *queue);
+} poll_table_t;
+
+/**
+ * Hook a wait queue, from a poll operation
+ *
+ * Does nothing when pt is NULL, which means only the current events are
+ * wanted.
+ *
+ * @param pt Table passed to the poll operation
+ * @param queue Queue woken when readiness changes
+ */
+static inline void poll_wait(poll_table_t *pt, wait_queue_t *queue) {
+    if (pt && queue) {
+        pt->queue(pt, queue);
+    }
+}
+
+struct vfs_file;
+
+/**
+ * Events a descriptor is ready for
+ *
+ * file is the open file behind fd, or NULL when fd is served by the
+ * console. Files without a poll operation are always readable and
+ * writable.
+ *
+ * @param fd Descriptor
+ * @param file Open file, or NULL for the console
+ * @param pt Table to hook wait queues into, or NULL
+ * @return POLL* events
+ */
+uint32_t poll_fd_events(int fd, struct vfs_file *file, poll_table_t *pt);
+
+/**
+ * Convert a poll timeout to timer ticks
+ *
+ * @param timeout_ms Milliseconds, greater than 0
+ * @return Ticks, rounded up
+ */
+uint64_t poll_timeout_ticks(int timeout_ms);
+
+/**
+ * Wait until one of a set of descriptors is ready
+ *
+ * Fills in revents of every entry.
+ *
+ * @param fds Descriptors, in kernel memory
+ * @param nfds Entries in fds (at most POLL_MAX_FDS)
+ * @param timeout_ms Milliseconds to wait, 0 to return at once, negative
+ *                   to wait forever
+ * @return Number of entries with revents set, 0 on timeout, -1 on error
+ */
+int poll_fds(struct pollfd *fds, uint32_t nfds, int timeout_ms);
+
+#endif // POLL_H
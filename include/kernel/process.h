@@ -12,6 +12,8 @@
 #include <stddef.h>
 #include "trap.h"
 #include "mm/paging.h"
+#include "kernel/ipc.h"
+#include "arch/fpu.h"
 
 // Process states
 typedef enum {
@@ -44,8 +46,10 @@ typedef int32_t pid_t;
 // User space memory layout
 #define USER_CODE_BASE    0x0000000000010000  // User code starts at 64KB
 #define USER_STACK_TOP    0x0000000040000000  // User stack top at 1GB (in user space)
+#define USER_ARG_MAX      4096           // Bytes of argv strings and pointers on a new stack
 #define USER_HEAP_BASE    0x0000000000100000  // User heap base (future)
 #define USER_MMAP_START   0x40000000     // Memory mapped region (1GB)
+#define USER_MMAP_END     0x80000000     // End of the memory mapped region
 
 // Process context - saved during context switch
 struct context {
@@ -65,6 +69,9 @@ struct context {
     unsigned long s11;
 };
 
+struct vfs_fd_table;
+struct vm_area;
+
 // Process control block (PCB)
 struct process {
     pid_t pid;                          // Process ID
@@ -75,14 +82,18 @@ struct process {
     page_table_t *page_table;           // Virtual memory page table
     uintptr_t kernel_stack;             // Kernel stack base
     uintptr_t user_stack;               // User stack base (virtual)
+    struct vm_area *vm_areas;           // mmap() regions, sorted by address
     
     // Saved context (for context switching)
     struct context context;             // Kernel context
     struct trap_frame *trap_frame;      // User context (trap frame)
+    struct trap_frame *syscall_frame;   // Registers of the system call in progress
+    struct fpu_state fpu;               // FP and vector registers (user processes)
     
     // Scheduling
     uint64_t cpu_time;                  // Total CPU time used (in ticks)
     uint64_t priority;                  // Scheduling priority (lower = higher priority)
+    uint64_t wake_tick;                 // Tick to wake a timed sleep at (0 = none)
     
     // Process tree
     struct process *parent;             // Parent process
@@ -92,6 +103,12 @@ struct process {
     
     // Error handling
     int errno_value;                    // Per-process error number (errno)
+    
+    // Open files
+    struct vfs_fd_table *fd_table;      // File descriptors (NULL = kernel table)
+    
+    // Synchronous IPC
+    ipc_thread_t ipc;                   // Call/reply state and IPC buffer
 };
 
 /**
@@ -161,10 +178,17 @@ int process_has_children(struct process *parent, int target_pid);
 /**
  * Sleep for a number of ticks
  * 
- * @param ticks Number of timer ticks to sleep
+ * @param ticks Number of timer ticks to sleep (0 = until woken)
  */
 void process_sleep(uint64_t ticks);
 
+/**
+ * Wake processes whose sleep has timed out
+ * 
+ * @param now Current timer tick count
+ */
+void process_wake_expired(uint64_t now);
+
 /**
  * Wake up a process
  * 
@@ -233,12 +257,18 @@ struct process *process_create_user(const char *name, void *user_code, size_t co
  * @param code_base Virtual address base where code should be mapped
  * @param code_mem Physical address of loaded code (page-aligned)
  * @param code_size Size of code in bytes
+ * @param page_flags PTE_R/PTE_W/PTE_X for each page of the image; pages
+ *                   with none are left unmapped
  * @param entry_point Entry point virtual address
+ * @param argv Arguments copied onto the new user stack, or NULL
+ * @param argc Argument count; the block must fit in USER_ARG_MAX
  * @return Pointer to new process, or NULL on failure
  */
 struct process *process_create_elf(const char *name, uint64_t code_base, 
                                    void *code_mem, size_t code_size, 
-                                   uint64_t entry_point);
+                                   const uint8_t *page_flags,
+                                   uint64_t entry_point,
+                                   const char *argv[], int argc);
 
 /**
  * Return to user mode (assembly function)
@@ -260,9 +290,27 @@ void user_return(struct trap_frame *trap_frame) __attribute__((noreturn));
  */
 void *process_alloc_mem(struct process *proc, uint64_t vaddr, uint64_t size);
 
+/**
+ * Bytes the argument block of argv takes on a user stack
+ * 
+ * Covers the strings, the argc word, the argv and envp pointer arrays
+ * and alignment. exec refuses argument lists above USER_ARG_MAX.
+ * 
+ * @param argv Array of argument strings, or NULL
+ * @param argc Argument count
+ * @return Size in bytes
+ */
+size_t process_args_size(const char *argv[], int argc);
+
 /**
  * Set up process arguments (argc, argv)
  * 
+ * Copies the strings to the top of the new process's user stack and
+ * lays out argc, the argv pointers, a NULL and an empty envp below
+ * them, as crt0 expects. The stack pointer is left at argc, with a0 and
+ * a1 holding argc and argv as well. Must be called before the process
+ * first runs; the block must fit in USER_ARG_MAX.
+ * 
  * @param proc Process to set up
  * @param argv Array of argument strings
  * @param argc Argument count
@@ -53,6 +53,15 @@ void scheduler_dequeue(struct process *proc);
  */
 void context_switch(struct process *old, struct process *new);
 
+/**
+ * Sleep and run a waiting process in the current one's place
+ * 
+ * next skips the ready queue and gets the rest of the time slice.
+ * 
+ * @param next Sleeping process to run
+ */
+void scheduler_handoff(struct process *next);
+
 /**
  * Get the next process to run
  * 
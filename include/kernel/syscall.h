@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "fs/vfs.h"
+#include "net/socket.h"
+#include "kernel/poll.h"
+#include "kernel/epoll.h"
 
 // System call numbers
 #define SYS_EXIT        0   // Exit process
@@ -26,14 +30,55 @@
 #define SYS_UNLINK      18  // Remove file
 #define SYS_RMDIR       19  // Remove directory
 #define SYS_EXECVE      20  // Execute program from file
+#define SYS_FTRUNCATE   21  // Change size of an open file
+#define SYS_FALLOCATE   22  // Reserve storage for a file range
+#define SYS_DUP         23  // Duplicate file descriptor
+#define SYS_DUP2        24  // Duplicate file descriptor onto another
+#define SYS_GETDENTS    25  // Read directory entries
+#define SYS_PREAD       26  // Read at a file offset
+#define SYS_PWRITE      27  // Write at a file offset
+#define SYS_READV       28  // Read into several buffers
+#define SYS_WRITEV      29  // Write from several buffers
+#define SYS_COPY_FILE_RANGE 30  // Copy between files in the kernel
+#define SYS_SENDFILE    31  // Send file data to a descriptor
+#define SYS_SYNC        32  // Write back all filesystems
+#define SYS_IOCTL       33  // Filesystem-specific request on a file
+#define SYS_PIPE        34  // Create a pipe
+#define SYS_SPLICE      35  // Move data between a pipe and a file or pipe
+#define SYS_VMSPLICE    36  // Move user buffers into or out of a pipe
+#define SYS_MMAP        37  // Map memory or a file into the address space
+#define SYS_MUNMAP      38  // Unmap part of the address space
+#define SYS_SHM_OPEN    39  // Open a named shared memory object
+#define SYS_SHM_UNLINK  40  // Remove a shared memory object's name
+#define SYS_MEMFD_CREATE 41 // Create an anonymous shared memory object
+#define SYS_IPC_ENDPOINT 42 // Open a named IPC endpoint
+#define SYS_IPC_BUFFER  43  // Set the buffer for long IPC messages
+#define SYS_IPC_CALL    44  // Send a message and wait for the reply
+#define SYS_IPC_REPLY_WAIT 45 // Reply to the last caller and wait for the next
+#define SYS_SOCKET      46  // Create a socket
+#define SYS_SOCKETPAIR  47  // Create a pair of connected sockets
+#define SYS_BIND        48  // Bind a socket to an address
+#define SYS_LISTEN      49  // Accept connections on a socket
+#define SYS_ACCEPT      50  // Take the next connection of a listening socket
+#define SYS_CONNECT     51  // Connect a socket to an address
+#define SYS_SENDMSG     52  // Send a message on a socket
+#define SYS_RECVMSG     53  // Receive a message from a socket
+#define SYS_POLL        54  // Wait until one of a set of descriptors is ready
+#define SYS_EPOLL_CREATE 55 // Create an epoll instance
+#define SYS_EPOLL_CTL   56  // Add, change or remove an epoll watch
+#define SYS_EPOLL_WAIT  57  // Wait for events on an epoll instance
+#define SYS_EVENTFD     58  // Create an event counter
+#define SYS_GETHWCAP    59  // ISA extensions user code may use
+#define SYS_FSYNC       60  // Write back one file and its filesystem
 
-#define SYSCALL_COUNT   21
+#define SYSCALL_COUNT   61
 
 // RISC-V Syscall ABI:
 // - Syscall number in a7 (x17)
 // - Arguments in a0-a5 (x10-x15)
 // - Return value in a0 (x10)
 // - Uses ECALL instruction from user mode
+// - IPC call and reply_wait also carry a message in a1-a6, both ways
 
 /**
  * Main syscall handler
@@ -67,5 +112,47 @@ uint64_t sys_mkdir(const char *path, int mode);
 uint64_t sys_unlink(const char *path);
 uint64_t sys_rmdir(const char *path);
 uint64_t sys_execve(const char *path, const char *argv[], const char *envp[]);
+uint64_t sys_ftruncate(int fd, uint64_t length);
+uint64_t sys_fallocate(int fd, int mode, uint64_t offset, uint64_t len);
+uint64_t sys_dup(int fd);
+uint64_t sys_dup2(int old_fd, int new_fd);
+uint64_t sys_getdents(int fd, void *buffer, size_t size);
+uint64_t sys_pread(int fd, char *buf, size_t len, int64_t offset);
+uint64_t sys_pwrite(int fd, const char *buf, size_t len, int64_t offset);
+uint64_t sys_readv(int fd, const vfs_iovec_t *iov, int iovcnt);
+uint64_t sys_writev(int fd, const vfs_iovec_t *iov, int iovcnt);
+uint64_t sys_copy_file_range(int fd_in, int64_t *off_in, int fd_out, int64_t *off_out,
+                             size_t len, unsigned int flags);
+uint64_t sys_sendfile(int out_fd, int in_fd, int64_t *offset, size_t count);
+uint64_t sys_sync(void);
+uint64_t sys_ioctl(int fd, uint32_t cmd, void *arg);
+uint64_t sys_pipe(int *fds, int flags);
+uint64_t sys_splice(int fd_in, int64_t *off_in, int fd_out, int64_t *off_out,
+                    size_t len, unsigned int flags);
+uint64_t sys_vmsplice(int fd, const vfs_iovec_t *iov, int iovcnt, unsigned int flags);
+uint64_t sys_mmap(void *addr, size_t length, int prot, int flags, int fd, int64_t offset);
+uint64_t sys_munmap(void *addr, size_t length);
+uint64_t sys_shm_open(const char *name, int flags, int mode);
+uint64_t sys_shm_unlink(const char *name);
+uint64_t sys_memfd_create(const char *name, unsigned int flags);
+uint64_t sys_ipc_endpoint(const char *name, int flags);
+uint64_t sys_ipc_buffer(void *buffer, size_t size);
+uint64_t sys_ipc_call(int fd);
+uint64_t sys_ipc_reply_wait(int fd);
+uint64_t sys_socket(int family, int type, int protocol);
+uint64_t sys_socketpair(int family, int type, int protocol, int *fds);
+uint64_t sys_bind(int fd, const struct sockaddr *addr, socklen_t len);
+uint64_t sys_listen(int fd, int backlog);
+uint64_t sys_accept(int fd, int flags);
+uint64_t sys_connect(int fd, const struct sockaddr *addr, socklen_t len);
+uint64_t sys_sendmsg(int fd, const struct msghdr *msg, int flags);
+uint64_t sys_recvmsg(int fd, struct msghdr *msg, int flags);
+uint64_t sys_poll(struct pollfd *fds, uint32_t nfds, int timeout_ms);
+uint64_t sys_epoll_create(int flags);
+uint64_t sys_epoll_ctl(int epfd, int op, int fd, const struct epoll_event *event);
+uint64_t sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout_ms);
+uint64_t sys_eventfd(unsigned int initval, int flags);
+uint64_t sys_gethwcap(void);
+uint64_t sys_fsync(int fd);
 
 #endif // SYSCALL_H
@@ -0,0 +1,104 @@
+/*
+ * Wait Queues
+ * 
+ * Lists of processes sleeping until some condition changes, such as data
+ * arriving in a pipe. An entry may instead carry a callback, which stays
+ * queued and is run on every wakeup; poll and epoll watch files this way.
+ */
+
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdint.h>
+
+struct process;
+struct wait_queue_entry;
+
+/**
+ * Callback run by a wakeup, with interrupts disabled
+ * 
+ * It may wake other queues but must not sleep or take a lock that
+ * yields.
+ */
+typedef void (*wait_func_t)(struct wait_queue_entry *entry);
+
+/**
+ * One sleeping process, or one callback
+ * 
+ * A sleeper's entry lives on its kernel stack for as long as it waits.
+ * Callback entries are added and removed by their owner.
+ */
+typedef struct wait_queue_entry {
+    struct process *proc;               // Sleeping process, or NULL
+    wait_func_t func;                   // Callback, or NULL for a sleeper
+    void *data;                         // For the callback
+    struct wait_queue_entry *next;      // Next entry
+} wait_queue_entry_t;
+
+/**
+ * Processes waiting for one condition
+ */
+typedef struct {
+    wait_queue_entry_t *head;           // Sleepers, most recent first
+} wait_queue_t;
+
+/**
+ * Initialize an empty wait queue
+ * 
+ * @param queue Queue to initialize
+ */
+void wait_queue_init(wait_queue_t *queue);
+
+/**
+ * Sleep on a wait queue until woken
+ * 
+ * The caller disables interrupts, checks its condition and only then
+ * calls this, so a wakeup cannot slip in between the check and the sleep.
+ * Returns with interrupts still disabled; the caller checks the condition
+ * again, since another process may have got there first.
+ * 
+ * @param queue Queue to sleep on
+ */
+void wait_queue_sleep(wait_queue_t *queue);
+
+/**
+ * Sleep on a wait queue until woken or until a number of timer ticks
+ * have passed
+ * 
+ * As wait_queue_sleep(); 0 ticks means no timeout.
+ * 
+ * @param queue Queue to sleep on
+ * @param ticks Timer ticks to sleep at most
+ */
+void wait_queue_sleep_timeout(wait_queue_t *queue, uint64_t ticks);
+
+/**
+ * Add a callback entry to a wait queue
+ * 
+ * The entry's func and data must be set. It stays queued until removed.
+ * 
+ * @param queue Queue to watch
+ * @param entry Entry to add
+ */
+void wait_queue_add(wait_queue_t *queue, wait_queue_entry_t *entry);
+
+/**
+ * Remove an entry added with wait_queue_add()
+ * 
+ * Once it returns the callback is not running and will not run again.
+ * 
+ * @param queue Queue the entry is on
+ * @param entry Entry to remove
+ */
+void wait_queue_remove(wait_queue_t *queue, wait_queue_entry_t *entry);
+
+/**
+ * Wake every process sleeping on a wait queue and run its callbacks
+ * 
+ * Safe to call from an interrupt handler.
+ * 
+ * @param queue Queue to wake
+ */
+void wait_queue_wake_all(wait_queue_t *queue);
+
+#endif // WAIT_H
@@ -19,6 +19,12 @@
 #define DMA_ALIGN_4K    (1 << 1)  // Align to 4KB (page boundary)
 #define DMA_ALIGN_64K   (1 << 2)  // Align to 64KB (for some devices)
 
+/**
+ * Scatter-gather transfer directions
+ */
+#define DMA_TO_DEVICE   0         // Device reads the buffer (disk write)
+#define DMA_FROM_DEVICE 1         // Device writes the buffer (disk read)
+
 /**
  * DMA region structure
  * 
@@ -32,6 +38,16 @@ typedef struct dma_region {
     struct dma_region *next;  // Linked list for tracking
 } dma_region_t;
 
+/**
+ * Scatter-gather segment
+ * 
+ * One physically contiguous piece of a buffer handed to a device.
+ */
+typedef struct {
+    uintptr_t phys_addr;      // Physical address of the piece
+    uint32_t len;             // Length in bytes
+} dma_sg_t;
+
 /**
  * Initialize the DMA allocator
  * 
@@ -88,6 +104,34 @@ static inline size_t dma_size(dma_region_t *region) {
     return region ? region->size : 0;
 }
 
+/**
+ * Describe a buffer as physical segments for device I/O
+ * 
+ * Walks the buffer page by page through the current process's page table
+ * (the kernel's when there is no process), so user buffers can be handed
+ * to a device without copying. Pages that follow each other in physical
+ * memory share a segment. Stops early when max_sg segments are used up.
+ * 
+ * Through a user page table every page must be a user page the process
+ * could access the same way: readable for DMA_TO_DEVICE, writable for
+ * DMA_FROM_DEVICE. Kernel memory mapped into the table is refused.
+ * 
+ * Pages are not pinned: user memory is never paged out or moved, and
+ * callers keep the buffer mapped until the request completes.
+ * 
+ * @param buffer Start of the buffer (any alignment)
+ * @param len Length in bytes
+ * @param dir DMA_TO_DEVICE or DMA_FROM_DEVICE
+ * @param sg Output: segment array
+ * @param max_sg Size of the segment array
+ * @param nr_sg Output: number of segments filled in
+ * @return Bytes described from the start of the buffer, less than len only
+ *         if the segments ran out; 0 with errno EFAULT if any page is not
+ *         mapped or does not allow the access
+ */
+size_t dma_map_sg(const void *buffer, size_t len, int dir, dma_sg_t *sg,
+                  uint32_t max_sg, uint32_t *nr_sg);
+
 /**
  * Get DMA statistics
  * 
@@ -0,0 +1,87 @@
+/*
+ * Memory Mappings
+ * 
+ * mmap() places anonymous memory or the pages of a file in a process's
+ * address space, between USER_MMAP_START and USER_MMAP_END. All pages are
+ * mapped when the region is created, since there is no page fault handler
+ * to fill them in later. Each mapped page holds a PMM reference, so a page
+ * shared with other processes or with a file is freed by the last user.
+ */
+
+#ifndef MMAP_H
+#define MMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct process;
+
+/**
+ * Protection flags
+ */
+#define PROT_READ     0x1   // Pages can be read
+#define PROT_WRITE    0x2   // Pages can be written
+#define PROT_EXEC     0x4   // Pages can be executed
+
+/**
+ * Mapping flags
+ */
+#define MAP_SHARED    0x01  // Map the file's own pages; writes are seen by all
+#define MAP_PRIVATE   0x02  // Map a private copy of the data
+#define MAP_ANONYMOUS 0x20  // Zeroed memory with no file behind it
+
+/**
+ * Mapped region
+ * 
+ * One per mmap() call, kept in a list sorted by address. munmap() of part
+ * of a region trims or splits it.
+ */
+typedef struct vm_area {
+    uintptr_t start;          // First address (page-aligned)
+    uintptr_t end;            // Address after the last page
+    uint32_t prot;            // PROT_* flags
+    uint32_t flags;           // MAP_* flags
+    struct vm_area *next;     // Next region by address
+} vm_area_t;
+
+/**
+ * Map memory into a process
+ * 
+ * With MAP_SHARED, a file must provide the get_page operation (tmpfs and
+ * shared memory objects do) and the mapping uses the file's own pages.
+ * With MAP_PRIVATE, the file is read into new pages. MAP_ANONYMOUS maps
+ * zeroed pages and ignores fd and offset.
+ * 
+ * @param proc Process whose address space gets the region
+ * @param length Length in bytes (rounded up to whole pages)
+ * @param prot PROT_* flags (at least one)
+ * @param flags MAP_SHARED or MAP_PRIVATE, optionally with MAP_ANONYMOUS
+ * @param fd File to map, in the current descriptor table
+ * @param offset Offset in the file (page-aligned)
+ * @return Address of the region, or 0 on failure with errno set
+ */
+uintptr_t mmap_map(struct process *proc, size_t length, uint32_t prot, uint32_t flags,
+                   int fd, uint64_t offset);
+
+/**
+ * Unmap a range of a process's address space
+ * 
+ * Parts of the range that are not mapped are skipped.
+ * 
+ * @param proc Process to unmap from
+ * @param addr Start of the range (page-aligned)
+ * @param length Length in bytes (rounded up to whole pages)
+ * @return 0 on success, -1 on failure with errno set
+ */
+int mmap_unmap(struct process *proc, uintptr_t addr, size_t length);
+
+/**
+ * Unmap every region of a process
+ * 
+ * Called when the process exits or is freed.
+ * 
+ * @param proc Process to clean up
+ */
+void mmap_release(struct process *proc);
+
+#endif // MMAP_H
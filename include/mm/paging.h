@@ -113,6 +113,21 @@ int unmap_page(page_table_t *page_table, uintptr_t vaddr);
  */
 int virt_to_phys(page_table_t *page_table, uintptr_t vaddr, uintptr_t *paddr);
 
+/**
+ * Translate a user virtual address, checking the access is allowed
+ * 
+ * Process page tables also map the kernel, so a plain translation would
+ * accept kernel memory. Only pages user mode could touch the same way
+ * are accepted.
+ * 
+ * @param page_table Root page table (level 2)
+ * @param vaddr Virtual address
+ * @param write Non-zero if the access writes the page
+ * @param paddr Output: physical address
+ * @return 0 on success, -1 if not mapped with PTE_U and PTE_R (or PTE_W)
+ */
+int user_virt_to_phys(page_table_t *page_table, uintptr_t vaddr, int write, uintptr_t *paddr);
+
 /**
  * Flush TLB for a specific virtual address
  * 
@@ -51,10 +51,31 @@ uintptr_t pmm_alloc_pages(size_t num_pages);
 /**
  * Free a previously allocated physical page
  * 
+ * A new page has one reference. Each call drops one, and the page is freed
+ * when none are left.
+ * 
  * @param page_addr Physical address of page to free (must be page-aligned)
  */
 void pmm_free_page(uintptr_t page_addr);
 
+/**
+ * Take another reference to an allocated page
+ * 
+ * Used when a page is shared, for example mapped into several address
+ * spaces. Each reference is dropped with pmm_free_page().
+ * 
+ * @param page_addr Physical address of the page (must be page-aligned)
+ */
+void pmm_page_get(uintptr_t page_addr);
+
+/**
+ * Get the number of references held on a page
+ * 
+ * @param page_addr Physical address of the page
+ * @return Reference count, or 0 if the page is free or not managed
+ */
+uint32_t pmm_page_refs(uintptr_t page_addr);
+
 /**
  * Free multiple contiguous physical pages
  * 
@@ -63,6 +84,18 @@ void pmm_free_page(uintptr_t page_addr);
  */
 void pmm_free_pages(uintptr_t page_addr, size_t num_pages);
 
+/**
+ * Mark a range of physical memory as allocated
+ * 
+ * Used for memory the boot loader placed inside the managed region, such
+ * as an initrd. Partial pages at either end are reserved whole; the range
+ * can be handed back with pmm_free_pages() on the same page-aligned span.
+ * 
+ * @param start Physical start address (need not be page-aligned)
+ * @param size Size of the range in bytes
+ */
+void pmm_reserve_range(uintptr_t start, size_t size);
+
 /**
  * Get memory statistics
  * 
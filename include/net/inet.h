@@ -0,0 +1,65 @@
+/*
+ * inet.h - IPv4 sockets
+ *
+ * AF_INET datagram sockets over UDP. Addresses and ports in struct
+ * sockaddr_in are in network byte order, as on other systems.
+ */
+
+#ifndef INET_H
+#define INET_H
+
+#include <stdint.h>
+#include "net/socket.h"
+
+/* Protocols */
+#define IPPROTO_UDP 17
+
+/* Special addresses, in host byte order */
+#define INADDR_ANY       0x00000000u
+#define INADDR_BROADCAST 0xFFFFFFFFu
+
+/* Ports handed out to sockets that send before binding */
+#define INET_EPHEMERAL_FIRST 49152
+#define INET_EPHEMERAL_LAST  65535
+
+/* Bytes a socket may have queued for reading; later datagrams are dropped */
+#define UDP_RCVBUF (64 * 1024)
+
+/**
+ * IPv4 address
+ */
+struct in_addr {
+    uint32_t s_addr;                   /* Network byte order */
+};
+
+/**
+ * IPv4 socket address
+ */
+struct sockaddr_in {
+    uint16_t sin_family;               /* AF_INET */
+    uint16_t sin_port;                 /* Network byte order */
+    struct in_addr sin_addr;           /* Network byte order */
+    uint8_t sin_zero[8];               /* Padding to struct sockaddr */
+};
+
+/* Byte order conversion; RISC-V is little-endian */
+static inline uint16_t htons(uint16_t x) {
+    return __builtin_bswap16(x);
+}
+
+static inline uint16_t ntohs(uint16_t x) {
+    return __builtin_bswap16(x);
+}
+
+static inline uint32_t htonl(uint32_t x) {
+    return __builtin_bswap32(x);
+}
+
+static inline uint32_t ntohl(uint32_t x) {
+    return __builtin_bswap32(x);
+}
+
+/* The AF_INET family, for the socket layer */
+extern const socket_family_t inet_family;
+
+#endif /* INET_H */
@@ -0,0 +1,187 @@
+/*
+ * ip.h - Ethernet, ARP, IPv4 and UDP
+ *
+ * A small stack for one interface with a fixed address (see
+ * kernel/config.h). Received frames come up from the network driver in
+ * the net-rx process; sends go down from the sending process. Frames are
+ * built in place: the sender leaves room for the headers in front of its
+ * data and each layer fills in its own.
+ *
+ * Addresses are passed in host byte order and only converted in headers.
+ */
+
+#ifndef IP_H
+#define IP_H
+
+#include <stdint.h>
+
+/* Ethernet */
+#define ETH_ALEN    6
+#define ETH_HLEN    14
+#define ETH_P_IP    0x0800
+#define ETH_P_ARP   0x0806
+
+/* IPv4 */
+#define IP_HLEN     20                 /* Header without options */
+#define IP_MTU      1500
+#define IP_TTL      64
+#define IP_DF       0x4000             /* Don't fragment */
+#define IP_MF       0x2000             /* More fragments */
+#define IP_OFFMASK  0x1FFF             /* Fragment offset */
+
+/* UDP */
+#define UDP_HLEN    8
+#define UDP_MAX_PAYLOAD (IP_MTU - IP_HLEN - UDP_HLEN)
+
+/* Offset of the UDP header in a frame, and of its checksum in the header */
+#define UDP_CSUM_START  (ETH_HLEN + IP_HLEN)
+#define UDP_CSUM_OFFSET 6
+
+/* Room a sender leaves in front of UDP data */
+#define NET_HEADROOM (ETH_HLEN + IP_HLEN + UDP_HLEN)
+
+/* Entries in the ARP cache */
+#define ARP_CACHE_SIZE 16
+
+/**
+ * Ethernet header
+ */
+typedef struct {
+    uint8_t dst[ETH_ALEN];
+    uint8_t src[ETH_ALEN];
+    uint16_t type;                     /* ETH_P_*, network byte order */
+} __attribute__((packed)) eth_hdr_t;
+
+/**
+ * ARP packet for IPv4 over Ethernet
+ */
+typedef struct {
+    uint16_t htype;                    /* 1: Ethernet */
+    uint16_t ptype;                    /* ETH_P_IP */
+    uint8_t hlen;                      /* ETH_ALEN */
+    uint8_t plen;                      /* 4 */
+    uint16_t oper;                     /* 1: request, 2: reply */
+    uint8_t sha[ETH_ALEN];             /* Sender hardware address */
+    uint32_t spa;                      /* Sender protocol address */
+    uint8_t tha[ETH_ALEN];             /* Target hardware address */
+    uint32_t tpa;                      /* Target protocol address */
+} __attribute__((packed)) arp_pkt_t;
+
+/**
+ * IPv4 header
+ */
+typedef struct {
+    uint8_t ver_ihl;                   /* Version 4, header length in words */
+    uint8_t tos;
+    uint16_t total_len;                /* Header and payload */
+    uint16_t id;
+    uint16_t frag_off;                 /* IP_DF, IP_MF, offset */
+    uint8_t ttl;
+    uint8_t protocol;                  /* IPPROTO_* */
+    uint16_t checksum;
+    uint32_t saddr;
+    uint32_t daddr;
+} __attribute__((packed)) ipv4_hdr_t;
+
+/**
+ * UDP header
+ */
+typedef struct {
+    uint16_t sport;
+    uint16_t dport;
+    uint16_t len;                      /* Header and data */
+    uint16_t checksum;                 /* 0: none */
+} __attribute__((packed)) udp_hdr_t;
+
+/**
+ * Start the stack
+ * Starts receiving on the network device.
+ * @return 0 on success, -1 with errno set if there is no device
+ */
+int net_init(void);
+
+/**
+ * Check whether there is a device to send on
+ * @return 1 if there is, else 0
+ */
+int net_up(void);
+
+/**
+ * Handle a received Ethernet frame
+ * @param frame Frame, valid during the call
+ * @param len Frame length
+ * @param csum_ok 1 if the device has checked the transport checksum
+ */
+void net_input(const uint8_t *frame, uint32_t len, int csum_ok);
+
+/**
+ * Add data to a one's complement sum
+ * @param sum Sum so far
+ * @param data Data, summed as big-endian 16-bit words
+ * @param len Length in bytes
+ * @return New sum, not folded
+ */
+uint32_t inet_csum_add(uint32_t sum, const void *data, uint32_t len);
+
+/**
+ * Fold a one's complement sum to 16 bits and complement it
+ * @return Checksum in host byte order
+ */
+uint16_t inet_csum_fold(uint32_t sum);
+
+/**
+ * Handle a received ARP packet
+ */
+void arp_input(const uint8_t *pkt, uint32_t len);
+
+/**
+ * Send a frame to a host on the local network
+ * Fills in the Ethernet addresses; the caller sets the type. If the
+ * host's hardware address is not known yet, the frame is copied and held
+ * until it is, and an ARP request goes out; a frame already held for the
+ * same host is dropped. The device is not notified; the caller flushes.
+ * @param next_hop Host, in host byte order
+ * @param frame Frame with room for the Ethernet header
+ * @param len Frame length
+ * @param csum_start, csum_offset As for virtio_net_xmit()
+ * @return 0 on success, -1 with errno set on failure
+ */
+int arp_output(uint32_t next_hop, uint8_t *frame, uint32_t len,
+               uint16_t csum_start, uint16_t csum_offset);
+
+/**
+ * Check whether an address is one of ours
+ * That is the interface address and the loopback network.
+ * @param addr Address, in host byte order
+ */
+int ip_is_local(uint32_t addr);
+
+/**
+ * Handle a received IPv4 packet
+ */
+void ip_input(const uint8_t *pkt, uint32_t len, int csum_ok);
+
+/**
+ * Send an IPv4 packet
+ * Packets to a local address are handed straight to ip_input().
+ * @param daddr Destination, in host byte order
+ * @param protocol IPPROTO_*
+ * @param frame Frame with room for the Ethernet and IP headers in front
+ *              of the payload
+ * @param payload_len Bytes after the IP header
+ * @param csum_start, csum_offset As for virtio_net_xmit()
+ * @return 0 on success, -1 with errno set on failure
+ */
+int ip_output(uint32_t daddr, uint8_t protocol, uint8_t *frame, uint32_t payload_len,
+              uint16_t csum_start, uint16_t csum_offset);
+
+/**
+ * Handle a received UDP datagram
+ * @param ip IP header of the packet
+ * @param seg UDP header and data
+ * @param len Bytes in seg
+ * @param csum_ok 1 if the device has checked the checksum
+ */
+void udp_input(const ipv4_hdr_t *ip, const uint8_t *seg, uint32_t len, int csum_ok);
+
+#endif /* IP_H */
@@ -0,0 +1,166 @@
+/*
+ * socket.h - Sockets
+ *
+ * A socket is a VFS node of type VFS_TYPE_SOCKET, so it lives in the
+ * descriptor table like a pipe and works with read, write and close.
+ * The socket layer checks arguments and passes each call on to the
+ * operations of the socket's address family.
+ */
+
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+
+/* Address families */
+#define AF_UNSPEC 0         /* connect(): dissolve a datagram association */
+#define AF_UNIX  1          /* Local sockets named by a path */
+#define AF_INET  2          /* IPv4 (UDP only) */
+
+/* Socket types; SOCK_NONBLOCK and SOCK_CLOEXEC may be or-ed in */
+#define SOCK_STREAM   1     /* Reliable byte stream */
+#define SOCK_DGRAM    2     /* Datagrams, boundaries kept */
+#define SOCK_TYPE_MASK 0xf
+#define SOCK_NONBLOCK O_NONBLOCK
+#define SOCK_CLOEXEC  O_CLOEXEC
+
+/* Control message levels and types */
+#define SOL_SOCKET  1
+#define SCM_RIGHTS  1       /* Data is an array of descriptors */
+
+/* Most descriptors one message can carry */
+#define SCM_MAX_FD  16
+
+/* sendmsg/recvmsg flags */
+#define MSG_CTRUNC       0x0008      /* Control data did not fit */
+#define MSG_TRUNC        0x0020      /* Datagram did not fit */
+#define MSG_DONTWAIT     0x0040      /* Fail with EAGAIN instead of waiting */
+#define MSG_CMSG_CLOEXEC 0x40000000  /* Received descriptors get O_CLOEXEC */
+
+/* Longest listen() backlog */
+#define SOMAXCONN 16
+
+typedef uint32_t socklen_t;
+
+/**
+ * Generic socket address
+ */
+struct sockaddr {
+    uint16_t sa_family;                /* AF_* */
+    char sa_data[14];                  /* Family-specific address */
+};
+
+/**
+ * Message for sendmsg/recvmsg
+ * msg_iov and msg_control are user pointers when passed to the system
+ * calls.
+ */
+struct msghdr {
+    void *msg_name;                    /* Address to send to / of the sender */
+    socklen_t msg_namelen;             /* Size of msg_name */
+    vfs_iovec_t *msg_iov;              /* Data buffers */
+    int msg_iovlen;                    /* Entries in msg_iov */
+    void *msg_control;                 /* Control messages */
+    socklen_t msg_controllen;          /* Size of msg_control */
+    int msg_flags;                     /* recvmsg: MSG_TRUNC, MSG_CTRUNC */
+};
+
+/**
+ * Control message header; the data follows at CMSG_DATA()
+ */
+struct cmsghdr {
+    socklen_t cmsg_len;                /* Header plus data, unpadded */
+    int cmsg_level;                    /* SOL_SOCKET */
+    int cmsg_type;                     /* SCM_RIGHTS */
+};
+
+#define CMSG_ALIGN(len)   (((len) + 7) & ~(socklen_t)7)
+#define CMSG_DATA(cmsg)   ((uint8_t *)(cmsg) + CMSG_ALIGN(sizeof(struct cmsghdr)))
+#define CMSG_LEN(len)     (CMSG_ALIGN(sizeof(struct cmsghdr)) + (len))
+#define CMSG_SPACE(len)   (CMSG_ALIGN(sizeof(struct cmsghdr)) + CMSG_ALIGN(len))
+
+struct socket;
+
+/**
+ * Message as the address families see it
+ * The data buffers have been checked; files are held references.
+ */
+typedef struct socket_msg {
+    void *name;                        /* Address, in kernel memory */
+    socklen_t namelen;                 /* Size of name (in/out) */
+    const vfs_iovec_t *iov;            /* Data buffers */
+    int iovcnt;                        /* Entries in iov */
+    vfs_file_t *files[SCM_MAX_FD];     /* Descriptors passed (SCM_RIGHTS) */
+    uint32_t nfiles;                   /* Entries in files */
+    uint32_t flags;                    /* recvmsg: MSG_TRUNC, MSG_CTRUNC */
+} socket_msg_t;
+
+/**
+ * Operations of an address family
+ * All return -1 with errno set on failure. Missing operations fail with
+ * EOPNOTSUPP.
+ */
+typedef struct socket_ops {
+    int (*bind)(struct socket *sock, const struct sockaddr *addr, socklen_t len);
+    int (*listen)(struct socket *sock, int backlog);
+    int (*accept)(struct socket *sock, struct socket **new_sock, int nonblock);
+    int (*connect)(struct socket *sock, const struct sockaddr *addr, socklen_t len,
+                   int nonblock);
+    int (*pair)(struct socket *a, struct socket *b);
+    int (*sendmsg)(struct socket *sock, socket_msg_t *msg, int nonblock);
+    int (*recvmsg)(struct socket *sock, socket_msg_t *msg, int nonblock);
+    void (*release)(struct socket *sock);
+    uint32_t (*poll)(struct socket *sock, struct poll_table *pt);
+} socket_ops_t;
+
+/**
+ * Socket shared by every descriptor open on it
+ */
+typedef struct socket {
+    uint16_t family;                   /* AF_* */
+    uint16_t type;                     /* SOCK_STREAM or SOCK_DGRAM */
+    const socket_ops_t *ops;           /* Family operations */
+    void *proto;                       /* Family-specific state */
+    vfs_node_t node;                   /* Node the descriptors refer to */
+} socket_t;
+
+/**
+ * An address family
+ * create sets up sock->ops and sock->proto for a new socket.
+ */
+typedef struct socket_family {
+    int family;                        /* AF_* */
+    int (*create)(socket_t *sock, int type);
+} socket_family_t;
+
+/**
+ * Allocate a socket of a family, not yet open on any descriptor
+ * Families use this for the sockets accept() returns. Returns NULL with
+ * errno set on failure.
+ */
+socket_t *socket_alloc(int family, int type);
+
+/**
+ * Release a socket and its family state
+ * Called when the last descriptor is closed, or by a family for a socket
+ * that never got one.
+ */
+void socket_free(socket_t *sock);
+
+/**
+ * Sockets of the running process, by descriptor
+ * These back the socket system calls; socket_sendmsg and socket_recvmsg
+ * expect msg->msg_iov to be a kernel copy and msg_name/msg_control to be
+ * checked user memory. All return -1 with errno set on failure.
+ */
+int socket_create(int family, int type, int protocol);
+int socket_pair(int family, int type, int protocol, int fds[2]);
+int socket_bind(int fd, const struct sockaddr *addr, socklen_t len);
+int socket_listen(int fd, int backlog);
+int socket_accept(int fd, uint32_t flags);
+int socket_connect(int fd, const struct sockaddr *addr, socklen_t len);
+int socket_sendmsg(int fd, const struct msghdr *msg, uint32_t flags);
+int socket_recvmsg(int fd, struct msghdr *msg, uint32_t flags);
+
+#endif /* SOCKET_H */
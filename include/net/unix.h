@@ -0,0 +1,37 @@
+/*
+ * unix.h - Unix-domain sockets
+ *
+ * Local stream and datagram sockets. A socket is bound to a path by
+ * creating a file there; connect and sendto look the file up again and
+ * find the socket bound to it. Data is queued on the receiving socket in
+ * pages, and descriptors can travel with it (SCM_RIGHTS).
+ */
+
+#ifndef UNIX_H
+#define UNIX_H
+
+#include <stdint.h>
+#include "net/socket.h"
+
+/* Longest path, including the terminating NUL */
+#define UNIX_PATH_MAX 108
+
+/* Pages of data one queued message can hold, so a datagram or a
+ * chunk of a stream send is at most 64 KiB */
+#define UNIX_MSG_PAGES 16
+
+/* Bytes a socket may have queued for reading before senders wait */
+#define UNIX_RCVBUF (UNIX_MSG_PAGES * 4096)
+
+/**
+ * Unix-domain socket address
+ */
+struct sockaddr_un {
+    uint16_t sun_family;               /* AF_UNIX */
+    char sun_path[UNIX_PATH_MAX];      /* Path, NUL-terminated */
+};
+
+/* The AF_UNIX family, for the socket layer */
+extern const socket_family_t unix_family;
+
+#endif /* UNIX_H */
@@ -0,0 +1,165 @@
+/*
+ * Floating-Point and Vector Context for RISC-V
+ *
+ * Detects the V extension at boot and switches the F/D and vector
+ * registers between user processes. The kernel runs with sstatus.FS and
+ * VS as the interrupted process left them and never touches the registers
+ * itself, so they only need saving when a process made them Dirty and
+ * only need loading when a different process is about to run.
+ */
+
+#include "arch/fpu.h"
+#include "kernel/process.h"
+#include "kernel/kstring.h"
+#include "hal/hal_uart.h"
+#include "mm/kmalloc.h"
+
+// vlenb: vector register length in bytes
+#define CSR_VLENB 0xc22
+
+// Extensions every supported hart has (the kernel is built for rv64gc)
+#define HWCAP_BASE (HWCAP_ISA('i') | HWCAP_ISA('m') | HWCAP_ISA('a') | \
+                    HWCAP_ISA('f') | HWCAP_ISA('d') | HWCAP_ISA('c'))
+
+static int has_vector = 0;
+static size_t vector_bytes = 0;         // Size of a vector save area
+
+// Process whose values are in the registers (NULL = none)
+static struct process *fpu_owner = NULL;
+
+static inline unsigned long read_sstatus(void) {
+    unsigned long value;
+    asm volatile("csrr %0, sstatus" : "=r"(value));
+    return value;
+}
+
+/**
+ * Detect the vector extension
+ *
+ * sstatus.VS is hardwired to zero on a hart without V, so setting it and
+ * reading it back tells the two apart without taking a trap. FS and VS
+ * are left Off: user processes get them through their own sstatus.
+ */
+void fpu_init(void) {
+    asm volatile("csrs sstatus, %0" :: "r"(SSTATUS_VS_INITIAL));
+    if (read_sstatus() & SSTATUS_VS) {
+        unsigned long vlenb;
+        asm volatile("csrr %0, %1" : "=r"(vlenb) : "i"(CSR_VLENB));
+        has_vector = 1;
+        vector_bytes = FPU_VECTOR_HEADER + 32 * vlenb;
+    }
+    asm volatile("csrc sstatus, %0" :: "r"(SSTATUS_FS | SSTATUS_VS));
+    
+    hal_uart_puts("[OK] FPU initialized");
+    if (has_vector) {
+        hal_uart_puts(" (V, VLEN=");
+        kprint_dec((vector_bytes - FPU_VECTOR_HEADER) / 32 * 8);
+        hal_uart_puts(")");
+    }
+    hal_uart_puts("\n");
+}
+
+int fpu_has_vector(void) {
+    return has_vector;
+}
+
+size_t fpu_vector_bytes(void) {
+    return vector_bytes;
+}
+
+/**
+ * Extensions user code may rely on, one bit per ISA letter
+ */
+unsigned long fpu_hwcap(void) {
+    return has_vector ? (HWCAP_BASE | HWCAP_ISA('v')) : HWCAP_BASE;
+}
+
+/**
+ * sstatus FS/VS bits for a new user process
+ *
+ * Initial: the process may use the registers and they start out zero.
+ */
+unsigned long fpu_user_sstatus(void) {
+    return has_vector ? (SSTATUS_FS_INITIAL | SSTATUS_VS_INITIAL) : SSTATUS_FS_INITIAL;
+}
+
+/**
+ * Set up the register save area of a new user process
+ *
+ * @param state State embedded in the process
+ * @return 0 on success, -1 if the vector area cannot be allocated
+ */
+int fpu_state_init(struct fpu_state *state) {
+    kmemset(state, 0, sizeof(*state));
+    if (has_vector) {
+        state->vector = kmalloc(vector_bytes);
+        if (!state->vector) {
+            return -1;
+        }
+        kmemset(state->vector, 0, vector_bytes);
+    }
+    state->enabled = 1;
+    return 0;
+}
+
+/**
+ * Release a process's save area
+ *
+ * The registers may still hold the process's values; forget that, so a
+ * new process in the same slot does not inherit them.
+ */
+void fpu_state_free(struct fpu_state *state) {
+    if (fpu_owner && &fpu_owner->fpu == state) {
+        fpu_owner = NULL;
+    }
+    if (state->vector) {
+        kfree(state->vector);
+        state->vector = NULL;
+    }
+    state->enabled = 0;
+}
+
+/**
+ * Hand the registers from one process to the next
+ *
+ * Called by context_switch() with interrupts disabled, before the kernel
+ * stacks are switched. The live sstatus still belongs to prev, which is
+ * the owner of the registers if it used them at all.
+ *
+ * Returning to user mode keeps the live FS and VS rather than the ones in
+ * the trap frame (trap_entry.S), so marking them Clean here is what lets
+ * the next switch skip the save when next leaves the registers alone.
+ */
+void fpu_switch(struct process *prev, struct process *next) {
+    unsigned long status = read_sstatus();
+    int clean = 0;
+    
+    if (prev && prev->fpu.enabled) {
+        if ((status & SSTATUS_FS) == SSTATUS_FS_DIRTY) {
+            fpu_save_fp(&prev->fpu);
+            clean = 1;
+        }
+        if (has_vector && (status & SSTATUS_VS) == SSTATUS_VS_DIRTY) {
+            fpu_save_vector(prev->fpu.vector);
+            clean = 1;
+        }
+    }
+    
+    if (next && next->fpu.enabled) {
+        if (fpu_owner != next) {
+            fpu_restore_fp(&next->fpu);
+            if (has_vector) {
+                fpu_restore_vector(next->fpu.vector);
+            }
+            fpu_owner = next;
+        }
+        clean = 1;
+    }
+    
+    // The registers now match the save areas
+    if (clean) {
+        unsigned long bits = SSTATUS_FS_CLEAN | (has_vector ? SSTATUS_VS_CLEAN : 0);
+        asm volatile("csrc sstatus, %0" :: "r"(SSTATUS_FS | SSTATUS_VS));
+        asm volatile("csrs sstatus, %0" :: "r"(bits));
+    }
+}
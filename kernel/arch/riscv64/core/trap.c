@@ -79,6 +79,12 @@ static void handle_exception(struct trap_frame *tf, unsigned long cause) {
     if (cause == CAUSE_USER_ECALL) {
         // System call - pass syscall number and arguments from trap frame directly
         
+        // IPC reads and writes message registers beyond a0
+        struct process *proc = process_current();
+        if (proc) {
+            proc->syscall_frame = tf;
+        }
+        
         // Call syscall handler
         uint64_t ret = syscall_handler(tf->a7, tf->a0, tf->a1, tf->a2, tf->a3, tf->a4, tf->a5);
         
@@ -15,6 +15,7 @@ static interrupt_handler_t interrupt_handlers[MAX_INTERRUPT_SOURCES] = {NULL};
 /* CSR definitions for interrupt enable/disable */
 #define CSR_SSTATUS 0x100
 #define SSTATUS_SIE (1UL << 1)  /* Supervisor Interrupt Enable */
+#define SIE_SEIE    (1UL << 9)  /* Supervisor External Interrupt Enable */
 
 /* Forward declarations */
 static void enable_supervisor_interrupts(void);
@@ -186,6 +187,9 @@ void interrupt_enable_irq(uint32_t irq_number)
     }
     
     plic_enable_interrupt(irq_number, context);
+    
+    /* Let PLIC interrupts through to the hart */
+    __asm__ volatile("csrs sie, %0" :: "r"(SIE_SEIE));
 }
 
 /*
@@ -10,6 +10,7 @@
 
 #include "hal/hal_timer.h"
 #include "hal/hal_uart.h"
+#include <stdint.h>
 
 // Timer frequency on QEMU (10 MHz)
 #define TIMER_FREQ 10000000UL
@@ -68,6 +69,9 @@ void hal_timer_init(unsigned long interval_us) {
     sie |= (1 << 5);  // STIE - Supervisor Timer Interrupt Enable
     asm volatile("csrw sie, %0" :: "r"(sie));
     
+    // Let user programs read the time CSR (rdtime) for benchmarks
+    asm volatile("csrs scounteren, %0" :: "r"(1UL << 1));  // TM
+    
     // Enable interrupts globally in sstatus
     unsigned long sstatus;
     asm volatile("csrr %0, sstatus" : "=r"(sstatus));
@@ -119,6 +123,10 @@ void hal_timer_handle_interrupt(void) {
     // Increment tick counter
     ticks++;
     
+    // Make timed sleepers runnable before picking the next process
+    extern void process_wake_expired(uint64_t now);
+    process_wake_expired(ticks);
+    
     // Call scheduler for preemptive multitasking
     extern void schedule(void);
     schedule();
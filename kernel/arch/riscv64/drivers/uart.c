@@ -7,18 +7,23 @@
 
 #include "hal/hal_uart.h"
 
-// UART0 base address on QEMU virt machine
+// UART0 base address and PLIC interrupt on QEMU virt machine
 #define UART0_BASE 0x10000000
+#define UART0_IRQ  10
 
 // UART registers (NS16550A)
 #define UART_RBR (UART0_BASE + 0)  // Receiver Buffer Register (read)
 #define UART_THR (UART0_BASE + 0)  // Transmitter Holding Register (write)
+#define UART_IER (UART0_BASE + 1)  // Interrupt Enable Register
 #define UART_LSR (UART0_BASE + 5)  // Line Status Register
 
 // Line Status Register bits
 #define LSR_DATA_READY (1 << 0)    // Data available to read
 #define LSR_TX_IDLE    (1 << 5)    // Transmitter idle (can write)
 
+// Interrupt Enable Register bits
+#define IER_RX_AVAILABLE (1 << 0)  // Received data available
+
 // Helper to write to UART register
 static inline void uart_write_reg(unsigned long addr, unsigned char val) {
     *(volatile unsigned char *)addr = val;
@@ -88,6 +93,18 @@ char hal_uart_getc(void) {
     return uart_read_reg(UART_RBR);
 }
 
+int hal_uart_try_getc(void) {
+    if ((uart_read_reg(UART_LSR) & LSR_DATA_READY) == 0) {
+        return -1;
+    }
+    return uart_read_reg(UART_RBR);
+}
+
+uint32_t hal_uart_enable_rx_interrupt(void) {
+    uart_write_reg(UART_IER, IER_RX_AVAILABLE);
+    return UART0_IRQ;
+}
+
 void hal_uart_put_uint32(uint32_t value) {
     // Convert to decimal string
     char buffer[11];  // Max 10 digits + null terminator
@@ -13,6 +13,11 @@
 #define ELF_MAGIC 0x464C457F
 #define PT_LOAD   1
 
+/* Segment permission flags (p_flags) */
+#define PF_X      (1 << 0)
+#define PF_W      (1 << 1)
+#define PF_R      (1 << 2)
+
 typedef struct {
     uint32_t magic;
     uint8_t  class;
@@ -51,13 +56,15 @@ typedef struct {
  * Load ELF binary from filesystem and create process
  * 
  * @param path Path to ELF binary
- * @param argv Argument array (unused)
- * @param argc Argument count (unused)
+ * @param argv Argument array, copied onto the new process's stack
+ * @param argc Argument count
  * @return PID of new process, or -1 on error (errno set)
  */
 int elf_load_exec(const char *path, const char *argv[], int argc) {
-    (void)argv;
-    (void)argc;
+    /* Arguments must fit the block reserved at the top of the stack */
+    if (process_args_size(argv, argc) > USER_ARG_MAX) {
+        RETURN_ERRNO(THUNDEROS_E2BIG);
+    }
     
     /* Open file */
     int fd = vfs_open(path, O_RDONLY);
@@ -159,6 +166,38 @@ int elf_load_exec(const char *path, const char *argv[], int argc) {
     /* Zero out the memory */
     kmemset(program_mem_virt, 0, total_size);
     
+    /* Page permissions: each page gets those of the segments on it, so
+     * text is never writable and data never executable unless a page is
+     * shared by both. Like mmap, every mapped page is readable. */
+    uint8_t *page_flags = kmalloc(num_pages);
+    if (!page_flags) {
+        pmm_free_pages(program_phys, num_pages);
+        kfree(phdrs);
+        vfs_close(fd);
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    kmemset(page_flags, 0, num_pages);
+    
+    for (int i = 0; i < ehdr.phnum; i++) {
+        if (phdrs[i].type != PT_LOAD || phdrs[i].memsz == 0) {
+            continue;
+        }
+        
+        uint8_t flags = PTE_R;
+        if (phdrs[i].flags & PF_W) {
+            flags |= PTE_W;
+        }
+        if (phdrs[i].flags & PF_X) {
+            flags |= PTE_X;
+        }
+        
+        size_t first = (phdrs[i].vaddr - min_addr) / PAGE_SIZE;
+        size_t last = (phdrs[i].vaddr + phdrs[i].memsz - min_addr - 1) / PAGE_SIZE;
+        for (size_t page = first; page <= last; page++) {
+            page_flags[page] |= flags;
+        }
+    }
+    
     /* Load each PT_LOAD segment */
     for (int i = 0; i < ehdr.phnum; i++) {
         if (phdrs[i].type != PT_LOAD) {
@@ -171,6 +210,7 @@ int elf_load_exec(const char *path, const char *argv[], int argc) {
         /* Seek to segment data in file */
         if (vfs_seek(fd, phdrs[i].offset, SEEK_SET) < 0) {
             pmm_free_pages(program_phys, num_pages);
+            kfree(page_flags);
             kfree(phdrs);
             vfs_close(fd);
             /* errno already set by vfs_seek */
@@ -182,6 +222,7 @@ int elf_load_exec(const char *path, const char *argv[], int argc) {
             int nread = vfs_read(fd, dest, phdrs[i].filesz);
             if (nread != (int)phdrs[i].filesz) {
                 pmm_free_pages(program_phys, num_pages);
+                kfree(page_flags);
                 kfree(phdrs);
                 vfs_close(fd);
                 RETURN_ERRNO(THUNDEROS_EIO);
@@ -208,7 +249,9 @@ int elf_load_exec(const char *path, const char *argv[], int argc) {
     }
     
     /* Create user process with loaded code and custom entry point */
-    struct process *proc = process_create_elf(program_name, min_addr, program_mem_phys, total_size, ehdr.entry);
+    struct process *proc = process_create_elf(program_name, min_addr, program_mem_phys, total_size,
+                                              page_flags, ehdr.entry, argv, argc);
+    kfree(page_flags);
     
     if (!proc) {
         pmm_free_pages(program_phys, num_pages);
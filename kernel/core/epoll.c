@@ -0,0 +1,506 @@
+/*
+ * epoll Implementation
+ *
+ * Each watch hooks a callback into the wait queues of its file. The
+ * callback appends the watch to the instance's ready list and wakes
+ * epoll_wait(), which takes watches off the list one at a time, asks the
+ * file for its current events and reports them. A level-triggered watch
+ * that reported events goes back on the end of the list, so the next call
+ * looks at it again; an edge-triggered one waits for the next wakeup.
+ *
+ * The ready list is changed with interrupts disabled, since callbacks run
+ * inside wakeups. The tables of watches and the lists of watches per file
+ * are guarded by one lock that yields while taken. Poll operations are
+ * called with that lock held, so they must not close files.
+ */
+
+#include "kernel/epoll.h"
+#include "kernel/poll.h"
+#include "kernel/wait.h"
+#include "kernel/lock.h"
+#include "kernel/kstring.h"
+#include "kernel/errno.h"
+#include "fs/vfs.h"
+#include "hal/hal_timer.h"
+#include "mm/kmalloc.h"
+#include "arch/interrupt.h"
+#include <stddef.h>
+
+// Wait queues one watch may hook
+#define EPOLL_ITEM_QUEUES 2
+
+// Event bits of epoll_item_t.events, without the modes
+#define EPOLL_EVENT_MASK (~(EPOLLET | EPOLLONESHOT))
+
+struct epoll;
+
+/**
+ * Watch of one descriptor
+ */
+typedef struct epoll_item {
+    struct epoll *ep;                   // Instance watching
+    vfs_file_t *file;                   // File watched, NULL for the console
+    int fd;                             // Descriptor it was added by
+    uint32_t events;                    // Events asked for, and modes
+    uint64_t data;                      // Returned with the events
+    wait_queue_entry_t hooks[EPOLL_ITEM_QUEUES];  // Callbacks on the file's queues
+    wait_queue_t *queues[EPOLL_ITEM_QUEUES];      // Queues hooked
+    uint32_t nhooks;                    // Entries in hooks
+    int ready;                          // On the ready list
+    struct epoll_item *ready_next;      // Next on the ready list
+    struct epoll_item *hash_next;       // Next in the bucket
+    struct epoll_item *file_next;       // Next watch of the same file
+} epoll_item_t;
+
+/**
+ * epoll instance
+ */
+typedef struct epoll {
+    epoll_item_t *table[EPOLL_HASH_SIZE];  // Watches, hashed by descriptor
+    epoll_item_t *ready_head;           // Watches that may be ready
+    epoll_item_t *ready_tail;           // Last of them
+    uint32_t nready;                    // Entries on the ready list
+    wait_queue_t wait;                  // epoll_wait() and poll() callers
+    vfs_node_t node;                    // Node the descriptors refer to
+} epoll_t;
+
+/**
+ * Poll table that hooks one watch
+ */
+typedef struct {
+    poll_table_t pt;                    // Passed to the poll operation
+    epoll_item_t *item;                 // Watch being added
+} epoll_hook_table_t;
+
+static yield_lock_t epoll_lock = YIELD_LOCK_INIT;
+
+/**
+ * Append a watch to the ready list, with interrupts disabled
+ */
+static void epoll_ready_add(epoll_t *ep, epoll_item_t *item) {
+    if (item->ready) {
+        return;
+    }
+    item->ready = 1;
+    item->ready_next = NULL;
+    if (ep->ready_tail) {
+        ep->ready_tail->ready_next = item;
+    } else {
+        ep->ready_head = item;
+    }
+    ep->ready_tail = item;
+    ep->nready++;
+}
+
+/**
+ * Take the first watch off the ready list, with interrupts disabled
+ */
+static epoll_item_t *epoll_ready_pop(epoll_t *ep) {
+    epoll_item_t *item = ep->ready_head;
+    if (!item) {
+        return NULL;
+    }
+    ep->ready_head = item->ready_next;
+    if (!ep->ready_head) {
+        ep->ready_tail = NULL;
+    }
+    item->ready = 0;
+    ep->nready--;
+    return item;
+}
+
+/**
+ * Remove a watch from the ready list, with interrupts disabled
+ */
+static void epoll_ready_remove(epoll_t *ep, epoll_item_t *item) {
+    if (!item->ready) {
+        return;
+    }
+    epoll_item_t *prev = NULL;
+    epoll_item_t *cur = ep->ready_head;
+    while (cur != item) {
+        prev = cur;
+        cur = cur->ready_next;
+    }
+    if (prev) {
+        prev->ready_next = item->ready_next;
+    } else {
+        ep->ready_head = item->ready_next;
+    }
+    if (ep->ready_tail == item) {
+        ep->ready_tail = prev;
+    }
+    item->ready = 0;
+    ep->nready--;
+}
+
+/**
+ * Wakeup callback on a watched file's queue
+ */
+static void epoll_callback(wait_queue_entry_t *entry) {
+    epoll_item_t *item = (epoll_item_t *)entry->data;
+    if (!(item->events & EPOLL_EVENT_MASK)) {
+        // Disabled by EPOLLONESHOT until the next EPOLL_CTL_MOD
+        return;
+    }
+    epoll_ready_add(item->ep, item);
+    wait_queue_wake_all(&item->ep->wait);
+}
+
+/**
+ * Hook a queue for a watch, from a poll operation
+ */
+static void epoll_hook(poll_table_t *pt, wait_queue_t *queue) {
+    epoll_item_t *item = ((epoll_hook_table_t *)pt)->item;
+    if (item->nhooks == EPOLL_ITEM_QUEUES) {
+        return;
+    }
+    
+    wait_queue_entry_t *entry = &item->hooks[item->nhooks];
+    entry->func = epoll_callback;
+    entry->data = item;
+    item->queues[item->nhooks++] = queue;
+    wait_queue_add(queue, entry);
+}
+
+/**
+ * Put a watch on the ready list if its file has an event it asks for
+ */
+static void epoll_item_check(epoll_item_t *item, uint32_t events) {
+    if (!(events & (item->events | EPOLLERR | EPOLLHUP) & EPOLL_EVENT_MASK) ||
+        !(item->events & EPOLL_EVENT_MASK)) {
+        return;
+    }
+    
+    int irq_state = interrupt_save_disable();
+    epoll_ready_add(item->ep, item);
+    interrupt_restore(irq_state);
+    wait_queue_wake_all(&item->ep->wait);
+}
+
+/**
+ * Find the watch of a descriptor, with the lock held
+ */
+static epoll_item_t *epoll_find(epoll_t *ep, int fd, vfs_file_t *file) {
+    epoll_item_t *item = ep->table[(uint32_t)fd % EPOLL_HASH_SIZE];
+    while (item && (item->fd != fd || item->file != file)) {
+        item = item->hash_next;
+    }
+    return item;
+}
+
+/**
+ * Add a watch, with the lock held
+ */
+static int epoll_insert(epoll_t *ep, int fd, vfs_file_t *file, const struct epoll_event *event) {
+    epoll_item_t *item = (epoll_item_t *)kmalloc(sizeof(epoll_item_t));
+    if (!item) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    kmemset(item, 0, sizeof(epoll_item_t));
+    item->ep = ep;
+    item->file = file;
+    item->fd = fd;
+    item->events = event->events;
+    item->data = event->data;
+    
+    uint32_t bucket = (uint32_t)fd % EPOLL_HASH_SIZE;
+    item->hash_next = ep->table[bucket];
+    ep->table[bucket] = item;
+    if (file) {
+        item->file_next = file->epoll_items;
+        file->epoll_items = item;
+    }
+    
+    epoll_hook_table_t table;
+    table.pt.queue = epoll_hook;
+    table.item = item;
+    epoll_item_check(item, poll_fd_events(fd, file, &table.pt));
+    return 0;
+}
+
+/**
+ * Unhook and free a watch, with the lock held
+ */
+static void epoll_item_free(epoll_item_t *item) {
+    epoll_t *ep = item->ep;
+    
+    for (uint32_t i = 0; i < item->nhooks; i++) {
+        wait_queue_remove(item->queues[i], &item->hooks[i]);
+    }
+    
+    int irq_state = interrupt_save_disable();
+    epoll_ready_remove(ep, item);
+    interrupt_restore(irq_state);
+    
+    epoll_item_t **link = &ep->table[(uint32_t)item->fd % EPOLL_HASH_SIZE];
+    while (*link != item) {
+        link = &(*link)->hash_next;
+    }
+    *link = item->hash_next;
+    
+    if (item->file) {
+        link = &item->file->epoll_items;
+        while (*link != item) {
+            link = &(*link)->file_next;
+        }
+        *link = item->file_next;
+    }
+    
+    kfree(item);
+}
+
+/**
+ * Look up an epoll descriptor and take a reference to its file
+ */
+static epoll_t *epoll_get(int epfd, vfs_file_t **file) {
+    *file = vfs_file_get(epfd);
+    if (!*file) {
+        // errno already set by vfs_file_get
+        return NULL;
+    }
+    if ((*file)->node->type != VFS_TYPE_EPOLL) {
+        vfs_file_put(*file);
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    return (epoll_t *)(*file)->node->fs_data;
+}
+
+/**
+ * Poll operation of an epoll descriptor: readable when a watch may be
+ */
+static uint32_t epoll_vfs_poll(vfs_node_t *node, poll_table_t *pt) {
+    epoll_t *ep = (epoll_t *)node->fs_data;
+    poll_wait(pt, &ep->wait);
+    
+    int irq_state = interrupt_save_disable();
+    int ready = (ep->ready_head != NULL);
+    interrupt_restore(irq_state);
+    
+    return ready ? POLLIN : 0;
+}
+
+/**
+ * Close the last descriptor of an instance
+ */
+static void epoll_close(vfs_node_t *node) {
+    epoll_t *ep = (epoll_t *)node->fs_data;
+    
+    yield_lock(&epoll_lock);
+    for (uint32_t i = 0; i < EPOLL_HASH_SIZE; i++) {
+        while (ep->table[i]) {
+            epoll_item_free(ep->table[i]);
+        }
+    }
+    yield_unlock(&epoll_lock);
+    
+    kfree(ep);
+}
+
+static vfs_ops_t epoll_ops = {
+    .close = epoll_close,
+    .poll = epoll_vfs_poll,
+};
+
+/**
+ * Create an epoll instance
+ */
+int epoll_create(uint32_t flags) {
+    if (flags & ~EPOLL_CLOEXEC) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    epoll_t *ep = (epoll_t *)kmalloc(sizeof(epoll_t));
+    if (!ep) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    kmemset(ep, 0, sizeof(epoll_t));
+    wait_queue_init(&ep->wait);
+    
+    kstrcpy(ep->node.name, "epoll");
+    ep->node.type = VFS_TYPE_EPOLL;
+    ep->node.fs = NULL;
+    ep->node.fs_data = ep;
+    ep->node.ops = &epoll_ops;
+    
+    int fd = vfs_open_node(&ep->node, O_RDONLY | flags);
+    if (fd < 0) {
+        kfree(ep);
+        // errno already set by vfs_open_node
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Add, change or remove the watch of a descriptor
+ */
+int epoll_ctl(int epfd, int op, int fd, const struct epoll_event *event) {
+    if (op != EPOLL_CTL_ADD && op != EPOLL_CTL_MOD && op != EPOLL_CTL_DEL) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    // The console has no file; anything else is held while it is changed
+    vfs_file_t *file = NULL;
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    if (fd < 0) {
+        RETURN_ERRNO(THUNDEROS_EBADF);
+    }
+    if ((uint32_t)fd < table->capacity && table->files[fd]) {
+        file = vfs_file_get(fd);
+    } else if (fd > VFS_FD_STDERR) {
+        RETURN_ERRNO(THUNDEROS_EBADF);
+    }
+    if (file && file->node->type == VFS_TYPE_EPOLL) {
+        vfs_file_put(file);
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    vfs_file_t *ep_file;
+    epoll_t *ep = epoll_get(epfd, &ep_file);
+    if (!ep) {
+        int error = get_errno();
+        if (file) {
+            vfs_file_put(file);
+        }
+        RETURN_ERRNO(error);
+    }
+    
+    yield_lock(&epoll_lock);
+    int result = 0;
+    epoll_item_t *item = epoll_find(ep, fd, file);
+    if (op == EPOLL_CTL_ADD) {
+        if (item) {
+            set_errno(THUNDEROS_EEXIST);
+            result = -1;
+        } else {
+            result = epoll_insert(ep, fd, file, event);
+        }
+    } else if (!item) {
+        set_errno(THUNDEROS_ENOENT);
+        result = -1;
+    } else if (op == EPOLL_CTL_MOD) {
+        item->events = event->events;
+        item->data = event->data;
+        epoll_item_check(item, poll_fd_events(fd, file, NULL));
+    } else {
+        epoll_item_free(item);
+    }
+    yield_unlock(&epoll_lock);
+    
+    int error = get_errno();
+    vfs_file_put(ep_file);
+    if (file) {
+        vfs_file_put(file);
+    }
+    if (result != 0) {
+        RETURN_ERRNO(error);
+    }
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Report the watches on the ready list, with the lock held
+ * Looks at each watch that was on the list at the start at most once.
+ */
+static int epoll_collect(epoll_t *ep, struct epoll_event *events, int maxevents) {
+    int irq_state = interrupt_save_disable();
+    uint32_t budget = ep->nready;
+    interrupt_restore(irq_state);
+    
+    int count = 0;
+    while (count < maxevents && budget-- > 0) {
+        irq_state = interrupt_save_disable();
+        epoll_item_t *item = epoll_ready_pop(ep);
+        interrupt_restore(irq_state);
+        if (!item) {
+            break;
+        }
+        if (!(item->events & EPOLL_EVENT_MASK)) {
+            continue;
+        }
+        
+        uint32_t revents = poll_fd_events(item->fd, item->file, NULL);
+        revents &= (item->events | EPOLLERR | EPOLLHUP) & EPOLL_EVENT_MASK;
+        if (!revents) {
+            continue;
+        }
+        
+        events[count].events = revents;
+        events[count].data = item->data;
+        count++;
+        
+        if (item->events & EPOLLONESHOT) {
+            item->events &= ~EPOLL_EVENT_MASK;
+        } else if (!(item->events & EPOLLET)) {
+            // Level-triggered: look again on the next call
+            irq_state = interrupt_save_disable();
+            epoll_ready_add(ep, item);
+            interrupt_restore(irq_state);
+        }
+    }
+    return count;
+}
+
+/**
+ * Wait for events on the watched descriptors
+ */
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout_ms) {
+    if (maxevents <= 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    vfs_file_t *ep_file;
+    epoll_t *ep = epoll_get(epfd, &ep_file);
+    if (!ep) {
+        // errno already set by epoll_get
+        return -1;
+    }
+    
+    uint64_t deadline = 0;
+    if (timeout_ms > 0) {
+        deadline = hal_timer_get_ticks() + poll_timeout_ticks(timeout_ms);
+    }
+    
+    int count;
+    while (1) {
+        yield_lock(&epoll_lock);
+        count = epoll_collect(ep, events, maxevents);
+        yield_unlock(&epoll_lock);
+        if (count > 0 || timeout_ms == 0) {
+            break;
+        }
+        
+        int irq_state = interrupt_save_disable();
+        if (!ep->ready_head) {
+            uint64_t ticks = 0;
+            if (deadline) {
+                uint64_t now = hal_timer_get_ticks();
+                if (now >= deadline) {
+                    interrupt_restore(irq_state);
+                    break;
+                }
+                ticks = deadline - now;
+            }
+            wait_queue_sleep_timeout(&ep->wait, ticks);
+        }
+        interrupt_restore(irq_state);
+    }
+    
+    vfs_file_put(ep_file);
+    clear_errno();
+    return count;
+}
+
+/**
+ * Drop every watch of a file
+ */
+void epoll_file_release(vfs_file_t *file) {
+    yield_lock(&epoll_lock);
+    while (file->epoll_items) {
+        epoll_item_free(file->epoll_items);
+    }
+    yield_unlock(&epoll_lock);
+}
@@ -96,6 +96,7 @@ const char *thunderos_strerror(int error_code) {
         case THUNDEROS_EFS_NOSPACE:  return "Directory full";
         case THUNDEROS_EFS_RDONLY:   return "Read-only filesystem";
         case THUNDEROS_EFS_NOTMNT:   return "Filesystem not mounted";
+        case THUNDEROS_EFS_NOTEMPTY: return "Directory not empty";
         
         /* ELF loader errors */
         case THUNDEROS_EELF_MAGIC:   return "Invalid ELF magic number";
@@ -141,6 +142,22 @@ const char *thunderos_strerror(int error_code) {
         case THUNDEROS_EMEM_BADPTE:  return "Invalid page table entry";
         case THUNDEROS_EMEM_DMA:     return "DMA allocation failed";
         
+        /* IPC errors */
+        case THUNDEROS_EPIPE:        return "Broken pipe";
+        case THUNDEROS_ECONNREFUSED: return "Connection refused";
+        case THUNDEROS_ECONNRESET:   return "Connection reset";
+        case THUNDEROS_EADDRINUSE:   return "Address already in use";
+        case THUNDEROS_ENOTCONN:     return "Socket not connected";
+        case THUNDEROS_EISCONN:      return "Socket already connected";
+        case THUNDEROS_ENOTSOCK:     return "Not a socket";
+        case THUNDEROS_EAFNOSUPPORT: return "Address family not supported";
+        case THUNDEROS_EOPNOTSUPP:   return "Operation not supported";
+        case THUNDEROS_EMSGSIZE:     return "Message too long";
+        case THUNDEROS_EPROTOTYPE:   return "Wrong socket type";
+        case THUNDEROS_EADDRNOTAVAIL: return "Address not available";
+        case THUNDEROS_ENETDOWN:     return "Network is down";
+        case THUNDEROS_EPROTONOSUPPORT: return "Protocol not supported";
+        
         default:
             return "Unknown error";
     }
@@ -0,0 +1,153 @@
+/*
+ * Flattened Device Tree Reader
+ * 
+ * Walks the structure block of a device tree blob. Only what boot needs
+ * is implemented; there is no general node or property API.
+ */
+
+#include "kernel/fdt.h"
+#include <stddef.h>
+
+// Structure block tokens
+#define FDT_BEGIN_NODE 0x1
+#define FDT_END_NODE 0x2
+#define FDT_PROP 0x3
+#define FDT_NOP 0x4
+#define FDT_END 0x9
+
+// Blob header (all fields big-endian)
+typedef struct {
+    uint32_t magic;
+    uint32_t totalsize;
+    uint32_t off_dt_struct;
+    uint32_t off_dt_strings;
+    uint32_t off_mem_rsvmap;
+    uint32_t version;
+    uint32_t last_comp_version;
+    uint32_t boot_cpuid_phys;
+    uint32_t size_dt_strings;
+    uint32_t size_dt_struct;
+} fdt_header_t;
+
+// Read a big-endian 32-bit value
+static uint32_t be32(const void *p) {
+    const uint8_t *b = (const uint8_t *)p;
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+// Compare a string of at most max bytes with a NUL-terminated one
+static int str_equals(const char *a, size_t max, const char *b) {
+    size_t i = 0;
+    while (i < max && a[i] && a[i] == b[i]) {
+        i++;
+    }
+    return i < max && a[i] == b[i];
+}
+
+// Read a 32- or 64-bit cell property as an address
+static int read_address(const uint8_t *value, uint32_t len, uintptr_t *out) {
+    if (len == 4) {
+        *out = be32(value);
+        return 0;
+    }
+    if (len == 8) {
+        *out = ((uintptr_t)be32(value) << 32) | be32(value + 4);
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * Find the initrd placed in memory by the boot loader
+ */
+int fdt_find_initrd(uintptr_t dtb, uintptr_t *start, uintptr_t *end) {
+    if (!dtb || !start || !end) {
+        return -1;
+    }
+    
+    const fdt_header_t *header = (const fdt_header_t *)dtb;
+    if (be32(&header->magic) != FDT_MAGIC) {
+        return -1;
+    }
+    
+    // Both blocks must lie within the blob; every read below stays in them
+    uint64_t total = be32(&header->totalsize);
+    uint32_t struct_off = be32(&header->off_dt_struct);
+    uint32_t struct_size = be32(&header->size_dt_struct);
+    uint32_t strings_off = be32(&header->off_dt_strings);
+    uint32_t strings_size = be32(&header->size_dt_strings);
+    if ((uint64_t)struct_off + struct_size > total ||
+        (uint64_t)strings_off + strings_size > total) {
+        return -1;
+    }
+    
+    const uint8_t *structs = (const uint8_t *)dtb + struct_off;
+    const char *strings = (const char *)dtb + strings_off;
+    
+    uint32_t pos = 0;
+    int depth = 0;
+    int in_chosen = 0;
+    int found = 0;
+    
+    while (pos + 4 <= struct_size) {
+        uint32_t token = be32(structs + pos);
+        pos += 4;
+        
+        if (token == FDT_BEGIN_NODE) {
+            const char *name = (const char *)structs + pos;
+            uint32_t max = struct_size - pos;
+            uint32_t len = 0;
+            while (len < max && name[len]) {
+                len++;
+            }
+            if (len == max) {
+                break;
+            }
+            pos = (pos + len + 1 + 3) & ~3U;
+            depth++;
+            
+            // /chosen is a direct child of the root node
+            in_chosen = (depth == 2 && str_equals(name, max, "chosen"));
+        } else if (token == FDT_END_NODE) {
+            if (in_chosen) {
+                break;
+            }
+            depth--;
+        } else if (token == FDT_PROP) {
+            // Length and name offset, then a value that must fit the block
+            if (struct_size - pos < 8) {
+                break;
+            }
+            uint32_t len = be32(structs + pos);
+            uint32_t name_off = be32(structs + pos + 4);
+            if (len > struct_size - pos - 8 || name_off >= strings_size) {
+                break;
+            }
+            const char *name = strings + name_off;
+            const uint8_t *value = structs + pos + 8;
+            pos = (pos + 8 + len + 3) & ~3U;
+            
+            if (!in_chosen) {
+                continue;
+            }
+            uint32_t name_max = strings_size - name_off;
+            if (str_equals(name, name_max, "linux,initrd-start") &&
+                read_address(value, len, start) == 0) {
+                found |= 1;
+            } else if (str_equals(name, name_max, "linux,initrd-end") &&
+                       read_address(value, len, end) == 0) {
+                found |= 2;
+            }
+        } else if (token == FDT_NOP) {
+            continue;
+        } else {
+            // FDT_END or a corrupt blob
+            break;
+        }
+    }
+    
+    if (found != 3 || *end <= *start) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,500 @@
+/*
+ * Synchronous IPC
+ *
+ * An endpoint has two nodes: servers open the server node and may
+ * receive, clients open the client node and may only call. Callers that
+ * find no server waiting queue on the endpoint in arrival order; servers
+ * that find no caller wait on it in a list of their own.
+ *
+ * Messages move straight from the sender's saved registers to the
+ * receiver's, and the long part from one address space to the other
+ * through their page tables, with no kernel buffer in between. All IPC
+ * state is changed with interrupts disabled.
+ */
+
+#include "kernel/ipc.h"
+#include "kernel/process.h"
+#include "kernel/scheduler.h"
+#include "kernel/kstring.h"
+#include "kernel/errno.h"
+#include "fs/vfs.h"
+#include "mm/kmalloc.h"
+#include "mm/paging.h"
+#include "arch/interrupt.h"
+#include <stddef.h>
+
+/**
+ * Endpoint shared by its servers and clients
+ */
+typedef struct ipc_endpoint {
+    char name[IPC_NAME_MAX];            // Name it was created under
+    uint32_t servers;                   // Open server files
+    uint32_t clients;                   // Open client files
+    struct process *receivers;          // Servers waiting for a caller
+    struct process *callers;            // Callers waiting for a server, oldest first
+    struct process *callers_tail;       // Newest waiting caller
+    vfs_node_t server_node;             // Node servers open
+    vfs_node_t client_node;             // Node clients open
+    struct ipc_endpoint *next;          // Next endpoint with a name
+} ipc_endpoint_t;
+
+// Endpoints that some process serves, found by name
+static ipc_endpoint_t *endpoints = NULL;
+
+/**
+ * Compare a name with an endpoint's
+ */
+static int ipc_name_equal(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+/**
+ * Find a served endpoint by name
+ */
+static ipc_endpoint_t *ipc_lookup(const char *name) {
+    for (ipc_endpoint_t *ep = endpoints; ep; ep = ep->next) {
+        if (ipc_name_equal(ep->name, name)) {
+            return ep;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Remove an endpoint from the names
+ */
+static void ipc_unlink(ipc_endpoint_t *ep) {
+    for (ipc_endpoint_t **link = &endpoints; *link; link = &(*link)->next) {
+        if (*link == ep) {
+            *link = ep->next;
+            return;
+        }
+    }
+}
+
+/**
+ * Wake a blocked caller with an error
+ */
+static void ipc_fail(struct process *caller, int error) {
+    caller->ipc.state = IPC_IDLE;
+    caller->ipc.server = NULL;
+    caller->ipc.status = error;
+    process_wakeup(caller);
+}
+
+/**
+ * Copy len bytes from one process's memory to another's
+ * Both addresses are translated through the owners' page tables, so the
+ * copy works whichever address space is live. Only pages the owner could
+ * read (source) or write (destination) from user mode are used. Stops
+ * early at any other page; returns the bytes copied.
+ */
+static uint32_t ipc_copy(struct process *dst, uintptr_t dst_va,
+                         struct process *src, uintptr_t src_va, uint32_t len) {
+    uint32_t done = 0;
+    while (done < len) {
+        uintptr_t dst_pa;
+        uintptr_t src_pa;
+        if (user_virt_to_phys(dst->page_table, dst_va + done, 1, &dst_pa) != 0 ||
+            user_virt_to_phys(src->page_table, src_va + done, 0, &src_pa) != 0) {
+            break;
+        }
+        
+        // Stay inside the current page on both sides
+        uint32_t chunk = len - done;
+        uint32_t dst_room = PAGE_SIZE - ((dst_va + done) & (PAGE_SIZE - 1));
+        uint32_t src_room = PAGE_SIZE - ((src_va + done) & (PAGE_SIZE - 1));
+        if (chunk > dst_room) chunk = dst_room;
+        if (chunk > src_room) chunk = src_room;
+        
+        kmemcpy((void *)translate_phys_to_virt(dst_pa),
+                (const void *)translate_phys_to_virt(src_pa), chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+/**
+ * Move a message from the registers and IPC buffer of one process to
+ * those of another
+ * The long part is cut to fit the receiver's buffer; the tag it gets
+ * holds the length actually delivered.
+ */
+static void ipc_transfer(struct process *from, struct process *to) {
+    struct trap_frame *src = from->syscall_frame;
+    struct trap_frame *dst = to->syscall_frame;
+    
+    uint32_t len = IPC_TAG_LEN(src->a1);
+    if (len > from->ipc.buffer_size) len = from->ipc.buffer_size;
+    if (len > to->ipc.buffer_size) len = to->ipc.buffer_size;
+    if (len > 0) {
+        len = ipc_copy(to, to->ipc.buffer, from, from->ipc.buffer, len);
+    }
+    
+    dst->a1 = IPC_TAG(IPC_TAG_LABEL(src->a1), len);
+    dst->a2 = src->a2;
+    dst->a3 = src->a3;
+    dst->a4 = src->a4;
+    dst->a5 = src->a5;
+    dst->a6 = src->a6;
+}
+
+/**
+ * Get the endpoint open on a descriptor
+ * With server set, the descriptor must be open on the server node.
+ */
+static ipc_endpoint_t *ipc_get_endpoint(int fd, int server) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file) {
+        /* errno already set by vfs_get_file */
+        return NULL;
+    }
+    
+    vfs_node_t *node = file->node;
+    if (node->type != VFS_TYPE_ENDPOINT) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    
+    ipc_endpoint_t *ep = (ipc_endpoint_t *)node->fs_data;
+    if (server && node != &ep->server_node) {
+        set_errno(THUNDEROS_EBADF);
+        return NULL;
+    }
+    return ep;
+}
+
+/**
+ * Close a server file: once the last server is gone the name is dropped
+ * and waiting callers get ECONNRESET
+ */
+static void ipc_server_close(vfs_node_t *node) {
+    ipc_endpoint_t *ep = (ipc_endpoint_t *)node->fs_data;
+    
+    int irq_state = interrupt_save_disable();
+    ep->servers--;
+    if (ep->servers == 0) {
+        ipc_unlink(ep);
+        while (ep->callers) {
+            struct process *caller = ep->callers;
+            ep->callers = caller->ipc.next;
+            caller->ipc.queued_on = NULL;
+            ipc_fail(caller, THUNDEROS_ECONNRESET);
+        }
+        ep->callers_tail = NULL;
+        
+        // Servers still queued are exiting; the endpoint may be freed
+        while (ep->receivers) {
+            struct process *server = ep->receivers;
+            ep->receivers = server->ipc.next;
+            server->ipc.queued_on = NULL;
+        }
+    }
+    int last = (ep->servers == 0 && ep->clients == 0);
+    interrupt_restore(irq_state);
+    
+    if (last) {
+        kfree(ep);
+    }
+}
+
+/**
+ * Close a client file
+ */
+static void ipc_client_close(vfs_node_t *node) {
+    ipc_endpoint_t *ep = (ipc_endpoint_t *)node->fs_data;
+    
+    int irq_state = interrupt_save_disable();
+    ep->clients--;
+    int last = (ep->servers == 0 && ep->clients == 0);
+    interrupt_restore(irq_state);
+    
+    if (last) {
+        kfree(ep);
+    }
+}
+
+static vfs_ops_t ipc_server_ops = {
+    .close = ipc_server_close,
+};
+
+static vfs_ops_t ipc_client_ops = {
+    .close = ipc_client_close,
+};
+
+/**
+ * Set up one node of an endpoint
+ */
+static void ipc_init_node(vfs_node_t *node, ipc_endpoint_t *ep, vfs_ops_t *ops) {
+    kstrcpy(node->name, ep->name);
+    node->inode = 0;
+    node->size = 0;
+    node->type = VFS_TYPE_ENDPOINT;
+    node->flags = 0;
+    node->fs = NULL;
+    node->fs_data = ep;
+    node->ops = ops;
+}
+
+/**
+ * Create an endpoint and give it a name
+ * Returns NULL with ENOMEM if there is no memory.
+ */
+static ipc_endpoint_t *ipc_create(const char *name) {
+    ipc_endpoint_t *ep = (ipc_endpoint_t *)kmalloc(sizeof(ipc_endpoint_t));
+    if (!ep) {
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    
+    kmemset(ep, 0, sizeof(ipc_endpoint_t));
+    kstrcpy(ep->name, name);
+    ipc_init_node(&ep->server_node, ep, &ipc_server_ops);
+    ipc_init_node(&ep->client_node, ep, &ipc_client_ops);
+    
+    ep->next = endpoints;
+    endpoints = ep;
+    return ep;
+}
+
+/**
+ * Open an endpoint by name
+ */
+int ipc_endpoint_open(const char *name, uint32_t flags) {
+    if (flags & ~(O_CREAT | O_EXCL | O_CLOEXEC)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    size_t len = kstrlen(name);
+    if (len == 0 || len >= IPC_NAME_MAX) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    int server = (flags & O_CREAT) != 0;
+    
+    int irq_state = interrupt_save_disable();
+    ipc_endpoint_t *ep = ipc_lookup(name);
+    if (ep && server && (flags & O_EXCL)) {
+        interrupt_restore(irq_state);
+        RETURN_ERRNO(THUNDEROS_EEXIST);
+    }
+    if (!ep && !server) {
+        interrupt_restore(irq_state);
+        RETURN_ERRNO(THUNDEROS_ENOENT);
+    }
+    if (!ep) {
+        ep = ipc_create(name);
+        if (!ep) {
+            interrupt_restore(irq_state);
+            /* errno already set by ipc_create */
+            return -1;
+        }
+    }
+    
+    // Count the file before opening it so a close elsewhere cannot free
+    // the endpoint under us
+    if (server) {
+        ep->servers++;
+    } else {
+        ep->clients++;
+    }
+    interrupt_restore(irq_state);
+    
+    vfs_node_t *node = server ? &ep->server_node : &ep->client_node;
+    int fd = vfs_open_node(node, O_RDWR | (flags & O_CLOEXEC));
+    if (fd < 0) {
+        int error = get_errno();
+        node->ops->close(node);
+        RETURN_ERRNO(error);
+    }
+    return fd;
+}
+
+/**
+ * Set the current process's IPC buffer
+ */
+int ipc_set_buffer(uintptr_t buffer, size_t size) {
+    struct process *self = process_current();
+    if (!self) {
+        RETURN_ERRNO(THUNDEROS_ESRCH);
+    }
+    
+    // Kernel memory is mapped in every process, so stay below it
+    if (buffer && (buffer >= USER_MMAP_END || size > USER_MMAP_END - buffer)) {
+        RETURN_ERRNO(THUNDEROS_EFAULT);
+    }
+    
+    self->ipc.buffer = buffer;
+    self->ipc.buffer_size = buffer ? size : 0;
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Send a message to an endpoint and wait for the reply
+ */
+int ipc_call(int fd) {
+    struct process *self = process_current();
+    ipc_endpoint_t *ep = ipc_get_endpoint(fd, 0);
+    if (!ep) {
+        /* errno already set by ipc_get_endpoint */
+        return -1;
+    }
+    
+    int irq_state = interrupt_save_disable();
+    if (ep->servers == 0) {
+        interrupt_restore(irq_state);
+        RETURN_ERRNO(THUNDEROS_ECONNREFUSED);
+    }
+    
+    self->ipc.status = 0;
+    struct process *server = ep->receivers;
+    if (server) {
+        // A server is waiting: hand it the message and the CPU
+        ep->receivers = server->ipc.next;
+        server->ipc.queued_on = NULL;
+        ipc_transfer(self, server);
+        server->ipc.state = IPC_IDLE;
+        server->ipc.reply_to = self;
+        self->ipc.state = IPC_WAIT_REPLY;
+        self->ipc.server = server;
+        scheduler_handoff(server);
+    } else {
+        // Queue until a server receives us
+        self->ipc.state = IPC_SEND;
+        self->ipc.server = NULL;
+        self->ipc.next = NULL;
+        self->ipc.queued_on = ep;
+        if (ep->callers_tail) {
+            ep->callers_tail->ipc.next = self;
+        } else {
+            ep->callers = self;
+        }
+        ep->callers_tail = self;
+    }
+    while (self->ipc.state != IPC_IDLE) {
+        process_sleep(0);
+        interrupt_restore(irq_state);
+        irq_state = interrupt_save_disable();
+    }
+    interrupt_restore(irq_state);
+    
+    // The reply is in our registers now, unless the server went away
+    if (self->ipc.status != 0) {
+        RETURN_ERRNO(self->ipc.status);
+    }
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Reply to the last caller received, if any, and wait for the next
+ */
+int ipc_reply_wait(int fd) {
+    struct process *self = process_current();
+    ipc_endpoint_t *ep = ipc_get_endpoint(fd, 1);
+    if (!ep) {
+        /* errno already set by ipc_get_endpoint */
+        return -1;
+    }
+    
+    int irq_state = interrupt_save_disable();
+    
+    // Answer the pending caller before our registers are reused
+    struct process *client = self->ipc.reply_to;
+    self->ipc.reply_to = NULL;
+    if (client) {
+        ipc_transfer(self, client);
+        client->ipc.state = IPC_IDLE;
+        client->ipc.server = NULL;
+    }
+    
+    struct process *caller = ep->callers;
+    if (caller) {
+        // Someone is already queued: take its message and keep running
+        ep->callers = caller->ipc.next;
+        if (!ep->callers) {
+            ep->callers_tail = NULL;
+        }
+        caller->ipc.queued_on = NULL;
+        ipc_transfer(caller, self);
+        caller->ipc.state = IPC_WAIT_REPLY;
+        caller->ipc.server = self;
+        self->ipc.reply_to = caller;
+        if (client) {
+            process_wakeup(client);
+        }
+    } else {
+        // Wait for a caller, giving the rest of our time to the client
+        self->ipc.state = IPC_RECEIVE;
+        self->ipc.next = ep->receivers;
+        self->ipc.queued_on = ep;
+        ep->receivers = self;
+        if (client) {
+            scheduler_handoff(client);
+        }
+        while (self->ipc.state == IPC_RECEIVE) {
+            process_sleep(0);
+            interrupt_restore(irq_state);
+            irq_state = interrupt_save_disable();
+        }
+    }
+    
+    // A caller has put its message in our registers
+    int pid = self->ipc.reply_to->pid;
+    interrupt_restore(irq_state);
+    
+    clear_errno();
+    return pid;
+}
+
+/**
+ * Remove a process from the endpoint queue it is on, if any
+ * Called with interrupts disabled.
+ */
+static void ipc_dequeue(struct process *proc) {
+    ipc_endpoint_t *ep = proc->ipc.queued_on;
+    if (!ep) {
+        return;
+    }
+    proc->ipc.queued_on = NULL;
+    
+    struct process **link = &ep->receivers;
+    while (*link && *link != proc) {
+        link = &(*link)->ipc.next;
+    }
+    if (*link) {
+        *link = proc->ipc.next;
+        return;
+    }
+    
+    struct process *prev = NULL;
+    link = &ep->callers;
+    while (*link && *link != proc) {
+        prev = *link;
+        link = &(*link)->ipc.next;
+    }
+    if (*link) {
+        *link = proc->ipc.next;
+        if (ep->callers_tail == proc) {
+            ep->callers_tail = prev;
+        }
+    }
+}
+
+/**
+ * Release an exiting process's IPC state
+ */
+void ipc_release(struct process *proc) {
+    int irq_state = interrupt_save_disable();
+    ipc_dequeue(proc);
+    struct process *caller = proc->ipc.reply_to;
+    proc->ipc.reply_to = NULL;
+    if (caller && caller->ipc.state == IPC_WAIT_REPLY && caller->ipc.server == proc) {
+        ipc_fail(caller, THUNDEROS_ECONNRESET);
+    }
+    interrupt_restore(irq_state);
+}
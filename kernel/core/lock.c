@@ -0,0 +1,30 @@
+/*
+ * Yield Lock Implementation
+ */
+
+#include "kernel/lock.h"
+#include "kernel/process.h"
+
+/**
+ * Initialize a free lock
+ */
+void yield_lock_init(yield_lock_t *lock) {
+    lock->locked = 0;
+}
+
+/**
+ * Acquire a lock, yielding until it is free
+ */
+void yield_lock(yield_lock_t *lock) {
+    while (__sync_lock_test_and_set(&lock->locked, 1)) {
+        // Holder may be a preempted process; let it run
+        process_yield();
+    }
+}
+
+/**
+ * Release a lock taken with yield_lock()
+ */
+void yield_unlock(yield_lock_t *lock) {
+    __sync_lock_release(&lock->locked);
+}
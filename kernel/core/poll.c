@@ -0,0 +1,205 @@
+/*
+ * poll() Implementation
+ *
+ * The first scan of the descriptors hooks an entry into every wait queue
+ * their poll operations name. A wakeup on any of them marks the call as
+ * triggered and wakes the caller, which scans again. The entries are
+ * removed before returning, so they can live in one allocation for the
+ * whole call.
+ */
+
+#include "kernel/poll.h"
+#include "kernel/wait.h"
+#include "kernel/process.h"
+#include "kernel/config.h"
+#include "kernel/errno.h"
+#include "drivers/console.h"
+#include "fs/vfs.h"
+#include "hal/hal_timer.h"
+#include "mm/kmalloc.h"
+#include "arch/interrupt.h"
+#include <stddef.h>
+
+// Wait queues one descriptor may hook (both directions of a pipe or socket)
+#define POLL_QUEUES_PER_FD 2
+
+/**
+ * One hooked wait queue
+ */
+typedef struct {
+    wait_queue_entry_t entry;           // Entry on the queue
+    wait_queue_t *queue;                // Queue it is on
+} poll_hook_t;
+
+/**
+ * State of one poll() call
+ */
+typedef struct {
+    poll_table_t pt;                    // Passed to poll operations
+    struct process *proc;               // Caller
+    volatile int triggered;             // Woken since the last scan
+    poll_hook_t *hooks;                 // POLL_QUEUES_PER_FD per descriptor
+    uint32_t nhooks;                    // Hooks in use
+    uint32_t max_hooks;                 // Hooks allocated
+} poll_call_t;
+
+/**
+ * Wakeup callback of a hooked queue
+ */
+static void poll_wake(wait_queue_entry_t *entry) {
+    poll_call_t *call = (poll_call_t *)entry->data;
+    call->triggered = 1;
+    process_wakeup(call->proc);
+}
+
+/**
+ * Hook a queue for the call, from a poll operation
+ */
+static void poll_queue(poll_table_t *pt, wait_queue_t *queue) {
+    poll_call_t *call = (poll_call_t *)pt;
+    if (call->nhooks == call->max_hooks) {
+        return;
+    }
+    
+    poll_hook_t *hook = &call->hooks[call->nhooks++];
+    hook->entry.func = poll_wake;
+    hook->entry.data = call;
+    hook->queue = queue;
+    wait_queue_add(queue, &hook->entry);
+}
+
+/**
+ * Events a descriptor is ready for
+ */
+uint32_t poll_fd_events(int fd, vfs_file_t *file, poll_table_t *pt) {
+    if (!file) {
+        // The console: stdin reads typed input, output never waits
+        return (fd == VFS_FD_STDIN) ? console_poll(pt) : POLLOUT;
+    }
+    
+    vfs_node_t *node = file->node;
+    if (node && node->ops && node->ops->poll) {
+        return node->ops->poll(node, pt);
+    }
+    return POLLIN | POLLOUT;
+}
+
+/**
+ * Convert a poll timeout to timer ticks
+ */
+uint64_t poll_timeout_ticks(int timeout_ms) {
+    uint64_t us = (uint64_t)timeout_ms * 1000;
+    return (us + TIMER_INTERVAL_US - 1) / TIMER_INTERVAL_US;
+}
+
+/**
+ * Look at every descriptor once
+ * files[] holds a reference to each file for the whole call; pt is only
+ * passed on the first scan.
+ *
+ * @return Number of entries with revents set
+ */
+static int poll_scan(struct pollfd *fds, vfs_file_t **files, uint32_t nfds, poll_table_t *pt) {
+    int count = 0;
+    for (uint32_t i = 0; i < nfds; i++) {
+        fds[i].revents = 0;
+        if (fds[i].fd < 0) {
+            continue;
+        }
+        
+        uint32_t events;
+        if (!files[i] && fds[i].fd > VFS_FD_STDERR) {
+            events = POLLNVAL;
+        } else {
+            events = poll_fd_events(fds[i].fd, files[i], pt);
+            events &= (uint16_t)fds[i].events | POLLERR | POLLHUP;
+        }
+        
+        if (events) {
+            fds[i].revents = (short)events;
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Wait until one of a set of descriptors is ready
+ */
+int poll_fds(struct pollfd *fds, uint32_t nfds, int timeout_ms) {
+    if (nfds > POLL_MAX_FDS) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    poll_call_t call;
+    call.pt.queue = poll_queue;
+    call.proc = process_current();
+    call.triggered = 0;
+    call.nhooks = 0;
+    call.max_hooks = nfds * POLL_QUEUES_PER_FD;
+    call.hooks = NULL;
+    
+    vfs_file_t **files = NULL;
+    if (nfds > 0) {
+        files = (vfs_file_t **)kmalloc(nfds * sizeof(vfs_file_t *));
+        call.hooks = (poll_hook_t *)kmalloc(call.max_hooks * sizeof(poll_hook_t));
+        if (!files || !call.hooks) {
+            kfree(files);
+            kfree(call.hooks);
+            RETURN_ERRNO(THUNDEROS_ENOMEM);
+        }
+    }
+    
+    // Hold the files so their queues stay put while hooked
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    for (uint32_t i = 0; i < nfds; i++) {
+        int fd = fds[i].fd;
+        files[i] = NULL;
+        if (fd >= 0 && (uint32_t)fd < table->capacity && table->files[fd]) {
+            files[i] = vfs_file_get(fd);
+        }
+    }
+    
+    // Without a process to wake there is nothing to sleep on
+    poll_table_t *pt = (timeout_ms != 0 && call.proc) ? &call.pt : NULL;
+    int count = poll_scan(fds, files, nfds, pt);
+    
+    uint64_t deadline = 0;
+    if (timeout_ms > 0) {
+        deadline = hal_timer_get_ticks() + poll_timeout_ticks(timeout_ms);
+    }
+    
+    while (count == 0 && pt) {
+        int irq_state = interrupt_save_disable();
+        if (!call.triggered) {
+            uint64_t ticks = 0;
+            if (deadline) {
+                uint64_t now = hal_timer_get_ticks();
+                if (now >= deadline) {
+                    interrupt_restore(irq_state);
+                    break;
+                }
+                ticks = deadline - now;
+            }
+            process_sleep(ticks);
+        }
+        call.triggered = 0;
+        interrupt_restore(irq_state);
+        
+        count = poll_scan(fds, files, nfds, NULL);
+    }
+    
+    for (uint32_t i = 0; i < call.nhooks; i++) {
+        wait_queue_remove(call.hooks[i].queue, &call.hooks[i].entry);
+    }
+    for (uint32_t i = 0; i < nfds; i++) {
+        if (files[i]) {
+            vfs_file_put(files[i]);
+        }
+    }
+    kfree(files);
+    kfree(call.hooks);
+    
+    clear_errno();
+    return count;
+}
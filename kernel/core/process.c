@@ -9,8 +9,13 @@
 #include "mm/pmm.h"
 #include "mm/kmalloc.h"
 #include "mm/paging.h"
+#include "mm/mmap.h"
 #include "hal/hal_uart.h"
+#include "hal/hal_timer.h"
 #include "kernel/elf_loader.h"
+#include "fs/vfs.h"
+#include "arch/interrupt.h"
+#include "arch/fpu.h"
 #include <stddef.h>
 
 // Process table
@@ -25,15 +30,25 @@ static pid_t next_pid = 1;
 // Lock for process table (simple spinlock)
 static volatile int process_lock = 0;
 
+// Interrupt state saved by lock_acquire
+static int process_lock_irq = 0;
+
 // Simple spinlock functions
+// Interrupt handlers wake processes, so the lock is held with interrupts
+// disabled; otherwise a handler could spin forever on a lock held by the
+// code it interrupted.
 static inline void lock_acquire(volatile int *lock) {
+    int irq_state = interrupt_save_disable();
     while (__sync_lock_test_and_set(lock, 1)) {
         // Spin
     }
+    process_lock_irq = irq_state;
 }
 
 static inline void lock_release(volatile int *lock) {
+    int irq_state = process_lock_irq;
     __sync_lock_release(lock);
+    interrupt_restore(irq_state);
 }
 
 /**
@@ -60,6 +75,10 @@ void process_init(void) {
     init_proc->exit_code = 0;
     init_proc->errno_value = 0;
     init_proc->trap_frame = NULL;
+    init_proc->fd_table = NULL;  // Uses the kernel descriptor table
+    init_proc->vm_areas = NULL;
+    init_proc->syscall_frame = NULL;
+    kmemset(&init_proc->ipc, 0, sizeof(ipc_thread_t));
     
     current_process = init_proc;
     
@@ -106,6 +125,12 @@ static struct process *alloc_process(void) {
         if (process_table[i].state == PROC_UNUSED) {
             // Mark slot as being allocated to prevent race conditions
             process_table[i].state = PROC_EMBRYO;
+            process_table[i].fd_table = NULL;
+            process_table[i].vm_areas = NULL;
+            process_table[i].wake_tick = 0;
+            process_table[i].syscall_frame = NULL;
+            kmemset(&process_table[i].ipc, 0, sizeof(ipc_thread_t));
+            kmemset(&process_table[i].fpu, 0, sizeof(struct fpu_state));
             lock_release(&process_lock);
             return &process_table[i];
         }
@@ -139,6 +164,17 @@ struct process *process_get(pid_t pid) {
 void process_free(struct process *proc) {
     if (!proc) return;
     
+    // Closing files may sleep, so do it before taking the lock
+    if (proc->fd_table) {
+        vfs_fd_table_destroy(proc->fd_table);
+        proc->fd_table = NULL;
+    }
+    
+    // Drop mapped pages while the page table still exists
+    mmap_release(proc);
+    
+    fpu_state_free(&proc->fpu);
+    
     lock_acquire(&process_lock);
     
     // Free allocated memory regions
@@ -249,6 +285,12 @@ struct process *process_create(const char *name, void (*entry_point)(void *), vo
     kstrncpy(proc->name, name, PROC_NAME_LEN - 1);
     proc->name[PROC_NAME_LEN - 1] = '\0';
     
+    // Inherit the creator's open files
+    proc->fd_table = vfs_fd_table_clone(vfs_current_fd_table());
+    if (!proc->fd_table) {
+        kernel_panic("process_create: Failed to allocate file descriptor table");
+    }
+    
     // Allocate kernel stack for trap handling and context switching
     proc->kernel_stack = (uintptr_t)kmalloc(KERNEL_STACK_SIZE);
     if (!proc->kernel_stack) {
@@ -309,6 +351,13 @@ void process_exit(int exit_code) {
         }
     }
     
+    // Close open files and unmap shared memory now rather than when the
+    // zombie is reaped
+    vfs_fd_table_destroy(proc->fd_table);
+    proc->fd_table = NULL;
+    mmap_release(proc);
+    ipc_release(proc);
+    
     lock_acquire(&process_lock);
     
     // Mark as zombie and record exit code
@@ -399,10 +448,11 @@ int process_has_children(struct process *parent, int target_pid) {
 /**
  * User process sleep
  * 
- * Marks process as sleeping and yields to scheduler.
- * TODO: Implement timer-based wakeup queue for actual sleep functionality.
+ * Marks process as sleeping and yields to scheduler. The timer interrupt
+ * wakes the process once the ticks have passed; with ticks == 0 it sleeps
+ * until process_wakeup().
  * 
- * @param ticks Number of ticks to sleep (currently unused)
+ * @param ticks Number of ticks to sleep (0 = until woken)
  */
 void process_sleep(uint64_t ticks) {
     struct process *proc = current_process;
@@ -410,13 +460,37 @@ void process_sleep(uint64_t ticks) {
     
     lock_acquire(&process_lock);
     proc->state = PROC_SLEEPING;
-    // TODO: Add to sleep queue with wakeup time
-    (void)ticks;  // Mark unused parameter
+    proc->wake_tick = ticks ? hal_timer_get_ticks() + ticks : 0;
     lock_release(&process_lock);
     
     process_yield();
 }
 
+/**
+ * Wake processes whose sleep timeout has expired
+ * 
+ * Called from the timer interrupt. If the process table is busy the scan
+ * is skipped; the sleepers are picked up on a later tick.
+ * 
+ * @param now Current tick count
+ */
+void process_wake_expired(uint64_t now) {
+    if (__sync_lock_test_and_set(&process_lock, 1)) {
+        return;
+    }
+    
+    for (int i = 0; i < MAX_PROCS; i++) {
+        struct process *p = &process_table[i];
+        if (p->state == PROC_SLEEPING && p->wake_tick != 0 && p->wake_tick <= now) {
+            p->wake_tick = 0;
+            p->state = PROC_READY;
+            scheduler_enqueue(p);
+        }
+    }
+    
+    __sync_lock_release(&process_lock);
+}
+
 /**
  * Wake up a sleeping process
  * 
@@ -429,6 +503,7 @@ void process_wakeup(struct process *proc) {
     
     lock_acquire(&process_lock);
     if (proc->state == PROC_SLEEPING) {
+        proc->wake_tick = 0;
         proc->state = PROC_READY;
         scheduler_enqueue(proc);
     }
@@ -518,6 +593,19 @@ struct process *process_create_user(const char *name, void *user_code, size_t co
     kstrncpy(proc->name, name, PROC_NAME_LEN - 1);
     proc->name[PROC_NAME_LEN - 1] = '\0';
     
+    // Inherit the creator's open files
+    proc->fd_table = vfs_fd_table_clone(vfs_current_fd_table());
+    if (!proc->fd_table) {
+        process_free(proc);
+        return NULL;
+    }
+    
+    // Let the process use the FP and vector registers, starting from zero
+    if (fpu_state_init(&proc->fpu) != 0) {
+        process_free(proc);
+        return NULL;
+    }
+    
     // Create isolated user page table with kernel memory mappings
     proc->page_table = create_user_page_table();
     if (!proc->page_table) {
@@ -567,7 +655,7 @@ struct process *process_create_user(const char *name, void *user_code, size_t co
     // Set sstatus for user mode return:
     // SPIE=1 (enable interrupts after sret)
     // SPP=0 (return to user mode, not supervisor)
-    proc->trap_frame->sstatus = (1 << 5);  // SPIE=1, SPP=0
+    proc->trap_frame->sstatus = (1 << 5) | fpu_user_sstatus();  // SPIE=1, SPP=0, FS/VS=Initial
     
     // Setup kernel context for initial context switch
     kmemset(&proc->context, 0, sizeof(struct context));
@@ -602,8 +690,10 @@ struct process *process_create_user(const char *name, void *user_code, size_t co
  */
 struct process *process_create_elf(const char *name, uint64_t code_base, 
                                    void *code_mem, size_t code_size, 
-                                   uint64_t entry_point) {
-    if (!name || !code_mem || code_size == 0) {
+                                   const uint8_t *page_flags,
+                                   uint64_t entry_point,
+                                   const char *argv[], int argc) {
+    if (!name || !code_mem || code_size == 0 || !page_flags) {
         return NULL;
     }
     
@@ -620,6 +710,19 @@ struct process *process_create_elf(const char *name, uint64_t code_base,
     kstrncpy(proc->name, name, PROC_NAME_LEN - 1);
     proc->name[PROC_NAME_LEN - 1] = '\0';
     
+    // Inherit the creator's open files
+    proc->fd_table = vfs_fd_table_clone(vfs_current_fd_table());
+    if (!proc->fd_table) {
+        process_free(proc);
+        return NULL;
+    }
+    
+    // Let the process use the FP and vector registers, starting from zero
+    if (fpu_state_init(&proc->fpu) != 0) {
+        process_free(proc);
+        return NULL;
+    }
+    
     // Allocate kernel stack
     proc->kernel_stack = (uintptr_t)kmalloc(KERNEL_STACK_SIZE);
     if (!proc->kernel_stack) {
@@ -642,9 +745,14 @@ struct process *process_create_elf(const char *name, uint64_t code_base,
         uintptr_t vaddr = code_base + (i * PAGE_SIZE);
         uintptr_t paddr = (uintptr_t)code_mem + (i * PAGE_SIZE);
         
-        // Map as user-readable, executable
+        // Gaps between segments stay unmapped
+        if (page_flags[i] == 0) {
+            continue;
+        }
+        
+        // Map with the permissions of the segments on this page
         if (map_page(proc->page_table, vaddr, paddr, 
-                           PTE_V | PTE_R | PTE_X | PTE_U) != 0) {
+                           PTE_V | PTE_U | page_flags[i]) != 0) {
             free_page_table(proc->page_table);
             kfree((void *)proc->kernel_stack);
             process_free(proc);
@@ -699,6 +807,9 @@ struct process *process_create_elf(const char *name, uint64_t code_base,
     // Set stack pointer to top of user stack (grows downward)
     proc->trap_frame->sp = USER_STACK_TOP;
     
+    // Put argc/argv on the stack before anything can run the process
+    process_setup_args(proc, argv, argc);
+    
     // Set sstatus for user mode return:
     // SPIE=1 (enable interrupts after sret)
     // SPP=0 (return to user mode, not supervisor)
@@ -707,6 +818,8 @@ struct process *process_create_elf(const char *name, uint64_t code_base,
     asm volatile("csrr %0, sstatus" : "=r"(sstatus));
     sstatus &= ~(1 << 8);  // Clear SPP (bit 8) = return to user mode
     sstatus |= (1 << 5);   // Set SPIE (bit 5) = enable interrupts after sret
+    sstatus &= ~(SSTATUS_FS | SSTATUS_VS);
+    sstatus |= fpu_user_sstatus();  // FS/VS=Initial: registers start out zero
     proc->trap_frame->sstatus = sstatus;
     
     // Setup kernel context for initial context switch
@@ -733,6 +846,94 @@ struct process *process_create_elf(const char *name, uint64_t code_base,
     return proc;
 }
 
+// Round a size up to the stack alignment
+#define ARG_ALIGN(x) (((x) + STACK_ALIGNMENT - 1) & ~(size_t)(STACK_ALIGNMENT - 1))
+
+/**
+ * Bytes the argument block of argv takes on a user stack
+ */
+size_t process_args_size(const char *argv[], int argc) {
+    if (!argv || argc < 0) {
+        argc = 0;
+    }
+    
+    size_t strings = 0;
+    for (int i = 0; i < argc; i++) {
+        strings += kstrlen(argv[i]) + 1;
+    }
+    
+    // argc, argv[0..argc-1], argv NULL, envp NULL
+    size_t words = (size_t)argc + 3;
+    return ARG_ALIGN(strings) + ARG_ALIGN(words * sizeof(uint64_t));
+}
+
+/**
+ * Copy bytes into a process's user stack through its page table
+ * 
+ * The stack is not mapped in the current address space, so each page is
+ * reached through its physical address.
+ */
+static void user_stack_write(struct process *proc, uintptr_t vaddr,
+                             const void *src, size_t len) {
+    const uint8_t *from = (const uint8_t *)src;
+    while (len > 0) {
+        size_t offset = vaddr & (PAGE_SIZE - 1);
+        size_t chunk = PAGE_SIZE - offset;
+        if (chunk > len) {
+            chunk = len;
+        }
+        
+        uintptr_t paddr;
+        if (virt_to_phys(proc->page_table, vaddr & ~(uintptr_t)(PAGE_SIZE - 1), &paddr) != 0) {
+            return;
+        }
+        kmemcpy((uint8_t *)translate_phys_to_virt(paddr) + offset, from, chunk);
+        
+        vaddr += chunk;
+        from += chunk;
+        len -= chunk;
+    }
+}
+
+/**
+ * Set up process arguments (argc, argv)
+ * 
+ * Layout from the top of the stack down: the strings, padding, then
+ * argc, argv[0..argc-1], NULL and envp's NULL at the new stack pointer.
+ */
+void process_setup_args(struct process *proc, const char *argv[], int argc) {
+    if (!proc || !proc->trap_frame) {
+        return;
+    }
+    if (!argv || argc < 0) {
+        argc = 0;
+    }
+    
+    size_t words = (size_t)argc + 3;
+    uintptr_t sp = USER_STACK_TOP - process_args_size(argv, argc);
+    uintptr_t strings = sp + ARG_ALIGN(words * sizeof(uint64_t));
+    
+    uint64_t word = (uint64_t)argc;
+    user_stack_write(proc, sp, &word, sizeof(word));
+    
+    for (int i = 0; i < argc; i++) {
+        size_t len = kstrlen(argv[i]) + 1;
+        user_stack_write(proc, strings, argv[i], len);
+        word = strings;
+        user_stack_write(proc, sp + (size_t)(i + 1) * sizeof(uint64_t), &word, sizeof(word));
+        strings += len;
+    }
+    
+    // argv and envp terminators
+    word = 0;
+    user_stack_write(proc, sp + (size_t)(argc + 1) * sizeof(uint64_t), &word, sizeof(word));
+    user_stack_write(proc, sp + (size_t)(argc + 2) * sizeof(uint64_t), &word, sizeof(word));
+    
+    proc->trap_frame->sp = sp;
+    proc->trap_frame->a0 = (unsigned long)argc;
+    proc->trap_frame->a1 = sp + sizeof(uint64_t);
+}
+
 /**
  * Wrapper for entering user mode from kernel context
  * 
@@ -10,6 +10,7 @@
 #include "kernel/panic.h"
 #include "hal/hal_uart.h"
 #include "arch/interrupt.h"
+#include "arch/fpu.h"
 
 // Simple circular queue for ready processes
 #define READY_QUEUE_SIZE MAX_PROCS
@@ -28,15 +29,23 @@ static volatile int sched_lock = 0;
 #define TIME_SLICE (1000000 / TIMER_INTERVAL_US)
 static uint64_t current_time_slice = 0;
 
+// Interrupt state saved by lock_acquire
+static int sched_lock_irq = 0;
+
 // Simple spinlock functions
+// Held with interrupts disabled, since interrupt handlers wake processes
 static inline void lock_acquire(volatile int *lock) {
+    int irq_state = interrupt_save_disable();
     while (__sync_lock_test_and_set(lock, 1)) {
         // Spin
     }
+    sched_lock_irq = irq_state;
 }
 
 static inline void lock_release(volatile int *lock) {
+    int irq_state = sched_lock_irq;
     __sync_lock_release(lock);
+    interrupt_restore(irq_state);
 }
 
 /**
@@ -149,10 +158,13 @@ void context_switch(struct process *old, struct process *new) {
     // Set current process
     process_set_current(new);
     
-    // TODO: Switch page tables if different
-    // if (old && old->page_table != new->page_table) {
-    //     switch_page_table(new->page_table);
-    // }
+    // Switch address spaces; every page table maps the kernel
+    if (new->page_table && (!old || old->page_table != new->page_table)) {
+        switch_page_table(new->page_table);
+    }
+    
+    // Hand over the FP/vector registers while old's sstatus is still live
+    fpu_switch(old, new);
     
     // Perform low-level context switch
     if (old) {
@@ -243,6 +255,33 @@ void scheduler_yield(void) {
     schedule();
 }
 
+/**
+ * Switch straight to a process that the current one is waiting on
+ * 
+ * The current process goes to sleep and next, which must be asleep, runs
+ * in its place without passing through the ready queue. The time slice
+ * is not reset, so next runs out what the current process had left.
+ * Used by synchronous IPC, where the caller is blocked until next
+ * answers anyway.
+ */
+void scheduler_handoff(struct process *next) {
+    int old_state = interrupt_save_disable();
+    
+    struct process *current = process_current();
+    current->state = PROC_SLEEPING;
+    current->wake_tick = 0;
+    
+    if (next->state == PROC_SLEEPING) {
+        // Asleep, so not in the ready queue
+        context_switch(current, next);
+    } else {
+        process_wakeup(next);
+        schedule();
+    }
+    
+    interrupt_restore(old_state);
+}
+
 /**
  * Helper function called from assembly to get current process trap frame
  */
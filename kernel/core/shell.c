@@ -7,12 +7,16 @@
 #include <kernel/process.h>
 #include <kernel/syscall.h>
 #include <hal/hal_uart.h>
+#include <drivers/console.h>
 #include <kernel/kstring.h>
 #include <fs/vfs.h>
 #include <kernel/elf_loader.h>
 
 #define MAX_CMD_LEN 256
 #define MAX_ARGS 16
+#define MAX_PIPELINE 8
+
+extern uint64_t sys_waitpid(int pid, int *wstatus, int options);
 
 static char input_buffer[MAX_CMD_LEN];
 static int input_pos = 0;
@@ -65,6 +69,9 @@ static void shell_help(void) {
     hal_uart_puts("  exit   - Exit the shell\n");
     hal_uart_puts("  cat    - Display file contents\n");
     hal_uart_puts("  ls     - List directory contents\n");
+    hal_uart_puts("  cp     - Copy a file\n");
+    hal_uart_puts("  sync   - Write back filesystem changes\n");
+    hal_uart_puts("Programs can be joined with '|', e.g. cat test.txt | wc\n");
 }
 
 /**
@@ -116,16 +123,29 @@ static void shell_ls(int argument_count, char **argument_vector) {
         return;
     }
     
-    /* List directory entries */
-    char entry_name[256];
-    uint32_t entry_inode = 0;
-    uint32_t entry_index = 0;
+    int directory_fd = vfs_open(directory_path, O_RDONLY);
+    if (directory_fd < 0) {
+        hal_uart_puts("ls: cannot open '");
+        hal_uart_puts(directory_path);
+        hal_uart_puts("'\n");
+        return;
+    }
     
-    while (directory_node->ops->readdir(directory_node, entry_index, entry_name, &entry_inode) == 0) {
-        hal_uart_puts(entry_name);
-        hal_uart_puts("\n");
-        entry_index++;
+    /* List directory entries, as many per call as fit in the buffer */
+    uint64_t entry_buffer[64];
+    int bytes_read;
+    
+    while ((bytes_read = vfs_getdents(directory_fd, entry_buffer, sizeof(entry_buffer))) > 0) {
+        uint8_t *entry_bytes = (uint8_t *)entry_buffer;
+        for (int offset = 0; offset < bytes_read; ) {
+            vfs_dirent_t *entry = (vfs_dirent_t *)(entry_bytes + offset);
+            hal_uart_puts(entry->d_name);
+            hal_uart_puts("\n");
+            offset += entry->d_reclen;
+        }
     }
+    
+    vfs_close(directory_fd);
 }
 
 /**
@@ -164,6 +184,50 @@ static void shell_cat(int argument_count, char **argument_vector) {
     vfs_close(file_descriptor);
 }
 
+/**
+ * Copy a file
+ * 
+ * The data is copied inside the kernel with vfs_copy_file_range.
+ * 
+ * @param argument_count Number of arguments
+ * @param argument_vector Array of argument strings
+ */
+static void shell_cp(int argument_count, char **argument_vector) {
+    if (argument_count < 3) {
+        hal_uart_puts("Usage: cp <source> <destination>\n");
+        return;
+    }
+    
+    int source_fd = vfs_open(argument_vector[1], O_RDONLY);
+    if (source_fd < 0) {
+        hal_uart_puts("cp: ");
+        hal_uart_puts(argument_vector[1]);
+        hal_uart_puts(": No such file or directory\n");
+        return;
+    }
+    
+    int destination_fd = vfs_open(argument_vector[2], O_CREAT | O_WRONLY | O_TRUNC);
+    if (destination_fd < 0) {
+        hal_uart_puts("cp: cannot create ");
+        hal_uart_puts(argument_vector[2]);
+        hal_uart_puts("\n");
+        vfs_close(source_fd);
+        return;
+    }
+    
+    /* Copy until the end of the source */
+    int bytes_copied;
+    do {
+        bytes_copied = vfs_copy_file_range(source_fd, NULL, destination_fd, NULL, 0x7FFFFFFF);
+    } while (bytes_copied > 0);
+    if (bytes_copied < 0) {
+        hal_uart_puts("cp: copy failed\n");
+    }
+    
+    vfs_close(destination_fd);
+    vfs_close(source_fd);
+}
+
 /**
  * Parse command line into arguments
  * 
@@ -206,14 +270,36 @@ static int shell_parse_args(char *command_line, char **argument_vector, int max_
 }
 
 /**
- * Execute external program from filesystem
+ * Build the path of an external program
+ * 
+ * Programs are looked up in /bin, then /usr/bin.
+ * 
+ * @param program_name Name the user typed
+ * @param program_path Buffer of 256 bytes for the path
+ */
+static void shell_find_program(const char *program_name, char *program_path) {
+    program_path[0] = '\0';
+    shell_strcat(program_path, "/bin/");
+    shell_strcat(program_path, program_name);
+    if (!vfs_exists(program_path)) {
+        program_path[0] = '\0';
+        shell_strcat(program_path, "/usr/bin/");
+        shell_strcat(program_path, program_name);
+    }
+}
+
+/**
+ * Start an external program without waiting for it
+ * 
+ * The program gets a copy of the shell's descriptors, so whatever is on
+ * stdin/stdout at this point is what it reads and writes.
  * 
  * @param program_path Path to executable file
  * @param argument_count Number of arguments
  * @param argument_vector Argument array
- * @return 0 on success, -1 on error
+ * @return Process ID, or -1 on error
  */
-static int shell_exec_program(const char *program_path, int argument_count, char **argument_vector) {
+static int shell_spawn_program(const char *program_path, int argument_count, char **argument_vector) {
     /* Convert to const char** for elf_load_exec */
     const char **const_argv = (const char **)argument_vector;
     
@@ -227,9 +313,25 @@ static int shell_exec_program(const char *program_path, int argument_count, char
         return -1;
     }
     
+    return process_id;
+}
+
+/**
+ * Execute external program from filesystem
+ * 
+ * @param program_path Path to executable file
+ * @param argument_count Number of arguments
+ * @param argument_vector Argument array
+ * @return 0 on success, -1 on error
+ */
+static int shell_exec_program(const char *program_path, int argument_count, char **argument_vector) {
+    int process_id = shell_spawn_program(program_path, argument_count, argument_vector);
+    if (process_id < 0) {
+        return -1;
+    }
+    
     /* Wait for child process to complete */
     int wait_status = 0;
-    extern uint64_t sys_waitpid(int pid, int *wstatus, int options);
     int result = sys_waitpid(process_id, &wait_status, 0);
     
     if (result < 0) {
@@ -240,6 +342,105 @@ static int shell_exec_program(const char *program_path, int argument_count, char
     return 0;
 }
 
+/**
+ * Run a pipeline of external programs
+ * 
+ * Each stage's stdout is the write end of a pipe whose read end is the
+ * next stage's stdin. All stages run at once and the data moves through
+ * the pipes' pages, never through a file. Builtins print straight to the
+ * console, so every stage is looked up as a program.
+ * 
+ * @param stage_lines Command line of each stage
+ * @param stage_count Number of stages (at least 2)
+ */
+static void shell_run_pipeline(char **stage_lines, int stage_count) {
+    int process_ids[MAX_PIPELINE];
+    int started = 0;
+    int input_fd = -1;  /* Read end for the next stage's stdin */
+    
+    for (int stage = 0; stage < stage_count; stage++) {
+        char *argument_vector[MAX_ARGS];
+        int argument_count = shell_parse_args(stage_lines[stage], argument_vector, MAX_ARGS);
+        if (argument_count == 0) {
+            hal_uart_puts("Error: empty command in pipeline\n");
+            break;
+        }
+        
+        /* The shell's own pipe descriptors stay out of the programs */
+        int pipe_fds[2] = { -1, -1 };
+        if (stage < stage_count - 1 && vfs_pipe(pipe_fds, O_CLOEXEC) != 0) {
+            hal_uart_puts("Error: cannot create pipe\n");
+            break;
+        }
+        
+        if (input_fd >= 0) {
+            vfs_dup2(input_fd, VFS_FD_STDIN);
+        }
+        if (pipe_fds[1] >= 0) {
+            vfs_dup2(pipe_fds[1], VFS_FD_STDOUT);
+        }
+        
+        char program_path[256];
+        shell_find_program(argument_vector[0], program_path);
+        int process_id = shell_spawn_program(program_path, argument_count, argument_vector);
+        
+        /*
+         * Back to the console. Only the programs hold the write ends now,
+         * so each reader sees end of file when its writer exits.
+         */
+        if (input_fd >= 0) {
+            vfs_close(VFS_FD_STDIN);
+            vfs_close(input_fd);
+        }
+        if (pipe_fds[1] >= 0) {
+            vfs_close(VFS_FD_STDOUT);
+            vfs_close(pipe_fds[1]);
+        }
+        input_fd = pipe_fds[0];
+        
+        if (process_id < 0) {
+            break;
+        }
+        process_ids[started++] = process_id;
+    }
+    
+    /* A stage that failed to start leaves its writer with no reader */
+    if (input_fd >= 0) {
+        vfs_close(input_fd);
+    }
+    
+    for (int i = 0; i < started; i++) {
+        int wait_status = 0;
+        sys_waitpid(process_ids[i], &wait_status, 0);
+    }
+}
+
+/**
+ * Split a command line at '|' into pipeline stages
+ * 
+ * @param command_line Command line, modified in place
+ * @param stage_lines Array to store the stage command lines
+ * @param max_stages Maximum number of stages
+ * @return Number of stages, or -1 if there are too many
+ */
+static int shell_split_pipeline(char *command_line, char **stage_lines, int max_stages) {
+    int stage_count = 1;
+    stage_lines[0] = command_line;
+    
+    for (char *position = command_line; *position; position++) {
+        if (*position != '|') {
+            continue;
+        }
+        if (stage_count == max_stages) {
+            return -1;
+        }
+        *position = '\0';
+        stage_lines[stage_count++] = position + 1;
+    }
+    
+    return stage_count;
+}
+
 /**
  * Execute a shell command
  * 
@@ -249,6 +450,18 @@ static void shell_execute(char *command_line) {
     char *argument_vector[MAX_ARGS];
     int argument_count = 0;
     
+    /* Commands joined with '|' run as a pipeline */
+    char *stage_lines[MAX_PIPELINE];
+    int stage_count = shell_split_pipeline(command_line, stage_lines, MAX_PIPELINE);
+    if (stage_count < 0) {
+        hal_uart_puts("Error: too many commands in pipeline\n");
+        return;
+    }
+    if (stage_count > 1) {
+        shell_run_pipeline(stage_lines, stage_count);
+        return;
+    }
+    
     /* Parse command line */
     argument_count = shell_parse_args(command_line, argument_vector, MAX_ARGS);
     
@@ -272,15 +485,21 @@ static void shell_execute(char *command_line) {
     else if (shell_strcmp(argument_vector[0], "cat") == 0) {
         shell_cat(argument_count, argument_vector);
     }
+    else if (shell_strcmp(argument_vector[0], "cp") == 0) {
+        shell_cp(argument_count, argument_vector);
+    }
+    else if (shell_strcmp(argument_vector[0], "sync") == 0) {
+        if (vfs_sync() != 0) {
+            hal_uart_puts("sync: write-back failed\n");
+        }
+    }
     else if (shell_strcmp(argument_vector[0], "exit") == 0) {
         hal_uart_puts("Goodbye!\n");
     }
     else {
-        /* Try to execute as external program from /bin directory */
+        /* Try to execute as external program from /bin, then /usr/bin */
         char program_path[256];
-        program_path[0] = '\0';
-        shell_strcat(program_path, "/bin/");
-        shell_strcat(program_path, argument_vector[0]);
+        shell_find_program(argument_vector[0], program_path);
         
         shell_exec_program(program_path, argument_count, argument_vector);
     }
@@ -349,8 +568,8 @@ void shell_init(void) {
  */
 void shell_run(void) {
     while (1) {
-        /* Read character from UART */
-        char input_char = hal_uart_getc();
+        /* Read character from the console input */
+        char input_char = console_getc();
         
         /* Process character */
         shell_process_char(input_char);
@@ -11,6 +11,14 @@
 #include "kernel/panic.h"
 #include "kernel/elf_loader.h"
 #include "fs/vfs.h"
+#include "fs/shm.h"
+#include "kernel/ipc.h"
+#include "net/socket.h"
+#include "fs/eventfd.h"
+#include "drivers/console.h"
+#include "mm/kmalloc.h"
+#include "mm/mmap.h"
+#include "arch/fpu.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -21,6 +29,7 @@
 #define STDERR_FD 2
 #define SYSCALL_ERROR ((uint64_t)-1)
 #define SYSCALL_SUCCESS 0
+#define SENDFILE_CHUNK 4096  // Bytes per UART or socket transfer in sys_sendfile
 
 // Forward declarations
 static int is_valid_user_pointer(const void *pointer, size_t length);
@@ -56,6 +65,24 @@ static int is_valid_user_pointer(const void *pointer, size_t length) {
     return 1;
 }
 
+/**
+ * is_console_fd - Check whether a descriptor is served by the console
+ * 
+ * stdin/stdout/stderr use the console until dup2() puts a file on them,
+ * for example the end of a pipe; after that they are ordinary descriptors.
+ * 
+ * @param fd File descriptor
+ * @return 1 for stdin/stdout/stderr with no file attached, 0 otherwise
+ */
+static int is_console_fd(int fd) {
+    if (fd < STDIN_FD || fd > STDERR_FD) {
+        return 0;
+    }
+    
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    return (uint32_t)fd >= table->capacity || !table->files[fd];
+}
+
 /**
  * sys_exit - Terminate the current process
  * 
@@ -275,6 +302,12 @@ uint64_t sys_open(const char *path, int flags, int mode) {
     if (flags & O_APPEND) {
         vfs_flags |= O_APPEND;
     }
+    if (flags & O_DIRECT) {
+        vfs_flags |= O_DIRECT;
+    }
+    if (flags & O_CLOEXEC) {
+        vfs_flags |= O_CLOEXEC;
+    }
     
     int fd = vfs_open(path, vfs_flags);
     if (fd < 0) {
@@ -292,8 +325,8 @@ uint64_t sys_open(const char *path, int flags, int mode) {
  * @return 0 on success, -1 on error
  */
 uint64_t sys_close(int fd) {
-    // Don't allow closing stdin/stdout/stderr
-    if (fd <= STDERR_FD) {
+    // The console cannot be closed
+    if (is_console_fd(fd)) {
         return SYSCALL_ERROR;
     }
     
@@ -316,14 +349,14 @@ uint64_t sys_read(int file_descriptor, char *buffer, size_t byte_count) {
         return SYSCALL_ERROR;
     }
     
-    // Handle stdin separately
-    if (file_descriptor == STDIN_FD) {
-        // Not implemented yet - requires input buffering
-        return 0;
+    // Console stdin reads typed input, waiting for the first character
+    if (file_descriptor == STDIN_FD && is_console_fd(STDIN_FD)) {
+        int bytes_read = console_read(buffer, byte_count, 0);
+        return (bytes_read < 0) ? SYSCALL_ERROR : (uint64_t)bytes_read;
     }
     
-    // Handle regular file descriptors
-    if (file_descriptor <= STDERR_FD) {
+    // Console stdout/stderr cannot be read
+    if (is_console_fd(file_descriptor)) {
         return SYSCALL_ERROR;
     }
     
@@ -350,8 +383,8 @@ uint64_t sys_write(int file_descriptor, const char *buffer, size_t byte_count) {
         return SYSCALL_ERROR;
     }
     
-    // Handle stdout/stderr with UART
-    if (file_descriptor == STDOUT_FD || file_descriptor == STDERR_FD) {
+    // Handle console stdout/stderr with UART
+    if (file_descriptor != STDIN_FD && is_console_fd(file_descriptor)) {
         int bytes_written = hal_uart_write(buffer, byte_count);
         if (bytes_written != (int)byte_count) {
             return SYSCALL_ERROR;
@@ -359,8 +392,8 @@ uint64_t sys_write(int file_descriptor, const char *buffer, size_t byte_count) {
         return byte_count;
     }
     
-    // Handle stdin (cannot write)
-    if (file_descriptor == STDIN_FD) {
+    // Handle console stdin (cannot write)
+    if (is_console_fd(file_descriptor)) {
         return SYSCALL_ERROR;
     }
     
@@ -382,8 +415,8 @@ uint64_t sys_write(int file_descriptor, const char *buffer, size_t byte_count) {
  * @return New file position, or -1 on error
  */
 uint64_t sys_lseek(int fd, int64_t offset, int whence) {
-    // Don't allow seeking on stdin/stdout/stderr
-    if (fd <= STDERR_FD) {
+    // Don't allow seeking on the console
+    if (is_console_fd(fd)) {
         return SYSCALL_ERROR;
     }
     
@@ -415,11 +448,11 @@ uint64_t sys_lseek(int fd, int64_t offset, int whence) {
  * sys_stat - Get file status
  * 
  * @param path File path
- * @param statbuf Buffer to store stat information (size and type)
+ * @param statbuf Buffer to store stat information (64-bit size, then 32-bit type)
  * @return 0 on success, -1 on error
  */
 uint64_t sys_stat(const char *path, void *statbuf) {
-    if (!is_valid_user_pointer(path, 1) || !is_valid_user_pointer(statbuf, 8)) {
+    if (!is_valid_user_pointer(path, 1) || !is_valid_user_pointer(statbuf, 16)) {
         return SYSCALL_ERROR;
     }
     
@@ -435,8 +468,8 @@ uint64_t sys_stat(const char *path, void *statbuf) {
         return SYSCALL_ERROR;
     }
     
-    uint32_t *stat_data = (uint32_t *)statbuf;
-    int result = vfs_stat(path, &stat_data[0], &stat_data[1]);
+    uint64_t *stat_data = (uint64_t *)statbuf;
+    int result = vfs_stat(path, &stat_data[0], (uint32_t *)&stat_data[1]);
     return (result == 0) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
 }
 
@@ -496,171 +529,1439 @@ uint64_t sys_unlink(const char *path) {
 }
 
 /**
- * sys_rmdir - Remove a directory
+ * sys_ftruncate - Change the size of an open file
  * 
- * @param path Directory path
+ * Shrinking releases the blocks past the new end.
+ * 
+ * @param fd File descriptor (opened for writing)
+ * @param length New size in bytes
  * @return 0 on success, -1 on error
  */
-uint64_t sys_rmdir(const char *path) {
-    if (!is_valid_user_pointer(path, 1)) {
+uint64_t sys_ftruncate(int fd, uint64_t length) {
+    if (is_console_fd(fd)) {
         return SYSCALL_ERROR;
     }
     
-    // Validate path length
-    size_t path_len = 0;
-    const char *p = path;
-    while (*p && path_len < 4096) {
-        p++;
-        path_len++;
+    int result = vfs_ftruncate(fd, length);
+    return (result == 0) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
+}
+
+/**
+ * sys_fallocate - Reserve storage for a range of an open file
+ * 
+ * The range is allocated as contiguously as the filesystem allows, so
+ * later writes into it do not need to allocate blocks.
+ * 
+ * @param fd File descriptor (opened for writing)
+ * @param mode 0 or FALLOC_FL_KEEP_SIZE
+ * @param offset Start of the range in bytes
+ * @param len Length of the range in bytes
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_fallocate(int fd, int mode, uint64_t offset, uint64_t len) {
+    if (is_console_fd(fd)) {
+        return SYSCALL_ERROR;
     }
     
-    if (path_len == 0 || path_len >= 4096) {
+    int result = vfs_fallocate(fd, (uint32_t)mode, offset, len);
+    return (result == 0) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
+}
+
+/**
+ * sys_dup - Duplicate a file descriptor
+ * 
+ * The new descriptor shares the open file, including its position.
+ * 
+ * @param fd File descriptor to duplicate
+ * @return Lowest free file descriptor, or -1 on error
+ */
+uint64_t sys_dup(int fd) {
+    if (is_console_fd(fd)) {
         return SYSCALL_ERROR;
     }
     
-    int result = vfs_rmdir(path);
-    return (result == 0) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
+    int new_fd = vfs_dup(fd);
+    if (new_fd < 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    return new_fd;
 }
 
 /**
- * sys_execve - Execute program from filesystem
+ * sys_dup2 - Duplicate a file descriptor onto a given descriptor
  * 
- * @param path Path to executable
- * @param argv Argument array
- * @param envp Environment array (ignored)
- * @return Does not return on success, -1 on error
+ * A file already open on new_fd is closed first. Duplicating onto
+ * stdin/stdout/stderr redirects it away from the console until it is
+ * closed.
+ * 
+ * @param old_fd File descriptor to duplicate
+ * @param new_fd Descriptor to use for the copy
+ * @return new_fd on success, -1 on error
  */
-uint64_t sys_execve(const char *path, const char *argv[], const char *envp[]) {
-    (void)envp;
+uint64_t sys_dup2(int old_fd, int new_fd) {
+    if (is_console_fd(old_fd)) {
+        return SYSCALL_ERROR;
+    }
     
-    if (!is_valid_user_pointer(path, 1)) {
+    int result = vfs_dup2(old_fd, new_fd);
+    if (result < 0) {
         return SYSCALL_ERROR;
     }
     
-    // Count arguments
-    int argc = 0;
-    if (argv) {
-        while (argv[argc] && argc < 256) {
-            if (!is_valid_user_pointer(argv[argc], 1)) {
-                return SYSCALL_ERROR;
+    return result;
+}
+
+/**
+ * sys_getdents - Read directory entries
+ * 
+ * Fills the buffer with as many packed vfs_dirent_t records as fit and
+ * advances the directory's position past them.
+ * 
+ * @param fd File descriptor of an open directory
+ * @param buffer Buffer to store the records
+ * @param size Size of buffer in bytes
+ * @return Bytes stored, 0 at end of directory, or -1 on error
+ */
+uint64_t sys_getdents(int fd, void *buffer, size_t size) {
+    if (is_console_fd(fd) || !is_valid_user_pointer(buffer, size)) {
+        return SYSCALL_ERROR;
+    }
+    
+    if (size > 0xFFFFFFFFUL) {
+        size = 0xFFFFFFFFUL;
+    }
+    
+    int bytes = vfs_getdents(fd, buffer, (uint32_t)size);
+    if (bytes < 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    return bytes;
+}
+
+/**
+ * sys_pread - Read from a file descriptor at a given offset
+ * 
+ * The file position is neither used nor changed, so readers sharing an
+ * open file do not race on it.
+ * 
+ * @param fd File descriptor
+ * @param buffer Buffer to read into
+ * @param byte_count Number of bytes to read
+ * @param offset File offset to read from
+ * @return Number of bytes read, or -1 on error
+ */
+uint64_t sys_pread(int fd, char *buffer, size_t byte_count, int64_t offset) {
+    if (is_console_fd(fd) || offset < 0 || !is_valid_user_pointer(buffer, byte_count)) {
+        return SYSCALL_ERROR;
+    }
+    
+    if (byte_count > 0x7FFFFFFFUL) {
+        byte_count = 0x7FFFFFFFUL;
+    }
+    
+    int bytes_read = vfs_pread(fd, buffer, (uint32_t)byte_count, (uint64_t)offset);
+    if (bytes_read < 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    return bytes_read;
+}
+
+/**
+ * sys_pwrite - Write to a file descriptor at a given offset
+ * 
+ * The file position is neither used nor changed.
+ * 
+ * @param fd File descriptor
+ * @param buffer Buffer to write from
+ * @param byte_count Number of bytes to write
+ * @param offset File offset to write at
+ * @return Number of bytes written, or -1 on error
+ */
+uint64_t sys_pwrite(int fd, const char *buffer, size_t byte_count, int64_t offset) {
+    if (is_console_fd(fd) || offset < 0 || !is_valid_user_pointer(buffer, byte_count)) {
+        return SYSCALL_ERROR;
+    }
+    
+    if (byte_count > 0x7FFFFFFFUL) {
+        byte_count = 0x7FFFFFFFUL;
+    }
+    
+    int bytes_written = vfs_pwrite(fd, buffer, (uint32_t)byte_count, (uint64_t)offset);
+    if (bytes_written < 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    return bytes_written;
+}
+
+/**
+ * copy_user_iovec - Copy and validate a user buffer list
+ * 
+ * The kernel works on its own copy so the lengths cannot change after
+ * they have been checked.
+ * 
+ * @param user_iov Buffer list in user memory
+ * @param iovcnt Number of entries (1 to VFS_IOV_MAX)
+ * @return Kernel copy to be freed with kfree, or NULL if invalid
+ */
+static vfs_iovec_t *copy_user_iovec(const vfs_iovec_t *user_iov, int iovcnt) {
+    if (iovcnt <= 0 || iovcnt > VFS_IOV_MAX ||
+        !is_valid_user_pointer(user_iov, iovcnt * sizeof(vfs_iovec_t))) {
+        return NULL;
+    }
+    
+    vfs_iovec_t *iov = kmalloc(iovcnt * sizeof(vfs_iovec_t));
+    if (!iov) {
+        return NULL;
+    }
+    
+    for (int i = 0; i < iovcnt; i++) {
+        iov[i] = user_iov[i];
+        if (!is_valid_user_pointer(iov[i].iov_base, iov[i].iov_len)) {
+            kfree(iov);
+            return NULL;
+        }
+    }
+    
+    return iov;
+}
+
+/**
+ * sys_readv - Read from a file descriptor into several buffers
+ * 
+ * The buffers are filled in order as if they were one, with a single
+ * filesystem operation.
+ * 
+ * @param fd File descriptor
+ * @param user_iov Array of buffers
+ * @param iovcnt Number of buffers (at most VFS_IOV_MAX)
+ * @return Number of bytes read, or -1 on error
+ */
+uint64_t sys_readv(int fd, const vfs_iovec_t *user_iov, int iovcnt) {
+    if (iovcnt == 0) {
+        return 0;
+    }
+    
+    vfs_iovec_t *iov = copy_user_iovec(user_iov, iovcnt);
+    if (!iov) {
+        return SYSCALL_ERROR;
+    }
+    
+    int bytes_read;
+    if (fd == STDIN_FD && is_console_fd(fd)) {
+        // Console input goes into the first buffer that has room
+        int i = 0;
+        while (i < iovcnt - 1 && iov[i].iov_len == 0) {
+            i++;
+        }
+        bytes_read = console_read(iov[i].iov_base, iov[i].iov_len, 0);
+    } else if (is_console_fd(fd)) {
+        bytes_read = -1;
+    } else {
+        bytes_read = vfs_readv(fd, iov, iovcnt);
+    }
+    
+    kfree(iov);
+    return (bytes_read < 0) ? SYSCALL_ERROR : (uint64_t)bytes_read;
+}
+
+/**
+ * sys_writev - Write several buffers to a file descriptor
+ * 
+ * The buffers are written in order as if they were one, with a single
+ * filesystem operation.
+ * 
+ * @param fd File descriptor
+ * @param user_iov Array of buffers
+ * @param iovcnt Number of buffers (at most VFS_IOV_MAX)
+ * @return Number of bytes written, or -1 on error
+ */
+uint64_t sys_writev(int fd, const vfs_iovec_t *user_iov, int iovcnt) {
+    if (iovcnt == 0) {
+        return 0;
+    }
+    
+    vfs_iovec_t *iov = copy_user_iovec(user_iov, iovcnt);
+    if (!iov) {
+        return SYSCALL_ERROR;
+    }
+    
+    int bytes_written = 0;
+    if (fd != STDIN_FD && is_console_fd(fd)) {
+        // Handle console stdout/stderr with UART
+        for (int i = 0; i < iovcnt; i++) {
+            int ret = hal_uart_write((const char *)iov[i].iov_base, iov[i].iov_len);
+            if (ret != (int)iov[i].iov_len) {
+                bytes_written = -1;
+                break;
             }
-            argc++;
+            bytes_written += ret;
         }
+    } else if (is_console_fd(fd)) {
+        bytes_written = -1;
+    } else {
+        bytes_written = vfs_writev(fd, iov, iovcnt);
     }
     
-    // Load and execute ELF binary
-    int result = elf_load_exec(path, argv, argc);
+    kfree(iov);
+    return (bytes_written < 0) ? SYSCALL_ERROR : (uint64_t)bytes_written;
+}
+
+/**
+ * read_user_offset - Fetch an optional file offset from user memory
+ * 
+ * @param user_offset User pointer, may be NULL
+ * @param offset Receives the offset when user_offset is not NULL
+ * @return 0 on success, -1 if the pointer or the offset is invalid
+ */
+static int read_user_offset(const int64_t *user_offset, uint64_t *offset) {
+    if (!user_offset) {
+        return 0;
+    }
     
-    // If we get here, exec failed
-    return (result < 0) ? SYSCALL_ERROR : result;
+    if (!is_valid_user_pointer(user_offset, sizeof(int64_t)) || *user_offset < 0) {
+        return -1;
+    }
+    
+    *offset = (uint64_t)*user_offset;
+    return 0;
 }
 
 /**
- * syscall_handler - Main system call dispatcher
+ * sys_copy_file_range - Copy a byte range between two files in the kernel
  * 
- * Called from trap handler when ECALL is executed from user mode.
- * Dispatches to appropriate syscall implementation based on syscall number.
+ * The data never passes through user memory. A NULL offset pointer means
+ * the file position is used and advanced; otherwise the offset it points
+ * to is used and advanced, and the file position is left alone.
  * 
- * @param syscall_number Syscall number (from a7 register)
- * @param argument0 First argument (from a0 register)
- * @param argument1 Second argument (from a1 register)
- * @param argument2 Third argument (from a2 register)
- * @param argument3 Fourth argument (from a3 register)
- * @param argument4 Fifth argument (from a4 register)
- * @param argument5 Sixth argument (from a5 register)
- * @return Return value (placed in a0 register)
+ * @param fd_in Source file descriptor (opened for reading)
+ * @param off_in Source offset, or NULL
+ * @param fd_out Destination file descriptor (opened for writing)
+ * @param off_out Destination offset, or NULL
+ * @param len Number of bytes to copy
+ * @param flags Must be 0
+ * @return Number of bytes copied, 0 at end of the source, or -1 on error
  */
-uint64_t syscall_handler(uint64_t syscall_number, 
-                        uint64_t argument0, uint64_t argument1, uint64_t argument2,
-                        uint64_t argument3, uint64_t argument4, uint64_t argument5) {
-    uint64_t return_value = SYSCALL_ERROR;
+uint64_t sys_copy_file_range(int fd_in, int64_t *off_in, int fd_out, int64_t *off_out,
+                             size_t len, unsigned int flags) {
+    if (is_console_fd(fd_in) || is_console_fd(fd_out) || flags != 0) {
+        return SYSCALL_ERROR;
+    }
     
-    (void)argument3;  // Suppress unused parameter warnings
-    (void)argument4;
-    (void)argument5;
+    uint64_t in_offset = 0;
+    uint64_t out_offset = 0;
+    if (read_user_offset(off_in, &in_offset) != 0 ||
+        read_user_offset(off_out, &out_offset) != 0) {
+        return SYSCALL_ERROR;
+    }
     
-    switch (syscall_number) {
-        case SYS_EXIT:
-            return_value = sys_exit((int)argument0);
-            break;
+    if (len > 0x7FFFFFFFUL) {
+        len = 0x7FFFFFFFUL;
+    }
+    
+    int copied = vfs_copy_file_range(fd_in, off_in ? &in_offset : NULL,
+                                     fd_out, off_out ? &out_offset : NULL, (uint32_t)len);
+    if (copied < 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    if (off_in) {
+        *off_in = (int64_t)in_offset;
+    }
+    if (off_out) {
+        *off_out = (int64_t)out_offset;
+    }
+    
+    return copied;
+}
+
+/**
+ * sys_sendfile - Send file data to another descriptor in the kernel
+ * 
+ * Console stdout/stderr and sockets receive the data through a kernel
+ * buffer, a chunk at a time, straight to the UART or the socket's
+ * sendmsg; pipes are handled like splice and files like copy_file_range.
+ * A NULL offset pointer means the input file position is used and
+ * advanced. A socket that takes only part of a chunk ends the transfer.
+ * 
+ * @param out_fd Destination: stdout, stderr, a pipe, a socket or a file
+ *               opened for writing
+ * @param in_fd Source file descriptor
+ * @param offset Source offset, or NULL
+ * @param count Number of bytes to send
+ * @return Number of bytes sent, or -1 on error
+ */
+uint64_t sys_sendfile(int out_fd, int in_fd, int64_t *offset, size_t count) {
+    if (is_console_fd(in_fd) || (out_fd == STDIN_FD && is_console_fd(out_fd))) {
+        return SYSCALL_ERROR;
+    }
+    
+    uint64_t position = 0;
+    if (read_user_offset(offset, &position) != 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    if (count > 0x7FFFFFFFUL) {
+        count = 0x7FFFFFFFUL;
+    }
+    
+    vfs_file_t *out_file = NULL;
+    if (!is_console_fd(out_fd)) {
+        out_file = vfs_get_file(out_fd);
+        if (!out_file || !out_file->node) {
+            return SYSCALL_ERROR;
+        }
+    }
+    int to_socket = out_file && out_file->node->type == VFS_TYPE_SOCKET;
+    
+    // Pipes and files: same path as splice or copy_file_range
+    if (out_file && !to_socket) {
+        int copied;
+        if (out_file->node->type == VFS_TYPE_PIPE) {
+            copied = vfs_splice(in_fd, offset ? &position : NULL, out_fd, NULL,
+                                (uint32_t)count, 0);
+        } else {
+            copied = vfs_copy_file_range(in_fd, offset ? &position : NULL,
+                                         out_fd, NULL, (uint32_t)count);
+        }
+        if (copied < 0) {
+            return SYSCALL_ERROR;
+        }
+        if (offset) {
+            *offset = (int64_t)position;
+        }
+        return copied;
+    }
+    
+    // Console and sockets: read a chunk at a time and hand it on
+    if (!offset) {
+        int64_t current = vfs_seek(in_fd, 0, SEEK_CUR);
+        if (current < 0) {
+            return SYSCALL_ERROR;
+        }
+        position = (uint64_t)current;
+    }
+    
+    size_t chunk_max = count < SENDFILE_CHUNK ? count : SENDFILE_CHUNK;
+    if (chunk_max == 0) {
+        return 0;
+    }
+    
+    char *buffer = kmalloc(chunk_max);
+    if (!buffer) {
+        return SYSCALL_ERROR;
+    }
+    
+    size_t sent = 0;
+    int failed = 0;
+    while (sent < count) {
+        size_t chunk = count - sent;
+        if (chunk > chunk_max) {
+            chunk = chunk_max;
+        }
         
-        case SYS_WAIT:  // waitpid
-            return_value = sys_waitpid((int)argument0, (int *)argument1, (int)argument2);
+        int bytes_read = vfs_pread(in_fd, buffer, (uint32_t)chunk, position + sent);
+        if (bytes_read <= 0) {
+            failed = (bytes_read < 0);
             break;
+        }
+        
+        if (to_socket) {
+            vfs_iovec_t iov = { buffer, (size_t)bytes_read };
+            struct msghdr msg = {0};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
             
-        case SYS_WRITE:
-            return_value = sys_write((int)argument0, (const char *)argument1, (size_t)argument2);
+            int written = socket_sendmsg(out_fd, &msg, 0);
+            if (written < 0) {
+                failed = 1;
+                break;
+            }
+            sent += written;
+            if (written < bytes_read) {
+                break;
+            }
+            continue;
+        }
+        
+        if (hal_uart_write(buffer, bytes_read) != bytes_read) {
+            failed = 1;
             break;
-            
-        case SYS_READ:
+        }
+        sent += bytes_read;
+    }
+    
+    kfree(buffer);
+    if (failed && sent == 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    // Advance whichever position the caller chose
+    if (offset) {
+        *offset = (int64_t)(position + sent);
+    } else if (vfs_seek(in_fd, (int64_t)(position + sent), SEEK_SET) < 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    return sent;
+}
+
+/**
+ * sys_sync - Make all completed filesystem changes durable
+ * 
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_sync(void) {
+    if (vfs_sync() != 0) {
+        return SYSCALL_ERROR;
+    }
+    return 0;
+}
+
+/**
+ * sys_fsync - Make an open file's data durable
+ * 
+ * Buffered data is written back first, so a write-back failure is
+ * reported here rather than lost.
+ * 
+ * @param fd Open file descriptor
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_fsync(int fd) {
+    if (vfs_fsync(fd) != 0) {
+        return SYSCALL_ERROR;
+    }
+    return 0;
+}
+
+/**
+ * sys_ioctl - Filesystem-specific request on an open file
+ * 
+ * The size of the argument is encoded in the request (VFS_IOC_SIZE), so
+ * the whole argument is checked before the filesystem sees it.
+ * 
+ * @param fd File descriptor
+ * @param cmd Request, built with VFS_IOC()
+ * @param arg Argument the request reads or fills
+ * @return Request-specific value (0 for ext2 requests), -1 on error
+ */
+uint64_t sys_ioctl(int fd, uint32_t cmd, void *arg) {
+    // The console answers only the isatty request
+    if (is_console_fd(fd)) {
+        return (cmd == VFS_IOC_ISATTY) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
+    }
+    
+    uint32_t size = VFS_IOC_SIZE(cmd);
+    if (size > 0 && !is_valid_user_pointer(arg, size)) {
+        return SYSCALL_ERROR;
+    }
+    
+    int result = vfs_ioctl(fd, cmd, arg);
+    return (result < 0) ? SYSCALL_ERROR : (uint64_t)result;
+}
+
+/**
+ * sys_pipe - Create a pipe
+ * 
+ * Reads from fds[0] return what was written to fds[1], waiting while the
+ * pipe is empty. Once every copy of fds[1] is closed, reads return 0 when
+ * the pipe is drained; once every copy of fds[0] is closed, writes fail.
+ * 
+ * @param fds Receives the read end in fds[0] and the write end in fds[1]
+ * @param flags O_NONBLOCK and O_CLOEXEC, or 0
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_pipe(int *fds, int flags) {
+    if (!is_valid_user_pointer(fds, 2 * sizeof(int))) {
+        return SYSCALL_ERROR;
+    }
+    
+    int kernel_fds[2];
+    if (vfs_pipe(kernel_fds, (uint32_t)flags) != 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    fds[0] = kernel_fds[0];
+    fds[1] = kernel_fds[1];
+    return SYSCALL_SUCCESS;
+}
+
+/**
+ * sys_splice - Move data between a pipe and a file or another pipe
+ * 
+ * The data never passes through user memory: file data is read straight
+ * into pipe pages or written straight from them, and pages move between
+ * pipes without being copied. Offsets work as for copy_file_range and
+ * must be NULL for a pipe.
+ * 
+ * @param fd_in Source descriptor
+ * @param off_in Source offset, or NULL
+ * @param fd_out Destination descriptor
+ * @param off_out Destination offset, or NULL
+ * @param len Number of bytes to move
+ * @param flags SPLICE_F_* flags
+ * @return Number of bytes moved, 0 at end of the source, or -1 on error
+ */
+uint64_t sys_splice(int fd_in, int64_t *off_in, int fd_out, int64_t *off_out,
+                    size_t len, unsigned int flags) {
+    if (is_console_fd(fd_in) || is_console_fd(fd_out)) {
+        return SYSCALL_ERROR;
+    }
+    
+    uint64_t in_offset = 0;
+    uint64_t out_offset = 0;
+    if (read_user_offset(off_in, &in_offset) != 0 ||
+        read_user_offset(off_out, &out_offset) != 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    if (len > 0x7FFFFFFFUL) {
+        len = 0x7FFFFFFFUL;
+    }
+    
+    int moved = vfs_splice(fd_in, off_in ? &in_offset : NULL,
+                           fd_out, off_out ? &out_offset : NULL, (uint32_t)len, flags);
+    if (moved < 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    if (off_in) {
+        *off_in = (int64_t)in_offset;
+    }
+    if (off_out) {
+        *off_out = (int64_t)out_offset;
+    }
+    
+    return moved;
+}
+
+/**
+ * sys_vmsplice - Move user buffers into a pipe, or pipe data into them
+ * 
+ * On the write end of a pipe the buffers are appended to it; on the read
+ * end they are filled from it. The data is copied once, between the
+ * buffers and the pipe's pages.
+ * 
+ * @param fd Pipe descriptor (either end)
+ * @param user_iov Array of buffers
+ * @param iovcnt Number of buffers (at most VFS_IOV_MAX)
+ * @param flags SPLICE_F_* flags
+ * @return Number of bytes moved, or -1 on error
+ */
+uint64_t sys_vmsplice(int fd, const vfs_iovec_t *user_iov, int iovcnt, unsigned int flags) {
+    if (is_console_fd(fd)) {
+        return SYSCALL_ERROR;
+    }
+    if (iovcnt == 0) {
+        return 0;
+    }
+    
+    vfs_iovec_t *iov = copy_user_iovec(user_iov, iovcnt);
+    if (!iov) {
+        return SYSCALL_ERROR;
+    }
+    
+    int moved = vfs_vmsplice(fd, iov, iovcnt, flags);
+    
+    kfree(iov);
+    return (moved < 0) ? SYSCALL_ERROR : (uint64_t)moved;
+}
+
+/**
+ * sys_mmap - Map memory or a file into the address space
+ * 
+ * Every page is mapped before the call returns. MAP_SHARED mappings of a
+ * shared memory object or a tmpfs file use the file's own pages, so all
+ * processes mapping it see the same memory.
+ * 
+ * @param addr Placement hint (ignored; the kernel picks the address)
+ * @param length Length in bytes
+ * @param prot PROT_* flags
+ * @param flags MAP_SHARED or MAP_PRIVATE, optionally with MAP_ANONYMOUS
+ * @param fd File to map (ignored with MAP_ANONYMOUS)
+ * @param offset Page-aligned offset in the file
+ * @return Address of the mapping, or -1 on error
+ */
+uint64_t sys_mmap(void *addr, size_t length, int prot, int flags, int fd, int64_t offset) {
+    (void)addr;
+    
+    if (offset < 0 || (!(flags & MAP_ANONYMOUS) && is_console_fd(fd))) {
+        return SYSCALL_ERROR;
+    }
+    
+    uintptr_t mapped = mmap_map(process_current(), length, (uint32_t)prot, (uint32_t)flags,
+                                fd, (uint64_t)offset);
+    return mapped ? (uint64_t)mapped : SYSCALL_ERROR;
+}
+
+/**
+ * sys_munmap - Unmap part of the address space
+ * 
+ * Pages are freed once nothing else maps or holds them.
+ * 
+ * @param addr Page-aligned start of the range
+ * @param length Length in bytes
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_munmap(void *addr, size_t length) {
+    if (mmap_unmap(process_current(), (uintptr_t)addr, length) != 0) {
+        return SYSCALL_ERROR;
+    }
+    return SYSCALL_SUCCESS;
+}
+
+/**
+ * sys_shm_open - Open a named shared memory object
+ * 
+ * The object starts empty; size it with ftruncate and map it with
+ * mmap(MAP_SHARED).
+ * 
+ * @param name Object name, such as "/frames"
+ * @param flags Open flags (O_RDWR, O_CREAT, O_EXCL, O_TRUNC, ...)
+ * @param mode Permission bits (ignored)
+ * @return File descriptor on success, -1 on error
+ */
+uint64_t sys_shm_open(const char *name, int flags, int mode) {
+    (void)mode;
+    
+    if (!is_valid_user_pointer(name, 1)) {
+        return SYSCALL_ERROR;
+    }
+    
+    int fd = shm_open(name, (uint32_t)flags);
+    return (fd < 0) ? SYSCALL_ERROR : (uint64_t)fd;
+}
+
+/**
+ * sys_shm_unlink - Remove a shared memory object's name
+ * 
+ * @param name Object name
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_shm_unlink(const char *name) {
+    if (!is_valid_user_pointer(name, 1) || shm_unlink(name) != 0) {
+        return SYSCALL_ERROR;
+    }
+    return SYSCALL_SUCCESS;
+}
+
+/**
+ * sys_memfd_create - Create an anonymous shared memory object
+ * 
+ * The descriptor can be passed to child processes and mapped by each.
+ * 
+ * @param name Label for the object
+ * @param flags MFD_CLOEXEC or 0
+ * @return File descriptor on success, -1 on error
+ */
+uint64_t sys_memfd_create(const char *name, unsigned int flags) {
+    if (!is_valid_user_pointer(name, 1)) {
+        return SYSCALL_ERROR;
+    }
+    
+    int fd = memfd_create(name, flags);
+    return (fd < 0) ? SYSCALL_ERROR : (uint64_t)fd;
+}
+
+/**
+ * sys_ipc_endpoint - Open a named IPC endpoint
+ * 
+ * @param name Endpoint name
+ * @param flags O_CREAT to serve the endpoint (with O_EXCL, only if it is
+ *              new), 0 to call it; O_CLOEXEC may be added
+ * @return File descriptor on success, -1 on error
+ */
+uint64_t sys_ipc_endpoint(const char *name, int flags) {
+    if (!is_valid_user_pointer(name, 1)) {
+        return SYSCALL_ERROR;
+    }
+    
+    int fd = ipc_endpoint_open(name, (uint32_t)flags);
+    return (fd < 0) ? SYSCALL_ERROR : (uint64_t)fd;
+}
+
+/**
+ * sys_ipc_buffer - Set the buffer for long IPC messages
+ * 
+ * The long part of a message, whose length is in the upper half of the
+ * tag, is sent from and received into this buffer.
+ * 
+ * @param buffer Buffer address, or NULL for none
+ * @param size Buffer size in bytes
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_ipc_buffer(void *buffer, size_t size) {
+    if (buffer && !is_valid_user_pointer(buffer, size)) {
+        return SYSCALL_ERROR;
+    }
+    
+    if (ipc_set_buffer((uintptr_t)buffer, size) != 0) {
+        return SYSCALL_ERROR;
+    }
+    return SYSCALL_SUCCESS;
+}
+
+/**
+ * sys_ipc_call - Send a message and wait for the reply
+ * 
+ * The message is the tag in a1 and five words in a2-a6; the reply comes
+ * back in the same registers. If a server is waiting, it runs at once in
+ * the caller's place.
+ * 
+ * @param fd Endpoint descriptor
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_ipc_call(int fd) {
+    if (ipc_call(fd) != 0) {
+        return SYSCALL_ERROR;
+    }
+    return SYSCALL_SUCCESS;
+}
+
+/**
+ * sys_ipc_reply_wait - Reply to the last caller and wait for the next
+ * 
+ * The reply is taken from a1-a6, which then receive the next message.
+ * 
+ * @param fd Endpoint descriptor opened with O_CREAT
+ * @return PID of the caller received, -1 on error
+ */
+uint64_t sys_ipc_reply_wait(int fd) {
+    int pid = ipc_reply_wait(fd);
+    return (pid < 0) ? SYSCALL_ERROR : (uint64_t)pid;
+}
+
+/**
+ * sys_socket - Create a socket
+ * 
+ * @param family Address family (AF_UNIX)
+ * @param type SOCK_STREAM or SOCK_DGRAM, optionally or-ed with
+ *             SOCK_NONBLOCK and SOCK_CLOEXEC
+ * @param protocol Must be 0
+ * @return New file descriptor, or -1 on error
+ */
+uint64_t sys_socket(int family, int type, int protocol) {
+    int fd = socket_create(family, type, protocol);
+    return (fd < 0) ? SYSCALL_ERROR : (uint64_t)fd;
+}
+
+/**
+ * sys_socketpair - Create a pair of connected sockets
+ * 
+ * @param family Address family (AF_UNIX)
+ * @param type As for sys_socket
+ * @param protocol Must be 0
+ * @param fds Receives the two descriptors
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_socketpair(int family, int type, int protocol, int *fds) {
+    if (!is_valid_user_pointer(fds, 2 * sizeof(int))) {
+        return SYSCALL_ERROR;
+    }
+    
+    int kernel_fds[2];
+    if (socket_pair(family, type, protocol, kernel_fds) != 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    fds[0] = kernel_fds[0];
+    fds[1] = kernel_fds[1];
+    return SYSCALL_SUCCESS;
+}
+
+/**
+ * sys_bind - Bind a socket to an address
+ * 
+ * @param fd Socket descriptor
+ * @param addr Address, e.g. a struct sockaddr_un
+ * @param len Size of the address
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_bind(int fd, const struct sockaddr *addr, socklen_t len) {
+    if (!is_valid_user_pointer(addr, len)) {
+        return SYSCALL_ERROR;
+    }
+    
+    int result = socket_bind(fd, addr, len);
+    return (result == 0) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
+}
+
+/**
+ * sys_listen - Accept connections on a socket
+ * 
+ * @param fd Bound stream socket
+ * @param backlog Connections that may wait for accept (at most SOMAXCONN)
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_listen(int fd, int backlog) {
+    int result = socket_listen(fd, backlog);
+    return (result == 0) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
+}
+
+/**
+ * sys_accept - Take the next connection of a listening socket
+ * 
+ * @param fd Listening socket
+ * @param flags SOCK_NONBLOCK and SOCK_CLOEXEC for the new descriptor, or 0
+ * @return Descriptor of the connected socket, or -1 on error
+ */
+uint64_t sys_accept(int fd, int flags) {
+    int new_fd = socket_accept(fd, (uint32_t)flags);
+    return (new_fd < 0) ? SYSCALL_ERROR : (uint64_t)new_fd;
+}
+
+/**
+ * sys_connect - Connect a socket to an address
+ * 
+ * @param fd Socket descriptor
+ * @param addr Address of a listening socket, or of the default peer for
+ *             a datagram socket
+ * @param len Size of the address
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_connect(int fd, const struct sockaddr *addr, socklen_t len) {
+    if (!is_valid_user_pointer(addr, len)) {
+        return SYSCALL_ERROR;
+    }
+    
+    int result = socket_connect(fd, addr, len);
+    return (result == 0) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
+}
+
+/**
+ * copy_user_msghdr - Copy and validate a user message header
+ * 
+ * The buffer list is copied as for readv; the name and control buffers
+ * are only checked.
+ * 
+ * @param user_msg Header in user memory
+ * @param msg Receives the copy; msg->msg_iov must be freed with kfree
+ * @return 0 on success, -1 if invalid
+ */
+static int copy_user_msghdr(const struct msghdr *user_msg, struct msghdr *msg) {
+    if (!is_valid_user_pointer(user_msg, sizeof(*user_msg))) {
+        return -1;
+    }
+    *msg = *user_msg;
+    
+    if ((msg->msg_name && !is_valid_user_pointer(msg->msg_name, msg->msg_namelen)) ||
+        (msg->msg_control && !is_valid_user_pointer(msg->msg_control, msg->msg_controllen))) {
+        return -1;
+    }
+    
+    if (msg->msg_iovlen == 0) {
+        msg->msg_iov = NULL;
+        return 0;
+    }
+    msg->msg_iov = copy_user_iovec(user_msg->msg_iov, msg->msg_iovlen);
+    return msg->msg_iov ? 0 : -1;
+}
+
+/**
+ * sys_sendmsg - Send a message on a socket
+ * 
+ * @param fd Socket descriptor
+ * @param user_msg Data, destination (msg_name, or NULL when connected) and
+ *                 SCM_RIGHTS control messages
+ * @param flags MSG_DONTWAIT, or 0
+ * @return Number of bytes sent, or -1 on error
+ */
+uint64_t sys_sendmsg(int fd, const struct msghdr *user_msg, int flags) {
+    struct msghdr msg;
+    if (copy_user_msghdr(user_msg, &msg) != 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    int result = socket_sendmsg(fd, &msg, (uint32_t)flags);
+    kfree(msg.msg_iov);
+    return (result < 0) ? SYSCALL_ERROR : (uint64_t)result;
+}
+
+/**
+ * sys_recvmsg - Receive a message from a socket
+ * 
+ * On return msg_namelen, msg_controllen and msg_flags describe what was
+ * received.
+ * 
+ * @param fd Socket descriptor
+ * @param user_msg Buffers for the data, the sender's address and
+ *                 SCM_RIGHTS control messages
+ * @param flags MSG_DONTWAIT and MSG_CMSG_CLOEXEC, or 0
+ * @return Number of bytes received, 0 at end of stream, or -1 on error
+ */
+uint64_t sys_recvmsg(int fd, struct msghdr *user_msg, int flags) {
+    struct msghdr msg;
+    if (copy_user_msghdr(user_msg, &msg) != 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    int result = socket_recvmsg(fd, &msg, (uint32_t)flags);
+    kfree(msg.msg_iov);
+    if (result < 0) {
+        return SYSCALL_ERROR;
+    }
+    
+    user_msg->msg_namelen = msg.msg_namelen;
+    user_msg->msg_controllen = msg.msg_controllen;
+    user_msg->msg_flags = msg.msg_flags;
+    return (uint64_t)result;
+}
+
+/**
+ * sys_poll - Wait until one of a set of descriptors is ready
+ * 
+ * @param fds Descriptors and events to watch; revents is filled in
+ * @param nfds Number of entries (at most POLL_MAX_FDS)
+ * @param timeout_ms Milliseconds to wait, 0 to return at once, negative
+ *                   to wait forever
+ * @return Number of ready descriptors, 0 on timeout, or -1 on error
+ */
+uint64_t sys_poll(struct pollfd *fds, uint32_t nfds, int timeout_ms) {
+    if (nfds > POLL_MAX_FDS ||
+        (nfds > 0 && !is_valid_user_pointer(fds, nfds * sizeof(struct pollfd)))) {
+        return SYSCALL_ERROR;
+    }
+    
+    // Work on a copy so the descriptors cannot change during the call
+    struct pollfd *kfds = NULL;
+    if (nfds > 0) {
+        kfds = kmalloc(nfds * sizeof(struct pollfd));
+        if (!kfds) {
+            return SYSCALL_ERROR;
+        }
+        for (uint32_t i = 0; i < nfds; i++) {
+            kfds[i] = fds[i];
+        }
+    }
+    
+    int result = poll_fds(kfds, nfds, timeout_ms);
+    if (result >= 0) {
+        for (uint32_t i = 0; i < nfds; i++) {
+            fds[i].revents = kfds[i].revents;
+        }
+    }
+    
+    kfree(kfds);
+    return (result < 0) ? SYSCALL_ERROR : (uint64_t)result;
+}
+
+/**
+ * sys_epoll_create - Create an epoll instance
+ * 
+ * @param flags EPOLL_CLOEXEC, or 0
+ * @return File descriptor of the instance, or -1 on error
+ */
+uint64_t sys_epoll_create(int flags) {
+    int fd = epoll_create((uint32_t)flags);
+    return (fd < 0) ? SYSCALL_ERROR : (uint64_t)fd;
+}
+
+/**
+ * sys_epoll_ctl - Add, change or remove an epoll watch
+ * 
+ * @param epfd epoll descriptor
+ * @param op EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL
+ * @param fd Descriptor to watch
+ * @param event Events and data to return with them (unused for DEL)
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_epoll_ctl(int epfd, int op, int fd, const struct epoll_event *event) {
+    struct epoll_event kevent = { 0, 0 };
+    if (op != EPOLL_CTL_DEL) {
+        if (!is_valid_user_pointer(event, sizeof(*event))) {
+            return SYSCALL_ERROR;
+        }
+        kevent = *event;
+    }
+    
+    int result = epoll_ctl(epfd, op, fd, &kevent);
+    return (result == 0) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
+}
+
+/**
+ * sys_epoll_wait - Wait for events on an epoll instance
+ * 
+ * @param epfd epoll descriptor
+ * @param events Buffer for up to maxevents events
+ * @param maxevents Size of events, greater than 0
+ * @param timeout_ms As for sys_poll
+ * @return Number of events stored, 0 on timeout, or -1 on error
+ */
+uint64_t sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout_ms) {
+    if (maxevents <= 0 ||
+        !is_valid_user_pointer(events, (size_t)maxevents * sizeof(struct epoll_event))) {
+        return SYSCALL_ERROR;
+    }
+    
+    int result = epoll_wait(epfd, events, maxevents, timeout_ms);
+    return (result < 0) ? SYSCALL_ERROR : (uint64_t)result;
+}
+
+/**
+ * sys_eventfd - Create an event counter
+ * 
+ * @param initval Initial value of the counter
+ * @param flags EFD_SEMAPHORE, EFD_NONBLOCK and EFD_CLOEXEC, or 0
+ * @return File descriptor, or -1 on error
+ */
+uint64_t sys_eventfd(unsigned int initval, int flags) {
+    int fd = eventfd_open(initval, (uint32_t)flags);
+    return (fd < 0) ? SYSCALL_ERROR : (uint64_t)fd;
+}
+
+/**
+ * sys_gethwcap - Get the ISA extensions user code may use
+ * 
+ * @return One bit per extension letter (bit 0 = 'a'); 'v' only when the
+ *         hart has vectors and the kernel switches their state
+ */
+uint64_t sys_gethwcap(void) {
+    return fpu_hwcap();
+}
+
+/**
+ * sys_rmdir - Remove a directory
+ * 
+ * @param path Directory path
+ * @return 0 on success, -1 on error
+ */
+uint64_t sys_rmdir(const char *path) {
+    if (!is_valid_user_pointer(path, 1)) {
+        return SYSCALL_ERROR;
+    }
+    
+    // Validate path length
+    size_t path_len = 0;
+    const char *p = path;
+    while (*p && path_len < 4096) {
+        p++;
+        path_len++;
+    }
+    
+    if (path_len == 0 || path_len >= 4096) {
+        return SYSCALL_ERROR;
+    }
+    
+    int result = vfs_rmdir(path);
+    return (result == 0) ? SYSCALL_SUCCESS : SYSCALL_ERROR;
+}
+
+/**
+ * sys_execve - Execute program from filesystem
+ * 
+ * @param path Path to executable
+ * @param argv Argument array
+ * @param envp Environment array (ignored)
+ * @return Does not return on success, -1 on error
+ */
+uint64_t sys_execve(const char *path, const char *argv[], const char *envp[]) {
+    (void)envp;
+    
+    if (!is_valid_user_pointer(path, 1)) {
+        return SYSCALL_ERROR;
+    }
+    
+    // Count arguments
+    int argc = 0;
+    if (argv) {
+        while (argv[argc] && argc < 256) {
+            if (!is_valid_user_pointer(argv[argc], 1)) {
+                return SYSCALL_ERROR;
+            }
+            argc++;
+        }
+    }
+    
+    // Load and execute ELF binary
+    int result = elf_load_exec(path, argv, argc);
+    
+    // If we get here, exec failed
+    return (result < 0) ? SYSCALL_ERROR : result;
+}
+
+/**
+ * syscall_handler - Main system call dispatcher
+ * 
+ * Called from trap handler when ECALL is executed from user mode.
+ * Dispatches to appropriate syscall implementation based on syscall number.
+ * 
+ * @param syscall_number Syscall number (from a7 register)
+ * @param argument0 First argument (from a0 register)
+ * @param argument1 Second argument (from a1 register)
+ * @param argument2 Third argument (from a2 register)
+ * @param argument3 Fourth argument (from a3 register)
+ * @param argument4 Fifth argument (from a4 register)
+ * @param argument5 Sixth argument (from a5 register)
+ * @return Return value (placed in a0 register)
+ */
+uint64_t syscall_handler(uint64_t syscall_number, 
+                        uint64_t argument0, uint64_t argument1, uint64_t argument2,
+                        uint64_t argument3, uint64_t argument4, uint64_t argument5) {
+    uint64_t return_value = SYSCALL_ERROR;
+    
+    
+    switch (syscall_number) {
+        case SYS_EXIT:
+            return_value = sys_exit((int)argument0);
+            break;
+        
+        case SYS_WAIT:  // waitpid
+            return_value = sys_waitpid((int)argument0, (int *)argument1, (int)argument2);
+            break;
+        
+        case SYS_WRITE:
+            return_value = sys_write((int)argument0, (const char *)argument1, (size_t)argument2);
+            break;
+        
+        case SYS_READ:
             return_value = sys_read((int)argument0, (char *)argument1, (size_t)argument2);
             break;
-            
+        
         case SYS_GETPID:
             return_value = sys_getpid();
             break;
-            
+        
         case SYS_SBRK:
             return_value = sys_sbrk((int)argument0);
             break;
-            
+        
         case SYS_SLEEP:
             return_value = sys_sleep(argument0);
             break;
-            
+        
         case SYS_YIELD:
             return_value = sys_yield();
             break;
-            
+        
         case SYS_GETPPID:
             return_value = sys_getppid();
             break;
-            
+        
         case SYS_KILL:
             return_value = sys_kill((int)argument0, (int)argument1);
             break;
-            
+        
         case SYS_GETTIME:
             return_value = sys_gettime();
             break;
-            
+        
         case SYS_OPEN:
             return_value = sys_open((const char *)argument0, (int)argument1, (int)argument2);
             break;
-            
+        
         case SYS_CLOSE:
             return_value = sys_close((int)argument0);
             break;
-            
+        
         case SYS_LSEEK:
             return_value = sys_lseek((int)argument0, (int64_t)argument1, (int)argument2);
             break;
-            
+        
         case SYS_STAT:
             return_value = sys_stat((const char *)argument0, (void *)argument1);
             break;
-            
+        
         case SYS_MKDIR:
             return_value = sys_mkdir((const char *)argument0, (int)argument1);
             break;
-            
+        
         case SYS_UNLINK:
             return_value = sys_unlink((const char *)argument0);
             break;
-            
+        
         case SYS_RMDIR:
             return_value = sys_rmdir((const char *)argument0);
             break;
-            
+        
         case SYS_EXECVE:
             return_value = sys_execve((const char *)argument0, (const char **)argument1, (const char **)argument2);
             break;
-            
+        
+        case SYS_FTRUNCATE:
+            return_value = sys_ftruncate((int)argument0, argument1);
+            break;
+        
+        case SYS_FALLOCATE:
+            return_value = sys_fallocate((int)argument0, (int)argument1, argument2, argument3);
+            break;
+        
+        case SYS_DUP:
+            return_value = sys_dup((int)argument0);
+            break;
+        
+        case SYS_DUP2:
+            return_value = sys_dup2((int)argument0, (int)argument1);
+            break;
+        
+        case SYS_GETDENTS:
+            return_value = sys_getdents((int)argument0, (void *)argument1, (size_t)argument2);
+            break;
+        
+        case SYS_PREAD:
+            return_value = sys_pread((int)argument0, (char *)argument1, (size_t)argument2,
+                                     (int64_t)argument3);
+            break;
+        
+        case SYS_PWRITE:
+            return_value = sys_pwrite((int)argument0, (const char *)argument1, (size_t)argument2,
+                                      (int64_t)argument3);
+            break;
+        
+        case SYS_READV:
+            return_value = sys_readv((int)argument0, (const vfs_iovec_t *)argument1, (int)argument2);
+            break;
+        
+        case SYS_WRITEV:
+            return_value = sys_writev((int)argument0, (const vfs_iovec_t *)argument1, (int)argument2);
+            break;
+        
+        case SYS_COPY_FILE_RANGE:
+            return_value = sys_copy_file_range((int)argument0, (int64_t *)argument1, (int)argument2,
+                                               (int64_t *)argument3, (size_t)argument4,
+                                               (unsigned int)argument5);
+            break;
+        
+        case SYS_SENDFILE:
+            return_value = sys_sendfile((int)argument0, (int)argument1, (int64_t *)argument2,
+                                        (size_t)argument3);
+            break;
+        
+        case SYS_SYNC:
+            return_value = sys_sync();
+            break;
+        
+        case SYS_IOCTL:
+            return_value = sys_ioctl((int)argument0, (uint32_t)argument1, (void *)argument2);
+            break;
+        
+        case SYS_PIPE:
+            return_value = sys_pipe((int *)argument0, (int)argument1);
+            break;
+        
+        case SYS_SPLICE:
+            return_value = sys_splice((int)argument0, (int64_t *)argument1, (int)argument2,
+                                      (int64_t *)argument3, (size_t)argument4,
+                                      (unsigned int)argument5);
+            break;
+        
+        case SYS_VMSPLICE:
+            return_value = sys_vmsplice((int)argument0, (const vfs_iovec_t *)argument1,
+                                        (int)argument2, (unsigned int)argument3);
+            break;
+        
+        case SYS_MMAP:
+            return_value = sys_mmap((void *)argument0, (size_t)argument1, (int)argument2,
+                                    (int)argument3, (int)argument4, (int64_t)argument5);
+            break;
+        
+        case SYS_MUNMAP:
+            return_value = sys_munmap((void *)argument0, (size_t)argument1);
+            break;
+        
+        case SYS_SHM_OPEN:
+            return_value = sys_shm_open((const char *)argument0, (int)argument1, (int)argument2);
+            break;
+        
+        case SYS_SHM_UNLINK:
+            return_value = sys_shm_unlink((const char *)argument0);
+            break;
+        
+        case SYS_MEMFD_CREATE:
+            return_value = sys_memfd_create((const char *)argument0, (unsigned int)argument1);
+            break;
+        
+        case SYS_IPC_ENDPOINT:
+            return_value = sys_ipc_endpoint((const char *)argument0, (int)argument1);
+            break;
+        
+        case SYS_IPC_BUFFER:
+            return_value = sys_ipc_buffer((void *)argument0, (size_t)argument1);
+            break;
+        
+        case SYS_IPC_CALL:
+            return_value = sys_ipc_call((int)argument0);
+            break;
+        
+        case SYS_IPC_REPLY_WAIT:
+            return_value = sys_ipc_reply_wait((int)argument0);
+            break;
+        
+        case SYS_SOCKET:
+            return_value = sys_socket((int)argument0, (int)argument1, (int)argument2);
+            break;
+        
+        case SYS_SOCKETPAIR:
+            return_value = sys_socketpair((int)argument0, (int)argument1, (int)argument2,
+                                          (int *)argument3);
+            break;
+        
+        case SYS_BIND:
+            return_value = sys_bind((int)argument0, (const struct sockaddr *)argument1,
+                                    (socklen_t)argument2);
+            break;
+        
+        case SYS_LISTEN:
+            return_value = sys_listen((int)argument0, (int)argument1);
+            break;
+        
+        case SYS_ACCEPT:
+            return_value = sys_accept((int)argument0, (int)argument1);
+            break;
+        
+        case SYS_CONNECT:
+            return_value = sys_connect((int)argument0, (const struct sockaddr *)argument1,
+                                       (socklen_t)argument2);
+            break;
+        
+        case SYS_SENDMSG:
+            return_value = sys_sendmsg((int)argument0, (const struct msghdr *)argument1,
+                                       (int)argument2);
+            break;
+        
+        case SYS_RECVMSG:
+            return_value = sys_recvmsg((int)argument0, (struct msghdr *)argument1,
+                                       (int)argument2);
+            break;
+        
+        case SYS_POLL:
+            return_value = sys_poll((struct pollfd *)argument0, (uint32_t)argument1,
+                                    (int)argument2);
+            break;
+        
+        case SYS_EPOLL_CREATE:
+            return_value = sys_epoll_create((int)argument0);
+            break;
+        
+        case SYS_EPOLL_CTL:
+            return_value = sys_epoll_ctl((int)argument0, (int)argument1, (int)argument2,
+                                         (const struct epoll_event *)argument3);
+            break;
+        
+        case SYS_EPOLL_WAIT:
+            return_value = sys_epoll_wait((int)argument0, (struct epoll_event *)argument1,
+                                          (int)argument2, (int)argument3);
+            break;
+        
+        case SYS_EVENTFD:
+            return_value = sys_eventfd((unsigned int)argument0, (int)argument1);
+            break;
+        
+        case SYS_GETHWCAP:
+            return_value = sys_gethwcap();
+            break;
+        
+        case SYS_FSYNC:
+            return_value = sys_fsync((int)argument0);
+            break;
+        
         case SYS_FORK:
         case SYS_EXEC:
             return_value = SYSCALL_ERROR;
             break;
-            
+        
         default:
             hal_uart_puts("[SYSCALL] Invalid syscall number\n");
             return_value = SYSCALL_ERROR;
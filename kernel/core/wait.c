@@ -0,0 +1,103 @@
+/*
+ * Wait Queue Implementation
+ * 
+ * Sleepers link an entry on their own stack into the queue, so a wait
+ * queue needs no memory of its own. Queues are only changed with
+ * interrupts disabled.
+ */
+
+#include "kernel/wait.h"
+#include "kernel/process.h"
+#include "arch/interrupt.h"
+#include <stddef.h>
+
+/**
+ * Initialize an empty wait queue
+ */
+void wait_queue_init(wait_queue_t *queue) {
+    queue->head = NULL;
+}
+
+/**
+ * Unlink an entry if it is still queued, with interrupts disabled
+ */
+static void wait_queue_unlink(wait_queue_t *queue, wait_queue_entry_t *entry) {
+    wait_queue_entry_t **link = &queue->head;
+    while (*link) {
+        if (*link == entry) {
+            *link = entry->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+}
+
+/**
+ * Sleep on a wait queue until woken
+ */
+void wait_queue_sleep(wait_queue_t *queue) {
+    wait_queue_sleep_timeout(queue, 0);
+}
+
+/**
+ * Sleep on a wait queue until woken or until the timeout
+ */
+void wait_queue_sleep_timeout(wait_queue_t *queue, uint64_t ticks) {
+    wait_queue_entry_t entry;
+    entry.proc = process_current();
+    if (!entry.proc) {
+        return;
+    }
+    entry.func = NULL;
+    entry.data = NULL;
+    
+    entry.next = queue->head;
+    queue->head = &entry;
+    
+    process_sleep(ticks);
+    
+    // Woken by anyone but wake_all, the entry is still linked
+    wait_queue_unlink(queue, &entry);
+}
+
+/**
+ * Add a callback entry to a wait queue
+ */
+void wait_queue_add(wait_queue_t *queue, wait_queue_entry_t *entry) {
+    int irq_state = interrupt_save_disable();
+    entry->proc = NULL;
+    entry->next = queue->head;
+    queue->head = entry;
+    interrupt_restore(irq_state);
+}
+
+/**
+ * Remove a callback entry from a wait queue
+ */
+void wait_queue_remove(wait_queue_t *queue, wait_queue_entry_t *entry) {
+    int irq_state = interrupt_save_disable();
+    wait_queue_unlink(queue, entry);
+    interrupt_restore(irq_state);
+}
+
+/**
+ * Wake every process sleeping on a wait queue and run its callbacks
+ */
+void wait_queue_wake_all(wait_queue_t *queue) {
+    int irq_state = interrupt_save_disable();
+    
+    wait_queue_entry_t **link = &queue->head;
+    while (*link) {
+        // The sleeper may reuse its stack as soon as it runs again
+        wait_queue_entry_t *entry = *link;
+        if (entry->func) {
+            link = &entry->next;
+            entry->func(entry);
+        } else {
+            *link = entry->next;
+            process_wakeup(entry->proc);
+        }
+    }
+    
+    interrupt_restore(irq_state);
+}
@@ -0,0 +1,118 @@
+/*
+ * Console Input
+ * 
+ * The UART's receive interrupt moves characters into a ring and wakes
+ * the input queue. Readers also drain the UART themselves and sleep for
+ * at most a timer tick at a time, so input still arrives, a little later,
+ * if the interrupt is never delivered.
+ */
+
+#include <drivers/console.h>
+#include <hal/hal_uart.h>
+#include <arch/interrupt.h>
+#include <kernel/wait.h>
+#include <kernel/errno.h>
+#include <stddef.h>
+
+/* Typed characters; head and tail count up and wrap with the buffer */
+static char input[CONSOLE_INPUT_SIZE];
+static uint32_t input_head = 0;
+static uint32_t input_tail = 0;
+
+/* Readers and pollers waiting for input */
+static wait_queue_t input_wait;
+
+/**
+ * Move waiting characters from the UART into the ring
+ * Called with interrupts disabled. Characters that do not fit are
+ * dropped, since they must be read to clear the interrupt.
+ * 
+ * @return Number of characters added
+ */
+static uint32_t console_drain(void) {
+    uint32_t added = 0;
+    int c;
+    while ((c = hal_uart_try_getc()) >= 0) {
+        if (input_tail - input_head < CONSOLE_INPUT_SIZE) {
+            input[input_tail++ % CONSOLE_INPUT_SIZE] = (char)c;
+            added++;
+        }
+    }
+    return added;
+}
+
+/**
+ * Drain the UART and wake whoever waits for what arrived
+ * Called with interrupts disabled, or from the interrupt handler.
+ */
+static void console_fill(void) {
+    if (console_drain() > 0) {
+        wait_queue_wake_all(&input_wait);
+    }
+}
+
+/**
+ * Start taking input by interrupt
+ */
+void console_init(void) {
+    wait_queue_init(&input_wait);
+    
+    uint32_t irq = hal_uart_enable_rx_interrupt();
+    if (interrupt_register_handler(irq, console_fill)) {
+        interrupt_set_priority(irq, IRQ_PRIORITY_NORMAL);
+        interrupt_enable_irq(irq);
+    }
+}
+
+/**
+ * Read typed characters
+ */
+int console_read(char *buffer, uint32_t size, int nonblock) {
+    if (size == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    int irq_state = interrupt_save_disable();
+    console_fill();
+    while (input_head == input_tail) {
+        if (nonblock) {
+            interrupt_restore(irq_state);
+            RETURN_ERRNO(THUNDEROS_EAGAIN);
+        }
+        wait_queue_sleep_timeout(&input_wait, 1);
+        console_fill();
+    }
+    
+    uint32_t count = 0;
+    while (count < size && input_head != input_tail) {
+        buffer[count++] = input[input_head++ % CONSOLE_INPUT_SIZE];
+    }
+    interrupt_restore(irq_state);
+    
+    clear_errno();
+    return (int)count;
+}
+
+/**
+ * Read one typed character, waiting for it
+ */
+char console_getc(void) {
+    char c;
+    console_read(&c, 1, 0);
+    return c;
+}
+
+/**
+ * Poll operation of the console input
+ */
+uint32_t console_poll(poll_table_t *pt) {
+    poll_wait(pt, &input_wait);
+    
+    int irq_state = interrupt_save_disable();
+    console_fill();
+    int ready = (input_head != input_tail);
+    interrupt_restore(irq_state);
+    
+    return ready ? POLLIN : 0;
+}
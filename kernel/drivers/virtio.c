@@ -0,0 +1,194 @@
+/*
+ * VirtIO Virtqueues
+ * 
+ * Split virtqueues over the MMIO transport, shared by the VirtIO drivers.
+ * Callers serialize access to each queue themselves.
+ */
+
+#include <drivers/virtio.h>
+#include <mm/dma.h>
+#include <arch/barrier.h>
+#include <kernel/errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Write a device register
+ */
+static inline void virtio_mmio_write32(uintptr_t base_addr, uint32_t offset, uint32_t value)
+{
+    *((volatile uint32_t *)(base_addr + offset)) = value;
+}
+
+/**
+ * Initialize virtqueue with descriptor, available, and used rings
+ */
+int virtqueue_init(uintptr_t base_addr, uint32_t queue_idx, virtqueue_t *vq,
+                   uint32_t queue_size)
+{
+    vq->queue_size = queue_size;
+    vq->last_seen_used = 0;
+    vq->num_free = queue_size;
+    
+    /* Calculate sizes for each ring */
+    size_t desc_size = sizeof(virtq_desc_t) * queue_size;
+    size_t avail_size = sizeof(uint16_t) * (3 + queue_size);
+    size_t used_size = sizeof(uint16_t) * 3 + sizeof(virtq_used_elem_t) * queue_size;
+    
+    /* Allocate descriptor ring using DMA allocator */
+    dma_region_t *desc_region = dma_alloc(desc_size, DMA_ZERO);
+    if (!desc_region) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    vq->desc = (virtq_desc_t *)desc_region->virt_addr;
+    vq->desc_phys = desc_region->phys_addr;
+    
+    /* Allocate available ring */
+    dma_region_t *avail_region = dma_alloc(avail_size, DMA_ZERO);
+    if (!avail_region) {
+        dma_free(desc_region);
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    vq->avail = (virtq_avail_t *)avail_region->virt_addr;
+    vq->avail_phys = avail_region->phys_addr;
+    
+    /* Allocate used ring */
+    dma_region_t *used_region = dma_alloc(used_size, DMA_ZERO);
+    if (!used_region) {
+        dma_free(desc_region);
+        dma_free(avail_region);
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    vq->used = (virtq_used_t *)used_region->virt_addr;
+    vq->used_phys = used_region->phys_addr;
+    
+    /* Initialize free descriptor list (link all descriptors together) */
+    for (uint16_t i = 0; i < queue_size - 1; i++) {
+        vq->desc[i].next = i + 1;
+    }
+    vq->desc[queue_size - 1].next = 0;
+    vq->free_head = 0;
+    
+    /* Configure queue in device */
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_SEL, queue_idx);
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_NUM, queue_size);
+    
+    /* Write descriptor ring address (split 64-bit address into low/high) */
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_DESC_LOW, (uint32_t)(vq->desc_phys & 0xFFFFFFFF));
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_DESC_HIGH, (uint32_t)(vq->desc_phys >> 32));
+    
+    /* Write available ring address */
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_AVAIL_LOW, (uint32_t)(vq->avail_phys & 0xFFFFFFFF));
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_AVAIL_HIGH, (uint32_t)(vq->avail_phys >> 32));
+    
+    /* Write used ring address */
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_USED_LOW, (uint32_t)(vq->used_phys & 0xFFFFFFFF));
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_USED_HIGH, (uint32_t)(vq->used_phys >> 32));
+    
+    /* Mark queue as ready */
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_READY, 1);
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Allocate a chain of descriptors from the free list
+ */
+int virtqueue_alloc_desc_chain(virtqueue_t *vq, uint16_t *desc_idx, uint32_t count)
+{
+    if (vq->num_free < count) {
+        RETURN_ERRNO(THUNDEROS_EBUSY);
+    }
+    
+    *desc_idx = vq->free_head;
+    uint16_t current = vq->free_head;
+    
+    /* Advance free_head by 'count' descriptors */
+    for (uint32_t i = 0; i < count; i++) {
+        current = vq->desc[current].next;
+    }
+    vq->free_head = current;
+    vq->num_free -= count;
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Free a descriptor chain back to the free list
+ */
+void virtqueue_free_desc_chain(virtqueue_t *vq, uint16_t desc_idx)
+{
+    /* Count descriptors in chain */
+    uint16_t count = 1;
+    uint16_t current = desc_idx;
+    while (vq->desc[current].flags & VIRTQ_DESC_F_NEXT) {
+        current = vq->desc[current].next;
+        count++;
+    }
+    
+    /* Add chain back to free list */
+    vq->desc[current].next = vq->free_head;
+    vq->free_head = desc_idx;
+    vq->num_free += count;
+}
+
+/**
+ * Add descriptor to available ring
+ */
+void virtqueue_add_to_avail(virtqueue_t *vq, uint16_t desc_idx)
+{
+    uint16_t avail_idx = vq->avail->idx % vq->queue_size;
+    vq->avail->ring[avail_idx] = desc_idx;
+    
+    /* Memory barrier to ensure descriptor writes complete before index update */
+    write_barrier();
+    
+    vq->avail->idx++;
+}
+
+/**
+ * Get buffer from used ring
+ */
+int virtqueue_get_used_buf(virtqueue_t *vq, uint16_t *desc_idx, uint32_t *len)
+{
+    /* Memory barrier to ensure we read latest used ring index */
+    read_barrier();
+    
+    if (vq->last_seen_used == vq->used->idx) {
+        return -1;  // No new completions
+    }
+    
+    uint16_t used_idx = vq->last_seen_used % vq->queue_size;
+    *desc_idx = vq->used->ring[used_idx].id;
+    *len = vq->used->ring[used_idx].len;
+    
+    vq->last_seen_used++;
+    return 0;
+}
+
+/**
+ * Check for used buffers not yet taken
+ */
+int virtqueue_has_used(virtqueue_t *vq)
+{
+    read_barrier();
+    return vq->last_seen_used != vq->used->idx;
+}
+
+/**
+ * Notify device of new available buffers
+ */
+void virtqueue_notify(uintptr_t base_addr, uint32_t queue_idx)
+{
+    /* Memory barrier to ensure all writes complete before notify */
+    write_barrier();
+    
+    /* Write queue index to QUEUE_NOTIFY register */
+    virtio_mmio_write32(base_addr, VIRTIO_MMIO_QUEUE_NOTIFY, queue_idx);
+    
+    /* Memory barrier after notify */
+    write_barrier();
+}
+
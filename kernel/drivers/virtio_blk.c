@@ -15,199 +15,27 @@
 #include <stddef.h>
 #include <stdint.h>
 
-/* Helper macros for MMIO register access */
-#define VIRTIO_READ32(dev, offset) \
-    (*((volatile uint32_t *)((dev)->base_addr + (offset))))
+/* Probed devices, in probe order */
+static virtio_blk_device_t *g_blk_devices[VIRTIO_BLK_MAX_DEVICES];
+static int g_blk_count = 0;
 
-#define VIRTIO_WRITE32(dev, offset, value) \
-    (*((volatile uint32_t *)((dev)->base_addr + (offset))) = (value))
-
-/* Global device state */
+/* Default device */
 static virtio_blk_device_t *g_blk_device = NULL;
 
-/* Forward declarations */
-static int virtqueue_init(virtio_blk_device_t *dev, uint32_t queue_size);
-static int virtqueue_alloc_desc_chain(virtqueue_t *vq, uint16_t *desc_idx, uint32_t count);
-static void virtqueue_free_desc_chain(virtqueue_t *vq, uint16_t desc_idx);
-static void virtqueue_add_to_avail(virtqueue_t *vq, uint16_t desc_idx);
-static int virtqueue_get_used_buf(virtqueue_t *vq, uint16_t *desc_idx, uint32_t *len);
-static void virtqueue_notify(virtio_blk_device_t *dev, uint32_t queue_idx);
-
-/**
- * Initialize virtqueue with descriptor, available, and used rings
- */
-static int virtqueue_init(virtio_blk_device_t *dev, uint32_t queue_size)
-{
-    virtqueue_t *vq = &dev->queue;
-    vq->queue_size = queue_size;
-    vq->last_seen_used = 0;
-    vq->num_free = queue_size;
-    
-    /* Calculate sizes for each ring */
-    size_t desc_size = sizeof(virtq_desc_t) * queue_size;
-    size_t avail_size = sizeof(uint16_t) * (3 + queue_size);
-    size_t used_size = sizeof(uint16_t) * 3 + sizeof(virtq_used_elem_t) * queue_size;
-    
-    /* Allocate descriptor ring using DMA allocator */
-    dma_region_t *desc_region = dma_alloc(desc_size, DMA_ZERO);
-    if (!desc_region) {
-        RETURN_ERRNO(THUNDEROS_ENOMEM);
-    }
-    vq->desc = (virtq_desc_t *)desc_region->virt_addr;
-    vq->desc_phys = desc_region->phys_addr;
-    
-    /* Allocate available ring */
-    dma_region_t *avail_region = dma_alloc(avail_size, DMA_ZERO);
-    if (!avail_region) {
-        dma_free(desc_region);
-        RETURN_ERRNO(THUNDEROS_ENOMEM);
-    }
-    vq->avail = (virtq_avail_t *)avail_region->virt_addr;
-    vq->avail_phys = avail_region->phys_addr;
-    
-    /* Allocate used ring */
-    dma_region_t *used_region = dma_alloc(used_size, DMA_ZERO);
-    if (!used_region) {
-        dma_free(desc_region);
-        dma_free(avail_region);
-        RETURN_ERRNO(THUNDEROS_ENOMEM);
-    }
-    vq->used = (virtq_used_t *)used_region->virt_addr;
-    vq->used_phys = used_region->phys_addr;
-    
-    /* Initialize free descriptor list (link all descriptors together) */
-    for (uint16_t i = 0; i < queue_size - 1; i++) {
-        vq->desc[i].next = i + 1;
-    }
-    vq->desc[queue_size - 1].next = 0;
-    vq->free_head = 0;
-    
-    /* Configure queue in device */
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_SEL, 0);
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_NUM, queue_size);
-    
-    /* Write descriptor ring address (split 64-bit address into low/high) */
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_DESC_LOW, (uint32_t)(vq->desc_phys & 0xFFFFFFFF));
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_DESC_HIGH, (uint32_t)(vq->desc_phys >> 32));
-    
-    /* Write available ring address */
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_AVAIL_LOW, (uint32_t)(vq->avail_phys & 0xFFFFFFFF));
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_AVAIL_HIGH, (uint32_t)(vq->avail_phys >> 32));
-    
-    /* Write used ring address */
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_USED_LOW, (uint32_t)(vq->used_phys & 0xFFFFFFFF));
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_USED_HIGH, (uint32_t)(vq->used_phys >> 32));
-    
-    /* Mark queue as ready */
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_READY, 1);
-    
-    clear_errno();
-    return 0;
-}
-
-/**
- * Allocate a chain of descriptors from the free list
- */
-static int virtqueue_alloc_desc_chain(virtqueue_t *vq, uint16_t *desc_idx, uint32_t count)
-{
-    if (vq->num_free < count) {
-        RETURN_ERRNO(THUNDEROS_EBUSY);
-    }
-    
-    *desc_idx = vq->free_head;
-    uint16_t current = vq->free_head;
-    
-    /* Advance free_head by 'count' descriptors */
-    for (uint32_t i = 0; i < count; i++) {
-        current = vq->desc[current].next;
-    }
-    vq->free_head = current;
-    vq->num_free -= count;
-    
-    clear_errno();
-    return 0;
-}
-
-/**
- * Free a descriptor chain back to the free list
- */
-static void virtqueue_free_desc_chain(virtqueue_t *vq, uint16_t desc_idx)
-{
-    /* Count descriptors in chain */
-    uint16_t count = 1;
-    uint16_t current = desc_idx;
-    while (vq->desc[current].flags & VIRTQ_DESC_F_NEXT) {
-        current = vq->desc[current].next;
-        count++;
-    }
-    
-    /* Add chain back to free list */
-    vq->desc[current].next = vq->free_head;
-    vq->free_head = desc_idx;
-    vq->num_free += count;
-}
-
-/**
- * Add descriptor to available ring
- */
-static void virtqueue_add_to_avail(virtqueue_t *vq, uint16_t desc_idx)
-{
-    uint16_t avail_idx = vq->avail->idx % vq->queue_size;
-    vq->avail->ring[avail_idx] = desc_idx;
-    
-    /* Memory barrier to ensure descriptor writes complete before index update */
-    write_barrier();
-    
-    vq->avail->idx++;
-}
-
-/**
- * Get buffer from used ring
- */
-static int virtqueue_get_used_buf(virtqueue_t *vq, uint16_t *desc_idx, uint32_t *len)
-{
-    /* Memory barrier to ensure we read latest used ring index */
-    read_barrier();
-    
-    if (vq->last_seen_used == vq->used->idx) {
-        return -1;  // No new completions
-    }
-    
-    uint16_t used_idx = vq->last_seen_used % vq->queue_size;
-    *desc_idx = vq->used->ring[used_idx].id;
-    *len = vq->used->ring[used_idx].len;
-    
-    vq->last_seen_used++;
-    return 0;
-}
-
-/**
- * Notify device of new available buffers
- */
-static void virtqueue_notify(virtio_blk_device_t *dev, uint32_t queue_idx)
-{
-    /* Memory barrier to ensure all writes complete before notify */
-    write_barrier();
-    
-    /* Write queue index to QUEUE_NOTIFY register */
-    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_NOTIFY, queue_idx);
-    
-    /* Memory barrier after notify */
-    write_barrier();
-}
-
 /**
- * Perform a synchronous block I/O request
+ * Perform a synchronous block I/O request on a scatter-gather list
+ * Each segment gets its own data descriptor between the header and the
+ * status byte. Requests without data (flush) use a two-descriptor chain.
  */
-static int virtio_blk_do_request(virtio_blk_device_t *dev, virtio_blk_request_t *req,
-                                  uint64_t sector, void *buffer, uint32_t sectors,
-                                  uint32_t type)
+static int virtio_blk_do_sg_request(virtio_blk_device_t *dev, virtio_blk_request_t *req,
+                                     uint64_t sector, const dma_sg_t *sg, uint32_t nr_sg,
+                                     uint32_t type)
 {
     virtqueue_t *vq = &dev->queue;
     
-    /* Allocate 3 descriptors: header, data buffer, status */
+    /* Allocate descriptors: header, one per data segment, status */
     uint16_t desc_idx;
-    if (virtqueue_alloc_desc_chain(vq, &desc_idx, 3) < 0) {
+    if (virtqueue_alloc_desc_chain(vq, &desc_idx, nr_sg + 2) < 0) {
         return -1;
     }
     
@@ -215,50 +43,53 @@ static int virtio_blk_do_request(virtio_blk_device_t *dev, virtio_blk_request_t
     req->header.type = type;
     req->header.reserved = 0;
     req->header.sector = sector;
-    req->data = buffer;
+    req->data = NULL;
     req->status = 0xFF;
     
-    /* Get physical addresses for all buffers */
+    /* Get physical addresses of the header and status byte */
     uintptr_t header_phys = translate_virt_to_phys((uintptr_t)&req->header);
-    uintptr_t data_phys = translate_virt_to_phys((uintptr_t)buffer);
     uintptr_t status_phys = translate_virt_to_phys((uintptr_t)&req->status);
     
-    if (header_phys == 0 || data_phys == 0 || status_phys == 0) {
+    if (header_phys == 0 || status_phys == 0) {
         virtqueue_free_desc_chain(vq, desc_idx);
         RETURN_ERRNO(THUNDEROS_EIO);
     }
     
     /* Descriptor 0: Request header (device reads) */
     uint16_t idx0 = desc_idx;
-    uint16_t idx1 = vq->desc[idx0].next;  // Get pre-allocated next descriptor
-    uint16_t idx2 = vq->desc[idx1].next;  // Get third descriptor
+    uint16_t idx_status = vq->desc[idx0].next;  // Get pre-allocated next descriptor
     
     vq->desc[idx0].addr = header_phys;
     vq->desc[idx0].len = sizeof(virtio_blk_req_header_t);
     vq->desc[idx0].flags = VIRTQ_DESC_F_NEXT;
-    // idx0.next is already set to idx1 from allocation
+    // idx0.next is already set from allocation
     
-    /* Descriptor 1: Data buffer (device reads for write, writes for read) */
-    vq->desc[idx1].addr = data_phys;
-    vq->desc[idx1].len = sectors * VIRTIO_BLK_SECTOR_SIZE;
-    vq->desc[idx1].flags = VIRTQ_DESC_F_NEXT;
-    if (type == VIRTIO_BLK_T_IN) {
-        vq->desc[idx1].flags |= VIRTQ_DESC_F_WRITE;
+    /* Data descriptors (device reads for write, writes for read) */
+    for (uint32_t i = 0; i < nr_sg; i++) {
+        uint16_t idx = idx_status;
+        idx_status = vq->desc[idx].next;  // Get the descriptor after it
+        
+        vq->desc[idx].addr = sg[i].phys_addr;
+        vq->desc[idx].len = sg[i].len;
+        vq->desc[idx].flags = VIRTQ_DESC_F_NEXT;
+        if (type == VIRTIO_BLK_T_IN) {
+            vq->desc[idx].flags |= VIRTQ_DESC_F_WRITE;
+        }
+        // next is already set from allocation
     }
-    // idx1.next is already set to idx2 from allocation
     
-    /* Descriptor 2: Status byte (device writes) */
-    vq->desc[idx2].addr = status_phys;
-    vq->desc[idx2].len = 1;
-    vq->desc[idx2].flags = VIRTQ_DESC_F_WRITE;  // Last descriptor, no NEXT flag
-    vq->desc[idx2].next = 0;
+    /* Last descriptor: Status byte (device writes) */
+    vq->desc[idx_status].addr = status_phys;
+    vq->desc[idx_status].len = 1;
+    vq->desc[idx_status].flags = VIRTQ_DESC_F_WRITE;  // Last descriptor, no NEXT flag
+    vq->desc[idx_status].next = 0;
     
     /* Memory barrier - ensure descriptor writes complete */
     write_barrier();
     
     /* Add to available ring and notify device */
     virtqueue_add_to_avail(vq, desc_idx);
-    virtqueue_notify(dev, 0);
+    virtqueue_notify(dev->base_addr, 0);
     
     /* Poll for completion (synchronous for now) */
     uint32_t timeout = 1000000;
@@ -280,7 +111,7 @@ static int virtio_blk_do_request(virtio_blk_device_t *dev, virtio_blk_request_t
             }
             
             clear_errno();
-            return sectors;
+            return 0;
         }
         timeout--;
     }
@@ -290,121 +121,176 @@ static int virtio_blk_do_request(virtio_blk_device_t *dev, virtio_blk_request_t
     RETURN_ERRNO(THUNDEROS_EVIRTIO_TIMEOUT);
 }
 
+/**
+ * Perform a synchronous block I/O request on one kernel buffer
+ * The buffer must be physically contiguous (DMA memory or kernel heap).
+ */
+static int virtio_blk_do_request(virtio_blk_device_t *dev, virtio_blk_request_t *req,
+                                  uint64_t sector, void *buffer, uint32_t data_len,
+                                  uint32_t type)
+{
+    if (data_len == 0) {
+        return virtio_blk_do_sg_request(dev, req, sector, NULL, 0, type);
+    }
+    
+    dma_sg_t seg;
+    seg.phys_addr = translate_virt_to_phys((uintptr_t)buffer);
+    seg.len = data_len;
+    if (seg.phys_addr == 0) {
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    return virtio_blk_do_sg_request(dev, req, sector, &seg, 1, type);
+}
+
 /**
  * Initialize VirtIO block device
  */
 int virtio_blk_init(uintptr_t base_addr, uint32_t irq)
 {
+    if (g_blk_count >= VIRTIO_BLK_MAX_DEVICES) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
     /* Allocate device structure */
-    g_blk_device = (virtio_blk_device_t *)kmalloc(sizeof(virtio_blk_device_t));
-    if (!g_blk_device) {
+    virtio_blk_device_t *dev = (virtio_blk_device_t *)kmalloc(sizeof(virtio_blk_device_t));
+    if (!dev) {
         RETURN_ERRNO(THUNDEROS_ENOMEM);
     }
     
-    g_blk_device->base_addr = base_addr;
-    g_blk_device->irq = irq;
-    g_blk_device->read_count = 0;
-    g_blk_device->write_count = 0;
-    g_blk_device->error_count = 0;
+    dev->base_addr = base_addr;
+    dev->irq = irq;
+    dev->read_count = 0;
+    dev->write_count = 0;
+    dev->error_count = 0;
     
     /* Check magic value */
-    uint32_t magic = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_MAGIC_VALUE);
+    uint32_t magic = VIRTIO_READ32(dev, VIRTIO_MMIO_MAGIC_VALUE);
     if (magic != VIRTIO_MAGIC) {
-        kfree(g_blk_device);
-        g_blk_device = NULL;
+        kfree(dev);
         RETURN_ERRNO(THUNDEROS_EVIRTIO_BADDEV);
     }
     
     /* Check device version and ID */
-    g_blk_device->version = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_VERSION);
-    g_blk_device->device_id = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_DEVICE_ID);
-    g_blk_device->vendor_id = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_VENDOR_ID);
+    dev->version = VIRTIO_READ32(dev, VIRTIO_MMIO_VERSION);
+    dev->device_id = VIRTIO_READ32(dev, VIRTIO_MMIO_DEVICE_ID);
+    dev->vendor_id = VIRTIO_READ32(dev, VIRTIO_MMIO_VENDOR_ID);
     
-    if (g_blk_device->device_id != VIRTIO_DEVICE_ID_BLOCK) {
-        kfree(g_blk_device);
-        g_blk_device = NULL;
+    if (dev->device_id != VIRTIO_DEVICE_ID_BLOCK) {
+        kfree(dev);
         RETURN_ERRNO(THUNDEROS_EVIRTIO_BADDEV);
     }
     
     /* Reset device */
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_STATUS, 0);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, 0);
     
     /* Device initialization sequence per VirtIO spec */
     uint32_t status = VIRTIO_STATUS_ACKNOWLEDGE;
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_STATUS, status);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, status);
     
     status |= VIRTIO_STATUS_DRIVER;
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_STATUS, status);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, status);
     
     /* Read device features */
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 0);
-    uint32_t features_low = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_DEVICE_FEATURES);
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 1);
-    uint32_t features_high = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_DEVICE_FEATURES);
-    g_blk_device->features = ((uint64_t)features_high << 32) | features_low;
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 0);
+    uint32_t features_low = VIRTIO_READ32(dev, VIRTIO_MMIO_DEVICE_FEATURES);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 1);
+    uint32_t features_high = VIRTIO_READ32(dev, VIRTIO_MMIO_DEVICE_FEATURES);
+    dev->features = ((uint64_t)features_high << 32) | features_low;
     
     /* Negotiate features (accept all for now) */
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 0);
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_DRIVER_FEATURES, features_low);
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 1);
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_DRIVER_FEATURES, features_high);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 0);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DRIVER_FEATURES, features_low);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 1);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DRIVER_FEATURES, features_high);
     
     status |= VIRTIO_STATUS_FEATURES_OK;
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_STATUS, status);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, status);
     
     /* Verify features accepted */
-    status = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_STATUS);
+    status = VIRTIO_READ32(dev, VIRTIO_MMIO_STATUS);
     if (!(status & VIRTIO_STATUS_FEATURES_OK)) {
-        kfree(g_blk_device);
-        g_blk_device = NULL;
+        kfree(dev);
         RETURN_ERRNO(THUNDEROS_EVIRTIO_BADDEV);
     }
     
     /* Read device configuration */
-    virtio_blk_config_t *config = (virtio_blk_config_t *)(g_blk_device->base_addr + VIRTIO_MMIO_CONFIG);
-    g_blk_device->capacity = config->capacity;
-    g_blk_device->block_size = (config->blk_size > 0) ? config->blk_size : VIRTIO_BLK_SECTOR_SIZE;
-    g_blk_device->read_only = (g_blk_device->features & VIRTIO_BLK_F_RO) ? 1 : 0;
+    virtio_blk_config_t *config = (virtio_blk_config_t *)(dev->base_addr + VIRTIO_MMIO_CONFIG);
+    dev->capacity = config->capacity;
+    dev->block_size = (config->blk_size > 0) ? config->blk_size : VIRTIO_BLK_SECTOR_SIZE;
+    dev->read_only = (dev->features & VIRTIO_BLK_F_RO) ? 1 : 0;
+    dev->max_discard_sectors = 0;
+    dev->max_discard_seg = 0;
+    if (dev->features & VIRTIO_BLK_F_DISCARD) {
+        dev->max_discard_sectors = config->max_discard_sectors ? config->max_discard_sectors : 0xFFFFFFFF;
+        dev->max_discard_seg = config->max_discard_seg ? config->max_discard_seg : 1;
+        if (dev->max_discard_seg > VIRTIO_BLK_MAX_DISCARD_SEG) {
+            dev->max_discard_seg = VIRTIO_BLK_MAX_DISCARD_SEG;
+        }
+    }
+    dev->max_write_zeroes_sectors = 0;
+    dev->max_write_zeroes_seg = 0;
+    if (dev->features & VIRTIO_BLK_F_WRITE_ZEROES) {
+        dev->max_write_zeroes_sectors = config->max_write_zeroes_sectors ? config->max_write_zeroes_sectors : 0xFFFFFFFF;
+        dev->max_write_zeroes_seg = config->max_write_zeroes_seg ? config->max_write_zeroes_seg : 1;
+        if (dev->max_write_zeroes_seg > VIRTIO_BLK_MAX_DISCARD_SEG) {
+            dev->max_write_zeroes_seg = VIRTIO_BLK_MAX_DISCARD_SEG;
+        }
+    }
     
     /* Get maximum queue size */
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_QUEUE_SEL, 0);
-    uint32_t queue_max = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_QUEUE_NUM_MAX);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_SEL, 0);
+    uint32_t queue_max = VIRTIO_READ32(dev, VIRTIO_MMIO_QUEUE_NUM_MAX);
     uint32_t queue_size = (queue_max < VIRTIO_BLK_QUEUE_SIZE) ? queue_max : VIRTIO_BLK_QUEUE_SIZE;
     
     /* Initialize virtqueue */
-    if (virtqueue_init(g_blk_device, queue_size) < 0) {
-        kfree(g_blk_device);
-        g_blk_device = NULL;
+    if (virtqueue_init(dev->base_addr, 0, &dev->queue, queue_size) < 0) {
+        kfree(dev);
         /* errno already set by virtqueue_init */
         return -1;
     }
     
+    /* Data segments per request: the chain also needs header and status */
+    dev->max_sg = queue_size - 2;
+    if ((dev->features & VIRTIO_BLK_F_SEG_MAX) && config->seg_max > 0 &&
+        config->seg_max < dev->max_sg) {
+        dev->max_sg = config->seg_max;
+    }
+    if (dev->max_sg > VIRTIO_BLK_MAX_SG) {
+        dev->max_sg = VIRTIO_BLK_MAX_SG;
+    }
+    
     /* Set DRIVER_OK status bit */
     status |= VIRTIO_STATUS_DRIVER_OK;
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_STATUS, status);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, status);
     
     /* Verify device accepted DRIVER_OK */
-    uint32_t final_status = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_STATUS);
+    uint32_t final_status = VIRTIO_READ32(dev, VIRTIO_MMIO_STATUS);
     if (!(final_status & VIRTIO_STATUS_DRIVER_OK)) {
-        kfree(g_blk_device);
-        g_blk_device = NULL;
+        kfree(dev);
         RETURN_ERRNO(THUNDEROS_EVIRTIO_BADDEV);
     }
     
+    /* The first device found serves the calls without a device argument */
+    g_blk_devices[g_blk_count++] = dev;
+    if (!g_blk_device) {
+        g_blk_device = dev;
+    }
+    
     clear_errno();
     return 0;
 }
 
 /**
- * Read sectors from block device
+ * Read sectors from a given block device
  */
-int virtio_blk_read(uint64_t sector, void *buffer, uint32_t count)
+int virtio_blk_read_dev(virtio_blk_device_t *dev, uint64_t sector, void *buffer, uint32_t count)
 {
-    if (!g_blk_device) {
+    if (!dev) {
         RETURN_ERRNO(THUNDEROS_EVIRTIO_NODEV);
     }
     
-    if (sector + count > g_blk_device->capacity) {
+    if (sector + count > dev->capacity) {
         RETURN_ERRNO(THUNDEROS_EINVAL);
     }
     
@@ -415,21 +301,31 @@ int virtio_blk_read(uint64_t sector, void *buffer, uint32_t count)
     }
     
     virtio_blk_request_t *req = (virtio_blk_request_t *)req_region->virt_addr;
-    int result = virtio_blk_do_request(g_blk_device, req, sector, buffer, count, VIRTIO_BLK_T_IN);
+    int result = virtio_blk_do_request(dev, req, sector, buffer,
+                                       count * VIRTIO_BLK_SECTOR_SIZE, VIRTIO_BLK_T_IN);
     
     dma_free(req_region);
     
-    if (result > 0) {
-        g_blk_device->read_count++;
+    if (result == 0) {
+        dev->read_count++;
         clear_errno();
+        return count;
     } else {
-        g_blk_device->error_count++;
+        dev->error_count++;
         /* errno already set by virtio_blk_do_request */
     }
     
     return result;
 }
 
+/**
+ * Read sectors from block device
+ */
+int virtio_blk_read(uint64_t sector, void *buffer, uint32_t count)
+{
+    return virtio_blk_read_dev(g_blk_device, sector, buffer, count);
+}
+
 /**
  * Write sectors to block device
  */
@@ -454,13 +350,15 @@ int virtio_blk_write(uint64_t sector, const void *buffer, uint32_t count)
     }
     
     virtio_blk_request_t *req = (virtio_blk_request_t *)req_region->virt_addr;
-    int result = virtio_blk_do_request(g_blk_device, req, sector, (void *)buffer, count, VIRTIO_BLK_T_OUT);
+    int result = virtio_blk_do_request(g_blk_device, req, sector, (void *)buffer,
+                                       count * VIRTIO_BLK_SECTOR_SIZE, VIRTIO_BLK_T_OUT);
     
     dma_free(req_region);
     
-    if (result > 0) {
+    if (result == 0) {
         g_blk_device->write_count++;
         clear_errno();
+        return count;
     } else {
         g_blk_device->error_count++;
         /* errno already set by virtio_blk_do_request */
@@ -469,6 +367,85 @@ int virtio_blk_write(uint64_t sector, const void *buffer, uint32_t count)
     return result;
 }
 
+/**
+ * Transfer sectors between the default device and a scatter-gather list
+ */
+static int virtio_blk_sg_request(uint64_t sector, const dma_sg_t *sg, uint32_t nr_sg,
+                                 uint32_t type)
+{
+    if (!g_blk_device) {
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_NODEV);
+    }
+    
+    if (type == VIRTIO_BLK_T_OUT && g_blk_device->read_only) {
+        RETURN_ERRNO(THUNDEROS_EFS_RDONLY);
+    }
+    
+    if (!sg || nr_sg == 0 || nr_sg > g_blk_device->max_sg) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Segments may split sectors, but the total must be whole sectors */
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < nr_sg; i++) {
+        bytes += sg[i].len;
+    }
+    uint64_t count = bytes / VIRTIO_BLK_SECTOR_SIZE;
+    if (bytes % VIRTIO_BLK_SECTOR_SIZE != 0 || count > 0x7FFFFFFF ||
+        sector + count > g_blk_device->capacity) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Allocate request structure from DMA memory */
+    dma_region_t *req_region = dma_alloc(sizeof(virtio_blk_request_t), DMA_ZERO);
+    if (!req_region) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    virtio_blk_request_t *req = (virtio_blk_request_t *)req_region->virt_addr;
+    int result = virtio_blk_do_sg_request(g_blk_device, req, sector, sg, nr_sg, type);
+    
+    dma_free(req_region);
+    
+    if (result != 0) {
+        g_blk_device->error_count++;
+        /* errno already set by virtio_blk_do_sg_request */
+        return result;
+    }
+    
+    if (type == VIRTIO_BLK_T_IN) {
+        g_blk_device->read_count++;
+    } else {
+        g_blk_device->write_count++;
+    }
+    clear_errno();
+    return (int)count;
+}
+
+/**
+ * Read sectors into a scatter-gather list
+ */
+int virtio_blk_read_sg(uint64_t sector, const dma_sg_t *sg, uint32_t nr_sg)
+{
+    return virtio_blk_sg_request(sector, sg, nr_sg, VIRTIO_BLK_T_IN);
+}
+
+/**
+ * Write sectors from a scatter-gather list
+ */
+int virtio_blk_write_sg(uint64_t sector, const dma_sg_t *sg, uint32_t nr_sg)
+{
+    return virtio_blk_sg_request(sector, sg, nr_sg, VIRTIO_BLK_T_OUT);
+}
+
+/**
+ * Get the number of data segments one request can carry
+ */
+uint32_t virtio_blk_get_max_sg(void)
+{
+    return g_blk_device ? g_blk_device->max_sg : 0;
+}
+
 /**
  * Flush device write cache
  */
@@ -483,12 +460,151 @@ int virtio_blk_flush(void)
         return 0;
     }
     
-    virtio_blk_request_t req;
-    int result = virtio_blk_do_request(g_blk_device, &req, 0, NULL, 0, VIRTIO_BLK_T_FLUSH);
+    /* Allocate request structure from DMA memory */
+    dma_region_t *req_region = dma_alloc(sizeof(virtio_blk_request_t), DMA_ZERO);
+    if (!req_region) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    virtio_blk_request_t *req = (virtio_blk_request_t *)req_region->virt_addr;
+    int result = virtio_blk_do_request(g_blk_device, req, 0, NULL, 0, VIRTIO_BLK_T_FLUSH);
+    
+    dma_free(req_region);
     /* errno already set by virtio_blk_do_request if failed */
     return result;
 }
 
+/**
+ * Send sector ranges as discard or write-zeroes requests
+ * Ranges are split at max_sectors and packed max_seg to a request.
+ */
+static int virtio_blk_range_request(uint32_t type, const virtio_blk_discard_t *ranges,
+                                    uint32_t count, uint32_t max_seg, uint32_t max_sectors)
+{
+    /* Request header and segment table both live in DMA memory */
+    dma_region_t *req_region = dma_alloc(sizeof(virtio_blk_request_t), DMA_ZERO);
+    if (!req_region) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    dma_region_t *seg_region = dma_alloc(max_seg * sizeof(virtio_blk_discard_t), DMA_ZERO);
+    if (!seg_region) {
+        dma_free(req_region);
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    virtio_blk_request_t *req = (virtio_blk_request_t *)req_region->virt_addr;
+    virtio_blk_discard_t *segs = (virtio_blk_discard_t *)seg_region->virt_addr;
+    uint32_t index = 0;
+    uint64_t sector = ranges[0].sector;
+    uint32_t remaining = ranges[0].num_sectors;
+    int result = 0;
+    
+    /* Pack as many segments per request as the device allows */
+    while (index < count && result == 0) {
+        uint32_t nr_segs = 0;
+        
+        while (index < count && nr_segs < max_seg) {
+            uint32_t len = (remaining < max_sectors) ? remaining : max_sectors;
+            
+            if (len > 0) {
+                segs[nr_segs].sector = sector;
+                segs[nr_segs].num_sectors = len;
+                segs[nr_segs].flags = ranges[index].flags;
+                nr_segs++;
+                sector += len;
+                remaining -= len;
+            }
+            
+            if (remaining == 0 && ++index < count) {
+                sector = ranges[index].sector;
+                remaining = ranges[index].num_sectors;
+            }
+        }
+        
+        if (nr_segs > 0) {
+            result = virtio_blk_do_request(g_blk_device, req, 0, segs,
+                                           nr_segs * sizeof(virtio_blk_discard_t), type);
+        }
+    }
+    
+    dma_free(seg_region);
+    dma_free(req_region);
+    
+    if (result != 0) {
+        g_blk_device->error_count++;
+        /* errno already set by virtio_blk_do_request */
+        return -1;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Discard sector ranges
+ */
+int virtio_blk_discard(const virtio_blk_discard_t *ranges, uint32_t count)
+{
+    if (!g_blk_device) {
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_NODEV);
+    }
+    
+    if (!ranges) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Discard is only a hint; devices without it simply keep the data */
+    if (!(g_blk_device->features & VIRTIO_BLK_F_DISCARD) || count == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    if (g_blk_device->read_only) {
+        RETURN_ERRNO(THUNDEROS_EFS_RDONLY);
+    }
+    
+    return virtio_blk_range_request(VIRTIO_BLK_T_DISCARD, ranges, count,
+                                    g_blk_device->max_discard_seg,
+                                    g_blk_device->max_discard_sectors);
+}
+
+/**
+ * Zero sectors without transferring data
+ */
+int virtio_blk_write_zeroes(uint64_t sector, uint32_t count)
+{
+    if (!g_blk_device) {
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_NODEV);
+    }
+    
+    /* Callers fall back to writing zero buffers */
+    if (!(g_blk_device->features & VIRTIO_BLK_F_WRITE_ZEROES)) {
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_BADREQ);
+    }
+    
+    if (g_blk_device->read_only) {
+        RETURN_ERRNO(THUNDEROS_EFS_RDONLY);
+    }
+    
+    if (sector + count > g_blk_device->capacity) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (count == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    virtio_blk_discard_t range;
+    range.sector = sector;
+    range.num_sectors = count;
+    range.flags = 0;
+    
+    return virtio_blk_range_request(VIRTIO_BLK_T_WRITE_ZEROES, &range, 1,
+                                    g_blk_device->max_write_zeroes_seg,
+                                    g_blk_device->max_write_zeroes_sectors);
+}
+
 /**
  * Get device capacity in sectors
  */
@@ -518,14 +634,12 @@ int virtio_blk_is_readonly(void)
  */
 void virtio_blk_irq_handler(void)
 {
-    if (!g_blk_device) {
-        return;
+    /* Read and acknowledge interrupts of every device */
+    for (int i = 0; i < g_blk_count; i++) {
+        uint32_t int_status = VIRTIO_READ32(g_blk_devices[i], VIRTIO_MMIO_INTERRUPT_STATUS);
+        VIRTIO_WRITE32(g_blk_devices[i], VIRTIO_MMIO_INTERRUPT_ACK, int_status);
     }
     
-    /* Read and acknowledge interrupt */
-    uint32_t int_status = VIRTIO_READ32(g_blk_device, VIRTIO_MMIO_INTERRUPT_STATUS);
-    VIRTIO_WRITE32(g_blk_device, VIRTIO_MMIO_INTERRUPT_ACK, int_status);
-    
     /* TODO: Process used buffers asynchronously */
 }
 
@@ -536,3 +650,22 @@ virtio_blk_device_t *virtio_blk_get_device(void)
 {
     return g_blk_device;
 }
+
+/**
+ * Get the number of probed block devices
+ */
+int virtio_blk_device_count(void)
+{
+    return g_blk_count;
+}
+
+/**
+ * Get a probed block device by index
+ */
+virtio_blk_device_t *virtio_blk_get_device_at(int index)
+{
+    if (index < 0 || index >= g_blk_count) {
+        return NULL;
+    }
+    return g_blk_devices[index];
+}
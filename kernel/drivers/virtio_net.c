@@ -0,0 +1,478 @@
+/*
+ * VirtIO Network Device Driver
+ *
+ * Every receive descriptor owns one buffer and is posted once at start-up,
+ * then handed back to the device as soon as its frame has been processed.
+ * Transmit descriptors also own one buffer each; a frame is copied in and
+ * queued, and the device hears about the queued frames in one notify.
+ *
+ * Received frames are processed in the net-rx process. The interrupt only
+ * wakes it and masks further receive interrupts; the process then polls
+ * the used ring until it runs dry, and unmasks them before sleeping.
+ */
+
+#include <drivers/virtio_net.h>
+#include <mm/dma.h>
+#include <mm/pmm.h>
+#include <mm/kmalloc.h>
+#include <arch/barrier.h>
+#include <arch/interrupt.h>
+#include <kernel/process.h>
+#include <kernel/errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The one network device */
+static virtio_net_device_t *g_net_device = NULL;
+
+/**
+ * Allocate the buffers of a queue, two to a DMA page
+ */
+static int virtio_net_alloc_bufs(uint32_t count, uint8_t ***bufs, uintptr_t **phys)
+{
+    *bufs = (uint8_t **)kmalloc(count * sizeof(uint8_t *));
+    *phys = (uintptr_t *)kmalloc(count * sizeof(uintptr_t));
+    if (!*bufs || !*phys) {
+        kfree(*bufs);
+        kfree(*phys);
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    uint32_t per_page = PAGE_SIZE / VIRTIO_NET_BUF_SIZE;
+    uint32_t npages = (count + per_page - 1) / per_page;
+    dma_region_t **pages = (dma_region_t **)kmalloc(npages * sizeof(dma_region_t *));
+    if (!pages) {
+        kfree(*bufs);
+        kfree(*phys);
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    for (uint32_t p = 0; p < npages; p++) {
+        pages[p] = dma_alloc(PAGE_SIZE, DMA_ZERO | DMA_ALIGN_4K);
+        if (!pages[p]) {
+            while (p > 0) {
+                dma_free(pages[--p]);
+            }
+            kfree(pages);
+            kfree(*bufs);
+            kfree(*phys);
+            RETURN_ERRNO(THUNDEROS_ENOMEM);
+        }
+    }
+    
+    /* The pages belong to the device from here on */
+    for (uint32_t i = 0; i < count; i += per_page) {
+        dma_region_t *page = pages[i / per_page];
+        for (uint32_t j = 0; j < per_page && i + j < count; j++) {
+            (*bufs)[i + j] = (uint8_t *)page->virt_addr + j * VIRTIO_NET_BUF_SIZE;
+            (*phys)[i + j] = page->phys_addr + j * VIRTIO_NET_BUF_SIZE;
+        }
+    }
+    kfree(pages);
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Post every receive buffer
+ * Descriptor i always describes buffer i, so frames are found by index.
+ */
+static void virtio_net_fill_rx(virtio_net_device_t *dev)
+{
+    virtqueue_t *vq = &dev->rx_queue;
+    
+    for (uint16_t i = 0; i < vq->queue_size; i++) {
+        vq->desc[i].addr = dev->rx_phys[i];
+        vq->desc[i].len = VIRTIO_NET_BUF_SIZE;
+        vq->desc[i].flags = VIRTQ_DESC_F_WRITE;
+        vq->desc[i].next = 0;
+        virtqueue_add_to_avail(vq, i);
+    }
+    vq->num_free = 0;
+}
+
+/**
+ * Set up one queue of the device
+ */
+static int virtio_net_setup_queue(virtio_net_device_t *dev, uint32_t queue_idx, virtqueue_t *vq)
+{
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_QUEUE_SEL, queue_idx);
+    uint32_t queue_max = VIRTIO_READ32(dev, VIRTIO_MMIO_QUEUE_NUM_MAX);
+    if (queue_max == 0) {
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_BADDEV);
+    }
+    uint32_t queue_size = (queue_max < VIRTIO_NET_QUEUE_SIZE) ? queue_max : VIRTIO_NET_QUEUE_SIZE;
+    
+    return virtqueue_init(dev->base_addr, queue_idx, vq, queue_size);
+}
+
+/**
+ * Give back the transmit buffers the device has sent
+ * Called with interrupts disabled.
+ */
+static void virtio_net_reclaim_tx(virtio_net_device_t *dev)
+{
+    uint16_t desc_idx;
+    uint32_t len;
+    
+    while (virtqueue_get_used_buf(&dev->tx_queue, &desc_idx, &len) == 0) {
+        virtqueue_free_desc_chain(&dev->tx_queue, desc_idx);
+    }
+}
+
+/**
+ * Notify the device of new buffers on a queue, unless it has said it
+ * does not need to hear about them
+ */
+static void virtio_net_kick(virtio_net_device_t *dev, virtqueue_t *vq, uint32_t queue_idx)
+{
+    memory_barrier();
+    if (!(vq->used->flags & VIRTQ_USED_F_NO_NOTIFY)) {
+        virtqueue_notify(dev->base_addr, queue_idx);
+    }
+}
+
+/**
+ * Process received frames, at most budget of them
+ * @return Number of frames taken from the ring
+ */
+static uint32_t virtio_net_rx_poll(virtio_net_device_t *dev, uint32_t budget)
+{
+    virtqueue_t *vq = &dev->rx_queue;
+    uint32_t done = 0;
+    
+    while (done < budget) {
+        uint16_t desc_idx;
+        uint32_t len;
+        if (virtqueue_get_used_buf(vq, &desc_idx, &len) != 0) {
+            break;
+        }
+        done++;
+        
+        uint8_t *buf = dev->rx_bufs[desc_idx];
+        if (len < sizeof(virtio_net_hdr_t) + 14 || len > VIRTIO_NET_BUF_SIZE) {
+            dev->rx_dropped++;
+        } else {
+            virtio_net_hdr_t *hdr = (virtio_net_hdr_t *)buf;
+            int csum_ok = (hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID) ? 1 : 0;
+            dev->rx_packets++;
+            dev->rx_handler(buf + sizeof(virtio_net_hdr_t),
+                            len - sizeof(virtio_net_hdr_t), csum_ok);
+        }
+        
+        /* The descriptor still describes its buffer; post it again */
+        virtqueue_add_to_avail(vq, desc_idx);
+    }
+    
+    if (done > 0) {
+        virtio_net_kick(dev, vq, VIRTIO_NET_RX_QUEUE);
+    }
+    return done;
+}
+
+/**
+ * net-rx process
+ * Polls while a full budget of frames keeps arriving, yielding between
+ * passes, and sleeps with the receive interrupt unmasked once the ring
+ * is empty.
+ */
+static void virtio_net_rx_worker(void *arg)
+{
+    virtio_net_device_t *dev = (virtio_net_device_t *)arg;
+    virtqueue_t *vq = &dev->rx_queue;
+    
+    while (1) {
+        uint32_t done = virtio_net_rx_poll(dev, VIRTIO_NET_NAPI_BUDGET);
+        
+        /* Replies produced by this pass go out in one notify */
+        virtio_net_flush();
+        
+        if (done == VIRTIO_NET_NAPI_BUDGET) {
+            process_yield();
+            continue;
+        }
+        
+        /* Unmask, then look again: a frame may have come in between */
+        int irq_state = interrupt_save_disable();
+        vq->avail->flags = 0;
+        memory_barrier();
+        if (!virtqueue_has_used(vq)) {
+            wait_queue_sleep(&dev->rx_wait);
+        }
+        interrupt_restore(irq_state);
+    }
+}
+
+/**
+ * Initialize VirtIO network device
+ */
+int virtio_net_init(uintptr_t base_addr, uint32_t irq)
+{
+    if (g_net_device) {
+        RETURN_ERRNO(THUNDEROS_EBUSY);
+    }
+    
+    /* Check magic value and device ID before allocating anything */
+    if (*((volatile uint32_t *)(base_addr + VIRTIO_MMIO_MAGIC_VALUE)) != VIRTIO_MAGIC ||
+        *((volatile uint32_t *)(base_addr + VIRTIO_MMIO_DEVICE_ID)) != VIRTIO_DEVICE_ID_NET) {
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_BADDEV);
+    }
+
+    virtio_net_device_t *dev = (virtio_net_device_t *)kmalloc(sizeof(virtio_net_device_t));
+    if (!dev) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+
+    dev->base_addr = base_addr;
+    dev->irq = irq;
+    dev->tx_pending = 0;
+    dev->rx_handler = NULL;
+    dev->rx_worker = NULL;
+    dev->rx_packets = 0;
+    dev->tx_packets = 0;
+    dev->rx_dropped = 0;
+    dev->tx_dropped = 0;
+    dev->rx_interrupts = 0;
+    dev->tx_notifies = 0;
+    wait_queue_init(&dev->rx_wait);
+
+    /* Reset device */
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, 0);
+
+    /* Device initialization sequence per VirtIO spec */
+    uint32_t status = VIRTIO_STATUS_ACKNOWLEDGE;
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, status);
+
+    status |= VIRTIO_STATUS_DRIVER;
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, status);
+
+    /* Read device features */
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 0);
+    uint32_t features_low = VIRTIO_READ32(dev, VIRTIO_MMIO_DEVICE_FEATURES);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 1);
+    uint32_t features_high = VIRTIO_READ32(dev, VIRTIO_MMIO_DEVICE_FEATURES);
+    uint64_t offered = ((uint64_t)features_high << 32) | features_low;
+
+    /* Take checksum offload when offered; no segmentation offload or merged buffers */
+    uint64_t wanted = VIRTIO_F_VERSION_1 | VIRTIO_NET_F_MAC | VIRTIO_NET_F_STATUS |
+                      VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM;
+    dev->features = offered & wanted;
+    if (!(dev->features & VIRTIO_F_VERSION_1)) {
+        VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, VIRTIO_STATUS_FAILED);
+        kfree(dev);
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_BADDEV);
+    }
+
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 0);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DRIVER_FEATURES, (uint32_t)dev->features);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 1);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_DRIVER_FEATURES, (uint32_t)(dev->features >> 32));
+
+    status |= VIRTIO_STATUS_FEATURES_OK;
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, status);
+
+    /* Verify features accepted */
+    status = VIRTIO_READ32(dev, VIRTIO_MMIO_STATUS);
+    if (!(status & VIRTIO_STATUS_FEATURES_OK)) {
+        kfree(dev);
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_BADDEV);
+    }
+
+    /* Read device configuration */
+    volatile virtio_net_config_t *config = (volatile virtio_net_config_t *)(dev->base_addr + VIRTIO_MMIO_CONFIG);
+    for (int i = 0; i < 6; i++) {
+        dev->mac[i] = (dev->features & VIRTIO_NET_F_MAC) ? config->mac[i] : 0;
+    }
+    if (!(dev->features & VIRTIO_NET_F_MAC)) {
+        /* Locally administered address */
+        dev->mac[0] = 0x02;
+        dev->mac[5] = 0x01;
+    }
+
+    /* Initialize virtqueues and their buffers */
+    if (virtio_net_setup_queue(dev, VIRTIO_NET_RX_QUEUE, &dev->rx_queue) < 0 ||
+        virtio_net_setup_queue(dev, VIRTIO_NET_TX_QUEUE, &dev->tx_queue) < 0 ||
+        virtio_net_alloc_bufs(dev->rx_queue.queue_size, &dev->rx_bufs, &dev->rx_phys) < 0 ||
+        virtio_net_alloc_bufs(dev->tx_queue.queue_size, &dev->tx_bufs, &dev->tx_phys) < 0) {
+        VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, VIRTIO_STATUS_FAILED);
+        kfree(dev);
+        /* errno already set by virtio_net_setup_queue or virtio_net_alloc_bufs */
+        return -1;
+    }
+
+    /* Sent frames are reclaimed when more are queued, so no TX interrupts */
+    dev->tx_queue.avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+
+    /* Receive interrupts stay masked until the net-rx process runs */
+    dev->rx_queue.avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+    virtio_net_fill_rx(dev);
+
+    /* Set DRIVER_OK status bit */
+    status |= VIRTIO_STATUS_DRIVER_OK;
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_STATUS, status);
+
+    /* Verify device accepted DRIVER_OK */
+    uint32_t final_status = VIRTIO_READ32(dev, VIRTIO_MMIO_STATUS);
+    if (!(final_status & VIRTIO_STATUS_DRIVER_OK)) {
+        kfree(dev);
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_BADDEV);
+    }
+
+    virtio_net_kick(dev, &dev->rx_queue, VIRTIO_NET_RX_QUEUE);
+
+    g_net_device = dev;
+
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Start delivering received frames
+ */
+int virtio_net_start(virtio_net_rx_t handler)
+{
+    virtio_net_device_t *dev = g_net_device;
+    if (!dev) {
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_NODEV);
+    }
+    if (dev->rx_worker) {
+        RETURN_ERRNO(THUNDEROS_EBUSY);
+    }
+
+    dev->rx_handler = handler;
+    dev->rx_worker = process_create("net-rx", virtio_net_rx_worker, dev);
+    if (!dev->rx_worker) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+
+    if (interrupt_register_handler(dev->irq, virtio_net_irq_handler)) {
+        interrupt_set_priority(dev->irq, IRQ_PRIORITY_NORMAL);
+        interrupt_enable_irq(dev->irq);
+    }
+
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Queue a frame for transmission
+ */
+int virtio_net_xmit(const void *frame, uint32_t len, uint16_t csum_start,
+                    uint16_t csum_offset)
+{
+    virtio_net_device_t *dev = g_net_device;
+    if (!dev) {
+        RETURN_ERRNO(THUNDEROS_ENETDOWN);
+    }
+    if (len == 0 || len > VIRTIO_NET_MAX_FRAME) {
+        RETURN_ERRNO(THUNDEROS_EMSGSIZE);
+    }
+
+    virtqueue_t *vq = &dev->tx_queue;
+    int irq_state = interrupt_save_disable();
+
+    virtio_net_reclaim_tx(dev);
+
+    uint16_t desc_idx;
+    if (virtqueue_alloc_desc_chain(vq, &desc_idx, 1) < 0) {
+        /* Ring full: make sure the device is working through it */
+        if (dev->tx_pending > 0) {
+            dev->tx_pending = 0;
+            dev->tx_notifies++;
+            virtio_net_kick(dev, vq, VIRTIO_NET_TX_QUEUE);
+        }
+        dev->tx_dropped++;
+        interrupt_restore(irq_state);
+        RETURN_ERRNO(THUNDEROS_EAGAIN);
+    }
+
+    uint8_t *buf = dev->tx_bufs[desc_idx];
+    virtio_net_hdr_t *hdr = (virtio_net_hdr_t *)buf;
+    hdr->flags = 0;
+    hdr->gso_type = VIRTIO_NET_HDR_GSO_NONE;
+    hdr->hdr_len = 0;
+    hdr->gso_size = 0;
+    hdr->csum_start = 0;
+    hdr->csum_offset = 0;
+    hdr->num_buffers = 0;
+    if (csum_start && (dev->features & VIRTIO_NET_F_CSUM)) {
+        hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr->csum_start = csum_start;
+        hdr->csum_offset = csum_offset;
+    }
+
+    const uint8_t *src = (const uint8_t *)frame;
+    uint8_t *dst = buf + sizeof(virtio_net_hdr_t);
+    for (uint32_t i = 0; i < len; i++) {
+        dst[i] = src[i];
+    }
+
+    vq->desc[desc_idx].addr = dev->tx_phys[desc_idx];
+    vq->desc[desc_idx].len = sizeof(virtio_net_hdr_t) + len;
+    vq->desc[desc_idx].flags = 0;
+    virtqueue_add_to_avail(vq, desc_idx);
+
+    dev->tx_pending++;
+    dev->tx_packets++;
+    interrupt_restore(irq_state);
+
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Notify the device of the queued frames
+ */
+void virtio_net_flush(void)
+{
+    virtio_net_device_t *dev = g_net_device;
+    if (!dev) {
+        return;
+    }
+
+    int irq_state = interrupt_save_disable();
+    if (dev->tx_pending > 0) {
+        dev->tx_pending = 0;
+        dev->tx_notifies++;
+        virtio_net_kick(dev, &dev->tx_queue, VIRTIO_NET_TX_QUEUE);
+    }
+    interrupt_restore(irq_state);
+}
+
+/**
+ * Check whether the device computes transmit checksums
+ */
+int virtio_net_tx_csum(void)
+{
+    return (g_net_device && (g_net_device->features & VIRTIO_NET_F_CSUM)) ? 1 : 0;
+}
+
+/**
+ * VirtIO network device interrupt handler
+ */
+void virtio_net_irq_handler(void)
+{
+    virtio_net_device_t *dev = g_net_device;
+    if (!dev) {
+        return;
+    }
+
+    uint32_t int_status = VIRTIO_READ32(dev, VIRTIO_MMIO_INTERRUPT_STATUS);
+    VIRTIO_WRITE32(dev, VIRTIO_MMIO_INTERRUPT_ACK, int_status);
+
+    if (int_status & 1) {
+        /* The net-rx process polls from here until the ring is empty */
+        dev->rx_queue.avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+        dev->rx_interrupts++;
+        wait_queue_wake_all(&dev->rx_wait);
+    }
+}
+
+/**
+ * Get the VirtIO network device
+ */
+virtio_net_device_t *virtio_net_get_device(void)
+{
+    return g_net_device;
+}
@@ -0,0 +1,181 @@
+/*
+ * eventfd.c - Event counters
+ *
+ * A read waits while the counter is 0 and a write waits while adding
+ * would take it past EVENTFD_MAX. The counter is only touched with
+ * interrupts disabled, which is also how sleepers avoid missing a wakeup.
+ */
+
+#include "../../include/fs/eventfd.h"
+#include "../../include/fs/vfs.h"
+#include "../../include/mm/kmalloc.h"
+#include "../../include/kernel/kstring.h"
+#include "../../include/kernel/wait.h"
+#include "../../include/kernel/poll.h"
+#include "../../include/kernel/errno.h"
+#include "../../include/arch/interrupt.h"
+#include <stddef.h>
+
+/**
+ * Counter behind an eventfd
+ */
+typedef struct {
+    uint64_t count;                    /* Current value */
+    uint32_t semaphore;                /* EFD_SEMAPHORE given */
+    wait_queue_t read_wait;            /* Readers waiting for a count */
+    wait_queue_t write_wait;           /* Writers waiting for room */
+    vfs_node_t node;                   /* Node the descriptors refer to */
+} eventfd_t;
+
+/**
+ * Bytes in a buffer list
+ */
+static size_t eventfd_iov_len(const vfs_iovec_t *iov, int iovcnt) {
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+/**
+ * VFS read operation: take the count, or 1 of it
+ */
+static int eventfd_readv(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov,
+                         int iovcnt) {
+    (void)offset;
+    eventfd_t *efd = (eventfd_t *)node->fs_data;
+    if (eventfd_iov_len(iov, iovcnt) < sizeof(uint64_t)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    int irq_state = interrupt_save_disable();
+    while (efd->count == 0) {
+        if (node->flags & O_NONBLOCK) {
+            interrupt_restore(irq_state);
+            RETURN_ERRNO(THUNDEROS_EAGAIN);
+        }
+        wait_queue_sleep(&efd->read_wait);
+    }
+    uint64_t value = efd->semaphore ? 1 : efd->count;
+    efd->count -= value;
+    interrupt_restore(irq_state);
+    
+    wait_queue_wake_all(&efd->write_wait);
+    
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, iov, iovcnt);
+    vfs_iov_copy_to(&iter, &value, sizeof(value));
+    clear_errno();
+    return sizeof(value);
+}
+
+/**
+ * VFS write operation: add to the count
+ */
+static int eventfd_writev(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov,
+                          int iovcnt) {
+    (void)offset;
+    eventfd_t *efd = (eventfd_t *)node->fs_data;
+    if (eventfd_iov_len(iov, iovcnt) < sizeof(uint64_t)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    uint64_t value;
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, iov, iovcnt);
+    vfs_iov_copy_from(&iter, &value, sizeof(value));
+    if (value > EVENTFD_MAX) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    int irq_state = interrupt_save_disable();
+    while (EVENTFD_MAX - efd->count < value) {
+        if (node->flags & O_NONBLOCK) {
+            interrupt_restore(irq_state);
+            RETURN_ERRNO(THUNDEROS_EAGAIN);
+        }
+        wait_queue_sleep(&efd->write_wait);
+    }
+    efd->count += value;
+    interrupt_restore(irq_state);
+    
+    if (value > 0) {
+        wait_queue_wake_all(&efd->read_wait);
+    }
+    clear_errno();
+    return sizeof(value);
+}
+
+/**
+ * VFS poll operation
+ */
+static uint32_t eventfd_poll(vfs_node_t *node, struct poll_table *pt) {
+    eventfd_t *efd = (eventfd_t *)node->fs_data;
+    poll_wait(pt, &efd->read_wait);
+    poll_wait(pt, &efd->write_wait);
+    
+    int irq_state = interrupt_save_disable();
+    uint64_t count = efd->count;
+    interrupt_restore(irq_state);
+    
+    uint32_t events = 0;
+    if (count > 0) {
+        events |= POLLIN;
+    }
+    if (count < EVENTFD_MAX) {
+        events |= POLLOUT;
+    }
+    return events;
+}
+
+/**
+ * VFS close operation, called with the last descriptor
+ */
+static void eventfd_close(vfs_node_t *node) {
+    kfree(node->fs_data);
+}
+
+static vfs_ops_t eventfd_ops = {
+    .readv = eventfd_readv,
+    .writev = eventfd_writev,
+    .close = eventfd_close,
+    .poll = eventfd_poll,
+};
+
+/**
+ * Create an eventfd
+ */
+int eventfd_open(uint64_t initval, uint32_t flags) {
+    if (flags & ~(EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (initval > EVENTFD_MAX) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    eventfd_t *efd = (eventfd_t *)kmalloc(sizeof(eventfd_t));
+    if (!efd) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    kmemset(efd, 0, sizeof(eventfd_t));
+    efd->count = initval;
+    efd->semaphore = flags & EFD_SEMAPHORE;
+    wait_queue_init(&efd->read_wait);
+    wait_queue_init(&efd->write_wait);
+    
+    kstrcpy(efd->node.name, "eventfd");
+    efd->node.type = VFS_TYPE_EVENTFD;
+    efd->node.flags = flags & O_NONBLOCK;
+    efd->node.fs = NULL;
+    efd->node.fs_data = efd;
+    efd->node.ops = &eventfd_ops;
+    
+    int fd = vfs_open_node(&efd->node, O_RDWR | (flags & (O_NONBLOCK | O_CLOEXEC)));
+    if (fd < 0) {
+        kfree(efd);
+        /* errno already set by vfs_open_node */
+        return -1;
+    }
+    return fd;
+}
@@ -3,131 +3,230 @@
  */
 
 #include "../include/fs/ext2.h"
-#include "../include/drivers/virtio_blk.h"
 #include "../include/mm/kmalloc.h"
 #include "../include/hal/hal_uart.h"
 #include "../include/kernel/errno.h"
 #include <stddef.h>
 
 /**
- * Read a block from the block device
+ * Number of blocks covered by a group's block bitmap
+ * The last group may be shorter than s_blocks_per_group.
  */
-static int read_block(void *device, uint32_t block_num, void *buffer, uint32_t block_size) {
-    (void)device;
-    
-    uint32_t sector = (block_num * block_size) / 512;
-    uint32_t num_sectors = block_size / 512;
-    
-    for (uint32_t i = 0; i < num_sectors; i++) {
-        int ret = virtio_blk_read(sector + i, (uint8_t *)buffer + (i * 512), 1);
-        if (ret != 1) {
-            set_errno(THUNDEROS_EIO);
-            return -1;
-        }
-    }
+static uint32_t group_block_count(ext2_fs_t *fs, uint32_t group) {
+    uint32_t blocks_per_group = fs->superblock->s_blocks_per_group;
+    uint32_t group_start = fs->superblock->s_first_data_block + group * blocks_per_group;
+    uint32_t remaining = fs->superblock->s_blocks_count - group_start;
     
-    clear_errno();
-    return 0;
+    return remaining < blocks_per_group ? remaining : blocks_per_group;
 }
 
 /**
- * Write a block to the block device
+ * Find a run of free bits in a block bitmap
+ * 
+ * Scans bits [start, end) and returns the first run of at least `want`
+ * free bits. If no run is that long, the longest run seen is returned.
+ * 
+ * @param bitmap Block bitmap
+ * @param start First bit to examine
+ * @param end One past the last bit to examine
+ * @param want Desired run length
+ * @param run_len Output: length of the returned run (0 if none)
+ * @return Bit index of the run start
  */
-static int write_block(void *device, uint32_t block_num, const void *buffer, uint32_t block_size) {
-    (void)device;
-    
-    uint32_t sector = (block_num * block_size) / 512;
-    uint32_t num_sectors = block_size / 512;
-    
-    for (uint32_t i = 0; i < num_sectors; i++) {
-        int ret = virtio_blk_write(sector + i, (const uint8_t *)buffer + (i * 512), 1);
-        if (ret != 1) {
-            set_errno(THUNDEROS_EIO);
-            return -1;
+static uint32_t find_free_run(const uint8_t *bitmap, uint32_t start, uint32_t end,
+                              uint32_t want, uint32_t *run_len) {
+    uint32_t best_start = 0;
+    uint32_t best_len = 0;
+    uint32_t i = start;
+    
+    while (i < end) {
+        /* Skip fully used bytes quickly */
+        if ((i % 8) == 0 && bitmap[i / 8] == 0xFF) {
+            i += 8;
+            continue;
+        }
+        
+        if (bitmap[i / 8] & (1 << (i % 8))) {
+            i++;
+            continue;
+        }
+        
+        /* Measure this free run */
+        uint32_t run_start = i;
+        while (i < end && !(bitmap[i / 8] & (1 << (i % 8))) && i - run_start < want) {
+            i++;
+        }
+        
+        uint32_t len = i - run_start;
+        if (len > best_len) {
+            best_start = run_start;
+            best_len = len;
+        }
+        if (best_len >= want) {
+            break;
         }
     }
     
-    clear_errno();
-    return 0;
+    *run_len = best_len;
+    return best_start;
 }
 
 /**
- * Allocate a block from block bitmap
- * Returns block number, or 0 on failure
+ * Allocate a contiguous run of blocks
+ * 
+ * Searches the goal block's group first, starting at the goal, for a free
+ * run of `count` blocks. If that group cannot satisfy the whole run, the
+ * other groups are tried; failing that, the longest run found is used.
+ * The bitmap of the chosen group is read and written once per call.
+ * 
+ * @param fs ext2 filesystem
+ * @param goal Preferred first block (0 for no preference)
+ * @param count Number of blocks wanted
+ * @param allocated Output: number of blocks actually allocated (1..count)
+ * @return First block of the run, or 0 on failure
  */
-uint32_t ext2_alloc_block(ext2_fs_t *fs, uint32_t group) {
-    if (!fs || group >= fs->num_groups) {
+uint32_t ext2_alloc_blocks(ext2_fs_t *fs, uint32_t goal, uint32_t count, uint32_t *allocated) {
+    if (!fs || count == 0 || !allocated) {
         set_errno(THUNDEROS_EINVAL);
         return 0;
     }
     
-    ext2_group_desc_t *gd = &fs->group_desc[group];
+    *allocated = 0;
     
-    /* Check if group has free blocks */
-    if (gd->bg_free_blocks_count == 0) {
-        set_errno(THUNDEROS_EFS_NOBLK);
-        return 0;
+    uint32_t blocks_per_group = fs->superblock->s_blocks_per_group;
+    uint32_t first_data_block = fs->superblock->s_first_data_block;
+    
+    if (goal < first_data_block || goal >= fs->superblock->s_blocks_count) {
+        goal = first_data_block;
     }
     
-    /* Read block bitmap */
+    uint32_t goal_group = (goal - first_data_block) / blocks_per_group;
+    uint32_t goal_offset = (goal - first_data_block) % blocks_per_group;
+    
     uint8_t *bitmap = (uint8_t *)kmalloc(fs->block_size);
     if (!bitmap) {
         set_errno(THUNDEROS_ENOMEM);
         return 0;
     }
     
-    if (read_block(fs->device, gd->bg_block_bitmap, bitmap, fs->block_size) != 0) {
-        kfree(bitmap);
-        /* errno already set by read_block */
-        return 0;
-    }
+    /* Best partial run seen so far, used if no group has a full run */
+    uint32_t best_group = 0;
+    uint32_t best_start = 0;
+    uint32_t best_len = 0;
+    uint32_t loaded_group = fs->num_groups;
+    int loaded_masked = 0;
     
-    /* Find first free block */
-    uint32_t blocks_per_group = fs->superblock->s_blocks_per_group;
-    for (uint32_t i = 0; i < blocks_per_group; i++) {
-        uint32_t byte = i / 8;
-        uint32_t bit = i % 8;
+    for (uint32_t n = 0; n < fs->num_groups; n++) {
+        uint32_t group = (goal_group + n) % fs->num_groups;
+        ext2_group_desc_t *gd = &fs->group_desc[group];
         
-        if (!(bitmap[byte] & (1 << bit))) {
-            /* Found free block */
-            bitmap[byte] |= (1 << bit);
-            
-            /* Write bitmap back */
-            if (write_block(fs->device, gd->bg_block_bitmap, bitmap, fs->block_size) != 0) {
-                kfree(bitmap);
-                /* errno already set by write_block */
-                return 0;
-            }
-            
-            /* Update group descriptor */
-            gd->bg_free_blocks_count--;
-            
-            /* Update superblock */
-            fs->superblock->s_free_blocks_count--;
-            
+        if (gd->bg_free_blocks_count == 0) {
+            continue;
+        }
+        
+        if (ext2_meta_read(fs, gd->bg_block_bitmap, bitmap) != 0) {
             kfree(bitmap);
-            clear_errno();
-            return group * blocks_per_group + i;
+            /* errno already set by ext2_meta_read */
+            return 0;
+        }
+        loaded_group = group;
+        
+        /* Blocks freed by the uncommitted transaction are not reused yet */
+        loaded_masked = ext2_journal_mask_freed(fs, gd->bg_block_bitmap, bitmap);
+        
+        uint32_t nbits = group_block_count(fs, group);
+        uint32_t start = (n == 0 && goal_offset < nbits) ? goal_offset : 0;
+        uint32_t len;
+        
+        /* Search from the goal to the end, then wrap to the beginning */
+        uint32_t run = find_free_run(bitmap, start, nbits, count, &len);
+        if (len < count && start > 0) {
+            uint32_t wrap_len;
+            uint32_t wrap_run = find_free_run(bitmap, 0, start, count, &wrap_len);
+            if (wrap_len > len) {
+                run = wrap_run;
+                len = wrap_len;
+            }
         }
+        
+        if (len > best_len) {
+            best_group = group;
+            best_start = run;
+            best_len = len;
+        }
+        
+        if (best_len >= count) {
+            break;
+        }
+    }
+    
+    if (best_len == 0) {
+        kfree(bitmap);
+        set_errno(THUNDEROS_EFS_NOBLK);
+        return 0;
+    }
+    
+    /* Reload the chosen group's bitmap if a later group was scanned */
+    ext2_group_desc_t *gd = &fs->group_desc[best_group];
+    if ((loaded_group != best_group || loaded_masked) &&
+        ext2_meta_read(fs, gd->bg_block_bitmap, bitmap) != 0) {
+        kfree(bitmap);
+        /* errno already set by ext2_meta_read */
+        return 0;
+    }
+    
+    uint32_t len = best_len < count ? best_len : count;
+    for (uint32_t i = best_start; i < best_start + len; i++) {
+        bitmap[i / 8] |= (1 << (i % 8));
+    }
+    
+    /* Write bitmap back once for the whole run */
+    if (ext2_meta_write(fs, gd->bg_block_bitmap, bitmap) != 0) {
+        kfree(bitmap);
+        /* errno already set by ext2_meta_write */
+        return 0;
     }
     
+    /* Update group descriptor and superblock */
+    gd->bg_free_blocks_count -= len;
+    fs->superblock->s_free_blocks_count -= len;
+    fs->super_dirty = 1;
+    
     kfree(bitmap);
-    set_errno(THUNDEROS_EFS_NOBLK);
-    return 0;
+    *allocated = len;
+    clear_errno();
+    return first_data_block + best_group * blocks_per_group + best_start;
+}
+
+/**
+ * Allocate a block from block bitmap
+ * Returns block number, or 0 on failure
+ */
+uint32_t ext2_alloc_block(ext2_fs_t *fs, uint32_t group) {
+    if (!fs || group >= fs->num_groups) {
+        set_errno(THUNDEROS_EINVAL);
+        return 0;
+    }
+    
+    uint32_t goal = fs->superblock->s_first_data_block +
+                    group * fs->superblock->s_blocks_per_group;
+    uint32_t allocated;
+    
+    return ext2_alloc_blocks(fs, goal, 1, &allocated);
 }
 
 /**
  * Free a block to block bitmap
  */
 int ext2_free_block(ext2_fs_t *fs, uint32_t block_num) {
-    if (!fs || block_num == 0) {
+    if (!fs || block_num < fs->superblock->s_first_data_block) {
         RETURN_ERRNO(THUNDEROS_EINVAL);
     }
     
     /* Determine which group contains this block */
     uint32_t blocks_per_group = fs->superblock->s_blocks_per_group;
-    uint32_t group = block_num / blocks_per_group;
-    uint32_t offset = block_num % blocks_per_group;
+    uint32_t group = (block_num - fs->superblock->s_first_data_block) / blocks_per_group;
+    uint32_t offset = (block_num - fs->superblock->s_first_data_block) % blocks_per_group;
     
     if (group >= fs->num_groups) {
         RETURN_ERRNO(THUNDEROS_EINVAL);
@@ -141,21 +240,23 @@ int ext2_free_block(ext2_fs_t *fs, uint32_t block_num) {
         RETURN_ERRNO(THUNDEROS_ENOMEM);
     }
     
-    if (read_block(fs->device, gd->bg_block_bitmap, bitmap, fs->block_size) != 0) {
+    if (ext2_meta_read(fs, gd->bg_block_bitmap, bitmap) != 0) {
         kfree(bitmap);
-        /* errno already set by read_block */
+        /* errno already set by ext2_meta_read */
         return -1;
     }
     
     /* Clear the bit */
     uint32_t byte = offset / 8;
     uint32_t bit = offset % 8;
+    ext2_journal_freeing(fs, gd->bg_block_bitmap, bitmap);
     bitmap[byte] &= ~(1 << bit);
+    ext2_journal_forget(fs, block_num);
     
     /* Write bitmap back */
-    if (write_block(fs->device, gd->bg_block_bitmap, bitmap, fs->block_size) != 0) {
+    if (ext2_meta_write(fs, gd->bg_block_bitmap, bitmap) != 0) {
         kfree(bitmap);
-        /* errno already set by write_block */
+        /* errno already set by ext2_meta_write */
         return -1;
     }
     
@@ -164,12 +265,164 @@ int ext2_free_block(ext2_fs_t *fs, uint32_t block_num) {
     
     /* Update superblock */
     fs->superblock->s_free_blocks_count++;
+    fs->super_dirty = 1;
     
     kfree(bitmap);
     clear_errno();
     return 0;
 }
 
+/**
+ * Pick a group for a top-level directory
+ * Among groups with at least the average number of free inodes and free
+ * blocks, takes the one holding the fewest directories. The search starts
+ * at a rotating group so equal candidates are spread out.
+ */
+static uint32_t find_group_top_dir(ext2_fs_t *fs) {
+    uint32_t avg_free_inodes = fs->superblock->s_free_inodes_count / fs->num_groups;
+    uint32_t avg_free_blocks = fs->superblock->s_free_blocks_count / fs->num_groups;
+    uint32_t start = fs->orlov_rotor++ % fs->num_groups;
+    uint32_t best = fs->num_groups;
+    
+    for (uint32_t n = 0; n < fs->num_groups; n++) {
+        uint32_t group = (start + n) % fs->num_groups;
+        ext2_group_desc_t *gd = &fs->group_desc[group];
+        
+        if (gd->bg_free_inodes_count == 0 ||
+            gd->bg_free_inodes_count < avg_free_inodes ||
+            gd->bg_free_blocks_count < avg_free_blocks) {
+            continue;
+        }
+        
+        if (best == fs->num_groups ||
+            gd->bg_used_dirs_count < fs->group_desc[best].bg_used_dirs_count ||
+            (gd->bg_used_dirs_count == fs->group_desc[best].bg_used_dirs_count &&
+             gd->bg_free_blocks_count > fs->group_desc[best].bg_free_blocks_count)) {
+            best = group;
+        }
+    }
+    
+    return best;
+}
+
+/**
+ * Pick a group for a nested directory
+ * Stays near the parent as long as that group is not crowded with
+ * directories and still has a reasonable share of free inodes and blocks.
+ */
+static uint32_t find_group_nested_dir(ext2_fs_t *fs, uint32_t parent_group) {
+    uint32_t inodes_per_group = fs->superblock->s_inodes_per_group;
+    uint32_t blocks_per_group = fs->superblock->s_blocks_per_group;
+    uint32_t avg_free_inodes = fs->superblock->s_free_inodes_count / fs->num_groups;
+    uint32_t avg_free_blocks = fs->superblock->s_free_blocks_count / fs->num_groups;
+    
+    uint32_t total_dirs = 0;
+    for (uint32_t group = 0; group < fs->num_groups; group++) {
+        total_dirs += fs->group_desc[group].bg_used_dirs_count;
+    }
+    
+    uint32_t max_dirs = total_dirs / fs->num_groups + inodes_per_group / 16;
+    uint32_t min_inodes = avg_free_inodes > inodes_per_group / 4 ?
+                          avg_free_inodes - inodes_per_group / 4 : 1;
+    uint32_t min_blocks = avg_free_blocks > blocks_per_group / 4 ?
+                          avg_free_blocks - blocks_per_group / 4 : 1;
+    
+    for (uint32_t n = 0; n < fs->num_groups; n++) {
+        uint32_t group = (parent_group + n) % fs->num_groups;
+        ext2_group_desc_t *gd = &fs->group_desc[group];
+        
+        if (gd->bg_used_dirs_count <= max_dirs &&
+            gd->bg_free_inodes_count >= min_inodes &&
+            gd->bg_free_blocks_count >= min_blocks) {
+            return group;
+        }
+    }
+    
+    return fs->num_groups;
+}
+
+/**
+ * Pick a group for a regular file
+ * Prefers the parent's group, then probes groups at quadratically growing
+ * distances so files of one directory do not all pile into the next group.
+ */
+static uint32_t find_group_file(ext2_fs_t *fs, uint32_t parent_group) {
+    ext2_group_desc_t *gd = &fs->group_desc[parent_group];
+    
+    if (gd->bg_free_inodes_count > 0 && gd->bg_free_blocks_count > 0) {
+        return parent_group;
+    }
+    
+    uint32_t group = parent_group;
+    for (uint32_t step = 1; step < fs->num_groups; step <<= 1) {
+        group = (group + step) % fs->num_groups;
+        gd = &fs->group_desc[group];
+        if (gd->bg_free_inodes_count > 0 && gd->bg_free_blocks_count > 0) {
+            return group;
+        }
+    }
+    
+    return fs->num_groups;
+}
+
+/**
+ * Choose the block group for a new inode
+ * 
+ * Orlov-style placement: top-level directories are spread over groups with
+ * above-average free space, nested directories and files stay close to
+ * their parent so that a directory tree remains physically clustered.
+ * Falls back to any group with a free inode.
+ * 
+ * @param fs ext2 filesystem
+ * @param parent_inode_num Inode number of the parent directory
+ * @param is_dir Nonzero if the new inode is a directory
+ * @return Group number (always valid if any inode is free)
+ */
+uint32_t ext2_find_inode_group(ext2_fs_t *fs, uint32_t parent_inode_num, int is_dir) {
+    uint32_t parent_group = (parent_inode_num - 1) / fs->superblock->s_inodes_per_group;
+    uint32_t group;
+    
+    if (parent_group >= fs->num_groups) {
+        parent_group = 0;
+    }
+    
+    if (is_dir && parent_inode_num == EXT2_ROOT_INO) {
+        group = find_group_top_dir(fs);
+    } else if (is_dir) {
+        group = find_group_nested_dir(fs, parent_group);
+    } else {
+        group = find_group_file(fs, parent_group);
+    }
+    
+    if (group < fs->num_groups) {
+        return group;
+    }
+    
+    /* Fallback: first group with any free inode */
+    for (uint32_t n = 0; n < fs->num_groups; n++) {
+        group = (parent_group + n) % fs->num_groups;
+        if (fs->group_desc[group].bg_free_inodes_count > 0) {
+            return group;
+        }
+    }
+    
+    return parent_group;
+}
+
+/**
+ * First block of the group that holds an inode
+ * Used as allocation goal so a file's data starts next to its inode.
+ */
+uint32_t ext2_inode_block_goal(ext2_fs_t *fs, uint32_t inode_num) {
+    uint32_t group = (inode_num - 1) / fs->superblock->s_inodes_per_group;
+    
+    if (inode_num == 0 || group >= fs->num_groups) {
+        return 0;
+    }
+    
+    return fs->superblock->s_first_data_block + group * fs->superblock->s_blocks_per_group;
+}
+
 /**
  * Allocate an inode from inode bitmap
  * Returns inode number, or 0 on failure
@@ -195,9 +448,9 @@ uint32_t ext2_alloc_inode(ext2_fs_t *fs, uint32_t group) {
         return 0;
     }
     
-    if (read_block(fs->device, gd->bg_inode_bitmap, bitmap, fs->block_size) != 0) {
+    if (ext2_meta_read(fs, gd->bg_inode_bitmap, bitmap) != 0) {
         kfree(bitmap);
-        /* errno already set by read_block */
+        /* errno already set by ext2_meta_read */
         return 0;
     }
     
@@ -212,9 +465,9 @@ uint32_t ext2_alloc_inode(ext2_fs_t *fs, uint32_t group) {
             bitmap[byte] |= (1 << bit);
             
             /* Write bitmap back */
-            if (write_block(fs->device, gd->bg_inode_bitmap, bitmap, fs->block_size) != 0) {
+            if (ext2_meta_write(fs, gd->bg_inode_bitmap, bitmap) != 0) {
                 kfree(bitmap);
-                /* errno already set by write_block */
+                /* errno already set by ext2_meta_write */
                 return 0;
             }
             
@@ -223,6 +476,7 @@ uint32_t ext2_alloc_inode(ext2_fs_t *fs, uint32_t group) {
             
             /* Update superblock */
             fs->superblock->s_free_inodes_count--;
+            fs->super_dirty = 1;
             
             kfree(bitmap);
             clear_errno();
@@ -263,9 +517,9 @@ int ext2_free_inode(ext2_fs_t *fs, uint32_t inode_num) {
         RETURN_ERRNO(THUNDEROS_ENOMEM);
     }
     
-    if (read_block(fs->device, gd->bg_inode_bitmap, bitmap, fs->block_size) != 0) {
+    if (ext2_meta_read(fs, gd->bg_inode_bitmap, bitmap) != 0) {
         kfree(bitmap);
-        /* errno already set by read_block */
+        /* errno already set by ext2_meta_read */
         return -1;
     }
     
@@ -275,9 +529,9 @@ int ext2_free_inode(ext2_fs_t *fs, uint32_t inode_num) {
     bitmap[byte] &= ~(1 << bit);
     
     /* Write bitmap back */
-    if (write_block(fs->device, gd->bg_inode_bitmap, bitmap, fs->block_size) != 0) {
+    if (ext2_meta_write(fs, gd->bg_inode_bitmap, bitmap) != 0) {
         kfree(bitmap);
-        /* errno already set by write_block */
+        /* errno already set by ext2_meta_write */
         return -1;
     }
     
@@ -286,6 +540,7 @@ int ext2_free_inode(ext2_fs_t *fs, uint32_t inode_num) {
     
     /* Update superblock */
     fs->superblock->s_free_inodes_count++;
+    fs->super_dirty = 1;
     
     kfree(bitmap);
     clear_errno();
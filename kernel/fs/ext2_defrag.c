@@ -0,0 +1,503 @@
+/*
+ * ext2_defrag.c - ext2 online defragmentation
+ *
+ * A file is moved while it stays open and in use. New runs of blocks are
+ * allocated first, the data is copied into them, and a new block map is
+ * built on a copy of the inode. The inode then takes over the new map in
+ * a single write and the old blocks are released. The filesystem lock is
+ * held throughout, so no reader or writer sees a half-built map, and every
+ * open of the file shares the one in-core inode whose map is swapped.
+ *
+ * Fragmentation is reported per file (runs of data blocks) and per block
+ * group (runs of free blocks).
+ */
+
+#include "../include/fs/ext2.h"
+#include "../include/mm/kmalloc.h"
+#include "../include/kernel/errno.h"
+#include <stddef.h>
+
+/* Target runs a file may be moved into; more would rarely be an improvement */
+#define DEFRAG_MAX_RUNS 64
+
+/**
+ * Called for every block of a file's tree, data blocks in file order
+ * depth is 0 for a data block and the levels below it for a pointer table.
+ * Returns 0 to continue, -1 to stop with errno set
+ */
+typedef int (*walk_fn_t)(void *ctx, uint32_t file_block, uint32_t block, uint32_t depth);
+
+/**
+ * Visit the count entries of a pointer table and everything below them
+ * Each entry points to a subtree of the given depth covering span file
+ * blocks, starting at base.
+ */
+static int walk_table(ext2_fs_t *fs, const uint32_t *table, uint32_t count, uint32_t depth,
+                      uint32_t base, walk_fn_t fn, void *ctx) {
+    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint32_t span = 1;
+    for (uint32_t d = 0; d < depth; d++) {
+        span *= ptrs_per_block;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (table[i] == 0) {
+            continue;
+        }
+        
+        uint32_t first = base + i * span;
+        if (fn(ctx, first, table[i], depth) != 0) {
+            /* errno already set by fn */
+            return -1;
+        }
+        if (depth == 0) {
+            continue;
+        }
+        
+        uint32_t *child = (uint32_t *)kmalloc(fs->block_size);
+        if (!child) {
+            RETURN_ERRNO(THUNDEROS_ENOMEM);
+        }
+        
+        if (ext2_meta_read(fs, table[i], child) != 0) {
+            kfree(child);
+            /* errno already set by ext2_meta_read */
+            return -1;
+        }
+        
+        int ret = walk_table(fs, child, ptrs_per_block, depth - 1, first, fn, ctx);
+        kfree(child);
+        if (ret != 0) {
+            /* errno already set by walk_table */
+            return -1;
+        }
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Visit every block of an inode's tree
+ */
+static int walk_inode(ext2_fs_t *fs, const ext2_inode_t *inode, walk_fn_t fn, void *ctx) {
+    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint32_t base = EXT2_NDIR_BLOCKS;
+    uint32_t span = 1;
+    uint32_t i_block[EXT2_N_BLOCKS];
+    
+    /* The on-disk inode is packed; work on an aligned copy of the map */
+    for (uint32_t i = 0; i < EXT2_N_BLOCKS; i++) {
+        i_block[i] = inode->i_block[i];
+    }
+    
+    if (walk_table(fs, i_block, EXT2_NDIR_BLOCKS, 0, 0, fn, ctx) != 0) {
+        /* errno already set by walk_table */
+        return -1;
+    }
+    
+    for (uint32_t depth = 1; depth <= 3; depth++) {
+        span *= ptrs_per_block;
+        if (walk_table(fs, &i_block[EXT2_IND_BLOCK + depth - 1], 1, depth, base,
+                       fn, ctx) != 0) {
+            /* errno already set by walk_table */
+            return -1;
+        }
+        base += span;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Fragmentation count in progress
+ */
+typedef struct {
+    ext2_frag_info_t *info;
+    uint32_t last_block;            /* Disk block of the previous data block, 0 if none */
+} frag_scan_t;
+
+static int frag_visit(void *ctx, uint32_t file_block, uint32_t block, uint32_t depth) {
+    frag_scan_t *scan = (frag_scan_t *)ctx;
+    (void)file_block;
+    
+    if (depth > 0) {
+        scan->info->meta_blocks++;
+        return 0;
+    }
+    
+    if (scan->last_block == 0 || block != scan->last_block + 1) {
+        scan->info->extents++;
+    }
+    scan->info->data_blocks++;
+    scan->last_block = block;
+    return 0;
+}
+
+/**
+ * Measure the fragmentation of a file's data
+ */
+int ext2_frag_info(ext2_fs_t *fs, ext2_inode_t *inode, ext2_frag_info_t *info) {
+    if (!fs || !inode || !info) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    info->data_blocks = 0;
+    info->meta_blocks = 0;
+    info->extents = 0;
+    
+    frag_scan_t scan = { info, 0 };
+    if (walk_inode(fs, inode, frag_visit, &scan) != 0) {
+        /* errno already set by walk_inode */
+        return -1;
+    }
+    
+    /* A run cannot cross a group: the next group starts with its own metadata */
+    uint32_t blocks_per_group = fs->superblock->s_blocks_per_group;
+    info->best_extents = (info->data_blocks + blocks_per_group - 1) / blocks_per_group;
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Measure the free space fragmentation of a block group
+ */
+int ext2_group_frag(ext2_fs_t *fs, uint32_t group, ext2_group_frag_t *frag) {
+    if (!fs || !frag || group >= fs->num_groups) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    uint32_t blocks_per_group = fs->superblock->s_blocks_per_group;
+    uint32_t group_start = fs->superblock->s_first_data_block + group * blocks_per_group;
+    uint32_t nbits = blocks_per_group;
+    
+    /* The last group may be cut short by the end of the disk */
+    if (group_start + nbits > fs->superblock->s_blocks_count) {
+        nbits = fs->superblock->s_blocks_count - group_start;
+    }
+    
+    uint8_t *bitmap = (uint8_t *)kmalloc(fs->block_size);
+    if (!bitmap) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    if (ext2_meta_read(fs, fs->group_desc[group].bg_block_bitmap, bitmap) != 0) {
+        kfree(bitmap);
+        /* errno already set by ext2_meta_read */
+        return -1;
+    }
+    
+    frag->group = group;
+    frag->groups = fs->num_groups;
+    frag->free_blocks = 0;
+    frag->free_extents = 0;
+    frag->largest_free = 0;
+    
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < nbits; i++) {
+        if (bitmap[i / 8] & (1 << (i % 8))) {
+            run = 0;
+            continue;
+        }
+        if (run == 0) {
+            frag->free_extents++;
+        }
+        run++;
+        frag->free_blocks++;
+        if (run > frag->largest_free) {
+            frag->largest_free = run;
+        }
+    }
+    
+    kfree(bitmap);
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Runs of new blocks a file is moved into
+ */
+typedef struct {
+    uint32_t start[DEFRAG_MAX_RUNS];
+    uint32_t len[DEFRAG_MAX_RUNS];
+    uint32_t count;                 /* Runs allocated */
+    uint32_t current;               /* Run being filled */
+    uint32_t used;                  /* Blocks of the current run already filled */
+} target_runs_t;
+
+/**
+ * Copy in progress
+ * Consecutive file blocks are gathered in buffer and written to the
+ * target with one request, so each chunk costs one write and one update
+ * per pointer table.
+ */
+typedef struct {
+    ext2_fs_t *fs;
+    ext2_inode_t *shadow;           /* Inode copy that receives the new map */
+    target_runs_t *runs;
+    uint8_t *buffer;                /* EXT2_READ_CLUSTER_BLOCKS blocks */
+    uint32_t first;                 /* File block of the first gathered block */
+    uint32_t count;                 /* Blocks gathered */
+    uint32_t src[EXT2_READ_CLUSTER_BLOCKS]; /* Their current disk blocks */
+} defrag_copy_t;
+
+/**
+ * Allocate target runs for count blocks, stopping at max_runs
+ * Each run is asked for everything still missing, so the allocator
+ * returns the longest free run it finds.
+ * Returns 0 if all blocks were allocated, -1 otherwise (runs kept)
+ */
+static int alloc_runs(ext2_fs_t *fs, target_runs_t *runs, uint32_t goal, uint32_t count,
+                      uint32_t max_runs) {
+    uint32_t missing = count;
+    
+    while (missing > 0) {
+        if (runs->count == max_runs) {
+            RETURN_ERRNO(THUNDEROS_EFS_NOBLK);
+        }
+        
+        uint32_t got;
+        uint32_t start = ext2_alloc_blocks(fs, goal, missing, &got);
+        if (start == 0) {
+            /* errno already set by ext2_alloc_blocks */
+            return -1;
+        }
+        
+        runs->start[runs->count] = start;
+        runs->len[runs->count] = got;
+        runs->count++;
+        missing -= got;
+        goal = start + got;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Return target blocks that were not mapped to the bitmap
+ */
+static void free_unused_runs(ext2_fs_t *fs, target_runs_t *runs) {
+    for (uint32_t r = runs->current; r < runs->count; r++) {
+        uint32_t from = (r == runs->current) ? runs->used : 0;
+        for (uint32_t i = from; i < runs->len[r]; i++) {
+            ext2_free_block(fs, runs->start[r] + i);
+        }
+    }
+    runs->current = runs->count;
+    runs->used = 0;
+}
+
+/**
+ * Write the gathered blocks to the target and map them in the new tree
+ */
+static int copy_flush(defrag_copy_t *copy) {
+    ext2_fs_t *fs = copy->fs;
+    target_runs_t *runs = copy->runs;
+    
+    if (copy->count == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    /* Blocks that follow each other on disk are read with one request */
+    uint32_t i = 0;
+    while (i < copy->count) {
+        uint32_t n = 1;
+        while (i + n < copy->count && copy->src[i + n] == copy->src[i] + n) {
+            n++;
+        }
+        if (ext2_read_blocks(fs, copy->src[i], n, copy->buffer + i * fs->block_size) != 0) {
+            /* errno already set by ext2_read_blocks */
+            return -1;
+        }
+        i += n;
+    }
+    
+    uint32_t target = runs->start[runs->current] + runs->used;
+    if (ext2_write_blocks(fs, target, copy->count, copy->buffer) != 0) {
+        /* errno already set by ext2_write_blocks */
+        return -1;
+    }
+    
+    uint32_t mapped;
+    int ret = ext2_map_blocks(fs, copy->shadow, copy->first, target, copy->count, &mapped);
+    runs->used += mapped;
+    if (ret != 0) {
+        /* errno already set by ext2_map_blocks */
+        return -1;
+    }
+    
+    if (runs->used == runs->len[runs->current]) {
+        runs->current++;
+        runs->used = 0;
+    }
+    copy->count = 0;
+    
+    clear_errno();
+    return 0;
+}
+
+static int copy_visit(void *ctx, uint32_t file_block, uint32_t block, uint32_t depth) {
+    defrag_copy_t *copy = (defrag_copy_t *)ctx;
+    target_runs_t *runs = copy->runs;
+    
+    /* The new tree gets its own pointer tables */
+    if (depth > 0) {
+        return 0;
+    }
+    
+    /* A chunk is consecutive in the file and fits in the current run */
+    if (copy->count > 0 &&
+        (file_block != copy->first + copy->count ||
+         copy->count == EXT2_READ_CLUSTER_BLOCKS ||
+         runs->used + copy->count == runs->len[runs->current])) {
+        if (copy_flush(copy) != 0) {
+            /* errno already set by copy_flush */
+            return -1;
+        }
+    }
+    
+    if (copy->count == 0) {
+        copy->first = file_block;
+    }
+    copy->src[copy->count++] = block;
+    return 0;
+}
+
+/**
+ * Move a regular file's data into as few runs of blocks as possible
+ */
+int ext2_defrag(ext2_fs_t *fs, ext2_inode_info_t *info, ext2_frag_info_t *result) {
+    if (!fs || !info || !result) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_inode_t *inode = &info->inode;
+    if ((inode->i_mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /*
+     * The old blocks are freed below, so no other copy of the block map
+     * may survive the swap. Every open reaches the inode through the
+     * in-core table; a copy outside it would keep the old map.
+     */
+    if (ext2_icache_find(fs, info->ino) != info) {
+        RETURN_ERRNO(THUNDEROS_EBUSY);
+    }
+    
+    /* Buffered data gets its blocks first, so the map is complete */
+    if (ext2_delalloc_flush(fs, info) != 0) {
+        /* errno already set by ext2_delalloc_flush */
+        return -1;
+    }
+    
+    ext2_frag_info_t before;
+    if (ext2_frag_info(fs, inode, &before) != 0) {
+        /* errno already set by ext2_frag_info */
+        return -1;
+    }
+    *result = before;
+    
+    if (before.extents <= before.best_extents) {
+        clear_errno();
+        return 0;
+    }
+    
+    /* Only a layout with fewer runs than now is worth the copy */
+    uint32_t max_runs = before.extents - 1;
+    if (max_runs > DEFRAG_MAX_RUNS) {
+        max_runs = DEFRAG_MAX_RUNS;
+    }
+    
+    target_runs_t *runs = (target_runs_t *)kmalloc(sizeof(target_runs_t));
+    uint8_t *buffer = (uint8_t *)kmalloc(EXT2_READ_CLUSTER_BLOCKS * fs->block_size);
+    defrag_copy_t *copy = (defrag_copy_t *)kmalloc(sizeof(defrag_copy_t));
+    if (!runs || !buffer || !copy) {
+        kfree(runs);
+        kfree(buffer);
+        kfree(copy);
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    runs->count = 0;
+    runs->current = 0;
+    runs->used = 0;
+    
+    if (alloc_runs(fs, runs, ext2_inode_block_goal(fs, info->ino), before.data_blocks,
+                   max_runs) != 0) {
+        int error = get_errno();
+        free_unused_runs(fs, runs);
+        kfree(runs);
+        kfree(buffer);
+        kfree(copy);
+        
+        /* Free space too fragmented to improve on the current layout */
+        if (error == THUNDEROS_EFS_NOBLK) {
+            clear_errno();
+            return 0;
+        }
+        RETURN_ERRNO(error);
+    }
+    
+    /* The new map is built on a copy of the inode */
+    ext2_inode_t shadow = *inode;
+    for (uint32_t i = 0; i < EXT2_N_BLOCKS; i++) {
+        shadow.i_block[i] = 0;
+    }
+    shadow.i_blocks = 0;
+    
+    copy->fs = fs;
+    copy->shadow = &shadow;
+    copy->runs = runs;
+    copy->buffer = buffer;
+    copy->first = 0;
+    copy->count = 0;
+    
+    int ret = walk_inode(fs, inode, copy_visit, copy);
+    if (ret == 0) {
+        ret = copy_flush(copy);
+    }
+    kfree(buffer);
+    kfree(copy);
+    
+    if (ret != 0) {
+        int error = get_errno();
+        /* The old map is untouched; drop everything the copy took */
+        free_unused_runs(fs, runs);
+        ext2_truncate_blocks(fs, &shadow, 0);
+        kfree(runs);
+        RETURN_ERRNO(error);
+    }
+    kfree(runs);
+    
+    /* Swap the maps: the inode write is the moment the file moves */
+    ext2_inode_t old = *inode;
+    for (uint32_t i = 0; i < EXT2_N_BLOCKS; i++) {
+        inode->i_block[i] = shadow.i_block[i];
+    }
+    inode->i_blocks = shadow.i_blocks;
+    
+    if (ext2_write_inode(fs, info->ino, inode) != 0) {
+        int error = get_errno();
+        *inode = old;
+        ext2_truncate_blocks(fs, &shadow, 0);
+        RETURN_ERRNO(error);
+    }
+    info->dirty = 0;
+    
+    /*
+     * Nothing points at the old blocks any more: the inode on disk and
+     * the in-core inode that every open of the file shares both hold the
+     * new map.
+     */
+    if (ext2_truncate_blocks(fs, &old, 0) != 0) {
+        /* errno already set by ext2_truncate_blocks */
+        return -1;
+    }
+    
+    /* errno set by ext2_frag_info */
+    return ext2_frag_info(fs, inode, result);
+}
@@ -0,0 +1,445 @@
+/*
+ * ext2_delalloc.c - ext2 delayed block allocation
+ *
+ * Writes that land in blocks without a disk block are buffered in the
+ * in-core inode instead of allocating at write() time. When the data is
+ * written back (file close, run full, or a non-sequential write), the
+ * allocator is asked for the whole run at once and the data goes out in
+ * one request. Small appends therefore end up in a single contiguous
+ * extent and no zero-fill writes are issued for them.
+ *
+ * ext2_fallocate() is the opposite case: the final size is known up
+ * front, so the whole range is allocated in as few runs as possible and
+ * later writes go straight to the reserved blocks.
+ */
+
+#include "../include/fs/ext2.h"
+#include "../include/drivers/virtio_blk.h"
+#include "../include/mm/kmalloc.h"
+#include "../include/hal/hal_uart.h"
+#include "../include/kernel/errno.h"
+#include <stddef.h>
+
+/* Blocks written per request when zeroing without device support */
+#define ZERO_CHUNK_BLOCKS 32
+
+/**
+ * Copy bytes
+ */
+static void copy_bytes(uint8_t *dst, const uint8_t *src, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        dst[i] = src[i];
+    }
+}
+
+/**
+ * Check whether a file block is held in the delayed-allocation buffer
+ */
+static int delalloc_contains(ext2_delalloc_t *da, uint32_t file_block) {
+    return da->data != NULL &&
+           file_block >= da->first_block &&
+           file_block < da->first_block + da->nr_blocks;
+}
+
+/**
+ * Pick an allocation goal for the run starting at file_block
+ * Continues right after the previous file block when it is on disk,
+ * otherwise starts in the block group that holds the inode.
+ */
+uint32_t ext2_delalloc_goal(ext2_fs_t *fs, ext2_inode_info_t *info, uint32_t file_block) {
+    if (file_block > 0) {
+        uint32_t prev = ext2_bmap(fs, &info->inode, file_block - 1);
+        if (prev != 0) {
+            return prev + 1;
+        }
+    }
+    if (info->inode.i_block[0] != 0) {
+        return info->inode.i_block[0];
+    }
+    return ext2_inode_block_goal(fs, info->ino);
+}
+
+/**
+ * Write data to a file, deferring block allocation for new blocks
+ */
+int ext2_delalloc_write(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t offset,
+                        const void *buffer, uint32_t size) {
+    if (!fs || !info || !buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (size == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    /* The block map and i_blocks cannot describe a larger file */
+    if (offset >= fs->max_file_size) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    if (size > fs->max_file_size - offset) {
+        size = (uint32_t)(fs->max_file_size - offset);
+    }
+    
+    ext2_inode_t *inode = &info->inode;
+    ext2_delalloc_t *da = &info->delalloc;
+    const uint8_t *src = (const uint8_t *)buffer;
+    uint64_t file_size = ext2_inode_size(inode);
+    uint32_t bytes_written = 0;
+    
+    while (bytes_written < size) {
+        uint64_t pos = offset + bytes_written;
+        uint32_t file_block = (uint32_t)(pos / fs->block_size);
+        uint32_t block_offset = (uint32_t)(pos % fs->block_size);
+        
+        uint32_t to_write = fs->block_size - block_offset;
+        if (to_write > size - bytes_written) {
+            to_write = size - bytes_written;
+        }
+        
+        /* Block already buffered */
+        if (delalloc_contains(da, file_block)) {
+            uint8_t *dst = da->data + (file_block - da->first_block) * fs->block_size;
+            copy_bytes(dst + block_offset, src + bytes_written, to_write);
+            bytes_written += to_write;
+            continue;
+        }
+        
+        /*
+         * Block already on disk: write through. Nothing is mapped past the
+         * end of the file, so appends skip the block map lookup.
+         */
+        if ((uint64_t)file_block * fs->block_size < file_size &&
+            ext2_bmap(fs, inode, file_block) != 0) {
+            if (ext2_write_file(fs, inode, pos, src + bytes_written, to_write) < 0) {
+                /* errno already set by ext2_write_file */
+                return -1;
+            }
+            info->dirty = 1;
+            bytes_written += to_write;
+            continue;
+        }
+        
+        /* Only sequential growth of the run is buffered */
+        if (da->data && (file_block != da->first_block + da->nr_blocks ||
+                         da->nr_blocks == EXT2_DELALLOC_MAX_BLOCKS)) {
+            if (ext2_delalloc_flush(fs, info) != 0) {
+                /* errno already set by ext2_delalloc_flush */
+                return -1;
+            }
+        }
+        
+        if (!da->data) {
+            da->data = (uint8_t *)kmalloc(EXT2_DELALLOC_MAX_BLOCKS * fs->block_size);
+            if (!da->data) {
+                /* Out of memory: fall back to allocating now */
+                if (ext2_write_file(fs, inode, pos, src + bytes_written, to_write) < 0) {
+                    /* errno already set by ext2_write_file */
+                    return -1;
+                }
+                info->dirty = 1;
+                bytes_written += to_write;
+                continue;
+            }
+            da->first_block = file_block;
+            da->nr_blocks = 0;
+        }
+        
+        /* New block is a hole until now, so the unwritten part reads as zero */
+        uint8_t *dst = da->data + da->nr_blocks * fs->block_size;
+        for (uint32_t i = 0; i < fs->block_size; i++) {
+            dst[i] = 0;
+        }
+        da->nr_blocks++;
+        
+        copy_bytes(dst + block_offset, src + bytes_written, to_write);
+        bytes_written += to_write;
+    }
+    
+    /* Size is updated now; blocks are accounted for at write-back */
+    if (offset + bytes_written > ext2_inode_size(inode)) {
+        ext2_inode_set_size(fs, inode, offset + bytes_written);
+        info->dirty = 1;
+    }
+    
+    clear_errno();
+    return bytes_written;
+}
+
+/**
+ * Read data from a file, including data not yet written back
+ */
+int ext2_delalloc_read(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t offset,
+                       void *buffer, uint32_t size) {
+    if (!fs || !info || !buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Buffered blocks are holes on disk and read back as zeros here */
+    int bytes_read = ext2_read_file(fs, &info->inode, offset, buffer, size);
+    if (bytes_read <= 0) {
+        /* errno already set by ext2_read_file */
+        return bytes_read;
+    }
+    
+    /* Overlay the buffered run */
+    ext2_delalloc_t *da = &info->delalloc;
+    if (da->data) {
+        uint64_t run_start = (uint64_t)da->first_block * fs->block_size;
+        uint64_t run_end = run_start + (uint64_t)da->nr_blocks * fs->block_size;
+        uint64_t read_end = offset + (uint32_t)bytes_read;
+        
+        uint64_t start = offset > run_start ? offset : run_start;
+        uint64_t end = read_end < run_end ? read_end : run_end;
+        
+        if (start < end) {
+            copy_bytes((uint8_t *)buffer + (start - offset),
+                       da->data + (start - run_start), (uint32_t)(end - start));
+        }
+    }
+    
+    return bytes_read;
+}
+
+/**
+ * Allocate blocks for buffered data, write it out and update the inode
+ */
+int ext2_delalloc_flush(ext2_fs_t *fs, ext2_inode_info_t *info) {
+    if (!fs || !info) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_inode_t *inode = &info->inode;
+    ext2_delalloc_t *da = &info->delalloc;
+    int error = 0;
+    
+    if (da->data) {
+        uint32_t done = 0;
+        
+        while (done < da->nr_blocks) {
+            uint32_t file_block = da->first_block + done;
+            uint32_t wanted = da->nr_blocks - done;
+            uint32_t got;
+            
+            /* The allocator sees the whole remaining run at once */
+            uint32_t start = ext2_alloc_blocks(fs, ext2_delalloc_goal(fs, info, file_block),
+                                               wanted, &got);
+            if (start == 0) {
+                hal_uart_puts("ext2: Delayed allocation failed\n");
+                error = get_errno();
+                break;
+            }
+            
+            /* Data goes out before the block map that points at it */
+            if (ext2_write_blocks(fs, start, got, da->data + done * fs->block_size) != 0) {
+                error = get_errno();
+                for (uint32_t i = 0; i < got; i++) {
+                    ext2_free_block(fs, start + i);
+                }
+                break;
+            }
+            
+            uint32_t mapped;
+            if (ext2_map_blocks(fs, inode, file_block, start, got, &mapped) != 0) {
+                error = get_errno();
+                /* Unmapped tail of the run goes back to the bitmap */
+                for (uint32_t i = mapped; i < got; i++) {
+                    ext2_free_block(fs, start + i);
+                }
+                /* The mapped head is in the inode; only the tail stays buffered */
+                done += mapped;
+                break;
+            }
+            
+            done += got;
+        }
+        
+        if (done == da->nr_blocks) {
+            ext2_delalloc_drop(info);
+        } else {
+            /* The rest stays buffered, so a later flush can try again */
+            copy_bytes(da->data, da->data + done * fs->block_size,
+                       (da->nr_blocks - done) * fs->block_size);
+            da->first_block += done;
+            da->nr_blocks -= done;
+        }
+        if (done > 0) {
+            info->dirty = 1;
+        }
+    }
+    
+    if (info->dirty) {
+        if (ext2_write_inode(fs, info->ino, inode) != 0) {
+            /* errno already set by ext2_write_inode */
+            return -1;
+        }
+        info->dirty = 0;
+    }
+    
+    if (error != 0) {
+        RETURN_ERRNO(error);
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Throw away buffered data without writing it
+ */
+void ext2_delalloc_drop(ext2_inode_info_t *info) {
+    ext2_delalloc_t *da = &info->delalloc;
+    
+    if (da->data) {
+        kfree(da->data);
+        da->data = NULL;
+    }
+    da->first_block = 0;
+    da->nr_blocks = 0;
+}
+
+/**
+ * Zero blocks on disk
+ * Uses the device's write-zeroes command when offered, otherwise writes
+ * zeroed buffers several blocks at a time.
+ */
+static int zero_blocks(ext2_fs_t *fs, uint32_t block_num, uint32_t count) {
+    uint32_t sectors_per_block = fs->block_size / 512;
+    
+    if (virtio_blk_write_zeroes((uint64_t)block_num * sectors_per_block,
+                                count * sectors_per_block) == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    uint32_t chunk = (count < ZERO_CHUNK_BLOCKS) ? count : ZERO_CHUNK_BLOCKS;
+    uint8_t *zeros = (uint8_t *)kmalloc(chunk * fs->block_size);
+    if (!zeros) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    for (uint32_t i = 0; i < chunk * fs->block_size; i++) {
+        zeros[i] = 0;
+    }
+    
+    while (count > 0) {
+        uint32_t n = (count < chunk) ? count : chunk;
+        if (ext2_write_blocks(fs, block_num, n, zeros) != 0) {
+            kfree(zeros);
+            /* errno already set by ext2_write_blocks */
+            return -1;
+        }
+        block_num += n;
+        count -= n;
+    }
+    
+    kfree(zeros);
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Reserve disk blocks for a byte range of a file
+ *
+ * ext2 has no unwritten-extent flag, so the reserved blocks are zeroed
+ * before they are mapped. Blocks already mapped in the range are kept.
+ * Blocks past i_size are an error to e2fsck, so keep_size is only
+ * accepted for ranges inside the current size.
+ */
+int ext2_fallocate(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t offset, uint64_t len,
+                   int keep_size) {
+    if (!fs || !info || len == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (offset > fs->max_file_size || len > fs->max_file_size - offset) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    
+    if ((info->inode.i_mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (keep_size && offset + len > ext2_inode_size(&info->inode)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Buffered data gets its blocks first so the block map is complete */
+    if (ext2_delalloc_flush(fs, info) != 0) {
+        /* errno already set by ext2_delalloc_flush */
+        return -1;
+    }
+    
+    ext2_inode_t *inode = &info->inode;
+    uint32_t file_block = (uint32_t)(offset / fs->block_size);
+    uint32_t end_block = (uint32_t)((offset + len - 1) / fs->block_size + 1);
+    int error = 0;
+    
+    while (file_block < end_block && error == 0) {
+        if (ext2_bmap(fs, inode, file_block) != 0) {
+            file_block++;
+            continue;
+        }
+        
+        /* Measure the hole so the allocator sees all of it at once */
+        uint32_t hole = 1;
+        while (file_block + hole < end_block && ext2_bmap(fs, inode, file_block + hole) == 0) {
+            hole++;
+        }
+        
+        while (hole > 0) {
+            uint32_t got;
+            uint32_t start = ext2_alloc_blocks(fs, ext2_delalloc_goal(fs, info, file_block), hole, &got);
+            if (start == 0) {
+                error = get_errno();
+                break;
+            }
+            
+            if (zero_blocks(fs, start, got) != 0) {
+                error = get_errno();
+                for (uint32_t i = 0; i < got; i++) {
+                    ext2_free_block(fs, start + i);
+                }
+                break;
+            }
+            
+            uint32_t mapped;
+            if (ext2_map_blocks(fs, inode, file_block, start, got, &mapped) != 0) {
+                error = get_errno();
+                /* Unmapped tail of the run goes back to the bitmap */
+                for (uint32_t i = mapped; i < got; i++) {
+                    ext2_free_block(fs, start + i);
+                }
+                file_block += mapped;
+                break;
+            }
+            
+            file_block += got;
+            hole -= got;
+        }
+    }
+    
+    /*
+     * Blocks reserved before a failure stay with the file, so the size
+     * still has to cover them.
+     */
+    uint64_t new_size = offset + len;
+    if (error != 0 && (uint64_t)file_block * fs->block_size < new_size) {
+        new_size = (uint64_t)file_block * fs->block_size;
+    }
+    if (!keep_size && new_size > ext2_inode_size(inode)) {
+        ext2_inode_set_size(fs, inode, new_size);
+    }
+    
+    if (ext2_write_inode(fs, info->ino, inode) != 0) {
+        /* errno already set by ext2_write_inode */
+        return -1;
+    }
+    info->dirty = 0;
+    
+    if (error != 0) {
+        RETURN_ERRNO(error);
+    }
+    
+    clear_errno();
+    return 0;
+}
@@ -172,3 +172,67 @@ int ext2_list_dir(ext2_fs_t *fs, ext2_inode_t *dir_inode, ext2_dir_callback_t ca
     clear_errno();
     return 0;
 }
+
+/**
+ * Read directory entries starting at a byte offset
+ */
+int ext2_read_dir(ext2_fs_t *fs, ext2_inode_t *dir_inode, uint32_t *offset,
+                  ext2_dir_fill_t fill, void *ctx) {
+    if (!fs || !dir_inode || !offset || !fill) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Verify this is a directory */
+    if ((dir_inode->i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+        RETURN_ERRNO(THUNDEROS_EFS_BADDIR);
+    }
+    
+    uint8_t *block = (uint8_t *)kmalloc(fs->block_size);
+    if (!block) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    uint32_t pos = *offset;
+    while (pos < dir_inode->i_size) {
+        uint32_t block_start = pos - (pos % fs->block_size);
+        
+        if (ext2_read_file(fs, dir_inode, block_start, block, fs->block_size) < 0) {
+            kfree(block);
+            /* errno already set by ext2_read_file */
+            return -1;
+        }
+        
+        /*
+         * Walk from the start of the block. A removal merges an entry into
+         * the one before it, so a saved offset may fall inside an entry
+         * that was already returned.
+         */
+        uint32_t in_block = 0;
+        while (in_block < fs->block_size) {
+            ext2_dirent_t *entry = (ext2_dirent_t *)(block + in_block);
+            
+            /* A damaged entry ends the block */
+            if (entry->rec_len < 8 || in_block + entry->rec_len > fs->block_size) {
+                break;
+            }
+            
+            uint32_t entry_pos = block_start + in_block;
+            if (entry_pos >= pos && entry->inode != 0 &&
+                fill(ctx, entry->name, entry->name_len, entry->inode, entry->file_type) != 0) {
+                *offset = entry_pos;
+                kfree(block);
+                clear_errno();
+                return 0;
+            }
+            
+            in_block += entry->rec_len;
+        }
+        
+        pos = block_start + fs->block_size;
+    }
+    
+    *offset = dir_inode->i_size;
+    kfree(block);
+    clear_errno();
+    return 0;
+}
@@ -1,5 +1,5 @@
 /*
- * ext2_file.c - ext2 file read operations
+ * ext2_file.c - ext2 file read operations and direct I/O
  */
 
 #include "../include/fs/ext2.h"
@@ -10,173 +10,316 @@
 #include <stddef.h>
 
 /**
- * Read a block from the block device
+ * Read consecutive blocks from disk in a single request
+ * Blocks with newer contents in the journal are returned from there.
  */
-static int read_block(void *device, uint32_t block_num, void *buffer, uint32_t block_size) {
-    (void)device;  /* Device parameter unused - we use global device */
-    
-    /* Calculate sector number (sectors are 512 bytes) */
-    uint32_t sector = (block_num * block_size) / 512;
-    uint32_t num_sectors = block_size / 512;
-    
-    /* Read sectors */
-    for (uint32_t i = 0; i < num_sectors; i++) {
-        int ret = virtio_blk_read(sector + i, 
-                                  (uint8_t *)buffer + (i * 512), 1);
-        if (ret != 1) {
-            set_errno(THUNDEROS_EIO);
-            return -1;
-        }
+int ext2_read_blocks(ext2_fs_t *fs, uint32_t block_num, uint32_t count, void *buffer) {
+    if (!fs || !buffer || count == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    uint32_t sectors_per_block = fs->block_size / 512;
+    uint32_t num_sectors = count * sectors_per_block;
+    
+    int ret = virtio_blk_read((uint64_t)block_num * sectors_per_block, buffer, num_sectors);
+    if (ret != (int)num_sectors) {
+        RETURN_ERRNO(THUNDEROS_EIO);
     }
     
+    ext2_journal_overlay(fs, block_num, count, buffer);
+    
     clear_errno();
     return 0;
 }
 
 /**
- * Get the block number for a given file block index
- * Handles direct, indirect, double-indirect, and triple-indirect blocks
+ * Find the i_block[] tree that maps a file block
+ * Trees are tried in order: direct, indirect, double and triple-indirect.
  */
-static uint32_t get_block_number(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t file_block) {
-    uint32_t *indirect_buffer = NULL;
-    uint32_t *dindirect_buffer = NULL;
-    uint32_t block_num = 0;
-    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+int ext2_block_tree(ext2_fs_t *fs, uint32_t file_block, uint32_t *depth, uint32_t *index) {
+    uint64_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint64_t span = ptrs_per_block;
     
-    /* Direct blocks */
     if (file_block < EXT2_NDIR_BLOCKS) {
-        return inode->i_block[file_block];
+        *depth = 0;
+        *index = file_block;
+        return (int)file_block;
     }
     
     file_block -= EXT2_NDIR_BLOCKS;
     
-    /* Indirect block */
-    if (file_block < ptrs_per_block) {
-        if (inode->i_block[EXT2_IND_BLOCK] == 0) {
-            return 0;
-        }
-        
-        indirect_buffer = (uint32_t *)kmalloc(fs->block_size);
-        if (!indirect_buffer) {
-            set_errno(THUNDEROS_ENOMEM);
-            return 0;
-        }
-        
-        if (read_block(fs->device, inode->i_block[EXT2_IND_BLOCK], 
-                      indirect_buffer, fs->block_size) != 0) {
-            kfree(indirect_buffer);
-            /* errno already set by read_block */
-            return 0;
+    for (uint32_t level = 1; level <= 3; level++) {
+        if (file_block < span) {
+            *depth = level;
+            *index = file_block;
+            return EXT2_IND_BLOCK + (int)level - 1;
         }
-        
-        block_num = indirect_buffer[file_block];
-        kfree(indirect_buffer);
+        file_block -= (uint32_t)span;
+        span *= ptrs_per_block;
+    }
+    
+    return -1;
+}
+
+/**
+ * Get the block number for a given file block index
+ * Handles direct, indirect, double-indirect, and triple-indirect blocks
+ */
+static uint32_t get_block_number(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t file_block) {
+    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint32_t depth;
+    uint32_t index;
+    
+    int root = ext2_block_tree(fs, file_block, &depth, &index);
+    if (root < 0) {
+        set_errno(THUNDEROS_EFBIG);
+        return 0;
+    }
+    
+    uint32_t block_num = inode->i_block[root];
+    if (depth == 0 || block_num == 0) {
         return block_num;
     }
     
-    file_block -= ptrs_per_block;
+    uint32_t *table = (uint32_t *)kmalloc(fs->block_size);
+    if (!table) {
+        set_errno(THUNDEROS_ENOMEM);
+        return 0;
+    }
     
-    /* Double-indirect block */
-    if (file_block < ptrs_per_block * ptrs_per_block) {
-        if (inode->i_block[EXT2_DIND_BLOCK] == 0) {
-            return 0;
-        }
-        
-        /* Read double-indirect block */
-        dindirect_buffer = (uint32_t *)kmalloc(fs->block_size);
-        if (!dindirect_buffer) {
-            set_errno(THUNDEROS_ENOMEM);
-            return 0;
-        }
-        
-        if (read_block(fs->device, inode->i_block[EXT2_DIND_BLOCK], 
-                      dindirect_buffer, fs->block_size) != 0) {
-            kfree(dindirect_buffer);
-            /* errno already set by read_block */
+    /* Blocks covered by one slot of the top table */
+    uint32_t span = 1;
+    for (uint32_t level = 1; level < depth; level++) {
+        span *= ptrs_per_block;
+    }
+    
+    /* One table read per level, stopping early at a hole */
+    while (block_num != 0 && depth > 0) {
+        if (ext2_meta_read(fs, block_num, table) != 0) {
+            kfree(table);
+            /* errno already set by ext2_meta_read */
             return 0;
         }
         
-        /* Get indirect block number */
-        uint32_t indirect_index = file_block / ptrs_per_block;
-        uint32_t indirect_block_num = dindirect_buffer[indirect_index];
-        kfree(dindirect_buffer);
-        
-        if (indirect_block_num == 0) {
-            return 0;
+        block_num = table[index / span];
+        index %= span;
+        span /= ptrs_per_block;
+        depth--;
+    }
+    
+    kfree(table);
+    return block_num;
+}
+
+/**
+ * Count how far a run continues in a block pointer array
+ * A run is either consecutive disk blocks starting at slots[0], or holes.
+ */
+static uint32_t run_length(const uint32_t *slots, uint32_t limit) {
+    uint32_t first = slots[0];
+    uint32_t n = 1;
+    
+    while (n < limit) {
+        uint32_t expect = first ? first + n : 0;
+        if (slots[n] != expect) {
+            break;
         }
-        
-        /* Read indirect block */
-        indirect_buffer = (uint32_t *)kmalloc(fs->block_size);
-        if (!indirect_buffer) {
-            set_errno(THUNDEROS_ENOMEM);
-            return 0;
+        n++;
+    }
+    return n;
+}
+
+/* Levels of pointer tables below the inode, for triple-indirect blocks */
+#define MAP_LEVELS 3
+
+/**
+ * Pointer tables kept between map_run calls
+ * Consecutive runs of a file mostly share their tables, so each one is
+ * read once rather than once per block. Level 0 holds the table that
+ * points at data blocks, higher levels the tables above it.
+ */
+typedef struct {
+    uint32_t *tables[MAP_LEVELS];   /* Table contents per level */
+    uint32_t blocks[MAP_LEVELS];    /* Disk block held in each, 0 if none */
+} map_cache_t;
+
+/**
+ * Read a pointer table into a cache slot unless it is already there
+ */
+static int map_cache_load(ext2_fs_t *fs, uint32_t block_num, uint32_t *table,
+                          uint32_t *cached) {
+    if (*cached == block_num) {
+        return 0;
+    }
+    
+    *cached = 0;
+    if (ext2_meta_read(fs, block_num, table) != 0) {
+        /* errno already set by ext2_meta_read */
+        return -1;
+    }
+    *cached = block_num;
+    return 0;
+}
+
+/**
+ * Map a run of file blocks to disk
+ *
+ * Returns the disk block of file_block (0 for a hole) and stores in *run
+ * how many blocks from file_block, at most max, continue the same way:
+ * consecutive on disk, or all holes. A run never crosses a pointer table.
+ * On error *run is 0 and errno is set.
+ */
+static uint32_t map_run(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t file_block,
+                        uint32_t max, map_cache_t *cache, uint32_t *run) {
+    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint32_t depth;
+    uint32_t index;
+    
+    *run = 0;
+    
+    int root = ext2_block_tree(fs, file_block, &depth, &index);
+    if (root < 0) {
+        set_errno(THUNDEROS_EFBIG);
+        return 0;
+    }
+    
+    /* Direct blocks */
+    if (depth == 0) {
+        uint32_t slots[EXT2_NDIR_BLOCKS];
+        uint32_t limit = EXT2_NDIR_BLOCKS - file_block;
+        for (uint32_t i = 0; i < limit; i++) {
+            slots[i] = inode->i_block[file_block + i];
         }
-        
-        if (read_block(fs->device, indirect_block_num, 
-                      indirect_buffer, fs->block_size) != 0) {
-            kfree(indirect_buffer);
-            /* errno already set by read_block */
+        *run = run_length(slots, limit < max ? limit : max);
+        return slots[0];
+    }
+    
+    /* Walk the upper tables down to the one holding data block pointers */
+    uint32_t leaf = inode->i_block[root];
+    uint32_t span = 1;
+    for (uint32_t level = 1; level < depth; level++) {
+        span *= ptrs_per_block;
+    }
+    for (uint32_t level = depth - 1; level > 0 && leaf != 0; level--) {
+        if (map_cache_load(fs, leaf, cache->tables[level], &cache->blocks[level]) != 0) {
+            /* errno already set by map_cache_load */
             return 0;
         }
-        
-        /* Get data block number */
-        uint32_t data_index = file_block % ptrs_per_block;
-        block_num = indirect_buffer[data_index];
-        kfree(indirect_buffer);
-        return block_num;
+        leaf = cache->tables[level][index / span];
+        index %= span;
+        span /= ptrs_per_block;
     }
+    index %= ptrs_per_block;
     
-    /* Triple-indirect block - not implemented for now */
-    /* Most files won't need this (would need to be > 4GB on 1KB blocks) */
-    hal_uart_puts("ext2: Triple-indirect blocks not yet supported\n");
-    set_errno(THUNDEROS_EFBIG);
-    return 0;
+    uint32_t limit = ptrs_per_block - index;
+    if (limit > max) {
+        limit = max;
+    }
+    
+    /* Missing table: the rest of its range is a hole */
+    if (leaf == 0) {
+        *run = limit;
+        return 0;
+    }
+    
+    if (map_cache_load(fs, leaf, cache->tables[0], &cache->blocks[0]) != 0) {
+        /* errno already set by map_cache_load */
+        return 0;
+    }
+    
+    *run = run_length(cache->tables[0] + index, limit);
+    return cache->tables[0][index];
+}
+
+/**
+ * Map a file block index to a disk block number
+ */
+uint32_t ext2_bmap(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t file_block) {
+    if (!fs || !inode) {
+        set_errno(THUNDEROS_EINVAL);
+        return 0;
+    }
+    
+    return get_block_number(fs, inode, file_block);
 }
 
 /**
  * Read data from a file
+ * Blocks that are consecutive on disk are fetched in one request, up to
+ * EXT2_READ_CLUSTER_BLOCKS at a time.
  */
-int ext2_read_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset, 
+int ext2_read_file(ext2_fs_t *fs, ext2_inode_t *inode, uint64_t offset, 
                    void *buffer, uint32_t size) {
     if (!fs || !inode || !buffer) {
         hal_uart_puts("ext2: Invalid parameters to ext2_read_file\n");
         RETURN_ERRNO(THUNDEROS_EINVAL);
     }
     
+    /* A damaged size cannot send the block index past the mapping */
+    uint64_t file_size = ext2_inode_size(inode);
+    if (file_size > fs->max_file_size) {
+        file_size = fs->max_file_size;
+    }
+    
     /* Check if offset is beyond file size */
-    if (offset >= inode->i_size) {
+    if (offset >= file_size) {
         clear_errno();
         return 0;
     }
     
     /* Adjust size if it would read past end of file */
-    if (offset + size > inode->i_size) {
-        size = inode->i_size - offset;
+    if (size > file_size - offset) {
+        size = (uint32_t)(file_size - offset);
     }
     
     uint8_t *dest = (uint8_t *)buffer;
     uint32_t bytes_read = 0;
     
-    /* Allocate temporary buffer for block reads */
-    uint8_t *block_buffer = (uint8_t *)kmalloc(fs->block_size);
-    if (!block_buffer) {
-        hal_uart_puts("ext2: Failed to allocate block buffer\n");
+    /* Cluster buffer sized for the request, capped at one cluster */
+    uint64_t span = (offset % fs->block_size + size + fs->block_size - 1) / fs->block_size;
+    uint32_t cluster_blocks = span < EXT2_READ_CLUSTER_BLOCKS ? (uint32_t)span : EXT2_READ_CLUSTER_BLOCKS;
+    
+    uint8_t *cluster = (uint8_t *)kmalloc(cluster_blocks * fs->block_size);
+    uint32_t *tables = (uint32_t *)kmalloc(MAP_LEVELS * fs->block_size);
+    if (!cluster || !tables) {
+        hal_uart_puts("ext2: Failed to allocate read buffers\n");
+        kfree(cluster);
+        kfree(tables);
         RETURN_ERRNO(THUNDEROS_ENOMEM);
     }
     
+    map_cache_t cache;
+    for (uint32_t level = 0; level < MAP_LEVELS; level++) {
+        cache.tables[level] = tables + level * (fs->block_size / sizeof(uint32_t));
+        cache.blocks[level] = 0;
+    }
+    
     while (bytes_read < size) {
         /* Calculate which file block we need */
-        uint32_t file_block = (offset + bytes_read) / fs->block_size;
-        uint32_t block_offset = (offset + bytes_read) % fs->block_size;
+        uint64_t pos = offset + bytes_read;
+        uint32_t file_block = (uint32_t)(pos / fs->block_size);
+        uint32_t block_offset = (uint32_t)(pos % fs->block_size);
+        
+        uint64_t left = ((uint64_t)block_offset + (size - bytes_read) + fs->block_size - 1) / fs->block_size;
+        uint32_t want = left < cluster_blocks ? (uint32_t)left : cluster_blocks;
+        
+        /* Find how many of those blocks can be read together */
+        uint32_t run;
+        uint32_t block_num = map_run(fs, inode, file_block, want, &cache, &run);
+        if (run == 0) {
+            kfree(cluster);
+            kfree(tables);
+            /* errno already set by map_run */
+            return -1;
+        }
+        
+        uint32_t to_copy = run * fs->block_size - block_offset;
+        if (to_copy > size - bytes_read) {
+            to_copy = size - bytes_read;
+        }
         
-        /* Get the actual block number on disk */
-        uint32_t block_num = get_block_number(fs, inode, file_block);
         if (block_num == 0) {
-            /* Sparse file - zero block */
-            uint32_t to_copy = fs->block_size - block_offset;
-            if (to_copy > size - bytes_read) {
-                to_copy = size - bytes_read;
-            }
+            /* Sparse file - zero blocks */
             for (uint32_t i = 0; i < to_copy; i++) {
                 dest[bytes_read + i] = 0;
             }
@@ -184,30 +327,220 @@ int ext2_read_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset,
             continue;
         }
         
-        /* Read the block */
-        if (read_block(fs->device, block_num, block_buffer, fs->block_size) != 0) {
+        /* Read the whole run */
+        if (ext2_read_blocks(fs, block_num, run, cluster) != 0) {
             hal_uart_puts("ext2: Failed to read data block ");
             hal_uart_put_uint32(block_num);
             hal_uart_puts("\n");
-            kfree(block_buffer);
-            /* errno already set by read_block */
+            kfree(cluster);
+            kfree(tables);
+            /* errno already set by ext2_read_blocks */
             return -1;
         }
         
-        /* Copy the requested portion of the block */
-        uint32_t to_copy = fs->block_size - block_offset;
-        if (to_copy > size - bytes_read) {
-            to_copy = size - bytes_read;
-        }
-        
+        /* Copy the requested portion of the run */
         for (uint32_t i = 0; i < to_copy; i++) {
-            dest[bytes_read + i] = block_buffer[block_offset + i];
+            dest[bytes_read + i] = cluster[block_offset + i];
         }
         
         bytes_read += to_copy;
     }
     
-    kfree(block_buffer);
+    kfree(cluster);
+    kfree(tables);
     clear_errno();
     return bytes_read;
 }
+
+/**
+ * Transfer whole blocks between a file and a buffer without a kernel copy
+ *
+ * Each run of blocks that is consecutive on disk goes to the device as one
+ * request whose data descriptors point at the pages of the buffer itself.
+ * Holes read as zeros; writing into a hole allocates a run for it first.
+ * Delayed-allocation data is the only in-memory copy of file contents, so
+ * it is written back before the transfer and the disk is then current.
+ */
+int ext2_direct_io(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t offset,
+                   void *buffer, uint32_t size, int write) {
+    if (!fs || !info || !buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Only whole blocks can bypass the kernel */
+    if (offset % fs->block_size != 0 || size % fs->block_size != 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (size == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    ext2_inode_t *inode = &info->inode;
+    
+    if (write) {
+        /* The block map and i_blocks cannot describe a larger file */
+        if (offset >= fs->max_file_size) {
+            RETURN_ERRNO(THUNDEROS_EFBIG);
+        }
+        if (size > fs->max_file_size - offset) {
+            size = (uint32_t)((fs->max_file_size - offset) / fs->block_size * fs->block_size);
+            if (size == 0) {
+                RETURN_ERRNO(THUNDEROS_EFBIG);
+            }
+        }
+    }
+    
+    if (info->delalloc.data && ext2_delalloc_flush(fs, info) != 0) {
+        /* errno already set by ext2_delalloc_flush */
+        return -1;
+    }
+    
+    /* Reads stop at the end of the file but fill whole blocks */
+    uint32_t length = size;
+    if (!write) {
+        uint64_t file_size = ext2_inode_size(inode);
+        if (file_size > fs->max_file_size) {
+            file_size = fs->max_file_size;
+        }
+        if (offset >= file_size) {
+            clear_errno();
+            return 0;
+        }
+        if (size > file_size - offset) {
+            length = (uint32_t)(file_size - offset);
+            size = (length + fs->block_size - 1) / fs->block_size * fs->block_size;
+        }
+    }
+    
+    uint32_t max_sg = virtio_blk_get_max_sg();
+    if (max_sg == 0) {
+        RETURN_ERRNO(THUNDEROS_EVIRTIO_NODEV);
+    }
+    
+    dma_sg_t *sg = (dma_sg_t *)kmalloc(max_sg * sizeof(dma_sg_t));
+    uint32_t *tables = (uint32_t *)kmalloc(MAP_LEVELS * fs->block_size);
+    if (!sg || !tables) {
+        kfree(sg);
+        kfree(tables);
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    map_cache_t cache;
+    for (uint32_t level = 0; level < MAP_LEVELS; level++) {
+        cache.tables[level] = tables + level * (fs->block_size / sizeof(uint32_t));
+        cache.blocks[level] = 0;
+    }
+    
+    uint8_t *data = (uint8_t *)buffer;
+    uint32_t sectors_per_block = fs->block_size / 512;
+    uint32_t done = 0;
+    int error = 0;
+    
+    while (done < size) {
+        uint32_t file_block = (uint32_t)((offset + done) / fs->block_size);
+        uint32_t run;
+        uint32_t block_num = map_run(fs, inode, file_block, (size - done) / fs->block_size,
+                                     &cache, &run);
+        if (run == 0) {
+            error = get_errno();
+            break;
+        }
+        
+        /* Holes read as zeros without touching the disk */
+        if (block_num == 0 && !write) {
+            for (uint32_t i = 0; i < run * fs->block_size; i++) {
+                data[done + i] = 0;
+            }
+            done += run * fs->block_size;
+            continue;
+        }
+        
+        /* As much of the run as one request can carry */
+        int dir = write ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+        uint32_t nr_sg;
+        size_t mapped = dma_map_sg(data + done, (size_t)run * fs->block_size, dir,
+                                   sg, max_sg, &nr_sg);
+        uint32_t count = (uint32_t)(mapped / fs->block_size);
+        if (count == 0) {
+            /* Buffer the process may not use this way, or a block spread
+             * over too many pages */
+            error = (mapped == 0) ? THUNDEROS_EFAULT : THUNDEROS_EINVAL;
+            break;
+        }
+        
+        /* A hole being written gets a run of new blocks */
+        int allocated = 0;
+        if (block_num == 0) {
+            uint32_t got;
+            block_num = ext2_alloc_blocks(fs, ext2_delalloc_goal(fs, info, file_block), count, &got);
+            if (block_num == 0) {
+                error = get_errno();
+                break;
+            }
+            allocated = 1;
+            count = got;
+        }
+        if ((size_t)count * fs->block_size != mapped) {
+            dma_map_sg(data + done, (size_t)count * fs->block_size, dir, sg, max_sg, &nr_sg);
+        }
+        
+        uint64_t sector = (uint64_t)block_num * sectors_per_block;
+        int ret = write ? virtio_blk_write_sg(sector, sg, nr_sg)
+                        : virtio_blk_read_sg(sector, sg, nr_sg);
+        if (ret != (int)(count * sectors_per_block)) {
+            if (allocated) {
+                for (uint32_t i = 0; i < count; i++) {
+                    ext2_free_block(fs, block_num + i);
+                }
+            }
+            error = THUNDEROS_EIO;
+            break;
+        }
+        
+        if (!write) {
+            ext2_journal_overlay(fs, block_num, count, data + done);
+        }
+        
+        /* Data is on disk before the block map points at it */
+        if (allocated) {
+            uint32_t mapped_blocks;
+            int map_ret = ext2_map_blocks(fs, inode, file_block, block_num, count, &mapped_blocks);
+            info->dirty = 1;
+            
+            /* Tables the mapping changed are read again */
+            for (uint32_t level = 0; level < MAP_LEVELS; level++) {
+                cache.blocks[level] = 0;
+            }
+            
+            if (map_ret != 0) {
+                /* Unmapped tail of the run goes back to the bitmap */
+                for (uint32_t i = mapped_blocks; i < count; i++) {
+                    ext2_free_block(fs, block_num + i);
+                }
+                done += mapped_blocks * fs->block_size;
+                error = THUNDEROS_EIO;
+                break;
+            }
+        }
+        
+        done += count * fs->block_size;
+    }
+    
+    kfree(sg);
+    kfree(tables);
+    
+    if (write && offset + done > ext2_inode_size(inode)) {
+        ext2_inode_set_size(fs, inode, offset + done);
+        info->dirty = 1;
+    }
+    
+    /* Report what was transferred before an error */
+    if (done == 0 && error != 0) {
+        RETURN_ERRNO(error);
+    }
+    
+    clear_errno();
+    return done < length ? done : length;
+}
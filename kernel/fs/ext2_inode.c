@@ -3,57 +3,12 @@
  */
 
 #include "../include/fs/ext2.h"
-#include "../include/drivers/virtio_blk.h"
 #include "../include/mm/kmalloc.h"
 #include "../include/hal/hal_uart.h"
 #include "../include/kernel/errno.h"
+#include "../include/kernel/kstring.h"
 #include <stddef.h>
 
-/**
- * Read a block from the block device
- */
-static int read_block(void *device, uint32_t block_num, void *buffer, uint32_t block_size) {
-    (void)device;  /* Device parameter unused - we use global device */
-    
-    /* Calculate sector number (sectors are 512 bytes) */
-    uint32_t sector = (block_num * block_size) / 512;
-    uint32_t num_sectors = block_size / 512;
-    
-    /* Read sectors */
-    for (uint32_t i = 0; i < num_sectors; i++) {
-        int ret = virtio_blk_read(sector + i, 
-                                  (uint8_t *)buffer + (i * 512), 1);
-        if (ret != 1) {
-            set_errno(THUNDEROS_EIO);
-            return -1;
-        }
-    }
-    
-    clear_errno();
-    return 0;
-}
-
-/**
- * Write a block to the block device
- */
-static int write_block(void *device, uint32_t block_num, const void *buffer, uint32_t block_size) {
-    (void)device;
-    
-    uint32_t sector = (block_num * block_size) / 512;
-    uint32_t num_sectors = block_size / 512;
-    
-    for (uint32_t i = 0; i < num_sectors; i++) {
-        int ret = virtio_blk_write(sector + i, (const uint8_t *)buffer + (i * 512), 1);
-        if (ret != 1) {
-            set_errno(THUNDEROS_EIO);
-            return -1;
-        }
-    }
-    
-    clear_errno();
-    return 0;
-}
-
 /**
  * Read an inode from disk
  */
@@ -105,13 +60,13 @@ int ext2_read_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode) {
     }
     
     /* Read the block containing the inode */
-    int ret = read_block(fs->device, inode_block, block_buffer, fs->block_size);
+    int ret = ext2_meta_read(fs, inode_block, block_buffer);
     if (ret != 0) {
         hal_uart_puts("ext2: Failed to read inode block ");
         hal_uart_put_uint32(inode_block);
         hal_uart_puts("\n");
         kfree(block_buffer);
-        /* errno already set by read_block */
+        /* errno already set by ext2_meta_read */
         return -1;
     }
     
@@ -178,13 +133,13 @@ int ext2_write_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode) {
     }
     
     /* Read the block containing the inode first */
-    int ret = read_block(fs->device, inode_block, block_buffer, fs->block_size);
+    int ret = ext2_meta_read(fs, inode_block, block_buffer);
     if (ret != 0) {
         hal_uart_puts("ext2: Failed to read inode block for write ");
         hal_uart_put_uint32(inode_block);
         hal_uart_puts("\n");
         kfree(block_buffer);
-        /* errno already set by read_block */
+        /* errno already set by ext2_meta_read */
         return -1;
     }
     
@@ -196,13 +151,13 @@ int ext2_write_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode) {
     }
     
     /* Write the block back to disk */
-    ret = write_block(fs->device, inode_block, block_buffer, fs->block_size);
+    ret = ext2_meta_write(fs, inode_block, block_buffer);
     if (ret != 0) {
         hal_uart_puts("ext2: Failed to write inode block ");
         hal_uart_put_uint32(inode_block);
         hal_uart_puts("\n");
         kfree(block_buffer);
-        /* errno already set by write_block */
+        /* errno already set by ext2_meta_write */
         return -1;
     }
     
@@ -211,3 +166,100 @@ int ext2_write_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode) {
     return 0;
 }
 
+/**
+ * Bucket of the in-core inode table holding an inode number
+ */
+static ext2_inode_info_t **icache_bucket(ext2_fs_t *fs, uint32_t inode_num) {
+    return &fs->icache[inode_num & (EXT2_ICACHE_BUCKETS - 1)];
+}
+
+/**
+ * Find the in-core inode for an inode number
+ */
+ext2_inode_info_t *ext2_icache_find(ext2_fs_t *fs, uint32_t inode_num) {
+    ext2_inode_info_t *info = *icache_bucket(fs, inode_num);
+    while (info && info->ino != inode_num) {
+        info = info->hash_next;
+    }
+    return info;
+}
+
+/**
+ * Get the in-core inode for an inode number
+ * Entries stay in the table while the inode has links, since VFS nodes
+ * handed out by lookup are not reference counted.
+ */
+ext2_inode_info_t *ext2_icache_get(ext2_fs_t *fs, uint32_t inode_num) {
+    ext2_inode_info_t *info = ext2_icache_find(fs, inode_num);
+    if (info) {
+        clear_errno();
+        return info;
+    }
+    
+    info = (ext2_inode_info_t *)kmalloc(sizeof(ext2_inode_info_t));
+    if (!info) {
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    kmemset(info, 0, sizeof(ext2_inode_info_t));
+    
+    if (ext2_read_inode(fs, inode_num, &info->inode) != 0) {
+        kfree(info);
+        /* errno already set by ext2_read_inode */
+        return NULL;
+    }
+    info->ino = inode_num;
+    
+    ext2_inode_info_t **bucket = icache_bucket(fs, inode_num);
+    info->hash_next = *bucket;
+    *bucket = info;
+    
+    clear_errno();
+    return info;
+}
+
+/**
+ * Take an in-core inode out of the table and free it
+ */
+void ext2_icache_remove(ext2_fs_t *fs, ext2_inode_info_t *info) {
+    ext2_inode_info_t **link = icache_bucket(fs, info->ino);
+    while (*link && *link != info) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = info->hash_next;
+    }
+    
+    ext2_delalloc_drop(info);
+    kfree(info);
+}
+
+/**
+ * Size of a file in bytes
+ * i_size_high is the directory ACL on directories, so only regular files
+ * use it.
+ */
+uint64_t ext2_inode_size(const ext2_inode_t *inode) {
+    if ((inode->i_mode & EXT2_S_IFMT) == EXT2_S_IFREG) {
+        return ((uint64_t)inode->i_size_high << 32) | inode->i_size;
+    }
+    return inode->i_size;
+}
+
+/**
+ * Set the size of a file
+ */
+void ext2_inode_set_size(ext2_fs_t *fs, ext2_inode_t *inode, uint64_t size) {
+    inode->i_size = (uint32_t)size;
+    if ((inode->i_mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+        return;
+    }
+    inode->i_size_high = (uint32_t)(size >> 32);
+    
+    /* Older drivers treat i_size as signed; the feature keeps them off */
+    if (size > 0x7FFFFFFFULL &&
+        !(fs->superblock->s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE)) {
+        fs->superblock->s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+        fs->super_dirty = 1;
+    }
+}
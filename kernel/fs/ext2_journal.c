@@ -0,0 +1,1293 @@
+/*
+ * ext2_journal.c - ext2 metadata journal (JBD format, as used by ext3)
+ *
+ * Metadata blocks written by filesystem operations are kept in memory as
+ * part of the running transaction instead of going to their home
+ * locations. Operations only ever end between transactions, so a
+ * transaction always holds whole operations.
+ *
+ * A commit writes the revoke records, descriptor blocks, block copies and
+ * commit block to the log as one sequential run and issues a single
+ * flush. The commit block carries a CRC32 of the transaction, so recovery
+ * ignores a transaction whose blocks did not all reach the disk.
+ *
+ * Committed blocks stay buffered and are only written in place when the
+ * log or the buffer pool runs low (checkpoint), so a block changed by many
+ * transactions reaches its home location once. At mount, committed
+ * transactions still in the log are replayed.
+ *
+ * Blocks freed by the running transaction are not reused until it
+ * commits: the allocator sees the block bitmaps as they were at the last
+ * commit. Otherwise a crash could leave a committed file pointing at
+ * blocks that already hold someone else's data.
+ */
+
+#include "../include/fs/ext2.h"
+#include "../include/drivers/virtio_blk.h"
+#include "../include/mm/kmalloc.h"
+#include "../include/hal/hal_uart.h"
+#include "../include/kernel/errno.h"
+#include "../include/kernel/kstring.h"
+#include "../include/kernel/process.h"
+#include <stddef.h>
+
+/* Buckets in the buffer hash table (power of two) */
+#define JOURNAL_HASH_BITS 8
+#define JOURNAL_HASH_SIZE (1 << JOURNAL_HASH_BITS)
+
+/* Log blocks gathered before a write request is sent */
+#define JOURNAL_WRITE_BATCH 64
+
+/* Recovery passes */
+#define PASS_SCAN   0  /* Find the end of the committed transactions */
+#define PASS_REVOKE 1  /* Collect revoke records */
+#define PASS_REPLAY 2  /* Write logged blocks in place */
+
+/**
+ * Buffered metadata block
+ * The block contents follow the header in the same allocation.
+ */
+typedef struct ext2_jbuf {
+    uint32_t block;                 /* Home location */
+    int running;                    /* Changed by the running transaction */
+    int logged;                     /* A committed copy is in the log */
+    uint8_t *committed;             /* Bitmap as of the last commit, if blocks were freed */
+    struct ext2_jbuf *hash_next;    /* Next buffer in the hash bucket */
+    struct ext2_jbuf *next;         /* All buffers, oldest first */
+    struct ext2_jbuf *prev;
+    uint8_t *data;                  /* Current contents */
+} ext2_jbuf_t;
+
+/**
+ * In-memory journal state
+ * Log positions are block numbers within the journal inode. The log
+ * holds the blocks from tail up to head, wrapping from maxlen to first.
+ */
+struct ext2_journal {
+    uint32_t *map;                  /* Journal block -> filesystem block */
+    uint32_t maxlen;                /* Journal size in blocks */
+    uint32_t first;                 /* First log block */
+    uint32_t head;                  /* Next log block to write */
+    uint32_t tail;                  /* Start of the oldest transaction in the log */
+    uint32_t sequence;              /* ID of the running transaction */
+    jbd_superblock_t *jsb;          /* Journal superblock (whole block) */
+    uint8_t *scratch;               /* One block for descriptors and recovery */
+    ext2_jbuf_t *hash[JOURNAL_HASH_SIZE];
+    ext2_jbuf_t *oldest;            /* List of all buffers */
+    ext2_jbuf_t *newest;
+    uint32_t nr_buffers;            /* Buffers in the list */
+    uint32_t nr_running;            /* Buffers changed by the running transaction */
+    uint32_t *revoked;              /* Blocks revoked by the running transaction */
+    uint32_t nr_revoked;
+    uint32_t revoke_capacity;
+    virtio_blk_discard_t discards[EXT2_JOURNAL_MAX_DISCARDS]; /* Waiting for commit */
+    uint32_t nr_discards;
+};
+
+/**
+ * Log blocks being gathered for one sequential write
+ */
+typedef struct {
+    ext2_fs_t *fs;
+    struct ext2_journal *journal;
+    uint8_t *stage;                 /* capacity blocks */
+    uint32_t capacity;
+    uint32_t count;                 /* Blocks gathered */
+    uint32_t start;                 /* Log block of stage[0] */
+    int error;                      /* A write failed */
+} log_writer_t;
+
+/**
+ * Revoke record seen during recovery
+ */
+typedef struct {
+    uint32_t block;                 /* Filesystem block */
+    uint32_t sequence;              /* Newest transaction that revoked it */
+} revoke_record_t;
+
+/**
+ * Revoke records collected during recovery
+ */
+typedef struct {
+    revoke_record_t *records;
+    uint32_t count;
+    uint32_t capacity;
+} revoke_table_t;
+
+static uint32_t crc_table[256];
+static int crc_table_ready = 0;
+
+/**
+ * Convert between CPU (little-endian) and on-disk (big-endian) order
+ */
+static uint32_t be32(uint32_t x) {
+    return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+}
+
+static uint16_t be16(uint16_t x) {
+    return (uint16_t)((x >> 8) | (x << 8));
+}
+
+/**
+ * Big-endian CRC32 (polynomial 0x04C11DB7), as used by JBD commit blocks
+ */
+static uint32_t crc32_be(uint32_t crc, const uint8_t *data, uint32_t len) {
+    if (!crc_table_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i << 24;
+            for (int bit = 0; bit < 8; bit++) {
+                c = (c & 0x80000000U) ? (c << 1) ^ 0x04C11DB7U : (c << 1);
+            }
+            crc_table[i] = c;
+        }
+        crc_table_ready = 1;
+    }
+    
+    while (len--) {
+        crc = (crc << 8) ^ crc_table[((crc >> 24) ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+/**
+ * Log block following block, wrapping at the end of the journal
+ */
+static uint32_t log_next(struct ext2_journal *j, uint32_t block) {
+    block++;
+    return block == j->maxlen ? j->first : block;
+}
+
+/**
+ * Log blocks that can be written without reaching the tail
+ * One block is kept free so a full log never looks empty.
+ */
+static uint32_t log_free(struct ext2_journal *j) {
+    uint32_t len = j->maxlen - j->first;
+    uint32_t used = (j->head + len - j->tail) % len;
+    return len - used - 1;
+}
+
+/**
+ * Location of the ext2 superblock within the filesystem blocks
+ */
+static void super_location(ext2_fs_t *fs, uint32_t *block, uint32_t *offset) {
+    *block = EXT2_SUPERBLOCK_OFFSET / fs->block_size;
+    *offset = EXT2_SUPERBLOCK_OFFSET % fs->block_size;
+}
+
+/**
+ * Number of blocks in the group descriptor table
+ */
+static uint32_t gdt_blocks(ext2_fs_t *fs) {
+    return (fs->num_groups + fs->desc_per_block - 1) / fs->desc_per_block;
+}
+
+static uint32_t hash_block(uint32_t block) {
+    return (block * 2654435761U) >> (32 - JOURNAL_HASH_BITS);
+}
+
+/**
+ * Find the buffer holding a block
+ */
+static ext2_jbuf_t *find_buffer(struct ext2_journal *j, uint32_t block) {
+    ext2_jbuf_t *buf = j->hash[hash_block(block)];
+    while (buf && buf->block != block) {
+        buf = buf->hash_next;
+    }
+    return buf;
+}
+
+/**
+ * Buffer a block with the given contents, or return its existing buffer
+ */
+static ext2_jbuf_t *get_buffer(ext2_fs_t *fs, uint32_t block, const void *contents) {
+    struct ext2_journal *j = fs->journal;
+    ext2_jbuf_t *buf = find_buffer(j, block);
+    if (buf) {
+        return buf;
+    }
+    
+    buf = (ext2_jbuf_t *)kmalloc(sizeof(ext2_jbuf_t) + fs->block_size);
+    if (!buf) {
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    
+    buf->block = block;
+    buf->running = 0;
+    buf->logged = 0;
+    buf->committed = NULL;
+    buf->data = (uint8_t *)(buf + 1);
+    kmemcpy(buf->data, contents, fs->block_size);
+    
+    uint32_t bucket = hash_block(block);
+    buf->hash_next = j->hash[bucket];
+    j->hash[bucket] = buf;
+    
+    buf->next = NULL;
+    buf->prev = j->newest;
+    if (j->newest) {
+        j->newest->next = buf;
+    } else {
+        j->oldest = buf;
+    }
+    j->newest = buf;
+    j->nr_buffers++;
+    
+    return buf;
+}
+
+/**
+ * Unlink a buffer from the journal and free it
+ */
+static void drop_buffer(struct ext2_journal *j, ext2_jbuf_t *buf) {
+    ext2_jbuf_t **link = &j->hash[hash_block(buf->block)];
+    while (*link != buf) {
+        link = &(*link)->hash_next;
+    }
+    *link = buf->hash_next;
+    
+    if (buf->prev) {
+        buf->prev->next = buf->next;
+    } else {
+        j->oldest = buf->next;
+    }
+    if (buf->next) {
+        buf->next->prev = buf->prev;
+    } else {
+        j->newest = buf->prev;
+    }
+    
+    if (buf->running) {
+        j->nr_running--;
+    }
+    j->nr_buffers--;
+    
+    kfree(buf->committed);
+    kfree(buf);
+}
+
+/**
+ * Remove a block from the running transaction's revoke list
+ * Needed when a freed block is reused as metadata before the commit:
+ * a revoke record would also cancel the new copy at replay.
+ */
+static void cancel_revoke(struct ext2_journal *j, uint32_t block) {
+    for (uint32_t i = 0; i < j->nr_revoked; i++) {
+        if (j->revoked[i] == block) {
+            j->revoked[i] = j->revoked[--j->nr_revoked];
+            return;
+        }
+    }
+}
+
+/**
+ * Read a metadata block
+ */
+int ext2_meta_read(ext2_fs_t *fs, uint32_t block_num, void *buffer) {
+    if (fs->journal) {
+        ext2_jbuf_t *buf = find_buffer(fs->journal, block_num);
+        if (buf) {
+            kmemcpy(buffer, buf->data, fs->block_size);
+            clear_errno();
+            return 0;
+        }
+    }
+    
+    /* errno set by ext2_read_blocks */
+    return ext2_read_blocks(fs, block_num, 1, buffer);
+}
+
+/**
+ * Write a metadata block
+ */
+int ext2_meta_write(ext2_fs_t *fs, uint32_t block_num, const void *buffer) {
+    struct ext2_journal *j = fs->journal;
+    if (!j) {
+        /* errno set by ext2_write_blocks */
+        return ext2_write_blocks(fs, block_num, 1, buffer);
+    }
+    
+    ext2_jbuf_t *buf = get_buffer(fs, block_num, buffer);
+    if (!buf) {
+        /* errno already set by get_buffer */
+        return -1;
+    }
+    
+    kmemcpy(buf->data, buffer, fs->block_size);
+    if (!buf->running) {
+        buf->running = 1;
+        j->nr_running++;
+        if (j->nr_revoked > 0) {
+            cancel_revoke(j, block_num);
+        }
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Replace blocks just read from disk with their journal copies
+ */
+void ext2_journal_overlay(ext2_fs_t *fs, uint32_t block_num, uint32_t count, void *buffer) {
+    struct ext2_journal *j = fs->journal;
+    if (!j || j->nr_buffers == 0) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        ext2_jbuf_t *buf = find_buffer(j, block_num + i);
+        if (buf) {
+            kmemcpy((uint8_t *)buffer + i * fs->block_size, buf->data, fs->block_size);
+        }
+    }
+}
+
+/**
+ * Drop a freed block from the journal
+ */
+void ext2_journal_forget(ext2_fs_t *fs, uint32_t block_num) {
+    struct ext2_journal *j = fs->journal;
+    if (!j) {
+        return;
+    }
+    
+    ext2_jbuf_t *buf = find_buffer(j, block_num);
+    if (!buf) {
+        return;
+    }
+    
+    /* An older copy in the log must not be replayed over the block's next use */
+    if (buf->logged) {
+        if (j->nr_revoked == j->revoke_capacity) {
+            uint32_t capacity = j->revoke_capacity ? j->revoke_capacity * 2 : 64;
+            uint32_t *grown = (uint32_t *)kmalloc(capacity * sizeof(uint32_t));
+            if (!grown) {
+                /* Keep the buffer; it is written back as a harmless stale copy */
+                return;
+            }
+            if (j->revoked) {
+                kmemcpy(grown, j->revoked, j->nr_revoked * sizeof(uint32_t));
+                kfree(j->revoked);
+            }
+            j->revoked = grown;
+            j->revoke_capacity = capacity;
+        }
+        j->revoked[j->nr_revoked++] = block_num;
+    }
+    
+    drop_buffer(j, buf);
+}
+
+/**
+ * Note that blocks are about to be freed in a block bitmap
+ * Saves the bitmap as of the last commit the first time the running
+ * transaction frees blocks from it.
+ */
+void ext2_journal_freeing(ext2_fs_t *fs, uint32_t bitmap_block, const uint8_t *bitmap) {
+    if (!fs->journal) {
+        return;
+    }
+    
+    ext2_jbuf_t *buf = get_buffer(fs, bitmap_block, bitmap);
+    if (!buf || buf->committed) {
+        return;
+    }
+    
+    buf->committed = (uint8_t *)kmalloc(fs->block_size);
+    if (buf->committed) {
+        kmemcpy(buf->committed, bitmap, fs->block_size);
+    }
+}
+
+/**
+ * Mark blocks freed by the running transaction as in use
+ * Returns 1 if bitmap was changed, 0 otherwise
+ */
+int ext2_journal_mask_freed(ext2_fs_t *fs, uint32_t bitmap_block, uint8_t *bitmap) {
+    if (!fs->journal) {
+        return 0;
+    }
+    
+    ext2_jbuf_t *buf = find_buffer(fs->journal, bitmap_block);
+    if (!buf || !buf->committed) {
+        return 0;
+    }
+    
+    for (uint32_t i = 0; i < fs->block_size; i++) {
+        bitmap[i] |= buf->committed[i];
+    }
+    return 1;
+}
+
+/**
+ * Send the discards held back for the last transaction
+ */
+static void send_discards(struct ext2_journal *j) {
+    if (j->nr_discards > 0) {
+        virtio_blk_discard(j->discards, j->nr_discards);
+        j->nr_discards = 0;
+    }
+}
+
+/**
+ * Discard freed blocks
+ * With a journal the discard waits for the commit, since until then a
+ * crash brings the blocks' old owner back. Discard is advisory, so ranges
+ * that do not fit are dropped.
+ */
+void ext2_discard(ext2_fs_t *fs, const virtio_blk_discard_t *ranges, uint32_t count) {
+    struct ext2_journal *j = fs->journal;
+    if (!j) {
+        virtio_blk_discard(ranges, count);
+        return;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (j->nr_discards > 0) {
+            virtio_blk_discard_t *last = &j->discards[j->nr_discards - 1];
+            if (last->sector + last->num_sectors == ranges[i].sector) {
+                last->num_sectors += ranges[i].num_sectors;
+                continue;
+            }
+        }
+        if (j->nr_discards == EXT2_JOURNAL_MAX_DISCARDS) {
+            return;
+        }
+        j->discards[j->nr_discards++] = ranges[i];
+    }
+}
+
+/**
+ * Write the superblock and group descriptors through the journal
+ */
+static int write_super(ext2_fs_t *fs) {
+    uint32_t sb_block, sb_offset;
+    super_location(fs, &sb_block, &sb_offset);
+    
+    uint8_t *block = (uint8_t *)kmalloc(fs->block_size);
+    if (!block) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    if (ext2_meta_read(fs, sb_block, block) != 0) {
+        kfree(block);
+        /* errno already set by ext2_meta_read */
+        return -1;
+    }
+    kmemcpy(block + sb_offset, fs->superblock, EXT2_SUPERBLOCK_SIZE);
+    
+    int ret = ext2_meta_write(fs, sb_block, block);
+    kfree(block);
+    if (ret != 0) {
+        /* errno already set by ext2_meta_write */
+        return -1;
+    }
+    
+    uint32_t gdt_block = fs->superblock->s_first_data_block + 1;
+    for (uint32_t i = 0; i < gdt_blocks(fs); i++) {
+        if (ext2_meta_write(fs, gdt_block + i,
+                            (uint8_t *)fs->group_desc + i * fs->block_size) != 0) {
+            /* errno already set by ext2_meta_write */
+            return -1;
+        }
+    }
+    
+    fs->super_dirty = 0;
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Write the journal superblock in place
+ */
+static int write_journal_super(ext2_fs_t *fs) {
+    struct ext2_journal *j = fs->journal;
+    /* errno set by ext2_write_blocks */
+    return ext2_write_blocks(fs, j->map[0], 1, j->jsb);
+}
+
+/**
+ * Record where the log starts (0 = clean) and flush
+ */
+static int set_log_start(ext2_fs_t *fs, uint32_t start) {
+    struct ext2_journal *j = fs->journal;
+    
+    j->jsb->s_start = be32(start);
+    j->jsb->s_sequence = be32(j->sequence);
+    if (write_journal_super(fs) != 0) {
+        /* errno already set by ext2_write_blocks */
+        return -1;
+    }
+    if (virtio_blk_flush() != 0) {
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Write every buffered block in place and empty the log
+ * Normally only committed blocks are buffered here. ext2_journal_op_end()
+ * keeps room in the log for the next operation, so a running transaction
+ * is written this way only when one operation alone is larger than that
+ * room; it then lacks the crash protection of a commit. With clean set the
+ * journal is marked as not needing recovery.
+ */
+static int checkpoint(ext2_fs_t *fs, int clean) {
+    struct ext2_journal *j = fs->journal;
+    
+    for (ext2_jbuf_t *buf = j->oldest; buf; buf = buf->next) {
+        if (ext2_write_blocks(fs, buf->block, 1, buf->data) != 0) {
+            /* errno already set by ext2_write_blocks */
+            return -1;
+        }
+    }
+    if (virtio_blk_flush() != 0) {
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    while (j->oldest) {
+        drop_buffer(j, j->oldest);
+    }
+    j->nr_revoked = 0;
+    
+    /* Nothing in the log is needed any more */
+    j->tail = j->head;
+    if (set_log_start(fs, clean ? 0 : j->head) != 0) {
+        /* errno already set by set_log_start */
+        return -1;
+    }
+    
+    send_discards(j);
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Send the gathered log blocks as one write request
+ */
+static void log_submit(log_writer_t *w) {
+    if (w->count == 0) {
+        return;
+    }
+    
+    if (ext2_write_blocks(w->fs, w->journal->map[w->start], w->count, w->stage) != 0) {
+        w->error = 1;
+    }
+    w->count = 0;
+}
+
+/**
+ * Take the next log block
+ * Returns where its contents go. Runs of log blocks that are contiguous
+ * on disk are gathered into one request.
+ */
+static uint8_t *log_slot(log_writer_t *w) {
+    struct ext2_journal *j = w->journal;
+    uint32_t block = j->head;
+    
+    if (w->count > 0 &&
+        (w->count == w->capacity || j->map[block] != j->map[w->start] + w->count)) {
+        log_submit(w);
+    }
+    if (w->count == 0) {
+        w->start = block;
+    }
+    
+    j->head = log_next(j, block);
+    return w->stage + (w->count++) * w->fs->block_size;
+}
+
+/**
+ * Check whether a block would be mistaken for a journal block
+ */
+static int needs_escape(const uint8_t *data) {
+    return data[0] == 0xC0 && data[1] == 0x3B && data[2] == 0x39 && data[3] == 0x98;
+}
+
+/**
+ * Fill in a journal block header
+ */
+static void set_header(void *block, uint32_t type, uint32_t sequence) {
+    jbd_header_t *header = (jbd_header_t *)block;
+    header->h_magic = be32(JBD_MAGIC);
+    header->h_blocktype = be32(type);
+    header->h_sequence = be32(sequence);
+}
+
+/**
+ * Log blocks needed to commit the running transaction
+ */
+static uint32_t commit_size(ext2_fs_t *fs) {
+    struct ext2_journal *j = fs->journal;
+    uint32_t bs = fs->block_size;
+    
+    /* The first tag of each descriptor is followed by the 16-byte UUID */
+    uint32_t tags_per_desc = (bs - sizeof(jbd_header_t) - 16) / sizeof(jbd_block_tag_t);
+    uint32_t revokes_per_block = (bs - sizeof(jbd_revoke_header_t)) / sizeof(uint32_t);
+    return (j->nr_revoked + revokes_per_block - 1) / revokes_per_block +
+           (j->nr_running + tags_per_desc - 1) / tags_per_desc +
+           j->nr_running + 1;
+}
+
+/**
+ * Commit the running transaction
+ */
+static int journal_commit(ext2_fs_t *fs) {
+    struct ext2_journal *j = fs->journal;
+    uint32_t bs = fs->block_size;
+    
+    if (fs->super_dirty && write_super(fs) != 0) {
+        /* errno already set by write_super */
+        return -1;
+    }
+    
+    if (j->nr_running == 0 && j->nr_revoked == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    uint32_t tags_per_desc = (bs - sizeof(jbd_header_t) - 16) / sizeof(jbd_block_tag_t);
+    uint32_t revokes_per_block = (bs - sizeof(jbd_revoke_header_t)) / sizeof(uint32_t);
+    uint32_t needed = commit_size(fs);
+    
+    if (needed > log_free(j)) {
+        hal_uart_puts("ext2: Operation too large for the journal, writing in place\n");
+        /* errno set by checkpoint */
+        return checkpoint(fs, 0);
+    }
+    
+    log_writer_t w;
+    w.fs = fs;
+    w.journal = j;
+    w.capacity = needed < JOURNAL_WRITE_BATCH ? needed : JOURNAL_WRITE_BATCH;
+    w.stage = (uint8_t *)kmalloc(w.capacity * bs);
+    if (!w.stage) {
+        /* Fall back to one block per request */
+        w.capacity = 1;
+        w.stage = (uint8_t *)kmalloc(bs);
+        if (!w.stage) {
+            RETURN_ERRNO(THUNDEROS_ENOMEM);
+        }
+    }
+    w.count = 0;
+    w.start = j->head;
+    w.error = 0;
+    
+    uint32_t old_head = j->head;
+    
+    /* Revoke records (not covered by the checksum) */
+    for (uint32_t done = 0; done < j->nr_revoked; ) {
+        uint8_t *slot = log_slot(&w);
+        kmemset(slot, 0, bs);
+        set_header(slot, JBD_REVOKE_BLOCK, j->sequence);
+        
+        uint32_t n = j->nr_revoked - done;
+        if (n > revokes_per_block) {
+            n = revokes_per_block;
+        }
+        uint32_t *records = (uint32_t *)(slot + sizeof(jbd_revoke_header_t));
+        for (uint32_t i = 0; i < n; i++) {
+            records[i] = be32(j->revoked[done + i]);
+        }
+        ((jbd_revoke_header_t *)slot)->r_count =
+            be32(sizeof(jbd_revoke_header_t) + n * sizeof(uint32_t));
+        done += n;
+    }
+    
+    /* Descriptor blocks, each followed by the blocks it describes */
+    uint32_t crc = 0xFFFFFFFFU;
+    ext2_jbuf_t *cursor = j->oldest;
+    uint32_t remaining = j->nr_running;
+    
+    while (remaining > 0) {
+        uint32_t n = remaining < tags_per_desc ? remaining : tags_per_desc;
+        uint8_t *desc = j->scratch;
+        uint32_t offset = sizeof(jbd_header_t);
+        
+        kmemset(desc, 0, bs);
+        set_header(desc, JBD_DESCRIPTOR_BLOCK, j->sequence);
+        
+        ext2_jbuf_t *buf = cursor;
+        for (uint32_t i = 0; i < n; i++, buf = buf->next) {
+            while (!buf->running) {
+                buf = buf->next;
+            }
+            
+            jbd_block_tag_t *tag = (jbd_block_tag_t *)(desc + offset);
+            uint16_t flags = 0;
+            if (i > 0) {
+                flags |= JBD_FLAG_SAME_UUID;
+            }
+            if (i == n - 1) {
+                flags |= JBD_FLAG_LAST_TAG;
+            }
+            if (needs_escape(buf->data)) {
+                flags |= JBD_FLAG_ESCAPE;
+            }
+            tag->t_blocknr = be32(buf->block);
+            tag->t_flags = be16(flags);
+            offset += sizeof(jbd_block_tag_t);
+            
+            if (i == 0) {
+                kmemcpy(desc + offset, j->jsb->s_uuid, 16);
+                offset += 16;
+            }
+        }
+        
+        crc = crc32_be(crc, desc, bs);
+        kmemcpy(log_slot(&w), desc, bs);
+        
+        buf = cursor;
+        for (uint32_t i = 0; i < n; i++, buf = buf->next) {
+            while (!buf->running) {
+                buf = buf->next;
+            }
+            
+            uint8_t *slot = log_slot(&w);
+            kmemcpy(slot, buf->data, bs);
+            if (needs_escape(slot)) {
+                kmemset(slot, 0, 4);
+            }
+            crc = crc32_be(crc, slot, bs);
+        }
+        
+        cursor = buf;
+        remaining -= n;
+    }
+    
+    /* The commit block goes out only once the rest is on the disk, so
+     * readers without async-commit support can trust it */
+    log_submit(&w);
+    if (w.error || virtio_blk_flush() != 0) {
+        kfree(w.stage);
+        j->head = old_head;
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    /* Commit block, checksummed so damage is still detected */
+    uint8_t *slot = log_slot(&w);
+    kmemset(slot, 0, bs);
+    set_header(slot, JBD_COMMIT_BLOCK, j->sequence);
+    jbd_commit_header_t *commit = (jbd_commit_header_t *)slot;
+    commit->h_chksum_type = JBD_CRC32_CHKSUM;
+    commit->h_chksum_size = JBD_CRC32_CHKSUM_SIZE;
+    commit->h_chksum[0] = be32(crc);
+    
+    log_submit(&w);
+    kfree(w.stage);
+    
+    if (w.error || virtio_blk_flush() != 0) {
+        /* The transaction stays in memory and is committed again later */
+        j->head = old_head;
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    for (ext2_jbuf_t *buf = j->oldest; buf; buf = buf->next) {
+        if (buf->running) {
+            buf->running = 0;
+            buf->logged = 1;
+        }
+        
+        /* Blocks freed by this transaction may be reused now */
+        if (buf->committed) {
+            kfree(buf->committed);
+            buf->committed = NULL;
+        }
+    }
+    j->nr_running = 0;
+    j->nr_revoked = 0;
+    j->sequence++;
+    send_discards(j);
+    
+    /* Checkpoint lazily, when the next transactions may not fit */
+    if (log_free(j) < (j->maxlen - j->first) / 4 || j->nr_buffers > EXT2_JOURNAL_MAX_BUFFERS) {
+        /* errno set by checkpoint */
+        return checkpoint(fs, 0);
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Make all completed operations durable
+ */
+int ext2_commit(ext2_fs_t *fs) {
+    if (fs->journal) {
+        /* errno set by journal_commit */
+        return journal_commit(fs);
+    }
+    
+    if (fs->super_dirty && write_super(fs) != 0) {
+        /* errno already set by write_super */
+        return -1;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Lock the filesystem and make all completed operations durable
+ */
+int ext2_sync(ext2_fs_t *fs) {
+    if (!fs) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_lock(fs);
+    int ret = ext2_commit(fs);
+    
+    /* Data blocks are written in place and may still be in the device cache */
+    if (ret == 0 && virtio_blk_flush() != 0) {
+        set_errno(THUNDEROS_EIO);
+        ret = -1;
+    }
+    ext2_unlock(fs);
+    
+    return ret;
+}
+
+/**
+ * Commit early when the running transaction has grown large
+ * Half the log is kept free beyond what the running transaction needs, so
+ * the next operation can always be committed. When less is left the
+ * transaction is committed, and the log checkpointed if that is not enough.
+ */
+void ext2_journal_op_end(ext2_fs_t *fs) {
+    struct ext2_journal *j = fs->journal;
+    if (!j) {
+        return;
+    }
+    
+    uint32_t reserve = (j->maxlen - j->first) / 2;
+    if (j->nr_running < EXT2_COMMIT_MAX_BLOCKS && commit_size(fs) + reserve <= log_free(j)) {
+        return;
+    }
+    
+    /* A failed commit is retried by the next one */
+    if (journal_commit(fs) == 0 && log_free(j) <= reserve) {
+        checkpoint(fs, 0);
+    }
+}
+
+/**
+ * Commit worker
+ * Bounds how much completed work a crash can lose.
+ */
+static void ext2_commit_worker(void *arg) {
+    ext2_fs_t *fs = (ext2_fs_t *)arg;
+    
+    while (1) {
+        process_sleep(EXT2_COMMIT_INTERVAL);
+        
+        ext2_lock(fs);
+        if (ext2_commit(fs) != 0) {
+            hal_uart_puts("ext2: Periodic commit failed\n");
+        }
+        ext2_unlock(fs);
+    }
+}
+
+/**
+ * Start the commit worker for a mounted filesystem
+ */
+void ext2_commit_start(ext2_fs_t *fs) {
+    if (!fs || fs->commit_worker) {
+        return;
+    }
+    
+    fs->commit_worker = process_create("ext2-commit", ext2_commit_worker, fs);
+}
+
+/**
+ * Look up a revoke record
+ * Returns 1 if block must not be replayed from transaction sequence
+ */
+static int is_revoked(revoke_table_t *table, uint32_t block, uint32_t sequence) {
+    for (uint32_t i = 0; i < table->count; i++) {
+        if (table->records[i].block == block) {
+            return (int32_t)(table->records[i].sequence - sequence) >= 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Add a revoke record, keeping the newest transaction per block
+ */
+static int add_revoke(revoke_table_t *table, uint32_t block, uint32_t sequence) {
+    for (uint32_t i = 0; i < table->count; i++) {
+        if (table->records[i].block == block) {
+            if ((int32_t)(sequence - table->records[i].sequence) > 0) {
+                table->records[i].sequence = sequence;
+            }
+            return 0;
+        }
+    }
+    
+    if (table->count == table->capacity) {
+        uint32_t capacity = table->capacity ? table->capacity * 2 : 64;
+        revoke_record_t *grown = (revoke_record_t *)kmalloc(capacity * sizeof(revoke_record_t));
+        if (!grown) {
+            RETURN_ERRNO(THUNDEROS_ENOMEM);
+        }
+        if (table->records) {
+            kmemcpy(grown, table->records, table->count * sizeof(revoke_record_t));
+            kfree(table->records);
+        }
+        table->records = grown;
+        table->capacity = capacity;
+    }
+    
+    table->records[table->count].block = block;
+    table->records[table->count].sequence = sequence;
+    table->count++;
+    return 0;
+}
+
+/**
+ * Read one log block during recovery
+ */
+static int read_log(ext2_fs_t *fs, struct ext2_journal *j, uint32_t block, void *buffer) {
+    /* errno set by ext2_read_blocks */
+    return ext2_read_blocks(fs, j->map[block], 1, buffer);
+}
+
+/**
+ * Walk the log from its start for one recovery pass
+ * PASS_SCAN stores the first transaction that is missing or incomplete
+ * in *end; the other passes stop there.
+ * Returns 0 on success, -1 on error
+ */
+static int recovery_pass(ext2_fs_t *fs, struct ext2_journal *j, int pass,
+                         uint32_t *end, revoke_table_t *revokes, uint8_t *data) {
+    uint32_t bs = fs->block_size;
+    uint8_t *buf = j->scratch;
+    uint32_t sequence = be32(j->jsb->s_sequence);
+    uint32_t block = be32(j->jsb->s_start);
+    int checksummed = (be32(j->jsb->s_feature_compat) & JBD_FEATURE_COMPAT_CHECKSUM) != 0;
+    uint32_t crc = 0xFFFFFFFFU;
+    
+    /* Each log block is visited at most once */
+    for (uint32_t visited = 0; visited < j->maxlen; visited++) {
+        if (pass != PASS_SCAN && sequence == *end) {
+            break;
+        }
+        
+        if (read_log(fs, j, block, buf) != 0) {
+            /* errno already set by ext2_read_blocks */
+            return -1;
+        }
+        
+        jbd_header_t *header = (jbd_header_t *)buf;
+        if (be32(header->h_magic) != JBD_MAGIC || be32(header->h_sequence) != sequence) {
+            break;
+        }
+        
+        uint32_t type = be32(header->h_blocktype);
+        block = log_next(j, block);
+        
+        if (type == JBD_DESCRIPTOR_BLOCK) {
+            if (pass == PASS_SCAN) {
+                crc = crc32_be(crc, buf, bs);
+            }
+            
+            uint32_t offset = sizeof(jbd_header_t);
+            while (offset + sizeof(jbd_block_tag_t) <= bs) {
+                jbd_block_tag_t *tag = (jbd_block_tag_t *)(buf + offset);
+                uint32_t target = be32(tag->t_blocknr);
+                uint16_t flags = be16(tag->t_flags);
+                uint32_t log_block = block;
+                block = log_next(j, block);
+                visited++;
+                
+                if (pass == PASS_SCAN && checksummed) {
+                    if (read_log(fs, j, log_block, data) != 0) {
+                        /* errno already set by ext2_read_blocks */
+                        return -1;
+                    }
+                    crc = crc32_be(crc, data, bs);
+                } else if (pass == PASS_REPLAY && !is_revoked(revokes, target, sequence)) {
+                    if (read_log(fs, j, log_block, data) != 0) {
+                        /* errno already set by ext2_read_blocks */
+                        return -1;
+                    }
+                    if (flags & JBD_FLAG_ESCAPE) {
+                        *(uint32_t *)data = be32(JBD_MAGIC);
+                    }
+                    if (ext2_write_blocks(fs, target, 1, data) != 0) {
+                        /* errno already set by ext2_write_blocks */
+                        return -1;
+                    }
+                }
+                
+                offset += sizeof(jbd_block_tag_t);
+                if (!(flags & JBD_FLAG_SAME_UUID)) {
+                    offset += 16;
+                }
+                if (flags & JBD_FLAG_LAST_TAG) {
+                    break;
+                }
+            }
+            continue;
+        }
+        
+        if (type == JBD_COMMIT_BLOCK) {
+            if (pass == PASS_SCAN && checksummed) {
+                jbd_commit_header_t *commit = (jbd_commit_header_t *)buf;
+                if (commit->h_chksum_type != JBD_CRC32_CHKSUM ||
+                    commit->h_chksum_size != JBD_CRC32_CHKSUM_SIZE ||
+                    be32(commit->h_chksum[0]) != crc) {
+                    /* Not all blocks of this transaction reached the disk */
+                    break;
+                }
+            }
+            crc = 0xFFFFFFFFU;
+            sequence++;
+            continue;
+        }
+        
+        if (type == JBD_REVOKE_BLOCK) {
+            if (pass == PASS_REVOKE) {
+                jbd_revoke_header_t *revoke = (jbd_revoke_header_t *)buf;
+                uint32_t used = be32(revoke->r_count);
+                if (used > bs) {
+                    used = bs;
+                }
+                for (uint32_t off = sizeof(jbd_revoke_header_t); off + 4 <= used; off += 4) {
+                    if (add_revoke(revokes, be32(*(uint32_t *)(buf + off)), sequence) != 0) {
+                        /* errno already set by add_revoke */
+                        return -1;
+                    }
+                }
+            }
+            continue;
+        }
+        
+        /* Unknown block type ends the log */
+        break;
+    }
+    
+    if (pass == PASS_SCAN) {
+        *end = sequence;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Reload the superblock and group descriptors after replay
+ */
+static int reload_super(ext2_fs_t *fs) {
+    uint32_t sb_block, sb_offset;
+    super_location(fs, &sb_block, &sb_offset);
+    
+    uint8_t *block = fs->journal->scratch;
+    if (ext2_read_blocks(fs, sb_block, 1, block) != 0) {
+        /* errno already set by ext2_read_blocks */
+        return -1;
+    }
+    kmemcpy(fs->superblock, block + sb_offset, EXT2_SUPERBLOCK_SIZE);
+    
+    /* errno set by ext2_read_blocks */
+    return ext2_read_blocks(fs, fs->superblock->s_first_data_block + 1, gdt_blocks(fs),
+                            fs->group_desc);
+}
+
+/**
+ * Replay committed transactions left in the log
+ * Returns 0 on success, -1 on error
+ */
+static int recover(ext2_fs_t *fs, struct ext2_journal *j) {
+    revoke_table_t revokes = { NULL, 0, 0 };
+    uint32_t end = 0;
+    int ret = -1;
+    
+    uint8_t *data = (uint8_t *)kmalloc(fs->block_size);
+    if (!data) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    if (recovery_pass(fs, j, PASS_SCAN, &end, &revokes, data) == 0 &&
+        recovery_pass(fs, j, PASS_REVOKE, &end, &revokes, data) == 0 &&
+        recovery_pass(fs, j, PASS_REPLAY, &end, &revokes, data) == 0) {
+        if (virtio_blk_flush() != 0) {
+            set_errno(THUNDEROS_EIO);
+        } else {
+            uint32_t replayed = end - be32(j->jsb->s_sequence);
+            if (replayed > 0) {
+                hal_uart_puts("ext2: Replayed ");
+                hal_uart_put_uint32(replayed);
+                hal_uart_puts(" journal transaction(s)\n");
+            }
+            
+            /* Old log blocks all carry lower IDs than the next transaction */
+            j->sequence = end + 1;
+            ret = reload_super(fs);
+        }
+    }
+    
+    kfree(revokes.records);
+    kfree(data);
+    return ret;
+}
+
+/**
+ * Free the in-memory journal
+ */
+static void journal_free(ext2_fs_t *fs) {
+    struct ext2_journal *j = fs->journal;
+    if (!j) {
+        return;
+    }
+    
+    while (j->oldest) {
+        drop_buffer(j, j->oldest);
+    }
+    kfree(j->revoked);
+    kfree(j->scratch);
+    kfree(j->jsb);
+    kfree(j->map);
+    kfree(j);
+    fs->journal = NULL;
+}
+
+/**
+ * Load the journal named by the superblock, replaying it if needed
+ */
+int ext2_journal_load(ext2_fs_t *fs) {
+    ext2_superblock_t *sb = fs->superblock;
+    int needs_recovery = (sb->s_feature_incompat & EXT3_FEATURE_INCOMPAT_RECOVER) != 0;
+    
+    fs->journal = NULL;
+    fs->super_dirty = 0;
+    
+    if (!(sb->s_feature_compat & EXT3_FEATURE_COMPAT_HAS_JOURNAL) || sb->s_journal_inum == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, sb->s_journal_inum, &inode) != 0) {
+        /* errno already set by ext2_read_inode */
+        return -1;
+    }
+    
+    struct ext2_journal *j = (struct ext2_journal *)kmalloc(sizeof(struct ext2_journal));
+    if (!j) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    kmemset(j, 0, sizeof(struct ext2_journal));
+    fs->journal = j;
+    
+    uint32_t nr_blocks = (uint32_t)(ext2_inode_size(&inode) / fs->block_size);
+    j->map = (uint32_t *)kmalloc(nr_blocks * sizeof(uint32_t));
+    j->jsb = (jbd_superblock_t *)kmalloc(fs->block_size);
+    j->scratch = (uint8_t *)kmalloc(fs->block_size);
+    if (nr_blocks < 2 || !j->map || !j->jsb || !j->scratch) {
+        journal_free(fs);
+        RETURN_ERRNO(nr_blocks < 2 ? THUNDEROS_EFS_INVAL : THUNDEROS_ENOMEM);
+    }
+    
+    for (uint32_t i = 0; i < nr_blocks; i++) {
+        j->map[i] = ext2_bmap(fs, &inode, i);
+        if (j->map[i] == 0) {
+            journal_free(fs);
+            RETURN_ERRNO(THUNDEROS_EFS_INVAL);
+        }
+    }
+    
+    if (ext2_read_blocks(fs, j->map[0], 1, j->jsb) != 0) {
+        journal_free(fs);
+        /* errno already set by ext2_read_blocks */
+        return -1;
+    }
+    
+    jbd_superblock_t *jsb = j->jsb;
+    j->maxlen = be32(jsb->s_maxlen);
+    j->first = be32(jsb->s_first);
+    if (be32(jsb->s_header.h_magic) != JBD_MAGIC ||
+        be32(jsb->s_blocksize) != fs->block_size ||
+        j->maxlen > nr_blocks || j->first == 0 || j->first + 1 >= j->maxlen) {
+        journal_free(fs);
+        RETURN_ERRNO(THUNDEROS_EFS_BADSUPER);
+    }
+    
+    /* Tags are read and written in the 32-bit format without checksums.
+     * Async-commit was set by older versions and is still replayed. */
+    uint32_t known = JBD_FEATURE_INCOMPAT_REVOKE | JBD_FEATURE_INCOMPAT_ASYNC_COMMIT;
+    if (be32(jsb->s_header.h_blocktype) != JBD_SUPERBLOCK_V2 ||
+        (be32(jsb->s_feature_incompat) & ~known) != 0) {
+        journal_free(fs);
+        if (needs_recovery) {
+            hal_uart_puts("ext2: Journal needs recovery but its format is not supported\n");
+            RETURN_ERRNO(THUNDEROS_EFS_INVAL);
+        }
+        hal_uart_puts("ext2: Journal format not supported, journaling disabled\n");
+        clear_errno();
+        return 0;
+    }
+    
+    if (jsb->s_start != 0) {
+        if (recover(fs, j) != 0) {
+            journal_free(fs);
+            /* errno already set by recover */
+            return -1;
+        }
+    } else {
+        j->sequence = be32(jsb->s_sequence) + 1;
+    }
+    
+    /* The log stays marked in use while mounted */
+    j->head = j->first;
+    j->tail = j->first;
+    jsb->s_feature_compat |= be32(JBD_FEATURE_COMPAT_CHECKSUM);
+    jsb->s_feature_incompat |= be32(JBD_FEATURE_INCOMPAT_REVOKE);
+    jsb->s_feature_incompat &= ~be32(JBD_FEATURE_INCOMPAT_ASYNC_COMMIT);
+    if (set_log_start(fs, j->first) != 0) {
+        journal_free(fs);
+        /* errno already set by set_log_start */
+        return -1;
+    }
+    
+    /* Written directly: the journal is not in use yet */
+    fs->journal = NULL;
+    sb->s_feature_incompat |= EXT3_FEATURE_INCOMPAT_RECOVER;
+    int ret = write_super(fs);
+    fs->journal = j;
+    if (ret != 0 || virtio_blk_flush() != 0) {
+        journal_free(fs);
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Commit, checkpoint and mark the journal clean
+ */
+void ext2_journal_destroy(ext2_fs_t *fs) {
+    struct ext2_journal *j = fs->journal;
+    if (!j) {
+        return;
+    }
+    
+    if (journal_commit(fs) != 0 || checkpoint(fs, 1) != 0) {
+        hal_uart_puts("ext2: Journal not emptied, it will be replayed at next mount\n");
+        journal_free(fs);
+        return;
+    }
+    
+    journal_free(fs);
+    fs->superblock->s_feature_incompat &= ~EXT3_FEATURE_INCOMPAT_RECOVER;
+    if (write_super(fs) != 0 || virtio_blk_flush() != 0) {
+        hal_uart_puts("ext2: Failed to mark the journal clean\n");
+    }
+}
@@ -34,6 +34,29 @@ static int read_block(void *device, uint32_t block_num, void *buffer, uint32_t b
     return 0;
 }
 
+/**
+ * Largest size a regular file can reach
+ * Bounded by the triple-indirect tree, and by i_blocks, which counts the
+ * 512-byte sectors of data and indirect blocks in 32 bits.
+ */
+static uint64_t max_file_size(ext2_fs_t *fs) {
+    uint64_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint64_t data = EXT2_NDIR_BLOCKS + ptrs_per_block + ptrs_per_block * ptrs_per_block +
+                    ptrs_per_block * ptrs_per_block * ptrs_per_block;
+    uint64_t meta = 3 + 2 * ptrs_per_block + ptrs_per_block * ptrs_per_block;
+    uint64_t limit = 0xFFFFFFFFULL / (fs->block_size / 512);
+    
+    if (data + meta > limit) {
+        data = limit - meta;
+    }
+    
+    /* Revision 0 has no feature flag to mark files of 2 GiB and more */
+    if (fs->superblock->s_rev_level == 0 && data * fs->block_size > 0x7FFFFFFFULL) {
+        return 0x7FFFFFFFULL;
+    }
+    return data * fs->block_size;
+}
+
 /**
  * Initialize and mount an ext2 filesystem
  */
@@ -46,6 +69,17 @@ int ext2_mount(ext2_fs_t *fs, void *device) {
     fs->device = device;
     fs->superblock = NULL;
     fs->group_desc = NULL;
+    fs->orlov_rotor = 0;
+    yield_lock_init(&fs->lock);
+    fs->reclaim_worker = NULL;
+    fs->reclaim_head = 0;
+    fs->reclaim_tail = 0;
+    fs->super_dirty = 0;
+    fs->journal = NULL;
+    fs->commit_worker = NULL;
+    for (uint32_t i = 0; i < EXT2_ICACHE_BUCKETS; i++) {
+        fs->icache[i] = NULL;
+    }
     
     /* Allocate buffer for superblock (1024 bytes) */
     fs->superblock = (ext2_superblock_t *)kmalloc(EXT2_SUPERBLOCK_SIZE);
@@ -110,6 +144,8 @@ int ext2_mount(ext2_fs_t *fs, void *device) {
     /* Calculate group descriptors per block */
     fs->desc_per_block = fs->block_size / sizeof(ext2_group_desc_t);
     
+    fs->max_file_size = max_file_size(fs);
+    
     /* Allocate buffer for group descriptors */
     uint32_t gdt_blocks = (fs->num_groups + fs->desc_per_block - 1) / fs->desc_per_block;
     uint32_t gdt_size = gdt_blocks * fs->block_size;
@@ -136,18 +172,48 @@ int ext2_mount(ext2_fs_t *fs, void *device) {
         }
     }
     
+    /* Replay an interrupted journal before anything reads the metadata */
+    if (ext2_journal_load(fs) != 0) {
+        kfree(fs->group_desc);
+        kfree(fs->superblock);
+        fs->group_desc = NULL;
+        fs->superblock = NULL;
+        /* errno already set by ext2_journal_load */
+        return -1;
+    }
+    
+    /* Files unlinked while open before a crash still hold their blocks */
+    if (fs->superblock->s_last_orphan != 0) {
+        ext2_lock(fs);
+        if (ext2_orphan_cleanup(fs) != 0) {
+            hal_uart_puts("ext2: Orphan list damaged, run e2fsck\n");
+        }
+        ext2_unlock(fs);
+    }
+    
     clear_errno();
     return 0;
 }
 
 /**
  * Unmount and clean up ext2 filesystem
+ * Completed operations are made durable first.
  */
 void ext2_unmount(ext2_fs_t *fs) {
     if (!fs) {
         return;
     }
     
+    if (fs->superblock) {
+        ext2_lock(fs);
+        if (fs->journal) {
+            ext2_journal_destroy(fs);
+        } else if (ext2_commit(fs) != 0 || virtio_blk_flush() != 0) {
+            hal_uart_puts("ext2: Failed to write back the superblock\n");
+        }
+        ext2_unlock(fs);
+    }
+    
     if (fs->group_desc) {
         kfree(fs->group_desc);
         fs->group_desc = NULL;
@@ -162,3 +228,19 @@ void ext2_unmount(ext2_fs_t *fs) {
     fs->num_groups = 0;
     fs->block_size = 0;
 }
+
+/**
+ * Acquire the filesystem lock
+ */
+void ext2_lock(ext2_fs_t *fs) {
+    yield_lock(&fs->lock);
+}
+
+/**
+ * Release the filesystem lock
+ * Operations end here, so this is where a large transaction is committed.
+ */
+void ext2_unlock(ext2_fs_t *fs) {
+    ext2_journal_op_end(fs);
+    yield_unlock(&fs->lock);
+}
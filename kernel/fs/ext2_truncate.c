@@ -0,0 +1,793 @@
+/*
+ * ext2_truncate.c - ext2 block release (truncate, unlink, rmdir)
+ *
+ * The block tree of an inode is walked once and every block to be freed
+ * is collected in a batch. The batch is sorted and applied per block
+ * group, so each group's bitmap is read and written once however many of
+ * its blocks are released, and the freed ranges are merged into a few
+ * discard requests. Deleted inodes holding many blocks are handed to a
+ * reclaim worker so unlink returns without waiting for the release.
+ *
+ * An inode unlinked while files still have it open keeps its blocks and
+ * stays usable through them. It goes on the ext3 orphan list (headed by
+ * s_last_orphan and linked through i_dtime) and is released by the last
+ * close, or at the next mount if the system stops first.
+ */
+
+#include "../include/fs/ext2.h"
+#include "../include/drivers/virtio_blk.h"
+#include "../include/mm/kmalloc.h"
+#include "../include/hal/hal_uart.h"
+#include "../include/kernel/errno.h"
+#include "../include/kernel/process.h"
+#include "../include/arch/interrupt.h"
+#include <stddef.h>
+
+/* Initial capacity of a free batch (grows as needed) */
+#define FREE_BATCH_INITIAL 128
+
+/* Discard ranges collected before a request is sent */
+#define DISCARD_BATCH VIRTIO_BLK_MAX_DISCARD_SEG
+
+/**
+ * Blocks collected for release
+ */
+typedef struct {
+    uint32_t *blocks;               /* Block numbers, unsorted until applied */
+    uint32_t count;                 /* Number of collected blocks */
+    uint32_t capacity;              /* Size of blocks[] */
+} free_batch_t;
+
+/**
+ * Restore the heap property below index root
+ */
+static void sift_down(uint32_t *a, uint32_t root, uint32_t count) {
+    while (2 * root + 1 < count) {
+        uint32_t child = 2 * root + 1;
+        if (child + 1 < count && a[child + 1] > a[child]) {
+            child++;
+        }
+        if (a[root] >= a[child]) {
+            return;
+        }
+        uint32_t tmp = a[root];
+        a[root] = a[child];
+        a[child] = tmp;
+        root = child;
+    }
+}
+
+/**
+ * Sort block numbers in place (heapsort, no recursion or extra memory)
+ */
+static void sort_blocks(uint32_t *a, uint32_t count) {
+    if (count < 2) {
+        return;
+    }
+    
+    for (uint32_t i = count / 2; i > 0; i--) {
+        sift_down(a, i - 1, count);
+    }
+    for (uint32_t end = count - 1; end > 0; end--) {
+        uint32_t tmp = a[0];
+        a[0] = a[end];
+        a[end] = tmp;
+        sift_down(a, 0, end);
+    }
+}
+
+/**
+ * Send collected discard ranges to the device
+ * Discard is advisory, so a failure only costs the hint. With a journal
+ * the ranges are held back until the freeing transaction commits.
+ */
+static void discard_flush(ext2_fs_t *fs, virtio_blk_discard_t *ranges, uint32_t *count) {
+    if (*count > 0) {
+        ext2_discard(fs, ranges, *count);
+        *count = 0;
+    }
+}
+
+/**
+ * Add a freed block to the pending discard ranges
+ */
+static void discard_add(ext2_fs_t *fs, virtio_blk_discard_t *ranges, uint32_t *count,
+                        uint32_t block) {
+    uint32_t spb = fs->block_size / 512;
+    uint64_t sector = (uint64_t)block * spb;
+    
+    if (*count > 0) {
+        virtio_blk_discard_t *last = &ranges[*count - 1];
+        if (last->sector + last->num_sectors == sector) {
+            last->num_sectors += spb;
+            return;
+        }
+    }
+    
+    if (*count == DISCARD_BATCH) {
+        discard_flush(fs, ranges, count);
+    }
+    
+    ranges[*count].sector = sector;
+    ranges[*count].num_sectors = spb;
+    ranges[*count].flags = 0;
+    (*count)++;
+}
+
+/**
+ * Release every block in the batch
+ * Blocks are sorted so each group's bitmap is updated in one
+ * read-modify-write, and contiguous blocks form one discard range.
+ */
+static int batch_apply(ext2_fs_t *fs, free_batch_t *batch) {
+    if (batch->count == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    sort_blocks(batch->blocks, batch->count);
+    
+    uint8_t *bitmap = (uint8_t *)kmalloc(fs->block_size);
+    if (!bitmap) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    uint32_t first_data_block = fs->superblock->s_first_data_block;
+    uint32_t blocks_per_group = fs->superblock->s_blocks_per_group;
+    virtio_blk_discard_t ranges[DISCARD_BATCH];
+    uint32_t nr_ranges = 0;
+    int error = 0;
+    uint32_t i = 0;
+    
+    while (i < batch->count) {
+        uint32_t block = batch->blocks[i];
+        uint32_t group = (block - first_data_block) / blocks_per_group;
+        
+        if (block < first_data_block || group >= fs->num_groups) {
+            error = THUNDEROS_EFS_BADBLK;
+            i++;
+            continue;
+        }
+        
+        ext2_group_desc_t *gd = &fs->group_desc[group];
+        uint32_t group_start = first_data_block + group * blocks_per_group;
+        uint32_t group_end = group_start + blocks_per_group;
+        
+        if (ext2_meta_read(fs, gd->bg_block_bitmap, bitmap) != 0) {
+            error = THUNDEROS_EIO;
+            while (i < batch->count && batch->blocks[i] < group_end) {
+                i++;
+            }
+            continue;
+        }
+        
+        /* Only blocks that were actually in use are counted as freed */
+        uint32_t freed = 0;
+        ext2_journal_freeing(fs, gd->bg_block_bitmap, bitmap);
+        while (i < batch->count && batch->blocks[i] < group_end) {
+            uint32_t offset = batch->blocks[i] - group_start;
+            uint8_t mask = (uint8_t)(1 << (offset % 8));
+            
+            if (bitmap[offset / 8] & mask) {
+                bitmap[offset / 8] &= ~mask;
+                freed++;
+                ext2_journal_forget(fs, batch->blocks[i]);
+                discard_add(fs, ranges, &nr_ranges, batch->blocks[i]);
+            }
+            i++;
+        }
+        
+        if (freed == 0) {
+            continue;
+        }
+        
+        if (ext2_meta_write(fs, gd->bg_block_bitmap, bitmap) != 0) {
+            error = THUNDEROS_EIO;
+            continue;
+        }
+        
+        gd->bg_free_blocks_count += freed;
+        fs->superblock->s_free_blocks_count += freed;
+        fs->super_dirty = 1;
+    }
+    
+    discard_flush(fs, ranges, &nr_ranges);
+    
+    kfree(bitmap);
+    batch->count = 0;
+    
+    if (error != 0) {
+        RETURN_ERRNO(error);
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Add a block to the batch, growing it or applying it early when full
+ */
+static int batch_add(ext2_fs_t *fs, free_batch_t *batch, uint32_t block) {
+    if (batch->count == batch->capacity) {
+        uint32_t new_capacity = batch->capacity ? batch->capacity * 2 : FREE_BATCH_INITIAL;
+        uint32_t *grown = (uint32_t *)kmalloc(new_capacity * sizeof(uint32_t));
+        
+        if (!grown) {
+            /* Out of memory: release what is collected so far to make room */
+            if (batch->count == 0) {
+                RETURN_ERRNO(THUNDEROS_ENOMEM);
+            }
+            if (batch_apply(fs, batch) != 0) {
+                /* errno already set by batch_apply */
+                return -1;
+            }
+        } else {
+            for (uint32_t i = 0; i < batch->count; i++) {
+                grown[i] = batch->blocks[i];
+            }
+            if (batch->blocks) {
+                kfree(batch->blocks);
+            }
+            batch->blocks = grown;
+            batch->capacity = new_capacity;
+        }
+    }
+    
+    batch->blocks[batch->count++] = block;
+    return 0;
+}
+
+/**
+ * Release the part of a block-pointer table that lies at or past from
+ *
+ * Each of the count entries in table points to a subtree of the given
+ * depth (0 = data block, 1 = indirect block, ...), covering span file
+ * blocks starting at base + i * span. Released pointers are zeroed and
+ * the blocks added to batch; *released counts them for i_blocks.
+ */
+static int truncate_table(ext2_fs_t *fs, uint32_t *table, uint32_t count, uint32_t depth,
+                          uint32_t base, uint32_t from, free_batch_t *batch,
+                          uint32_t *released) {
+    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint32_t span = 1;
+    for (uint32_t d = 0; d < depth; d++) {
+        span *= ptrs_per_block;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t first = base + i * span;
+        
+        if (table[i] == 0 || first + span <= from) {
+            continue;
+        }
+        
+        if (depth > 0) {
+            uint32_t *child = (uint32_t *)kmalloc(fs->block_size);
+            if (!child) {
+                RETURN_ERRNO(THUNDEROS_ENOMEM);
+            }
+            
+            if (ext2_meta_read(fs, table[i], child) != 0) {
+                kfree(child);
+                /* errno already set by ext2_meta_read */
+                return -1;
+            }
+            
+            if (truncate_table(fs, child, ptrs_per_block, depth - 1, first, from,
+                               batch, released) != 0) {
+                kfree(child);
+                /* errno already set by truncate_table */
+                return -1;
+            }
+            
+            /* A table that still maps blocks below from stays, minus the freed tail */
+            if (first < from) {
+                int ret = ext2_meta_write(fs, table[i], child);
+                kfree(child);
+                if (ret != 0) {
+                    /* errno already set by ext2_meta_write */
+                    return -1;
+                }
+                continue;
+            }
+            
+            kfree(child);
+        }
+        
+        if (batch_add(fs, batch, table[i]) != 0) {
+            /* errno already set by batch_add */
+            return -1;
+        }
+        table[i] = 0;
+        (*released)++;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Release all blocks of an inode from file block from onwards
+ * Updates i_block[] and i_blocks; the caller writes the inode.
+ */
+int ext2_truncate_blocks(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t from) {
+    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint32_t ind_base = EXT2_NDIR_BLOCKS;
+    uint32_t dind_base = ind_base + ptrs_per_block;
+    uint32_t tind_base = dind_base + ptrs_per_block * ptrs_per_block;
+    free_batch_t batch = { NULL, 0, 0 };
+    uint32_t released = 0;
+    uint32_t i_block[EXT2_N_BLOCKS];
+    int ret;
+    
+    /* The on-disk inode is packed; work on an aligned copy of the map */
+    for (uint32_t i = 0; i < EXT2_N_BLOCKS; i++) {
+        i_block[i] = inode->i_block[i];
+    }
+    
+    /* Walk the whole tree once, collecting blocks */
+    ret = truncate_table(fs, i_block, EXT2_NDIR_BLOCKS, 0, 0, from, &batch, &released);
+    if (ret == 0) {
+        ret = truncate_table(fs, &i_block[EXT2_IND_BLOCK], 1, 1, ind_base, from,
+                             &batch, &released);
+    }
+    if (ret == 0) {
+        ret = truncate_table(fs, &i_block[EXT2_DIND_BLOCK], 1, 2, dind_base, from,
+                             &batch, &released);
+    }
+    if (ret == 0) {
+        ret = truncate_table(fs, &i_block[EXT2_TIND_BLOCK], 1, 3, tind_base, from,
+                             &batch, &released);
+    }
+    
+    for (uint32_t i = 0; i < EXT2_N_BLOCKS; i++) {
+        inode->i_block[i] = i_block[i];
+    }
+    int error = (ret != 0) ? get_errno() : 0;
+    
+    /* Blocks already unhooked from the tree are released even after an error */
+    if (batch_apply(fs, &batch) != 0 && error == 0) {
+        error = get_errno();
+    }
+    if (batch.blocks) {
+        kfree(batch.blocks);
+    }
+    
+    uint32_t sectors = released * (fs->block_size / 512);
+    inode->i_blocks = (inode->i_blocks > sectors) ? inode->i_blocks - sectors : 0;
+    
+    if (error != 0) {
+        RETURN_ERRNO(error);
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Zero the on-disk bytes from size up to the end of its block
+ * Keeps stale data from reappearing if the file grows again.
+ */
+static int zero_block_tail(ext2_fs_t *fs, ext2_inode_t *inode, uint64_t size, uint64_t old_size) {
+    uint32_t block_offset = (uint32_t)(size % fs->block_size);
+    if (block_offset == 0 || ext2_bmap(fs, inode, (uint32_t)(size / fs->block_size)) == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    uint32_t len = fs->block_size - block_offset;
+    if (len > old_size - size) {
+        len = (uint32_t)(old_size - size);
+    }
+    
+    uint8_t *zeros = (uint8_t *)kmalloc(len);
+    if (!zeros) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        zeros[i] = 0;
+    }
+    
+    /* Stays inside the old size, so i_size is left alone */
+    int ret = ext2_write_file(fs, inode, size, zeros, len);
+    kfree(zeros);
+    if (ret < 0) {
+        /* errno already set by ext2_write_file */
+        return -1;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Change the size of a file, releasing blocks past the new end
+ */
+int ext2_truncate(ext2_fs_t *fs, ext2_inode_info_t *info, uint64_t size) {
+    if (!fs || !info) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_inode_t *inode = &info->inode;
+    uint64_t old_size = ext2_inode_size(inode);
+    
+    if ((inode->i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    if (size > fs->max_file_size) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    
+    /* Growing only moves i_size; the new range is a hole */
+    if (size >= old_size) {
+        if (size > old_size) {
+            ext2_inode_set_size(fs, inode, size);
+            info->dirty = 1;
+        }
+        clear_errno();
+        return 0;
+    }
+    
+    uint32_t keep_blocks = (uint32_t)((size + fs->block_size - 1) / fs->block_size);
+    
+    /* Drop buffered blocks past the end and zero the tail of the last one */
+    ext2_delalloc_t *da = &info->delalloc;
+    if (da->data) {
+        if (keep_blocks <= da->first_block) {
+            kfree(da->data);
+            da->data = NULL;
+            da->first_block = 0;
+            da->nr_blocks = 0;
+        } else {
+            if (da->first_block + da->nr_blocks > keep_blocks) {
+                da->nr_blocks = keep_blocks - da->first_block;
+            }
+            uint64_t run_start = (uint64_t)da->first_block * fs->block_size;
+            uint64_t run_end = run_start + (uint64_t)da->nr_blocks * fs->block_size;
+            for (uint64_t pos = size; pos < run_end; pos++) {
+                da->data[pos - run_start] = 0;
+            }
+        }
+    }
+    
+    if (zero_block_tail(fs, inode, size, old_size) != 0) {
+        /* errno already set by zero_block_tail */
+        return -1;
+    }
+    
+    ext2_inode_set_size(fs, inode, size);
+    info->dirty = 1;
+    
+    int error = 0;
+    if (ext2_truncate_blocks(fs, inode, keep_blocks) != 0) {
+        error = get_errno();
+    }
+    
+    /* The block map changed on disk, so the inode goes out now */
+    if (ext2_write_inode(fs, info->ino, inode) != 0) {
+        /* errno already set by ext2_write_inode */
+        return -1;
+    }
+    info->dirty = 0;
+    
+    if (error != 0) {
+        RETURN_ERRNO(error);
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Free every block of a deleted inode, then the inode itself
+ */
+static int free_inode_blocks(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode) {
+    int error = 0;
+    
+    if (ext2_truncate_blocks(fs, inode, 0) != 0) {
+        error = get_errno();
+    }
+    ext2_inode_set_size(fs, inode, 0);
+    
+    if (ext2_write_inode(fs, inode_num, inode) != 0 && error == 0) {
+        error = get_errno();
+    }
+    
+    /* Blocks that could not be released stay allocated; the inode is still freed */
+    if (ext2_free_inode(fs, inode_num) != 0 && error == 0) {
+        error = get_errno();
+    }
+    
+    if (error != 0) {
+        RETURN_ERRNO(error);
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Reclaim worker
+ * Releases queued inodes and sleeps while the queue is empty.
+ */
+static void ext2_reclaim_worker(void *arg) {
+    ext2_fs_t *fs = (ext2_fs_t *)arg;
+    
+    while (1) {
+        /* Queue check and sleep must not be split by a wakeup */
+        int irq_state = interrupt_save_disable();
+        if (fs->reclaim_head == fs->reclaim_tail) {
+            process_sleep(0);
+            interrupt_restore(irq_state);
+            continue;
+        }
+        interrupt_restore(irq_state);
+        
+        ext2_lock(fs);
+        
+        uint32_t inode_num = fs->reclaim_queue[fs->reclaim_head % EXT2_RECLAIM_QUEUE_LEN];
+        ext2_inode_t inode;
+        
+        /* Only inodes still marked deleted are released */
+        if (ext2_read_inode(fs, inode_num, &inode) == 0 && inode.i_links_count == 0 &&
+            inode.i_dtime != 0) {
+            if (free_inode_blocks(fs, inode_num, &inode) != 0) {
+                hal_uart_puts("ext2: Failed to release inode ");
+                hal_uart_put_uint32(inode_num);
+                hal_uart_puts("\n");
+            }
+        }
+        fs->reclaim_head++;
+        
+        ext2_unlock(fs);
+    }
+}
+
+/**
+ * Queue a deleted inode for the reclaim worker
+ * Returns 0 if queued, -1 if it has to be released inline
+ */
+static int reclaim_queue_inode(ext2_fs_t *fs, uint32_t inode_num) {
+    if (!fs->reclaim_worker ||
+        fs->reclaim_tail - fs->reclaim_head >= EXT2_RECLAIM_QUEUE_LEN) {
+        return -1;
+    }
+    
+    fs->reclaim_queue[fs->reclaim_tail % EXT2_RECLAIM_QUEUE_LEN] = inode_num;
+    __sync_synchronize();
+    fs->reclaim_tail++;
+    
+    process_wakeup(fs->reclaim_worker);
+    return 0;
+}
+
+/**
+ * Start the reclaim worker for a mounted filesystem
+ */
+void ext2_reclaim_start(ext2_fs_t *fs) {
+    if (!fs || fs->reclaim_worker) {
+        return;
+    }
+    
+    fs->reclaim_worker = process_create("ext2-reclaim", ext2_reclaim_worker, fs);
+}
+
+/**
+ * Release an inode whose link count has dropped to zero
+ */
+int ext2_release_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode) {
+    if (!fs || !inode || inode_num == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /*
+     * No wall clock yet, so the last superblock write time stands in.
+     * Values below s_inodes_count would read as an orphan list link.
+     */
+    inode->i_dtime = fs->superblock->s_wtime;
+    if (inode->i_dtime < fs->superblock->s_inodes_count) {
+        inode->i_dtime = fs->superblock->s_inodes_count;
+    }
+    
+    if ((inode->i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+        uint32_t group = (inode_num - 1) / fs->superblock->s_inodes_per_group;
+        if (group < fs->num_groups && fs->group_desc[group].bg_used_dirs_count > 0) {
+            fs->group_desc[group].bg_used_dirs_count--;
+            fs->super_dirty = 1;
+        }
+    }
+    
+    /* The deleted state is on disk before any block is released */
+    if (ext2_write_inode(fs, inode_num, inode) != 0) {
+        /* errno already set by ext2_write_inode */
+        return -1;
+    }
+    
+    uint32_t nr_blocks = inode->i_blocks / (fs->block_size / 512);
+    if (nr_blocks > EXT2_RECLAIM_MIN_BLOCKS && reclaim_queue_inode(fs, inode_num) == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    return free_inode_blocks(fs, inode_num, inode);
+}
+
+/**
+ * Next inode on the orphan list after inode_num
+ * The in-core copy is used when there is one, since it is the newer.
+ * Returns 0 at the end of the list or on error
+ */
+static uint32_t orphan_next(ext2_fs_t *fs, uint32_t inode_num) {
+    ext2_inode_info_t *info = ext2_icache_find(fs, inode_num);
+    if (info) {
+        return info->inode.i_dtime;
+    }
+    
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, inode_num, &inode) != 0) {
+        return 0;
+    }
+    return inode.i_dtime;
+}
+
+/**
+ * Point an orphan at a new next inode, on disk and in core
+ */
+static int orphan_set_next(ext2_fs_t *fs, uint32_t inode_num, uint32_t next) {
+    ext2_inode_info_t *info = ext2_icache_find(fs, inode_num);
+    if (info) {
+        info->inode.i_dtime = next;
+        if (ext2_write_inode(fs, inode_num, &info->inode) != 0) {
+            /* errno already set by ext2_write_inode */
+            return -1;
+        }
+        info->dirty = 0;
+        clear_errno();
+        return 0;
+    }
+    
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, inode_num, &inode) != 0) {
+        /* errno already set by ext2_read_inode */
+        return -1;
+    }
+    inode.i_dtime = next;
+    
+    /* errno set by ext2_write_inode */
+    return ext2_write_inode(fs, inode_num, &inode);
+}
+
+/**
+ * Drop the last link of an inode
+ */
+int ext2_unlink_inode(ext2_fs_t *fs, uint32_t inode_num, ext2_inode_t *inode) {
+    if (!fs || !inode || inode_num == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_inode_info_t *info = ext2_icache_find(fs, inode_num);
+    if (!info || info->opens == 0) {
+        if (info) {
+            ext2_icache_remove(fs, info);
+        }
+        /* errno set by ext2_release_inode */
+        return ext2_release_inode(fs, inode_num, inode);
+    }
+    
+    /*
+     * Still open: the inode number and blocks stay allocated, so nothing
+     * can reuse them before the last close.
+     */
+    info->inode.i_links_count = 0;
+    info->inode.i_dtime = fs->superblock->s_last_orphan;
+    info->deleted = 1;
+    fs->superblock->s_last_orphan = inode_num;
+    fs->super_dirty = 1;
+    
+    if (ext2_write_inode(fs, inode_num, &info->inode) != 0) {
+        /* errno already set by ext2_write_inode */
+        return -1;
+    }
+    info->dirty = 0;
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Release an orphan inode after its last open file is closed
+ */
+int ext2_orphan_release(ext2_fs_t *fs, ext2_inode_info_t *info) {
+    if (!fs || !info || !info->deleted) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    uint32_t inode_num = info->ino;
+    uint32_t next = info->inode.i_dtime;
+    
+    /* Off the list first, so a later mount cannot release it twice */
+    if (fs->superblock->s_last_orphan == inode_num) {
+        fs->superblock->s_last_orphan = next;
+        fs->super_dirty = 1;
+    } else {
+        uint32_t prev = fs->superblock->s_last_orphan;
+        uint32_t steps = 0;
+        
+        while (prev != 0 && steps++ < fs->superblock->s_inodes_count) {
+            uint32_t prev_next = orphan_next(fs, prev);
+            if (prev_next == inode_num) {
+                if (orphan_set_next(fs, prev, next) != 0) {
+                    /* errno already set by orphan_set_next */
+                    return -1;
+                }
+                break;
+            }
+            prev = prev_next;
+        }
+    }
+    
+    ext2_inode_t inode = info->inode;
+    ext2_icache_remove(fs, info);
+    
+    /* errno set by ext2_release_inode */
+    return ext2_release_inode(fs, inode_num, &inode);
+}
+
+/**
+ * Release the inodes left on the orphan list by an unclean shutdown
+ * The list head moves past each inode before it is released, so an
+ * interrupted cleanup resumes where it stopped.
+ */
+int ext2_orphan_cleanup(ext2_fs_t *fs) {
+    if (!fs) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    uint32_t inode_num = fs->superblock->s_last_orphan;
+    uint32_t released = 0;
+    int error = 0;
+    
+    while (inode_num != 0) {
+        /* A damaged list could point anywhere or loop */
+        if (inode_num > fs->superblock->s_inodes_count ||
+            released >= fs->superblock->s_inodes_count) {
+            error = THUNDEROS_EFS_BADINO;
+            break;
+        }
+        
+        ext2_inode_t inode;
+        if (ext2_read_inode(fs, inode_num, &inode) != 0) {
+            error = get_errno();
+            break;
+        }
+        
+        uint32_t next = inode.i_dtime;
+        fs->superblock->s_last_orphan = next;
+        fs->super_dirty = 1;
+        
+        if (inode.i_links_count == 0 && ext2_release_inode(fs, inode_num, &inode) != 0) {
+            error = get_errno();
+            break;
+        }
+        
+        released++;
+        inode_num = next;
+    }
+    
+    if (error != 0) {
+        /* What is left is e2fsck's job */
+        fs->superblock->s_last_orphan = 0;
+        fs->super_dirty = 1;
+        RETURN_ERRNO(error);
+    }
+    
+    if (released > 0) {
+        hal_uart_puts("ext2: Released ");
+        hal_uart_put_uint32(released);
+        hal_uart_puts(" orphan inodes\n");
+    }
+    
+    clear_errno();
+    return 0;
+}
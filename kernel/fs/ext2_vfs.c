@@ -10,27 +10,49 @@
 #include <stddef.h>
 
 /* Forward declarations for ext2 VFS operations */
-static int ext2_vfs_read(vfs_node_t *node, uint32_t offset, void *buffer, uint32_t size);
-static int ext2_vfs_write(vfs_node_t *node, uint32_t offset, const void *buffer, uint32_t size);
+static int ext2_vfs_read(vfs_node_t *node, uint64_t offset, void *buffer, uint32_t size);
+static int ext2_vfs_write(vfs_node_t *node, uint64_t offset, const void *buffer, uint32_t size);
+static int ext2_vfs_readv(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov, int iovcnt);
+static int ext2_vfs_writev(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov, int iovcnt);
+static int ext2_vfs_direct_io(vfs_node_t *node, uint64_t offset, void *buffer, uint32_t size,
+                              int write);
+static int ext2_vfs_copy_range(vfs_node_t *src, uint64_t src_offset,
+                               vfs_node_t *dst, uint64_t dst_offset, uint32_t len);
+static int ext2_vfs_open(vfs_node_t *node, uint32_t flags);
+static void ext2_vfs_close(vfs_node_t *node);
+static int ext2_vfs_flush(vfs_node_t *node);
 static vfs_node_t *ext2_vfs_lookup(vfs_node_t *dir, const char *name);
-static int ext2_vfs_readdir(vfs_node_t *dir, uint32_t index, char *name, uint32_t *inode);
+static int ext2_vfs_getdents(vfs_node_t *dir, uint64_t *cookie, void *buffer, uint32_t size);
 static int ext2_vfs_create(vfs_node_t *dir, const char *name, uint32_t mode);
 static int ext2_vfs_mkdir(vfs_node_t *dir, const char *name, uint32_t mode);
 static int ext2_vfs_unlink(vfs_node_t *dir, const char *name);
 static int ext2_vfs_rmdir(vfs_node_t *dir, const char *name);
+static int ext2_vfs_truncate(vfs_node_t *node, uint64_t size);
+static int ext2_vfs_fallocate(vfs_node_t *node, uint32_t mode, uint64_t offset, uint64_t len);
+static int ext2_vfs_sync(vfs_filesystem_t *fs);
+static int ext2_vfs_ioctl(vfs_node_t *node, uint32_t cmd, void *arg);
 
 /* ext2 VFS operations table */
 static vfs_ops_t ext2_vfs_ops = {
     .read = ext2_vfs_read,
     .write = ext2_vfs_write,
-    .open = NULL,   /* No special open handling needed */
-    .close = NULL,  /* No special close handling needed */
+    .readv = ext2_vfs_readv,
+    .writev = ext2_vfs_writev,
+    .direct_io = ext2_vfs_direct_io,
+    .open = ext2_vfs_open,
+    .close = ext2_vfs_close,
+    .flush = ext2_vfs_flush,
     .lookup = ext2_vfs_lookup,
-    .readdir = ext2_vfs_readdir,
+    .getdents = ext2_vfs_getdents,
     .create = ext2_vfs_create,
     .mkdir = ext2_vfs_mkdir,
     .unlink = ext2_vfs_unlink,
     .rmdir = ext2_vfs_rmdir,
+    .copy_range = ext2_vfs_copy_range,
+    .truncate = ext2_vfs_truncate,
+    .fallocate = ext2_vfs_fallocate,
+    .sync = ext2_vfs_sync,
+    .ioctl = ext2_vfs_ioctl,
 };
 
 /**
@@ -45,156 +67,534 @@ static void strcpy_safe(char *dst, const char *src, uint32_t max_len) {
     dst[i] = '\0';
 }
 
+/**
+ * Get the VFS node of an inode, setting it up the first time
+ * Every lookup of the inode returns the same node, so all opens share
+ * one in-core inode.
+ */
+static vfs_node_t *ext2_get_node(ext2_fs_t *ext2_fs, vfs_filesystem_t *vfs_fs,
+                                 uint32_t inode_num, const char *name) {
+    ext2_inode_info_t *info = ext2_icache_get(ext2_fs, inode_num);
+    if (!info) {
+        /* errno already set by ext2_icache_get */
+        return NULL;
+    }
+    
+    vfs_node_t *node = &info->node;
+    if (!node->ops) {
+        strcpy_safe(node->name, name, sizeof(node->name));
+        node->inode = inode_num;
+        node->size = ext2_inode_size(&info->inode);
+        node->type = ((info->inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR) ?
+                     VFS_TYPE_DIRECTORY : VFS_TYPE_FILE;
+        node->flags = 0;
+        node->fs = vfs_fs;
+        node->fs_data = info;
+        node->ops = &ext2_vfs_ops;
+    }
+    
+    return node;
+}
+
+/**
+ * Reload a directory's in-core inode after its entries changed on disk
+ * Preserves errno from the operation that changed the directory.
+ */
+static void ext2_refresh_dir(ext2_fs_t *ext2_fs, vfs_node_t *dir) {
+    ext2_inode_info_t *info = (ext2_inode_info_t *)dir->fs_data;
+    if (!info) {
+        return;
+    }
+    
+    int saved_errno = get_errno();
+    if (ext2_read_inode(ext2_fs, info->ino, &info->inode) == 0) {
+        dir->size = ext2_inode_size(&info->inode);
+    }
+    set_errno(saved_errno);
+}
+
 /**
  * Read from ext2 file via VFS
  */
-static int ext2_vfs_read(vfs_node_t *node, uint32_t offset, void *buffer, uint32_t size) {
+static int ext2_vfs_read(vfs_node_t *node, uint64_t offset, void *buffer, uint32_t size) {
     if (!node || !node->fs || !node->fs->fs_data || !node->fs_data) {
         set_errno(THUNDEROS_EINVAL);
         return -1;
     }
     
     ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
-    ext2_inode_t *inode = (ext2_inode_t *)node->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    
+    ext2_lock(ext2_fs);
+    int ret = ext2_delalloc_read(ext2_fs, info, offset, buffer, size);
+    ext2_unlock(ext2_fs);
     
-    return ext2_read_file(ext2_fs, inode, offset, buffer, size);
+    return ret;
 }
 
 /**
  * Write to ext2 file via VFS
  */
-static int ext2_vfs_write(vfs_node_t *node, uint32_t offset, const void *buffer, uint32_t size) {
+static int ext2_vfs_write(vfs_node_t *node, uint64_t offset, const void *buffer, uint32_t size) {
     if (!node || !node->fs || !node->fs->fs_data || !node->fs_data) {
         set_errno(THUNDEROS_EINVAL);
         return -1;
     }
     
     ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
-    ext2_inode_t *inode = (ext2_inode_t *)node->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
     
-    return ext2_write_file(ext2_fs, inode, offset, buffer, size);
+    /* Blocks for new data are allocated at write-back (see ext2_delalloc.c) */
+    ext2_lock(ext2_fs);
+    int ret = ext2_delalloc_write(ext2_fs, info, offset, buffer, size);
+    ext2_unlock(ext2_fs);
+    
+    return ret;
 }
 
 /**
- * Lookup file in ext2 directory via VFS
+ * Transfer whole blocks of an ext2 file straight to or from user memory
  */
-static vfs_node_t *ext2_vfs_lookup(vfs_node_t *dir, const char *name) {
-    if (!dir || !dir->fs || !dir->fs->fs_data || !dir->fs_data) {
+static int ext2_vfs_direct_io(vfs_node_t *node, uint64_t offset, void *buffer, uint32_t size,
+                              int write) {
+    if (!node || !node->fs || !node->fs->fs_data || !node->fs_data) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    
+    ext2_lock(ext2_fs);
+    int ret = ext2_direct_io(ext2_fs, info, offset, buffer, size, write);
+    ext2_unlock(ext2_fs);
+    
+    return ret;
+}
+
+/**
+ * Sum of buffer lengths (the VFS has already bounded it)
+ */
+static uint32_t iov_length(const vfs_iovec_t *iov, int iovcnt) {
+    uint32_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += (uint32_t)iov[i].iov_len;
+    }
+    return total;
+}
+
+/**
+ * Read into a buffer list via VFS
+ * The range is read as one span, a cluster at a time, and scattered into
+ * the buffers, so small buffers do not each cost a block request.
+ */
+static int ext2_vfs_readv(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov, int iovcnt) {
+    if (!node || !node->fs || !node->fs->fs_data || !node->fs_data || !iov) {
         set_errno(THUNDEROS_EINVAL);
-        return NULL;
+        return -1;
     }
     
-    ext2_fs_t *ext2_fs = (ext2_fs_t *)dir->fs->fs_data;
-    ext2_inode_t *dir_inode = (ext2_inode_t *)dir->fs_data;
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    uint32_t total = iov_length(iov, iovcnt);
     
-    /* Lookup inode number */
-    uint32_t inode_num = ext2_lookup(ext2_fs, dir_inode, name);
-    if (inode_num == 0) {
-        set_errno(THUNDEROS_ENOENT);
-        return NULL;
+    if (iovcnt == 1) {
+        return ext2_vfs_read(node, offset, iov[0].iov_base, total);
+    }
+    if (total == 0) {
+        clear_errno();
+        return 0;
     }
     
-    /* Allocate and read inode */
-    ext2_inode_t *inode = (ext2_inode_t *)kmalloc(sizeof(ext2_inode_t));
-    if (!inode) {
+    uint32_t chunk_max = EXT2_READ_CLUSTER_BLOCKS * ext2_fs->block_size;
+    if (chunk_max > total) {
+        chunk_max = total;
+    }
+    uint8_t *bounce = (uint8_t *)kmalloc(chunk_max);
+    if (!bounce) {
         set_errno(THUNDEROS_ENOMEM);
-        return NULL;
+        return -1;
     }
     
-    if (ext2_read_inode(ext2_fs, inode_num, inode) != 0) {
-        kfree(inode);
-        /* errno already set by ext2_read_inode */
-        return NULL;
-    }
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, iov, iovcnt);
+    int done = 0;
     
-    /* Create VFS node */
-    vfs_node_t *node = (vfs_node_t *)kmalloc(sizeof(vfs_node_t));
-    if (!node) {
-        kfree(inode);
-        return NULL;
+    ext2_lock(ext2_fs);
+    while ((uint32_t)done < total) {
+        uint32_t chunk = total - done;
+        if (chunk > chunk_max) {
+            chunk = chunk_max;
+        }
+        
+        int ret = ext2_delalloc_read(ext2_fs, info, offset + done, bounce, chunk);
+        if (ret < 0) {
+            /* errno already set by ext2_delalloc_read */
+            if (done == 0) {
+                done = -1;
+            }
+            break;
+        }
+        
+        vfs_iov_copy_to(&iter, bounce, (uint32_t)ret);
+        done += ret;
+        
+        /* End of file */
+        if ((uint32_t)ret < chunk) {
+            break;
+        }
     }
+    ext2_unlock(ext2_fs);
     
-    strcpy_safe(node->name, name, sizeof(node->name));
-    node->inode = inode_num;
-    node->size = inode->i_size;
-    node->type = ((inode->i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR) ? 
-                 VFS_TYPE_DIRECTORY : VFS_TYPE_FILE;
-    node->flags = 0;
-    node->fs = dir->fs;
-    node->fs_data = inode;
-    node->ops = &ext2_vfs_ops;
-    
-    return node;
+    kfree(bounce);
+    return done;
 }
 
 /**
- * Read directory entry by index via VFS
- * 
- * @param directory VFS directory node
- * @param entry_index Index of directory entry to read
- * @param entry_name Buffer to store entry name
- * @param entry_inode Pointer to store entry inode number
- * @return 0 on success, -1 on error
+ * Write a buffer list via VFS
+ * The buffers are gathered into one span, so the data lands in the file
+ * as if written by a single write call.
  */
-static int ext2_vfs_readdir(vfs_node_t *directory, uint32_t entry_index, char *entry_name, uint32_t *entry_inode) {
-    if (!directory || !directory->fs || !directory->fs->fs_data || !directory->fs_data || !entry_name || !entry_inode) {
+static int ext2_vfs_writev(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov, int iovcnt) {
+    if (!node || !node->fs || !node->fs->fs_data || !node->fs_data || !iov) {
+        set_errno(THUNDEROS_EINVAL);
         return -1;
     }
     
-    ext2_fs_t *ext2_filesystem = (ext2_fs_t *)directory->fs->fs_data;
-    ext2_inode_t *directory_inode = (ext2_inode_t *)directory->fs_data;
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    uint32_t total = iov_length(iov, iovcnt);
     
-    /* Verify this is a directory */
-    if ((directory_inode->i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+    if (iovcnt == 1) {
+        return ext2_vfs_write(node, offset, iov[0].iov_base, total);
+    }
+    if (total == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    uint32_t chunk_max = EXT2_DELALLOC_MAX_BLOCKS * ext2_fs->block_size;
+    if (chunk_max > total) {
+        chunk_max = total;
+    }
+    uint8_t *bounce = (uint8_t *)kmalloc(chunk_max);
+    if (!bounce) {
+        set_errno(THUNDEROS_ENOMEM);
         return -1;
     }
     
-    /* Allocate buffer for directory data */
-    uint8_t *directory_buffer = (uint8_t *)kmalloc(directory_inode->i_size);
-    if (!directory_buffer) {
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, iov, iovcnt);
+    int done = 0;
+    
+    /* Blocks for new data are allocated at write-back (see ext2_delalloc.c) */
+    ext2_lock(ext2_fs);
+    while ((uint32_t)done < total) {
+        uint32_t chunk = vfs_iov_copy_from(&iter, bounce, chunk_max);
+        
+        int ret = ext2_delalloc_write(ext2_fs, info, offset + done, bounce, chunk);
+        if (ret < 0) {
+            /* errno already set by ext2_delalloc_write */
+            if (done == 0) {
+                done = -1;
+            }
+            break;
+        }
+        done += ret;
+    }
+    ext2_unlock(ext2_fs);
+    
+    kfree(bounce);
+    return done;
+}
+
+/**
+ * Check whether a buffer holds only zero bytes
+ */
+static int is_zero(const uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (data[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Copy a byte range between two ext2 files via VFS
+ * Data moves a cluster at a time through one kernel buffer under a single
+ * hold of the filesystem lock. Zero chunks landing past the end of the
+ * destination are not written, so holes in the source stay holes.
+ */
+static int ext2_vfs_copy_range(vfs_node_t *src, uint64_t src_offset,
+                               vfs_node_t *dst, uint64_t dst_offset, uint32_t len) {
+    if (!src || !src->fs || !src->fs->fs_data || !src->fs_data || !dst || !dst->fs_data) {
+        set_errno(THUNDEROS_EINVAL);
         return -1;
     }
     
-    /* Read directory contents */
-    int read_result = ext2_read_file(ext2_filesystem, directory_inode, 0, directory_buffer, directory_inode->i_size);
-    if (read_result < 0) {
-        kfree(directory_buffer);
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)src->fs->fs_data;
+    ext2_inode_info_t *src_info = (ext2_inode_info_t *)src->fs_data;
+    ext2_inode_info_t *dst_info = (ext2_inode_info_t *)dst->fs_data;
+    
+    /* Skipped zero chunks still grow the file, so bound the range up front */
+    if (dst_offset >= ext2_fs->max_file_size) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    if (len > ext2_fs->max_file_size - dst_offset) {
+        len = (uint32_t)(ext2_fs->max_file_size - dst_offset);
+    }
+    
+    uint32_t chunk_max = EXT2_DELALLOC_MAX_BLOCKS * ext2_fs->block_size;
+    if (chunk_max > len) {
+        chunk_max = len;
+    }
+    uint8_t *buffer = (uint8_t *)kmalloc(chunk_max);
+    if (!buffer) {
+        set_errno(THUNDEROS_ENOMEM);
         return -1;
     }
     
-    /* Find the entry at the requested index */
-    uint32_t buffer_offset = 0;
-    uint32_t current_index = 0;
-    int entry_found = 0;
+    int done = 0;
     
-    while (buffer_offset < directory_inode->i_size) {
-        ext2_dirent_t *directory_entry = (ext2_dirent_t *)(directory_buffer + buffer_offset);
+    ext2_lock(ext2_fs);
+    while ((uint32_t)done < len) {
+        uint32_t chunk = len - done;
+        if (chunk > chunk_max) {
+            chunk = chunk_max;
+        }
         
-        /* Check for invalid entry */
-        if (directory_entry->rec_len == 0) {
+        int got = ext2_delalloc_read(ext2_fs, src_info, src_offset + done, buffer, chunk);
+        if (got <= 0) {
+            /* errno already set by ext2_delalloc_read */
+            if (got < 0 && done == 0) {
+                done = -1;
+            }
             break;
         }
         
-        /* Count only valid entries */
-        if (directory_entry->inode != 0) {
-            if (current_index == entry_index) {
-                /* Found the requested entry - copy name and null-terminate */
-                for (uint32_t char_index = 0; char_index < directory_entry->name_len && char_index < 255; char_index++) {
-                    entry_name[char_index] = directory_entry->name[char_index];
+        uint64_t pos = dst_offset + done;
+        if (pos < ext2_inode_size(&dst_info->inode) || !is_zero(buffer, (uint32_t)got)) {
+            if (ext2_delalloc_write(ext2_fs, dst_info, pos, buffer, (uint32_t)got) < 0) {
+                /* errno already set by ext2_delalloc_write */
+                if (done == 0) {
+                    done = -1;
                 }
-                entry_name[directory_entry->name_len] = '\0';
-                *entry_inode = directory_entry->inode;
-                entry_found = 1;
                 break;
             }
-            current_index++;
         }
+        done += got;
         
-        buffer_offset += directory_entry->rec_len;
+        /* End of the source file */
+        if ((uint32_t)got < chunk) {
+            break;
+        }
+    }
+    
+    /* Skipped zero chunks at the end still count towards the size */
+    if (done > 0 && dst_offset + (uint32_t)done > ext2_inode_size(&dst_info->inode)) {
+        ext2_inode_set_size(ext2_fs, &dst_info->inode, dst_offset + (uint32_t)done);
+        dst_info->dirty = 1;
     }
+    ext2_unlock(ext2_fs);
     
-    kfree(directory_buffer);
-    return entry_found ? 0 : -1;
+    kfree(buffer);
+    return done;
+}
+
+/**
+ * Open ext2 file via VFS
+ */
+static int ext2_vfs_open(vfs_node_t *node, uint32_t flags) {
+    (void)flags;
+    
+    if (!node || !node->fs || !node->fs->fs_data || !node->fs_data) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    
+    ext2_lock(ext2_fs);
+    info->opens++;
+    ext2_unlock(ext2_fs);
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Write back buffered data and the inode via VFS (close and fsync)
+ */
+static int ext2_vfs_flush(vfs_node_t *node) {
+    if (!node || !node->fs || !node->fs->fs_data || !node->fs_data) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    
+    ext2_lock(ext2_fs);
+    int ret = ext2_delalloc_flush(ext2_fs, info);
+    ext2_unlock(ext2_fs);
+    
+    /* errno set by ext2_delalloc_flush */
+    return ret;
+}
+
+/**
+ * Close ext2 file via VFS
+ * The last close writes back buffered data and the inode. Data that still
+ * cannot be written is dropped then; close() or fsync() has reported it.
+ * A file unlinked while open is released instead.
+ */
+static void ext2_vfs_close(vfs_node_t *node) {
+    if (!node || !node->fs || !node->fs->fs_data || !node->fs_data) {
+        return;
+    }
+    
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    
+    ext2_lock(ext2_fs);
+    if (info->opens > 0) {
+        info->opens--;
+    }
+    if (info->opens == 0) {
+        if (info->deleted) {
+            if (ext2_orphan_release(ext2_fs, info) != 0) {
+                hal_uart_puts("ext2: Failed to release orphan inode\n");
+            }
+        } else if (ext2_delalloc_flush(ext2_fs, info) != 0) {
+            hal_uart_puts("ext2: Write-back failed for inode ");
+            hal_uart_put_uint32(info->ino);
+            hal_uart_puts("\n");
+            ext2_delalloc_drop(info);
+        }
+    }
+    ext2_unlock(ext2_fs);
+}
+
+/**
+ * Lookup file in ext2 directory via VFS
+ */
+static vfs_node_t *ext2_vfs_lookup(vfs_node_t *dir, const char *name) {
+    if (!dir || !dir->fs || !dir->fs->fs_data || !dir->fs_data) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)dir->fs->fs_data;
+    ext2_inode_t *dir_inode = &((ext2_inode_info_t *)dir->fs_data)->inode;
+    
+    /* Lookup inode number and find its in-core inode */
+    ext2_lock(ext2_fs);
+    uint32_t inode_num = ext2_lookup(ext2_fs, dir_inode, name);
+    vfs_node_t *node = NULL;
+    if (inode_num != 0) {
+        node = ext2_get_node(ext2_fs, dir->fs, inode_num, name);
+    }
+    ext2_unlock(ext2_fs);
+    
+    if (inode_num == 0) {
+        set_errno(THUNDEROS_ENOENT);
+        return NULL;
+    }
+    
+    /* errno set by ext2_get_node */
+    return node;
+}
+
+/**
+ * Packing state for ext2_vfs_getdents
+ */
+typedef struct {
+    uint8_t *buffer;
+    uint32_t size;
+    uint32_t used;
+} getdents_ctx_t;
+
+/**
+ * Append one entry to the getdents buffer
+ * Returns non-zero when the entry does not fit.
+ */
+static int getdents_fill(void *ctx, const char *name, uint32_t name_len,
+                         uint32_t inode, uint8_t type) {
+    getdents_ctx_t *out = (getdents_ctx_t *)ctx;
+    uint32_t reclen = (offsetof(vfs_dirent_t, d_name) + name_len + 1 + 7) & ~7U;
+    
+    if (out->used + reclen > out->size) {
+        return 1;
+    }
+    
+    vfs_dirent_t *dirent = (vfs_dirent_t *)(out->buffer + out->used);
+    dirent->d_ino = inode;
+    dirent->d_reclen = (uint16_t)reclen;
+    switch (type) {
+        case EXT2_FT_REG_FILE:
+            dirent->d_type = VFS_TYPE_FILE;
+            break;
+        case EXT2_FT_DIR:
+            dirent->d_type = VFS_TYPE_DIRECTORY;
+            break;
+        default:
+            dirent->d_type = 0;
+            break;
+    }
+    for (uint32_t i = 0; i < name_len; i++) {
+        dirent->d_name[i] = name[i];
+    }
+    dirent->d_name[name_len] = '\0';
+    
+    out->used += reclen;
+    return 0;
+}
+
+/**
+ * Read packed directory entries from an ext2 directory via VFS
+ * 
+ * @param directory VFS directory node
+ * @param cookie Byte offset in the directory to resume from; advanced
+ * @param buffer Buffer to store vfs_dirent_t records
+ * @param size Size of buffer in bytes
+ * @return Bytes stored, 0 at end of directory, -1 on error
+ */
+static int ext2_vfs_getdents(vfs_node_t *directory, uint64_t *cookie, void *buffer, uint32_t size) {
+    if (!directory || !directory->fs || !directory->fs->fs_data || !directory->fs_data ||
+        !cookie || !buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_fs_t *ext2_filesystem = (ext2_fs_t *)directory->fs->fs_data;
+    ext2_inode_t *directory_inode = &((ext2_inode_info_t *)directory->fs_data)->inode;
+    
+    if (*cookie >= directory_inode->i_size) {
+        clear_errno();
+        return 0;
+    }
+    
+    getdents_ctx_t ctx;
+    ctx.buffer = (uint8_t *)buffer;
+    ctx.size = size;
+    ctx.used = 0;
+    
+    uint32_t offset = (uint32_t)*cookie;
+    
+    ext2_lock(ext2_filesystem);
+    int result = ext2_read_dir(ext2_filesystem, directory_inode, &offset, getdents_fill, &ctx);
+    ext2_unlock(ext2_filesystem);
+    if (result != 0) {
+        /* errno already set by ext2_read_dir */
+        return -1;
+    }
+    
+    /* The buffer cannot hold even the next entry */
+    if (ctx.used == 0 && offset < directory_inode->i_size) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    *cookie = offset;
+    clear_errno();
+    return (int)ctx.used;
 }
 
 /**
@@ -208,7 +608,11 @@ static int ext2_vfs_create(vfs_node_t *dir, const char *name, uint32_t mode) {
     ext2_fs_t *ext2_fs = (ext2_fs_t *)dir->fs->fs_data;
     uint32_t dir_inode_num = dir->inode;
     
+    ext2_lock(ext2_fs);
     uint32_t new_inode = ext2_create_file(ext2_fs, dir_inode_num, name, mode);
+    ext2_refresh_dir(ext2_fs, dir);
+    ext2_unlock(ext2_fs);
+    
     return (new_inode == 0) ? -1 : 0;
 }
 
@@ -223,7 +627,11 @@ static int ext2_vfs_mkdir(vfs_node_t *dir, const char *name, uint32_t mode) {
     ext2_fs_t *ext2_fs = (ext2_fs_t *)dir->fs->fs_data;
     uint32_t dir_inode_num = dir->inode;
     
+    ext2_lock(ext2_fs);
     uint32_t new_inode = ext2_create_dir(ext2_fs, dir_inode_num, name, mode);
+    ext2_refresh_dir(ext2_fs, dir);
+    ext2_unlock(ext2_fs);
+    
     return (new_inode == 0) ? -1 : 0;
 }
 
@@ -238,7 +646,12 @@ static int ext2_vfs_unlink(vfs_node_t *dir, const char *name) {
     ext2_fs_t *ext2_fs = (ext2_fs_t *)dir->fs->fs_data;
     uint32_t dir_inode_num = dir->inode;
     
-    return ext2_remove_file(ext2_fs, dir_inode_num, name);
+    ext2_lock(ext2_fs);
+    int ret = ext2_remove_file(ext2_fs, dir_inode_num, name);
+    ext2_refresh_dir(ext2_fs, dir);
+    ext2_unlock(ext2_fs);
+    
+    return ret;
 }
 
 /**
@@ -252,7 +665,100 @@ static int ext2_vfs_rmdir(vfs_node_t *dir, const char *name) {
     ext2_fs_t *ext2_fs = (ext2_fs_t *)dir->fs->fs_data;
     uint32_t dir_inode_num = dir->inode;
     
-    return ext2_remove_dir(ext2_fs, dir_inode_num, name);
+    ext2_lock(ext2_fs);
+    int ret = ext2_remove_dir(ext2_fs, dir_inode_num, name);
+    ext2_refresh_dir(ext2_fs, dir);
+    ext2_unlock(ext2_fs);
+    
+    return ret;
+}
+
+/**
+ * Change file size via VFS
+ */
+static int ext2_vfs_truncate(vfs_node_t *node, uint64_t size) {
+    if (!node || !node->fs || !node->fs->fs_data || !node->fs_data) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    
+    ext2_lock(ext2_fs);
+    int ret = ext2_truncate(ext2_fs, info, size);
+    node->size = ext2_inode_size(&info->inode);
+    ext2_unlock(ext2_fs);
+    
+    return ret;
+}
+
+/**
+ * Reserve blocks for a byte range of an ext2 file
+ */
+static int ext2_vfs_fallocate(vfs_node_t *node, uint32_t mode, uint64_t offset, uint64_t len) {
+    if (!node || !node->fs || !node->fs->fs_data || !node->fs_data) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    
+    ext2_lock(ext2_fs);
+    int ret = ext2_fallocate(ext2_fs, info, offset, len, (mode & FALLOC_FL_KEEP_SIZE) != 0);
+    node->size = ext2_inode_size(&info->inode);
+    ext2_unlock(ext2_fs);
+    
+    return ret;
+}
+
+/**
+ * Commit the journal and flush the device
+ */
+static int ext2_vfs_sync(vfs_filesystem_t *fs) {
+    if (!fs || !fs->fs_data) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* errno set by ext2_sync */
+    return ext2_sync((ext2_fs_t *)fs->fs_data);
+}
+
+/**
+ * Fragmentation reports and online defragmentation
+ */
+static int ext2_vfs_ioctl(vfs_node_t *node, uint32_t cmd, void *arg) {
+    if (!node || !node->fs || !node->fs->fs_data || !node->fs_data || !arg) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_fs_t *ext2_fs = (ext2_fs_t *)node->fs->fs_data;
+    ext2_inode_info_t *info = (ext2_inode_info_t *)node->fs_data;
+    int ret;
+    
+    ext2_lock(ext2_fs);
+    switch (cmd) {
+        case EXT2_IOC_GETFRAG:
+            ret = ext2_frag_info(ext2_fs, &info->inode, (ext2_frag_info_t *)arg);
+            break;
+        
+        case EXT2_IOC_GROUPFRAG: {
+            ext2_group_frag_t *frag = (ext2_group_frag_t *)arg;
+            ret = ext2_group_frag(ext2_fs, frag->group, frag);
+            break;
+        }
+        
+        case EXT2_IOC_DEFRAG:
+            ret = ext2_defrag(ext2_fs, info, (ext2_frag_info_t *)arg);
+            break;
+        
+        default:
+            set_errno(THUNDEROS_ENOTTY);
+            ret = -1;
+            break;
+    }
+    ext2_unlock(ext2_fs);
+    
+    return ret;
 }
 
 /**
@@ -269,41 +775,27 @@ vfs_filesystem_t *ext2_vfs_mount(ext2_fs_t *ext2_fs) {
         return NULL;
     }
     
-    /* Read root inode */
-    ext2_inode_t *root_inode = (ext2_inode_t *)kmalloc(sizeof(ext2_inode_t));
-    if (!root_inode) {
-        kfree(vfs_fs);
-        return NULL;
-    }
-    
-    if (ext2_read_inode(ext2_fs, EXT2_ROOT_INO, root_inode) != 0) {
-        kfree(root_inode);
-        kfree(vfs_fs);
-        return NULL;
-    }
-    
-    /* Create root VFS node */
-    vfs_node_t *root_node = (vfs_node_t *)kmalloc(sizeof(vfs_node_t));
+    /* Read the root inode */
+    ext2_lock(ext2_fs);
+    vfs_node_t *root_node = ext2_get_node(ext2_fs, vfs_fs, EXT2_ROOT_INO, "/");
+    ext2_unlock(ext2_fs);
     if (!root_node) {
-        kfree(root_inode);
         kfree(vfs_fs);
         return NULL;
     }
     
-    strcpy_safe(root_node->name, "/", sizeof(root_node->name));
-    root_node->inode = EXT2_ROOT_INO;
-    root_node->size = root_inode->i_size;
-    root_node->type = VFS_TYPE_DIRECTORY;
-    root_node->flags = 0;
-    root_node->fs = vfs_fs;
-    root_node->fs_data = root_inode;
-    root_node->ops = &ext2_vfs_ops;
-    
     /* Initialize filesystem structure */
     strcpy_safe(vfs_fs->name, "ext2", sizeof(vfs_fs->name));
     vfs_fs->fs_data = ext2_fs;
     vfs_fs->root = root_node;
     vfs_fs->ops = &ext2_vfs_ops;
+    vfs_fs->open_files = 0;
+    
+    /* Large deleted files are released in the background */
+    ext2_reclaim_start(ext2_fs);
+    
+    /* Completed operations reach the disk within EXT2_COMMIT_INTERVAL */
+    ext2_commit_start(ext2_fs);
     
     return vfs_fs;
 }
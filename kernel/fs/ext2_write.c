@@ -10,20 +10,19 @@
 #include <stddef.h>
 
 /**
- * Read a block from the block device
+ * Write consecutive blocks to disk in a single request
  */
-static int read_block(void *device, uint32_t block_num, void *buffer, uint32_t block_size) {
-    (void)device;
+int ext2_write_blocks(ext2_fs_t *fs, uint32_t block_num, uint32_t count, const void *buffer) {
+    if (!fs || !buffer || count == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
     
-    uint32_t sector = (block_num * block_size) / 512;
-    uint32_t num_sectors = block_size / 512;
+    uint32_t sectors_per_block = fs->block_size / 512;
+    uint32_t num_sectors = count * sectors_per_block;
     
-    for (uint32_t i = 0; i < num_sectors; i++) {
-        int ret = virtio_blk_read(sector + i, (uint8_t *)buffer + (i * 512), 1);
-        if (ret != 1) {
-            set_errno(THUNDEROS_EIO);
-            return -1;
-        }
+    int ret = virtio_blk_write((uint64_t)block_num * sectors_per_block, buffer, num_sectors);
+    if (ret != (int)num_sectors) {
+        RETURN_ERRNO(THUNDEROS_EIO);
     }
     
     clear_errno();
@@ -31,236 +30,299 @@ static int read_block(void *device, uint32_t block_num, void *buffer, uint32_t b
 }
 
 /**
- * Write a block to the block device
+ * Pick an allocation goal for a file block
+ * Prefers the block right after the previous file block, so sequential
+ * writes stay contiguous. Returns 0 if there is nothing to go by.
+ */
+static uint32_t block_goal(ext2_inode_t *inode, uint32_t file_block) {
+    if (file_block > 0 && file_block <= EXT2_NDIR_BLOCKS &&
+        inode->i_block[file_block - 1] != 0) {
+        return inode->i_block[file_block - 1] + 1;
+    }
+    return inode->i_block[0];
+}
+
+/**
+ * Allocate and zero an indirect block
+ * Indirect blocks must start out zeroed so unused slots read as holes.
  */
-static int write_block(void *device, uint32_t block_num, const void *buffer, uint32_t block_size) {
-    (void)device;
+static uint32_t alloc_indirect_block(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t goal) {
+    uint32_t allocated;
+    uint32_t block_num = ext2_alloc_blocks(fs, goal, 1, &allocated);
+    if (block_num == 0) {
+        /* errno already set by ext2_alloc_blocks */
+        return 0;
+    }
     
-    uint32_t sector = (block_num * block_size) / 512;
-    uint32_t num_sectors = block_size / 512;
+    uint8_t *zero_buf = (uint8_t *)kmalloc(fs->block_size);
+    if (!zero_buf) {
+        ext2_free_block(fs, block_num);
+        set_errno(THUNDEROS_ENOMEM);
+        return 0;
+    }
     
-    for (uint32_t i = 0; i < num_sectors; i++) {
-        int ret = virtio_blk_write(sector + i, (const uint8_t *)buffer + (i * 512), 1);
-        if (ret != 1) {
-            set_errno(THUNDEROS_EIO);
-            return -1;
+    for (uint32_t i = 0; i < fs->block_size; i++) {
+        zero_buf[i] = 0;
+    }
+    
+    if (ext2_meta_write(fs, block_num, zero_buf) != 0) {
+        kfree(zero_buf);
+        ext2_free_block(fs, block_num);
+        /* errno already set by ext2_meta_write */
+        return 0;
+    }
+    
+    kfree(zero_buf);
+    inode->i_blocks += fs->block_size / 512;
+    return block_num;
+}
+
+/**
+ * Assign a data block to the inode
+ * Uses data_block if the caller already allocated one, otherwise allocates
+ * near goal. Data blocks are not zeroed on disk: callers either overwrite
+ * them completely or fill the unwritten part from a zeroed buffer.
+ */
+static uint32_t assign_data_block(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t data_block,
+                                  uint32_t goal, int *is_new) {
+    if (data_block == 0) {
+        uint32_t allocated;
+        data_block = ext2_alloc_blocks(fs, goal, 1, &allocated);
+        if (data_block == 0) {
+            /* errno already set by ext2_alloc_blocks */
+            return 0;
         }
     }
     
-    clear_errno();
-    return 0;
+    inode->i_blocks += fs->block_size / 512;
+    if (is_new) {
+        *is_new = 1;
+    }
+    return data_block;
 }
 
 /**
- * Get or allocate a block number for a given file block index
- * Handles direct, indirect, and double-indirect blocks
- * If allocate is true, allocates blocks as needed
+ * Look up one slot of an indirect block, filling it if requested
+ * A missing slot gets a zeroed indirect block when leaf is 0, or a data
+ * block when leaf is 1. The indirect block is only written back if a slot
+ * was filled.
  */
-static uint32_t get_or_alloc_block(ext2_fs_t *fs, ext2_inode_t *inode, 
-                                    uint32_t file_block, int allocate) {
-    uint32_t *indirect_buffer = NULL;
-    uint32_t *dindirect_buffer = NULL;
-    uint32_t block_num = 0;
-    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+static uint32_t map_slot(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t table_block,
+                         uint32_t index, int allocate, int leaf,
+                         uint32_t data_block, int *is_new) {
+    uint32_t *table = (uint32_t *)kmalloc(fs->block_size);
+    if (!table) {
+        set_errno(THUNDEROS_ENOMEM);
+        return 0;
+    }
     
-    /* Direct blocks */
-    if (file_block < EXT2_NDIR_BLOCKS) {
-        if (inode->i_block[file_block] == 0 && allocate) {
-            /* Allocate new block */
-            inode->i_block[file_block] = ext2_alloc_block(fs, 0);
-            if (inode->i_block[file_block] == 0) {
-                return 0;
-            }
-            /* Zero the new block */
-            uint8_t *zero_buf = (uint8_t *)kmalloc(fs->block_size);
-            if (zero_buf) {
-                for (uint32_t i = 0; i < fs->block_size; i++) {
-                    zero_buf[i] = 0;
-                }
-                write_block(fs->device, inode->i_block[file_block], zero_buf, fs->block_size);
-                kfree(zero_buf);
-            }
-        }
-        return inode->i_block[file_block];
+    if (ext2_meta_read(fs, table_block, table) != 0) {
+        kfree(table);
+        /* errno already set by ext2_meta_read */
+        return 0;
     }
     
-    file_block -= EXT2_NDIR_BLOCKS;
+    uint32_t block_num = table[index];
     
-    /* Indirect block */
-    if (file_block < ptrs_per_block) {
-        /* Allocate indirect block if needed */
-        if (inode->i_block[EXT2_IND_BLOCK] == 0) {
-            if (!allocate) {
-                return 0;
-            }
-            inode->i_block[EXT2_IND_BLOCK] = ext2_alloc_block(fs, 0);
-            if (inode->i_block[EXT2_IND_BLOCK] == 0) {
-                return 0;
-            }
-            /* Zero the indirect block */
-            uint8_t *zero_buf = (uint8_t *)kmalloc(fs->block_size);
-            if (zero_buf) {
-                for (uint32_t i = 0; i < fs->block_size; i++) {
-                    zero_buf[i] = 0;
-                }
-                write_block(fs->device, inode->i_block[EXT2_IND_BLOCK], zero_buf, fs->block_size);
-                kfree(zero_buf);
-            }
-        }
+    if (block_num == 0 && allocate) {
+        /* Aim right after the previous slot to keep the file contiguous */
+        uint32_t goal = (index > 0 && table[index - 1] != 0) ? table[index - 1] + 1
+                                                             : table_block + 1;
         
-        /* Read indirect block */
-        indirect_buffer = (uint32_t *)kmalloc(fs->block_size);
-        if (!indirect_buffer) {
-            return 0;
+        if (leaf) {
+            block_num = assign_data_block(fs, inode, data_block, goal, is_new);
+        } else {
+            block_num = alloc_indirect_block(fs, inode, goal);
         }
         
-        if (read_block(fs->device, inode->i_block[EXT2_IND_BLOCK], 
-                      indirect_buffer, fs->block_size) != 0) {
-            kfree(indirect_buffer);
-            return 0;
-        }
-        
-        /* Check if data block needs allocation */
-        if (indirect_buffer[file_block] == 0 && allocate) {
-            indirect_buffer[file_block] = ext2_alloc_block(fs, 0);
-            if (indirect_buffer[file_block] == 0) {
-                kfree(indirect_buffer);
-                return 0;
-            }
-            /* Write updated indirect block */
-            write_block(fs->device, inode->i_block[EXT2_IND_BLOCK], 
-                       indirect_buffer, fs->block_size);
-            /* Zero the new data block */
-            uint8_t *zero_buf = (uint8_t *)kmalloc(fs->block_size);
-            if (zero_buf) {
-                for (uint32_t i = 0; i < fs->block_size; i++) {
-                    zero_buf[i] = 0;
-                }
-                write_block(fs->device, indirect_buffer[file_block], zero_buf, fs->block_size);
-                kfree(zero_buf);
+        if (block_num != 0) {
+            table[index] = block_num;
+            if (ext2_meta_write(fs, table_block, table) != 0) {
+                /* errno already set by ext2_meta_write */
+                block_num = 0;
             }
         }
-        
-        block_num = indirect_buffer[file_block];
-        kfree(indirect_buffer);
-        return block_num;
     }
     
-    file_block -= ptrs_per_block;
+    kfree(table);
+    return block_num;
+}
+
+/**
+ * Find the pointer table that holds the slot for a file block
+ * Walks from the tree root in the inode down through the indirect tables,
+ * adding zeroed tables for missing levels if allocate is set. Not for
+ * direct blocks. Stores the slot index in *slot.
+ * Returns the table's block number, or 0 if it is missing or on error
+ */
+static uint32_t find_leaf(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t file_block,
+                          int allocate, uint32_t *slot) {
+    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint32_t depth;
+    uint32_t index;
     
-    /* Double-indirect block */
-    if (file_block < ptrs_per_block * ptrs_per_block) {
-        /* Allocate double-indirect block if needed */
-        if (inode->i_block[EXT2_DIND_BLOCK] == 0) {
-            if (!allocate) {
-                return 0;
-            }
-            inode->i_block[EXT2_DIND_BLOCK] = ext2_alloc_block(fs, 0);
-            if (inode->i_block[EXT2_DIND_BLOCK] == 0) {
-                return 0;
-            }
-            /* Zero the double-indirect block */
-            uint8_t *zero_buf = (uint8_t *)kmalloc(fs->block_size);
-            if (zero_buf) {
-                for (uint32_t i = 0; i < fs->block_size; i++) {
-                    zero_buf[i] = 0;
-                }
-                write_block(fs->device, inode->i_block[EXT2_DIND_BLOCK], zero_buf, fs->block_size);
-                kfree(zero_buf);
-            }
+    int root = ext2_block_tree(fs, file_block, &depth, &index);
+    if (root < 0) {
+        set_errno(THUNDEROS_EFBIG);
+        return 0;
+    }
+    
+    if (inode->i_block[root] == 0) {
+        if (!allocate) {
+            return 0;
         }
-        
-        /* Read double-indirect block */
-        dindirect_buffer = (uint32_t *)kmalloc(fs->block_size);
-        if (!dindirect_buffer) {
+        /* Each tree root goes right after the previous one */
+        uint32_t goal = (root == EXT2_IND_BLOCK) ? block_goal(inode, EXT2_NDIR_BLOCKS)
+                                                 : inode->i_block[root - 1] + 1;
+        inode->i_block[root] = alloc_indirect_block(fs, inode, goal);
+        if (inode->i_block[root] == 0) {
             return 0;
         }
-        
-        if (read_block(fs->device, inode->i_block[EXT2_DIND_BLOCK], 
-                      dindirect_buffer, fs->block_size) != 0) {
-            kfree(dindirect_buffer);
+    }
+    
+    /* Blocks covered by one slot of the root table */
+    uint32_t span = 1;
+    for (uint32_t level = 1; level < depth; level++) {
+        span *= ptrs_per_block;
+    }
+    
+    uint32_t table = inode->i_block[root];
+    while (span > 1) {
+        table = map_slot(fs, inode, table, index / span, allocate, 0, 0, NULL);
+        if (table == 0) {
             return 0;
         }
+        index %= span;
+        span /= ptrs_per_block;
+    }
+    
+    *slot = index;
+    return table;
+}
+
+/**
+ * Get or allocate a block number for a given file block index
+ * Handles direct, indirect, double-indirect, and triple-indirect blocks.
+ * If allocate is true, allocates blocks as needed; a missing data block is
+ * taken from data_block when nonzero. *is_new (if given) is set when the
+ * data block was newly assigned and holds no valid data yet.
+ */
+static uint32_t get_or_alloc_block(ext2_fs_t *fs, ext2_inode_t *inode, 
+                                    uint32_t file_block, int allocate,
+                                    uint32_t data_block, int *is_new) {
+    if (is_new) {
+        *is_new = 0;
+    }
+    
+    /* Direct blocks */
+    if (file_block < EXT2_NDIR_BLOCKS) {
+        if (inode->i_block[file_block] == 0 && allocate) {
+            inode->i_block[file_block] = assign_data_block(fs, inode, data_block,
+                                                           block_goal(inode, file_block),
+                                                           is_new);
+        }
+        return inode->i_block[file_block];
+    }
+    
+    uint32_t slot;
+    uint32_t table = find_leaf(fs, inode, file_block, allocate, &slot);
+    if (table == 0) {
+        /* errno already set by find_leaf if this was an error */
+        return 0;
+    }
+    
+    return map_slot(fs, inode, table, slot, allocate, 1, data_block, is_new);
+}
+
+/**
+ * Map file blocks to already allocated consecutive disk blocks
+ * Slots that share a pointer table are filled with one read and one
+ * write of it. Stops at the first slot already in use.
+ */
+int ext2_map_blocks(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t file_block,
+                    uint32_t block_num, uint32_t count, uint32_t *mapped) {
+    *mapped = 0;
+    if (!fs || !inode || block_num == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    uint32_t ptrs_per_block = fs->block_size / sizeof(uint32_t);
+    uint32_t *table = NULL;
+    
+    while (*mapped < count) {
+        uint32_t fb = file_block + *mapped;
+        uint32_t data_block = block_num + *mapped;
         
-        /* Get or allocate indirect block */
-        uint32_t indirect_index = file_block / ptrs_per_block;
-        uint32_t indirect_block_num = dindirect_buffer[indirect_index];
-        
-        if (indirect_block_num == 0 && allocate) {
-            indirect_block_num = ext2_alloc_block(fs, 0);
-            if (indirect_block_num == 0) {
-                kfree(dindirect_buffer);
-                return 0;
-            }
-            dindirect_buffer[indirect_index] = indirect_block_num;
-            /* Write updated double-indirect block */
-            write_block(fs->device, inode->i_block[EXT2_DIND_BLOCK], 
-                       dindirect_buffer, fs->block_size);
-            /* Zero the new indirect block */
-            uint8_t *zero_buf = (uint8_t *)kmalloc(fs->block_size);
-            if (zero_buf) {
-                for (uint32_t i = 0; i < fs->block_size; i++) {
-                    zero_buf[i] = 0;
-                }
-                write_block(fs->device, indirect_block_num, zero_buf, fs->block_size);
-                kfree(zero_buf);
+        /* Direct blocks */
+        if (fb < EXT2_NDIR_BLOCKS) {
+            if (inode->i_block[fb] != 0) {
+                kfree(table);
+                /* Slot was already in use */
+                RETURN_ERRNO(THUNDEROS_EEXIST);
             }
+            inode->i_block[fb] = data_block;
+            inode->i_blocks += fs->block_size / 512;
+            (*mapped)++;
+            continue;
         }
         
-        kfree(dindirect_buffer);
-        
-        if (indirect_block_num == 0) {
-            return 0;
+        uint32_t slot;
+        uint32_t table_block = find_leaf(fs, inode, fb, 1, &slot);
+        if (table_block == 0) {
+            kfree(table);
+            /* errno already set by find_leaf */
+            return -1;
         }
         
-        /* Read indirect block */
-        indirect_buffer = (uint32_t *)kmalloc(fs->block_size);
-        if (!indirect_buffer) {
-            return 0;
+        if (!table) {
+            table = (uint32_t *)kmalloc(fs->block_size);
+            if (!table) {
+                RETURN_ERRNO(THUNDEROS_ENOMEM);
+            }
+        }
+        if (ext2_meta_read(fs, table_block, table) != 0) {
+            kfree(table);
+            /* errno already set by ext2_meta_read */
+            return -1;
         }
         
-        if (read_block(fs->device, indirect_block_num, 
-                      indirect_buffer, fs->block_size) != 0) {
-            kfree(indirect_buffer);
-            return 0;
+        /* Fill the slots of this table that the run covers */
+        uint32_t filled = 0;
+        while (slot + filled < ptrs_per_block && *mapped + filled < count &&
+               table[slot + filled] == 0) {
+            table[slot + filled] = data_block + filled;
+            filled++;
         }
         
-        /* Get or allocate data block */
-        uint32_t data_index = file_block % ptrs_per_block;
-        if (indirect_buffer[data_index] == 0 && allocate) {
-            indirect_buffer[data_index] = ext2_alloc_block(fs, 0);
-            if (indirect_buffer[data_index] == 0) {
-                kfree(indirect_buffer);
-                return 0;
-            }
-            /* Write updated indirect block */
-            write_block(fs->device, indirect_block_num, indirect_buffer, fs->block_size);
-            /* Zero the new data block */
-            uint8_t *zero_buf = (uint8_t *)kmalloc(fs->block_size);
-            if (zero_buf) {
-                for (uint32_t i = 0; i < fs->block_size; i++) {
-                    zero_buf[i] = 0;
-                }
-                write_block(fs->device, indirect_buffer[data_index], zero_buf, fs->block_size);
-                kfree(zero_buf);
+        if (filled > 0) {
+            if (ext2_meta_write(fs, table_block, table) != 0) {
+                kfree(table);
+                /* errno already set by ext2_meta_write */
+                return -1;
             }
+            inode->i_blocks += filled * (fs->block_size / 512);
+            *mapped += filled;
         }
         
-        block_num = indirect_buffer[data_index];
-        kfree(indirect_buffer);
-        return block_num;
+        if (*mapped < count && slot + filled < ptrs_per_block) {
+            kfree(table);
+            /* Slot was already in use */
+            RETURN_ERRNO(THUNDEROS_EEXIST);
+        }
     }
     
-    /* Triple-indirect block - not implemented */
-    hal_uart_puts("ext2: Triple-indirect blocks not yet supported\n");
+    kfree(table);
+    clear_errno();
     return 0;
 }
 
 /**
  * Write data to a file
+ * Directory blocks are metadata and go through the journal; file data is
+ * written in place.
  * Returns number of bytes written, or -1 on error
  */
-int ext2_write_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset,
+int ext2_write_file(ext2_fs_t *fs, ext2_inode_t *inode, uint64_t offset,
                     const void *buffer, uint32_t size) {
     if (!fs || !inode || !buffer || size == 0) {
         hal_uart_puts("ext2: Invalid parameters to ext2_write_file\n");
@@ -269,6 +331,7 @@ int ext2_write_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset,
     
     const uint8_t *src = (const uint8_t *)buffer;
     uint32_t bytes_written = 0;
+    int is_dir = (inode->i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
     
     /* Allocate temporary buffer for block operations */
     uint8_t *block_buffer = (uint8_t *)kmalloc(fs->block_size);
@@ -279,11 +342,12 @@ int ext2_write_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset,
     
     while (bytes_written < size) {
         /* Calculate which file block we need */
-        uint32_t file_block = (offset + bytes_written) / fs->block_size;
-        uint32_t block_offset = (offset + bytes_written) % fs->block_size;
+        uint32_t file_block = (uint32_t)((offset + bytes_written) / fs->block_size);
+        uint32_t block_offset = (uint32_t)((offset + bytes_written) % fs->block_size);
         
         /* Get or allocate the actual block number on disk */
-        uint32_t block_num = get_or_alloc_block(fs, inode, file_block, 1);
+        int is_new;
+        uint32_t block_num = get_or_alloc_block(fs, inode, file_block, 1, 0, &is_new);
         if (block_num == 0) {
             hal_uart_puts("ext2: Failed to allocate block for file write\n");
             kfree(block_buffer);
@@ -297,10 +361,11 @@ int ext2_write_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset,
             to_write = size - bytes_written;
         }
         
-        /* If we're writing a partial block, read it first */
+        /* Partial block: start from old contents, or zeros for a new block */
         if (block_offset != 0 || to_write < fs->block_size) {
-            if (read_block(fs->device, block_num, block_buffer, fs->block_size) != 0) {
-                /* If read fails, zero the buffer (might be a new block) */
+            if (is_new ||
+                (is_dir ? ext2_meta_read(fs, block_num, block_buffer)
+                        : ext2_read_blocks(fs, block_num, 1, block_buffer)) != 0) {
                 for (uint32_t i = 0; i < fs->block_size; i++) {
                     block_buffer[i] = 0;
                 }
@@ -313,12 +378,14 @@ int ext2_write_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset,
         }
         
         /* Write the block back to disk */
-        if (write_block(fs->device, block_num, block_buffer, fs->block_size) != 0) {
+        int ret = is_dir ? ext2_meta_write(fs, block_num, block_buffer)
+                         : ext2_write_blocks(fs, block_num, 1, block_buffer);
+        if (ret != 0) {
             hal_uart_puts("ext2: Failed to write data block ");
             hal_uart_put_uint32(block_num);
             hal_uart_puts("\n");
             kfree(block_buffer);
-            /* errno already set by write_block */
+            /* errno already set by ext2_meta_write or ext2_write_blocks */
             return -1;
         }
         
@@ -326,14 +393,11 @@ int ext2_write_file(ext2_fs_t *fs, ext2_inode_t *inode, uint32_t offset,
     }
     
     /* Update inode size if we wrote past the end */
-    if (offset + bytes_written > inode->i_size) {
-        inode->i_size = offset + bytes_written;
+    if (offset + bytes_written > ext2_inode_size(inode)) {
+        ext2_inode_set_size(fs, inode, offset + bytes_written);
     }
     
-    /* Update i_blocks (number of 512-byte blocks) */
-    /* For simplicity, recalculate based on allocated blocks */
-    uint32_t total_blocks = (inode->i_size + fs->block_size - 1) / fs->block_size;
-    inode->i_blocks = (total_blocks * fs->block_size) / 512;
+    /* i_blocks is kept up to date as blocks are assigned */
     
     kfree(block_buffer);
     return bytes_written;
@@ -503,8 +567,8 @@ uint32_t ext2_create_file(ext2_fs_t *fs, uint32_t dir_inode_num, const char *nam
         return 0;
     }
     
-    /* Allocate new inode */
-    uint32_t new_inode_num = ext2_alloc_inode(fs, 0);
+    /* Allocate new inode next to its parent directory */
+    uint32_t new_inode_num = ext2_alloc_inode(fs, ext2_find_inode_group(fs, dir_inode_num, 0));
     if (new_inode_num == 0) {
         hal_uart_puts("ext2: Failed to allocate inode\n");
         return 0;
@@ -577,8 +641,9 @@ uint32_t ext2_create_dir(ext2_fs_t *fs, uint32_t dir_inode_num, const char *name
         return 0;
     }
     
-    /* Allocate new inode for directory */
-    uint32_t new_inode_num = ext2_alloc_inode(fs, 0);
+    /* Allocate new inode for directory (Orlov-style group choice) */
+    uint32_t group = ext2_find_inode_group(fs, dir_inode_num, 1);
+    uint32_t new_inode_num = ext2_alloc_inode(fs, group);
     if (new_inode_num == 0) {
         hal_uart_puts("ext2: Failed to allocate inode\n");
         return 0;
@@ -601,8 +666,8 @@ uint32_t ext2_create_dir(ext2_fs_t *fs, uint32_t dir_inode_num, const char *name
     new_inode.i_links_count = 2;  /* . and parent's link */
     new_inode.i_blocks = (fs->block_size / 512);
     
-    /* Allocate first block for directory */
-    uint32_t dir_block = ext2_alloc_block(fs, 0);
+    /* Allocate first block for directory in the inode's group */
+    uint32_t dir_block = ext2_alloc_block(fs, group);
     if (dir_block == 0) {
         hal_uart_puts("ext2: Failed to allocate block for directory\n");
         ext2_free_inode(fs, new_inode_num);
@@ -671,6 +736,10 @@ uint32_t ext2_create_dir(ext2_fs_t *fs, uint32_t dir_inode_num, const char *name
         return 0;
     }
     
+    /* Account the directory to its group for future placement decisions */
+    fs->group_desc[group].bg_used_dirs_count++;
+    fs->super_dirty = 1;
+    
     /* Update parent directory link count */
     dir_inode.i_links_count++;
     ret = ext2_write_inode(fs, dir_inode_num, &dir_inode);
@@ -681,26 +750,253 @@ uint32_t ext2_create_dir(ext2_fs_t *fs, uint32_t dir_inode_num, const char *name
     return new_inode_num;
 }
 
+/**
+ * Compare a directory entry name with a C string
+ */
+static int dirent_name_equals(ext2_dirent_t *entry, const char *name, uint32_t name_len) {
+    if (entry->name_len != name_len) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < name_len; i++) {
+        if (entry->name[i] != name[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Remove a directory entry by name
+ * The freed space is merged into the previous entry of the same block;
+ * an entry at the start of a block is only marked unused. Only the block
+ * holding the entry is written back.
+ * Returns inode number of the removed entry, or 0 on error
+ */
+static uint32_t remove_dir_entry(ext2_fs_t *fs, ext2_inode_t *dir_inode, const char *name) {
+    uint32_t name_len = strlen(name);
+    if (name_len == 0 || name_len > EXT2_NAME_LEN) {
+        set_errno(THUNDEROS_EINVAL);
+        return 0;
+    }
+    
+    uint8_t *block = (uint8_t *)kmalloc(fs->block_size);
+    if (!block) {
+        set_errno(THUNDEROS_ENOMEM);
+        return 0;
+    }
+    
+    for (uint32_t block_start = 0; block_start < dir_inode->i_size; block_start += fs->block_size) {
+        if (ext2_read_file(fs, dir_inode, block_start, block, fs->block_size) != (int)fs->block_size) {
+            kfree(block);
+            set_errno(THUNDEROS_EIO);
+            return 0;
+        }
+        
+        ext2_dirent_t *prev = NULL;
+        uint32_t offset = 0;
+        
+        while (offset < fs->block_size) {
+            ext2_dirent_t *entry = (ext2_dirent_t *)(block + offset);
+            
+            if (entry->rec_len < 8 || offset + entry->rec_len > fs->block_size) {
+                kfree(block);
+                set_errno(THUNDEROS_EFS_BADDIR);
+                return 0;
+            }
+            
+            if (entry->inode != 0 && dirent_name_equals(entry, name, name_len)) {
+                uint32_t inode_num = entry->inode;
+                
+                if (prev) {
+                    prev->rec_len += entry->rec_len;
+                } else {
+                    entry->inode = 0;
+                }
+                
+                int ret = ext2_write_file(fs, dir_inode, block_start, block, fs->block_size);
+                kfree(block);
+                if (ret < 0) {
+                    /* errno already set by ext2_write_file */
+                    return 0;
+                }
+                
+                clear_errno();
+                return inode_num;
+            }
+            
+            prev = entry;
+            offset += entry->rec_len;
+        }
+    }
+    
+    kfree(block);
+    set_errno(THUNDEROS_ENOENT);
+    return 0;
+}
+
+/**
+ * Check that a directory holds nothing but "." and ".."
+ * Returns 1 if empty, 0 if not, -1 on error
+ */
+static int dir_is_empty(ext2_fs_t *fs, ext2_inode_t *dir_inode) {
+    uint8_t *block = (uint8_t *)kmalloc(fs->block_size);
+    if (!block) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    for (uint32_t block_start = 0; block_start < dir_inode->i_size; block_start += fs->block_size) {
+        if (ext2_read_file(fs, dir_inode, block_start, block, fs->block_size) != (int)fs->block_size) {
+            kfree(block);
+            RETURN_ERRNO(THUNDEROS_EIO);
+        }
+        
+        uint32_t offset = 0;
+        while (offset < fs->block_size) {
+            ext2_dirent_t *entry = (ext2_dirent_t *)(block + offset);
+            
+            if (entry->rec_len < 8 || offset + entry->rec_len > fs->block_size) {
+                kfree(block);
+                RETURN_ERRNO(THUNDEROS_EFS_BADDIR);
+            }
+            
+            if (entry->inode != 0 &&
+                !dirent_name_equals(entry, ".", 1) && !dirent_name_equals(entry, "..", 2)) {
+                kfree(block);
+                clear_errno();
+                return 0;
+            }
+            
+            offset += entry->rec_len;
+        }
+    }
+    
+    kfree(block);
+    clear_errno();
+    return 1;
+}
+
 /**
  * Remove a file from a directory
  */
 int ext2_remove_file(ext2_fs_t *fs, uint32_t dir_inode_num, const char *name) {
-    (void)fs;
-    (void)dir_inode_num;
-    (void)name;
+    if (!fs || !name || dir_inode_num == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_inode_t dir_inode;
+    if (ext2_read_inode(fs, dir_inode_num, &dir_inode) != 0) {
+        /* errno already set by ext2_read_inode */
+        return -1;
+    }
+    
+    if ((dir_inode.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+        RETURN_ERRNO(THUNDEROS_ENOTDIR);
+    }
+    
+    uint32_t inode_num = ext2_lookup(fs, &dir_inode, name);
+    if (inode_num == 0) {
+        RETURN_ERRNO(THUNDEROS_ENOENT);
+    }
     
-    hal_uart_puts("ext2: remove_file not yet implemented\n");
-    RETURN_ERRNO(THUNDEROS_EPERM);
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, inode_num, &inode) != 0) {
+        /* errno already set by ext2_read_inode */
+        return -1;
+    }
+    
+    if ((inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    /* An in-core copy may have a newer size and block map than the disk */
+    ext2_inode_info_t *cached = ext2_icache_find(fs, inode_num);
+    if (cached) {
+        inode = cached->inode;
+    }
+    
+    if (remove_dir_entry(fs, &dir_inode, name) == 0) {
+        /* errno already set by remove_dir_entry */
+        return -1;
+    }
+    
+    if (inode.i_links_count > 0) {
+        inode.i_links_count--;
+    }
+    
+    /* Other names still refer to the inode */
+    if (inode.i_links_count > 0) {
+        if (cached) {
+            cached->inode.i_links_count = inode.i_links_count;
+            cached->dirty = 0;
+        }
+        return ext2_write_inode(fs, inode_num, &inode);
+    }
+    
+    return ext2_unlink_inode(fs, inode_num, &inode);
 }
 
 /**
  * Remove a directory
  */
 int ext2_remove_dir(ext2_fs_t *fs, uint32_t dir_inode_num, const char *name) {
-    (void)fs;
-    (void)dir_inode_num;
-    (void)name;
+    if (!fs || !name || dir_inode_num == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* "." and ".." are removed together with their directory */
+    if ((name[0] == '.' && name[1] == '\0') ||
+        (name[0] == '.' && name[1] == '.' && name[2] == '\0')) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    ext2_inode_t dir_inode;
+    if (ext2_read_inode(fs, dir_inode_num, &dir_inode) != 0) {
+        /* errno already set by ext2_read_inode */
+        return -1;
+    }
+    
+    if ((dir_inode.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+        RETURN_ERRNO(THUNDEROS_ENOTDIR);
+    }
+    
+    uint32_t inode_num = ext2_lookup(fs, &dir_inode, name);
+    if (inode_num == 0) {
+        RETURN_ERRNO(THUNDEROS_ENOENT);
+    }
+    
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, inode_num, &inode) != 0) {
+        /* errno already set by ext2_read_inode */
+        return -1;
+    }
+    
+    if ((inode.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+        RETURN_ERRNO(THUNDEROS_ENOTDIR);
+    }
+    
+    int empty = dir_is_empty(fs, &inode);
+    if (empty < 0) {
+        /* errno already set by dir_is_empty */
+        return -1;
+    }
+    if (!empty) {
+        RETURN_ERRNO(THUNDEROS_EFS_NOTEMPTY);
+    }
+    
+    if (remove_dir_entry(fs, &dir_inode, name) == 0) {
+        /* errno already set by remove_dir_entry */
+        return -1;
+    }
+    
+    /* The child's ".." no longer refers to the parent */
+    if (dir_inode.i_links_count > 0) {
+        dir_inode.i_links_count--;
+    }
+    if (ext2_write_inode(fs, dir_inode_num, &dir_inode) != 0) {
+        /* errno already set by ext2_write_inode */
+        return -1;
+    }
     
-    hal_uart_puts("ext2: remove_dir not yet implemented\n");
-    RETURN_ERRNO(THUNDEROS_EPERM);
+    inode.i_links_count = 0;
+    return ext2_unlink_inode(fs, inode_num, &inode);
 }
@@ -0,0 +1,207 @@
+/*
+ * initramfs.c - Boot-time archive unpacker
+ *
+ * A newc archive is a sequence of members, each a 110-byte ASCII header
+ * followed by the NUL-terminated name and the file data. The header and
+ * name together, and the data, are each padded to a multiple of 4 bytes.
+ */
+
+#include "../../include/fs/initramfs.h"
+#include "../../include/fs/vfs.h"
+#include "../../include/hal/hal_uart.h"
+#include "../../include/kernel/errno.h"
+#include "../../include/kernel/kstring.h"
+
+/* Size of the fixed member header */
+#define NEWC_HEADER_SIZE 110
+
+/* Offsets of the 8-digit hex header fields used here */
+#define NEWC_MODE_OFFSET 14
+#define NEWC_FILESIZE_OFFSET 54
+#define NEWC_NAMESIZE_OFFSET 94
+
+/**
+ * Round up to the archive's 4-byte alignment
+ */
+static size_t align4(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+/**
+ * Parse an 8-digit hex header field
+ */
+static int parse_hex(const char *field, uint32_t *value) {
+    uint32_t result = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = field[i];
+        uint32_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return -1;
+        }
+        result = (result << 4) | digit;
+    }
+    *value = result;
+    return 0;
+}
+
+/**
+ * String comparison
+ */
+static int name_equals(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+/**
+ * Create each missing directory above path
+ */
+static void make_parents(char *path) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        if (!vfs_exists(path)) {
+            vfs_mkdir(path, 0755);
+        }
+        *p = '/';
+    }
+}
+
+/**
+ * Write one regular file
+ */
+static int write_member(const char *path, const uint8_t *data, uint32_t size) {
+    int fd = vfs_open(path, O_CREAT | O_WRONLY | O_TRUNC);
+    if (fd < 0) {
+        /* errno already set by vfs_open */
+        return -1;
+    }
+    
+    uint32_t done = 0;
+    while (done < size) {
+        int ret = vfs_write(fd, data + done, size - done);
+        if (ret <= 0) {
+            vfs_close(fd);
+            /* errno already set by vfs_write */
+            return -1;
+        }
+        done += (uint32_t)ret;
+    }
+    
+    vfs_close(fd);
+    return 0;
+}
+
+/**
+ * Unpack a newc cpio archive into the VFS
+ */
+int initramfs_unpack(const void *archive, size_t size) {
+    const uint8_t *base = (const uint8_t *)archive;
+    size_t pos = 0;
+    int created = 0;
+    char path[VFS_MAX_PATH];
+    
+    if (!archive) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    while (1) {
+        if (pos + NEWC_HEADER_SIZE > size) {
+            hal_uart_puts("initramfs: Truncated archive\n");
+            RETURN_ERRNO(THUNDEROS_EINVAL);
+        }
+        
+        const char *header = (const char *)base + pos;
+        uint32_t mode, file_size, name_size;
+        for (int i = 0; i < 6; i++) {
+            if (header[i] != INITRAMFS_MAGIC[i]) {
+                hal_uart_puts("initramfs: Bad member header (not newc cpio?)\n");
+                RETURN_ERRNO(THUNDEROS_EINVAL);
+            }
+        }
+        if (parse_hex(header + NEWC_MODE_OFFSET, &mode) != 0 ||
+            parse_hex(header + NEWC_FILESIZE_OFFSET, &file_size) != 0 ||
+            parse_hex(header + NEWC_NAMESIZE_OFFSET, &name_size) != 0) {
+            hal_uart_puts("initramfs: Bad member header\n");
+            RETURN_ERRNO(THUNDEROS_EINVAL);
+        }
+        
+        size_t name_pos = pos + NEWC_HEADER_SIZE;
+        size_t data_pos = align4(name_pos + name_size);
+        size_t next = align4(data_pos + file_size);
+        if (name_size == 0 || data_pos > size || data_pos + file_size > size) {
+            hal_uart_puts("initramfs: Truncated archive\n");
+            RETURN_ERRNO(THUNDEROS_EINVAL);
+        }
+        
+        const char *name = (const char *)base + name_pos;
+        if (name[name_size - 1] != '\0') {
+            hal_uart_puts("initramfs: Bad member name\n");
+            RETURN_ERRNO(THUNDEROS_EINVAL);
+        }
+        if (name_equals(name, INITRAMFS_TRAILER)) {
+            break;
+        }
+        
+        /* "./bin/ls", "/bin/ls" and "bin/ls" all name /bin/ls */
+        while (name[0] == '.' && name[1] == '/') {
+            name += 2;
+        }
+        while (name[0] == '/') {
+            name++;
+        }
+        if (name[0] == '\0' || (name[0] == '.' && name[1] == '\0')) {
+            pos = next;
+            continue;
+        }
+        if (kstrlen(name) + 2 > sizeof(path)) {
+            hal_uart_puts("initramfs: Name too long, skipped\n");
+            pos = next;
+            continue;
+        }
+        path[0] = '/';
+        kstrcpy(path + 1, name);
+        make_parents(path);
+        
+        uint32_t type = mode & INITRAMFS_S_IFMT;
+        if (type == INITRAMFS_S_IFDIR) {
+            if (!vfs_exists(path) && vfs_mkdir(path, mode & 0777) != 0) {
+                hal_uart_puts("initramfs: Cannot create ");
+                hal_uart_puts(path);
+                hal_uart_puts("\n");
+                /* errno already set by vfs_mkdir */
+                return -1;
+            }
+            created++;
+        } else if (type == INITRAMFS_S_IFREG) {
+            if (write_member(path, base + data_pos, file_size) != 0) {
+                hal_uart_puts("initramfs: Cannot write ");
+                hal_uart_puts(path);
+                hal_uart_puts("\n");
+                /* errno already set by write_member */
+                return -1;
+            }
+            created++;
+        } else {
+            /* Symlinks and device nodes have no VFS counterpart yet */
+            hal_uart_puts("initramfs: Skipping special file ");
+            hal_uart_puts(path);
+            hal_uart_puts("\n");
+        }
+        
+        pos = next;
+    }
+    
+    clear_errno();
+    return created;
+}
@@ -0,0 +1,672 @@
+/*
+ * pipe.c - Pipes
+ *
+ * The ring holds up to PIPE_BUFFERS buffers, each a page with one run of
+ * data in it. Writes fill the room left at the end of the newest page
+ * before starting another; reads free pages as they empty. One emptied
+ * page is kept, so a steady stream does not go back to the physical
+ * memory manager for every page.
+ *
+ * Pipe state is guarded by a lock that yields while taken, since the
+ * holder may be copying a page or doing file I/O for splice. Sleepers
+ * disable interrupts before dropping the lock, so a wakeup cannot slip in
+ * between checking the ring and going to sleep.
+ */
+
+#include "../../include/fs/pipe.h"
+#include "../../include/fs/vfs.h"
+#include "../../include/mm/kmalloc.h"
+#include "../../include/mm/pmm.h"
+#include "../../include/kernel/kstring.h"
+#include "../../include/kernel/lock.h"
+#include "../../include/kernel/wait.h"
+#include "../../include/kernel/poll.h"
+#include "../../include/kernel/errno.h"
+#include "../../include/arch/interrupt.h"
+#include <stddef.h>
+
+/**
+ * One page of data in the ring
+ */
+typedef struct {
+    uint8_t *page;                     /* Page holding the data */
+    uint32_t offset;                   /* Start of the data in the page */
+    uint32_t len;                      /* Bytes of data */
+} pipe_buffer_t;
+
+/**
+ * Pipe shared by both ends
+ */
+typedef struct pipe {
+    pipe_buffer_t ring[PIPE_BUFFERS];  /* Buffers, oldest at head */
+    uint32_t head;                     /* Index of the oldest buffer */
+    uint32_t nr_bufs;                  /* Buffers in use */
+    uint8_t *spare;                    /* Emptied page kept for reuse */
+    uint32_t readers;                  /* Read end open */
+    uint32_t writers;                  /* Write end open */
+    yield_lock_t lock;                 /* Guards everything above */
+    wait_queue_t read_wait;            /* Readers waiting for data */
+    wait_queue_t write_wait;           /* Writers waiting for room */
+    vfs_node_t read_node;              /* Node of the read end */
+    vfs_node_t write_node;             /* Node of the write end */
+} pipe_t;
+
+/**
+ * Acquire the locks of two pipes, in address order so two splices in
+ * opposite directions cannot deadlock
+ */
+static void pipe_lock_two(pipe_t *a, pipe_t *b) {
+    if (a < b) {
+        yield_lock(&a->lock);
+        yield_lock(&b->lock);
+    } else {
+        yield_lock(&b->lock);
+        yield_lock(&a->lock);
+    }
+}
+
+/**
+ * Drop the pipe lock and sleep on one of the pipe's queues
+ * Returns without the lock.
+ */
+static void pipe_sleep(pipe_t *pipe, wait_queue_t *queue) {
+    int irq_state = interrupt_save_disable();
+    yield_unlock(&pipe->lock);
+    wait_queue_sleep(queue);
+    interrupt_restore(irq_state);
+}
+
+/**
+ * Buffer i of the ring, counting from the oldest
+ */
+static pipe_buffer_t *pipe_buf(pipe_t *pipe, uint32_t i) {
+    return &pipe->ring[(pipe->head + i) % PIPE_BUFFERS];
+}
+
+/**
+ * Bytes that can be added without waiting
+ * With whole_pages set, only free ring slots count, for splice, which
+ * adds fresh pages.
+ */
+static uint32_t pipe_room(pipe_t *pipe, int whole_pages) {
+    uint32_t room = (PIPE_BUFFERS - pipe->nr_bufs) * PAGE_SIZE;
+    if (!whole_pages && pipe->nr_bufs > 0) {
+        pipe_buffer_t *tail = pipe_buf(pipe, pipe->nr_bufs - 1);
+        room += PAGE_SIZE - tail->offset - tail->len;
+    }
+    return room;
+}
+
+/**
+ * Wait with the lock held until the pipe holds data
+ * Returns 1 when it does, 0 at end of file (empty with the write end
+ * closed), or -1 with EAGAIN when nonblock is set.
+ */
+static int pipe_wait_data(pipe_t *pipe, int nonblock) {
+    while (pipe->nr_bufs == 0) {
+        if (pipe->writers == 0) {
+            return 0;
+        }
+        if (nonblock) {
+            set_errno(THUNDEROS_EAGAIN);
+            return -1;
+        }
+        pipe_sleep(pipe, &pipe->read_wait);
+        yield_lock(&pipe->lock);
+    }
+    return 1;
+}
+
+/**
+ * Wait with the lock held until need bytes can be added
+ * Returns 0 when they can, or -1 with EPIPE once the read end is closed
+ * or EAGAIN when nonblock is set.
+ */
+static int pipe_wait_room(pipe_t *pipe, uint32_t need, int whole_pages, int nonblock) {
+    while (1) {
+        if (pipe->readers == 0) {
+            RETURN_ERRNO(THUNDEROS_EPIPE);
+        }
+        if (pipe_room(pipe, whole_pages) >= need) {
+            return 0;
+        }
+        if (nonblock) {
+            RETURN_ERRNO(THUNDEROS_EAGAIN);
+        }
+        pipe_sleep(pipe, &pipe->write_wait);
+        yield_lock(&pipe->lock);
+    }
+}
+
+/**
+ * Get an empty page, the spare one if there is one
+ */
+static uint8_t *pipe_page_get(pipe_t *pipe) {
+    uint8_t *page = pipe->spare;
+    if (page) {
+        pipe->spare = NULL;
+        return page;
+    }
+    return (uint8_t *)pmm_alloc_page();
+}
+
+/**
+ * Give back an emptied page, keeping it as the spare if there is none
+ */
+static void pipe_page_put(pipe_t *pipe, uint8_t *page) {
+    if (!pipe->spare) {
+        pipe->spare = page;
+    } else {
+        pmm_free_page((uintptr_t)page);
+    }
+}
+
+/**
+ * Append an empty buffer to the ring (which must have a free slot)
+ * Returns NULL with ENOMEM if no page is available.
+ */
+static pipe_buffer_t *pipe_push(pipe_t *pipe) {
+    uint8_t *page = pipe_page_get(pipe);
+    if (!page) {
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    
+    pipe_buffer_t *buf = pipe_buf(pipe, pipe->nr_bufs++);
+    buf->page = page;
+    buf->offset = 0;
+    buf->len = 0;
+    return buf;
+}
+
+/**
+ * Remove the oldest buffer from the ring
+ */
+static void pipe_pop(pipe_t *pipe) {
+    pipe_page_put(pipe, pipe->ring[pipe->head].page);
+    pipe->head = (pipe->head + 1) % PIPE_BUFFERS;
+    pipe->nr_bufs--;
+}
+
+/**
+ * Free a pipe once both ends are closed
+ */
+static void pipe_release(pipe_t *pipe) {
+    while (pipe->nr_bufs > 0) {
+        pipe_pop(pipe);
+    }
+    if (pipe->spare) {
+        pmm_free_page((uintptr_t)pipe->spare);
+    }
+    kfree(pipe);
+}
+
+/**
+ * Read from a pipe through a buffer list
+ * Waits only while the pipe is empty, then returns what is there.
+ */
+int pipe_readv(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, int nonblock) {
+    pipe_t *pipe = (pipe_t *)node->fs_data;
+    
+    uint32_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += (uint32_t)iov[i].iov_len;
+    }
+    if (total == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    yield_lock(&pipe->lock);
+    
+    int ready = pipe_wait_data(pipe, nonblock);
+    if (ready <= 0) {
+        yield_unlock(&pipe->lock);
+        if (ready == 0) {
+            clear_errno();
+        }
+        return ready;
+    }
+    
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, iov, iovcnt);
+    
+    uint32_t done = 0;
+    while (done < total && pipe->nr_bufs > 0) {
+        pipe_buffer_t *buf = pipe_buf(pipe, 0);
+        uint32_t copied = vfs_iov_copy_to(&iter, buf->page + buf->offset, buf->len);
+        buf->offset += copied;
+        buf->len -= copied;
+        done += copied;
+        if (buf->len > 0) {
+            break;
+        }
+        pipe_pop(pipe);
+    }
+    
+    yield_unlock(&pipe->lock);
+    wait_queue_wake_all(&pipe->write_wait);
+    
+    clear_errno();
+    return (int)done;
+}
+
+/**
+ * Write to a pipe through a buffer list
+ * Writes of at most PIPE_BUF bytes wait until all of it fits, so they are
+ * never interleaved with other writers. Larger writes go in as room
+ * appears.
+ */
+int pipe_writev(vfs_node_t *node, const vfs_iovec_t *iov, int iovcnt, int nonblock) {
+    pipe_t *pipe = (pipe_t *)node->fs_data;
+    
+    uint32_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += (uint32_t)iov[i].iov_len;
+    }
+    if (total == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, iov, iovcnt);
+    
+    yield_lock(&pipe->lock);
+    
+    uint32_t need = (total <= PIPE_BUF) ? total : 1;
+    uint32_t done = 0;
+    int failed = 0;
+    while (done < total && !failed) {
+        if (pipe_wait_room(pipe, need, 0, nonblock) != 0) {
+            break;
+        }
+        
+        while (done < total) {
+            pipe_buffer_t *buf = pipe->nr_bufs > 0 ? pipe_buf(pipe, pipe->nr_bufs - 1) : NULL;
+            if (!buf || buf->offset + buf->len == PAGE_SIZE) {
+                if (pipe->nr_bufs == PIPE_BUFFERS) {
+                    break;
+                }
+                buf = pipe_push(pipe);
+                if (!buf) {
+                    failed = 1;
+                    break;
+                }
+            }
+            
+            uint32_t copied = vfs_iov_copy_from(&iter, buf->page + buf->offset + buf->len,
+                                                PAGE_SIZE - buf->offset - buf->len);
+            buf->len += copied;
+            done += copied;
+        }
+        
+        /* Let readers drain what is there before waiting for more room */
+        need = 1;
+        wait_queue_wake_all(&pipe->read_wait);
+    }
+    
+    yield_unlock(&pipe->lock);
+    
+    if (done == 0) {
+        /* errno already set by pipe_wait_room or pipe_push */
+        return -1;
+    }
+    clear_errno();
+    return (int)done;
+}
+
+/**
+ * Hand up to len bytes of a pipe's buffers to actor, oldest first
+ */
+int pipe_splice_read(vfs_node_t *node, pipe_actor_t actor, void *ctx, uint32_t len,
+                     int nonblock) {
+    pipe_t *pipe = (pipe_t *)node->fs_data;
+    
+    if (len == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    yield_lock(&pipe->lock);
+    
+    int ready = pipe_wait_data(pipe, nonblock || (node->flags & O_NONBLOCK));
+    if (ready <= 0) {
+        yield_unlock(&pipe->lock);
+        if (ready == 0) {
+            clear_errno();
+        }
+        return ready;
+    }
+    
+    uint32_t done = 0;
+    int failed = 0;
+    while (done < len && pipe->nr_bufs > 0) {
+        pipe_buffer_t *buf = pipe_buf(pipe, 0);
+        uint32_t chunk = buf->len < len - done ? buf->len : len - done;
+        
+        int moved = actor(ctx, buf->page + buf->offset, chunk);
+        if (moved < 0) {
+            failed = 1;
+            break;
+        }
+        buf->offset += moved;
+        buf->len -= moved;
+        done += moved;
+        
+        if (buf->len == 0) {
+            pipe_pop(pipe);
+        }
+        if ((uint32_t)moved < chunk) {
+            break;
+        }
+    }
+    
+    yield_unlock(&pipe->lock);
+    wait_queue_wake_all(&pipe->write_wait);
+    
+    if (failed && done == 0) {
+        /* errno already set by actor */
+        return -1;
+    }
+    clear_errno();
+    return (int)done;
+}
+
+/**
+ * Append up to len bytes to a pipe in fresh pages that actor fills
+ * Each page starts at offset 0, so a file opened with O_DIRECT can read
+ * straight into it.
+ */
+int pipe_splice_write(vfs_node_t *node, pipe_actor_t actor, void *ctx, uint32_t len,
+                      int nonblock) {
+    pipe_t *pipe = (pipe_t *)node->fs_data;
+    
+    if (len == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    yield_lock(&pipe->lock);
+    
+    if (pipe_wait_room(pipe, PAGE_SIZE, 1, nonblock || (node->flags & O_NONBLOCK)) != 0) {
+        yield_unlock(&pipe->lock);
+        /* errno already set by pipe_wait_room */
+        return -1;
+    }
+    
+    uint32_t done = 0;
+    int failed = 0;
+    while (done < len && pipe->nr_bufs < PIPE_BUFFERS) {
+        pipe_buffer_t *buf = pipe_push(pipe);
+        if (!buf) {
+            failed = 1;
+            break;
+        }
+        
+        uint32_t chunk = len - done < PAGE_SIZE ? len - done : PAGE_SIZE;
+        int filled = actor(ctx, buf->page, chunk);
+        if (filled <= 0) {
+            /* Nothing to add; take the empty buffer off again */
+            pipe->nr_bufs--;
+            pipe_page_put(pipe, buf->page);
+            failed = (filled < 0);
+            break;
+        }
+        buf->len = (uint32_t)filled;
+        done += filled;
+        
+        if ((uint32_t)filled < chunk) {
+            break;
+        }
+    }
+    
+    yield_unlock(&pipe->lock);
+    wait_queue_wake_all(&pipe->read_wait);
+    
+    if (failed && done == 0) {
+        /* errno already set by pipe_push or actor */
+        return -1;
+    }
+    clear_errno();
+    return (int)done;
+}
+
+/**
+ * Move up to len bytes from one pipe to another
+ */
+int pipe_splice_pipe(vfs_node_t *in_node, vfs_node_t *out_node, uint32_t len, int nonblock) {
+    pipe_t *in = (pipe_t *)in_node->fs_data;
+    pipe_t *out = (pipe_t *)out_node->fs_data;
+    
+    if (in == out) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (len == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    pipe_lock_two(in, out);
+    
+    /* Wait for data on one side and a free slot on the other */
+    while (1) {
+        if (out->readers == 0) {
+            yield_unlock(&in->lock);
+            yield_unlock(&out->lock);
+            RETURN_ERRNO(THUNDEROS_EPIPE);
+        }
+        
+        if (in->nr_bufs == 0) {
+            if (in->writers == 0) {
+                yield_unlock(&in->lock);
+                yield_unlock(&out->lock);
+                clear_errno();
+                return 0;
+            }
+            if (nonblock || (in_node->flags & O_NONBLOCK)) {
+                yield_unlock(&in->lock);
+                yield_unlock(&out->lock);
+                RETURN_ERRNO(THUNDEROS_EAGAIN);
+            }
+            yield_unlock(&out->lock);
+            pipe_sleep(in, &in->read_wait);
+        } else if (out->nr_bufs == PIPE_BUFFERS) {
+            if (nonblock || (out_node->flags & O_NONBLOCK)) {
+                yield_unlock(&in->lock);
+                yield_unlock(&out->lock);
+                RETURN_ERRNO(THUNDEROS_EAGAIN);
+            }
+            yield_unlock(&in->lock);
+            pipe_sleep(out, &out->write_wait);
+        } else {
+            break;
+        }
+        
+        pipe_lock_two(in, out);
+    }
+    
+    uint32_t done = 0;
+    while (done < len && in->nr_bufs > 0 && out->nr_bufs < PIPE_BUFFERS) {
+        pipe_buffer_t *src = pipe_buf(in, 0);
+        pipe_buffer_t *dst = pipe_buf(out, out->nr_bufs);
+        
+        if (src->len <= len - done) {
+            /* Whole buffer: the page changes hands */
+            *dst = *src;
+            out->nr_bufs++;
+            done += src->len;
+            in->head = (in->head + 1) % PIPE_BUFFERS;
+            in->nr_bufs--;
+        } else {
+            /* Part of a buffer: copy that part into a page of the output */
+            uint8_t *page = pipe_page_get(out);
+            if (!page) {
+                set_errno(THUNDEROS_ENOMEM);
+                break;
+            }
+            
+            uint32_t chunk = len - done;
+            kmemcpy(page, src->page + src->offset, chunk);
+            dst->page = page;
+            dst->offset = 0;
+            dst->len = chunk;
+            out->nr_bufs++;
+            src->offset += chunk;
+            src->len -= chunk;
+            done += chunk;
+        }
+    }
+    
+    yield_unlock(&in->lock);
+    yield_unlock(&out->lock);
+    wait_queue_wake_all(&in->write_wait);
+    wait_queue_wake_all(&out->read_wait);
+    
+    if (done == 0) {
+        /* errno already set: no page for a partial buffer */
+        return -1;
+    }
+    clear_errno();
+    return (int)done;
+}
+
+/**
+ * VFS read operation of the read end
+ */
+static int pipe_vfs_readv(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov, int iovcnt) {
+    (void)offset;
+    return pipe_readv(node, iov, iovcnt, node->flags & O_NONBLOCK);
+}
+
+/**
+ * VFS write operation of the write end
+ */
+static int pipe_vfs_writev(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov,
+                           int iovcnt) {
+    (void)offset;
+    return pipe_writev(node, iov, iovcnt, node->flags & O_NONBLOCK);
+}
+
+/**
+ * Close the read end: writers get EPIPE from now on
+ */
+static void pipe_read_close(vfs_node_t *node) {
+    pipe_t *pipe = (pipe_t *)node->fs_data;
+    
+    yield_lock(&pipe->lock);
+    pipe->readers--;
+    int last = (pipe->readers == 0 && pipe->writers == 0);
+    yield_unlock(&pipe->lock);
+    
+    if (last) {
+        pipe_release(pipe);
+    } else {
+        wait_queue_wake_all(&pipe->write_wait);
+    }
+}
+
+/**
+ * Close the write end: readers see end of file once the pipe is drained
+ */
+static void pipe_write_close(vfs_node_t *node) {
+    pipe_t *pipe = (pipe_t *)node->fs_data;
+    
+    yield_lock(&pipe->lock);
+    pipe->writers--;
+    int last = (pipe->readers == 0 && pipe->writers == 0);
+    yield_unlock(&pipe->lock);
+    
+    if (last) {
+        pipe_release(pipe);
+    } else {
+        wait_queue_wake_all(&pipe->read_wait);
+    }
+}
+
+/**
+ * Poll operation of the read end: readable with data queued or no writers
+ */
+static uint32_t pipe_read_poll(vfs_node_t *node, struct poll_table *pt) {
+    pipe_t *pipe = (pipe_t *)node->fs_data;
+    poll_wait(pt, &pipe->read_wait);
+    
+    uint32_t events = 0;
+    yield_lock(&pipe->lock);
+    if (pipe->nr_bufs > 0) {
+        events |= POLLIN;
+    }
+    if (pipe->writers == 0) {
+        events |= POLLHUP;
+    }
+    yield_unlock(&pipe->lock);
+    return events;
+}
+
+/**
+ * Poll operation of the write end: writable with a free buffer
+ */
+static uint32_t pipe_write_poll(vfs_node_t *node, struct poll_table *pt) {
+    pipe_t *pipe = (pipe_t *)node->fs_data;
+    poll_wait(pt, &pipe->write_wait);
+    
+    uint32_t events = 0;
+    yield_lock(&pipe->lock);
+    if (pipe->nr_bufs < PIPE_BUFFERS) {
+        events |= POLLOUT;
+    }
+    if (pipe->readers == 0) {
+        events |= POLLERR;
+    }
+    yield_unlock(&pipe->lock);
+    return events;
+}
+
+static vfs_ops_t pipe_read_ops = {
+    .readv = pipe_vfs_readv,
+    .close = pipe_read_close,
+    .poll = pipe_read_poll,
+};
+
+static vfs_ops_t pipe_write_ops = {
+    .writev = pipe_vfs_writev,
+    .close = pipe_write_close,
+    .poll = pipe_write_poll,
+};
+
+/**
+ * Set up the node of one end of a pipe
+ */
+static void pipe_init_node(vfs_node_t *node, pipe_t *pipe, vfs_ops_t *ops, uint32_t flags) {
+    kstrcpy(node->name, "pipe");
+    node->inode = 0;
+    node->size = 0;
+    node->type = VFS_TYPE_PIPE;
+    node->flags = flags & O_NONBLOCK;
+    node->fs = NULL;
+    node->fs_data = pipe;
+    node->ops = ops;
+}
+
+/**
+ * Create a pipe
+ */
+int pipe_create(vfs_node_t **read_end, vfs_node_t **write_end, uint32_t flags) {
+    pipe_t *pipe = (pipe_t *)kmalloc(sizeof(pipe_t));
+    if (!pipe) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    kmemset(pipe, 0, sizeof(pipe_t));
+    pipe->readers = 1;
+    pipe->writers = 1;
+    wait_queue_init(&pipe->read_wait);
+    wait_queue_init(&pipe->write_wait);
+    pipe_init_node(&pipe->read_node, pipe, &pipe_read_ops, flags);
+    pipe_init_node(&pipe->write_node, pipe, &pipe_write_ops, flags);
+    
+    *read_end = &pipe->read_node;
+    *write_end = &pipe->write_node;
+    clear_errno();
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * shm.c - Shared memory objects
+ *
+ * The objects are regular files in a private tmpfs, created the first time
+ * one is needed. A memfd is a file whose name is removed as soon as it is
+ * opened.
+ */
+
+#include "../../include/fs/shm.h"
+#include "../../include/fs/vfs.h"
+#include "../../include/fs/tmpfs.h"
+#include "../../include/kernel/kstring.h"
+#include "../../include/kernel/process.h"
+#include "../../include/kernel/errno.h"
+#include <stddef.h>
+
+static vfs_filesystem_t *shm_fs;
+static volatile int shm_setup_lock;
+static uint32_t memfd_serial;
+
+/**
+ * Root directory of the shared memory tmpfs, creating it on first use
+ */
+static vfs_node_t *shm_root(void) {
+    if (shm_fs) {
+        return shm_fs->root;
+    }
+    
+    while (__sync_lock_test_and_set(&shm_setup_lock, 1)) {
+        process_yield();
+    }
+    if (!shm_fs) {
+        shm_fs = tmpfs_create(SHM_SIZE);
+    }
+    __sync_lock_release(&shm_setup_lock);
+    
+    if (!shm_fs) {
+        /* errno already set by tmpfs_create */
+        return NULL;
+    }
+    return shm_fs->root;
+}
+
+/**
+ * Strip the leading '/' of an object name and check what is left
+ * Returns the name to use in the tmpfs, or NULL with errno set.
+ */
+static const char *shm_name(const char *name) {
+    if (!name) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    if (name[0] == '/') {
+        name++;
+    }
+    
+    size_t len = kstrlen(name);
+    int dots = name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.'));
+    if (len == 0 || len > TMPFS_NAME_MAX || dots) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] == '/') {
+            set_errno(THUNDEROS_EINVAL);
+            return NULL;
+        }
+    }
+    return name;
+}
+
+/**
+ * Open a named shared memory object
+ */
+int shm_open(const char *name, uint32_t flags) {
+    const char *object = shm_name(name);
+    if (!object) {
+        /* errno already set by shm_name */
+        return -1;
+    }
+    if (flags & (O_APPEND | O_DIRECT)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    vfs_node_t *root = shm_root();
+    if (!root) {
+        /* errno already set by shm_root */
+        return -1;
+    }
+    
+    /* errno set by vfs_open_at */
+    return vfs_open_at(root, object, flags);
+}
+
+/**
+ * Remove the name of a shared memory object
+ */
+int shm_unlink(const char *name) {
+    const char *object = shm_name(name);
+    if (!object) {
+        /* errno already set by shm_name */
+        return -1;
+    }
+    
+    vfs_node_t *root = shm_root();
+    if (!root) {
+        /* errno already set by shm_root */
+        return -1;
+    }
+    
+    /* errno set by unlink */
+    return root->ops->unlink(root, object);
+}
+
+/**
+ * Create an anonymous shared memory object
+ */
+int memfd_create(const char *name, uint32_t flags) {
+    if (!name || (flags & ~MFD_CLOEXEC)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    vfs_node_t *root = shm_root();
+    if (!root) {
+        /* errno already set by shm_root */
+        return -1;
+    }
+    
+    /*
+     * The name starts with '/', which shm_open() never leaves in a name,
+     * so nobody can open the object before it is removed
+     */
+    char object[TMPFS_NAME_MAX + 1];
+    char serial[12];
+    uint32_t n = __sync_add_and_fetch(&memfd_serial, 1);
+    int digits = 0;
+    do {
+        serial[digits++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    
+    size_t len = 0;
+    const char *prefix = "/memfd:";
+    while (*prefix) {
+        object[len++] = *prefix++;
+    }
+    while (digits > 0) {
+        object[len++] = serial[--digits];
+    }
+    object[len++] = ':';
+    for (size_t i = 0; name[i] && len < TMPFS_NAME_MAX; i++) {
+        object[len++] = name[i];
+    }
+    object[len] = '\0';
+    
+    uint32_t open_flags = O_RDWR | O_CREAT | O_EXCL;
+    if (flags & MFD_CLOEXEC) {
+        open_flags |= O_CLOEXEC;
+    }
+    int fd = vfs_open_at(root, object, open_flags);
+    if (fd < 0) {
+        /* errno already set by vfs_open_at */
+        return -1;
+    }
+    
+    /* The open file keeps the inode alive once its name is gone */
+    root->ops->unlink(root, object);
+    clear_errno();
+    return fd;
+}
@@ -0,0 +1,1020 @@
+/*
+ * squashfs.c - Read-only compressed filesystem
+ *
+ * The image is read from its block device in whole sectors. Inodes,
+ * directory listings and the fragment table live in 8 KiB metadata blocks
+ * that are decompressed whole and kept in a small LRU cache, so walking a
+ * directory or loading several inodes from one block costs one read.
+ * File data is split into block_size blocks, each compressed on its own,
+ * and the tails of small files share fragment blocks. Decompressed data
+ * blocks go into a second cache, so a block is read and decompressed once
+ * however the file is read, and small files packed into one fragment
+ * block share a single read.
+ *
+ * Looked-up inodes are kept for the lifetime of the filesystem, so lookups
+ * return the same node every time. Symbolic links and special files are
+ * not shown.
+ */
+
+#include "../../include/fs/squashfs.h"
+#include "../../include/fs/vfs.h"
+#include "../../include/drivers/virtio_blk.h"
+#include "../../include/mm/kmalloc.h"
+#include "../../include/kernel/kstring.h"
+#include "../../include/kernel/lz4.h"
+#include "../../include/kernel/lock.h"
+#include "../../include/kernel/errno.h"
+#include "../../include/hal/hal_uart.h"
+#include <stddef.h>
+
+/* Longest name a VFS node holds */
+#define SQUASHFS_NAME_MAX 255
+
+/* Fragment entries per metadata block */
+#define SQUASHFS_FRAGMENTS_PER_BLOCK (SQUASHFS_METADATA_SIZE / sizeof(squashfs_fragment_entry_t))
+
+/* getdents cookies 0 and 1 are "." and ".."; entries start here */
+#define SQUASHFS_FIRST_COOKIE 2
+
+/**
+ * Decompressed block in a cache
+ * Offset 0 holds the superblock, so no cached block starts there.
+ */
+typedef struct {
+    uint64_t pos;                      /* Disk offset of the block, 0 if unused */
+    uint64_t next;                     /* Disk offset of the following metadata block */
+    uint32_t length;                   /* Decompressed bytes */
+    uint32_t last_used;                /* LRU stamp */
+    uint8_t *data;                     /* Decompressed contents */
+} squashfs_cache_entry_t;
+
+/**
+ * In-memory inode
+ */
+typedef struct squashfs_inode {
+    vfs_node_t node;                   /* VFS view; node.fs_data points here */
+    struct squashfs_inode *hash_next;  /* Next inode in the bucket */
+    struct squashfs_inode *parent;     /* Directory it was found in */
+    uint64_t ref;                      /* Inode reference */
+    uint64_t file_size;
+    
+    /* Directories */
+    uint64_t dir_block;                /* Disk offset of the listing's first block */
+    uint32_t dir_offset;               /* Listing offset inside that block */
+    uint32_t dir_size;                 /* Listing size in bytes */
+    uint32_t parent_ino;               /* Inode number of the parent */
+    
+    /* Regular files */
+    uint32_t nr_blocks;                /* Full blocks outside the fragment */
+    uint32_t *block_sizes;             /* On-disk size word of each block */
+    uint64_t *block_pos;               /* Disk offset of each block */
+    uint32_t fragment;                 /* Fragment index or SQUASHFS_INVALID_FRAG */
+    uint32_t frag_offset;              /* Tail offset inside the fragment block */
+    int frag_loaded;                   /* frag_start and frag_size are valid */
+    uint64_t frag_start;
+    uint32_t frag_size;
+} squashfs_inode_t;
+
+/**
+ * Filesystem instance
+ */
+typedef struct {
+    yield_lock_t lock;                 /* Serializes filesystem operations */
+    virtio_blk_device_t *dev;          /* Device holding the image */
+    squashfs_super_t sb;
+    uint32_t block_size;
+    uint64_t *fragment_index;          /* Disk offsets of fragment table blocks */
+    uint8_t *io_buffer;                /* Sectors being read */
+    uint32_t io_size;
+    squashfs_cache_entry_t meta[SQUASHFS_META_CACHE];
+    squashfs_cache_entry_t data[SQUASHFS_DATA_CACHE];
+    uint32_t clock;                    /* LRU time */
+    squashfs_inode_t *nodes[SQUASHFS_NODE_BUCKETS];
+    squashfs_inode_t *root;
+} squashfs_t;
+
+/**
+ * Position in a directory listing
+ */
+typedef struct {
+    uint64_t block;                    /* Metadata block being read */
+    uint32_t offset;                   /* Offset inside it */
+    uint32_t used;                     /* Listing bytes consumed */
+    uint32_t size;                     /* Listing size */
+    uint32_t remaining;                /* Entries left under the current header */
+    squashfs_dir_header_t header;      /* Current header */
+} squashfs_dir_iter_t;
+
+static vfs_ops_t squashfs_ops;
+
+/**
+ * Filesystem and inode behind a VFS node
+ */
+static squashfs_t *node_fs(vfs_node_t *node) {
+    return (squashfs_t *)node->fs->fs_data;
+}
+
+static squashfs_inode_t *node_inode(vfs_node_t *node) {
+    return (squashfs_inode_t *)node->fs_data;
+}
+
+/**
+ * Check that a node belongs to a squashfs
+ */
+static int valid_node(vfs_node_t *node) {
+    return node && node->fs && node->fs->fs_data && node->fs_data;
+}
+
+/**
+ * Byte-wise string comparison, the order mksquashfs sorts entries in
+ */
+static int name_compare(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return (int)(uint8_t)*a - (int)(uint8_t)*b;
+}
+
+/**
+ * Read bytes of the image
+ * Returns a pointer into the I/O buffer, valid until the next read.
+ */
+static const uint8_t *read_image(squashfs_t *fs, uint64_t pos, uint32_t len) {
+    if (len == 0 || pos + len > fs->sb.bytes_used) {
+        set_errno(THUNDEROS_EIO);
+        return NULL;
+    }
+    
+    uint64_t sector = pos / VIRTIO_BLK_SECTOR_SIZE;
+    uint32_t skip = (uint32_t)(pos % VIRTIO_BLK_SECTOR_SIZE);
+    uint32_t count = (skip + len + VIRTIO_BLK_SECTOR_SIZE - 1) / VIRTIO_BLK_SECTOR_SIZE;
+    if (count * VIRTIO_BLK_SECTOR_SIZE > fs->io_size) {
+        set_errno(THUNDEROS_EIO);
+        return NULL;
+    }
+    
+    if (virtio_blk_read_dev(fs->dev, sector, fs->io_buffer, count) < 0) {
+        /* errno already set by virtio_blk_read_dev */
+        return NULL;
+    }
+    return fs->io_buffer + skip;
+}
+
+/**
+ * Find a cached block, or pick the least recently used entry for it
+ */
+static squashfs_cache_entry_t *cache_lookup(squashfs_t *fs, squashfs_cache_entry_t *cache,
+                                            uint32_t count, uint64_t pos, int *hit) {
+    squashfs_cache_entry_t *victim = &cache[0];
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (cache[i].pos == pos) {
+            cache[i].last_used = ++fs->clock;
+            *hit = 1;
+            return &cache[i];
+        }
+        if (cache[i].pos == 0) {
+            victim = &cache[i];
+        } else if (victim->pos != 0 && cache[i].last_used < victim->last_used) {
+            victim = &cache[i];
+        }
+    }
+    
+    victim->pos = 0;
+    victim->last_used = ++fs->clock;
+    *hit = 0;
+    return victim;
+}
+
+/**
+ * Get a decompressed metadata block
+ */
+static squashfs_cache_entry_t *meta_block(squashfs_t *fs, uint64_t pos) {
+    int hit;
+    squashfs_cache_entry_t *entry = cache_lookup(fs, fs->meta, SQUASHFS_META_CACHE, pos, &hit);
+    if (hit) {
+        return entry;
+    }
+    
+    /* The length is in the block's header; read the largest block at once */
+    if (pos + 2 > fs->sb.bytes_used) {
+        set_errno(THUNDEROS_EIO);
+        return NULL;
+    }
+    uint64_t avail = fs->sb.bytes_used - pos;
+    uint32_t len = avail < SQUASHFS_METADATA_SIZE + 2 ? (uint32_t)avail : SQUASHFS_METADATA_SIZE + 2;
+    const uint8_t *raw = read_image(fs, pos, len);
+    if (!raw) {
+        /* errno already set by read_image */
+        return NULL;
+    }
+    
+    uint16_t header = raw[0] | ((uint16_t)raw[1] << 8);
+    uint32_t stored = SQUASHFS_META_LENGTH(header);
+    if (stored == 0 || stored > SQUASHFS_METADATA_SIZE || stored + 2 > len) {
+        hal_uart_puts("squashfs: Bad metadata block header\n");
+        set_errno(THUNDEROS_EIO);
+        return NULL;
+    }
+    
+    int length;
+    if (header & SQUASHFS_META_UNCOMPRESSED) {
+        kmemcpy(entry->data, raw + 2, stored);
+        length = (int)stored;
+    } else {
+        length = lz4_decompress(raw + 2, stored, entry->data, SQUASHFS_METADATA_SIZE);
+        if (length <= 0) {
+            hal_uart_puts("squashfs: Corrupt metadata block\n");
+            set_errno(THUNDEROS_EIO);
+            return NULL;
+        }
+    }
+    
+    entry->pos = pos;
+    entry->next = pos + 2 + stored;
+    entry->length = (uint32_t)length;
+    return entry;
+}
+
+/**
+ * Read bytes from metadata, advancing the position across blocks
+ */
+static int meta_read(squashfs_t *fs, uint64_t *block, uint32_t *offset, void *dst, uint32_t len) {
+    uint8_t *out = (uint8_t *)dst;
+    
+    while (len > 0) {
+        squashfs_cache_entry_t *entry = meta_block(fs, *block);
+        if (!entry) {
+            /* errno already set by meta_block */
+            return -1;
+        }
+        if (*offset > entry->length) {
+            RETURN_ERRNO(THUNDEROS_EIO);
+        }
+        
+        uint32_t chunk = entry->length - *offset;
+        if (chunk > len) {
+            chunk = len;
+        }
+        kmemcpy(out, entry->data + *offset, chunk);
+        out += chunk;
+        len -= chunk;
+        *offset += chunk;
+        
+        if (*offset == entry->length) {
+            *block = entry->next;
+            *offset = 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Get a decompressed data or fragment block
+ * size is the on-disk size word. Returns NULL for a sparse block.
+ */
+static squashfs_cache_entry_t *data_block(squashfs_t *fs, uint64_t pos, uint32_t size) {
+    int hit;
+    squashfs_cache_entry_t *entry = cache_lookup(fs, fs->data, SQUASHFS_DATA_CACHE, pos, &hit);
+    if (hit) {
+        return entry;
+    }
+    
+    uint32_t stored = SQUASHFS_DATA_LENGTH(size);
+    if (stored == 0 || stored > fs->block_size) {
+        set_errno(THUNDEROS_EIO);
+        return NULL;
+    }
+    const uint8_t *raw = read_image(fs, pos, stored);
+    if (!raw) {
+        /* errno already set by read_image */
+        return NULL;
+    }
+    
+    int length;
+    if (size & SQUASHFS_DATA_UNCOMPRESSED) {
+        kmemcpy(entry->data, raw, stored);
+        length = (int)stored;
+    } else {
+        length = lz4_decompress(raw, stored, entry->data, fs->block_size);
+        if (length <= 0) {
+            hal_uart_puts("squashfs: Corrupt data block\n");
+            set_errno(THUNDEROS_EIO);
+            return NULL;
+        }
+    }
+    
+    entry->pos = pos;
+    entry->length = (uint32_t)length;
+    return entry;
+}
+
+/**
+ * Load the fragment table entry of a file
+ */
+static int load_fragment(squashfs_t *fs, squashfs_inode_t *inode) {
+    uint32_t index = inode->fragment;
+    if (!fs->fragment_index || index >= fs->sb.fragments) {
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    uint64_t block = fs->fragment_index[index / SQUASHFS_FRAGMENTS_PER_BLOCK];
+    uint32_t offset = (index % SQUASHFS_FRAGMENTS_PER_BLOCK) * sizeof(squashfs_fragment_entry_t);
+    squashfs_fragment_entry_t entry;
+    if (meta_read(fs, &block, &offset, &entry, sizeof(entry)) != 0) {
+        /* errno already set by meta_read */
+        return -1;
+    }
+    
+    inode->frag_start = entry.start_block;
+    inode->frag_size = entry.size;
+    inode->frag_loaded = 1;
+    return 0;
+}
+
+/**
+ * Hash an inode reference
+ */
+static uint32_t ref_hash(uint64_t ref) {
+    return (uint32_t)((ref >> 16) ^ (ref * 2654435761U)) & (SQUASHFS_NODE_BUCKETS - 1);
+}
+
+/**
+ * Read the block list of a regular file
+ */
+static int load_block_list(squashfs_t *fs, squashfs_inode_t *inode, uint64_t start,
+                           uint64_t *block, uint32_t *offset) {
+    uint64_t count = inode->file_size / fs->block_size;
+    if (inode->fragment == SQUASHFS_INVALID_FRAG && (inode->file_size % fs->block_size) != 0) {
+        count++;
+    }
+    inode->nr_blocks = (uint32_t)count;
+    if (count == 0) {
+        return 0;
+    }
+    if (count > 0xFFFFFFFFU / 12) {
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    /* Offsets first, for their alignment */
+    uint8_t *lists = (uint8_t *)kmalloc(count * (sizeof(uint64_t) + sizeof(uint32_t)));
+    if (!lists) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    inode->block_pos = (uint64_t *)lists;
+    inode->block_sizes = (uint32_t *)(lists + count * sizeof(uint64_t));
+    
+    if (meta_read(fs, block, offset, inode->block_sizes, (uint32_t)count * sizeof(uint32_t)) != 0) {
+        kfree(lists);
+        inode->block_pos = NULL;
+        inode->block_sizes = NULL;
+        /* errno already set by meta_read */
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        inode->block_pos[i] = start;
+        start += SQUASHFS_DATA_LENGTH(inode->block_sizes[i]);
+    }
+    return 0;
+}
+
+/**
+ * Get the inode for a reference, reading it on first use
+ */
+static squashfs_inode_t *get_inode(squashfs_t *fs, vfs_filesystem_t *vfs_fs, uint64_t ref,
+                                   const char *name, squashfs_inode_t *parent) {
+    uint32_t bucket = ref_hash(ref);
+    for (squashfs_inode_t *inode = fs->nodes[bucket]; inode; inode = inode->hash_next) {
+        if (inode->ref == ref) {
+            return inode;
+        }
+    }
+    
+    uint64_t block = fs->sb.inode_table_start + SQUASHFS_REF_BLOCK(ref);
+    uint32_t offset = SQUASHFS_REF_OFFSET(ref);
+    union {
+        squashfs_base_inode_t base;
+        squashfs_dir_inode_t dir;
+        squashfs_ldir_inode_t ldir;
+        squashfs_reg_inode_t reg;
+        squashfs_lreg_inode_t lreg;
+    } raw;
+    
+    if (meta_read(fs, &block, &offset, &raw.base, sizeof(raw.base)) != 0) {
+        /* errno already set by meta_read */
+        return NULL;
+    }
+    
+    squashfs_inode_t *inode = (squashfs_inode_t *)kmalloc(sizeof(squashfs_inode_t));
+    if (!inode) {
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    kmemset(inode, 0, sizeof(squashfs_inode_t));
+    inode->ref = ref;
+    inode->parent = parent ? parent : inode;
+    inode->fragment = SQUASHFS_INVALID_FRAG;
+    
+    uint8_t *rest = (uint8_t *)&raw + sizeof(raw.base);
+    uint32_t type;
+    int result;
+    
+    switch (raw.base.inode_type) {
+    case SQUASHFS_DIR_TYPE:
+        result = meta_read(fs, &block, &offset, rest, sizeof(raw.dir) - sizeof(raw.base));
+        inode->dir_block = fs->sb.directory_table_start + raw.dir.start_block;
+        inode->dir_offset = raw.dir.offset;
+        inode->file_size = raw.dir.file_size;
+        inode->parent_ino = raw.dir.parent_inode;
+        type = VFS_TYPE_DIRECTORY;
+        break;
+    case SQUASHFS_LDIR_TYPE:
+        result = meta_read(fs, &block, &offset, rest, sizeof(raw.ldir) - sizeof(raw.base));
+        inode->dir_block = fs->sb.directory_table_start + raw.ldir.start_block;
+        inode->dir_offset = raw.ldir.offset;
+        inode->file_size = raw.ldir.file_size;
+        inode->parent_ino = raw.ldir.parent_inode;
+        type = VFS_TYPE_DIRECTORY;
+        break;
+    case SQUASHFS_REG_TYPE:
+        result = meta_read(fs, &block, &offset, rest, sizeof(raw.reg) - sizeof(raw.base));
+        inode->file_size = raw.reg.file_size;
+        inode->fragment = raw.reg.fragment;
+        inode->frag_offset = raw.reg.offset;
+        if (result == 0) {
+            result = load_block_list(fs, inode, raw.reg.start_block, &block, &offset);
+        }
+        type = VFS_TYPE_FILE;
+        break;
+    case SQUASHFS_LREG_TYPE:
+        result = meta_read(fs, &block, &offset, rest, sizeof(raw.lreg) - sizeof(raw.base));
+        inode->file_size = raw.lreg.file_size;
+        inode->fragment = raw.lreg.fragment;
+        inode->frag_offset = raw.lreg.offset;
+        if (result == 0) {
+            result = load_block_list(fs, inode, raw.lreg.start_block, &block, &offset);
+        }
+        type = VFS_TYPE_FILE;
+        break;
+    default:
+        set_errno(THUNDEROS_EINVAL);
+        result = -1;
+        type = 0;
+        break;
+    }
+    
+    /* An empty directory still counts "." "..", and the terminating NUL, as 3 bytes */
+    if (result == 0 && type == VFS_TYPE_DIRECTORY) {
+        if (inode->file_size < 3) {
+            set_errno(THUNDEROS_EIO);
+            result = -1;
+        } else {
+            inode->dir_size = (uint32_t)inode->file_size - 3;
+        }
+    }
+    if (result != 0) {
+        kfree(inode->block_pos);
+        kfree(inode);
+        /* errno already set above */
+        return NULL;
+    }
+    
+    kstrncpy(inode->node.name, name, sizeof(inode->node.name) - 1);
+    inode->node.name[sizeof(inode->node.name) - 1] = '\0';
+    inode->node.inode = raw.base.inode_number;
+    inode->node.size = inode->file_size;
+    inode->node.type = type;
+    inode->node.flags = 0;
+    inode->node.fs = vfs_fs;
+    inode->node.fs_data = inode;
+    inode->node.ops = &squashfs_ops;
+    
+    inode->hash_next = fs->nodes[bucket];
+    fs->nodes[bucket] = inode;
+    return inode;
+}
+
+/**
+ * Start reading a directory listing
+ */
+static void dir_iter_init(squashfs_dir_iter_t *iter, squashfs_inode_t *dir) {
+    iter->block = dir->dir_block;
+    iter->offset = dir->dir_offset;
+    iter->used = 0;
+    iter->size = dir->dir_size;
+    iter->remaining = 0;
+}
+
+/**
+ * Read the next entry of a directory listing
+ * name must hold SQUASHFS_NAME_MAX + 2 bytes.
+ * Returns 1 with the entry, 0 at the end, -1 on error.
+ */
+static int dir_iter_next(squashfs_t *fs, squashfs_dir_iter_t *iter,
+                         squashfs_dir_entry_t *entry, char *name) {
+    if (iter->remaining == 0) {
+        if (iter->used >= iter->size) {
+            return 0;
+        }
+        if (meta_read(fs, &iter->block, &iter->offset, &iter->header, sizeof(iter->header)) != 0) {
+            /* errno already set by meta_read */
+            return -1;
+        }
+        iter->used += sizeof(iter->header);
+        
+        /* mksquashfs starts a new header every 256 entries */
+        if (iter->header.count >= 256) {
+            RETURN_ERRNO(THUNDEROS_EIO);
+        }
+        iter->remaining = iter->header.count + 1;
+    }
+    
+    if (meta_read(fs, &iter->block, &iter->offset, entry, sizeof(*entry)) != 0) {
+        /* errno already set by meta_read */
+        return -1;
+    }
+    uint32_t name_len = (uint32_t)entry->size + 1;
+    if (name_len > SQUASHFS_NAME_MAX + 1) {
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    if (meta_read(fs, &iter->block, &iter->offset, name, name_len) != 0) {
+        /* errno already set by meta_read */
+        return -1;
+    }
+    name[name_len] = '\0';
+    
+    iter->used += sizeof(*entry) + name_len;
+    iter->remaining--;
+    return 1;
+}
+
+/**
+ * Check whether an entry is shown through the VFS
+ */
+static int entry_visible(const squashfs_dir_entry_t *entry, const char *name) {
+    return (entry->type == SQUASHFS_DIR_TYPE || entry->type == SQUASHFS_REG_TYPE) &&
+           kstrlen(name) <= SQUASHFS_NAME_MAX;
+}
+
+/**
+ * Read from a squashfs file via VFS
+ */
+static int squashfs_read(vfs_node_t *node, uint64_t offset, void *buffer, uint32_t size) {
+    if (!valid_node(node) || !buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    squashfs_t *fs = node_fs(node);
+    squashfs_inode_t *inode = node_inode(node);
+    uint8_t *out = (uint8_t *)buffer;
+    uint32_t done = 0;
+    
+    if (offset >= inode->file_size) {
+        clear_errno();
+        return 0;
+    }
+    if (size > inode->file_size - offset) {
+        size = (uint32_t)(inode->file_size - offset);
+    }
+    
+    yield_lock(&fs->lock);
+    
+    while (done < size) {
+        uint64_t pos = offset + done;
+        uint64_t index = pos >> fs->sb.block_log;
+        uint32_t in_block = (uint32_t)(pos & (fs->block_size - 1));
+        uint32_t chunk = fs->block_size - in_block;
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+        
+        squashfs_cache_entry_t *block;
+        uint32_t start = in_block;
+        
+        if (index < inode->nr_blocks) {
+            uint32_t word = inode->block_sizes[index];
+            if (SQUASHFS_DATA_LENGTH(word) == 0) {
+                /* Sparse block */
+                kmemset(out + done, 0, chunk);
+                done += chunk;
+                continue;
+            }
+            block = data_block(fs, inode->block_pos[index], word);
+        } else {
+            /* The tail lives in a fragment block */
+            if (inode->fragment == SQUASHFS_INVALID_FRAG ||
+                (!inode->frag_loaded && load_fragment(fs, inode) != 0)) {
+                yield_unlock(&fs->lock);
+                if (inode->fragment == SQUASHFS_INVALID_FRAG) {
+                    RETURN_ERRNO(THUNDEROS_EIO);
+                }
+                /* errno already set by load_fragment */
+                return -1;
+            }
+            block = data_block(fs, inode->frag_start, inode->frag_size);
+            start += inode->frag_offset;
+        }
+        
+        if (!block) {
+            yield_unlock(&fs->lock);
+            /* errno already set by data_block */
+            return -1;
+        }
+        if (start + chunk > block->length) {
+            yield_unlock(&fs->lock);
+            RETURN_ERRNO(THUNDEROS_EIO);
+        }
+        kmemcpy(out + done, block->data + start, chunk);
+        done += chunk;
+    }
+    
+    yield_unlock(&fs->lock);
+    clear_errno();
+    return (int)done;
+}
+
+/**
+ * Refuse to change a read-only filesystem via VFS
+ */
+static int squashfs_write(vfs_node_t *node, uint64_t offset, const void *buffer, uint32_t size) {
+    (void)node;
+    (void)offset;
+    (void)buffer;
+    (void)size;
+    RETURN_ERRNO(THUNDEROS_EFS_RDONLY);
+}
+
+static int squashfs_create(vfs_node_t *dir, const char *name, uint32_t mode) {
+    (void)dir;
+    (void)name;
+    (void)mode;
+    RETURN_ERRNO(THUNDEROS_EFS_RDONLY);
+}
+
+static int squashfs_remove(vfs_node_t *dir, const char *name) {
+    (void)dir;
+    (void)name;
+    RETURN_ERRNO(THUNDEROS_EFS_RDONLY);
+}
+
+static int squashfs_truncate(vfs_node_t *node, uint64_t size) {
+    (void)node;
+    (void)size;
+    RETURN_ERRNO(THUNDEROS_EFS_RDONLY);
+}
+
+static int squashfs_fallocate(vfs_node_t *node, uint32_t mode, uint64_t offset, uint64_t len) {
+    (void)node;
+    (void)mode;
+    (void)offset;
+    (void)len;
+    RETURN_ERRNO(THUNDEROS_EFS_RDONLY);
+}
+
+/**
+ * Open a squashfs file via VFS
+ * Only read access is allowed.
+ */
+static int squashfs_open(vfs_node_t *node, uint32_t flags) {
+    if (!valid_node(node)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (flags & (O_WRONLY | O_RDWR | O_TRUNC | O_APPEND)) {
+        RETURN_ERRNO(THUNDEROS_EFS_RDONLY);
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Look up a name in a squashfs directory via VFS
+ * Entries are sorted, so the search stops at the first larger name.
+ */
+static vfs_node_t *squashfs_lookup(vfs_node_t *dir, const char *name) {
+    if (!valid_node(dir) || !name) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    if (dir->type != VFS_TYPE_DIRECTORY) {
+        set_errno(THUNDEROS_ENOTDIR);
+        return NULL;
+    }
+    
+    squashfs_t *fs = node_fs(dir);
+    squashfs_inode_t *inode = node_inode(dir);
+    
+    if (name_compare(name, ".") == 0) {
+        return dir;
+    }
+    if (name_compare(name, "..") == 0) {
+        return &inode->parent->node;
+    }
+    
+    yield_lock(&fs->lock);
+    
+    squashfs_dir_iter_t iter;
+    squashfs_dir_entry_t entry;
+    char entry_name[SQUASHFS_NAME_MAX + 2];
+    squashfs_inode_t *found = NULL;
+    int result;
+    
+    dir_iter_init(&iter, inode);
+    while ((result = dir_iter_next(fs, &iter, &entry, entry_name)) > 0) {
+        int cmp = name_compare(entry_name, name);
+        if (cmp > 0) {
+            break;
+        }
+        if (cmp == 0) {
+            if (entry_visible(&entry, entry_name)) {
+                uint64_t ref = ((uint64_t)iter.header.start_block << 16) | entry.offset;
+                found = get_inode(fs, dir->fs, ref, entry_name, inode);
+                result = found ? 1 : -1;
+            }
+            break;
+        }
+    }
+    
+    yield_unlock(&fs->lock);
+    
+    if (!found) {
+        if (result >= 0) {
+            set_errno(THUNDEROS_ENOENT);
+        }
+        /* otherwise errno already set while reading the directory */
+        return NULL;
+    }
+    return &found->node;
+}
+
+/**
+ * Append one vfs_dirent_t record
+ * Returns 1 if it does not fit.
+ */
+static int put_dirent(uint8_t *buffer, uint32_t size, uint32_t *used,
+                      const char *name, uint32_t ino, uint32_t type) {
+    uint32_t name_len = kstrlen(name);
+    uint32_t reclen = (offsetof(vfs_dirent_t, d_name) + name_len + 1 + 7) & ~7U;
+    
+    if (*used + reclen > size) {
+        return 1;
+    }
+    
+    vfs_dirent_t *dirent = (vfs_dirent_t *)(buffer + *used);
+    dirent->d_ino = ino;
+    dirent->d_reclen = (uint16_t)reclen;
+    dirent->d_type = (uint8_t)type;
+    kmemcpy(dirent->d_name, name, name_len + 1);
+    
+    *used += reclen;
+    return 0;
+}
+
+/**
+ * Read packed directory entries from a squashfs directory via VFS
+ * The cookie counts entries from the start of the listing.
+ */
+static int squashfs_getdents(vfs_node_t *dir, uint64_t *cookie, void *buffer, uint32_t size) {
+    if (!valid_node(dir) || !cookie || !buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (dir->type != VFS_TYPE_DIRECTORY) {
+        RETURN_ERRNO(THUNDEROS_ENOTDIR);
+    }
+    
+    squashfs_t *fs = node_fs(dir);
+    squashfs_inode_t *inode = node_inode(dir);
+    uint8_t *out = (uint8_t *)buffer;
+    uint32_t used = 0;
+    int more = 0;
+    
+    if (*cookie == 0) {
+        if (put_dirent(out, size, &used, ".", dir->inode, VFS_TYPE_DIRECTORY) != 0) {
+            more = 1;
+        } else {
+            *cookie = 1;
+        }
+    }
+    if (!more && *cookie == 1) {
+        if (put_dirent(out, size, &used, "..", inode->parent_ino, VFS_TYPE_DIRECTORY) != 0) {
+            more = 1;
+        } else {
+            *cookie = SQUASHFS_FIRST_COOKIE;
+        }
+    }
+    
+    yield_lock(&fs->lock);
+    
+    squashfs_dir_iter_t iter;
+    squashfs_dir_entry_t entry;
+    char name[SQUASHFS_NAME_MAX + 2];
+    uint64_t index = SQUASHFS_FIRST_COOKIE;
+    int result = 0;
+    
+    dir_iter_init(&iter, inode);
+    while (!more && (result = dir_iter_next(fs, &iter, &entry, name)) > 0) {
+        if (index++ < *cookie || !entry_visible(&entry, name)) {
+            continue;
+        }
+        uint32_t type = entry.type == SQUASHFS_DIR_TYPE ? VFS_TYPE_DIRECTORY : VFS_TYPE_FILE;
+        uint32_t ino = iter.header.inode_number + entry.inode_number;
+        if (put_dirent(out, size, &used, name, ino, type) != 0) {
+            more = 1;
+            break;
+        }
+        *cookie = index;
+    }
+    
+    /* Hidden entries at the end of the listing are passed over too */
+    if (result == 0 && !more) {
+        *cookie = index;
+    }
+    
+    yield_unlock(&fs->lock);
+    
+    if (result < 0) {
+        /* errno already set by dir_iter_next */
+        return -1;
+    }
+    
+    /* The buffer cannot hold even the next entry */
+    if (used == 0 && more) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    clear_errno();
+    return (int)used;
+}
+
+/* squashfs VFS operations table */
+static vfs_ops_t squashfs_ops = {
+    .read = squashfs_read,
+    .write = squashfs_write,
+    .open = squashfs_open,
+    .lookup = squashfs_lookup,
+    .getdents = squashfs_getdents,
+    .create = squashfs_create,
+    .mkdir = squashfs_create,
+    .unlink = squashfs_remove,
+    .rmdir = squashfs_remove,
+    .truncate = squashfs_truncate,
+    .fallocate = squashfs_fallocate,
+};
+
+/**
+ * Free a filesystem that failed to mount
+ */
+static void squashfs_free(squashfs_t *fs) {
+    for (uint32_t i = 0; i < SQUASHFS_NODE_BUCKETS; i++) {
+        while (fs->nodes[i]) {
+            squashfs_inode_t *inode = fs->nodes[i];
+            fs->nodes[i] = inode->hash_next;
+            kfree(inode->block_pos);
+            kfree(inode);
+        }
+    }
+    for (uint32_t i = 0; i < SQUASHFS_META_CACHE; i++) {
+        kfree(fs->meta[i].data);
+    }
+    for (uint32_t i = 0; i < SQUASHFS_DATA_CACHE; i++) {
+        kfree(fs->data[i].data);
+    }
+    kfree(fs->io_buffer);
+    kfree(fs->fragment_index);
+    kfree(fs);
+}
+
+/**
+ * Check the superblock
+ */
+static int check_super(const squashfs_super_t *sb, uint64_t capacity) {
+    if (sb->s_magic != SQUASHFS_MAGIC) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (sb->s_major != SQUASHFS_MAJOR) {
+        hal_uart_puts("squashfs: Unsupported version\n");
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (sb->compression != SQUASHFS_COMP_LZ4) {
+        hal_uart_puts("squashfs: Unsupported compression (only LZ4)\n");
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (sb->block_log < SQUASHFS_MIN_BLOCK_LOG || sb->block_log > SQUASHFS_MAX_BLOCK_LOG ||
+        sb->block_size != (1U << sb->block_log)) {
+        hal_uart_puts("squashfs: Bad block size\n");
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (sb->bytes_used < sizeof(squashfs_super_t) ||
+        sb->bytes_used > capacity * VIRTIO_BLK_SECTOR_SIZE) {
+        hal_uart_puts("squashfs: Image larger than its device\n");
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    return 0;
+}
+
+/**
+ * Mount a squashfs image from a block device
+ */
+vfs_filesystem_t *squashfs_mount(virtio_blk_device_t *dev) {
+    if (!dev) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    
+    /* Read the superblock */
+    uint8_t *sector = (uint8_t *)kmalloc(VIRTIO_BLK_SECTOR_SIZE);
+    if (!sector) {
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    if (virtio_blk_read_dev(dev, 0, sector, 1) < 0) {
+        kfree(sector);
+        /* errno already set by virtio_blk_read_dev */
+        return NULL;
+    }
+    squashfs_super_t sb;
+    kmemcpy(&sb, sector, sizeof(sb));
+    kfree(sector);
+    
+    if (check_super(&sb, dev->capacity) != 0) {
+        /* errno already set by check_super */
+        return NULL;
+    }
+    
+    squashfs_t *fs = (squashfs_t *)kmalloc(sizeof(squashfs_t));
+    vfs_filesystem_t *vfs_fs = (vfs_filesystem_t *)kmalloc(sizeof(vfs_filesystem_t));
+    if (!fs || !vfs_fs) {
+        kfree(fs);
+        kfree(vfs_fs);
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    kmemset(fs, 0, sizeof(squashfs_t));
+    fs->dev = dev;
+    fs->sb = sb;
+    fs->block_size = sb.block_size;
+    
+    /* Room for a whole data or metadata block plus partial sectors at both ends */
+    uint32_t largest = fs->block_size > SQUASHFS_METADATA_SIZE + 2 ?
+                       fs->block_size : SQUASHFS_METADATA_SIZE + 2;
+    fs->io_size = largest + 2 * VIRTIO_BLK_SECTOR_SIZE;
+    fs->io_buffer = (uint8_t *)kmalloc(fs->io_size);
+    int ok = fs->io_buffer != NULL;
+    for (uint32_t i = 0; ok && i < SQUASHFS_META_CACHE; i++) {
+        fs->meta[i].data = (uint8_t *)kmalloc(SQUASHFS_METADATA_SIZE);
+        ok = fs->meta[i].data != NULL;
+    }
+    for (uint32_t i = 0; ok && i < SQUASHFS_DATA_CACHE; i++) {
+        fs->data[i].data = (uint8_t *)kmalloc(fs->block_size);
+        ok = fs->data[i].data != NULL;
+    }
+    if (!ok) {
+        squashfs_free(fs);
+        kfree(vfs_fs);
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    
+    /* The fragment table index is an uncompressed array of block offsets */
+    if (!(sb.flags & SQUASHFS_FLAG_NO_FRAGMENTS) && sb.fragments > 0) {
+        uint32_t nr_blocks = (sb.fragments + SQUASHFS_FRAGMENTS_PER_BLOCK - 1) /
+                             SQUASHFS_FRAGMENTS_PER_BLOCK;
+        uint32_t len = nr_blocks * sizeof(uint64_t);
+        fs->fragment_index = (uint64_t *)kmalloc(len);
+        const uint8_t *raw = NULL;
+        if (fs->fragment_index && len <= largest) {
+            raw = read_image(fs, sb.fragment_table_start, len);
+        }
+        if (!raw) {
+            hal_uart_puts("squashfs: Cannot read fragment table\n");
+            squashfs_free(fs);
+            kfree(vfs_fs);
+            set_errno(THUNDEROS_EIO);
+            return NULL;
+        }
+        kmemcpy(fs->fragment_index, raw, len);
+    }
+    
+    kstrcpy(vfs_fs->name, "squashfs");
+    vfs_fs->fs_data = fs;
+    vfs_fs->ops = &squashfs_ops;
+    vfs_fs->open_files = 0;
+    
+    fs->root = get_inode(fs, vfs_fs, sb.root_inode, "/", NULL);
+    if (!fs->root || fs->root->node.type != VFS_TYPE_DIRECTORY) {
+        hal_uart_puts("squashfs: Cannot read root directory\n");
+        squashfs_free(fs);
+        kfree(vfs_fs);
+        set_errno(THUNDEROS_EIO);
+        return NULL;
+    }
+    vfs_fs->root = &fs->root->node;
+    
+    clear_errno();
+    return vfs_fs;
+}
@@ -0,0 +1,1024 @@
+/*
+ * tmpfs.c - Memory-backed filesystem
+ *
+ * Each inode is one kmalloc allocation holding its VFS node, so lookups
+ * return the same node every time and nothing is read from disk. Regular
+ * files keep an array of page pointers (NULL for holes). Directories keep
+ * their entries in a hash table for lookup and in a creation-ordered list
+ * for getdents. A file has exactly one name, so the directory entry is
+ * part of the inode.
+ */
+
+#include "../../include/fs/tmpfs.h"
+#include "../../include/fs/vfs.h"
+#include "../../include/mm/kmalloc.h"
+#include "../../include/mm/pmm.h"
+#include "../../include/kernel/kstring.h"
+#include "../../include/kernel/lock.h"
+#include "../../include/kernel/errno.h"
+#include <stddef.h>
+
+/**
+ * In-memory inode
+ */
+typedef struct tmpfs_inode {
+    vfs_node_t node;                   /* VFS view; node.fs_data points here */
+    struct tmpfs_inode *parent;        /* Containing directory, NULL if none */
+    struct tmpfs_inode *hash_next;     /* Next entry in the parent's bucket */
+    struct tmpfs_inode *prev;          /* Previous entry in creation order */
+    struct tmpfs_inode *next;          /* Next entry in creation order */
+    uint64_t cookie;                   /* getdents position in the parent */
+    uint32_t hash;                     /* Hash of node.name */
+    uint32_t opens;                    /* Open files referring to this inode */
+    
+    /* Regular files */
+    uint8_t **pages;                   /* Data pages, NULL entries are holes */
+    uint32_t nr_slots;                 /* Entries in pages[] */
+    
+    /* Directories */
+    struct tmpfs_inode **buckets;      /* Hash table, NULL until first entry */
+    uint32_t nr_buckets;               /* Buckets in the table */
+    uint32_t nr_entries;               /* Entries in the directory */
+    struct tmpfs_inode *first;         /* Oldest entry */
+    struct tmpfs_inode *last;          /* Newest entry */
+    uint64_t next_cookie;              /* Cookie for the next entry */
+} tmpfs_inode_t;
+
+/**
+ * Filesystem instance
+ */
+typedef struct {
+    yield_lock_t lock;                 /* Serializes filesystem operations */
+    uint32_t max_pages;                /* Size limit in pages */
+    uint32_t used_pages;               /* Data pages plus one per inode */
+    uint32_t next_ino;                 /* Number for the next inode */
+    tmpfs_inode_t *root;               /* Root directory */
+} tmpfs_t;
+
+/* getdents cookies 0 and 1 are "." and ".."; entries start here */
+#define TMPFS_FIRST_COOKIE 2
+
+static vfs_ops_t tmpfs_ops;
+
+/**
+ * FNV-1a hash of a name
+ */
+static uint32_t name_hash(const char *name) {
+    uint32_t hash = 2166136261U;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/**
+ * String comparison
+ */
+static int name_equals(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+/**
+ * Filesystem and inode behind a VFS node
+ */
+static tmpfs_t *node_fs(vfs_node_t *node) {
+    return (tmpfs_t *)node->fs->fs_data;
+}
+
+static tmpfs_inode_t *node_inode(vfs_node_t *node) {
+    return (tmpfs_inode_t *)node->fs_data;
+}
+
+/**
+ * Check that a node belongs to a tmpfs
+ */
+static int valid_node(vfs_node_t *node) {
+    return node && node->fs && node->fs->fs_data && node->fs_data;
+}
+
+/**
+ * Charge pages against the size limit
+ */
+static int charge_pages(tmpfs_t *fs, uint32_t count) {
+    if (fs->used_pages + count > fs->max_pages || fs->used_pages + count < fs->used_pages) {
+        RETURN_ERRNO(THUNDEROS_ENOSPC);
+    }
+    fs->used_pages += count;
+    return 0;
+}
+
+/**
+ * Allocate an inode
+ */
+static tmpfs_inode_t *inode_alloc(tmpfs_t *fs, vfs_filesystem_t *vfs_fs,
+                                  const char *name, uint32_t type) {
+    if (charge_pages(fs, 1) != 0) {
+        /* errno already set by charge_pages */
+        return NULL;
+    }
+    
+    tmpfs_inode_t *inode = (tmpfs_inode_t *)kmalloc(sizeof(tmpfs_inode_t));
+    if (!inode) {
+        fs->used_pages--;
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    kmemset(inode, 0, sizeof(tmpfs_inode_t));
+    
+    kstrncpy(inode->node.name, name, sizeof(inode->node.name) - 1);
+    inode->node.name[sizeof(inode->node.name) - 1] = '\0';
+    inode->node.inode = fs->next_ino++;
+    inode->node.type = type;
+    inode->node.fs = vfs_fs;
+    inode->node.fs_data = inode;
+    inode->node.ops = &tmpfs_ops;
+    inode->hash = name_hash(inode->node.name);
+    inode->next_cookie = TMPFS_FIRST_COOKIE;
+    
+    return inode;
+}
+
+/**
+ * Release the data pages from page index first onwards
+ */
+static void free_pages_from(tmpfs_t *fs, tmpfs_inode_t *inode, uint32_t first) {
+    for (uint32_t i = first; i < inode->nr_slots; i++) {
+        if (inode->pages[i]) {
+            pmm_free_page((uintptr_t)inode->pages[i]);
+            inode->pages[i] = NULL;
+            fs->used_pages--;
+        }
+    }
+}
+
+/**
+ * Free an inode that has no name and no open files
+ */
+static void inode_free(tmpfs_t *fs, tmpfs_inode_t *inode) {
+    free_pages_from(fs, inode, 0);
+    kfree(inode->pages);
+    kfree(inode->buckets);
+    kfree(inode);
+    fs->used_pages--;
+}
+
+/**
+ * Find an entry in a directory
+ */
+static tmpfs_inode_t *dir_find(tmpfs_inode_t *dir, const char *name) {
+    if (!dir->buckets) {
+        return NULL;
+    }
+    
+    uint32_t hash = name_hash(name);
+    tmpfs_inode_t *entry = dir->buckets[hash & (dir->nr_buckets - 1)];
+    while (entry) {
+        if (entry->hash == hash && name_equals(entry->node.name, name)) {
+            return entry;
+        }
+        entry = entry->hash_next;
+    }
+    return NULL;
+}
+
+/**
+ * Resize a directory's hash table
+ */
+static int dir_rehash(tmpfs_inode_t *dir, uint32_t nr_buckets) {
+    tmpfs_inode_t **buckets = (tmpfs_inode_t **)kmalloc(nr_buckets * sizeof(tmpfs_inode_t *));
+    if (!buckets) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    kmemset(buckets, 0, nr_buckets * sizeof(tmpfs_inode_t *));
+    
+    for (tmpfs_inode_t *entry = dir->first; entry; entry = entry->next) {
+        uint32_t slot = entry->hash & (nr_buckets - 1);
+        entry->hash_next = buckets[slot];
+        buckets[slot] = entry;
+    }
+    
+    kfree(dir->buckets);
+    dir->buckets = buckets;
+    dir->nr_buckets = nr_buckets;
+    return 0;
+}
+
+/**
+ * Add an inode to a directory
+ * The table doubles once it averages two entries per bucket.
+ */
+static int dir_insert(tmpfs_inode_t *dir, tmpfs_inode_t *inode) {
+    if (!dir->buckets || dir->nr_entries >= 2 * dir->nr_buckets) {
+        uint32_t nr_buckets = dir->buckets ? dir->nr_buckets * 2 : TMPFS_MIN_BUCKETS;
+        if (dir_rehash(dir, nr_buckets) != 0 && !dir->buckets) {
+            /* errno already set by dir_rehash; a full table still works */
+            return -1;
+        }
+    }
+    
+    uint32_t slot = inode->hash & (dir->nr_buckets - 1);
+    inode->hash_next = dir->buckets[slot];
+    dir->buckets[slot] = inode;
+    
+    inode->prev = dir->last;
+    inode->next = NULL;
+    if (dir->last) {
+        dir->last->next = inode;
+    } else {
+        dir->first = inode;
+    }
+    dir->last = inode;
+    
+    inode->parent = dir;
+    inode->cookie = dir->next_cookie++;
+    dir->nr_entries++;
+    dir->node.size = dir->nr_entries;
+    return 0;
+}
+
+/**
+ * Take an inode out of its directory
+ * The inode is freed here unless it is still open.
+ */
+static void dir_remove(tmpfs_t *fs, tmpfs_inode_t *inode) {
+    tmpfs_inode_t *dir = inode->parent;
+    
+    tmpfs_inode_t **link = &dir->buckets[inode->hash & (dir->nr_buckets - 1)];
+    while (*link != inode) {
+        link = &(*link)->hash_next;
+    }
+    *link = inode->hash_next;
+    
+    if (inode->prev) {
+        inode->prev->next = inode->next;
+    } else {
+        dir->first = inode->next;
+    }
+    if (inode->next) {
+        inode->next->prev = inode->prev;
+    } else {
+        dir->last = inode->prev;
+    }
+    
+    dir->nr_entries--;
+    dir->node.size = dir->nr_entries;
+    inode->parent = NULL;
+    
+    if (inode->opens == 0) {
+        inode_free(fs, inode);
+    }
+}
+
+/**
+ * Make pages[] cover page index slot
+ */
+static int ensure_slots(tmpfs_inode_t *inode, uint32_t slot) {
+    if (slot < inode->nr_slots) {
+        return 0;
+    }
+    
+    uint32_t nr_slots = inode->nr_slots ? inode->nr_slots * 2 : 16;
+    while (nr_slots <= slot) {
+        nr_slots *= 2;
+    }
+    
+    uint8_t **pages = (uint8_t **)kmalloc(nr_slots * sizeof(uint8_t *));
+    if (!pages) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    for (uint32_t i = 0; i < nr_slots; i++) {
+        pages[i] = i < inode->nr_slots ? inode->pages[i] : NULL;
+    }
+    
+    kfree(inode->pages);
+    inode->pages = pages;
+    inode->nr_slots = nr_slots;
+    return 0;
+}
+
+/**
+ * Get the data page at index slot, allocating a zeroed one if missing
+ */
+static uint8_t *get_page(tmpfs_t *fs, tmpfs_inode_t *inode, uint32_t slot) {
+    if (ensure_slots(inode, slot) != 0) {
+        /* errno already set by ensure_slots */
+        return NULL;
+    }
+    if (inode->pages[slot]) {
+        return inode->pages[slot];
+    }
+    
+    if (charge_pages(fs, 1) != 0) {
+        /* errno already set by charge_pages */
+        return NULL;
+    }
+    
+    uint8_t *page = (uint8_t *)pmm_alloc_page();
+    if (!page) {
+        fs->used_pages--;
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    kmemset(page, 0, PAGE_SIZE);
+    
+    inode->pages[slot] = page;
+    return page;
+}
+
+/**
+ * Data page at index slot, or NULL for a hole
+ */
+static uint8_t *find_page(tmpfs_inode_t *inode, uint64_t slot) {
+    return slot < inode->nr_slots ? inode->pages[slot] : NULL;
+}
+
+/**
+ * Read file data (lock held)
+ */
+static int read_locked(tmpfs_inode_t *inode, uint64_t offset, uint8_t *buffer, uint32_t size) {
+    if (offset >= inode->node.size) {
+        return 0;
+    }
+    if (size > inode->node.size - offset) {
+        size = (uint32_t)(inode->node.size - offset);
+    }
+    
+    uint32_t done = 0;
+    while (done < size) {
+        uint64_t pos = offset + done;
+        uint32_t in_page = pos % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - in_page;
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+        
+        uint8_t *page = find_page(inode, pos / PAGE_SIZE);
+        if (page) {
+            kmemcpy(buffer + done, page + in_page, chunk);
+        } else {
+            kmemset(buffer + done, 0, chunk);
+        }
+        done += chunk;
+    }
+    
+    return (int)done;
+}
+
+/**
+ * Write file data (lock held)
+ * Returns the bytes written, short only when memory runs out part way.
+ */
+static int write_locked(tmpfs_t *fs, tmpfs_inode_t *inode, uint64_t offset,
+                        const uint8_t *buffer, uint32_t size) {
+    if (offset >= TMPFS_MAX_FILE_SIZE) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    if (size > TMPFS_MAX_FILE_SIZE - offset) {
+        size = (uint32_t)(TMPFS_MAX_FILE_SIZE - offset);
+    }
+    
+    uint32_t done = 0;
+    while (done < size) {
+        uint64_t pos = offset + done;
+        uint32_t in_page = pos % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - in_page;
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+        
+        uint8_t *page = get_page(fs, inode, (uint32_t)(pos / PAGE_SIZE));
+        if (!page) {
+            /* errno already set by get_page */
+            break;
+        }
+        kmemcpy(page + in_page, buffer + done, chunk);
+        done += chunk;
+    }
+    
+    if (offset + done > inode->node.size) {
+        inode->node.size = offset + done;
+    }
+    
+    if (done == 0 && size > 0) {
+        return -1;
+    }
+    return (int)done;
+}
+
+/**
+ * Read from a tmpfs file via VFS
+ */
+static int tmpfs_read(vfs_node_t *node, uint64_t offset, void *buffer, uint32_t size) {
+    if (!valid_node(node) || !buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    tmpfs_t *fs = node_fs(node);
+    yield_lock(&fs->lock);
+    int ret = read_locked(node_inode(node), offset, (uint8_t *)buffer, size);
+    yield_unlock(&fs->lock);
+    
+    clear_errno();
+    return ret;
+}
+
+/**
+ * Write to a tmpfs file via VFS
+ */
+static int tmpfs_write(vfs_node_t *node, uint64_t offset, const void *buffer, uint32_t size) {
+    if (!valid_node(node) || !buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    tmpfs_t *fs = node_fs(node);
+    yield_lock(&fs->lock);
+    int ret = write_locked(fs, node_inode(node), offset, (const uint8_t *)buffer, size);
+    yield_unlock(&fs->lock);
+    
+    return ret;
+}
+
+/**
+ * Read into a buffer list via VFS
+ */
+static int tmpfs_readv(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov, int iovcnt) {
+    if (!valid_node(node) || !iov) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    tmpfs_t *fs = node_fs(node);
+    tmpfs_inode_t *inode = node_inode(node);
+    int done = 0;
+    
+    yield_lock(&fs->lock);
+    for (int i = 0; i < iovcnt; i++) {
+        int ret = read_locked(inode, offset + done, (uint8_t *)iov[i].iov_base,
+                              (uint32_t)iov[i].iov_len);
+        done += ret;
+        if ((size_t)ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    yield_unlock(&fs->lock);
+    
+    clear_errno();
+    return done;
+}
+
+/**
+ * Write a buffer list via VFS
+ */
+static int tmpfs_writev(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov, int iovcnt) {
+    if (!valid_node(node) || !iov) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    tmpfs_t *fs = node_fs(node);
+    tmpfs_inode_t *inode = node_inode(node);
+    int done = 0;
+    
+    yield_lock(&fs->lock);
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        int ret = write_locked(fs, inode, offset + done, (const uint8_t *)iov[i].iov_base,
+                               (uint32_t)iov[i].iov_len);
+        if (ret < 0) {
+            /* errno already set by write_locked */
+            if (done == 0) {
+                done = -1;
+            }
+            break;
+        }
+        done += ret;
+        if ((size_t)ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    yield_unlock(&fs->lock);
+    
+    return done;
+}
+
+/**
+ * Copy a byte range between two tmpfs files via VFS
+ * Data moves straight from page to page. Holes in the source stay holes
+ * where the destination has no page yet.
+ */
+static int tmpfs_copy_range(vfs_node_t *src, uint64_t src_offset,
+                            vfs_node_t *dst, uint64_t dst_offset, uint32_t len) {
+    if (!valid_node(src) || !valid_node(dst)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    tmpfs_t *fs = node_fs(src);
+    tmpfs_inode_t *in = node_inode(src);
+    tmpfs_inode_t *out = node_inode(dst);
+    uint32_t done = 0;
+    
+    if (dst_offset >= TMPFS_MAX_FILE_SIZE) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    if (len > TMPFS_MAX_FILE_SIZE - dst_offset) {
+        len = (uint32_t)(TMPFS_MAX_FILE_SIZE - dst_offset);
+    }
+    
+    yield_lock(&fs->lock);
+    if (src_offset >= in->node.size) {
+        len = 0;
+    } else if (len > in->node.size - src_offset) {
+        len = (uint32_t)(in->node.size - src_offset);
+    }
+    
+    while (done < len) {
+        uint64_t from = src_offset + done;
+        uint64_t to = dst_offset + done;
+        
+        /* Stay within one source page and one destination page */
+        uint32_t chunk = PAGE_SIZE - from % PAGE_SIZE;
+        if (chunk > PAGE_SIZE - to % PAGE_SIZE) {
+            chunk = PAGE_SIZE - to % PAGE_SIZE;
+        }
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        
+        uint8_t *src_page = find_page(in, from / PAGE_SIZE);
+        uint8_t *dst_page = find_page(out, to / PAGE_SIZE);
+        if (src_page || dst_page) {
+            dst_page = get_page(fs, out, (uint32_t)(to / PAGE_SIZE));
+            if (!dst_page) {
+                /* errno already set by get_page */
+                break;
+            }
+            if (src_page) {
+                kmemcpy(dst_page + to % PAGE_SIZE, src_page + from % PAGE_SIZE, chunk);
+            } else {
+                kmemset(dst_page + to % PAGE_SIZE, 0, chunk);
+            }
+        }
+        done += chunk;
+    }
+    
+    if (dst_offset + done > out->node.size) {
+        out->node.size = dst_offset + done;
+    }
+    yield_unlock(&fs->lock);
+    
+    if (done == 0 && len > 0) {
+        return -1;
+    }
+    clear_errno();
+    return (int)done;
+}
+
+/**
+ * Count an open file on a tmpfs inode via VFS
+ */
+static int tmpfs_open(vfs_node_t *node, uint32_t flags) {
+    (void)flags;
+    if (!valid_node(node)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    tmpfs_t *fs = node_fs(node);
+    yield_lock(&fs->lock);
+    node_inode(node)->opens++;
+    yield_unlock(&fs->lock);
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Drop an open file via VFS, freeing a removed inode with the last one
+ */
+static void tmpfs_close(vfs_node_t *node) {
+    if (!valid_node(node)) {
+        return;
+    }
+    
+    tmpfs_t *fs = node_fs(node);
+    tmpfs_inode_t *inode = node_inode(node);
+    
+    yield_lock(&fs->lock);
+    inode->opens--;
+    if (inode->opens == 0 && !inode->parent && inode != fs->root) {
+        inode_free(fs, inode);
+    }
+    yield_unlock(&fs->lock);
+}
+
+/**
+ * Look up a name in a tmpfs directory via VFS
+ */
+static vfs_node_t *tmpfs_lookup(vfs_node_t *dir, const char *name) {
+    if (!valid_node(dir) || !name) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    if (dir->type != VFS_TYPE_DIRECTORY) {
+        set_errno(THUNDEROS_ENOTDIR);
+        return NULL;
+    }
+    
+    tmpfs_t *fs = node_fs(dir);
+    tmpfs_inode_t *inode = node_inode(dir);
+    tmpfs_inode_t *found;
+    
+    yield_lock(&fs->lock);
+    if (name_equals(name, ".")) {
+        found = inode;
+    } else if (name_equals(name, "..")) {
+        found = inode->parent ? inode->parent : inode;
+    } else {
+        found = dir_find(inode, name);
+    }
+    yield_unlock(&fs->lock);
+    
+    if (!found) {
+        set_errno(THUNDEROS_ENOENT);
+        return NULL;
+    }
+    return &found->node;
+}
+
+/**
+ * Append one vfs_dirent_t record
+ * Returns 1 if it does not fit.
+ */
+static int put_dirent(uint8_t *buffer, uint32_t size, uint32_t *used,
+                      const char *name, uint32_t ino, uint32_t type) {
+    uint32_t name_len = kstrlen(name);
+    uint32_t reclen = (offsetof(vfs_dirent_t, d_name) + name_len + 1 + 7) & ~7U;
+    
+    if (*used + reclen > size) {
+        return 1;
+    }
+    
+    vfs_dirent_t *dirent = (vfs_dirent_t *)(buffer + *used);
+    dirent->d_ino = ino;
+    dirent->d_reclen = (uint16_t)reclen;
+    dirent->d_type = (uint8_t)type;
+    kmemcpy(dirent->d_name, name, name_len + 1);
+    
+    *used += reclen;
+    return 0;
+}
+
+/**
+ * Read packed directory entries from a tmpfs directory via VFS
+ * The cookie is the creation number of the next entry, so entries added
+ * or removed between calls do not shift the others.
+ */
+static int tmpfs_getdents(vfs_node_t *dir, uint64_t *cookie, void *buffer, uint32_t size) {
+    if (!valid_node(dir) || !cookie || !buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (dir->type != VFS_TYPE_DIRECTORY) {
+        RETURN_ERRNO(THUNDEROS_ENOTDIR);
+    }
+    
+    tmpfs_t *fs = node_fs(dir);
+    tmpfs_inode_t *inode = node_inode(dir);
+    uint8_t *out = (uint8_t *)buffer;
+    uint32_t used = 0;
+    int more = 0;
+    
+    yield_lock(&fs->lock);
+    
+    /* A removed directory reads as empty */
+    if (*cookie == 0 && (inode->parent || inode == fs->root)) {
+        if (put_dirent(out, size, &used, ".", inode->node.inode, VFS_TYPE_DIRECTORY) != 0) {
+            more = 1;
+        } else {
+            *cookie = 1;
+        }
+    }
+    if (!more && *cookie == 1) {
+        tmpfs_inode_t *up = inode->parent ? inode->parent : inode;
+        if (put_dirent(out, size, &used, "..", up->node.inode, VFS_TYPE_DIRECTORY) != 0) {
+            more = 1;
+        } else {
+            *cookie = TMPFS_FIRST_COOKIE;
+        }
+    }
+    
+    for (tmpfs_inode_t *entry = inode->first; entry && !more; entry = entry->next) {
+        if (entry->cookie < *cookie) {
+            continue;
+        }
+        if (put_dirent(out, size, &used, entry->node.name, entry->node.inode,
+                       entry->node.type) != 0) {
+            more = 1;
+            break;
+        }
+        *cookie = entry->cookie + 1;
+    }
+    
+    yield_unlock(&fs->lock);
+    
+    /* The buffer cannot hold even the next entry */
+    if (used == 0 && more) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    clear_errno();
+    return (int)used;
+}
+
+/**
+ * Create a file or directory entry
+ */
+static int create_entry(vfs_node_t *dir, const char *name, uint32_t type) {
+    if (!valid_node(dir) || !name || name[0] == '\0') {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (dir->type != VFS_TYPE_DIRECTORY) {
+        RETURN_ERRNO(THUNDEROS_ENOTDIR);
+    }
+    if (kstrlen(name) > TMPFS_NAME_MAX) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    tmpfs_t *fs = node_fs(dir);
+    tmpfs_inode_t *parent = node_inode(dir);
+    int ret = 0;
+    
+    yield_lock(&fs->lock);
+    if (!parent->parent && parent != fs->root) {
+        /* Directory was removed while still open */
+        set_errno(THUNDEROS_ENOENT);
+        ret = -1;
+    } else if (name_equals(name, ".") || name_equals(name, "..") || dir_find(parent, name)) {
+        set_errno(THUNDEROS_EEXIST);
+        ret = -1;
+    } else {
+        tmpfs_inode_t *inode = inode_alloc(fs, dir->fs, name, type);
+        if (!inode) {
+            /* errno already set by inode_alloc */
+            ret = -1;
+        } else if (dir_insert(parent, inode) != 0) {
+            /* errno already set by dir_insert */
+            inode_free(fs, inode);
+            ret = -1;
+        }
+    }
+    yield_unlock(&fs->lock);
+    
+    if (ret == 0) {
+        clear_errno();
+    }
+    return ret;
+}
+
+/**
+ * Create a file in a tmpfs directory via VFS
+ */
+static int tmpfs_create_file(vfs_node_t *dir, const char *name, uint32_t mode) {
+    (void)mode;
+    return create_entry(dir, name, VFS_TYPE_FILE);
+}
+
+/**
+ * Create a directory in a tmpfs directory via VFS
+ */
+static int tmpfs_mkdir(vfs_node_t *dir, const char *name, uint32_t mode) {
+    (void)mode;
+    return create_entry(dir, name, VFS_TYPE_DIRECTORY);
+}
+
+/**
+ * Remove a file or an empty directory entry
+ */
+static int remove_entry(vfs_node_t *dir, const char *name, uint32_t type) {
+    if (!valid_node(dir) || !name) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    tmpfs_t *fs = node_fs(dir);
+    int error = 0;
+    
+    yield_lock(&fs->lock);
+    tmpfs_inode_t *inode = dir_find(node_inode(dir), name);
+    if (!inode) {
+        error = THUNDEROS_ENOENT;
+    } else if (inode->node.type != type) {
+        error = (type == VFS_TYPE_FILE) ? THUNDEROS_EISDIR : THUNDEROS_ENOTDIR;
+    } else if (type == VFS_TYPE_DIRECTORY && inode->nr_entries > 0) {
+        error = THUNDEROS_EFS_NOTEMPTY;
+    } else {
+        dir_remove(fs, inode);
+    }
+    yield_unlock(&fs->lock);
+    
+    if (error != 0) {
+        RETURN_ERRNO(error);
+    }
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Remove a file via VFS
+ */
+static int tmpfs_unlink(vfs_node_t *dir, const char *name) {
+    return remove_entry(dir, name, VFS_TYPE_FILE);
+}
+
+/**
+ * Remove an empty directory via VFS
+ */
+static int tmpfs_rmdir(vfs_node_t *dir, const char *name) {
+    return remove_entry(dir, name, VFS_TYPE_DIRECTORY);
+}
+
+/**
+ * Change the size of a tmpfs file via VFS
+ * Pages past the new end are released, and the rest of the last page is
+ * cleared so a later extension reads zeros.
+ */
+static int tmpfs_truncate(vfs_node_t *node, uint64_t size) {
+    if (!valid_node(node)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    if (size > TMPFS_MAX_FILE_SIZE) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    
+    tmpfs_t *fs = node_fs(node);
+    tmpfs_inode_t *inode = node_inode(node);
+    
+    yield_lock(&fs->lock);
+    free_pages_from(fs, inode, (uint32_t)((size + PAGE_SIZE - 1) / PAGE_SIZE));
+    uint8_t *tail = find_page(inode, size / PAGE_SIZE);
+    if (tail) {
+        kmemset(tail + size % PAGE_SIZE, 0, PAGE_SIZE - size % PAGE_SIZE);
+    }
+    inode->node.size = size;
+    yield_unlock(&fs->lock);
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Reserve pages for a byte range of a tmpfs file via VFS
+ * On ENOSPC the pages reserved so far are kept.
+ */
+static int tmpfs_fallocate(vfs_node_t *node, uint32_t mode, uint64_t offset, uint64_t len) {
+    if (!valid_node(node) || (mode & ~FALLOC_FL_KEEP_SIZE) || len == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    if (offset > TMPFS_MAX_FILE_SIZE || len > TMPFS_MAX_FILE_SIZE - offset) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    
+    tmpfs_t *fs = node_fs(node);
+    tmpfs_inode_t *inode = node_inode(node);
+    uint64_t end = offset + len;
+    int ret = 0;
+    
+    yield_lock(&fs->lock);
+    for (uint64_t slot = offset / PAGE_SIZE; slot < (end + PAGE_SIZE - 1) / PAGE_SIZE; slot++) {
+        if (!get_page(fs, inode, (uint32_t)slot)) {
+            /* errno already set by get_page */
+            ret = -1;
+            break;
+        }
+    }
+    if (ret == 0 && !(mode & FALLOC_FL_KEEP_SIZE) && end > inode->node.size) {
+        inode->node.size = end;
+    }
+    yield_unlock(&fs->lock);
+    
+    if (ret == 0) {
+        clear_errno();
+    }
+    return ret;
+}
+
+/**
+ * Get a reference to a data page of a tmpfs file via VFS
+ * Holes get a zeroed page first. The page outlives a truncate or the
+ * file's removal for as long as the caller holds its reference.
+ */
+static int tmpfs_get_page(vfs_node_t *node, uint64_t index, uintptr_t *page) {
+    if (!valid_node(node) || !page) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    tmpfs_t *fs = node_fs(node);
+    tmpfs_inode_t *inode = node_inode(node);
+    int ret = 0;
+    
+    yield_lock(&fs->lock);
+    if (index >= (inode->node.size + PAGE_SIZE - 1) / PAGE_SIZE) {
+        set_errno(THUNDEROS_ENXIO);
+        ret = -1;
+    } else {
+        uint8_t *data = get_page(fs, inode, (uint32_t)index);
+        if (!data) {
+            /* errno already set by get_page */
+            ret = -1;
+        } else {
+            pmm_page_get((uintptr_t)data);
+            *page = (uintptr_t)data;
+        }
+    }
+    yield_unlock(&fs->lock);
+    
+    if (ret == 0) {
+        clear_errno();
+    }
+    return ret;
+}
+
+/* tmpfs VFS operations table */
+static vfs_ops_t tmpfs_ops = {
+    .read = tmpfs_read,
+    .write = tmpfs_write,
+    .readv = tmpfs_readv,
+    .writev = tmpfs_writev,
+    .open = tmpfs_open,
+    .close = tmpfs_close,
+    .lookup = tmpfs_lookup,
+    .getdents = tmpfs_getdents,
+    .create = tmpfs_create_file,
+    .mkdir = tmpfs_mkdir,
+    .unlink = tmpfs_unlink,
+    .rmdir = tmpfs_rmdir,
+    .copy_range = tmpfs_copy_range,
+    .truncate = tmpfs_truncate,
+    .fallocate = tmpfs_fallocate,
+    .get_page = tmpfs_get_page,
+};
+
+/**
+ * Create an empty tmpfs
+ */
+vfs_filesystem_t *tmpfs_create(uint32_t max_bytes) {
+    uint32_t max_pages = max_bytes / PAGE_SIZE;
+    if (max_pages == 0) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    
+    vfs_filesystem_t *vfs_fs = (vfs_filesystem_t *)kmalloc(sizeof(vfs_filesystem_t));
+    tmpfs_t *fs = (tmpfs_t *)kmalloc(sizeof(tmpfs_t));
+    if (!vfs_fs || !fs) {
+        kfree(vfs_fs);
+        kfree(fs);
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    
+    yield_lock_init(&fs->lock);
+    fs->max_pages = max_pages;
+    fs->used_pages = 0;
+    fs->next_ino = 1;
+    
+    kstrcpy(vfs_fs->name, "tmpfs");
+    vfs_fs->fs_data = fs;
+    vfs_fs->ops = &tmpfs_ops;
+    vfs_fs->open_files = 0;
+    
+    fs->root = inode_alloc(fs, vfs_fs, "/", VFS_TYPE_DIRECTORY);
+    if (!fs->root) {
+        kfree(vfs_fs);
+        kfree(fs);
+        /* errno already set by inode_alloc */
+        return NULL;
+    }
+    vfs_fs->root = &fs->root->node;
+    
+    clear_errno();
+    return vfs_fs;
+}
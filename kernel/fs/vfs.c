@@ -3,17 +3,47 @@
  */
 
 #include "../../include/fs/vfs.h"
+#include "../../include/fs/pipe.h"
 #include "../../include/hal/hal_uart.h"
 #include "../../include/mm/kmalloc.h"
 #include "../../include/kernel/errno.h"
+#include "../../include/kernel/process.h"
+#include "../../include/kernel/epoll.h"
 #include <stddef.h>
 
-/* Global file descriptor table (per-process would be better, but global for now) */
-static vfs_file_t g_file_table[VFS_MAX_OPEN_FILES];
+/* stdin/stdout/stderr are reserved in every descriptor table */
+#define FD_STDIO_MASK ((1ULL << VFS_FD_STDIN) | (1ULL << VFS_FD_STDOUT) | (1ULL << VFS_FD_STDERR))
+
+/*
+ * Largest file offset, that of a signed 64-bit off_t. Filesystems with a
+ * smaller limit fail writes past it with THUNDEROS_EFBIG.
+ */
+#define VFS_MAX_OFFSET 0x7FFFFFFFFFFFFFFFULL
+
+/* Kernel buffer size for copies between files without copy_range */
+#define VFS_COPY_CHUNK (64 * 1024)
+
+/* Descriptor table for code running outside any process (boot, kernel init) */
+static vfs_fd_table_t g_kernel_fd_table = {
+    .files = NULL,
+    .capacity = 0,
+    .full = 0,
+    .used = { FD_STDIO_MASK },
+};
 
 /* Root filesystem */
 static vfs_filesystem_t *g_root_fs = NULL;
 
+/* Filesystem mounted on a directory */
+typedef struct {
+    char path[VFS_MAX_PATH];           /* Normalized mount point */
+    uint32_t path_len;                 /* Length of path */
+    vfs_filesystem_t *fs;              /* Mounted filesystem, NULL if slot free */
+} vfs_mount_t;
+
+/* Mount table (the root filesystem is not in it) */
+static vfs_mount_t g_mounts[VFS_MAX_MOUNTS];
+
 /**
  * String length
  */
@@ -50,20 +80,10 @@ static int strcmp(const char *s1, const char *s2) {
  * Initialize VFS
  */
 int vfs_init(void) {
-    /* Initialize file descriptor table */
-    for (int i = 0; i < VFS_MAX_OPEN_FILES; i++) {
-        g_file_table[i].node = NULL;
-        g_file_table[i].flags = 0;
-        g_file_table[i].pos = 0;
-        g_file_table[i].in_use = 0;
-    }
-    
-    /* Reserve stdin/stdout/stderr */
-    g_file_table[VFS_FD_STDIN].in_use = 1;
-    g_file_table[VFS_FD_STDOUT].in_use = 1;
-    g_file_table[VFS_FD_STDERR].in_use = 1;
-    
     g_root_fs = NULL;
+    for (uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+        g_mounts[i].fs = NULL;
+    }
     
     hal_uart_puts("vfs: Initialized\n");
     return 0;
@@ -87,412 +107,1896 @@ int vfs_mount_root(vfs_filesystem_t *fs) {
 }
 
 /**
- * Allocate a file descriptor
+ * Copy an absolute path with repeated and trailing slashes removed
+ * Returns the length of the result, or -1 if the path is not absolute or
+ * does not fit in VFS_MAX_PATH bytes.
  */
-int vfs_alloc_fd(void) {
-    for (int i = 3; i < VFS_MAX_OPEN_FILES; i++) {  /* Skip stdin/stdout/stderr */
-        if (!g_file_table[i].in_use) {
-            g_file_table[i].in_use = 1;
-            g_file_table[i].node = NULL;
-            g_file_table[i].pos = 0;
-            g_file_table[i].flags = 0;
-            return i;
+static int normalize_path(const char *path, char *out) {
+    if (!path || path[0] != '/') {
+        return -1;
+    }
+    
+    uint32_t len = 0;
+    while (*path) {
+        if (*path == '/' && len > 0 && out[len - 1] == '/') {
+            path++;
+            continue;
+        }
+        if (len + 1 >= VFS_MAX_PATH) {
+            return -1;
         }
+        out[len++] = *path++;
     }
-    /* No free descriptors */
-    RETURN_ERRNO(THUNDEROS_EMFILE);
-}
-
-/**
- * Free a file descriptor
- */
-void vfs_free_fd(int fd) {
-    if (fd >= 0 && fd < VFS_MAX_OPEN_FILES) {
-        g_file_table[fd].in_use = 0;
-        g_file_table[fd].node = NULL;
-        g_file_table[fd].pos = 0;
-        g_file_table[fd].flags = 0;
+    
+    if (len > 1 && out[len - 1] == '/') {
+        len--;
     }
+    out[len] = '\0';
+    return (int)len;
 }
 
 /**
- * Get file structure from descriptor
+ * Find the mount table entry for exactly this normalized path
  */
-vfs_file_t *vfs_get_file(int fd) {
-    if (fd < 0 || fd >= VFS_MAX_OPEN_FILES || !g_file_table[fd].in_use) {
-        set_errno(THUNDEROS_EBADF);
-        return NULL;
+static vfs_mount_t *find_mount_point(const char *path, uint32_t len) {
+    for (uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (g_mounts[i].fs && g_mounts[i].path_len == len && strcmp(g_mounts[i].path, path) == 0) {
+            return &g_mounts[i];
+        }
     }
-    return &g_file_table[fd];
+    return NULL;
 }
 
 /**
- * Resolve a path to a VFS node
- * Currently only supports absolute paths from root
+ * Find the filesystem a normalized path lives on
+ * The longest mount point that is a whole-component prefix wins. Stores
+ * the length of that prefix in *consumed (0 for the root filesystem).
  */
-vfs_node_t *vfs_resolve_path(const char *path) {
-    if (!g_root_fs) {
-        hal_uart_puts("vfs: No root filesystem mounted\n");
-        set_errno(THUNDEROS_EFS_NOTMNT);
-        return NULL;
-    }
-    
-    if (!path || path[0] != '/') {
-        hal_uart_puts("vfs: Path must be absolute (start with /)\n");
-        set_errno(THUNDEROS_EINVAL);
-        return NULL;
-    }
+static vfs_filesystem_t *find_mount(const char *path, uint32_t len, uint32_t *consumed) {
+    vfs_filesystem_t *fs = g_root_fs;
+    uint32_t best = 0;
     
-    /* Root directory */
-    if (path[1] == '\0') {
-        return g_root_fs->root;
-    }
-    
-    /* Skip leading slash */
-    path++;
-    
-    /* Start from root */
-    vfs_node_t *current = g_root_fs->root;
-    char component[256];
-    uint32_t comp_idx = 0;
-    
-    while (*path) {
-        /* Extract path component */
-        comp_idx = 0;
-        while (*path && *path != '/') {
-            if (comp_idx < 255) {
-                component[comp_idx++] = *path;
-            }
-            path++;
-        }
-        component[comp_idx] = '\0';
-        
-        if (comp_idx == 0) {
-            /* Skip empty components (e.g., "//") */
-            if (*path == '/') {
-                path++;
-            }
+    for (uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t *mount = &g_mounts[i];
+        if (!mount->fs || mount->path_len <= best || mount->path_len > len) {
             continue;
         }
-        
-        /* Lookup component in current directory */
-        if (!current->ops || !current->ops->lookup) {
-            hal_uart_puts("vfs: No lookup operation\n");
-            set_errno(THUNDEROS_EIO);
-            return NULL;
+        if (path[mount->path_len] != '/' && path[mount->path_len] != '\0') {
+            continue;
         }
         
-        vfs_node_t *next = current->ops->lookup(current, component);
-        if (!next) {
-            /* errno already set by lookup */
-            return NULL;
+        uint32_t j = 0;
+        while (j < mount->path_len && mount->path[j] == path[j]) {
+            j++;
         }
-        
-        current = next;
-        
-        /* Skip separator */
-        if (*path == '/') {
-            path++;
+        if (j == mount->path_len) {
+            fs = mount->fs;
+            best = mount->path_len;
         }
     }
     
-    return current;
+    *consumed = best;
+    return fs;
 }
 
 /**
- * Open a file
+ * Mount a filesystem on a directory
+ * The directory's own contents are hidden until the filesystem is
+ * unmounted.
  */
-int vfs_open(const char *path, uint32_t flags) {
-    if (!path) {
-        hal_uart_puts("vfs: NULL path\n");
+int vfs_mount(const char *path, vfs_filesystem_t *fs) {
+    if (!fs || !fs->root) {
+        hal_uart_puts("vfs: Invalid filesystem\n");
         RETURN_ERRNO(THUNDEROS_EINVAL);
     }
     
-    /* Resolve path */
-    vfs_node_t *node = vfs_resolve_path(path);
-    
-    /* If file doesn't exist and O_CREAT is set, create it */
-    if (!node && (flags & O_CREAT)) {
-        /* Extract parent directory and filename */
-        /* For now, only support files in root directory */
-        if (path[0] == '/' && path[1] != '\0') {
-            const char *filename = path + 1;
-            
-            /* Check if filename contains '/' */
-            const char *p = filename;
-            while (*p && *p != '/') p++;
-            if (*p == '/') {
-                hal_uart_puts("vfs: O_CREAT only supports root directory for now\n");
-                RETURN_ERRNO(THUNDEROS_EINVAL);
-            }
-            
-            /* Create file in root directory */
-            vfs_node_t *root = g_root_fs->root;
-            if (root->ops && root->ops->create) {
-                int ret = root->ops->create(root, filename, 0644);
-                if (ret != 0) {
-                    hal_uart_puts("vfs: Failed to create file\n");
-                    /* errno already set by create */
-                    return -1;
-                }
-                
-                /* Try to resolve again */
-                node = vfs_resolve_path(path);
-            }
-        }
-    }
-    
-    if (!node) {
-        hal_uart_puts("vfs: File not found: ");
-        hal_uart_puts(path);
-        hal_uart_puts("\n");
-        RETURN_ERRNO(THUNDEROS_ENOENT);
+    char normalized[VFS_MAX_PATH];
+    int len = normalize_path(path, normalized);
+    if (len <= 1) {
+        /* The root is mounted with vfs_mount_root() */
+        RETURN_ERRNO(THUNDEROS_EINVAL);
     }
     
-    /* Allocate file descriptor */
-    int fd = vfs_alloc_fd();
-    if (fd < 0) {
-        hal_uart_puts("vfs: No free file descriptors\n");
-        /* errno already set by vfs_alloc_fd */
+    vfs_node_t *dir = vfs_resolve_path(normalized);
+    if (!dir) {
+        /* errno already set by vfs_resolve_path */
         return -1;
     }
-    
-    /* Initialize file descriptor */
-    g_file_table[fd].node = node;
-    g_file_table[fd].flags = flags;
-    g_file_table[fd].pos = 0;
-    
-    /* Call filesystem open if available */
-    if (node->ops && node->ops->open) {
-        int ret = node->ops->open(node, flags);
-        if (ret != 0) {
-            vfs_free_fd(fd);
-            /* errno already set by open */
-            return -1;
-        }
+    if (dir->type != VFS_TYPE_DIRECTORY) {
+        RETURN_ERRNO(THUNDEROS_ENOTDIR);
     }
     
-    /* If O_TRUNC, truncate file to zero */
-    if (flags & O_TRUNC) {
-        node->size = 0;
+    if (find_mount_point(normalized, (uint32_t)len)) {
+        RETURN_ERRNO(THUNDEROS_EBUSY);
     }
     
-    /* If O_APPEND, seek to end */
-    if (flags & O_APPEND) {
-        g_file_table[fd].pos = node->size;
+    for (uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (!g_mounts[i].fs) {
+            strcpy(g_mounts[i].path, normalized);
+            g_mounts[i].path_len = (uint32_t)len;
+            g_mounts[i].fs = fs;
+            
+            hal_uart_puts("vfs: Mounted ");
+            hal_uart_puts(fs->name);
+            hal_uart_puts(" on ");
+            hal_uart_puts(normalized);
+            hal_uart_puts("\n");
+            clear_errno();
+            return 0;
+        }
     }
     
-    clear_errno();
-    return fd;
+    hal_uart_puts("vfs: Mount table full\n");
+    RETURN_ERRNO(THUNDEROS_ENOMEM);
 }
 
 /**
- * Close a file
+ * Detach the filesystem mounted on a directory
+ * Fails with EBUSY while files on it are open or other filesystems are
+ * mounted below it.
  */
-int vfs_close(int fd) {
-    vfs_file_t *file = vfs_get_file(fd);
-    if (!file) {
-        /* errno already set by vfs_get_file */
+int vfs_unmount(const char *path) {
+    char normalized[VFS_MAX_PATH];
+    int len = normalize_path(path, normalized);
+    if (len < 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    vfs_mount_t *mount = find_mount_point(normalized, (uint32_t)len);
+    if (!mount) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (mount->fs->open_files > 0) {
+        RETURN_ERRNO(THUNDEROS_EBUSY);
+    }
+    
+    if (mount->fs->ops->sync && mount->fs->ops->sync(mount->fs) != 0) {
+        /* errno already set by sync */
         return -1;
     }
     
-    /* Call filesystem close if available */
-    if (file->node && file->node->ops && file->node->ops->close) {
-        file->node->ops->close(file->node);
+    for (uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t *other = &g_mounts[i];
+        if (other != mount && other->fs && other->path_len > mount->path_len &&
+            other->path[mount->path_len] == '/') {
+            uint32_t j = 0;
+            while (j < mount->path_len && other->path[j] == mount->path[j]) {
+                j++;
+            }
+            if (j == mount->path_len) {
+                RETURN_ERRNO(THUNDEROS_EBUSY);
+            }
+        }
     }
     
-    /* Free the file descriptor */
-    vfs_free_fd(fd);
+    mount->fs = NULL;
     clear_errno();
     return 0;
 }
 
 /**
- * Read from a file
+ * Write back every mounted filesystem
+ * All filesystems are tried; the first error is reported.
  */
-int vfs_read(int fd, void *buffer, uint32_t size) {
-    vfs_file_t *file = vfs_get_file(fd);
-    if (!file || !file->node) {
-        /* errno already set by vfs_get_file */
-        return -1;
-    }
+int vfs_sync(void) {
+    int error = 0;
     
-    /* Check if opened for reading */
-    if ((file->flags & O_WRONLY) && !(file->flags & O_RDWR)) {
-        hal_uart_puts("vfs: File not open for reading\n");
-        RETURN_ERRNO(THUNDEROS_EACCES);
+    if (g_root_fs && g_root_fs->ops->sync && g_root_fs->ops->sync(g_root_fs) != 0) {
+        error = get_errno();
     }
     
-    /* Check if read operation exists */
-    if (!file->node->ops || !file->node->ops->read) {
-        hal_uart_puts("vfs: No read operation\n");
-        RETURN_ERRNO(THUNDEROS_EIO);
+    for (uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_filesystem_t *fs = g_mounts[i].fs;
+        if (fs && fs->ops->sync && fs->ops->sync(fs) != 0 && error == 0) {
+            error = get_errno();
+        }
     }
     
-    /* Read from current position */
-    int bytes_read = file->node->ops->read(file->node, file->pos, buffer, size);
-    if (bytes_read > 0) {
-        file->pos += bytes_read;
+    if (error != 0) {
+        RETURN_ERRNO(error);
     }
     
-    return bytes_read;
+    clear_errno();
+    return 0;
 }
 
 /**
- * Write to a file
+ * Index of the lowest set bit (x must be non-zero)
+ * De Bruijn multiply, since the kernel is not linked against libgcc.
  */
-int vfs_write(int fd, const void *buffer, uint32_t size) {
-    vfs_file_t *file = vfs_get_file(fd);
-    if (!file || !file->node) {
-        /* errno already set by vfs_get_file */
-        return -1;
-    }
+static uint32_t lowest_bit(uint64_t x) {
+    static const uint8_t debruijn_index[64] = {
+        0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6
+    };
     
-    /* Check if opened for writing */
-    if ((file->flags & O_RDONLY) && !(file->flags & O_RDWR)) {
-        hal_uart_puts("vfs: File not open for writing\n");
-        RETURN_ERRNO(THUNDEROS_EACCES);
+    return debruijn_index[((x & -x) * 0x03F79D71B4CB0A89ULL) >> 58];
+}
+
+/**
+ * Drop a reference to an open file, closing it with the last one
+ */
+void vfs_file_put(vfs_file_t *file) {
+    if (__sync_sub_and_fetch(&file->refcount, 1) != 0) {
+        return;
     }
     
-    /* Check if write operation exists */
-    if (!file->node->ops || !file->node->ops->write) {
-        hal_uart_puts("vfs: No write operation\n");
-        RETURN_ERRNO(THUNDEROS_EIO);
+    /* Watches hook the node's wait queues, which close may free */
+    if (file->epoll_items) {
+        epoll_file_release(file);
     }
     
-    /* Write at current position */
-    int bytes_written = file->node->ops->write(file->node, file->pos, buffer, size);
-    if (bytes_written > 0) {
-        file->pos += bytes_written;
-        
-        /* Update file size if we wrote past end */
-        if (file->pos > file->node->size) {
-            file->node->size = file->pos;
-        }
+    /* A node without a filesystem (a pipe end) may be freed by close */
+    vfs_filesystem_t *fs = file->node ? file->node->fs : NULL;
+    if (file->node && file->node->ops && file->node->ops->close) {
+        file->node->ops->close(file->node);
     }
-    
-    return bytes_written;
+    if (fs) {
+        __sync_sub_and_fetch(&fs->open_files, 1);
+    }
+    kfree(file);
 }
 
 /**
- * Seek within a file
+ * Get the descriptor table of the running process
  */
-int vfs_seek(int fd, int offset, int whence) {
-    vfs_file_t *file = vfs_get_file(fd);
-    if (!file || !file->node) {
-        /* errno already set by vfs_get_file */
-        return -1;
-    }
-    
-    uint32_t new_pos;
-    
-    switch (whence) {
-        case SEEK_SET:
-            new_pos = offset;
-            break;
-            
-        case SEEK_CUR:
-            new_pos = file->pos + offset;
-            break;
-            
-        case SEEK_END:
-            new_pos = file->node->size + offset;
-            break;
-            
-        default:
-            hal_uart_puts("vfs: Invalid whence value\n");
-            RETURN_ERRNO(THUNDEROS_EINVAL);
+vfs_fd_table_t *vfs_current_fd_table(void) {
+    struct process *proc = process_current();
+    if (proc && proc->fd_table) {
+        return proc->fd_table;
     }
-    
-    file->pos = new_pos;
-    clear_errno();
-    return new_pos;
+    return &g_kernel_fd_table;
 }
 
 /**
- * Create a directory
+ * Grow a descriptor table so that descriptor fd fits
+ * Capacity doubles, so growth cost is amortized over the descriptors.
  */
-int vfs_mkdir(const char *path, uint32_t mode) {
-    if (!g_root_fs || !path) {
-        RETURN_ERRNO(THUNDEROS_EINVAL);
+static int fd_table_grow(vfs_fd_table_t *table, uint32_t fd) {
+    uint32_t capacity = table->capacity ? table->capacity : VFS_FD_TABLE_INITIAL;
+    while (capacity <= fd) {
+        capacity *= 2;
     }
     
-    /* For now, only support directories in root */
-    if (path[0] != '/' || path[1] == '\0') {
-        RETURN_ERRNO(THUNDEROS_EINVAL);
+    vfs_file_t **files = (vfs_file_t **)kmalloc(capacity * sizeof(vfs_file_t *));
+    if (!files) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
     }
     
-    const char *dirname = path + 1;
-    
-    /* Check if name contains '/' */
-    const char *p = dirname;
-    while (*p && *p != '/') p++;
-    if (*p == '/') {
-        hal_uart_puts("vfs: mkdir only supports root directory for now\n");
-        RETURN_ERRNO(THUNDEROS_EINVAL);
+    for (uint32_t i = 0; i < capacity; i++) {
+        files[i] = (i < table->capacity) ? table->files[i] : NULL;
     }
     
-    vfs_node_t *root = g_root_fs->root;
-    if (!root->ops || !root->ops->mkdir) {
-        hal_uart_puts("vfs: No mkdir operation\n");
-        RETURN_ERRNO(THUNDEROS_EIO);
+    if (table->files) {
+        kfree(table->files);
     }
-    
-    return root->ops->mkdir(root, dirname, mode);
+    table->files = files;
+    table->capacity = capacity;
+    return 0;
 }
 
 /**
- * Remove a directory
+ * Mark a descriptor used in the allocation bitmap
+ * A descriptor starts out passed on to new processes.
  */
-int vfs_rmdir(const char *path) {
-    if (!g_root_fs || !path) {
-        RETURN_ERRNO(THUNDEROS_EINVAL);
-    }
-    
-    /* For now, only support directories in root */
-    if (path[0] != '/' || path[1] == '\0') {
-        RETURN_ERRNO(THUNDEROS_EINVAL);
-    }
+static void fd_mark_used(vfs_fd_table_t *table, uint32_t fd) {
+    uint32_t word = fd / 64;
     
-    const char *dirname = path + 1;
-    
-    vfs_node_t *root = g_root_fs->root;
-    if (!root->ops || !root->ops->rmdir) {
-        hal_uart_puts("vfs: No rmdir operation\n");
-        RETURN_ERRNO(THUNDEROS_EIO);
+    table->used[word] |= 1ULL << (fd % 64);
+    table->cloexec[word] &= ~(1ULL << (fd % 64));
+    if (table->used[word] == ~0ULL) {
+        table->full |= 1ULL << word;
     }
-    
-    return root->ops->rmdir(root, dirname);
 }
 
 /**
- * Remove a file
+ * Mark a descriptor free in the allocation bitmap
  */
-int vfs_unlink(const char *path) {
-    if (!g_root_fs || !path) {
-        RETURN_ERRNO(THUNDEROS_EINVAL);
-    }
+static void fd_mark_free(vfs_fd_table_t *table, uint32_t fd) {
+    uint32_t word = fd / 64;
     
-    /* For now, only support files in root */
-    if (path[0] != '/' || path[1] == '\0') {
-        RETURN_ERRNO(THUNDEROS_EINVAL);
+    table->used[word] &= ~(1ULL << (fd % 64));
+    table->full &= ~(1ULL << word);
+}
+
+/**
+ * Keep a descriptor from being passed on to new processes
+ */
+static void fd_mark_cloexec(vfs_fd_table_t *table, uint32_t fd) {
+    table->cloexec[fd / 64] |= 1ULL << (fd % 64);
+}
+
+/**
+ * Install a file at the lowest free descriptor
+ */
+static int fd_table_install(vfs_fd_table_t *table, vfs_file_t *file) {
+    if (table->full == ~0ULL) {
+        RETURN_ERRNO(THUNDEROS_EMFILE);
+    }
+    
+    uint32_t word = lowest_bit(~table->full);
+    uint32_t fd = word * 64 + lowest_bit(~table->used[word]);
+    
+    if (fd >= table->capacity && fd_table_grow(table, fd) != 0) {
+        /* errno already set by fd_table_grow */
+        return -1;
+    }
+    
+    fd_mark_used(table, fd);
+    table->files[fd] = file;
+    return (int)fd;
+}
+
+/**
+ * Create a copy of a descriptor table for a new process
+ * The copy shares every open file with the original, except those of
+ * descriptors opened with O_CLOEXEC.
+ */
+vfs_fd_table_t *vfs_fd_table_clone(vfs_fd_table_t *parent) {
+    vfs_fd_table_t *table = (vfs_fd_table_t *)kmalloc(sizeof(vfs_fd_table_t));
+    if (!table) {
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    
+    table->files = NULL;
+    table->capacity = 0;
+    table->full = 0;
+    for (uint32_t i = 0; i < VFS_FD_WORDS; i++) {
+        table->used[i] = 0;
+        table->cloexec[i] = 0;
+    }
+    table->used[0] = FD_STDIO_MASK;
+    
+    if (parent && parent->capacity > 0) {
+        if (fd_table_grow(table, parent->capacity - 1) != 0) {
+            kfree(table);
+            /* errno already set by fd_table_grow */
+            return NULL;
+        }
+        
+        for (uint32_t fd = 0; fd < parent->capacity; fd++) {
+            vfs_file_t *file = parent->files[fd];
+            if (file && !(parent->cloexec[fd / 64] & (1ULL << (fd % 64)))) {
+                __sync_add_and_fetch(&file->refcount, 1);
+                table->files[fd] = file;
+                fd_mark_used(table, fd);
+            }
+        }
+    }
+    
+    clear_errno();
+    return table;
+}
+
+/**
+ * Close every descriptor in a table and free it
+ */
+void vfs_fd_table_destroy(vfs_fd_table_t *table) {
+    if (!table || table == &g_kernel_fd_table) {
+        return;
+    }
+    
+    for (uint32_t fd = 0; fd < table->capacity; fd++) {
+        if (table->files[fd]) {
+            vfs_file_t *file = table->files[fd];
+            table->files[fd] = NULL;
+            vfs_file_put(file);
+        }
+    }
+    
+    if (table->files) {
+        kfree(table->files);
+    }
+    kfree(table);
+}
+
+/**
+ * Allocate a file descriptor
+ * The descriptor is reserved with no file attached.
+ */
+int vfs_alloc_fd(void) {
+    int fd = fd_table_install(vfs_current_fd_table(), NULL);
+    if (fd < 0) {
+        /* errno already set by fd_table_install */
+        return -1;
+    }
+    
+    clear_errno();
+    return fd;
+}
+
+/**
+ * Free a file descriptor
+ * Drops the descriptor's reference to its open file. stdin/stdout/stderr
+ * stay reserved and go back to the console.
+ */
+void vfs_free_fd(int fd) {
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    
+    if (fd < 0 || (uint32_t)fd >= table->capacity) {
+        return;
+    }
+    
+    vfs_file_t *file = table->files[fd];
+    table->files[fd] = NULL;
+    if (fd > VFS_FD_STDERR) {
+        fd_mark_free(table, fd);
+    }
+    
+    if (file) {
+        vfs_file_put(file);
+    }
+}
+
+/**
+ * Get file structure from descriptor
+ */
+vfs_file_t *vfs_get_file(int fd) {
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    
+    if (fd < 0 || (uint32_t)fd >= table->capacity || !table->files[fd]) {
+        set_errno(THUNDEROS_EBADF);
+        return NULL;
+    }
+    return table->files[fd];
+}
+
+/**
+ * Take a reference to the file open on a descriptor
+ * The file stays open, even if the descriptor is closed, until the
+ * reference is dropped with vfs_file_put().
+ */
+vfs_file_t *vfs_file_get(int fd) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file) {
+        /* errno already set by vfs_get_file */
+        return NULL;
+    }
+    __sync_add_and_fetch(&file->refcount, 1);
+    return file;
+}
+
+/**
+ * Install a file at the lowest free descriptor
+ * The descriptor takes over the caller's reference. flags may contain
+ * O_CLOEXEC.
+ */
+int vfs_install_file(vfs_file_t *file, uint32_t flags) {
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    int fd = fd_table_install(table, file);
+    if (fd < 0) {
+        /* errno already set by fd_table_install */
+        return -1;
+    }
+    if (flags & O_CLOEXEC) {
+        fd_mark_cloexec(table, fd);
+    }
+    
+    clear_errno();
+    return fd;
+}
+
+/**
+ * Duplicate a descriptor onto the lowest free descriptor
+ */
+int vfs_dup(int fd) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    int new_fd = fd_table_install(vfs_current_fd_table(), file);
+    if (new_fd < 0) {
+        /* errno already set by fd_table_install */
+        return -1;
+    }
+    
+    __sync_add_and_fetch(&file->refcount, 1);
+    clear_errno();
+    return new_fd;
+}
+
+/**
+ * Duplicate a descriptor onto a chosen descriptor, closing what was there
+ * Putting a file on stdin/stdout/stderr redirects it away from the console,
+ * which is how the shell connects a pipeline.
+ */
+int vfs_dup2(int old_fd, int new_fd) {
+    vfs_file_t *file = vfs_get_file(old_fd);
+    if (!file) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (new_fd < 0 || new_fd >= VFS_FD_TABLE_MAX) {
+        RETURN_ERRNO(THUNDEROS_EBADF);
+    }
+    
+    if (new_fd == old_fd) {
+        clear_errno();
+        return new_fd;
+    }
+    
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    if ((uint32_t)new_fd >= table->capacity && fd_table_grow(table, new_fd) != 0) {
+        /* errno already set by fd_table_grow */
+        return -1;
+    }
+    
+    /* Take the new reference first in case new_fd held the last one */
+    __sync_add_and_fetch(&file->refcount, 1);
+    vfs_free_fd(new_fd);
+    fd_mark_used(table, new_fd);
+    table->files[new_fd] = file;
+    
+    clear_errno();
+    return new_fd;
+}
+
+/**
+ * Open a node that has no path, such as one end of a pipe
+ * The node's open operation is not called; whoever made the node has set
+ * it up. On failure the node is left to the caller.
+ */
+int vfs_open_node(vfs_node_t *node, uint32_t flags) {
+    vfs_file_t *file = (vfs_file_t *)kmalloc(sizeof(vfs_file_t));
+    if (!file) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    file->node = node;
+    file->flags = flags & ~O_CLOEXEC;
+    file->pos = 0;
+    file->refcount = 1;
+    file->epoll_items = NULL;
+    
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    int fd = fd_table_install(table, file);
+    if (fd < 0) {
+        kfree(file);
+        /* errno already set by fd_table_install */
+        return -1;
+    }
+    if (flags & O_CLOEXEC) {
+        fd_mark_cloexec(table, fd);
+    }
+    
+    if (node->fs) {
+        __sync_add_and_fetch(&node->fs->open_files, 1);
+    }
+    clear_errno();
+    return fd;
+}
+
+/**
+ * Resolve a path to a VFS node
+ * Only absolute paths are supported. The walk starts at the root of the
+ * filesystem with the longest mount point matching the path.
+ */
+vfs_node_t *vfs_resolve_path(const char *path) {
+    if (!g_root_fs) {
+        hal_uart_puts("vfs: No root filesystem mounted\n");
+        set_errno(THUNDEROS_EFS_NOTMNT);
+        return NULL;
+    }
+    
+    if (!path || path[0] != '/') {
+        hal_uart_puts("vfs: Path must be absolute (start with /)\n");
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    
+    char normalized[VFS_MAX_PATH];
+    int len = normalize_path(path, normalized);
+    if (len < 0) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    
+    /* Start from the root of the filesystem holding the path */
+    uint32_t consumed;
+    vfs_filesystem_t *fs = find_mount(normalized, (uint32_t)len, &consumed);
+    vfs_node_t *current = fs->root;
+    path = normalized + consumed;
+    
+    /* Skip leading slash */
+    if (*path == '/') {
+        path++;
+    }
+    char component[256];
+    uint32_t comp_idx = 0;
+    
+    while (*path) {
+        /* Extract path component */
+        comp_idx = 0;
+        while (*path && *path != '/') {
+            if (comp_idx < 255) {
+                component[comp_idx++] = *path;
+            }
+            path++;
+        }
+        component[comp_idx] = '\0';
+        
+        if (comp_idx == 0) {
+            /* Skip empty components (e.g., "//") */
+            if (*path == '/') {
+                path++;
+            }
+            continue;
+        }
+        
+        /* Lookup component in current directory */
+        if (!current->ops || !current->ops->lookup) {
+            hal_uart_puts("vfs: No lookup operation\n");
+            set_errno(THUNDEROS_EIO);
+            return NULL;
+        }
+        
+        vfs_node_t *next = current->ops->lookup(current, component);
+        if (!next) {
+            /* errno already set by lookup */
+            return NULL;
+        }
+        
+        current = next;
+        
+        /* Skip separator */
+        if (*path == '/') {
+            path++;
+        }
+    }
+    
+    return current;
+}
+
+/**
+ * Resolve the directory that holds the last component of a path
+ * Copies the last component to name (at most 256 bytes with terminator).
+ */
+static vfs_node_t *vfs_resolve_parent(const char *path, char *name) {
+    if (!path || path[0] != '/') {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    
+    /* Find the last component, ignoring trailing slashes */
+    uint32_t end = strlen(path);
+    while (end > 1 && path[end - 1] == '/') {
+        end--;
+    }
+    uint32_t start = end;
+    while (start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+    
+    if (start == end || end - start > 255) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    
+    for (uint32_t i = start; i < end; i++) {
+        name[i - start] = path[i];
+    }
+    name[end - start] = '\0';
+    
+    /* Parent path is everything before the last component */
+    char parent_path[256];
+    if (start >= sizeof(parent_path)) {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < start; i++) {
+        parent_path[i] = path[i];
+    }
+    parent_path[start] = '\0';
+    
+    vfs_node_t *parent = vfs_resolve_path(parent_path);
+    if (!parent) {
+        /* errno already set by vfs_resolve_path */
+        return NULL;
+    }
+    
+    if (parent->type != VFS_TYPE_DIRECTORY) {
+        set_errno(THUNDEROS_ENOTDIR);
+        return NULL;
+    }
+    
+    return parent;
+}
+
+/**
+ * Open a node found by name: set up the open file and give it a descriptor
+ */
+static int open_found_node(vfs_node_t *node, uint32_t flags) {
+    /* Direct I/O needs the filesystem to drive the device itself */
+    if ((flags & O_DIRECT) &&
+        (node->type != VFS_TYPE_FILE || !node->ops || !node->ops->direct_io)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Call filesystem open if available */
+    if (node->ops && node->ops->open) {
+        int ret = node->ops->open(node, flags);
+        if (ret != 0) {
+            /* errno already set by open */
+            return -1;
+        }
+    }
+    
+    /* Initialize the open file */
+    vfs_file_t *file = (vfs_file_t *)kmalloc(sizeof(vfs_file_t));
+    if (!file) {
+        if (node->ops && node->ops->close) {
+            node->ops->close(node);
+        }
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    file->node = node;
+    file->flags = flags & ~(O_CLOEXEC | O_EXCL);
+    file->pos = 0;
+    file->refcount = 1;
+    file->epoll_items = NULL;
+    if (node->fs) {
+        __sync_add_and_fetch(&node->fs->open_files, 1);
+    }
+    
+    /* If O_TRUNC, truncate file to zero and release its blocks */
+    if ((flags & O_TRUNC) && node->type == VFS_TYPE_FILE && node->size > 0) {
+        if (node->ops && node->ops->truncate) {
+            if (node->ops->truncate(node, 0) != 0) {
+                int error = get_errno();
+                vfs_file_put(file);
+                RETURN_ERRNO(error);
+            }
+        }
+        node->size = 0;
+    }
+    
+    /* If O_APPEND, seek to end */
+    if (flags & O_APPEND) {
+        file->pos = node->size;
+    }
+    
+    /* Allocate file descriptor */
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    int fd = fd_table_install(table, file);
+    if (fd < 0) {
+        hal_uart_puts("vfs: No free file descriptors\n");
+        int error = get_errno();
+        vfs_file_put(file);
+        RETURN_ERRNO(error);
+    }
+    if (flags & O_CLOEXEC) {
+        fd_mark_cloexec(table, fd);
+    }
+    
+    clear_errno();
+    return fd;
+}
+
+/**
+ * Open a file
+ */
+int vfs_open(const char *path, uint32_t flags) {
+    if (!path) {
+        hal_uart_puts("vfs: NULL path\n");
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Resolve path */
+    vfs_node_t *node = vfs_resolve_path(path);
+    if (node && (flags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL)) {
+        RETURN_ERRNO(THUNDEROS_EEXIST);
+    }
+    
+    /* If file doesn't exist and O_CREAT is set, create it */
+    if (!node && (flags & O_CREAT)) {
+        char filename[256];
+        vfs_node_t *parent = vfs_resolve_parent(path, filename);
+        if (!parent) {
+            /* errno already set by vfs_resolve_parent */
+            return -1;
+        }
+        
+        if (parent->ops && parent->ops->create) {
+            int ret = parent->ops->create(parent, filename, 0644);
+            if (ret != 0) {
+                hal_uart_puts("vfs: Failed to create file\n");
+                /* errno already set by create */
+                return -1;
+            }
+            
+            /* Try to resolve again */
+            node = vfs_resolve_path(path);
+        }
+    }
+    
+    if (!node) {
+        hal_uart_puts("vfs: File not found: ");
+        hal_uart_puts(path);
+        hal_uart_puts("\n");
+        RETURN_ERRNO(THUNDEROS_ENOENT);
+    }
+    
+    return open_found_node(node, flags);
+}
+
+/**
+ * Open a name in a directory node
+ * Used for objects that live in a filesystem with no mount point, such
+ * as shared memory. Takes the same flags as vfs_open().
+ */
+int vfs_open_at(vfs_node_t *dir, const char *name, uint32_t flags) {
+    if (!dir || !name || !name[0]) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (!dir->ops || !dir->ops->lookup) {
+        RETURN_ERRNO(THUNDEROS_ENOTDIR);
+    }
+    
+    vfs_node_t *node = dir->ops->lookup(dir, name);
+    if (node && (flags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL)) {
+        RETURN_ERRNO(THUNDEROS_EEXIST);
+    }
+    
+    if (!node && (flags & O_CREAT)) {
+        if (!dir->ops->create) {
+            RETURN_ERRNO(THUNDEROS_EPERM);
+        }
+        /* Someone else may have created it in the meantime */
+        if (dir->ops->create(dir, name, 0644) != 0 &&
+            (get_errno() != THUNDEROS_EEXIST || (flags & O_EXCL))) {
+            /* errno already set by create */
+            return -1;
+        }
+        node = dir->ops->lookup(dir, name);
+    }
+    
+    if (!node) {
+        RETURN_ERRNO(THUNDEROS_ENOENT);
+    }
+    return open_found_node(node, flags);
+}
+
+/**
+ * Close a file
+ */
+int vfs_close(int fd) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    /* Write-back errors would be lost once the descriptor is gone */
+    int error = 0;
+    if (file->node && file->node->ops && file->node->ops->flush &&
+        file->node->ops->flush(file->node) != 0) {
+        error = get_errno();
+    }
+    
+    /* Free the file descriptor; the last one closes the file */
+    vfs_free_fd(fd);
+    
+    if (error != 0) {
+        RETURN_ERRNO(error);
+    }
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Total length of a buffer list
+ * Returns -1 if the list is too long or the total does not fit the
+ * byte count a read or write returns.
+ */
+static int64_t iov_total(const vfs_iovec_t *iov, int iovcnt) {
+    if (!iov || iovcnt < 0 || iovcnt > VFS_IOV_MAX) {
+        return -1;
+    }
+    
+    int64_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > 0x7FFFFFFFUL || total + (int64_t)iov[i].iov_len > 0x7FFFFFFF) {
+            return -1;
+        }
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+/**
+ * Shorten a buffer list so it covers at most limit bytes
+ * Returns the number of entries still in use.
+ */
+static int iov_trim(vfs_iovec_t *iov, int iovcnt, uint64_t limit) {
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len >= limit) {
+            iov[i].iov_len = limit;
+            return i + 1;
+        }
+        limit -= iov[i].iov_len;
+    }
+    return iovcnt;
+}
+
+/**
+ * Transfer a buffer list with the filesystem's direct I/O operation
+ * One call per buffer, stopping at the first short one.
+ */
+static int file_direct_io(vfs_file_t *file, uint64_t offset, vfs_iovec_t *iov, int iovcnt,
+                          int write) {
+    int done = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        
+        int bytes = file->node->ops->direct_io(file->node, offset + done, iov[i].iov_base,
+                                               (uint32_t)iov[i].iov_len, write);
+        if (bytes < 0) {
+            /* Report what was transferred before the error */
+            return done > 0 ? done : -1;
+        }
+        done += bytes;
+        if ((size_t)bytes < iov[i].iov_len) {
+            break;
+        }
+    }
+    
+    return done;
+}
+
+/**
+ * Whether a node has positions: pipes, sockets, eventfds and epoll
+ * instances do not
+ */
+static int node_is_seekable(vfs_node_t *node) {
+    return node->type != VFS_TYPE_PIPE && node->type != VFS_TYPE_SOCKET &&
+           node->type != VFS_TYPE_EVENTFD && node->type != VFS_TYPE_EPOLL;
+}
+
+/**
+ * Read from a file into a buffer list at the given offset
+ * The file position is neither used nor changed.
+ */
+static int file_readv(vfs_file_t *file, uint64_t offset, vfs_iovec_t *iov, int iovcnt) {
+    /* Check if opened for reading */
+    if ((file->flags & O_WRONLY) && !(file->flags & O_RDWR)) {
+        hal_uart_puts("vfs: File not open for reading\n");
+        RETURN_ERRNO(THUNDEROS_EACCES);
+    }
+    
+    /* Check if read operation exists */
+    if (!file->node->ops || (!file->node->ops->read && !file->node->ops->readv)) {
+        hal_uart_puts("vfs: No read operation\n");
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    int64_t total = iov_total(iov, iovcnt);
+    if (total < 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Nothing is stored past the filesystem's offset range */
+    if (total == 0 || offset >= VFS_MAX_OFFSET) {
+        clear_errno();
+        return 0;
+    }
+    iovcnt = iov_trim(iov, iovcnt, VFS_MAX_OFFSET - offset);
+    
+    if (file->flags & O_DIRECT) {
+        return file_direct_io(file, offset, iov, iovcnt, 0);
+    }
+    
+    if (file->node->ops->readv) {
+        return file->node->ops->readv(file->node, offset, iov, iovcnt);
+    }
+    
+    /* One read per buffer, stopping at the first short one */
+    int done = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        
+        int bytes_read = file->node->ops->read(file->node, offset + done,
+                                               iov[i].iov_base, (uint32_t)iov[i].iov_len);
+        if (bytes_read < 0) {
+            /* Report what was read before the error */
+            return done > 0 ? done : -1;
+        }
+        done += bytes_read;
+        if ((size_t)bytes_read < iov[i].iov_len) {
+            break;
+        }
+    }
+    
+    return done;
+}
+
+/**
+ * Write a buffer list to a file at the given offset
+ * The file position is neither used nor changed.
+ */
+static int file_writev(vfs_file_t *file, uint64_t offset, vfs_iovec_t *iov, int iovcnt) {
+    /* Check if opened for writing (O_RDONLY is 0, so test the others) */
+    if (!(file->flags & (O_WRONLY | O_RDWR))) {
+        hal_uart_puts("vfs: File not open for writing\n");
+        RETURN_ERRNO(THUNDEROS_EACCES);
+    }
+    
+    /* Check if write operation exists */
+    if (!file->node->ops || (!file->node->ops->write && !file->node->ops->writev)) {
+        hal_uart_puts("vfs: No write operation\n");
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    int64_t total = iov_total(iov, iovcnt);
+    if (total < 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (total == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    if (offset >= VFS_MAX_OFFSET) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    iovcnt = iov_trim(iov, iovcnt, VFS_MAX_OFFSET - offset);
+    
+    int done = 0;
+    if (file->flags & O_DIRECT) {
+        done = file_direct_io(file, offset, iov, iovcnt, 1);
+    } else if (file->node->ops->writev) {
+        done = file->node->ops->writev(file->node, offset, iov, iovcnt);
+    } else {
+        /* One write per buffer, stopping at the first short one */
+        for (int i = 0; i < iovcnt; i++) {
+            if (iov[i].iov_len == 0) {
+                continue;
+            }
+            
+            int bytes_written = file->node->ops->write(file->node, offset + done,
+                                                       iov[i].iov_base, (uint32_t)iov[i].iov_len);
+            if (bytes_written < 0) {
+                if (done == 0) {
+                    return -1;
+                }
+                /* Report what was written before the error */
+                break;
+            }
+            done += bytes_written;
+            if ((size_t)bytes_written < iov[i].iov_len) {
+                break;
+            }
+        }
+    }
+    
+    /* Update file size if we wrote past end */
+    if (done > 0 && file->node->type == VFS_TYPE_FILE && offset + done > file->node->size) {
+        file->node->size = offset + done;
+    }
+    
+    return done;
+}
+
+/**
+ * Read from a file
+ */
+int vfs_read(int fd, void *buffer, uint32_t size) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    /* Read from current position */
+    vfs_iovec_t iov = { buffer, size };
+    int bytes_read = file_readv(file, file->pos, &iov, 1);
+    if (bytes_read > 0) {
+        file->pos += bytes_read;
+    }
+    
+    return bytes_read;
+}
+
+/**
+ * Write to a file
+ */
+int vfs_write(int fd, const void *buffer, uint32_t size) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    /* Write at current position */
+    vfs_iovec_t iov = { (void *)buffer, size };
+    int bytes_written = file_writev(file, file->pos, &iov, 1);
+    if (bytes_written > 0) {
+        file->pos += bytes_written;
+    }
+    
+    return bytes_written;
+}
+
+/**
+ * Read from a file at an offset, leaving the file position alone
+ */
+int vfs_pread(int fd, void *buffer, uint32_t size, uint64_t offset) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (!node_is_seekable(file->node)) {
+        RETURN_ERRNO(THUNDEROS_ESPIPE);
+    }
+    
+    vfs_iovec_t iov = { buffer, size };
+    return file_readv(file, offset, &iov, 1);
+}
+
+/**
+ * Write to a file at an offset, leaving the file position alone
+ */
+int vfs_pwrite(int fd, const void *buffer, uint32_t size, uint64_t offset) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (!node_is_seekable(file->node)) {
+        RETURN_ERRNO(THUNDEROS_ESPIPE);
+    }
+    
+    vfs_iovec_t iov = { (void *)buffer, size };
+    return file_writev(file, offset, &iov, 1);
+}
+
+/**
+ * Read from a file into a list of buffers
+ * iov must be a kernel copy; entries past the file's offset range are
+ * shortened in place.
+ */
+int vfs_readv(int fd, vfs_iovec_t *iov, int iovcnt) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    int bytes_read = file_readv(file, file->pos, iov, iovcnt);
+    if (bytes_read > 0) {
+        file->pos += bytes_read;
+    }
+    
+    return bytes_read;
+}
+
+/**
+ * Write a list of buffers to a file
+ * iov must be a kernel copy; entries past the file's offset range are
+ * shortened in place.
+ */
+int vfs_writev(int fd, vfs_iovec_t *iov, int iovcnt) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    int bytes_written = file_writev(file, file->pos, iov, iovcnt);
+    if (bytes_written > 0) {
+        file->pos += bytes_written;
+    }
+    
+    return bytes_written;
+}
+
+/**
+ * Copy between two files through a kernel buffer
+ * Used when the filesystem has no copy_range operation of its own.
+ */
+static int copy_through_buffer(vfs_node_t *src, uint64_t src_offset,
+                               vfs_node_t *dst, uint64_t dst_offset, uint32_t len) {
+    uint32_t chunk_max = len < VFS_COPY_CHUNK ? len : VFS_COPY_CHUNK;
+    uint8_t *buffer = (uint8_t *)kmalloc(chunk_max);
+    if (!buffer) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    int done = 0;
+    while ((uint32_t)done < len) {
+        uint32_t chunk = len - done;
+        if (chunk > chunk_max) {
+            chunk = chunk_max;
+        }
+        
+        int got = src->ops->read(src, src_offset + done, buffer, chunk);
+        if (got <= 0) {
+            if (got < 0 && done == 0) {
+                done = -1;
+            }
+            break;
+        }
+        
+        int put = dst->ops->write(dst, dst_offset + done, buffer, (uint32_t)got);
+        if (put < 0) {
+            if (done == 0) {
+                done = -1;
+            }
+            break;
+        }
+        done += put;
+        
+        if (put < got || (uint32_t)got < chunk) {
+            break;
+        }
+    }
+    
+    kfree(buffer);
+    return done;
+}
+
+/**
+ * Copy a byte range from one open file to another
+ * 
+ * off_in and off_out give the offsets to use and are advanced past the
+ * copied data. When one is NULL, that file's position is used and
+ * advanced instead. The data never passes through user memory.
+ * Returns the number of bytes copied, 0 at the end of the source file,
+ * or -1 on error.
+ */
+int vfs_copy_file_range(int fd_in, uint64_t *off_in, int fd_out, uint64_t *off_out, uint32_t len) {
+    vfs_file_t *in = vfs_get_file(fd_in);
+    vfs_file_t *out = vfs_get_file(fd_out);
+    if (!in || !in->node || !out || !out->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    /* Check access modes (O_RDONLY is 0, so test the others) */
+    if ((in->flags & O_WRONLY) && !(in->flags & O_RDWR)) {
+        RETURN_ERRNO(THUNDEROS_EACCES);
+    }
+    if (!(out->flags & (O_WRONLY | O_RDWR))) {
+        RETURN_ERRNO(THUNDEROS_EACCES);
+    }
+    
+    if (in->node->type != VFS_TYPE_FILE || out->node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    vfs_ops_t *in_ops = in->node->ops;
+    vfs_ops_t *out_ops = out->node->ops;
+    if (!in_ops || !in_ops->read || !out_ops || !out_ops->write) {
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    uint64_t src = off_in ? *off_in : in->pos;
+    uint64_t dst = off_out ? *off_out : out->pos;
+    
+    /* Nothing is stored past the filesystem's offset range */
+    if (src >= VFS_MAX_OFFSET || src >= in->node->size || len == 0) {
+        clear_errno();
+        return 0;
+    }
+    if (dst >= VFS_MAX_OFFSET) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    
+    if (len > 0x7FFFFFFF) {
+        len = 0x7FFFFFFF;
+    }
+    if (len > in->node->size - src) {
+        len = (uint32_t)(in->node->size - src);
+    }
+    if (len > VFS_MAX_OFFSET - dst) {
+        len = (uint32_t)(VFS_MAX_OFFSET - dst);
+    }
+    
+    /* Overlapping ranges of one file would read back their own output */
+    if (in->node == out->node && src < dst + len && dst < src + len) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    int copied;
+    if (in->node->fs == out->node->fs && out_ops->copy_range) {
+        copied = out_ops->copy_range(in->node, src, out->node, dst, len);
+    } else {
+        copied = copy_through_buffer(in->node, src, out->node, dst, len);
+    }
+    if (copied <= 0) {
+        return copied;
+    }
+    
+    if (off_in) {
+        *off_in += copied;
+    } else {
+        in->pos += copied;
+    }
+    if (off_out) {
+        *off_out += copied;
+    } else {
+        out->pos += copied;
+    }
+    
+    /* Update file size if we wrote past end */
+    if (dst + copied > out->node->size) {
+        out->node->size = dst + copied;
+    }
+    
+    return copied;
+}
+
+/**
+ * Create a pipe
+ * fds[0] receives the read end and fds[1] the write end.
+ */
+int vfs_pipe(int fds[2], uint32_t flags) {
+    if (flags & ~(O_NONBLOCK | O_CLOEXEC)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    vfs_node_t *read_end;
+    vfs_node_t *write_end;
+    if (pipe_create(&read_end, &write_end, flags) != 0) {
+        /* errno already set by pipe_create */
+        return -1;
+    }
+    
+    int read_fd = vfs_open_node(read_end, O_RDONLY | flags);
+    if (read_fd < 0) {
+        int error = get_errno();
+        read_end->ops->close(read_end);
+        write_end->ops->close(write_end);
+        RETURN_ERRNO(error);
+    }
+    
+    int write_fd = vfs_open_node(write_end, O_WRONLY | flags);
+    if (write_fd < 0) {
+        int error = get_errno();
+        vfs_close(read_fd);
+        write_end->ops->close(write_end);
+        RETURN_ERRNO(error);
+    }
+    
+    fds[0] = read_fd;
+    fds[1] = write_fd;
+    clear_errno();
+    return 0;
+}
+
+/**
+ * File side of a splice
+ */
+typedef struct {
+    vfs_file_t *file;                  /* Open file */
+    uint64_t offset;                   /* Next offset in the file */
+} splice_file_t;
+
+/**
+ * Splice actor: read file data straight into a pipe page
+ */
+static int splice_from_file(void *ctx, void *data, uint32_t len) {
+    splice_file_t *splice = (splice_file_t *)ctx;
+    vfs_iovec_t iov = { data, len };
+    
+    int bytes_read = file_readv(splice->file, splice->offset, &iov, 1);
+    if (bytes_read > 0) {
+        splice->offset += bytes_read;
+    }
+    return bytes_read;
+}
+
+/**
+ * Splice actor: write a pipe page straight to a file
+ */
+static int splice_to_file(void *ctx, void *data, uint32_t len) {
+    splice_file_t *splice = (splice_file_t *)ctx;
+    vfs_iovec_t iov = { data, len };
+    
+    int bytes_written = file_writev(splice->file, splice->offset, &iov, 1);
+    if (bytes_written > 0) {
+        splice->offset += bytes_written;
+    }
+    return bytes_written;
+}
+
+/**
+ * Move data between a pipe and a file or another pipe
+ * One side must be a pipe. File data goes straight between the file and
+ * the pipe's pages, and between two pipes whole pages change hands, so
+ * nothing passes through user memory. Offsets work as for
+ * copy_file_range; a pipe has none, so passing one for it fails with
+ * ESPIPE.
+ */
+int vfs_splice(int fd_in, uint64_t *off_in, int fd_out, uint64_t *off_out, uint32_t len,
+               uint32_t flags) {
+    vfs_file_t *in = vfs_get_file(fd_in);
+    vfs_file_t *out = vfs_get_file(fd_out);
+    if (!in || !in->node || !out || !out->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    int in_pipe = (in->node->type == VFS_TYPE_PIPE);
+    int out_pipe = (out->node->type == VFS_TYPE_PIPE);
+    if ((in_pipe && off_in) || (out_pipe && off_out)) {
+        RETURN_ERRNO(THUNDEROS_ESPIPE);
+    }
+    
+    /* Check access modes (O_RDONLY is 0, so test the others) */
+    if ((in->flags & O_WRONLY) && !(in->flags & O_RDWR)) {
+        RETURN_ERRNO(THUNDEROS_EBADF);
+    }
+    if (!(out->flags & (O_WRONLY | O_RDWR))) {
+        RETURN_ERRNO(THUNDEROS_EBADF);
+    }
+    
+    if (len > 0x7FFFFFFF) {
+        len = 0x7FFFFFFF;
+    }
+    int nonblock = (flags & SPLICE_F_NONBLOCK) != 0;
+    
+    if (in_pipe && out_pipe) {
+        return pipe_splice_pipe(in->node, out->node, len, nonblock);
+    }
+    
+    if (in_pipe && out->node->type == VFS_TYPE_FILE) {
+        splice_file_t splice = { out, off_out ? *off_out : out->pos };
+        int moved = pipe_splice_read(in->node, splice_to_file, &splice, len, nonblock);
+        if (moved > 0) {
+            if (off_out) {
+                *off_out = splice.offset;
+            } else {
+                out->pos = splice.offset;
+            }
+        }
+        return moved;
+    }
+    
+    if (out_pipe && in->node->type == VFS_TYPE_FILE) {
+        splice_file_t splice = { in, off_in ? *off_in : in->pos };
+        int moved = pipe_splice_write(out->node, splice_from_file, &splice, len, nonblock);
+        if (moved > 0) {
+            if (off_in) {
+                *off_in = splice.offset;
+            } else {
+                in->pos = splice.offset;
+            }
+        }
+        return moved;
+    }
+    
+    RETURN_ERRNO(THUNDEROS_EINVAL);
+}
+
+/**
+ * Move user memory into a pipe (write end) or pipe data into user memory
+ * (read end)
+ * iov must be a kernel copy. The data is copied: pages cannot be shared
+ * between a process and a pipe, so SPLICE_F_GIFT has no effect.
+ */
+int vfs_vmsplice(int fd, vfs_iovec_t *iov, int iovcnt, uint32_t flags) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (file->node->type != VFS_TYPE_PIPE) {
+        RETURN_ERRNO(THUNDEROS_EBADF);
+    }
+    
+    if ((flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT)) ||
+        iov_total(iov, iovcnt) < 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    int nonblock = (flags & SPLICE_F_NONBLOCK) || (file->node->flags & O_NONBLOCK);
+    if (file->flags & (O_WRONLY | O_RDWR)) {
+        return pipe_writev(file->node, iov, iovcnt, nonblock);
+    }
+    return pipe_readv(file->node, iov, iovcnt, nonblock);
+}
+
+/**
+ * Start a cursor at the beginning of a buffer list
+ */
+void vfs_iov_iter_init(vfs_iov_iter_t *iter, const vfs_iovec_t *iov, int iovcnt) {
+    iter->iov = iov;
+    iter->iovcnt = iovcnt;
+    iter->index = 0;
+    iter->offset = 0;
+}
+
+/**
+ * Copy bytes into the buffer list and advance the cursor
+ * Returns the number of bytes copied, short when the list runs out.
+ */
+uint32_t vfs_iov_copy_to(vfs_iov_iter_t *iter, const void *src, uint32_t len) {
+    const uint8_t *from = (const uint8_t *)src;
+    uint32_t done = 0;
+    
+    while (done < len && iter->index < iter->iovcnt) {
+        const vfs_iovec_t *cur = &iter->iov[iter->index];
+        size_t room = cur->iov_len - iter->offset;
+        if (room > len - done) {
+            room = len - done;
+        }
+        
+        uint8_t *to = (uint8_t *)cur->iov_base + iter->offset;
+        for (size_t i = 0; i < room; i++) {
+            to[i] = from[done + i];
+        }
+        done += room;
+        iter->offset += room;
+        
+        if (iter->offset == cur->iov_len) {
+            iter->index++;
+            iter->offset = 0;
+        }
+    }
+    
+    return done;
+}
+
+/**
+ * Copy bytes out of the buffer list and advance the cursor
+ * Returns the number of bytes copied, short when the list runs out.
+ */
+uint32_t vfs_iov_copy_from(vfs_iov_iter_t *iter, void *dst, uint32_t len) {
+    uint8_t *to = (uint8_t *)dst;
+    uint32_t done = 0;
+    
+    while (done < len && iter->index < iter->iovcnt) {
+        const vfs_iovec_t *cur = &iter->iov[iter->index];
+        size_t avail = cur->iov_len - iter->offset;
+        if (avail > len - done) {
+            avail = len - done;
+        }
+        
+        const uint8_t *from = (const uint8_t *)cur->iov_base + iter->offset;
+        for (size_t i = 0; i < avail; i++) {
+            to[done + i] = from[i];
+        }
+        done += avail;
+        iter->offset += avail;
+        
+        if (iter->offset == cur->iov_len) {
+            iter->index++;
+            iter->offset = 0;
+        }
+    }
+    
+    return done;
+}
+
+/**
+ * Seek within a file
+ */
+int64_t vfs_seek(int fd, int64_t offset, int whence) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (!node_is_seekable(file->node)) {
+        RETURN_ERRNO(THUNDEROS_ESPIPE);
+    }
+    
+    int64_t new_pos;
+    
+    switch (whence) {
+        case SEEK_SET:
+            new_pos = offset;
+            break;
+        
+        case SEEK_CUR:
+            new_pos = (int64_t)file->pos + offset;
+            break;
+        
+        case SEEK_END:
+            new_pos = (int64_t)file->node->size + offset;
+            break;
+        
+        default:
+            hal_uart_puts("vfs: Invalid whence value\n");
+            RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (new_pos < 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    file->pos = (uint64_t)new_pos;
+    clear_errno();
+    return new_pos;
+}
+
+/**
+ * Change the size of an open file
+ */
+int vfs_ftruncate(int fd, uint64_t length) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (length > VFS_MAX_OFFSET) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    
+    if (file->node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    /* Check if opened for writing */
+    if (!(file->flags & (O_WRONLY | O_RDWR))) {
+        RETURN_ERRNO(THUNDEROS_EACCES);
+    }
+    
+    if (!file->node->ops || !file->node->ops->truncate) {
+        RETURN_ERRNO(THUNDEROS_EPERM);
+    }
+    
+    if (file->node->ops->truncate(file->node, length) != 0) {
+        /* errno already set by truncate */
+        return -1;
+    }
+    
+    file->node->size = length;
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Make an open file's data and the filesystem's completed changes durable
+ */
+int vfs_fsync(int fd) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    vfs_node_t *node = file->node;
+    if (node->ops && node->ops->flush && node->ops->flush(node) != 0) {
+        /* errno already set by flush */
+        return -1;
+    }
+    
+    if (node->fs && node->fs->ops && node->fs->ops->sync && node->fs->ops->sync(node->fs) != 0) {
+        /* errno already set by sync */
+        return -1;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Reserve storage for a byte range of an open file
+ */
+int vfs_fallocate(int fd, uint32_t mode, uint64_t offset, uint64_t len) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (mode & ~FALLOC_FL_KEEP_SIZE) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (len == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (offset > VFS_MAX_OFFSET || len > VFS_MAX_OFFSET - offset) {
+        RETURN_ERRNO(THUNDEROS_EFBIG);
+    }
+    
+    if (file->node->type != VFS_TYPE_FILE) {
+        RETURN_ERRNO(THUNDEROS_EISDIR);
+    }
+    
+    /* Check if opened for writing */
+    if (!(file->flags & (O_WRONLY | O_RDWR))) {
+        RETURN_ERRNO(THUNDEROS_EACCES);
+    }
+    
+    if (!file->node->ops || !file->node->ops->fallocate) {
+        RETURN_ERRNO(THUNDEROS_EPERM);
+    }
+    
+    if (file->node->ops->fallocate(file->node, mode, offset, len) != 0) {
+        /* errno already set by fallocate */
+        return -1;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Pass a filesystem-specific request to the filesystem of an open file
+ */
+int vfs_ioctl(int fd, uint32_t cmd, void *arg) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (!file->node->ops || !file->node->ops->ioctl) {
+        RETURN_ERRNO(THUNDEROS_ENOTTY);
+    }
+    
+    /* errno set by ioctl */
+    return file->node->ops->ioctl(file->node, cmd, arg);
+}
+
+/**
+ * Get a reference to the page holding page index of an open file
+ * Used to map the file's own pages with MAP_SHARED.
+ */
+int vfs_get_page(int fd, uint64_t index, uintptr_t *page) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (!page) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (file->node->type != VFS_TYPE_FILE || !file->node->ops ||
+        !file->node->ops->get_page) {
+        RETURN_ERRNO(THUNDEROS_ENODEV);
+    }
+    
+    /* errno set by get_page */
+    return file->node->ops->get_page(file->node, index, page);
+}
+
+/**
+ * Read directory entries from an open directory
+ * The file position is the directory's resume cookie.
+ */
+int vfs_getdents(int fd, void *buffer, uint32_t size) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file || !file->node) {
+        /* errno already set by vfs_get_file */
+        return -1;
+    }
+    
+    if (!buffer) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    if (file->node->type != VFS_TYPE_DIRECTORY) {
+        RETURN_ERRNO(THUNDEROS_ENOTDIR);
+    }
+    
+    if (!file->node->ops || !file->node->ops->getdents) {
+        RETURN_ERRNO(THUNDEROS_EPERM);
+    }
+    
+    int bytes = file->node->ops->getdents(file->node, &file->pos, buffer, size);
+    if (bytes < 0) {
+        /* errno already set by getdents */
+        return -1;
+    }
+    
+    clear_errno();
+    return bytes;
+}
+
+/**
+ * Create a directory
+ */
+int vfs_mkdir(const char *path, uint32_t mode) {
+    if (!g_root_fs || !path) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* A mount point stays until its filesystem is unmounted */
+    char normalized[VFS_MAX_PATH];
+    int len = normalize_path(path, normalized);
+    if (len > 0 && find_mount_point(normalized, (uint32_t)len)) {
+        RETURN_ERRNO(THUNDEROS_EBUSY);
+    }
+    
+    char dirname[256];
+    vfs_node_t *parent = vfs_resolve_parent(path, dirname);
+    if (!parent) {
+        /* errno already set by vfs_resolve_parent */
+        return -1;
+    }
+    
+    if (!parent->ops || !parent->ops->mkdir) {
+        hal_uart_puts("vfs: No mkdir operation\n");
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    return parent->ops->mkdir(parent, dirname, mode);
+}
+
+/**
+ * Remove a directory
+ */
+int vfs_rmdir(const char *path) {
+    if (!g_root_fs || !path) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    /* Something is mounted on this directory */
+    char normalized[VFS_MAX_PATH];
+    int len = normalize_path(path, normalized);
+    if (len > 0 && find_mount_point(normalized, (uint32_t)len)) {
+        RETURN_ERRNO(THUNDEROS_EBUSY);
+    }
+    
+    char dirname[256];
+    vfs_node_t *parent = vfs_resolve_parent(path, dirname);
+    if (!parent) {
+        /* errno already set by vfs_resolve_parent */
+        return -1;
     }
     
-    const char *filename = path + 1;
+    if (!parent->ops || !parent->ops->rmdir) {
+        hal_uart_puts("vfs: No rmdir operation\n");
+        RETURN_ERRNO(THUNDEROS_EIO);
+    }
+    
+    return parent->ops->rmdir(parent, dirname);
+}
+
+/**
+ * Remove a file
+ */
+int vfs_unlink(const char *path) {
+    if (!g_root_fs || !path) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    char filename[256];
+    vfs_node_t *parent = vfs_resolve_parent(path, filename);
+    if (!parent) {
+        /* errno already set by vfs_resolve_parent */
+        return -1;
+    }
     
-    vfs_node_t *root = g_root_fs->root;
-    if (!root->ops || !root->ops->unlink) {
+    if (!parent->ops || !parent->ops->unlink) {
         hal_uart_puts("vfs: No unlink operation\n");
         RETURN_ERRNO(THUNDEROS_EIO);
     }
     
-    return root->ops->unlink(root, filename);
+    return parent->ops->unlink(parent, filename);
 }
 
 /**
  * Get file status
  */
-int vfs_stat(const char *path, uint32_t *size, uint32_t *type) {
+int vfs_stat(const char *path, uint64_t *size, uint32_t *type) {
     vfs_node_t *node = vfs_resolve_path(path);
     if (!node) {
         /* errno already set by vfs_resolve_path */
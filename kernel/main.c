@@ -6,6 +6,7 @@
 #include "hal/hal_timer.h"
 #include "trap.h"
 #include "arch/interrupt.h"
+#include "arch/fpu.h"
 #include "mm/pmm.h"
 #include "mm/kmalloc.h"
 #include "mm/paging.h"
@@ -18,8 +19,15 @@
 #include "kernel/syscall.h"
 #include "kernel/shell.h"
 #include "drivers/virtio_blk.h"
+#include "drivers/virtio_net.h"
+#include "net/ip.h"
+#include "drivers/console.h"
 #include "fs/ext2.h"
 #include "fs/vfs.h"
+#include "fs/tmpfs.h"
+#include "fs/initramfs.h"
+#include "fs/squashfs.h"
+#include "kernel/fdt.h"
 
 // Test allocation size
 #define TEST_ALLOC_SIZE 256             // Bytes for kmalloc test
@@ -27,6 +35,10 @@
 // Linker symbols (defined in kernel.ld)
 extern char _kernel_end[];
 
+// Built-in initramfs (kernel/arch/riscv64/initramfs.S)
+extern char _initramfs_start[];
+extern char _initramfs_end[];
+
 // External functions
 ext2_fs_t g_test_ext2_fs;
 
@@ -34,6 +46,10 @@ ext2_fs_t g_test_ext2_fs;
 // Built-in test functions (only compiled if ENABLE_KERNEL_TESTS is set)
 extern void test_memory_management(void);
 extern void test_elf_all(void);
+extern void test_lz4_all(void);
+extern void test_initramfs_all(void);
+extern void test_fd_table_all(void);
+extern void test_getdents_all(void);
 #endif
 
 // Demo process functions
@@ -76,7 +92,71 @@ void process_c(void *arg) {
     }
 }
 
-void kernel_main(void) {
+/**
+ * Mount a squashfs system image found on a second block device
+ * Programs in its /bin are then found through /usr/bin.
+ */
+static void mount_system_image(void) {
+    for (int i = 1; i < virtio_blk_device_count(); i++) {
+        vfs_filesystem_t *sys_fs = squashfs_mount(virtio_blk_get_device_at(i));
+        if (!sys_fs) {
+            continue;
+        }
+        if (!vfs_exists(SQUASHFS_MOUNT_POINT)) {
+            vfs_mkdir(SQUASHFS_MOUNT_POINT, 0755);
+        }
+        if (vfs_mount(SQUASHFS_MOUNT_POINT, sys_fs) == 0) {
+            hal_uart_puts("[OK] squashfs system image mounted on " SQUASHFS_MOUNT_POINT "\n");
+        } else {
+            hal_uart_puts("[WARN] Failed to mount squashfs system image\n");
+        }
+        return;
+    }
+}
+
+/**
+ * Unpack the initramfs archives into a tmpfs root
+ * 
+ * The built-in archive is unpacked first, then the boot loader's initrd
+ * on top of it. The initrd pages are returned to the PMM afterwards.
+ * 
+ * @return 1 if the root filesystem is now the tmpfs, 0 otherwise
+ */
+static int mount_initramfs(uintptr_t initrd_start, uintptr_t initrd_end) {
+    size_t builtin_size = (size_t)(_initramfs_end - _initramfs_start);
+    size_t initrd_size = initrd_end - initrd_start;
+    if (builtin_size == 0 && initrd_size == 0) {
+        return 0;
+    }
+    
+    hal_uart_puts("\n[INFO] Unpacking initramfs (");
+    kprint_dec(builtin_size + initrd_size);
+    hal_uart_puts(" bytes)\n");
+    
+    vfs_filesystem_t *root_fs = tmpfs_create(TMPFS_DEFAULT_SIZE + builtin_size + initrd_size);
+    if (!root_fs || vfs_mount_root(root_fs) != 0) {
+        hal_uart_puts("[WARN] Failed to create initramfs root\n");
+        return 0;
+    }
+    
+    if (builtin_size > 0 && initramfs_unpack(_initramfs_start, builtin_size) < 0) {
+        hal_uart_puts("[WARN] Built-in initramfs is incomplete\n");
+    }
+    if (initrd_size > 0) {
+        if (initramfs_unpack((const void *)initrd_start, initrd_size) < 0) {
+            hal_uart_puts("[WARN] initrd is incomplete\n");
+        }
+        uintptr_t first = PAGE_ALIGN_DOWN(initrd_start);
+        pmm_free_pages(first, (PAGE_ALIGN_UP(initrd_end) - first) / PAGE_SIZE);
+    }
+    
+    hal_uart_puts("[OK] initramfs mounted as root\n");
+    return 1;
+}
+
+void kernel_main(unsigned long hart_id, uintptr_t dtb) {
+    (void)hart_id;
+    
     // Initialize UART for serial output
     hal_uart_init();
     
@@ -100,6 +180,9 @@ void kernel_main(void) {
     trap_init();
     hal_uart_puts("[OK] Trap handler initialized\n");
     
+    // Detect the vector extension before any user process exists
+    fpu_init();
+    
     // Enable interrupts globally
     interrupt_enable();
     hal_uart_puts("[OK] Interrupts enabled\n");
@@ -108,6 +191,10 @@ void kernel_main(void) {
     hal_timer_init(TIMER_INTERVAL_US);
     hal_uart_puts("[OK] Timer interrupts enabled\n");
     
+    // Take console input by the UART receive interrupt
+    console_init();
+    hal_uart_puts("[OK] Console input initialized\n");
+    
     // Initialize memory management
     // QEMU virt machine: 128MB RAM at 0x80000000 to 0x88000000
     // Our kernel ends at _kernel_end, so free memory starts there
@@ -120,6 +207,19 @@ void kernel_main(void) {
     pmm_init(mem_start, free_mem_size);
     hal_uart_puts("[OK] Memory management initialized\n");
     
+    // Keep the boot loader's initrd (QEMU -initrd) until it is unpacked
+    uintptr_t initrd_start = 0;
+    uintptr_t initrd_end = 0;
+    if (fdt_find_initrd(dtb, &initrd_start, &initrd_end) == 0) {
+        pmm_reserve_range(initrd_start, initrd_end - initrd_start);
+        hal_uart_puts("[OK] Found initrd at 0x");
+        kprint_hex(initrd_start);
+        hal_uart_puts("\n");
+    } else {
+        initrd_start = 0;
+        initrd_end = 0;
+    }
+    
     // Initialize virtual memory (paging)
     // Identity map the kernel region
     paging_init(KERNEL_LOAD_ADDRESS, kernel_end);
@@ -188,6 +288,9 @@ void kernel_main(void) {
     hal_uart_puts("\n[INFO] Running built-in kernel tests...\n");
     test_memory_management();
     test_elf_all();
+    test_lz4_all();
+    test_initramfs_all();
+    test_fd_table_all();
     hal_uart_puts("[INFO] Built-in tests completed\n\n");
 #endif
     
@@ -265,6 +368,9 @@ void kernel_main(void) {
     hal_uart_puts("  Starting Interactive Shell\n");
     hal_uart_puts("=================================\n");
     
+    // A RAM root makes /bin usable before any disk I/O
+    int initramfs_root = mount_initramfs(initrd_start, initrd_end);
+    
     // Test VirtIO block device (simple test before shell)
     hal_uart_puts("\n[TEST] VirtIO Block Device\n");
     
@@ -274,14 +380,26 @@ void kernel_main(void) {
         0x10005000, 0x10006000, 0x10007000, 0x10008000
     };
     
-    int result = -1;
-    for (int i = 0; i < 8; i++) {
-        result = virtio_blk_init(virtio_addrs[i], 1 + i);
-        if (result == 0) {
+    // The first disk holds ext2; later ones may hold a squashfs system image.
+    // QEMU gives the first -device the highest slot, so probe downwards.
+    for (int i = 7; i >= 0; i--) {
+        if (virtio_blk_init(virtio_addrs[i], 1 + i) == 0) {
             hal_uart_puts("[OK] VirtIO block device initialized\n");
+        }
+    }
+    int result = virtio_blk_device_count() > 0 ? 0 : -1;
+    
+    // Any slot left over may hold the network device
+    for (int i = 7; i >= 0; i--) {
+        if (virtio_net_init(virtio_addrs[i], 1 + i) == 0) {
             break;
         }
     }
+    if (net_init() == 0) {
+        hal_uart_puts("[OK] VirtIO network device initialized\n");
+    } else {
+        hal_uart_puts("[WARN] No VirtIO network device found - running without network\n");
+    }
     
     if (result != 0) {
         hal_uart_puts("[WARN] No VirtIO block device found - running without filesystem\n");
@@ -308,10 +426,31 @@ void kernel_main(void) {
                 
                 // Mount into VFS
                 vfs_filesystem_t *vfs_fs = ext2_vfs_mount(&g_test_ext2_fs);
-                if (vfs_fs) {
+                if (vfs_fs && initramfs_root) {
+                    // The initramfs stays the root; the disk goes on /mnt
+                    if (!vfs_exists("/mnt")) {
+                        vfs_mkdir("/mnt", 0755);
+                    }
+                    if (vfs_mount("/mnt", vfs_fs) == 0) {
+                        hal_uart_puts("[OK] ext2 mounted on /mnt\n");
+                    } else {
+                        hal_uart_puts("[WARN] Failed to mount ext2 on /mnt\n");
+                    }
+                } else if (vfs_fs) {
                     ret = vfs_mount_root(vfs_fs);
                     if (ret == 0) {
                         hal_uart_puts("[OK] VFS root filesystem mounted\n");
+                        
+                        // Scratch files live in memory under /tmp
+                        if (!vfs_exists("/tmp")) {
+                            vfs_mkdir("/tmp", 0755);
+                        }
+                        vfs_filesystem_t *tmp_fs = tmpfs_create(TMPFS_DEFAULT_SIZE);
+                        if (tmp_fs && vfs_mount("/tmp", tmp_fs) == 0) {
+                            hal_uart_puts("[OK] tmpfs mounted on /tmp\n");
+                        } else {
+                            hal_uart_puts("[WARN] Failed to mount tmpfs on /tmp\n");
+                        }
                     } else {
                         hal_uart_puts("[WARN] Failed to set VFS root\n");
                     }
@@ -322,8 +461,15 @@ void kernel_main(void) {
                 hal_uart_puts("[FAIL] Failed to mount ext2 filesystem\n");
             }
         }
+        
+        mount_system_image();
     }
     
+#ifdef ENABLE_KERNEL_TESTS
+    // Tests that need the mounted filesystems
+    test_getdents_all();
+#endif
+    
     hal_uart_puts("\n");
     shell_init();
     shell_run();
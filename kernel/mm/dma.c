@@ -8,6 +8,8 @@
 #include "mm/kmalloc.h"
 #include "hal/hal_uart.h"
 #include "kernel/kstring.h"
+#include "kernel/process.h"
+#include "kernel/errno.h"
 
 // Linked list of allocated DMA regions for tracking
 static dma_region_t *dma_regions_head = NULL;
@@ -134,6 +136,63 @@ void dma_free(dma_region_t *region) {
     kfree(region);
 }
 
+/**
+ * Describe a buffer as physical segments for device I/O
+ */
+size_t dma_map_sg(const void *buffer, size_t len, int dir, dma_sg_t *sg,
+                  uint32_t max_sg, uint32_t *nr_sg) {
+    *nr_sg = 0;
+    
+    // A user table also maps the kernel, so its pages are checked as user
+    // accesses; kernel processes run on the kernel table itself
+    struct process *proc = process_current();
+    page_table_t *kernel_table = get_kernel_page_table();
+    page_table_t *table = (proc && proc->page_table) ? proc->page_table
+                                                     : kernel_table;
+    int user = (table != kernel_table);
+    
+    uintptr_t vaddr = (uintptr_t)buffer;
+    size_t mapped = 0;
+    
+    while (mapped < len) {
+        // Stay within the current page
+        size_t chunk = PAGE_SIZE - (vaddr & (PAGE_SIZE - 1));
+        if (chunk > len - mapped) {
+            chunk = len - mapped;
+        }
+        
+        // The device writes memory when data comes from it
+        uintptr_t paddr;
+        int ret = user ? user_virt_to_phys(table, vaddr, dir == DMA_FROM_DEVICE, &paddr)
+                       : virt_to_phys(table, vaddr, &paddr);
+        if (ret != 0) {
+            *nr_sg = 0;
+            set_errno(THUNDEROS_EFAULT);
+            return 0;
+        }
+        
+        // Extend the previous segment if this page follows it physically
+        if (*nr_sg > 0 &&
+            sg[*nr_sg - 1].phys_addr + sg[*nr_sg - 1].len == paddr &&
+            sg[*nr_sg - 1].len <= UINT32_MAX - chunk) {
+            sg[*nr_sg - 1].len += (uint32_t)chunk;
+        } else {
+            if (*nr_sg == max_sg) {
+                break;
+            }
+            sg[*nr_sg].phys_addr = paddr;
+            sg[*nr_sg].len = (uint32_t)chunk;
+            (*nr_sg)++;
+        }
+        
+        vaddr += chunk;
+        mapped += chunk;
+    }
+    
+    clear_errno();
+    return mapped;
+}
+
 /**
  * Get DMA statistics
  */
@@ -0,0 +1,260 @@
+/*
+ * Memory Mappings Implementation
+ */
+
+#include "mm/mmap.h"
+#include "mm/pmm.h"
+#include "mm/paging.h"
+#include "mm/kmalloc.h"
+#include "fs/vfs.h"
+#include "kernel/kstring.h"
+#include "kernel/process.h"
+#include "kernel/errno.h"
+
+/**
+ * Page table flags for a set of PROT_* flags
+ * RISC-V has no write-only pages, so every mapping is readable.
+ */
+static uint64_t prot_to_pte(uint32_t prot) {
+    uint64_t pte = PTE_V | PTE_R | PTE_U;
+    if (prot & PROT_WRITE) {
+        pte |= PTE_W;
+    }
+    if (prot & PROT_EXEC) {
+        pte |= PTE_X;
+    }
+    return pte;
+}
+
+/**
+ * Unmap pages and drop their references
+ */
+static void unmap_range(struct process *proc, uintptr_t start, uintptr_t end) {
+    for (uintptr_t vaddr = start; vaddr < end; vaddr += PAGE_SIZE) {
+        uintptr_t paddr;
+        if (virt_to_phys(proc->page_table, vaddr, &paddr) != 0) {
+            continue;
+        }
+        unmap_page(proc->page_table, vaddr);
+        pmm_free_page(paddr);
+    }
+}
+
+/**
+ * Find a free range of the mmap area
+ * 
+ * @param proc Process to search
+ * @param size Size in bytes (page multiple)
+ * @param prev Output: region the new one goes after, or NULL for the head
+ * @return Start of the range, or 0 if there is none
+ */
+static uintptr_t find_free_range(struct process *proc, size_t size, vm_area_t **prev) {
+    uintptr_t start = USER_MMAP_START;
+    *prev = NULL;
+    
+    for (vm_area_t *area = proc->vm_areas; area; area = area->next) {
+        if (area->start - start >= size) {
+            break;
+        }
+        start = area->end;
+        *prev = area;
+    }
+    
+    if (start > USER_MMAP_END || USER_MMAP_END - start < size) {
+        return 0;
+    }
+    return start;
+}
+
+/**
+ * Get the physical page for one page of a new region
+ * 
+ * @return Physical page holding one reference for the mapping, or 0 with
+ *         errno set
+ */
+static uintptr_t region_page(uint32_t flags, int fd, uint64_t offset) {
+    uintptr_t page;
+    
+    if ((flags & (MAP_SHARED | MAP_ANONYMOUS)) == MAP_SHARED) {
+        if (vfs_get_page(fd, offset / PAGE_SIZE, &page) != 0) {
+            /* errno already set by vfs_get_page */
+            return 0;
+        }
+        return page;
+    }
+    
+    page = pmm_alloc_page();
+    if (!page) {
+        set_errno(THUNDEROS_ENOMEM);
+        return 0;
+    }
+    kmemset((void *)page, 0, PAGE_SIZE);
+    
+    // A private file mapping starts as a copy of the file
+    if (!(flags & MAP_ANONYMOUS) && vfs_pread(fd, (void *)page, PAGE_SIZE, offset) < 0) {
+        pmm_free_page(page);
+        /* errno already set by vfs_pread */
+        return 0;
+    }
+    return page;
+}
+
+/**
+ * Map memory into a process
+ */
+uintptr_t mmap_map(struct process *proc, size_t length, uint32_t prot, uint32_t flags,
+                   int fd, uint64_t offset) {
+    if (!proc || !proc->page_table || proc->page_table == get_kernel_page_table()) {
+        set_errno(THUNDEROS_EINVAL);
+        return 0;
+    }
+    
+    uint32_t sharing = flags & (MAP_SHARED | MAP_PRIVATE);
+    if (length == 0 || prot == 0 || (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) ||
+        (flags & ~(MAP_SHARED | MAP_PRIVATE | MAP_ANONYMOUS)) ||
+        (sharing != MAP_SHARED && sharing != MAP_PRIVATE) || (offset & (PAGE_SIZE - 1))) {
+        set_errno(THUNDEROS_EINVAL);
+        return 0;
+    }
+    
+    if (length > USER_MMAP_END - USER_MMAP_START) {
+        set_errno(THUNDEROS_ENOMEM);
+        return 0;
+    }
+    size_t size = PAGE_ALIGN_UP(length);
+    
+    // The file must be readable, and writable too for a shared writable map
+    if (!(flags & MAP_ANONYMOUS)) {
+        vfs_file_t *file = vfs_get_file(fd);
+        if (!file) {
+            /* errno already set by vfs_get_file */
+            return 0;
+        }
+        uint32_t access = file->flags & (O_WRONLY | O_RDWR);
+        if (access == O_WRONLY ||
+            (sharing == MAP_SHARED && (prot & PROT_WRITE) && access != O_RDWR)) {
+            set_errno(THUNDEROS_EACCES);
+            return 0;
+        }
+        if (!file->node || file->node->type != VFS_TYPE_FILE) {
+            set_errno(THUNDEROS_ENODEV);
+            return 0;
+        }
+    }
+    
+    vm_area_t *area = (vm_area_t *)kmalloc(sizeof(vm_area_t));
+    if (!area) {
+        set_errno(THUNDEROS_ENOMEM);
+        return 0;
+    }
+    
+    vm_area_t *prev;
+    uintptr_t start = find_free_range(proc, size, &prev);
+    if (!start) {
+        kfree(area);
+        set_errno(THUNDEROS_ENOMEM);
+        return 0;
+    }
+    
+    uint64_t pte_flags = prot_to_pte(prot);
+    for (size_t done = 0; done < size; done += PAGE_SIZE) {
+        uintptr_t page = region_page(flags, fd, offset + done);
+        if (!page || map_page(proc->page_table, start + done, page, pte_flags) != 0) {
+            int error = page ? THUNDEROS_ENOMEM : get_errno();
+            if (page) {
+                pmm_free_page(page);
+            }
+            unmap_range(proc, start, start + done);
+            kfree(area);
+            set_errno(error);
+            return 0;
+        }
+    }
+    
+    area->start = start;
+    area->end = start + size;
+    area->prot = prot;
+    area->flags = flags;
+    if (prev) {
+        area->next = prev->next;
+        prev->next = area;
+    } else {
+        area->next = proc->vm_areas;
+        proc->vm_areas = area;
+    }
+    
+    clear_errno();
+    return start;
+}
+
+/**
+ * Unmap a range of a process's address space
+ */
+int mmap_unmap(struct process *proc, uintptr_t addr, size_t length) {
+    if (!proc || length == 0 || (addr & (PAGE_SIZE - 1)) ||
+        addr + length < addr || addr + length > USER_MMAP_END) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    uintptr_t end = PAGE_ALIGN_UP(addr + length);
+    
+    vm_area_t **link = &proc->vm_areas;
+    while (*link) {
+        vm_area_t *area = *link;
+        if (area->start >= end) {
+            break;
+        }
+        if (area->end <= addr) {
+            link = &area->next;
+            continue;
+        }
+        
+        uintptr_t lo = area->start > addr ? area->start : addr;
+        uintptr_t hi = area->end < end ? area->end : end;
+        
+        if (lo > area->start && hi < area->end) {
+            // A hole in the middle splits the region in two
+            vm_area_t *tail = (vm_area_t *)kmalloc(sizeof(vm_area_t));
+            if (!tail) {
+                RETURN_ERRNO(THUNDEROS_ENOMEM);
+            }
+            *tail = *area;
+            tail->start = hi;
+            area->end = lo;
+            area->next = tail;
+            unmap_range(proc, lo, hi);
+            break;
+        }
+        
+        unmap_range(proc, lo, hi);
+        if (lo == area->start && hi == area->end) {
+            *link = area->next;
+            kfree(area);
+            continue;
+        }
+        if (lo == area->start) {
+            area->start = hi;
+        } else {
+            area->end = lo;
+        }
+        link = &area->next;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Unmap every region of a process
+ */
+void mmap_release(struct process *proc) {
+    if (!proc) {
+        return;
+    }
+    
+    while (proc->vm_areas) {
+        vm_area_t *area = proc->vm_areas;
+        proc->vm_areas = area->next;
+        unmap_range(proc, area->start, area->end);
+        kfree(area);
+    }
+}
@@ -153,6 +153,22 @@ int virt_to_phys(page_table_t *page_table, uintptr_t vaddr, uintptr_t *paddr) {
     return 0;
 }
 
+/**
+ * Translate a user virtual address, checking the access is allowed
+ */
+int user_virt_to_phys(page_table_t *page_table, uintptr_t vaddr, int write, uintptr_t *paddr) {
+    pte_t *pte = walk_page_table(page_table, vaddr, 0);
+    uint64_t need = PTE_V | PTE_U | (write ? PTE_W : PTE_R);
+    if (pte == NULL || (*pte & need) != need) {
+        return -1;
+    }
+    
+    uintptr_t offset = vaddr & (PAGE_SIZE - 1);
+    *paddr = PTE_TO_PA(*pte) + offset;
+    
+    return 0;
+}
+
 /**
  * Flush TLB
  */
@@ -3,6 +3,10 @@
  * 
  * Uses a bitmap allocator for simplicity and efficiency.
  * Each bit represents one 4KB page: 0=free, 1=allocated
+ * 
+ * Each allocated page also has a reference count, so a page mapped by
+ * several processes (shared memory) is freed only when the last one
+ * drops it.
  */
 
 #include "mm/pmm.h"
@@ -33,6 +37,9 @@ static size_t free_pages = 0;
 // Each byte represents 8 pages (1 bit per page)
 static uint8_t page_bitmap[BITMAP_SIZE];
 
+// References held on each allocated page
+static uint16_t page_refs[BITMAP_SIZE * BITS_PER_BYTE];
+
 // Helper: Check if a bit is set in the bitmap
 static inline int bitmap_test(size_t page_num) {
     size_t byte_index = page_num / BITS_PER_BYTE;
@@ -120,6 +127,7 @@ uintptr_t pmm_alloc_page(void) {
         if (!bitmap_test(page_num)) {
             // Found a free page!
             bitmap_set(page_num);
+            page_refs[page_num] = 1;
             free_pages--;
             
             // Calculate physical address
@@ -166,6 +174,7 @@ uintptr_t pmm_alloc_pages(size_t num_pages) {
             // Allocate all pages
             for (size_t i = 0; i < num_pages; i++) {
                 bitmap_set(start_page + i);
+                page_refs[start_page + i] = 1;
                 free_pages--;
             }
             
@@ -192,19 +201,20 @@ uintptr_t pmm_alloc_pages(size_t num_pages) {
 }
 
 /**
- * Free a previously allocated page
+ * Page number of a managed page, or -1 (with a message) if the address is
+ * not one
  */
-void pmm_free_page(uintptr_t page_addr) {
+static long page_index(uintptr_t page_addr) {
     // Validate address is page-aligned
     if (page_addr & (PAGE_SIZE - 1)) {
         hal_uart_puts("PMM: Error - address not page-aligned\n");
-        return;
+        return -1;
     }
     
     // Validate address is in managed region
     if (page_addr < memory_start) {
         hal_uart_puts("PMM: Error - address below managed region\n");
-        return;
+        return -1;
     }
     
     // Calculate page number
@@ -212,6 +222,18 @@ void pmm_free_page(uintptr_t page_addr) {
     
     if (page_num >= total_pages) {
         hal_uart_puts("PMM: Error - address above managed region\n");
+        return -1;
+    }
+    
+    return (long)page_num;
+}
+
+/**
+ * Drop a reference to a page, freeing it with the last one
+ */
+void pmm_free_page(uintptr_t page_addr) {
+    long page_num = page_index(page_addr);
+    if (page_num < 0) {
         return;
     }
     
@@ -221,11 +243,39 @@ void pmm_free_page(uintptr_t page_addr) {
         return;
     }
     
+    if (__sync_sub_and_fetch(&page_refs[page_num], 1) != 0) {
+        return;
+    }
+    
     // Free the page
     bitmap_clear(page_num);
     free_pages++;
 }
 
+/**
+ * Take another reference to an allocated page
+ */
+void pmm_page_get(uintptr_t page_addr) {
+    long page_num = page_index(page_addr);
+    if (page_num >= 0 && bitmap_test(page_num)) {
+        __sync_add_and_fetch(&page_refs[page_num], 1);
+    }
+}
+
+/**
+ * Number of references held on a page (0 if it is free)
+ */
+uint32_t pmm_page_refs(uintptr_t page_addr) {
+    if (page_addr < memory_start || (page_addr & (PAGE_SIZE - 1))) {
+        return 0;
+    }
+    size_t page_num = (page_addr - memory_start) / PAGE_SIZE;
+    if (page_num >= total_pages || !bitmap_test(page_num)) {
+        return 0;
+    }
+    return page_refs[page_num];
+}
+
 /**
  * Free multiple contiguous physical pages
  */
@@ -239,6 +289,34 @@ void pmm_free_pages(uintptr_t page_addr, size_t num_pages) {
     }
 }
 
+/**
+ * Mark a range of physical memory as allocated
+ */
+void pmm_reserve_range(uintptr_t start, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    
+    uintptr_t first = PAGE_ALIGN_DOWN(start);
+    uintptr_t end = PAGE_ALIGN_UP(start + size);
+    
+    for (uintptr_t addr = first; addr < end; addr += PAGE_SIZE) {
+        // Pages outside the managed region are never handed out anyway
+        if (addr < memory_start) {
+            continue;
+        }
+        size_t page_num = (addr - memory_start) / PAGE_SIZE;
+        if (page_num >= total_pages) {
+            break;
+        }
+        if (!bitmap_test(page_num)) {
+            bitmap_set(page_num);
+            page_refs[page_num] = 1;
+            free_pages--;
+        }
+    }
+}
+
 /**
  * Get memory statistics
  */
@@ -0,0 +1,233 @@
+/*
+ * arp.c - Address resolution
+ *
+ * A small cache maps IPv4 addresses on the local network to Ethernet
+ * addresses. A send to a host not in the cache holds on to one frame for
+ * it and asks the network who has the address; the frame goes out when
+ * the answer comes in. Entries are replaced oldest first.
+ *
+ * The cache is guarded by a lock that yields while taken, since both the
+ * net-rx process and sending processes use it.
+ */
+
+#include "net/ip.h"
+#include "net/inet.h"
+#include "drivers/virtio_net.h"
+#include "mm/kmalloc.h"
+#include "kernel/kstring.h"
+#include "kernel/lock.h"
+#include "kernel/config.h"
+#include "kernel/errno.h"
+#include <stddef.h>
+
+/* ARP operations */
+#define ARP_REQUEST 1
+#define ARP_REPLY   2
+
+/**
+ * One cache entry
+ */
+typedef struct {
+    uint32_t ip;                       /* Address, 0 if the entry is free */
+    uint8_t mac[ETH_ALEN];             /* Hardware address, once resolved */
+    int resolved;                      /* mac is valid */
+    uint32_t used;                     /* Stamp of the last use */
+    uint8_t *held;                     /* Frame waiting for mac, or NULL */
+    uint32_t held_len;
+    uint16_t held_csum_start;
+    uint16_t held_csum_offset;
+} arp_entry_t;
+
+static arp_entry_t arp_cache[ARP_CACHE_SIZE];
+static uint32_t arp_clock = 0;
+
+static yield_lock_t arp_lock = YIELD_LOCK_INIT;
+
+static const uint8_t eth_broadcast[ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+/**
+ * Find the entry of an address, with the lock held
+ */
+static arp_entry_t *arp_lookup(uint32_t ip) {
+    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (arp_cache[i].ip == ip) {
+            arp_cache[i].used = ++arp_clock;
+            return &arp_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Take a free or the oldest entry for an address, with the lock held
+ * A frame held by the old entry is returned through held for the caller
+ * to free outside the lock.
+ */
+static arp_entry_t *arp_insert(uint32_t ip, uint8_t **held) {
+    arp_entry_t *victim = &arp_cache[0];
+    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (arp_cache[i].ip == 0) {
+            victim = &arp_cache[i];
+            break;
+        }
+        if (arp_cache[i].used < victim->used) {
+            victim = &arp_cache[i];
+        }
+    }
+    
+    *held = victim->held;
+    kmemset(victim, 0, sizeof(arp_entry_t));
+    victim->ip = ip;
+    victim->used = ++arp_clock;
+    return victim;
+}
+
+/**
+ * Send an ARP packet
+ */
+static void arp_send(uint16_t oper, const uint8_t *tha, uint32_t tpa) {
+    virtio_net_device_t *dev = virtio_net_get_device();
+    uint8_t frame[ETH_HLEN + sizeof(arp_pkt_t)];
+    eth_hdr_t *eth = (eth_hdr_t *)frame;
+    arp_pkt_t *arp = (arp_pkt_t *)(frame + ETH_HLEN);
+    
+    kmemcpy(eth->dst, oper == ARP_REQUEST ? eth_broadcast : tha, ETH_ALEN);
+    kmemcpy(eth->src, dev->mac, ETH_ALEN);
+    eth->type = htons(ETH_P_ARP);
+    
+    arp->htype = htons(1);
+    arp->ptype = htons(ETH_P_IP);
+    arp->hlen = ETH_ALEN;
+    arp->plen = 4;
+    arp->oper = htons(oper);
+    kmemcpy(arp->sha, dev->mac, ETH_ALEN);
+    arp->spa = htonl(NET_IP_ADDR);
+    if (oper == ARP_REQUEST) {
+        kmemset(arp->tha, 0, ETH_ALEN);
+    } else {
+        kmemcpy(arp->tha, tha, ETH_ALEN);
+    }
+    arp->tpa = htonl(tpa);
+    
+    virtio_net_xmit(frame, sizeof(frame), 0, 0);
+}
+
+/**
+ * Send a frame to a host on the local network
+ */
+int arp_output(uint32_t next_hop, uint8_t *frame, uint32_t len,
+               uint16_t csum_start, uint16_t csum_offset) {
+    virtio_net_device_t *dev = virtio_net_get_device();
+    if (!dev) {
+        RETURN_ERRNO(THUNDEROS_ENETDOWN);
+    }
+    
+    eth_hdr_t *eth = (eth_hdr_t *)frame;
+    kmemcpy(eth->src, dev->mac, ETH_ALEN);
+    
+    if (next_hop == INADDR_BROADCAST || next_hop == (NET_IP_ADDR | ~NET_NETMASK)) {
+        kmemcpy(eth->dst, eth_broadcast, ETH_ALEN);
+        return virtio_net_xmit(frame, len, csum_start, csum_offset);
+    }
+    
+    yield_lock(&arp_lock);
+    arp_entry_t *entry = arp_lookup(next_hop);
+    if (entry && entry->resolved) {
+        kmemcpy(eth->dst, entry->mac, ETH_ALEN);
+        yield_unlock(&arp_lock);
+        return virtio_net_xmit(frame, len, csum_start, csum_offset);
+    }
+    yield_unlock(&arp_lock);
+    
+    /* Hold a copy until the address is known */
+    uint8_t *copy = (uint8_t *)kmalloc(len);
+    if (!copy) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    kmemcpy(copy, frame, len);
+    
+    uint8_t *dropped = NULL;
+    yield_lock(&arp_lock);
+    entry = arp_lookup(next_hop);
+    if (!entry) {
+        entry = arp_insert(next_hop, &dropped);
+    }
+    if (entry->resolved) {
+        /* Answered while the copy was made */
+        kmemcpy(eth->dst, entry->mac, ETH_ALEN);
+        yield_unlock(&arp_lock);
+        kfree(copy);
+        return virtio_net_xmit(frame, len, csum_start, csum_offset);
+    }
+    if (!dropped) {
+        dropped = entry->held;
+    }
+    entry->held = copy;
+    entry->held_len = len;
+    entry->held_csum_start = csum_start;
+    entry->held_csum_offset = csum_offset;
+    yield_unlock(&arp_lock);
+    
+    kfree(dropped);
+    arp_send(ARP_REQUEST, NULL, next_hop);
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Handle a received ARP packet
+ * The sender is learned if it is in the cache or if it is asking for
+ * us, and requests for our address are answered.
+ */
+void arp_input(const uint8_t *pkt, uint32_t len) {
+    if (len < sizeof(arp_pkt_t)) {
+        return;
+    }
+    
+    const arp_pkt_t *arp = (const arp_pkt_t *)pkt;
+    if (ntohs(arp->htype) != 1 || ntohs(arp->ptype) != ETH_P_IP ||
+        arp->hlen != ETH_ALEN || arp->plen != 4) {
+        return;
+    }
+    
+    uint32_t spa = ntohl(arp->spa);
+    uint32_t tpa = ntohl(arp->tpa);
+    uint16_t oper = ntohs(arp->oper);
+    if (spa == 0) {
+        return;
+    }
+    
+    uint8_t *held = NULL;
+    uint8_t *dropped = NULL;
+    uint32_t held_len = 0;
+    uint16_t held_csum_start = 0;
+    uint16_t held_csum_offset = 0;
+    
+    yield_lock(&arp_lock);
+    arp_entry_t *entry = arp_lookup(spa);
+    if (!entry && tpa == NET_IP_ADDR) {
+        entry = arp_insert(spa, &dropped);
+    }
+    if (entry) {
+        kmemcpy(entry->mac, arp->sha, ETH_ALEN);
+        entry->resolved = 1;
+        held = entry->held;
+        held_len = entry->held_len;
+        held_csum_start = entry->held_csum_start;
+        held_csum_offset = entry->held_csum_offset;
+        entry->held = NULL;
+    }
+    yield_unlock(&arp_lock);
+    
+    kfree(dropped);
+    if (held) {
+        kmemcpy(((eth_hdr_t *)held)->dst, arp->sha, ETH_ALEN);
+        virtio_net_xmit(held, held_len, held_csum_start, held_csum_offset);
+        kfree(held);
+    }
+    
+    if (oper == ARP_REQUEST && tpa == NET_IP_ADDR) {
+        arp_send(ARP_REPLY, arp->sha, spa);
+    }
+}
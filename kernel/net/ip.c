@@ -0,0 +1,178 @@
+/*
+ * ip.c - Ethernet and IPv4
+ *
+ * Received frames are sorted by Ethernet type and IPv4 packets by
+ * protocol. Only packets addressed to us are accepted, and fragments are
+ * dropped since nothing reassembles them. Outgoing
+ * packets go to the destination itself when it is on the local network
+ * and to the gateway otherwise; packets to a local address never reach
+ * the device and are turned around here.
+ */
+
+#include "net/ip.h"
+#include "net/inet.h"
+#include "drivers/virtio_net.h"
+#include "kernel/config.h"
+#include "kernel/errno.h"
+#include <stddef.h>
+
+/* Identification of the next packet sent */
+static volatile uint32_t ip_next_id = 0;
+
+/**
+ * Start the stack
+ */
+int net_init(void) {
+    if (virtio_net_start(net_input) != 0) {
+        /* errno already set by virtio_net_start */
+        return -1;
+    }
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Check whether there is a device to send on
+ */
+int net_up(void) {
+    return virtio_net_get_device() != NULL;
+}
+
+/**
+ * Handle a received Ethernet frame
+ */
+void net_input(const uint8_t *frame, uint32_t len, int csum_ok) {
+    if (len < ETH_HLEN) {
+        return;
+    }
+    
+    const eth_hdr_t *eth = (const eth_hdr_t *)frame;
+    switch (ntohs(eth->type)) {
+    case ETH_P_ARP:
+        arp_input(frame + ETH_HLEN, len - ETH_HLEN);
+        break;
+    case ETH_P_IP:
+        ip_input(frame + ETH_HLEN, len - ETH_HLEN, csum_ok);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Add data to a one's complement sum
+ */
+uint32_t inet_csum_add(uint32_t sum, const void *data, uint32_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    while (len > 1) {
+        sum += ((uint32_t)p[0] << 8) | p[1];
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        sum += (uint32_t)p[0] << 8;
+    }
+    return sum;
+}
+
+/**
+ * Fold a one's complement sum and complement it
+ */
+uint16_t inet_csum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/**
+ * Check whether an address is one of ours
+ */
+int ip_is_local(uint32_t addr) {
+    return addr == NET_IP_ADDR || (addr >> 24) == 127;
+}
+
+/**
+ * Check whether an address reaches every host on the local network
+ */
+static int ip_is_broadcast(uint32_t addr) {
+    return addr == INADDR_BROADCAST || addr == (NET_IP_ADDR | ~NET_NETMASK);
+}
+
+/**
+ * Handle a received IPv4 packet
+ */
+void ip_input(const uint8_t *pkt, uint32_t len, int csum_ok) {
+    if (len < IP_HLEN) {
+        return;
+    }
+    
+    const ipv4_hdr_t *ip = (const ipv4_hdr_t *)pkt;
+    uint32_t hlen = (ip->ver_ihl & 0xF) * 4;
+    uint32_t total = ntohs(ip->total_len);
+    if ((ip->ver_ihl >> 4) != 4 || hlen < IP_HLEN || total < hlen || total > len) {
+        return;
+    }
+    if (inet_csum_fold(inet_csum_add(0, pkt, hlen)) != 0) {
+        return;
+    }
+    
+    uint32_t daddr = ntohl(ip->daddr);
+    if (!ip_is_local(daddr) && !ip_is_broadcast(daddr)) {
+        return;
+    }
+    
+    /* No reassembly: fragments are dropped */
+    if (ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK)) {
+        return;
+    }
+    
+    if (ip->protocol == IPPROTO_UDP) {
+        udp_input(ip, pkt + hlen, total - hlen, csum_ok);
+    }
+}
+
+/**
+ * Send an IPv4 packet
+ */
+int ip_output(uint32_t daddr, uint8_t protocol, uint8_t *frame, uint32_t payload_len,
+              uint16_t csum_start, uint16_t csum_offset) {
+    if (payload_len > IP_MTU - IP_HLEN) {
+        RETURN_ERRNO(THUNDEROS_EMSGSIZE);
+    }
+    
+    eth_hdr_t *eth = (eth_hdr_t *)frame;
+    ipv4_hdr_t *ip = (ipv4_hdr_t *)(frame + ETH_HLEN);
+    uint32_t saddr = ((daddr >> 24) == 127) ? daddr : NET_IP_ADDR;
+    
+    ip->ver_ihl = (4 << 4) | (IP_HLEN / 4);
+    ip->tos = 0;
+    ip->total_len = htons((uint16_t)(IP_HLEN + payload_len));
+    ip->id = htons((uint16_t)__sync_fetch_and_add(&ip_next_id, 1));
+    ip->frag_off = htons(IP_DF);
+    ip->ttl = IP_TTL;
+    ip->protocol = protocol;
+    ip->checksum = 0;
+    ip->saddr = htonl(saddr);
+    ip->daddr = htonl(daddr);
+    ip->checksum = htons(inet_csum_fold(inet_csum_add(0, ip, IP_HLEN)));
+    
+    if (ip_is_local(daddr)) {
+        ip_input((const uint8_t *)ip, IP_HLEN + payload_len, 1);
+        clear_errno();
+        return 0;
+    }
+    
+    if (!net_up()) {
+        RETURN_ERRNO(THUNDEROS_ENETDOWN);
+    }
+    
+    uint32_t next_hop = daddr;
+    if (!ip_is_broadcast(daddr) && (daddr & NET_NETMASK) != (NET_IP_ADDR & NET_NETMASK)) {
+        next_hop = NET_GATEWAY;
+    }
+    
+    eth->type = htons(ETH_P_IP);
+    return arp_output(next_hop, frame, ETH_HLEN + IP_HLEN + payload_len,
+                      csum_start, csum_offset);
+}
@@ -0,0 +1,504 @@
+/*
+ * socket.c - Socket layer
+ *
+ * Sockets are VFS nodes, so descriptors, dup, inheritance and close work
+ * as for pipes. This layer finds the socket behind a descriptor, copies
+ * addresses and control messages between user and kernel memory, and
+ * leaves everything else to the socket's address family.
+ *
+ * Descriptors passed with SCM_RIGHTS become file references here and are
+ * handed to the family with the message. References the family does not
+ * take are dropped again before the call returns.
+ */
+
+#include "net/socket.h"
+#include "net/unix.h"
+#include "net/inet.h"
+#include "fs/vfs.h"
+#include "mm/kmalloc.h"
+#include "kernel/kstring.h"
+#include "kernel/errno.h"
+#include "kernel/poll.h"
+#include <stddef.h>
+
+/* Largest address any family uses (struct sockaddr_un) */
+#define SOCKADDR_MAX 128
+
+/* Address families, by AF_* number */
+static const socket_family_t *families[] = {
+    [AF_UNIX] = &unix_family,
+    [AF_INET] = &inet_family,
+};
+
+#define NUM_FAMILIES (sizeof(families) / sizeof(families[0]))
+
+/**
+ * VFS read operation: receive without address or control data
+ */
+static int socket_vfs_readv(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov,
+                            int iovcnt) {
+    (void)offset;
+    socket_t *sock = (socket_t *)node->fs_data;
+    socket_msg_t msg;
+    kmemset(&msg, 0, sizeof(msg));
+    msg.iov = iov;
+    msg.iovcnt = iovcnt;
+    
+    int received = sock->ops->recvmsg(sock, &msg, node->flags & O_NONBLOCK);
+    for (uint32_t i = 0; i < msg.nfiles; i++) {
+        vfs_file_put(msg.files[i]);
+    }
+    return received;
+}
+
+/**
+ * VFS write operation: send to the connected peer
+ */
+static int socket_vfs_writev(vfs_node_t *node, uint64_t offset, const vfs_iovec_t *iov,
+                             int iovcnt) {
+    (void)offset;
+    socket_t *sock = (socket_t *)node->fs_data;
+    socket_msg_t msg;
+    kmemset(&msg, 0, sizeof(msg));
+    msg.iov = iov;
+    msg.iovcnt = iovcnt;
+    
+    return sock->ops->sendmsg(sock, &msg, node->flags & O_NONBLOCK);
+}
+
+/**
+ * VFS close operation, called with the last descriptor
+ */
+static void socket_vfs_close(vfs_node_t *node) {
+    socket_free((socket_t *)node->fs_data);
+}
+
+/**
+ * VFS poll operation
+ */
+static uint32_t socket_vfs_poll(vfs_node_t *node, struct poll_table *pt) {
+    socket_t *sock = (socket_t *)node->fs_data;
+    if (!sock->ops->poll) {
+        return POLLIN | POLLOUT;
+    }
+    return sock->ops->poll(sock, pt);
+}
+
+static vfs_ops_t socket_vfs_ops = {
+    .readv = socket_vfs_readv,
+    .writev = socket_vfs_writev,
+    .close = socket_vfs_close,
+    .poll = socket_vfs_poll,
+};
+
+/**
+ * Allocate a socket of a family
+ */
+socket_t *socket_alloc(int family, int type) {
+    if (family < 0 || (uint32_t)family >= NUM_FAMILIES || !families[family]) {
+        set_errno(THUNDEROS_EAFNOSUPPORT);
+        return NULL;
+    }
+    
+    socket_t *sock = (socket_t *)kmalloc(sizeof(socket_t));
+    if (!sock) {
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    
+    kmemset(sock, 0, sizeof(socket_t));
+    sock->family = (uint16_t)family;
+    sock->type = (uint16_t)type;
+    kstrcpy(sock->node.name, "socket");
+    sock->node.type = VFS_TYPE_SOCKET;
+    sock->node.fs_data = sock;
+    sock->node.ops = &socket_vfs_ops;
+    
+    if (families[family]->create(sock, type) != 0) {
+        kfree(sock);
+        /* errno already set by the family */
+        return NULL;
+    }
+    return sock;
+}
+
+/**
+ * Release a socket and its family state
+ */
+void socket_free(socket_t *sock) {
+    if (sock->ops && sock->ops->release) {
+        sock->ops->release(sock);
+    }
+    kfree(sock);
+}
+
+/**
+ * Open a socket on a new descriptor
+ * flags may contain SOCK_NONBLOCK and SOCK_CLOEXEC. On failure the socket
+ * is freed.
+ */
+static int socket_open(socket_t *sock, uint32_t flags) {
+    sock->node.flags = flags & O_NONBLOCK;
+    
+    int fd = vfs_open_node(&sock->node, O_RDWR | (flags & O_CLOEXEC));
+    if (fd < 0) {
+        int error = get_errno();
+        socket_free(sock);
+        RETURN_ERRNO(error);
+    }
+    return fd;
+}
+
+/**
+ * Get the socket open on a descriptor
+ */
+static socket_t *socket_get(int fd) {
+    vfs_file_t *file = vfs_get_file(fd);
+    if (!file) {
+        /* errno already set by vfs_get_file */
+        return NULL;
+    }
+    if (file->node->type != VFS_TYPE_SOCKET) {
+        set_errno(THUNDEROS_ENOTSOCK);
+        return NULL;
+    }
+    return (socket_t *)file->node->fs_data;
+}
+
+/**
+ * Split the flags or-ed into a socket type
+ * Returns the type, or -1 with EINVAL for unknown flags or protocols.
+ * The only protocol that may be named is UDP, for AF_INET datagrams.
+ */
+static int socket_split_type(int family, int type, int protocol, uint32_t *flags) {
+    if (protocol == IPPROTO_UDP && family == AF_INET &&
+        (type & SOCK_TYPE_MASK) == SOCK_DGRAM) {
+        protocol = 0;
+    }
+    if (protocol != 0 || (type & ~(SOCK_TYPE_MASK | SOCK_NONBLOCK | SOCK_CLOEXEC))) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    *flags = (uint32_t)type & (SOCK_NONBLOCK | SOCK_CLOEXEC);
+    return type & SOCK_TYPE_MASK;
+}
+
+/**
+ * Copy an address into kernel memory
+ */
+static int socket_copy_addr(void *buf, const struct sockaddr *addr, socklen_t len) {
+    if (!addr || len < sizeof(uint16_t) || len > SOCKADDR_MAX) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    kmemset(buf, 0, SOCKADDR_MAX);
+    kmemcpy(buf, addr, len);
+    return 0;
+}
+
+/**
+ * Create a socket
+ */
+int socket_create(int family, int type, int protocol) {
+    uint32_t flags;
+    type = socket_split_type(family, type, protocol, &flags);
+    if (type < 0) {
+        return -1;
+    }
+    
+    socket_t *sock = socket_alloc(family, type);
+    if (!sock) {
+        /* errno already set by socket_alloc */
+        return -1;
+    }
+    return socket_open(sock, flags);
+}
+
+/**
+ * Create a pair of connected sockets
+ */
+int socket_pair(int family, int type, int protocol, int fds[2]) {
+    uint32_t flags;
+    type = socket_split_type(family, type, protocol, &flags);
+    if (type < 0) {
+        return -1;
+    }
+    
+    socket_t *a = socket_alloc(family, type);
+    if (!a) {
+        /* errno already set by socket_alloc */
+        return -1;
+    }
+    socket_t *b = socket_alloc(family, type);
+    if (!b) {
+        socket_free(a);
+        /* errno already set by socket_alloc */
+        return -1;
+    }
+    
+    if (!a->ops->pair || a->ops->pair(a, b) != 0) {
+        int error = a->ops->pair ? get_errno() : THUNDEROS_EOPNOTSUPP;
+        socket_free(a);
+        socket_free(b);
+        RETURN_ERRNO(error);
+    }
+    
+    int fd_a = socket_open(a, flags);
+    if (fd_a < 0) {
+        socket_free(b);
+        /* errno already set by socket_open */
+        return -1;
+    }
+    int fd_b = socket_open(b, flags);
+    if (fd_b < 0) {
+        int error = get_errno();
+        vfs_close(fd_a);
+        RETURN_ERRNO(error);
+    }
+    
+    fds[0] = fd_a;
+    fds[1] = fd_b;
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Give a socket an address
+ */
+int socket_bind(int fd, const struct sockaddr *addr, socklen_t len) {
+    socket_t *sock = socket_get(fd);
+    if (!sock) {
+        /* errno already set by socket_get */
+        return -1;
+    }
+    
+    uint64_t buf[SOCKADDR_MAX / 8];
+    if (socket_copy_addr(buf, addr, len) != 0) {
+        return -1;
+    }
+    if (!sock->ops->bind) {
+        RETURN_ERRNO(THUNDEROS_EOPNOTSUPP);
+    }
+    return sock->ops->bind(sock, (struct sockaddr *)buf, len);
+}
+
+/**
+ * Accept connections on a socket
+ */
+int socket_listen(int fd, int backlog) {
+    socket_t *sock = socket_get(fd);
+    if (!sock) {
+        /* errno already set by socket_get */
+        return -1;
+    }
+    if (!sock->ops->listen) {
+        RETURN_ERRNO(THUNDEROS_EOPNOTSUPP);
+    }
+    return sock->ops->listen(sock, backlog);
+}
+
+/**
+ * Take the next connection of a listening socket
+ */
+int socket_accept(int fd, uint32_t flags) {
+    socket_t *sock = socket_get(fd);
+    if (!sock) {
+        /* errno already set by socket_get */
+        return -1;
+    }
+    if (flags & ~(SOCK_NONBLOCK | SOCK_CLOEXEC)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (!sock->ops->accept) {
+        RETURN_ERRNO(THUNDEROS_EOPNOTSUPP);
+    }
+    
+    socket_t *new_sock;
+    if (sock->ops->accept(sock, &new_sock, sock->node.flags & O_NONBLOCK) != 0) {
+        /* errno already set by the family */
+        return -1;
+    }
+    return socket_open(new_sock, flags);
+}
+
+/**
+ * Connect a socket to an address
+ */
+int socket_connect(int fd, const struct sockaddr *addr, socklen_t len) {
+    socket_t *sock = socket_get(fd);
+    if (!sock) {
+        /* errno already set by socket_get */
+        return -1;
+    }
+    
+    uint64_t buf[SOCKADDR_MAX / 8];
+    if (socket_copy_addr(buf, addr, len) != 0) {
+        return -1;
+    }
+    if (!sock->ops->connect) {
+        RETURN_ERRNO(THUNDEROS_EOPNOTSUPP);
+    }
+    return sock->ops->connect(sock, (struct sockaddr *)buf, len,
+                              sock->node.flags & O_NONBLOCK);
+}
+
+/**
+ * Collect the descriptors of SCM_RIGHTS control messages
+ * Takes a reference to each file. Other control messages fail with
+ * EINVAL.
+ */
+static int socket_get_rights(socket_msg_t *msg, const uint8_t *control, socklen_t len) {
+    socklen_t pos = 0;
+    while (pos + sizeof(struct cmsghdr) <= len) {
+        const struct cmsghdr *cmsg = (const struct cmsghdr *)(control + pos);
+        if (cmsg->cmsg_len < CMSG_LEN(0) || cmsg->cmsg_len > len - pos ||
+            cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            RETURN_ERRNO(THUNDEROS_EINVAL);
+        }
+        
+        const int *fds = (const int *)CMSG_DATA(cmsg);
+        uint32_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (uint32_t i = 0; i < count; i++) {
+            if (msg->nfiles == SCM_MAX_FD) {
+                RETURN_ERRNO(THUNDEROS_EINVAL);
+            }
+            vfs_file_t *file = vfs_file_get(fds[i]);
+            if (!file) {
+                /* errno already set by vfs_file_get */
+                return -1;
+            }
+            msg->files[msg->nfiles++] = file;
+        }
+        
+        pos += CMSG_ALIGN(cmsg->cmsg_len);
+    }
+    return 0;
+}
+
+/**
+ * Install received descriptors and describe them in one SCM_RIGHTS
+ * control message
+ * Descriptors that do not fit in the control buffer are closed and
+ * MSG_CTRUNC is set. Returns the control bytes used.
+ */
+static socklen_t socket_put_rights(socket_msg_t *msg, uint8_t *control, socklen_t len,
+                                   uint32_t flags) {
+    uint32_t room = 0;
+    if (control && len >= CMSG_LEN(sizeof(int))) {
+        room = (len - CMSG_LEN(0)) / sizeof(int);
+    }
+    
+    int *fds = room ? (int *)CMSG_DATA(control) : NULL;
+    uint32_t installed = 0;
+    for (uint32_t i = 0; i < msg->nfiles; i++) {
+        int fd = -1;
+        if (installed < room) {
+            fd = vfs_install_file(msg->files[i],
+                                  (flags & MSG_CMSG_CLOEXEC) ? O_CLOEXEC : 0);
+        }
+        if (fd < 0) {
+            vfs_file_put(msg->files[i]);
+            msg->flags |= MSG_CTRUNC;
+            continue;
+        }
+        fds[installed++] = fd;
+    }
+    msg->nfiles = 0;
+    
+    if (installed == 0) {
+        return 0;
+    }
+    struct cmsghdr *cmsg = (struct cmsghdr *)control;
+    cmsg->cmsg_len = CMSG_LEN(installed * sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    return CMSG_SPACE(installed * sizeof(int)) <= len ? CMSG_SPACE(installed * sizeof(int))
+                                                      : cmsg->cmsg_len;
+}
+
+/**
+ * Send a message
+ */
+int socket_sendmsg(int fd, const struct msghdr *msg, uint32_t flags) {
+    socket_t *sock = socket_get(fd);
+    if (!sock) {
+        /* errno already set by socket_get */
+        return -1;
+    }
+    if (flags & ~MSG_DONTWAIT) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    uint64_t name[SOCKADDR_MAX / 8];
+    socket_msg_t kmsg;
+    kmemset(&kmsg, 0, sizeof(kmsg));
+    kmsg.iov = msg->msg_iov;
+    kmsg.iovcnt = msg->msg_iovlen;
+    if (msg->msg_name) {
+        if (socket_copy_addr(name, msg->msg_name, msg->msg_namelen) != 0) {
+            return -1;
+        }
+        kmsg.name = name;
+        kmsg.namelen = msg->msg_namelen;
+    }
+    
+    int result = 0;
+    if (msg->msg_control && msg->msg_controllen > 0) {
+        result = socket_get_rights(&kmsg, msg->msg_control, msg->msg_controllen);
+    }
+    if (result == 0) {
+        int nonblock = (flags & MSG_DONTWAIT) || (sock->node.flags & O_NONBLOCK);
+        result = sock->ops->sendmsg(sock, &kmsg, nonblock);
+    }
+    
+    /* Drop the references the family did not take */
+    int error = get_errno();
+    for (uint32_t i = 0; i < kmsg.nfiles; i++) {
+        vfs_file_put(kmsg.files[i]);
+    }
+    set_errno(error);
+    return result;
+}
+
+/**
+ * Receive a message
+ */
+int socket_recvmsg(int fd, struct msghdr *msg, uint32_t flags) {
+    socket_t *sock = socket_get(fd);
+    if (!sock) {
+        /* errno already set by socket_get */
+        return -1;
+    }
+    if (flags & ~(MSG_DONTWAIT | MSG_CMSG_CLOEXEC)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    uint64_t name[SOCKADDR_MAX / 8];
+    socket_msg_t kmsg;
+    kmemset(&kmsg, 0, sizeof(kmsg));
+    kmsg.name = name;
+    kmsg.namelen = SOCKADDR_MAX;
+    kmsg.iov = msg->msg_iov;
+    kmsg.iovcnt = msg->msg_iovlen;
+    
+    int nonblock = (flags & MSG_DONTWAIT) || (sock->node.flags & O_NONBLOCK);
+    int received = sock->ops->recvmsg(sock, &kmsg, nonblock);
+    if (received < 0) {
+        /* errno already set by the family */
+        return -1;
+    }
+    
+    if (msg->msg_name) {
+        socklen_t copy = kmsg.namelen < msg->msg_namelen ? kmsg.namelen : msg->msg_namelen;
+        kmemcpy(msg->msg_name, name, copy);
+    }
+    msg->msg_namelen = kmsg.namelen;
+    
+    socklen_t control_len = 0;
+    if (kmsg.nfiles > 0) {
+        control_len = socket_put_rights(&kmsg, msg->msg_control, msg->msg_controllen, flags);
+    }
+    msg->msg_controllen = control_len;
+    msg->msg_flags = (int)kmsg.flags;
+    
+    clear_errno();
+    return received;
+}
@@ -0,0 +1,535 @@
+/*
+ * udp.c - UDP and the AF_INET family
+ *
+ * AF_INET sockets are UDP datagram sockets. Bound sockets sit in a table
+ * hashed by local port, where the net-rx process finds them for incoming
+ * datagrams; a socket that sends before binding gets an ephemeral port.
+ * Each datagram is copied once into a buffer on the receiving socket's
+ * queue, and datagrams that would take the queue over UDP_RCVBUF are
+ * dropped, as UDP allows.
+ *
+ * Outgoing datagrams are built in one buffer with room for the headers
+ * in front. The UDP checksum is left to the device when it offers to
+ * complete it and computed here otherwise.
+ *
+ * All UDP state is guarded by one lock that yields while taken. Sleepers
+ * disable interrupts before dropping it, as for AF_UNIX.
+ */
+
+#include "net/inet.h"
+#include "net/ip.h"
+#include "net/socket.h"
+#include "drivers/virtio_net.h"
+#include "fs/vfs.h"
+#include "mm/kmalloc.h"
+#include "kernel/kstring.h"
+#include "kernel/process.h"
+#include "kernel/lock.h"
+#include "kernel/wait.h"
+#include "kernel/poll.h"
+#include "kernel/config.h"
+#include "kernel/errno.h"
+#include "arch/interrupt.h"
+#include <stddef.h>
+
+/* Buckets of the table of bound sockets */
+#define UDP_HASH_SIZE 64
+
+/**
+ * Datagram queued for reading
+ */
+typedef struct udp_dgram {
+    struct udp_dgram *next;            /* Next datagram in the queue */
+    uint32_t saddr;                    /* Sender, host byte order */
+    uint16_t sport;
+    uint32_t len;                      /* Bytes of data */
+    uint8_t data[];
+} udp_dgram_t;
+
+/**
+ * AF_INET state of one socket
+ * Addresses and ports are in host byte order.
+ */
+typedef struct udp_sock {
+    socket_t *sock;                    /* Owning socket */
+    uint32_t laddr;                    /* Bound address, or INADDR_ANY */
+    uint16_t lport;                    /* Bound port, 0 if unbound */
+    uint32_t raddr;                    /* Connected peer */
+    uint16_t rport;                    /* Connected port, 0 if not connected */
+    udp_dgram_t *head;                 /* Receive queue, oldest first */
+    udp_dgram_t *tail;                 /* Newest datagram */
+    uint32_t queued;                   /* Bytes in the queue */
+    struct udp_sock *next_bound;       /* Next socket in the hash bucket */
+    wait_queue_t read_wait;            /* Readers waiting for data */
+} udp_sock_t;
+
+static yield_lock_t udp_lock = YIELD_LOCK_INIT;
+
+/* Bound sockets, by local port */
+static udp_sock_t *udp_hash[UDP_HASH_SIZE];
+
+/* Where the search for a free ephemeral port starts */
+static uint32_t udp_next_port = INET_EPHEMERAL_FIRST;
+
+/**
+ * Drop the lock, sleep on a queue and take the lock again
+ */
+static void udp_sleep(wait_queue_t *queue) {
+    int irq_state = interrupt_save_disable();
+    yield_unlock(&udp_lock);
+    wait_queue_sleep(queue);
+    interrupt_restore(irq_state);
+    yield_lock(&udp_lock);
+}
+
+/**
+ * Check whether a port is bound, with the lock held
+ */
+static int udp_port_used(uint16_t port) {
+    for (udp_sock_t *u = udp_hash[port % UDP_HASH_SIZE]; u; u = u->next_bound) {
+        if (u->lport == port) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Bind a socket to a port, with the lock held
+ * Port 0 picks a free ephemeral port.
+ */
+static int udp_hash_in(udp_sock_t *u, uint32_t addr, uint16_t port) {
+    if (port == 0) {
+        uint32_t range = INET_EPHEMERAL_LAST - INET_EPHEMERAL_FIRST + 1;
+        for (uint32_t tries = 0; tries < range && port == 0; tries++) {
+            uint16_t candidate = (uint16_t)udp_next_port;
+            udp_next_port = (udp_next_port == INET_EPHEMERAL_LAST) ?
+                            INET_EPHEMERAL_FIRST : udp_next_port + 1;
+            if (!udp_port_used(candidate)) {
+                port = candidate;
+            }
+        }
+        if (port == 0) {
+            RETURN_ERRNO(THUNDEROS_EADDRINUSE);
+        }
+    } else if (udp_port_used(port)) {
+        RETURN_ERRNO(THUNDEROS_EADDRINUSE);
+    }
+    
+    u->laddr = addr;
+    u->lport = port;
+    u->next_bound = udp_hash[port % UDP_HASH_SIZE];
+    udp_hash[port % UDP_HASH_SIZE] = u;
+    return 0;
+}
+
+/**
+ * Find the socket a datagram is for, with the lock held
+ * A connected socket only takes datagrams from its peer.
+ */
+static udp_sock_t *udp_lookup(uint32_t daddr, uint16_t dport, uint32_t saddr, uint16_t sport) {
+    for (udp_sock_t *u = udp_hash[dport % UDP_HASH_SIZE]; u; u = u->next_bound) {
+        if (u->lport != dport) {
+            continue;
+        }
+        if (u->laddr != INADDR_ANY && u->laddr != daddr) {
+            continue;
+        }
+        if (u->rport && (u->raddr != saddr || u->rport != sport)) {
+            continue;
+        }
+        return u;
+    }
+    return NULL;
+}
+
+/**
+ * Check an AF_INET address and convert it to host byte order
+ */
+static int udp_parse_addr(const struct sockaddr *addr, socklen_t len,
+                          uint32_t *ip, uint16_t *port) {
+    if (len < sizeof(struct sockaddr_in)) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    const struct sockaddr_in *sin = (const struct sockaddr_in *)addr;
+    if (sin->sin_family != AF_INET) {
+        RETURN_ERRNO(THUNDEROS_EAFNOSUPPORT);
+    }
+    *ip = ntohl(sin->sin_addr.s_addr);
+    *port = ntohs(sin->sin_port);
+    return 0;
+}
+
+/**
+ * One's complement sum of the IPv4 pseudo-header
+ */
+static uint32_t udp_pseudo_sum(uint32_t saddr, uint32_t daddr, uint32_t len) {
+    return (saddr >> 16) + (saddr & 0xFFFF) + (daddr >> 16) + (daddr & 0xFFFF) +
+           IPPROTO_UDP + len;
+}
+
+/**
+ * Bind a socket to a local address and port
+ */
+static int udp_bind(socket_t *sock, const struct sockaddr *addr, socklen_t len) {
+    udp_sock_t *u = (udp_sock_t *)sock->proto;
+    uint32_t ip;
+    uint16_t port;
+    if (udp_parse_addr(addr, len, &ip, &port) != 0) {
+        /* errno already set by udp_parse_addr */
+        return -1;
+    }
+    if (ip != INADDR_ANY && !ip_is_local(ip)) {
+        RETURN_ERRNO(THUNDEROS_EADDRNOTAVAIL);
+    }
+    
+    yield_lock(&udp_lock);
+    if (u->lport) {
+        yield_unlock(&udp_lock);
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    int result = udp_hash_in(u, ip, port);
+    yield_unlock(&udp_lock);
+    if (result != 0) {
+        /* errno already set by udp_hash_in */
+        return -1;
+    }
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Set the default destination, or clear it with AF_UNSPEC
+ */
+static int udp_connect(socket_t *sock, const struct sockaddr *addr, socklen_t len,
+                       int nonblock) {
+    (void)nonblock;
+    udp_sock_t *u = (udp_sock_t *)sock->proto;
+    
+    if (len >= sizeof(uint16_t) && addr->sa_family == AF_UNSPEC) {
+        yield_lock(&udp_lock);
+        u->raddr = 0;
+        u->rport = 0;
+        yield_unlock(&udp_lock);
+        clear_errno();
+        return 0;
+    }
+    
+    uint32_t ip;
+    uint16_t port;
+    if (udp_parse_addr(addr, len, &ip, &port) != 0) {
+        /* errno already set by udp_parse_addr */
+        return -1;
+    }
+    if (port == 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    yield_lock(&udp_lock);
+    if (!u->lport && udp_hash_in(u, INADDR_ANY, 0) != 0) {
+        yield_unlock(&udp_lock);
+        /* errno already set by udp_hash_in */
+        return -1;
+    }
+    u->raddr = ip;
+    u->rport = port;
+    yield_unlock(&udp_lock);
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Send one datagram
+ * A blocking send waits for room in the device's transmit ring.
+ */
+static int udp_sendmsg(socket_t *sock, socket_msg_t *msg, int nonblock) {
+    udp_sock_t *u = (udp_sock_t *)sock->proto;
+    if (msg->nfiles > 0) {
+        RETURN_ERRNO(THUNDEROS_EOPNOTSUPP);
+    }
+    
+    uint64_t total = 0;
+    for (int i = 0; i < msg->iovcnt; i++) {
+        total += msg->iov[i].iov_len;
+    }
+    if (total > UDP_MAX_PAYLOAD) {
+        RETURN_ERRNO(THUNDEROS_EMSGSIZE);
+    }
+    
+    uint32_t daddr;
+    uint16_t dport;
+    yield_lock(&udp_lock);
+    if (msg->name) {
+        yield_unlock(&udp_lock);
+        if (udp_parse_addr((const struct sockaddr *)msg->name, msg->namelen,
+                           &daddr, &dport) != 0) {
+            /* errno already set by udp_parse_addr */
+            return -1;
+        }
+        if (dport == 0) {
+            RETURN_ERRNO(THUNDEROS_EINVAL);
+        }
+        yield_lock(&udp_lock);
+    } else if (u->rport) {
+        daddr = u->raddr;
+        dport = u->rport;
+    } else {
+        yield_unlock(&udp_lock);
+        RETURN_ERRNO(THUNDEROS_ENOTCONN);
+    }
+    if (!u->lport && udp_hash_in(u, INADDR_ANY, 0) != 0) {
+        yield_unlock(&udp_lock);
+        /* errno already set by udp_hash_in */
+        return -1;
+    }
+    uint16_t sport = u->lport;
+    yield_unlock(&udp_lock);
+    
+    if (!ip_is_local(daddr) && !net_up()) {
+        RETURN_ERRNO(THUNDEROS_ENETDOWN);
+    }
+    
+    uint8_t *frame = (uint8_t *)kmalloc(NET_HEADROOM + total);
+    if (!frame) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, msg->iov, msg->iovcnt);
+    if (vfs_iov_copy_from(&iter, frame + NET_HEADROOM, (uint32_t)total) != total) {
+        kfree(frame);
+        RETURN_ERRNO(THUNDEROS_EFAULT);
+    }
+    
+    udp_hdr_t *udp = (udp_hdr_t *)(frame + ETH_HLEN + IP_HLEN);
+    uint32_t udp_len = UDP_HLEN + (uint32_t)total;
+    uint32_t saddr = ((daddr >> 24) == 127) ? daddr : NET_IP_ADDR;
+    udp->sport = htons(sport);
+    udp->dport = htons(dport);
+    udp->len = htons((uint16_t)udp_len);
+    udp->checksum = 0;
+    
+    uint32_t pseudo = udp_pseudo_sum(saddr, daddr, udp_len);
+    uint16_t csum_start = 0;
+    uint16_t csum_offset = 0;
+    if (virtio_net_tx_csum() && !ip_is_local(daddr)) {
+        /* The device adds in the rest and complements */
+        udp->checksum = htons((uint16_t)~inet_csum_fold(pseudo));
+        csum_start = UDP_CSUM_START;
+        csum_offset = UDP_CSUM_OFFSET;
+    } else {
+        uint16_t csum = inet_csum_fold(inet_csum_add(pseudo, udp, udp_len));
+        udp->checksum = htons(csum ? csum : 0xFFFF);
+    }
+    
+    int result;
+    while ((result = ip_output(daddr, IPPROTO_UDP, frame, udp_len,
+                               csum_start, csum_offset)) != 0) {
+        if (get_errno() != THUNDEROS_EAGAIN || nonblock) {
+            break;
+        }
+        process_yield();
+    }
+    virtio_net_flush();
+    kfree(frame);
+    
+    if (result != 0) {
+        /* errno already set by ip_output */
+        return -1;
+    }
+    clear_errno();
+    return (int)total;
+}
+
+/**
+ * Handle a received UDP datagram
+ */
+void udp_input(const ipv4_hdr_t *ip, const uint8_t *seg, uint32_t len, int csum_ok) {
+    if (len < UDP_HLEN) {
+        return;
+    }
+    
+    const udp_hdr_t *udp = (const udp_hdr_t *)seg;
+    uint32_t udp_len = ntohs(udp->len);
+    if (udp_len < UDP_HLEN || udp_len > len) {
+        return;
+    }
+    
+    uint32_t saddr = ntohl(ip->saddr);
+    uint32_t daddr = ntohl(ip->daddr);
+    if (!csum_ok && udp->checksum != 0) {
+        uint32_t sum = inet_csum_add(udp_pseudo_sum(saddr, daddr, udp_len), seg, udp_len);
+        if (inet_csum_fold(sum) != 0) {
+            return;
+        }
+    }
+    
+    uint32_t data_len = udp_len - UDP_HLEN;
+    udp_dgram_t *dgram = (udp_dgram_t *)kmalloc(sizeof(udp_dgram_t) + data_len);
+    if (!dgram) {
+        return;
+    }
+    dgram->next = NULL;
+    dgram->saddr = saddr;
+    dgram->sport = ntohs(udp->sport);
+    dgram->len = data_len;
+    kmemcpy(dgram->data, seg + UDP_HLEN, data_len);
+    
+    yield_lock(&udp_lock);
+    udp_sock_t *u = udp_lookup(daddr, ntohs(udp->dport), saddr, dgram->sport);
+    if (!u || u->queued + data_len > UDP_RCVBUF) {
+        yield_unlock(&udp_lock);
+        kfree(dgram);
+        return;
+    }
+    if (u->tail) {
+        u->tail->next = dgram;
+    } else {
+        u->head = dgram;
+    }
+    u->tail = dgram;
+    u->queued += data_len;
+    wait_queue_wake_all(&u->read_wait);
+    yield_unlock(&udp_lock);
+}
+
+/**
+ * Receive one datagram
+ * What does not fit is dropped with MSG_TRUNC.
+ */
+static int udp_recvmsg(socket_t *sock, socket_msg_t *msg, int nonblock) {
+    udp_sock_t *u = (udp_sock_t *)sock->proto;
+    
+    uint64_t total = 0;
+    for (int i = 0; i < msg->iovcnt; i++) {
+        total += msg->iov[i].iov_len;
+    }
+    if (total > 0x7FFFFFFF) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    yield_lock(&udp_lock);
+    while (!u->head) {
+        if (nonblock) {
+            yield_unlock(&udp_lock);
+            RETURN_ERRNO(THUNDEROS_EAGAIN);
+        }
+        udp_sleep(&u->read_wait);
+    }
+    udp_dgram_t *dgram = u->head;
+    u->head = dgram->next;
+    if (!u->head) {
+        u->tail = NULL;
+    }
+    u->queued -= dgram->len;
+    yield_unlock(&udp_lock);
+    
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, msg->iov, msg->iovcnt);
+    uint32_t want = dgram->len < total ? dgram->len : (uint32_t)total;
+    uint32_t received = vfs_iov_copy_to(&iter, dgram->data, want);
+    if (received < dgram->len) {
+        msg->flags |= MSG_TRUNC;
+    }
+    
+    if (msg->name) {
+        struct sockaddr_in *sin = (struct sockaddr_in *)msg->name;
+        kmemset(sin, 0, sizeof(struct sockaddr_in));
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(dgram->sport);
+        sin->sin_addr.s_addr = htonl(dgram->saddr);
+        msg->namelen = sizeof(struct sockaddr_in);
+    } else {
+        msg->namelen = 0;
+    }
+    kfree(dgram);
+    
+    clear_errno();
+    return (int)received;
+}
+
+/**
+ * Release a socket: unbind it and drop its queue
+ */
+static void udp_release(socket_t *sock) {
+    udp_sock_t *u = (udp_sock_t *)sock->proto;
+    
+    yield_lock(&udp_lock);
+    if (u->lport) {
+        udp_sock_t **link = &udp_hash[u->lport % UDP_HASH_SIZE];
+        while (*link && *link != u) {
+            link = &(*link)->next_bound;
+        }
+        if (*link) {
+            *link = u->next_bound;
+        }
+        u->lport = 0;
+    }
+    udp_dgram_t *queue = u->head;
+    u->head = NULL;
+    u->tail = NULL;
+    u->queued = 0;
+    yield_unlock(&udp_lock);
+    
+    while (queue) {
+        udp_dgram_t *next = queue->next;
+        kfree(queue);
+        queue = next;
+    }
+    kfree(u);
+}
+
+/**
+ * Report readiness
+ * Sending never waits for long, so POLLOUT is always reported.
+ */
+static uint32_t udp_poll(socket_t *sock, struct poll_table *pt) {
+    udp_sock_t *u = (udp_sock_t *)sock->proto;
+    poll_wait(pt, &u->read_wait);
+    
+    uint32_t events = POLLOUT;
+    yield_lock(&udp_lock);
+    if (u->head) {
+        events |= POLLIN;
+    }
+    yield_unlock(&udp_lock);
+    return events;
+}
+
+static const socket_ops_t udp_ops = {
+    .bind = udp_bind,
+    .connect = udp_connect,
+    .sendmsg = udp_sendmsg,
+    .recvmsg = udp_recvmsg,
+    .release = udp_release,
+    .poll = udp_poll,
+};
+
+/**
+ * Create the AF_INET state of a new socket
+ */
+static int inet_create(socket_t *sock, int type) {
+    if (type != SOCK_DGRAM) {
+        RETURN_ERRNO(THUNDEROS_EPROTONOSUPPORT);
+    }
+    
+    udp_sock_t *u = (udp_sock_t *)kmalloc(sizeof(udp_sock_t));
+    if (!u) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    kmemset(u, 0, sizeof(udp_sock_t));
+    u->sock = sock;
+    wait_queue_init(&u->read_wait);
+    
+    sock->ops = &udp_ops;
+    sock->proto = u;
+    clear_errno();
+    return 0;
+}
+
+const socket_family_t inet_family = {
+    .family = AF_INET,
+    .create = inet_create,
+};
@@ -0,0 +1,901 @@
+/*
+ * unix.c - Unix-domain sockets
+ *
+ * Every socket has a receive queue of messages. A message holds up to
+ * UNIX_MSG_PAGES pages of data, the descriptors sent with it and, for
+ * datagrams, the sender. Senders copy straight into pages on the
+ * receiver's queue; there is no send buffer, so data is copied once on
+ * the way in and once on the way out. Small stream writes fill the room
+ * left in the newest message; large ones go out as whole fresh pages that
+ * change hands with the message.
+ *
+ * A stream connection is made by connect(), which creates the server's
+ * end of it at once and queues it on the listening socket for accept().
+ *
+ * All AF_UNIX state is guarded by one lock that yields while taken.
+ * Sleepers disable interrupts before dropping it, as for pipes. Files
+ * are never released with the lock held, since closing one may release
+ * another socket.
+ */
+
+#include "net/unix.h"
+#include "net/socket.h"
+#include "fs/vfs.h"
+#include "mm/kmalloc.h"
+#include "mm/pmm.h"
+#include "kernel/kstring.h"
+#include "kernel/lock.h"
+#include "kernel/wait.h"
+#include "kernel/poll.h"
+#include "kernel/errno.h"
+#include "arch/interrupt.h"
+#include <stddef.h>
+
+/* Socket states */
+#define UNIX_UNCONNECTED  0    /* New, or a datagram socket */
+#define UNIX_LISTENING    1    /* Accepting connections */
+#define UNIX_CONNECTED    2    /* Stream with a peer */
+#define UNIX_DISCONNECTED 3    /* Stream whose peer has closed */
+
+struct unix_sock;
+
+/**
+ * Data queued for reading, with what travels along with it
+ */
+typedef struct unix_msg {
+    struct unix_msg *next;             /* Next message in the queue */
+    uint8_t *pages[UNIX_MSG_PAGES];    /* Data, PAGE_SIZE bytes per page */
+    uint32_t npages;                   /* Pages allocated */
+    uint32_t len;                      /* Bytes of data */
+    uint32_t pos;                      /* Bytes already read (streams) */
+    vfs_file_t *files[SCM_MAX_FD];     /* Descriptors sent with the data */
+    uint32_t nfiles;                   /* Entries in files */
+    struct unix_sock *from;            /* Sender of a datagram, referenced */
+} unix_msg_t;
+
+/**
+ * AF_UNIX state of one socket
+ * Lives until the socket is released and nobody points at it any more.
+ */
+typedef struct unix_sock {
+    socket_t *sock;                    /* Owning socket, NULL once released */
+    uint32_t refs;                     /* The socket, peers and senders */
+    int type;                          /* SOCK_STREAM or SOCK_DGRAM */
+    int state;                         /* UNIX_* above */
+    struct unix_sock *peer;            /* Connected peer, referenced */
+    unix_msg_t *head;                  /* Receive queue, oldest first */
+    unix_msg_t *tail;                  /* Newest message */
+    uint32_t queued;                   /* Unread bytes in the queue */
+    struct unix_sock *pending;         /* Connections waiting for accept */
+    struct unix_sock *next_pending;    /* Next on the listener's list */
+    uint32_t npending;                 /* Entries in pending */
+    uint32_t backlog;                  /* Most pending connections */
+    vfs_filesystem_t *bound_fs;        /* Filesystem of the bound file */
+    uint32_t bound_inode;              /* Inode of the bound file, 0 if unbound */
+    char path[UNIX_PATH_MAX];          /* Path bound to */
+    struct unix_sock *next_bound;      /* Next bound socket */
+    wait_queue_t read_wait;            /* Readers and accept waiting */
+    wait_queue_t write_wait;           /* Senders waiting for room here */
+    wait_queue_t space_wait;           /* Pollers waiting for room at the peer */
+} unix_sock_t;
+
+static yield_lock_t unix_lock = YIELD_LOCK_INIT;
+
+/* Sockets bound to a path */
+static unix_sock_t *bound_list = NULL;
+
+/**
+ * Drop the lock, sleep on a queue and take the lock again
+ */
+static void unix_sleep(wait_queue_t *queue) {
+    int irq_state = interrupt_save_disable();
+    yield_unlock(&unix_lock);
+    wait_queue_sleep(queue);
+    interrupt_restore(irq_state);
+    yield_lock(&unix_lock);
+}
+
+/**
+ * Drop a reference, with the lock held
+ */
+static void unix_put(unix_sock_t *u) {
+    if (--u->refs == 0) {
+        kfree(u);
+    }
+}
+
+/**
+ * Free a message and what it carries, without the lock
+ */
+static void unix_msg_free(unix_msg_t *msg) {
+    for (uint32_t i = 0; i < msg->npages; i++) {
+        pmm_free_page((uintptr_t)msg->pages[i]);
+    }
+    for (uint32_t i = 0; i < msg->nfiles; i++) {
+        vfs_file_put(msg->files[i]);
+    }
+    if (msg->from) {
+        yield_lock(&unix_lock);
+        unix_put(msg->from);
+        yield_unlock(&unix_lock);
+    }
+    kfree(msg);
+}
+
+/**
+ * Allocate an empty message
+ */
+static unix_msg_t *unix_msg_alloc(void) {
+    unix_msg_t *msg = (unix_msg_t *)kmalloc(sizeof(unix_msg_t));
+    if (!msg) {
+        set_errno(THUNDEROS_ENOMEM);
+        return NULL;
+    }
+    kmemset(msg, 0, sizeof(unix_msg_t));
+    return msg;
+}
+
+/**
+ * Append up to len bytes from a buffer list to a message
+ * Pages are added as needed, up to UNIX_MSG_PAGES. Returns the bytes
+ * appended, or -1 with ENOMEM if nothing could be.
+ */
+static int unix_msg_fill(unix_msg_t *msg, vfs_iov_iter_t *iter, uint32_t len) {
+    uint32_t done = 0;
+    while (done < len) {
+        uint32_t offset = msg->len % PAGE_SIZE;
+        if (offset == 0 && msg->len == msg->npages * PAGE_SIZE) {
+            if (msg->npages == UNIX_MSG_PAGES) {
+                break;
+            }
+            uint8_t *fresh = (uint8_t *)pmm_alloc_page();
+            if (!fresh) {
+                if (done == 0) {
+                    RETURN_ERRNO(THUNDEROS_ENOMEM);
+                }
+                break;
+            }
+            msg->pages[msg->npages++] = fresh;
+        }
+        
+        uint32_t chunk = PAGE_SIZE - offset;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        uint8_t *page = msg->pages[msg->len / PAGE_SIZE];
+        uint32_t copied = vfs_iov_copy_from(iter, page + offset, chunk);
+        msg->len += copied;
+        done += copied;
+        if (copied < chunk) {
+            break;
+        }
+    }
+    return (int)done;
+}
+
+/**
+ * Copy up to len unread bytes of a message into a buffer list
+ * Returns the bytes copied.
+ */
+static uint32_t unix_msg_read(unix_msg_t *msg, vfs_iov_iter_t *iter, uint32_t len) {
+    uint32_t done = 0;
+    while (done < len && msg->pos < msg->len) {
+        uint32_t offset = msg->pos % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - offset;
+        if (chunk > msg->len - msg->pos) {
+            chunk = msg->len - msg->pos;
+        }
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        uint32_t copied = vfs_iov_copy_to(iter, msg->pages[msg->pos / PAGE_SIZE] + offset,
+                                          chunk);
+        msg->pos += copied;
+        done += copied;
+        if (copied < chunk) {
+            break;
+        }
+    }
+    return done;
+}
+
+/**
+ * Total length of a buffer list, or -1 if it overflows
+ */
+static int64_t unix_iov_total(const vfs_iovec_t *iov, int iovcnt) {
+    int64_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+        if (total > 0x7FFFFFFF) {
+            return -1;
+        }
+    }
+    return total;
+}
+
+/**
+ * Add a message to the end of a socket's receive queue
+ */
+static void unix_enqueue(unix_sock_t *u, unix_msg_t *msg) {
+    msg->next = NULL;
+    if (u->tail) {
+        u->tail->next = msg;
+    } else {
+        u->head = msg;
+    }
+    u->tail = msg;
+    u->queued += msg->len - msg->pos;
+}
+
+/**
+ * Take the oldest message off a socket's receive queue
+ */
+static unix_msg_t *unix_dequeue(unix_sock_t *u) {
+    unix_msg_t *msg = u->head;
+    u->head = msg->next;
+    if (!u->head) {
+        u->tail = NULL;
+    }
+    return msg;
+}
+
+/**
+ * Check a sockaddr_un and find the socket bound to its path
+ * Returns a referenced socket, or NULL with ENOENT, ECONNREFUSED or
+ * EINVAL.
+ */
+static unix_sock_t *unix_lookup(const struct sockaddr *addr, socklen_t len) {
+    const struct sockaddr_un *sun = (const struct sockaddr_un *)addr;
+    if (sun->sun_family != AF_UNIX || len <= sizeof(uint16_t) || sun->sun_path[0] != '/') {
+        set_errno(THUNDEROS_EINVAL);
+        return NULL;
+    }
+    
+    vfs_node_t *node = vfs_resolve_path(sun->sun_path);
+    if (!node) {
+        /* errno already set by vfs_resolve_path */
+        return NULL;
+    }
+    
+    yield_lock(&unix_lock);
+    unix_sock_t *u = bound_list;
+    while (u && (u->bound_fs != node->fs || u->bound_inode != node->inode)) {
+        u = u->next_bound;
+    }
+    if (u) {
+        u->refs++;
+    }
+    yield_unlock(&unix_lock);
+    
+    if (!u) {
+        set_errno(THUNDEROS_ECONNREFUSED);
+    }
+    return u;
+}
+
+/**
+ * Drop the lock and a reference taken by unix_lookup, and fail
+ */
+static int unix_fail_put(unix_sock_t *target, int error) {
+    unix_put(target);
+    yield_unlock(&unix_lock);
+    RETURN_ERRNO(error);
+}
+
+/**
+ * Bind a socket to a path by creating a file there
+ */
+static int unix_bind(socket_t *sock, const struct sockaddr *addr, socklen_t len) {
+    unix_sock_t *u = (unix_sock_t *)sock->proto;
+    const struct sockaddr_un *sun = (const struct sockaddr_un *)addr;
+    if (sun->sun_family != AF_UNIX || len <= sizeof(uint16_t) || sun->sun_path[0] != '/') {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (kstrlen(sun->sun_path) >= UNIX_PATH_MAX) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (u->bound_inode) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    int fd = vfs_open(sun->sun_path, O_RDWR | O_CREAT | O_EXCL);
+    if (fd < 0) {
+        RETURN_ERRNO(get_errno() == THUNDEROS_EEXIST ? THUNDEROS_EADDRINUSE : get_errno());
+    }
+    vfs_node_t *node = vfs_get_file(fd)->node;
+    
+    yield_lock(&unix_lock);
+    u->bound_fs = node->fs;
+    u->bound_inode = node->inode;
+    kstrcpy(u->path, sun->sun_path);
+    u->next_bound = bound_list;
+    bound_list = u;
+    yield_unlock(&unix_lock);
+    
+    vfs_close(fd);
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Make a stream socket accept connections
+ */
+static int unix_listen(socket_t *sock, int backlog) {
+    unix_sock_t *u = (unix_sock_t *)sock->proto;
+    if (u->type != SOCK_STREAM) {
+        RETURN_ERRNO(THUNDEROS_EOPNOTSUPP);
+    }
+    
+    yield_lock(&unix_lock);
+    if (u->state != UNIX_UNCONNECTED && u->state != UNIX_LISTENING) {
+        yield_unlock(&unix_lock);
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (backlog < 1) backlog = 1;
+    if (backlog > SOMAXCONN) backlog = SOMAXCONN;
+    u->backlog = (uint32_t)backlog;
+    u->state = UNIX_LISTENING;
+    yield_unlock(&unix_lock);
+    
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Join two sockets as peers, with the lock held
+ */
+static void unix_join(unix_sock_t *a, unix_sock_t *b) {
+    a->peer = b;
+    b->peer = a;
+    a->refs++;
+    b->refs++;
+    if (a->type == SOCK_STREAM) {
+        a->state = UNIX_CONNECTED;
+        b->state = UNIX_CONNECTED;
+    }
+}
+
+/**
+ * Connect to the socket bound to an address
+ * A datagram socket only records the default destination. A stream
+ * socket gets a new server-side socket queued on the listener.
+ */
+static int unix_connect(socket_t *sock, const struct sockaddr *addr, socklen_t len,
+                        int nonblock) {
+    unix_sock_t *u = (unix_sock_t *)sock->proto;
+    unix_sock_t *target = unix_lookup(addr, len);
+    if (!target) {
+        /* errno already set by unix_lookup */
+        return -1;
+    }
+    
+    yield_lock(&unix_lock);
+    if (target->type != u->type) {
+        return unix_fail_put(target, THUNDEROS_EPROTOTYPE);
+    }
+    
+    if (u->type == SOCK_DGRAM) {
+        if (u->peer) {
+            unix_put(u->peer);
+        }
+        u->peer = target;
+        yield_unlock(&unix_lock);
+        clear_errno();
+        return 0;
+    }
+    
+    if (u->state == UNIX_CONNECTED || u->state == UNIX_DISCONNECTED) {
+        return unix_fail_put(target, THUNDEROS_EISCONN);
+    }
+    if (u->state == UNIX_LISTENING) {
+        return unix_fail_put(target, THUNDEROS_EINVAL);
+    }
+    
+    /* Wait for room in the listener's backlog */
+    while (1) {
+        if (!target->sock || target->state != UNIX_LISTENING) {
+            return unix_fail_put(target, THUNDEROS_ECONNREFUSED);
+        }
+        if (target->npending < target->backlog) {
+            break;
+        }
+        if (nonblock) {
+            return unix_fail_put(target, THUNDEROS_EAGAIN);
+        }
+        unix_sleep(&target->write_wait);
+    }
+    
+    socket_t *server = socket_alloc(AF_UNIX, SOCK_STREAM);
+    if (!server) {
+        return unix_fail_put(target, get_errno());
+    }
+    unix_sock_t *s = (unix_sock_t *)server->proto;
+    unix_join(u, s);
+    
+    s->next_pending = NULL;
+    unix_sock_t **link = &target->pending;
+    while (*link) {
+        link = &(*link)->next_pending;
+    }
+    *link = s;
+    target->npending++;
+    wait_queue_wake_all(&target->read_wait);
+    
+    unix_put(target);
+    yield_unlock(&unix_lock);
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Take the oldest pending connection of a listening socket
+ */
+static int unix_accept(socket_t *sock, socket_t **new_sock, int nonblock) {
+    unix_sock_t *u = (unix_sock_t *)sock->proto;
+    
+    yield_lock(&unix_lock);
+    if (u->state != UNIX_LISTENING) {
+        yield_unlock(&unix_lock);
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    while (!u->pending) {
+        if (nonblock) {
+            yield_unlock(&unix_lock);
+            RETURN_ERRNO(THUNDEROS_EAGAIN);
+        }
+        unix_sleep(&u->read_wait);
+    }
+    
+    unix_sock_t *s = u->pending;
+    u->pending = s->next_pending;
+    u->npending--;
+    wait_queue_wake_all(&u->write_wait);
+    yield_unlock(&unix_lock);
+    
+    *new_sock = s->sock;
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Connect two new sockets to each other
+ */
+static int unix_pair(socket_t *a, socket_t *b) {
+    yield_lock(&unix_lock);
+    unix_join((unix_sock_t *)a->proto, (unix_sock_t *)b->proto);
+    yield_unlock(&unix_lock);
+    clear_errno();
+    return 0;
+}
+
+/**
+ * Send a datagram, to msg->name or to the connected socket
+ */
+static int unix_send_dgram(unix_sock_t *u, socket_msg_t *msg, int nonblock) {
+    int64_t total = unix_iov_total(msg->iov, msg->iovcnt);
+    if (total < 0 || total > UNIX_RCVBUF) {
+        RETURN_ERRNO(THUNDEROS_EMSGSIZE);
+    }
+    
+    unix_sock_t *target;
+    if (msg->name) {
+        target = unix_lookup((const struct sockaddr *)msg->name, msg->namelen);
+        if (!target) {
+            /* errno already set by unix_lookup */
+            return -1;
+        }
+    } else {
+        yield_lock(&unix_lock);
+        target = u->peer;
+        if (target) {
+            target->refs++;
+        }
+        yield_unlock(&unix_lock);
+        if (!target) {
+            RETURN_ERRNO(THUNDEROS_ENOTCONN);
+        }
+    }
+    
+    /* Fill the datagram before taking the lock */
+    unix_msg_t *dgram = unix_msg_alloc();
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, msg->iov, msg->iovcnt);
+    if (!dgram || unix_msg_fill(dgram, &iter, (uint32_t)total) != total) {
+        if (dgram) {
+            unix_msg_free(dgram);
+        }
+        yield_lock(&unix_lock);
+        return unix_fail_put(target, THUNDEROS_ENOMEM);
+    }
+    
+    yield_lock(&unix_lock);
+    if (target->type != SOCK_DGRAM) {
+        yield_unlock(&unix_lock);
+        unix_msg_free(dgram);
+        yield_lock(&unix_lock);
+        return unix_fail_put(target, THUNDEROS_EPROTOTYPE);
+    }
+    while (target->sock && target->head && target->queued + dgram->len > UNIX_RCVBUF) {
+        if (nonblock) {
+            yield_unlock(&unix_lock);
+            unix_msg_free(dgram);
+            yield_lock(&unix_lock);
+            return unix_fail_put(target, THUNDEROS_EAGAIN);
+        }
+        unix_sleep(&target->write_wait);
+    }
+    if (!target->sock) {
+        yield_unlock(&unix_lock);
+        unix_msg_free(dgram);
+        yield_lock(&unix_lock);
+        return unix_fail_put(target, THUNDEROS_ECONNREFUSED);
+    }
+    
+    /* The datagram takes over the file references and the target's */
+    kmemcpy(dgram->files, msg->files, msg->nfiles * sizeof(vfs_file_t *));
+    dgram->nfiles = msg->nfiles;
+    msg->nfiles = 0;
+    dgram->from = u;
+    u->refs++;
+    unix_enqueue(target, dgram);
+    wait_queue_wake_all(&target->read_wait);
+    unix_put(target);
+    yield_unlock(&unix_lock);
+    
+    clear_errno();
+    return (int)total;
+}
+
+/**
+ * Write to a stream, waiting for room in the peer's queue
+ * Returns the bytes sent; a blocking send only returns early on error.
+ */
+static int unix_send_stream(unix_sock_t *u, socket_msg_t *msg, int nonblock) {
+    int64_t total = unix_iov_total(msg->iov, msg->iovcnt);
+    if (total < 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    if (msg->name) {
+        RETURN_ERRNO(THUNDEROS_EISCONN);
+    }
+    if (total == 0) {
+        clear_errno();
+        return 0;
+    }
+    
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, msg->iov, msg->iovcnt);
+    uint32_t sent = 0;
+    int error = 0;
+    
+    yield_lock(&unix_lock);
+    if (u->state != UNIX_CONNECTED && u->state != UNIX_DISCONNECTED) {
+        yield_unlock(&unix_lock);
+        RETURN_ERRNO(THUNDEROS_ENOTCONN);
+    }
+    
+    unix_sock_t *peer = u->peer;
+    do {
+        if (u->state == UNIX_DISCONNECTED || !peer->sock) {
+            error = THUNDEROS_EPIPE;
+            break;
+        }
+        
+        uint32_t room = UNIX_RCVBUF - peer->queued;
+        if (room == 0) {
+            if (nonblock) {
+                error = THUNDEROS_EAGAIN;
+                break;
+            }
+            unix_sleep(&peer->write_wait);
+            continue;
+        }
+        uint32_t want = (uint32_t)total - sent;
+        if (want > room) {
+            want = room;
+        }
+        
+        /* Small writes fill the newest message; descriptors start one */
+        unix_msg_t *tail = peer->tail;
+        int appended = 0;
+        if (tail && tail->nfiles == 0 && msg->nfiles == 0 &&
+            tail->len < UNIX_MSG_PAGES * PAGE_SIZE) {
+            appended = unix_msg_fill(tail, &iter, want);
+            if (appended > 0) {
+                peer->queued += appended;
+            }
+        }
+        if (appended <= 0) {
+            unix_msg_t *chunk = unix_msg_alloc();
+            appended = chunk ? unix_msg_fill(chunk, &iter, want) : -1;
+            if (appended <= 0) {
+                if (chunk) {
+                    kfree(chunk);
+                }
+                error = THUNDEROS_ENOMEM;
+                break;
+            }
+            kmemcpy(chunk->files, msg->files, msg->nfiles * sizeof(vfs_file_t *));
+            chunk->nfiles = msg->nfiles;
+            msg->nfiles = 0;
+            unix_enqueue(peer, chunk);
+        }
+        
+        sent += (uint32_t)appended;
+        wait_queue_wake_all(&peer->read_wait);
+    } while (sent < total);
+    yield_unlock(&unix_lock);
+    
+    if (sent > 0 || total == 0) {
+        clear_errno();
+        return (int)sent;
+    }
+    RETURN_ERRNO(error);
+}
+
+/**
+ * Send data
+ */
+static int unix_sendmsg(socket_t *sock, socket_msg_t *msg, int nonblock) {
+    unix_sock_t *u = (unix_sock_t *)sock->proto;
+    if (u->type == SOCK_DGRAM) {
+        return unix_send_dgram(u, msg, nonblock);
+    }
+    return unix_send_stream(u, msg, nonblock);
+}
+
+/**
+ * Describe the address a socket is bound to
+ */
+static void unix_fill_name(unix_sock_t *u, socket_msg_t *msg) {
+    if (!u || !u->bound_inode || !msg->name) {
+        msg->namelen = 0;
+        return;
+    }
+    struct sockaddr_un *sun = (struct sockaddr_un *)msg->name;
+    sun->sun_family = AF_UNIX;
+    kstrcpy(sun->sun_path, u->path);
+    msg->namelen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + kstrlen(u->path) + 1);
+}
+
+/**
+ * Wait with the lock held until the receive queue is not empty
+ * Returns 1 when it is, 0 at the end of a stream, or -1 with EAGAIN.
+ */
+static int unix_wait_data(unix_sock_t *u, int nonblock) {
+    while (!u->head) {
+        if (u->type == SOCK_STREAM && u->state == UNIX_DISCONNECTED) {
+            return 0;
+        }
+        if (nonblock) {
+            set_errno(THUNDEROS_EAGAIN);
+            return -1;
+        }
+        unix_sleep(&u->read_wait);
+    }
+    return 1;
+}
+
+/**
+ * Receive data
+ * A datagram is read whole; what does not fit is dropped with MSG_TRUNC.
+ * A stream read takes whatever is queued, but stops before data that
+ * carries descriptors, so they arrive with the bytes sent along with them.
+ */
+static int unix_recvmsg(socket_t *sock, socket_msg_t *msg, int nonblock) {
+    unix_sock_t *u = (unix_sock_t *)sock->proto;
+    int64_t total = unix_iov_total(msg->iov, msg->iovcnt);
+    if (total < 0) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    yield_lock(&unix_lock);
+    if (u->type == SOCK_STREAM && u->state != UNIX_CONNECTED &&
+        u->state != UNIX_DISCONNECTED) {
+        yield_unlock(&unix_lock);
+        RETURN_ERRNO(u->state == UNIX_LISTENING ? THUNDEROS_EINVAL : THUNDEROS_ENOTCONN);
+    }
+    
+    int ready = unix_wait_data(u, nonblock);
+    if (ready <= 0) {
+        yield_unlock(&unix_lock);
+        if (ready == 0) {
+            msg->namelen = 0;
+            clear_errno();
+        }
+        return ready;
+    }
+    
+    vfs_iov_iter_t iter;
+    vfs_iov_iter_init(&iter, msg->iov, msg->iovcnt);
+    uint32_t received = 0;
+    unix_msg_t *done = NULL;
+    
+    if (u->type == SOCK_DGRAM) {
+        unix_msg_t *dgram = unix_dequeue(u);
+        u->queued -= dgram->len;
+        received = unix_msg_read(dgram, &iter, (uint32_t)total);
+        if (received < dgram->len) {
+            msg->flags |= MSG_TRUNC;
+        }
+        unix_fill_name(dgram->from, msg);
+        kmemcpy(msg->files, dgram->files, dgram->nfiles * sizeof(vfs_file_t *));
+        msg->nfiles = dgram->nfiles;
+        dgram->nfiles = 0;
+        dgram->next = NULL;
+        done = dgram;
+    } else {
+        msg->namelen = 0;
+        while (u->head && received < total) {
+            unix_msg_t *head = u->head;
+            if (head->nfiles > 0) {
+                if (received > 0) {
+                    break;
+                }
+                kmemcpy(msg->files, head->files, head->nfiles * sizeof(vfs_file_t *));
+                msg->nfiles = head->nfiles;
+                head->nfiles = 0;
+            }
+            uint32_t copied = unix_msg_read(head, &iter, (uint32_t)total - received);
+            u->queued -= copied;
+            received += copied;
+            if (head->pos < head->len) {
+                break;
+            }
+            unix_dequeue(u);
+            head->next = done;
+            done = head;
+        }
+    }
+    
+    wait_queue_wake_all(&u->write_wait);
+    if (u->peer) {
+        wait_queue_wake_all(&u->peer->space_wait);
+    }
+    yield_unlock(&unix_lock);
+    
+    while (done) {
+        unix_msg_t *next = done->next;
+        unix_msg_free(done);
+        done = next;
+    }
+    
+    clear_errno();
+    return (int)received;
+}
+
+/**
+ * Release a socket: unbind it, disconnect its peer and drop its queue
+ */
+static void unix_release(socket_t *sock) {
+    unix_sock_t *u = (unix_sock_t *)sock->proto;
+    
+    yield_lock(&unix_lock);
+    u->sock = NULL;
+    
+    if (u->bound_inode) {
+        unix_sock_t **link = &bound_list;
+        while (*link && *link != u) {
+            link = &(*link)->next_bound;
+        }
+        if (*link) {
+            *link = u->next_bound;
+        }
+        u->bound_inode = 0;
+    }
+    
+    unix_sock_t *peer = u->peer;
+    u->peer = NULL;
+    if (peer) {
+        if (u->type == SOCK_STREAM) {
+            peer->state = UNIX_DISCONNECTED;
+            wait_queue_wake_all(&peer->read_wait);
+            wait_queue_wake_all(&peer->write_wait);
+            wait_queue_wake_all(&peer->space_wait);
+        }
+        unix_put(peer);
+    }
+    
+    unix_msg_t *queue = u->head;
+    u->head = NULL;
+    u->tail = NULL;
+    u->queued = 0;
+    
+    unix_sock_t *pending = u->pending;
+    u->pending = NULL;
+    u->npending = 0;
+    u->state = UNIX_UNCONNECTED;
+    
+    wait_queue_wake_all(&u->read_wait);
+    wait_queue_wake_all(&u->write_wait);
+    unix_put(u);
+    yield_unlock(&unix_lock);
+    
+    /* Outside the lock: closing a passed file may release a socket */
+    while (queue) {
+        unix_msg_t *next = queue->next;
+        unix_msg_free(queue);
+        queue = next;
+    }
+    while (pending) {
+        unix_sock_t *next = pending->next_pending;
+        socket_free(pending->sock);
+        pending = next;
+    }
+}
+
+/**
+ * Report readiness
+ * A datagram socket always reports POLLOUT, since whether a send waits
+ * depends on where it goes.
+ */
+static uint32_t unix_poll(socket_t *sock, struct poll_table *pt) {
+    unix_sock_t *u = (unix_sock_t *)sock->proto;
+    poll_wait(pt, &u->read_wait);
+    poll_wait(pt, &u->space_wait);
+    
+    uint32_t events = 0;
+    yield_lock(&unix_lock);
+    if (u->state == UNIX_LISTENING) {
+        if (u->pending) {
+            events |= POLLIN;
+        }
+    } else if (u->head) {
+        events |= POLLIN;
+    }
+    
+    if (u->type == SOCK_DGRAM) {
+        events |= POLLOUT;
+    } else if (u->state == UNIX_DISCONNECTED) {
+        events |= POLLIN | POLLHUP;
+    } else if (u->state == UNIX_CONNECTED && u->peer->queued < UNIX_RCVBUF) {
+        events |= POLLOUT;
+    }
+    yield_unlock(&unix_lock);
+    return events;
+}
+
+static const socket_ops_t unix_ops = {
+    .bind = unix_bind,
+    .listen = unix_listen,
+    .accept = unix_accept,
+    .connect = unix_connect,
+    .pair = unix_pair,
+    .sendmsg = unix_sendmsg,
+    .recvmsg = unix_recvmsg,
+    .release = unix_release,
+    .poll = unix_poll,
+};
+
+/**
+ * Create the AF_UNIX state of a new socket
+ */
+static int unix_create(socket_t *sock, int type) {
+    if (type != SOCK_STREAM && type != SOCK_DGRAM) {
+        RETURN_ERRNO(THUNDEROS_EINVAL);
+    }
+    
+    unix_sock_t *u = (unix_sock_t *)kmalloc(sizeof(unix_sock_t));
+    if (!u) {
+        RETURN_ERRNO(THUNDEROS_ENOMEM);
+    }
+    
+    kmemset(u, 0, sizeof(unix_sock_t));
+    u->sock = sock;
+    u->refs = 1;
+    u->type = type;
+    u->state = UNIX_UNCONNECTED;
+    wait_queue_init(&u->read_wait);
+    wait_queue_init(&u->write_wait);
+    wait_queue_init(&u->space_wait);
+    
+    sock->ops = &unix_ops;
+    sock->proto = u;
+    clear_errno();
+    return 0;
+}
+
+const socket_family_t unix_family = {
+    .family = AF_UNIX,
+    .create = unix_create,
+};
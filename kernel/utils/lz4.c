@@ -0,0 +1,95 @@
+/*
+ * LZ4 Block Decompression Implementation
+ *
+ * A block is a list of sequences. Each sequence starts with a token: the
+ * high nibble is the literal length, the low nibble the match length minus
+ * 4. A nibble of 15 is continued by bytes that are added on until one is
+ * below 255. Literals follow, then a 2-byte little-endian match offset.
+ * The last sequence has literals only.
+ */
+
+#include "kernel/lz4.h"
+#include "kernel/kstring.h"
+
+#define LZ4_MIN_MATCH 4
+
+/**
+ * Read a length continued past its token nibble
+ * Returns 0 if the input ends first.
+ */
+static int read_length(const uint8_t **ip, const uint8_t *end, uint32_t *length) {
+    uint8_t byte;
+    do {
+        if (*ip >= end) {
+            return 0;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+        if (*length > 0x7FFFFFFF) {
+            return 0;
+        }
+    } while (byte == 255);
+    return 1;
+}
+
+/**
+ * Decompress one LZ4 block
+ */
+int lz4_decompress(const void *src, uint32_t src_len, void *dst, uint32_t dst_cap) {
+    const uint8_t *ip = (const uint8_t *)src;
+    const uint8_t *ip_end = ip + src_len;
+    uint8_t *out = (uint8_t *)dst;
+    uint32_t op = 0;
+    
+    while (ip < ip_end) {
+        uint8_t token = *ip++;
+        
+        /* Literals */
+        uint32_t literals = token >> 4;
+        if (literals == 15 && !read_length(&ip, ip_end, &literals)) {
+            return -1;
+        }
+        if (literals > (uint32_t)(ip_end - ip) || literals > dst_cap - op) {
+            return -1;
+        }
+        kmemcpy(out + op, ip, literals);
+        ip += literals;
+        op += literals;
+        
+        /* The last sequence ends after its literals */
+        if (ip == ip_end) {
+            break;
+        }
+        
+        /* Match */
+        if (ip_end - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = ip[0] | ((uint32_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return -1;
+        }
+        
+        uint32_t match = token & 0x0F;
+        if (match == 15 && !read_length(&ip, ip_end, &match)) {
+            return -1;
+        }
+        match += LZ4_MIN_MATCH;
+        if (match > dst_cap - op) {
+            return -1;
+        }
+        
+        /* A match closer than its length repeats bytes it produces itself */
+        if (offset >= match) {
+            kmemcpy(out + op, out + op - offset, match);
+        } else {
+            for (uint32_t i = 0; i < match; i++) {
+                out[op + i] = out[op - offset + i];
+            }
+        }
+        op += match;
+    }
+    
+    return (int)op;
+}
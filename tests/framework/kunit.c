@@ -31,13 +31,15 @@ static void print_int(int val) {
 }
 
 // Run all test cases
-int kunit_run_tests(struct kunit_test *test_cases, int num_tests) {
+int kunit_run_tests(const char *suite, struct kunit_test *test_cases, int num_tests) {
     int passed = 0;
     int failed = 0;
     
     hal_uart_puts("\n");
     hal_uart_puts("========================================\n");
-    hal_uart_puts("  KUnit Test Suite - ThunderOS\n");
+    hal_uart_puts("  ");
+    hal_uart_puts(suite);
+    hal_uart_puts("\n");
     hal_uart_puts("========================================\n\n");
     
     // Run each test
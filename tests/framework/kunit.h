@@ -75,7 +75,7 @@ struct kunit_test {
 #define KUNIT_EXPECT_NOT_NULL(test, ptr) \
     KUNIT_EXPECT_NE(test, ptr, NULL)
 
-// Test suite runner
-int kunit_run_tests(struct kunit_test *test_cases, int num_tests);
+// Test suite runner; returns the number of failed tests
+int kunit_run_tests(const char *suite, struct kunit_test *test_cases, int num_tests);
 
 #endif // KUNIT_H
@@ -0,0 +1,238 @@
+#!/bin/bash
+#
+# ThunderOS Benchmark Runner
+# Boots QEMU, runs the userland/bench programs from the shell and collects
+# their results as JSON lines
+#
+# Usage: run_bench.sh [--no-build] [--compare <earlier results.jsonl>]
+#
+# Each "BENCH key=value ..." line a program prints becomes one JSON object
+# in tests/outputs/bench_results.jsonl, tagged with the kernel's git
+# revision. With --compare, the median of every result is shown next to
+# the one in an earlier file.
+#
+# Exit codes:
+#   0 - All benchmarks ran
+#   1 - Build, boot or a benchmark failed
+#
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+ROOT_DIR="${SCRIPT_DIR}/../.."
+BUILD_DIR="${ROOT_DIR}/build"
+OUTPUT_DIR="${SCRIPT_DIR}/../outputs"
+CONSOLE_FILE="${OUTPUT_DIR}/bench_console.txt"
+RESULTS_FILE="${OUTPUT_DIR}/bench_results.jsonl"
+BOOT_TIMEOUT=30                        # Seconds to reach the shell prompt
+COMMAND_TIMEOUT=300                    # Seconds for one benchmark program
+
+# Shell commands to run, in order
+BENCH_COMMANDS=(
+    "bench_syscall"
+    "bench_ctxsw"
+    "bench_fault"
+    "bench_spawn"
+    "bench_file /tmp"
+    "bench_file /"
+    "bench_dir /tmp"
+    "bench_dir /"
+    "bench_ml"
+)
+
+# Colors
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m'
+
+print_header() {
+    echo ""
+    echo "========================================"
+    echo "  $1"
+    echo "========================================"
+    echo ""
+}
+
+print_pass() {
+    echo -e "  ${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "  ${RED}[FAIL]${NC} $1"
+}
+
+print_info() {
+    echo -e "  ${BLUE}[INFO]${NC} $1"
+}
+
+print_test() {
+    echo -e "\n${YELLOW}[TEST]${NC} $1"
+}
+
+BUILD=1
+COMPARE_FILE=""
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --no-build) BUILD=0 ;;
+        --compare) COMPARE_FILE="$2"; shift ;;
+        *) echo "Usage: $0 [--no-build] [--compare <results.jsonl>]"; exit 1 ;;
+    esac
+    shift
+done
+
+mkdir -p "${OUTPUT_DIR}"
+cd "${ROOT_DIR}"
+
+print_header "ThunderOS Benchmarks"
+
+if [ $BUILD -eq 1 ]; then
+    print_info "Building kernel, userland and filesystem image..."
+    if make >/dev/null 2>&1 && make userland >/dev/null 2>&1 && make -B fs >/dev/null 2>&1; then
+        print_pass "Build successful"
+    else
+        print_fail "Build failed"
+        exit 1
+    fi
+fi
+
+# Number of shell prompts printed so far
+prompt_count() {
+    grep -o "ThunderOS> " "${CONSOLE_FILE}" 2>/dev/null | wc -l
+}
+
+# Wait until more than $1 prompts have appeared, for at most $2 seconds
+wait_for_prompt() {
+    local seen=$1
+    local deadline=$((SECONDS + $2))
+    while [ "$(prompt_count)" -le "$seen" ]; do
+        if [ $SECONDS -ge $deadline ] || ! kill -0 "${QEMU_PID}" 2>/dev/null; then
+            return 1
+        fi
+        sleep 0.5
+    done
+    return 0
+}
+
+# QEMU reads the shell's input from a FIFO the script writes commands to
+INPUT_FIFO="$(mktemp -u)"
+mkfifo "${INPUT_FIFO}"
+: > "${CONSOLE_FILE}"
+
+qemu-system-riscv64 \
+    -machine virt \
+    -cpu rv64,v=true,vlen=256 \
+    -m 128M \
+    -nographic \
+    -serial mon:stdio \
+    -bios default \
+    -kernel "${BUILD_DIR}/thunderos.elf" \
+    -global virtio-mmio.force-legacy=false \
+    -drive file="${BUILD_DIR}/fs.img",if=none,format=raw,id=hd0 \
+    -device virtio-blk-device,drive=hd0 \
+    <"${INPUT_FIFO}" >"${CONSOLE_FILE}" 2>&1 &
+QEMU_PID=$!
+
+# Hold the FIFO open for writing so QEMU does not see end of input
+exec 3>"${INPUT_FIFO}"
+rm -f "${INPUT_FIFO}"
+
+cleanup() {
+    exec 3>&-
+    kill "${QEMU_PID}" 2>/dev/null || true
+    wait "${QEMU_PID}" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+print_test "Booting (${BOOT_TIMEOUT}s timeout)"
+if wait_for_prompt 0 ${BOOT_TIMEOUT}; then
+    print_pass "Shell prompt reached"
+else
+    print_fail "Shell prompt not reached; console output in ${CONSOLE_FILE}"
+    exit 1
+fi
+
+FAILED=0
+for command in "${BENCH_COMMANDS[@]}"; do
+    print_test "${command}"
+    seen=$(prompt_count)
+    printf '%s\r' "${command}" >&3
+    if wait_for_prompt "${seen}" ${COMMAND_TIMEOUT}; then
+        print_pass "${command} finished"
+    else
+        print_fail "${command} did not finish in ${COMMAND_TIMEOUT}s"
+        FAILED=$((FAILED + 1))
+        break
+    fi
+done
+
+cleanup
+trap - EXIT
+
+# Turn "BENCH key=value ..." lines into JSON objects; numbers stay numbers
+REVISION="$(git -C "${ROOT_DIR}" rev-parse --short HEAD 2>/dev/null || echo unknown)"
+tr -d '\r' <"${CONSOLE_FILE}" | grep '^BENCH ' | awk -v rev="${REVISION}" '{
+    line = "{\"revision\":\"" rev "\""
+    for (i = 2; i <= NF; i++) {
+        eq = index($i, "=")
+        if (eq == 0) continue
+        key = substr($i, 1, eq - 1)
+        value = substr($i, eq + 1)
+        if (value !~ /^[0-9]+$/) value = "\"" value "\""
+        line = line ",\"" key "\":" value
+    }
+    print line "}"
+}' >"${RESULTS_FILE}"
+
+RESULT_COUNT=$(wc -l <"${RESULTS_FILE}")
+if grep -q '"error"' "${RESULTS_FILE}"; then
+    print_fail "Some benchmarks reported errors"
+    FAILED=$((FAILED + 1))
+fi
+
+print_header "Benchmark Results"
+
+# One line per result: the identifying fields, median and p99
+summarize() {
+    sed -e 's/^{//' -e 's/}$//' "$1" | awk -F',' '{
+        id = ""; median = "-"; p99 = "-"
+        for (i = 1; i <= NF; i++) {
+            split($i, kv, ":")
+            key = kv[1]; gsub(/"/, "", key)
+            value = substr($i, length(kv[1]) + 2); gsub(/"/, "", value)
+            if (key == "median_ns") median = value
+            else if (key == "p99_ns") p99 = value
+            else if (key == "name" || key == "fs" || key == "bs" || key == "pages" || key == "files" ||
+                     key == "impl" || key == "n" || key == "size_kib" || key == "regs")
+                id = id (id == "" ? "" : " ") key "=" value
+        }
+        print id "\t" median "\t" p99
+    }'
+}
+
+if [ -n "${COMPARE_FILE}" ]; then
+    printf "  %-44s %12s %12s %8s\n" "result" "before (ns)" "after (ns)" "change"
+    awk -F'\t' 'NR == FNR { before[$1] = $2; next }
+        {
+            old = ($1 in before) ? before[$1] : "-"
+            change = "-"
+            if (old != "-" && old > 0) change = sprintf("%+.1f%%", ($2 - old) * 100 / old)
+            printf "  %-44s %12s %12s %8s\n", $1, old, $2, change
+        }' <(summarize "${COMPARE_FILE}") <(summarize "${RESULTS_FILE}")
+else
+    printf "  %-44s %12s %12s\n" "result" "median (ns)" "p99 (ns)"
+    summarize "${RESULTS_FILE}" | awk -F'\t' '{ printf "  %-44s %12s %12s\n", $1, $2, $3 }'
+fi
+
+echo ""
+print_info "${RESULT_COUNT} results saved to: ${RESULTS_FILE}"
+print_info "Console output saved to: ${CONSOLE_FILE}"
+
+if [ $FAILED -eq 0 ]; then
+    echo -e "${GREEN}✓ All benchmarks ran${NC}"
+    exit 0
+else
+    echo -e "${RED}✗ ${FAILED} problem(s) while benchmarking${NC}"
+    exit 1
+fi
@@ -0,0 +1,159 @@
+/*
+ * File Descriptor Table Test Program
+ * 
+ * Tests the descriptor allocation bitmap: lowest-free allocation, reuse,
+ * growth across bitmap words, the full-word summary, the per-process
+ * limit, and the reserved stdin/stdout/stderr slots. Runs on the table
+ * in use (the kernel's before any process exists); every case gives back
+ * the descriptors it takes before checking its results.
+ * 
+ * This file is only compiled when ENABLE_KERNEL_TESTS is defined.
+ */
+
+#ifdef ENABLE_KERNEL_TESTS
+
+#include "../framework/kunit.h"
+#include "fs/vfs.h"
+#include "mm/kmalloc.h"
+#include "kernel/errno.h"
+
+// Whether descriptor fd is marked used
+static int fd_used(vfs_fd_table_t *table, int fd) {
+    return (table->used[fd / 64] >> (fd % 64)) & 1;
+}
+
+// Free the first count descriptors in fds
+static void free_all(int *fds, int count) {
+    for (int i = 0; i < count; i++) {
+        vfs_free_fd(fds[i]);
+    }
+}
+
+static void test_fd_lowest_free(struct kunit_test *test) {
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    
+    int a = vfs_alloc_fd();
+    int b = vfs_alloc_fd();
+    int c = vfs_alloc_fd();
+    int marked = a >= 0 && c >= 0 && fd_used(table, a) && fd_used(table, c);
+    
+    vfs_free_fd(b);
+    int b_freed = b >= 0 && !fd_used(table, b);
+    int again = vfs_alloc_fd();
+    
+    vfs_free_fd(c);
+    vfs_free_fd(again);
+    vfs_free_fd(a);
+    
+    // stdin/stdout/stderr are never handed out
+    KUNIT_EXPECT_TRUE(test, a > VFS_FD_STDERR);
+    KUNIT_EXPECT_TRUE(test, marked);
+    KUNIT_EXPECT_TRUE(test, b_freed);
+    KUNIT_EXPECT_EQ(test, again, b);
+    KUNIT_EXPECT_FALSE(test, fd_used(table, a) || fd_used(table, b) || fd_used(table, c));
+}
+
+static void test_fd_growth(struct kunit_test *test) {
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    int *fds = (int *)kmalloc(VFS_FD_TABLE_MAX * sizeof(int));
+    KUNIT_EXPECT_NOT_NULL(test, fds);
+    
+    // Allocate past the first two bitmap words
+    int count = 0;
+    int ascending = 1;
+    while (count < VFS_FD_TABLE_MAX) {
+        int fd = vfs_alloc_fd();
+        if (fd < 0) {
+            break;
+        }
+        if (count > 0 && fd <= fds[count - 1]) {
+            ascending = 0;
+        }
+        fds[count++] = fd;
+        if (fd >= 130) {
+            break;
+        }
+    }
+    int highest = count > 0 ? fds[count - 1] : -1;
+    uint32_t capacity = table->capacity;
+    int first_full = (table->full & 1) && table->used[0] == ~0ULL;
+    
+    // Free one in the first word: it is the lowest free again
+    int low = count > 0 ? fds[0] : -1;
+    vfs_free_fd(low);
+    int summary_cleared = !(table->full & 1);
+    int reused = vfs_alloc_fd();
+    
+    free_all(fds, count);
+    kfree(fds);
+    
+    KUNIT_EXPECT_TRUE(test, ascending);
+    KUNIT_EXPECT_TRUE(test, highest >= 130);
+    KUNIT_EXPECT_TRUE(test, capacity > 130);
+    KUNIT_EXPECT_TRUE(test, first_full);
+    KUNIT_EXPECT_TRUE(test, summary_cleared);
+    KUNIT_EXPECT_EQ(test, reused, low);
+    KUNIT_EXPECT_FALSE(test, fd_used(table, highest));
+}
+
+static void test_fd_limit(struct kunit_test *test) {
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    int *fds = (int *)kmalloc(VFS_FD_TABLE_MAX * sizeof(int));
+    KUNIT_EXPECT_NOT_NULL(test, fds);
+    
+    int count = 0;
+    int fd;
+    while (count < VFS_FD_TABLE_MAX && (fd = vfs_alloc_fd()) >= 0) {
+        fds[count++] = fd;
+    }
+    int refused = vfs_alloc_fd() < 0;
+    int error = get_errno();
+    int all_used = table->full == ~0ULL && fd_used(table, VFS_FD_TABLE_MAX - 1);
+    
+    // A freed descriptor at the top is handed out again
+    int last = count > 0 ? fds[count - 1] : -1;
+    vfs_free_fd(last);
+    int again = vfs_alloc_fd();
+    
+    free_all(fds, count);
+    kfree(fds);
+    
+    KUNIT_EXPECT_TRUE(test, refused);
+    KUNIT_EXPECT_EQ(test, error, THUNDEROS_EMFILE);
+    KUNIT_EXPECT_TRUE(test, all_used);
+    KUNIT_EXPECT_EQ(test, again, last);
+    KUNIT_EXPECT_FALSE(test, table->full & 1);
+}
+
+static void test_fd_reserved(struct kunit_test *test) {
+    vfs_fd_table_t *table = vfs_current_fd_table();
+    
+    // Closing stdout keeps it reserved
+    vfs_free_fd(VFS_FD_STDOUT);
+    KUNIT_EXPECT_TRUE(test, fd_used(table, VFS_FD_STDOUT));
+    int fd = vfs_alloc_fd();
+    vfs_free_fd(fd);
+    KUNIT_EXPECT_TRUE(test, fd > VFS_FD_STDERR);
+    
+    // Out-of-range descriptors are ignored
+    uint64_t used = table->used[0];
+    uint64_t full = table->full;
+    vfs_free_fd(-1);
+    vfs_free_fd(VFS_FD_TABLE_MAX);
+    KUNIT_EXPECT_EQ(test, table->used[0], used);
+    KUNIT_EXPECT_EQ(test, table->full, full);
+}
+
+static struct kunit_test fd_table_tests[] = {
+    KUNIT_CASE(test_fd_lowest_free),
+    KUNIT_CASE(test_fd_growth),
+    KUNIT_CASE(test_fd_limit),
+    KUNIT_CASE(test_fd_reserved),
+};
+
+void test_fd_table_all(void) {
+    kunit_run_tests("File Descriptor Table Tests", fd_table_tests,
+                    sizeof(fd_table_tests) / sizeof(fd_table_tests[0]));
+}
+
+#endif // ENABLE_KERNEL_TESTS
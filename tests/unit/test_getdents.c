@@ -0,0 +1,213 @@
+/*
+ * getdents Test Program
+ * 
+ * Tests that vfs_getdents() resumes from the cookie kept in the open
+ * file: a directory read through a small buffer returns every entry once,
+ * and entries removed between calls neither hide nor repeat the others.
+ * Runs on the tmpfs at /tmp and, when one is mounted, on ext2, in a
+ * scratch directory that is removed afterwards.
+ * 
+ * This file is only compiled when ENABLE_KERNEL_TESTS is defined.
+ */
+
+#ifdef ENABLE_KERNEL_TESTS
+
+#include "../framework/kunit.h"
+#include "hal/hal_uart.h"
+#include "fs/vfs.h"
+#include "kernel/errno.h"
+#include "kernel/kstring.h"
+
+// Files in the scratch directory, named f00 to f39
+#define GETDENTS_FILES 40
+
+// Holds four short records, so a listing takes many calls
+#define GETDENTS_SMALL_BUFFER 64
+
+// Compare two NUL-terminated strings for equality
+static int name_is(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+// Build "<dir>/fNN"
+static void file_path(char *out, const char *dir, int n) {
+    kstrcpy(out, dir);
+    size_t len = kstrlen(out);
+    out[len] = '/';
+    out[len + 1] = 'f';
+    out[len + 2] = (char)('0' + n / 10);
+    out[len + 3] = (char)('0' + n % 10);
+    out[len + 4] = '\0';
+}
+
+// Index of a test file name, or -1 for any other name
+static int file_index(const char *name) {
+    if (name[0] != 'f' || name[1] < '0' || name[1] > '9' ||
+        name[2] < '0' || name[2] > '9' || name[3] != '\0') {
+        return -1;
+    }
+    return (name[1] - '0') * 10 + (name[2] - '0');
+}
+
+/**
+ * Read one buffer of entries and count each test file seen
+ * Returns what vfs_getdents() returned.
+ */
+static int read_batch(int fd, uint8_t *seen, int *dots, int *others) {
+    uint64_t buffer[GETDENTS_SMALL_BUFFER / 8];
+    int bytes = vfs_getdents(fd, buffer, sizeof(buffer));
+    
+    for (int off = 0; off < bytes; ) {
+        vfs_dirent_t *entry = (vfs_dirent_t *)((uint8_t *)buffer + off);
+        int index = file_index(entry->d_name);
+        if (index >= 0 && index < GETDENTS_FILES) {
+            seen[index]++;
+        } else if (name_is(entry->d_name, ".") || name_is(entry->d_name, "..")) {
+            (*dots)++;
+        } else {
+            (*others)++;
+        }
+        if (entry->d_reclen == 0) {
+            break;
+        }
+        off += entry->d_reclen;
+    }
+    return bytes;
+}
+
+// Whether path resolves to a directory on the named filesystem type
+static int on_filesystem(const char *path, const char *type) {
+    vfs_node_t *node = vfs_resolve_path(path);
+    return node && node->fs && node->type == VFS_TYPE_DIRECTORY && name_is(node->fs->name, type);
+}
+
+// Run the checks in a scratch directory below base
+static void check_directory(struct kunit_test *test, const char *base) {
+    char dir[VFS_MAX_PATH];
+    char path[VFS_MAX_PATH];
+    uint8_t seen[GETDENTS_FILES];
+    int dots = 0;
+    int others = 0;
+    
+    kstrcpy(dir, base);
+    kstrcpy(dir + kstrlen(dir), "/getdents_test");
+    
+    KUNIT_EXPECT_EQ(test, vfs_mkdir(dir, 0755), 0);
+    int created = 0;
+    while (created < GETDENTS_FILES) {
+        file_path(path, dir, created);
+        int fd = vfs_open(path, O_CREAT | O_WRONLY);
+        if (fd < 0) {
+            break;
+        }
+        vfs_close(fd);
+        created++;
+    }
+    
+    // Whole listing through a small buffer
+    kmemset(seen, 0, sizeof(seen));
+    int fd = vfs_open(dir, O_RDONLY);
+    int calls = 0;
+    int bytes;
+    while ((bytes = read_batch(fd, seen, &dots, &others)) > 0) {
+        calls++;
+    }
+    int end_again = read_batch(fd, seen, &dots, &others);
+    int listed_once = 1;
+    for (int i = 0; i < GETDENTS_FILES; i++) {
+        listed_once = listed_once && seen[i] == 1;
+    }
+    int listed_dots = dots;
+    int listed_others = others;
+    vfs_close(fd);
+    
+    // A buffer too small for one record
+    fd = vfs_open(dir, O_RDONLY);
+    uint64_t tiny;
+    int tiny_result = vfs_getdents(fd, &tiny, sizeof(tiny));
+    int tiny_error = get_errno();
+    
+    // Remove one entry already returned and one not yet returned
+    kmemset(seen, 0, sizeof(seen));
+    others = 0;
+    read_batch(fd, seen, &dots, &others);
+    int returned = -1;
+    for (int i = 0; i < GETDENTS_FILES && returned < 0; i++) {
+        if (seen[i]) {
+            returned = i;
+        }
+    }
+    int pending = GETDENTS_FILES - 1;
+    if (returned >= 0) {
+        file_path(path, dir, returned);
+        vfs_unlink(path);
+    }
+    file_path(path, dir, pending);
+    vfs_unlink(path);
+    
+    while (read_batch(fd, seen, &dots, &others) > 0) {
+    }
+    vfs_close(fd);
+    
+    int resumed_once = returned >= 0 && seen[pending] == 0 && others == 0;
+    for (int i = 0; i < GETDENTS_FILES; i++) {
+        if (i != pending) {
+            resumed_once = resumed_once && seen[i] == 1;
+        }
+    }
+    
+    // Clean up before checking, so a failure leaves nothing behind
+    for (int i = 0; i < created; i++) {
+        if (i != returned && i != pending) {
+            file_path(path, dir, i);
+            vfs_unlink(path);
+        }
+    }
+    int removed = vfs_rmdir(dir) == 0 && !vfs_exists(dir);
+    
+    KUNIT_EXPECT_EQ(test, created, GETDENTS_FILES);
+    KUNIT_EXPECT_TRUE(test, calls > 1);
+    KUNIT_EXPECT_TRUE(test, listed_once);
+    KUNIT_EXPECT_EQ(test, listed_dots, 2);
+    KUNIT_EXPECT_EQ(test, listed_others, 0);
+    KUNIT_EXPECT_EQ(test, bytes, 0);
+    KUNIT_EXPECT_EQ(test, end_again, 0);
+    KUNIT_EXPECT_TRUE(test, tiny_result < 0);
+    KUNIT_EXPECT_EQ(test, tiny_error, THUNDEROS_EINVAL);
+    KUNIT_EXPECT_TRUE(test, resumed_once);
+    KUNIT_EXPECT_TRUE(test, removed);
+}
+
+static void test_getdents_tmpfs(struct kunit_test *test) {
+    if (!on_filesystem("/tmp", "tmpfs")) {
+        hal_uart_puts("             SKIP (no tmpfs on /tmp)\n");
+        return;
+    }
+    check_directory(test, "/tmp");
+}
+
+static void test_getdents_ext2(struct kunit_test *test) {
+    if (on_filesystem("/mnt", "ext2")) {
+        check_directory(test, "/mnt");
+    } else if (on_filesystem("/", "ext2")) {
+        check_directory(test, "");
+    } else {
+        hal_uart_puts("             SKIP (no ext2 filesystem mounted)\n");
+    }
+}
+
+static struct kunit_test getdents_tests[] = {
+    KUNIT_CASE(test_getdents_tmpfs),
+    KUNIT_CASE(test_getdents_ext2),
+};
+
+void test_getdents_all(void) {
+    kunit_run_tests("getdents Tests", getdents_tests,
+                    sizeof(getdents_tests) / sizeof(getdents_tests[0]));
+}
+
+#endif // ENABLE_KERNEL_TESTS
@@ -0,0 +1,150 @@
+/*
+ * initramfs Parser Test Program
+ * 
+ * Tests how initramfs_unpack() reads newc cpio headers: archives that end
+ * at the trailer, and truncated or malformed headers and names that must
+ * be rejected before anything is read past the archive. None of the
+ * archives here creates a file, so no filesystem needs to be mounted.
+ * 
+ * This file is only compiled when ENABLE_KERNEL_TESTS is defined.
+ */
+
+#ifdef ENABLE_KERNEL_TESTS
+
+#include "../framework/kunit.h"
+#include "fs/initramfs.h"
+#include "kernel/errno.h"
+#include "kernel/kstring.h"
+
+// Size of a newc member header
+#define NEWC_HEADER 110
+
+// Large enough for the archives built here
+#define ARCHIVE_MAX 512
+
+// Write an 8-digit hex header field
+static void put_hex(char *field, uint32_t value) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 7; i >= 0; i--) {
+        field[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+}
+
+/**
+ * Append a member to an archive
+ * name_size is written as given, so it can disagree with the name.
+ * Returns the size of the archive after the member and its padding.
+ */
+static size_t put_member(char *archive, size_t pos, const char *name, uint32_t name_size,
+                         uint32_t mode, uint32_t file_size) {
+    char *header = archive + pos;
+    kmemcpy(header, INITRAMFS_MAGIC, 6);
+    for (int field = 0; field < 13; field++) {
+        put_hex(header + 6 + field * 8, 0);
+    }
+    put_hex(header + 14, mode);
+    put_hex(header + 54, file_size);
+    put_hex(header + 94, name_size);
+    
+    size_t len = kstrlen(name);
+    kmemcpy(header + NEWC_HEADER, name, len + 1);
+    pos += NEWC_HEADER + len + 1;
+    while (pos % 4) {
+        archive[pos++] = '\0';
+    }
+    return pos;
+}
+
+// Append the member that ends an archive
+static size_t put_trailer(char *archive, size_t pos) {
+    return put_member(archive, pos, INITRAMFS_TRAILER, sizeof(INITRAMFS_TRAILER), 0, 0);
+}
+
+// Unpack and check the result is -1 with EINVAL
+static int rejected(const char *archive, size_t size) {
+    clear_errno();
+    return initramfs_unpack(archive, size) == -1 && get_errno() == THUNDEROS_EINVAL;
+}
+
+static char archive[ARCHIVE_MAX];
+
+static void test_initramfs_well_formed(struct kunit_test *test) {
+    size_t size = put_trailer(archive, 0);
+    KUNIT_EXPECT_EQ(test, initramfs_unpack(archive, size), 0);
+    
+    // "." names the root, which already exists
+    size = put_member(archive, 0, ".", 2, INITRAMFS_S_IFDIR | 0755, 0);
+    size = put_trailer(archive, size);
+    KUNIT_EXPECT_EQ(test, initramfs_unpack(archive, size), 0);
+    
+    // Anything after the trailer is ignored
+    size = put_trailer(archive, 0);
+    KUNIT_EXPECT_EQ(test, initramfs_unpack(archive, size + 64), 0);
+}
+
+static void test_initramfs_truncated_headers(struct kunit_test *test) {
+    put_trailer(archive, 0);
+    KUNIT_EXPECT_TRUE(test, rejected(archive, 0));
+    KUNIT_EXPECT_TRUE(test, rejected(archive, NEWC_HEADER - 1));
+    
+    // A member, then a second header cut short
+    size_t size = put_member(archive, 0, ".", 2, INITRAMFS_S_IFDIR | 0755, 0);
+    put_trailer(archive, size);
+    KUNIT_EXPECT_TRUE(test, rejected(archive, size + 20));
+}
+
+static void test_initramfs_malformed_headers(struct kunit_test *test) {
+    // Old-style magic 070702
+    size_t size = put_trailer(archive, 0);
+    archive[5] = '2';
+    KUNIT_EXPECT_TRUE(test, rejected(archive, size));
+    
+    // Name size that is not hex
+    size = put_trailer(archive, 0);
+    archive[94 + 3] = 'g';
+    KUNIT_EXPECT_TRUE(test, rejected(archive, size));
+    
+    size = put_member(archive, 0, INITRAMFS_TRAILER, 0, 0, 0);
+    KUNIT_EXPECT_TRUE(test, rejected(archive, size));
+}
+
+static void test_initramfs_malformed_names(struct kunit_test *test) {
+    // Archive ends inside the name
+    put_trailer(archive, 0);
+    KUNIT_EXPECT_TRUE(test, rejected(archive, NEWC_HEADER + 5));
+    
+    // Name size runs past the archive
+    size_t size = put_member(archive, 0, INITRAMFS_TRAILER, 200, 0, 0);
+    KUNIT_EXPECT_TRUE(test, rejected(archive, size));
+    
+    size = put_member(archive, 0, INITRAMFS_TRAILER, 0xFFFFFFFF, 0, 0);
+    KUNIT_EXPECT_TRUE(test, rejected(archive, size));
+    
+    // Name size one short, so the name has no NUL within it
+    size = put_member(archive, 0, INITRAMFS_TRAILER, sizeof(INITRAMFS_TRAILER) - 1, 0, 0);
+    KUNIT_EXPECT_TRUE(test, rejected(archive, size));
+}
+
+static void test_initramfs_truncated_data(struct kunit_test *test) {
+    size_t size = put_member(archive, 0, "file", 5, INITRAMFS_S_IFREG | 0644, 100);
+    KUNIT_EXPECT_TRUE(test, rejected(archive, size));
+    
+    size = put_member(archive, 0, "file", 5, INITRAMFS_S_IFREG | 0644, 0xFFFFFFFF);
+    KUNIT_EXPECT_TRUE(test, rejected(archive, size));
+}
+
+static struct kunit_test initramfs_tests[] = {
+    KUNIT_CASE(test_initramfs_well_formed),
+    KUNIT_CASE(test_initramfs_truncated_headers),
+    KUNIT_CASE(test_initramfs_malformed_headers),
+    KUNIT_CASE(test_initramfs_malformed_names),
+    KUNIT_CASE(test_initramfs_truncated_data),
+};
+
+void test_initramfs_all(void) {
+    kunit_run_tests("initramfs Parser Tests", initramfs_tests,
+                    sizeof(initramfs_tests) / sizeof(initramfs_tests[0]));
+}
+
+#endif // ENABLE_KERNEL_TESTS
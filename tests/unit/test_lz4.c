@@ -0,0 +1,156 @@
+/*
+ * LZ4 Decompression Test Program
+ * 
+ * Tests lz4_decompress() on hand-made blocks: literals, long lengths,
+ * overlapping matches, and malformed input that must be rejected without
+ * reading or writing past the buffers.
+ * 
+ * This file is only compiled when ENABLE_KERNEL_TESTS is defined.
+ */
+
+#ifdef ENABLE_KERNEL_TESTS
+
+#include "../framework/kunit.h"
+#include "kernel/lz4.h"
+#include "kernel/kstring.h"
+
+// Output buffer with guard bytes after the capacity under test
+#define LZ4_TEST_OUT 64
+#define LZ4_GUARD 0xA5
+
+static uint8_t out[LZ4_TEST_OUT];
+
+// Decompress into the guarded buffer; 1 if nothing past dst_cap was written
+static int run(const uint8_t *src, uint32_t len, uint32_t dst_cap, int *result) {
+    kmemset(out, LZ4_GUARD, LZ4_TEST_OUT);
+    *result = lz4_decompress(src, len, out, dst_cap);
+    for (uint32_t i = dst_cap; i < LZ4_TEST_OUT; i++) {
+        if (out[i] != LZ4_GUARD) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Compare n bytes of output
+static int same(const char *b, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (out[i] != (uint8_t)b[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static const uint8_t literals[] = { 0x50, 'h', 'e', 'l', 'l', 'o' };
+
+// "ab" then a match of 8 at offset 2 repeats its own output
+static const uint8_t overlap[] = { 0x24, 'a', 'b', 0x02, 0x00 };
+
+static void test_lz4_well_formed(struct kunit_test *test) {
+    int result;
+    
+    KUNIT_EXPECT_TRUE(test, run((const uint8_t *)"", 0, 16, &result));
+    KUNIT_EXPECT_EQ(test, result, 0);
+    
+    KUNIT_EXPECT_TRUE(test, run(literals, sizeof(literals), 16, &result));
+    KUNIT_EXPECT_EQ(test, result, 5);
+    KUNIT_EXPECT_TRUE(test, same("hello", 5));
+    
+    // Literal length 15 + 3 continued in a second byte
+    static const uint8_t long_literals[] = {
+        0xF0, 0x03, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
+        'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r'
+    };
+    KUNIT_EXPECT_TRUE(test, run(long_literals, sizeof(long_literals), 32, &result));
+    KUNIT_EXPECT_EQ(test, result, 18);
+    KUNIT_EXPECT_TRUE(test, same("abcdefghijklmnopqr", 18));
+    
+    // "abcd" then a match of 4 at offset 4, then literals "!"
+    static const uint8_t match[] = { 0x40, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x10, '!' };
+    KUNIT_EXPECT_TRUE(test, run(match, sizeof(match), 16, &result));
+    KUNIT_EXPECT_EQ(test, result, 9);
+    KUNIT_EXPECT_TRUE(test, same("abcdabcd!", 9));
+}
+
+static void test_lz4_overlapping_matches(struct kunit_test *test) {
+    int result;
+    
+    KUNIT_EXPECT_TRUE(test, run(overlap, sizeof(overlap), 16, &result));
+    KUNIT_EXPECT_EQ(test, result, 10);
+    KUNIT_EXPECT_TRUE(test, same("ababababab", 10));
+    
+    // A run of one byte: offset 1, match length 15 + 4 + 1
+    static const uint8_t run_length[] = { 0x1F, 'x', 0x01, 0x00, 0x01 };
+    KUNIT_EXPECT_TRUE(test, run(run_length, sizeof(run_length), 32, &result));
+    KUNIT_EXPECT_EQ(test, result, 21);
+    KUNIT_EXPECT_TRUE(test, same("xxxxxxxxxxxxxxxxxxxxx", 21));
+}
+
+static void test_lz4_truncated_input(struct kunit_test *test) {
+    int result;
+    
+    // Literals run past the end
+    KUNIT_EXPECT_TRUE(test, run(literals, 4, 16, &result));
+    KUNIT_EXPECT_EQ(test, result, -1);
+    
+    static const uint8_t cut_length[] = { 0xF0 };
+    KUNIT_EXPECT_TRUE(test, run(cut_length, sizeof(cut_length), 16, &result));
+    KUNIT_EXPECT_EQ(test, result, -1);
+    
+    static const uint8_t cut_offset[] = { 0x14, 'a', 0x01 };
+    KUNIT_EXPECT_TRUE(test, run(cut_offset, sizeof(cut_offset), 16, &result));
+    KUNIT_EXPECT_EQ(test, result, -1);
+    
+    static const uint8_t cut_match_length[] = { 0x1F, 'x', 0x01, 0x00 };
+    KUNIT_EXPECT_TRUE(test, run(cut_match_length, sizeof(cut_match_length), 32, &result));
+    KUNIT_EXPECT_EQ(test, result, -1);
+}
+
+static void test_lz4_bad_offsets(struct kunit_test *test) {
+    int result;
+    
+    // Offset beyond the output so far
+    static const uint8_t far_offset[] = { 0x24, 'a', 'b', 0x03, 0x00 };
+    KUNIT_EXPECT_TRUE(test, run(far_offset, sizeof(far_offset), 16, &result));
+    KUNIT_EXPECT_EQ(test, result, -1);
+    
+    // Match before any output
+    static const uint8_t first_match[] = { 0x04, 0x01, 0x00 };
+    KUNIT_EXPECT_TRUE(test, run(first_match, sizeof(first_match), 16, &result));
+    KUNIT_EXPECT_EQ(test, result, -1);
+    
+    static const uint8_t zero_offset[] = { 0x24, 'a', 'b', 0x00, 0x00 };
+    KUNIT_EXPECT_TRUE(test, run(zero_offset, sizeof(zero_offset), 16, &result));
+    KUNIT_EXPECT_EQ(test, result, -1);
+}
+
+static void test_lz4_output_limit(struct kunit_test *test) {
+    int result;
+    
+    KUNIT_EXPECT_TRUE(test, run(literals, sizeof(literals), 4, &result));
+    KUNIT_EXPECT_EQ(test, result, -1);
+    
+    KUNIT_EXPECT_TRUE(test, run(overlap, sizeof(overlap), 9, &result));
+    KUNIT_EXPECT_EQ(test, result, -1);
+    
+    // Output exactly dst_cap
+    KUNIT_EXPECT_TRUE(test, run(overlap, sizeof(overlap), 10, &result));
+    KUNIT_EXPECT_EQ(test, result, 10);
+    KUNIT_EXPECT_TRUE(test, same("ababababab", 10));
+}
+
+static struct kunit_test lz4_tests[] = {
+    KUNIT_CASE(test_lz4_well_formed),
+    KUNIT_CASE(test_lz4_overlapping_matches),
+    KUNIT_CASE(test_lz4_truncated_input),
+    KUNIT_CASE(test_lz4_bad_offsets),
+    KUNIT_CASE(test_lz4_output_limit),
+};
+
+void test_lz4_all(void) {
+    kunit_run_tests("LZ4 Decompression Tests", lz4_tests,
+                    sizeof(lz4_tests) / sizeof(lz4_tests[0]));
+}
+
+#endif // ENABLE_KERNEL_TESTS
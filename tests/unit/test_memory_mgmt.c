@@ -1,7 +1,8 @@
 /*
  * Memory Management Test Program
  * 
- * Tests DMA allocation, address translation, and memory barriers
+ * Tests DMA allocation, address translation, memory barriers and page
+ * reference counts
  * 
  * This file is only compiled when ENABLE_KERNEL_TESTS is defined.
  */
@@ -299,6 +300,41 @@ void test_memory_management(void) {
         hal_uart_puts("SKIP (region2 is NULL)\n");
     }
     
+    // ========================================
+    // Test 11: Page Reference Counts
+    // ========================================
+    hal_uart_puts("\nTest 11: Page Reference Counts\n");
+    hal_uart_puts("  Sharing a page and dropping both references... ");
+    tests_total++;
+    
+    size_t free_before, free_shared, free_after;
+    pmm_get_stats(NULL, &free_before);
+    uintptr_t shared_page = pmm_alloc_page();
+    if (shared_page != 0) {
+        int refs_ok = (pmm_page_refs(shared_page) == 1);
+        pmm_page_get(shared_page);
+        refs_ok = refs_ok && (pmm_page_refs(shared_page) == 2);
+        
+        // The first free only drops a reference
+        pmm_free_page(shared_page);
+        pmm_get_stats(NULL, &free_shared);
+        refs_ok = refs_ok && (pmm_page_refs(shared_page) == 1) &&
+                  (free_shared == free_before - 1);
+        
+        pmm_free_page(shared_page);
+        pmm_get_stats(NULL, &free_after);
+        refs_ok = refs_ok && (pmm_page_refs(shared_page) == 0) && (free_after == free_before);
+        
+        if (refs_ok) {
+            hal_uart_puts("PASS\n");
+            tests_passed++;
+        } else {
+            hal_uart_puts("FAIL\n");
+        }
+    } else {
+        hal_uart_puts("SKIP (out of memory)\n");
+    }
+    
     // ========================================
     // Summary
     // ========================================
@@ -0,0 +1,86 @@
+/*
+ * bench.c - Shared code for the benchmark programs
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int bench_init(bench_t *b, const char *name, const char *params, int max) {
+    b->name = name;
+    b->params = params;
+    b->count = 0;
+    b->max = max;
+    b->ops_per_sample = 1;
+    b->bytes_per_op = 0;
+    b->flops_per_op = 0;
+    b->samples = malloc((size_t)max * sizeof(b->samples[0]));
+    if (!b->samples) {
+        fprintf(stderr, "%s: cannot allocate %d samples\n", name, max);
+        return -1;
+    }
+    return 0;
+}
+
+// Shell sort; samples number in the thousands
+static void sort_samples(unsigned long *v, int n) {
+    static const int gaps[] = { 1750, 701, 301, 132, 57, 23, 10, 4, 1 };
+    for (size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        int gap = gaps[g];
+        for (int i = gap; i < n; i++) {
+            unsigned long value = v[i];
+            int j = i;
+            while (j >= gap && v[j - gap] > value) {
+                v[j] = v[j - gap];
+                j -= gap;
+            }
+            v[j] = value;
+        }
+    }
+}
+
+// Nanoseconds per operation for a sample of the given ticks
+static unsigned long to_ns(const bench_t *b, unsigned long ticks) {
+    return ticks * (1000000000UL / BENCH_TIMEBASE) / b->ops_per_sample;
+}
+
+void bench_report(bench_t *b) {
+    if (b->count == 0) {
+        printf("BENCH name=%s%s%s error=no_samples\n", b->name,
+               b->params ? " " : "", b->params ? b->params : "");
+        free(b->samples);
+        return;
+    }
+    
+    sort_samples(b->samples, b->count);
+    unsigned long median = to_ns(b, b->samples[b->count / 2]);
+    unsigned long p99 = to_ns(b, b->samples[(b->count * 99) / 100]);
+    
+    printf("BENCH name=%s%s%s iters=%d median_ns=%lu p99_ns=%lu",
+           b->name, b->params ? " " : "", b->params ? b->params : "",
+           b->count * (int)b->ops_per_sample, median, p99);
+    // A median below the timer's resolution reads as zero
+    if (median > 0) {
+        printf(" ops_s=%lu", 1000000000UL / median);
+        if (b->bytes_per_op) {
+            printf(" kib_s=%lu", (unsigned long)(b->bytes_per_op * (1000000000UL / 1024) / median));
+        }
+        if (b->flops_per_op) {
+            printf(" mflop_s=%lu", b->flops_per_op * 1000UL / median);
+        }
+    }
+    printf("\n");
+    
+    free(b->samples);
+    b->samples = NULL;
+}
+
+int bench_arg_iters(int argc, char **argv, int index, int def) {
+    if (index < argc) {
+        int n = atoi(argv[index]);
+        if (n > 0) {
+            return n;
+        }
+    }
+    return def;
+}
@@ -0,0 +1,70 @@
+/*
+ * bench.h - Shared code for the benchmark programs
+ *
+ * A benchmark times each iteration with rdtime and prints one line per
+ * result, which tests/scripts/run_bench.sh collects:
+ *
+ *   BENCH name=<name> [key=value ...] iters=<n> median_ns=<m> p99_ns=<p> ...
+ */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stddef.h>
+
+// Rate of the time CSR (QEMU virt)
+#define BENCH_TIMEBASE 10000000UL
+
+/**
+ * Read the time CSR
+ */
+static inline unsigned long rdtime(void) {
+    unsigned long t;
+    asm volatile("rdtime %0" : "=r"(t));
+    return t;
+}
+
+/**
+ * Samples of one measurement
+ */
+typedef struct {
+    const char *name;
+    const char *params;                // Extra key=value pairs, or NULL
+    unsigned long *samples;            // Ticks per sample
+    int count;
+    int max;
+    unsigned int ops_per_sample;       // Operations timed together in one sample
+    size_t bytes_per_op;               // Data moved per operation, 0 if none
+    unsigned long flops_per_op;        // Arithmetic per operation, 0 if not counted
+} bench_t;
+
+/**
+ * Start a measurement of up to max samples
+ * @return 0 on success, -1 if the samples cannot be allocated
+ */
+int bench_init(bench_t *b, const char *name, const char *params, int max);
+
+/**
+ * Record the ticks taken by one sample
+ */
+static inline void bench_record(bench_t *b, unsigned long ticks) {
+    if (b->count < b->max) {
+        b->samples[b->count++] = ticks;
+    }
+}
+
+/**
+ * Print the result line and free the samples
+ *
+ * Reports the median and 99th percentile time per operation, the
+ * operations per second at the median, the throughput in KiB/s when
+ * bytes_per_op is set and in MFLOP/s when flops_per_op is.
+ */
+void bench_report(bench_t *b);
+
+/**
+ * Iteration count from argv[index], or def if absent
+ */
+int bench_arg_iters(int argc, char **argv, int index, int def);
+
+#endif // _BENCH_H
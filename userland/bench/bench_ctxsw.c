@@ -0,0 +1,83 @@
+/*
+ * bench_ctxsw - Context switch ping-pong
+ * This program starts a copy of itself, and the two pass one byte back and
+ * forth over two pipes; each round trip is two switches, each with a read
+ * and a write
+ * Usage: bench_ctxsw [iterations] [path of this program]
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Echo every byte until the other end closes
+static int echo(int in_fd, int out_fd) {
+    char token;
+    while (read(in_fd, &token, 1) == 1) {
+        write(out_fd, &token, 1);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "-echo") == 0) {
+        return echo(atoi(argv[2]), atoi(argv[3]));
+    }
+    
+    int iters = bench_arg_iters(argc, argv, 1, 5000);
+    const char *self = (argc > 2) ? argv[2] : "/bin/bench_ctxsw";
+    
+    // Only the copies made below reach the child, so it sees end of input
+    int to_child[2], to_parent[2];
+    if (pipe2(to_child, O_CLOEXEC) != 0 || pipe2(to_parent, O_CLOEXEC) != 0) {
+        fprintf(stderr, "bench_ctxsw: pipe failed\n");
+        return 1;
+    }
+    int child_in = dup(to_child[0]);
+    int child_out = dup(to_parent[1]);
+    
+    bench_t b;
+    if (bench_init(&b, "ctxsw.pipe_roundtrip", NULL, iters) != 0) {
+        return 1;
+    }
+    
+    char in_arg[12], out_arg[12];
+    snprintf(in_arg, sizeof(in_arg), "%d", child_in);
+    snprintf(out_arg, sizeof(out_arg), "%d", child_out);
+    char *const child_argv[] = { (char *)self, "-echo", in_arg, out_arg, NULL };
+    pid_t pid = execve(self, child_argv, NULL);
+    if (pid < 0) {
+        fprintf(stderr, "bench_ctxsw: cannot execute %s\n", self);
+        return 1;
+    }
+    
+    close(child_in);
+    close(child_out);
+    close(to_child[0]);
+    close(to_parent[1]);
+    
+    // Warm up both processes before timing
+    char token = 'x';
+    for (int i = 0; i < 16; i++) {
+        write(to_child[1], &token, 1);
+        read(to_parent[0], &token, 1);
+    }
+    
+    for (int i = 0; i < iters; i++) {
+        unsigned long start = rdtime();
+        write(to_child[1], &token, 1);
+        if (read(to_parent[0], &token, 1) != 1) {
+            fprintf(stderr, "bench_ctxsw: child went away\n");
+            break;
+        }
+        bench_record(&b, rdtime() - start);
+    }
+    
+    close(to_child[1]);
+    waitpid(pid, NULL, 0);
+    bench_report(&b);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * bench_dir - Directory operation rates
+ * Creates files in a fresh directory, looks each one up, lists the
+ * directory and removes the files again
+ * Usage: bench_dir [directory] [number of files]
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define LIST_PASSES 50
+
+static char dir_path[128];
+
+static void file_path(char *buf, size_t size, int i) {
+    snprintf(buf, size, "%s/f%05d", dir_path, i);
+}
+
+// Read the whole directory; returns the number of entries
+static int list_once(void) {
+    int fd = open(dir_path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    long buf[512];
+    int entries = 0;
+    ssize_t nread;
+    while ((nread = getdents(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t pos = 0; pos < nread; ) {
+            struct dirent *entry = (struct dirent *)((char *)buf + pos);
+            entries++;
+            pos += entry->d_reclen;
+        }
+    }
+    close(fd);
+    return entries;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = (argc > 1) ? argv[1] : "/tmp";
+    int count = bench_arg_iters(argc, argv, 2, 500);
+    
+    snprintf(dir_path, sizeof(dir_path), "%s/bench_dir.%d", dir, getpid());
+    if (mkdir(dir_path, 0755) != 0) {
+        fprintf(stderr, "bench_dir: cannot create %s\n", dir_path);
+        return 1;
+    }
+    
+    char params[96];
+    snprintf(params, sizeof(params), "fs=%s files=%d", dir, count);
+    char path[160];
+    bench_t b;
+    
+    if (bench_init(&b, "dir.create", params, count) == 0) {
+        for (int i = 0; i < count; i++) {
+            file_path(path, sizeof(path), i);
+            unsigned long start = rdtime();
+            int fd = open(path, O_WRONLY | O_CREAT, 0644);
+            if (fd < 0) {
+                fprintf(stderr, "bench_dir: cannot create %s\n", path);
+                count = i;
+                break;
+            }
+            close(fd);
+            bench_record(&b, rdtime() - start);
+        }
+        bench_report(&b);
+    }
+    
+    if (bench_init(&b, "dir.lookup", params, count) == 0) {
+        // Visit the names in a scattered order
+        for (int i = 0; i < count; i++) {
+            file_path(path, sizeof(path), (int)(((unsigned long)i * 7919) % count));
+            struct stat st;
+            unsigned long start = rdtime();
+            if (stat(path, &st) != 0) {
+                fprintf(stderr, "bench_dir: cannot find %s\n", path);
+                break;
+            }
+            bench_record(&b, rdtime() - start);
+        }
+        bench_report(&b);
+    }
+    
+    // One sample per pass over the directory, reported per entry
+    if (bench_init(&b, "dir.list", params, LIST_PASSES) == 0) {
+        int entries = list_once();
+        b.ops_per_sample = (entries > 0) ? entries : 1;
+        for (int pass = 0; pass < LIST_PASSES && entries > 0; pass++) {
+            unsigned long start = rdtime();
+            list_once();
+            bench_record(&b, rdtime() - start);
+        }
+        bench_report(&b);
+    }
+    
+    if (bench_init(&b, "dir.unlink", params, count) == 0) {
+        for (int i = 0; i < count; i++) {
+            file_path(path, sizeof(path), i);
+            unsigned long start = rdtime();
+            if (unlink(path) != 0) {
+                fprintf(stderr, "bench_dir: cannot remove %s\n", path);
+                break;
+            }
+            bench_record(&b, rdtime() - start);
+        }
+        bench_report(&b);
+    }
+    
+    rmdir(dir_path);
+    return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * bench_fault - Cost of bringing in a page
+ * Maps anonymous memory, touches every page and unmaps it again, and
+ * reports the time per page. The kernel populates mappings in mmap rather
+ * than on first touch, so this is the work a page fault would do (a zeroed
+ * page and a page table entry), paid up front
+ * Usage: bench_fault [iterations]
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <sys/mman.h>
+
+#define PAGE_SIZE 4096
+
+static void run(int pages, int iters) {
+    char params[32];
+    snprintf(params, sizeof(params), "pages=%d", pages);
+    
+    bench_t b;
+    if (bench_init(&b, "fault.anon_page", params, iters) != 0) {
+        return;
+    }
+    b.ops_per_sample = pages;
+    
+    size_t length = (size_t)pages * PAGE_SIZE;
+    for (int i = 0; i < iters; i++) {
+        unsigned long start = rdtime();
+        char *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "bench_fault: mmap of %d pages failed\n", pages);
+            break;
+        }
+        for (size_t off = 0; off < length; off += PAGE_SIZE) {
+            p[off] = 1;
+        }
+        munmap(p, length);
+        bench_record(&b, rdtime() - start);
+    }
+    bench_report(&b);
+}
+
+int main(int argc, char **argv) {
+    int iters = bench_arg_iters(argc, argv, 1, 1000);
+    
+    run(1, iters);
+    run(16, iters);
+    run(256, iters / 10 > 0 ? iters / 10 : 1);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * bench_file - File read and write throughput
+ * Sequential and random reads and writes of one file at several block
+ * sizes; every call is one sample. Sequential writes start from an empty
+ * file each pass, so they include block allocation; random writes
+ * overwrite blocks already there
+ * Usage: bench_file [directory] [file size in KiB]
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define MIN_SAMPLES 256
+
+static const size_t block_sizes[] = { 512, 4096, 65536 };
+
+static unsigned long rng_state = 0x2545f4914f6cdd1dUL;
+
+static unsigned long rng(void) {
+    // xorshift64
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void run(const char *dir, const char *path, size_t file_size, size_t bs, char *buf) {
+    size_t blocks = file_size / bs;
+    int passes = (blocks >= MIN_SAMPLES) ? 1 : (int)((MIN_SAMPLES + blocks - 1) / blocks);
+    int samples = (int)blocks * passes;
+    
+    char params[96];
+    snprintf(params, sizeof(params), "fs=%s bs=%lu", dir, (unsigned long)bs);
+    
+    bench_t b;
+    
+    // Sequential write into an empty file
+    if (bench_init(&b, "file.seq_write", params, samples) != 0) {
+        return;
+    }
+    b.bytes_per_op = bs;
+    for (int pass = 0; pass < passes; pass++) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "bench_file: cannot create %s\n", path);
+            free(b.samples);
+            return;
+        }
+        for (size_t i = 0; i < blocks; i++) {
+            unsigned long start = rdtime();
+            if (write(fd, buf, bs) != (ssize_t)bs) {
+                fprintf(stderr, "bench_file: write failed\n");
+                break;
+            }
+            bench_record(&b, rdtime() - start);
+        }
+        close(fd);
+    }
+    bench_report(&b);
+    
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "bench_file: cannot open %s\n", path);
+        return;
+    }
+    
+    // Sequential read
+    if (bench_init(&b, "file.seq_read", params, samples) == 0) {
+        b.bytes_per_op = bs;
+        for (int pass = 0; pass < passes; pass++) {
+            lseek(fd, 0, SEEK_SET);
+            for (size_t i = 0; i < blocks; i++) {
+                unsigned long start = rdtime();
+                if (read(fd, buf, bs) != (ssize_t)bs) {
+                    fprintf(stderr, "bench_file: read failed\n");
+                    break;
+                }
+                bench_record(&b, rdtime() - start);
+            }
+        }
+        bench_report(&b);
+    }
+    
+    // Random reads and overwrites of whole blocks
+    if (bench_init(&b, "file.rand_read", params, samples) == 0) {
+        b.bytes_per_op = bs;
+        for (int i = 0; i < samples; i++) {
+            off_t offset = (off_t)(rng() % blocks) * bs;
+            unsigned long start = rdtime();
+            if (pread(fd, buf, bs, offset) != (ssize_t)bs) {
+                fprintf(stderr, "bench_file: pread failed\n");
+                break;
+            }
+            bench_record(&b, rdtime() - start);
+        }
+        bench_report(&b);
+    }
+    
+    if (bench_init(&b, "file.rand_write", params, samples) == 0) {
+        b.bytes_per_op = bs;
+        for (int i = 0; i < samples; i++) {
+            off_t offset = (off_t)(rng() % blocks) * bs;
+            unsigned long start = rdtime();
+            if (pwrite(fd, buf, bs, offset) != (ssize_t)bs) {
+                fprintf(stderr, "bench_file: pwrite failed\n");
+                break;
+            }
+            bench_record(&b, rdtime() - start);
+        }
+        bench_report(&b);
+    }
+    
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    const char *dir = (argc > 1) ? argv[1] : "/tmp";
+    size_t file_size = (size_t)bench_arg_iters(argc, argv, 2, 1024) * 1024;
+    
+    char path[128];
+    snprintf(path, sizeof(path), "%s/bench_file.%d", dir, getpid());
+    
+    size_t max_bs = block_sizes[sizeof(block_sizes) / sizeof(block_sizes[0]) - 1];
+    if (file_size < max_bs) {
+        file_size = max_bs;
+    }
+    char *buf = malloc(max_bs);
+    if (!buf) {
+        fprintf(stderr, "bench_file: out of memory\n");
+        return 1;
+    }
+    memset(buf, 0xa5, max_bs);
+    
+    for (size_t i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++) {
+        run(dir, path, file_size, block_sizes[i], buf);
+    }
+    
+    unlink(path);
+    free(buf);
+    return 0;
+}
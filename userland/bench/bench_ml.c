@@ -0,0 +1,401 @@
+/*
+ * bench_ml - Neural network kernels and memory bandwidth
+ * Times the libml kernels with the scalar and, when the hart has V, the
+ * vector implementation (checking that the two agree), a STREAM-style
+ * copy/scale/add/triad at sizes from cache-resident to well past it, and
+ * finally checks that FP and vector registers survive preemption while
+ * another process uses them too
+ * Usage: bench_ml [iterations] [path of this program]
+ */
+
+#include "bench.h"
+#include <ml.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/auxv.h>
+
+#define GEMM_N       128                // Square matrix multiply size
+#define VEC_N        4096               // Element-wise layer length
+#define HOLD_SECONDS 2                  // Register check, about 20 time slices
+
+static const ml_conv2d_t conv = {
+    .in_channels = 16, .height = 32, .width = 32,
+    .out_channels = 32, .kernel_h = 3, .kernel_w = 3, .stride = 1, .pad = 1,
+};
+
+// Operands, shared by all kernels and sized for the largest
+static float *fa, *fb, *fc, *fref, *work;
+static int8_t *qa, *qb;
+static int32_t *qc, *qref;
+
+static unsigned long rng_state = 0x9e3779b97f4a7c15UL;
+
+static float random_float(void) {
+    // xorshift64, scaled to [-1, 1)
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (float)(long)(rng_state >> 40) / (1L << 23) - 1.0f;
+}
+
+static int setup(void) {
+    size_t taps = (size_t)conv.in_channels * conv.kernel_h * conv.kernel_w;
+    size_t out = (size_t)conv.out_channels * ml_conv2d_out_h(&conv) * ml_conv2d_out_w(&conv);
+    size_t big = (out > GEMM_N * GEMM_N) ? out : GEMM_N * GEMM_N;
+    
+    fa = malloc(big * sizeof(float));
+    fb = malloc(big * sizeof(float));
+    fc = malloc(big * sizeof(float));
+    fref = malloc(big * sizeof(float));
+    work = malloc(ml_conv2d_work_size(&conv) * sizeof(float));
+    qa = malloc(GEMM_N * GEMM_N);
+    qb = malloc(GEMM_N * GEMM_N);
+    qc = malloc(GEMM_N * GEMM_N * sizeof(int32_t));
+    qref = malloc(GEMM_N * GEMM_N * sizeof(int32_t));
+    if (!fa || !fb || !fc || !fref || !work || !qa || !qb || !qc || !qref) {
+        fprintf(stderr, "bench_ml: cannot allocate operands\n");
+        return -1;
+    }
+    if (taps * conv.out_channels > big) {
+        fprintf(stderr, "bench_ml: weights do not fit\n");
+        return -1;
+    }
+    
+    for (size_t i = 0; i < big; i++) {
+        fa[i] = random_float();
+        fb[i] = random_float();
+    }
+    for (size_t i = 0; i < GEMM_N * GEMM_N; i++) {
+        qa[i] = (int8_t)(random_float() * 127);
+        qb[i] = (int8_t)(random_float() * 127);
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------------
+ * Kernels
+ * ------------------------------------------------------------------- */
+
+static void op_sgemm(void) {
+    ml_sgemm(GEMM_N, GEMM_N, GEMM_N, fa, GEMM_N, fb, GEMM_N, fc, GEMM_N);
+}
+
+static void op_gemm_s8(void) {
+    ml_gemm_s8(GEMM_N, GEMM_N, GEMM_N, qa, GEMM_N, qb, GEMM_N, qc, GEMM_N);
+}
+
+static void op_conv2d(void) {
+    // fa is the image, fb the weights and the bias
+    ml_conv2d(&conv, fa, fb, fb, fc, work);
+}
+
+static void op_softmax(void) {
+    ml_softmax(fa, fc, VEC_N);
+}
+
+static void op_layernorm(void) {
+    ml_layernorm(fa, fc, VEC_N, fb, fb + VEC_N, 1e-5f);
+}
+
+// The int8 results fill the first VEC_N bytes of fc, the scale follows
+#define QUANT_SCALE (VEC_N / sizeof(float))
+
+static void op_quantize(void) {
+    fc[QUANT_SCALE] = ml_quantize_s8(fa, (int8_t *)fc, VEC_N);
+}
+
+static void op_dequantize(void) {
+    ml_dequantize_s8(qa, fc, VEC_N, 0.01f);
+}
+
+// How the vector result is compared with the scalar one
+typedef enum {
+    CHECK_FLOAT,                       // Within 1e-4 of the largest value
+    CHECK_INT32,                       // Equal (qc)
+    CHECK_QUANT,                       // Within one step, same scale
+} check_t;
+
+/**
+ * A kernel and what one call of it does
+ */
+typedef struct {
+    const char *name;
+    const char *params;
+    void (*run)(void);
+    check_t check;
+    size_t outputs;                    // Floats of fc (int32s of qc) to compare
+    unsigned long flops;
+    size_t bytes;                      // Memory read and written
+    int iters_div;                     // Fewer iterations for the slow ones
+} kernel_t;
+
+#define CONV_PIXELS (32 * 32)
+#define CONV_TAPS   (16 * 3 * 3)
+
+static const kernel_t kernels[] = {
+    { "ml.sgemm", "n=128", op_sgemm, CHECK_FLOAT, GEMM_N * GEMM_N,
+      2UL * GEMM_N * GEMM_N * GEMM_N, 3 * GEMM_N * GEMM_N * sizeof(float), 10 },
+    { "ml.gemm_s8", "n=128", op_gemm_s8, CHECK_INT32, GEMM_N * GEMM_N,
+      2UL * GEMM_N * GEMM_N * GEMM_N, GEMM_N * GEMM_N * (2 + sizeof(int32_t)), 10 },
+    { "ml.conv2d", "n=16x32x32", op_conv2d, CHECK_FLOAT, 32 * CONV_PIXELS,
+      2UL * 32 * CONV_PIXELS * CONV_TAPS, 0, 10 },
+    { "ml.softmax", "n=4096", op_softmax, CHECK_FLOAT, VEC_N,
+      0, 2 * VEC_N * sizeof(float), 1 },
+    { "ml.layernorm", "n=4096", op_layernorm, CHECK_FLOAT, VEC_N,
+      0, 4 * VEC_N * sizeof(float), 1 },
+    { "ml.quantize", "n=4096", op_quantize, CHECK_QUANT, QUANT_SCALE + 1,
+      0, VEC_N * (sizeof(float) + 1), 1 },
+    { "ml.dequantize", "n=4096", op_dequantize, CHECK_FLOAT, VEC_N,
+      0, VEC_N * (sizeof(float) + 1), 1 },
+};
+
+static int results_agree(const kernel_t *k) {
+    if (k->check == CHECK_INT32) {
+        return memcmp(qc, qref, k->outputs * sizeof(int32_t)) == 0;
+    }
+    if (k->check == CHECK_QUANT) {
+        // Exact halves round to even in one and away from zero in the other
+        const int8_t *q = (const int8_t *)fc, *r = (const int8_t *)fref;
+        for (int i = 0; i < VEC_N; i++) {
+            if (q[i] - r[i] > 1 || r[i] - q[i] > 1) {
+                return 0;
+            }
+        }
+        return fc[QUANT_SCALE] == fref[QUANT_SCALE];
+    }
+    
+    float max = 0, diff = 0;
+    for (size_t i = 0; i < k->outputs; i++) {
+        float r = fref[i] < 0 ? -fref[i] : fref[i];
+        float d = fc[i] - fref[i];
+        d = d < 0 ? -d : d;
+        if (r > max) {
+            max = r;
+        }
+        if (d > diff) {
+            diff = d;
+        }
+    }
+    return diff <= max * 1e-4f;
+}
+
+static void save_reference(const kernel_t *k) {
+    if (k->check == CHECK_INT32) {
+        memcpy(qref, qc, k->outputs * sizeof(int32_t));
+    } else {
+        memcpy(fref, fc, k->outputs * sizeof(float));
+    }
+}
+
+static void run_kernel(const kernel_t *k, int vector, int iters) {
+    char params[48];
+    snprintf(params, sizeof(params), "impl=%s %s", vector ? "rvv" : "scalar", k->params);
+    
+    // The scalar result is the reference for the vector one
+    k->run();
+    if (!vector) {
+        save_reference(k);
+    } else if (!results_agree(k)) {
+        printf("BENCH name=%s %s error=mismatch\n", k->name, params);
+        return;
+    }
+    
+    bench_t b;
+    if (bench_init(&b, k->name, params, iters) != 0) {
+        return;
+    }
+    b.flops_per_op = k->flops;
+    b.bytes_per_op = k->bytes;
+    for (int i = 0; i < iters; i++) {
+        unsigned long start = rdtime();
+        k->run();
+        bench_record(&b, rdtime() - start);
+    }
+    bench_report(&b);
+}
+
+/* ---------------------------------------------------------------------
+ * Memory bandwidth
+ * ------------------------------------------------------------------- */
+
+// The four STREAM loops on arrays of n doubles; bytes counts reads and
+// writes as STREAM does
+static void run_stream(size_t n, int iters) {
+    double *x = malloc(n * sizeof(double));
+    double *y = malloc(n * sizeof(double));
+    double *z = malloc(n * sizeof(double));
+    if (!x || !y || !z) {
+        fprintf(stderr, "bench_ml: cannot allocate %lu KiB arrays\n",
+                (unsigned long)(n * sizeof(double) / 1024));
+        free(x);
+        free(y);
+        free(z);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        x[i] = 1.0;
+        y[i] = 2.0;
+        z[i] = 0.0;
+    }
+    
+    static const char *const names[] = {
+        "stream.copy", "stream.scale", "stream.add", "stream.triad"
+    };
+    static const int arrays[] = { 2, 2, 3, 3 };
+    const double s = 3.0;
+    char params[32];
+    snprintf(params, sizeof(params), "size_kib=%lu", (unsigned long)(n * sizeof(double) / 1024));
+    
+    for (int kind = 0; kind < 4; kind++) {
+        bench_t b;
+        if (bench_init(&b, names[kind], params, iters) != 0) {
+            break;
+        }
+        b.bytes_per_op = arrays[kind] * n * sizeof(double);
+        if (kind >= 1) {
+            b.flops_per_op = (kind == 3) ? 2 * n : n;
+        }
+        for (int i = 0; i < iters; i++) {
+            unsigned long start = rdtime();
+            switch (kind) {
+                case 0:
+                    for (size_t j = 0; j < n; j++) {
+                        z[j] = x[j];
+                    }
+                    break;
+                case 1:
+                    for (size_t j = 0; j < n; j++) {
+                        y[j] = s * z[j];
+                    }
+                    break;
+                case 2:
+                    for (size_t j = 0; j < n; j++) {
+                        z[j] = x[j] + y[j];
+                    }
+                    break;
+                default:
+                    for (size_t j = 0; j < n; j++) {
+                        x[j] = y[j] + s * z[j];
+                    }
+                    break;
+            }
+            bench_record(&b, rdtime() - start);
+        }
+        bench_report(&b);
+    }
+    
+    free(x);
+    free(y);
+    free(z);
+}
+
+/* ---------------------------------------------------------------------
+ * Register state across context switches
+ * ------------------------------------------------------------------- */
+
+/**
+ * Load pattern into some FP and (if vector) vector registers and check
+ * them until the time CSR reaches deadline. Other processes are
+ * preempted in and out meanwhile; a lost or swapped register shows up
+ * as a changed value, and a lost vl or vtype as a changed vl.
+ * @return 1 if every check passed
+ */
+static int hold_registers(unsigned long pattern, unsigned long deadline, int vector) {
+    unsigned long bad;
+    asm volatile(
+        ".option push\n"
+        ".option arch, +v\n"
+        "fmv.d.x fs1, %[p]\n"
+        "fmv.d.x ft11, %[p]\n"
+        "beqz %[v], 1f\n"
+        "vsetvli t0, zero, e64, m1, ta, ma\n"
+        "vmv.v.x v1, %[p]\n"
+        "vmv.v.x v31, %[p]\n"
+        "1:\n"
+        "li %[bad], 1\n"
+        "fmv.x.d t1, fs1\n"
+        "bne t1, %[p], 3f\n"
+        "fmv.x.d t1, ft11\n"
+        "bne t1, %[p], 3f\n"
+        "beqz %[v], 2f\n"
+        "csrr t1, vl\n"
+        "bne t1, t0, 3f\n"
+        "vmv.x.s t1, v1\n"
+        "bne t1, %[p], 3f\n"
+        "addi t2, t0, -1\n"
+        "vslidedown.vx v2, v31, t2\n"          // Last element of v31
+        "vmv.x.s t1, v2\n"
+        "bne t1, %[p], 3f\n"
+        "2:\n"
+        "rdtime t1\n"
+        "bltu t1, %[d], 1b\n"
+        "li %[bad], 0\n"
+        "3:\n"
+        ".option pop\n"
+        : [bad] "=&r"(bad)
+        : [p] "r"(pattern), [d] "r"(deadline), [v] "r"(vector)
+        : "t0", "t1", "t2", "fs1", "ft11", "memory");
+    return bad == 0;
+}
+
+static void run_context(const char *self, int vector) {
+    const char *regs = vector ? "fp_v" : "fp";
+    unsigned long deadline = rdtime() + HOLD_SECONDS * BENCH_TIMEBASE;
+    
+    // The child holds the complement of the parent's pattern
+    char deadline_arg[24];
+    snprintf(deadline_arg, sizeof(deadline_arg), "%lu", deadline);
+    char *const child_argv[] = { (char *)self, "-hold", deadline_arg, NULL };
+    pid_t pid = execve(self, child_argv, NULL);
+    if (pid < 0) {
+        printf("BENCH name=ml.context regs=%s error=no_child\n", regs);
+        return;
+    }
+    
+    int ok = hold_registers(0x5a5a5a5a12345678UL, deadline, vector);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    
+    if (!ok) {
+        printf("BENCH name=ml.context regs=%s error=corrupted\n", regs);
+    } else if (((status >> 8) & 0xff) != 0) {
+        printf("BENCH name=ml.context regs=%s error=child_corrupted\n", regs);
+    } else {
+        printf("BENCH name=ml.context regs=%s seconds=%d status=ok\n", regs, HOLD_SECONDS);
+    }
+}
+
+int main(int argc, char **argv) {
+    int vector = (getauxval(AT_HWCAP) & HWCAP_ISA_V) != 0;
+    
+    if (argc > 2 && strcmp(argv[1], "-hold") == 0) {
+        unsigned long deadline = strtoul(argv[2], NULL, 10);
+        return hold_registers(~0x5a5a5a5a12345678UL, deadline, vector) ? 0 : 1;
+    }
+    
+    int iters = bench_arg_iters(argc, argv, 1, 50);
+    const char *self = (argc > 2) ? argv[2] : "/bin/bench_ml";
+    
+    if (setup() != 0) {
+        return 1;
+    }
+    
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        int n = iters / kernels[k].iters_div;
+        for (int v = 0; v <= vector; v++) {
+            ml_use_vector(v);
+            run_kernel(&kernels[k], v, n > 0 ? n : 1);
+        }
+    }
+    
+    // On hardware 16 KiB stays in L1 and 4 MiB spills most L2s; QEMU has
+    // no caches, but each 4 MiB array spans 1024 pages of its software TLB
+    run_stream(2 * 1024, iters);
+    run_stream(32 * 1024, iters);
+    run_stream(512 * 1024, iters / 10 > 0 ? iters / 10 : 1);
+    
+    run_context(self, vector);
+    return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * bench_spawn - Process creation latency
+ * Times execve of this program with -exit up to the parent's waitpid
+ * returning. execve loads the program into a new child process, so this
+ * covers ELF loading, process setup, exit and reaping
+ * Usage: bench_spawn [iterations] [path of this program]
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "-exit") == 0) {
+        return 0;
+    }
+    
+    int iters = bench_arg_iters(argc, argv, 1, 200);
+    const char *self = (argc > 2) ? argv[2] : "/bin/bench_spawn";
+    
+    bench_t b;
+    if (bench_init(&b, "spawn.exec_exit", NULL, iters) != 0) {
+        return 1;
+    }
+    
+    char *const child_argv[] = { (char *)self, "-exit", NULL };
+    for (int i = 0; i < iters; i++) {
+        unsigned long start = rdtime();
+        pid_t pid = execve(self, child_argv, NULL);
+        if (pid < 0) {
+            fprintf(stderr, "bench_spawn: cannot execute %s\n", self);
+            break;
+        }
+        waitpid(pid, NULL, 0);
+        bench_record(&b, rdtime() - start);
+    }
+    bench_report(&b);
+    return 0;
+}
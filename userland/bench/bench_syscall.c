@@ -0,0 +1,31 @@
+/*
+ * bench_syscall - Null system call latency
+ * Times getppid, which does no work in the kernel beyond the trap
+ * Usage: bench_syscall [iterations]
+ */
+
+#include "bench.h"
+#include <unistd.h>
+
+// Calls per sample, enough to rise above the timer's resolution
+#define CALLS_PER_SAMPLE 16
+
+int main(int argc, char **argv) {
+    int iters = bench_arg_iters(argc, argv, 1, 10000);
+    
+    bench_t b;
+    if (bench_init(&b, "syscall.null", NULL, iters) != 0) {
+        return 1;
+    }
+    b.ops_per_sample = CALLS_PER_SAMPLE;
+    
+    for (int i = 0; i < iters; i++) {
+        unsigned long start = rdtime();
+        for (int j = 0; j < CALLS_PER_SAMPLE; j++) {
+            getppid();
+        }
+        bench_record(&b, rdtime() - start);
+    }
+    bench_report(&b);
+    return 0;
+}
@@ -1,69 +1,45 @@
 /*
  * cat - Concatenate files and print to stdout
- * Simple implementation using open/read/write syscalls
+ * Files are moved with sendfile, so the data never passes through a user
+ * buffer; with no arguments, stdin is copied through stdio.
  */
 
-// ThunderOS syscall numbers
-#define SYS_EXIT 0
-#define SYS_WRITE 1
-#define SYS_READ 2
-#define SYS_OPEN 13
-#define SYS_CLOSE 14
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
 
-#define AT_FDCWD -100
-#define O_RDONLY 0
-
-typedef unsigned long size_t;
-typedef long ssize_t;
-
-// System call wrapper
-static inline long syscall(long n, long a0, long a1, long a2) {
-    register long syscall_num asm("a7") = n;
-    register long arg0 asm("a0") = a0;
-    register long arg1 asm("a1") = a1;
-    register long arg2 asm("a2") = a2;
+// Copy one file to stdout inside the kernel
+static int cat_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "cat: %s: No such file or directory\n", path);
+        return 1;
+    }
     
-    asm volatile("ecall"
-                 : "+r"(arg0)
-                 : "r"(syscall_num), "r"(arg1), "r"(arg2)
-                 : "memory");
+    // Anything printed before must come out first
+    fflush(stdout);
+    while (1) {
+        ssize_t nsent = sendfile(STDOUT_FILENO, fd, NULL, 65536);
+        if (nsent <= 0) break;
+    }
     
-    return arg0;
-}
-
-// Helper functions
-static size_t strlen(const char *s) {
-    size_t len = 0;
-    while (s[len]) len++;
-    return len;
+    close(fd);
+    return 0;
 }
 
-static void print(const char *s) {
-    syscall(SYS_WRITE, 1, (long)s, strlen(s));
-}
-
-void _start(void) {
-    char buf[512];
-    
-    // For now, cat just reads test.txt as a demo
-    const char *filename = "test.txt";
-    
-    int fd = syscall(SYS_OPEN, (long)filename, O_RDONLY, 0);
-    if (fd < 0) {
-        print("cat: ");
-        print(filename);
-        print(": No such file or directory\n");
-        syscall(SYS_EXIT, 1, 0, 0);
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        static char buf[BUFSIZ];
+        size_t nread;
+        while ((nread = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+            fwrite(buf, 1, nread, stdout);
+        }
+        return 0;
     }
     
-    // Read and write file contents
-    while (1) {
-        long nread = syscall(SYS_READ, fd, (long)buf, sizeof(buf));
-        if (nread <= 0) break;
-        
-        syscall(SYS_WRITE, 1, (long)buf, nread);
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        status |= cat_file(argv[i]);
     }
-    
-    syscall(SYS_CLOSE, fd, 0, 0);
-    syscall(SYS_EXIT, 0, 0, 0);
+    return status;
 }
@@ -0,0 +1,94 @@
+/*
+ * defrag - Defragment ext2 files online
+ * Moves each file of the root directory into as few runs of blocks as
+ * free space allows, then reports free space per block group
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+// ext2 ioctl requests (argument size in the upper 16 bits)
+#define IOC(nr, size) (((unsigned int)(size) << 16) | (nr))
+#define EXT2_IOC_GETFRAG   IOC(0x6601, sizeof(struct frag_info))
+#define EXT2_IOC_GROUPFRAG IOC(0x6602, sizeof(struct group_frag))
+#define EXT2_IOC_DEFRAG    IOC(0x6603, sizeof(struct frag_info))
+
+// Fragmentation of one file
+struct frag_info {
+    unsigned int data_blocks;
+    unsigned int meta_blocks;
+    unsigned int extents;
+    unsigned int best_extents;
+};
+
+// Free space of one block group
+struct group_frag {
+    unsigned int group;
+    unsigned int groups;
+    unsigned int free_blocks;
+    unsigned int free_extents;
+    unsigned int largest_free;
+};
+
+// Defragment one file and report its extents before and after
+static void defrag_file(const char *name) {
+    char path[260];
+    if (snprintf(path, sizeof(path), "/%s", name) >= (int)sizeof(path)) return;
+    
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "defrag: cannot open %s\n", path);
+        return;
+    }
+    
+    struct frag_info before, after;
+    if (ioctl(fd, EXT2_IOC_GETFRAG, &before) < 0 ||
+        ioctl(fd, EXT2_IOC_DEFRAG, &after) < 0) {
+        fprintf(stderr, "defrag: %s: failed\n", path);
+        close(fd);
+        return;
+    }
+    
+    printf("%s: %u blocks, %u -> %u extents\n",
+           path, before.data_blocks, before.extents, after.extents);
+    
+    close(fd);
+}
+
+int main(void) {
+    // Work on the root directory
+    int dir = open("/", O_RDONLY);
+    if (dir < 0) {
+        fprintf(stderr, "defrag: cannot open /\n");
+        return 1;
+    }
+    
+    long buf[128];
+    while (1) {
+        ssize_t nread = getdents(dir, buf, sizeof(buf));
+        if (nread <= 0) break;
+        
+        for (ssize_t pos = 0; pos < nread; ) {
+            struct dirent *entry = (struct dirent *)((char *)buf + pos);
+            if (entry->d_type == DT_FILE) {
+                defrag_file(entry->d_name);
+            }
+            pos += entry->d_reclen;
+        }
+    }
+    
+    // Free space left behind, per block group
+    struct group_frag frag;
+    frag.group = 0;
+    while (ioctl(dir, EXT2_IOC_GROUPFRAG, &frag) == 0) {
+        printf("group %u: %u free blocks in %u runs, largest %u\n",
+               frag.group, frag.free_blocks, frag.free_extents, frag.largest_free);
+        
+        if (++frag.group >= frag.groups) break;
+    }
+    
+    close(dir);
+    return 0;
+}
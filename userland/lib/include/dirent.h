@@ -0,0 +1,28 @@
+/*
+ * dirent.h - Directory entries
+ */
+
+#ifndef _DIRENT_H
+#define _DIRENT_H
+
+#include <sys/types.h>
+
+// Directory entry types (d_type)
+#define DT_FILE 1
+#define DT_DIR  2
+
+// Directory entry as returned by getdents
+struct dirent {
+    unsigned int d_ino;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/**
+ * Read as many directory entries as fit in buf
+ * @return Bytes filled, 0 at the end of the directory, -1 on error
+ */
+ssize_t getdents(int fd, void *buf, size_t count);
+
+#endif // _DIRENT_H
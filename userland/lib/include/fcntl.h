@@ -0,0 +1,23 @@
+/*
+ * fcntl.h - Opening files
+ */
+
+#ifndef _FCNTL_H
+#define _FCNTL_H
+
+#include <sys/types.h>
+
+// Open flags, as the kernel's VFS defines them
+#define O_RDONLY  0x0000
+#define O_WRONLY  0x0001
+#define O_RDWR    0x0002
+#define O_ACCMODE 0x0003
+#define O_CREAT   0x0040
+#define O_TRUNC   0x0200
+#define O_APPEND  0x0400
+#define O_NONBLOCK 0x0800
+#define O_CLOEXEC 0x80000
+
+int open(const char *path, int flags, ...);
+
+#endif // _FCNTL_H
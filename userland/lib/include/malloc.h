@@ -0,0 +1,29 @@
+/*
+ * malloc.h - Heap statistics
+ */
+
+#ifndef _MALLOC_H
+#define _MALLOC_H
+
+#include <stdlib.h>
+
+/**
+ * State of the heap, for benchmarks and leak checks
+ */
+struct mallinfo {
+    size_t mapped;                     // Bytes currently mapped from the kernel
+    size_t peak_mapped;                // Most bytes ever mapped at once
+    size_t in_use;                     // Bytes in allocated blocks, by block size
+    size_t cached;                     // Bytes in free blocks held by the thread cache
+    size_t mmap_calls;                 // mmap system calls made
+    size_t munmap_calls;               // munmap system calls made
+};
+
+struct mallinfo mallinfo(void);
+
+/**
+ * Bytes usable in an allocated block, at least the size asked for
+ */
+size_t malloc_usable_size(void *ptr);
+
+#endif // _MALLOC_H
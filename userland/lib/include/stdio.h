@@ -0,0 +1,79 @@
+/*
+ * stdio.h - Buffered streams
+ *
+ * Streams collect output in a buffer and write it with one system call
+ * when the buffer fills, instead of one call per print. Files and pipes
+ * are fully buffered. stdout is line buffered when it is the console, so
+ * prompts and progress lines still appear as they are printed; stderr is
+ * unbuffered. Everything still buffered is written out by exit() or by
+ * returning from main().
+ */
+
+#ifndef _STDIO_H
+#define _STDIO_H
+
+#include <stdarg.h>
+#include <sys/types.h>
+
+#define BUFSIZ    4096
+#define FOPEN_MAX 4                    // Streams open at once, besides the standard three
+#define EOF       (-1)
+
+// Buffering modes for setvbuf
+#define _IOFBF 0                       // Full: write when the buffer fills
+#define _IOLBF 1                       // Line: also write at each newline
+#define _IONBF 2                       // None: write at once
+
+/**
+ * An open stream
+ */
+typedef struct _FILE {
+    int fd;
+    int flags;                         // State bits, private to the library
+    int mode;                          // _IOFBF, _IOLBF or _IONBF
+    unsigned char *buf;
+    size_t size;                       // Buffer capacity
+    size_t pos;                        // Next byte to read, or bytes waiting to be written
+    size_t len;                        // Bytes in the buffer when reading
+} FILE;
+
+extern FILE *stdin;
+extern FILE *stdout;
+extern FILE *stderr;
+
+FILE *fopen(const char *path, const char *mode);
+FILE *fdopen(int fd, const char *mode);
+int fclose(FILE *stream);
+int fflush(FILE *stream);
+int setvbuf(FILE *stream, char *buf, int mode, size_t size);
+int fileno(FILE *stream);
+int feof(FILE *stream);
+int ferror(FILE *stream);
+void clearerr(FILE *stream);
+
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream);
+int fgetc(FILE *stream);
+char *fgets(char *s, int size, FILE *stream);
+int fputc(int c, FILE *stream);
+int fputs(const char *s, FILE *stream);
+int puts(const char *s);
+
+#define getc(stream)    fgetc(stream)
+#define putc(c, stream) fputc((c), (stream))
+#define getchar()       fgetc(stdin)
+#define putchar(c)      fputc((c), stdout)
+
+/*
+ * Formatting supports the flags '-', '0', '+', ' ' and '#', field width
+ * and precision (also given as '*'), the length modifiers hh, h, l, ll
+ * and z, and the conversions d, i, u, x, X, o, c, s, p and %.
+ */
+int printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+int fprintf(FILE *stream, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int snprintf(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+int vprintf(const char *fmt, va_list ap);
+int vfprintf(FILE *stream, const char *fmt, va_list ap);
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
+
+#endif // _STDIO_H
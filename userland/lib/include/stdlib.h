@@ -0,0 +1,27 @@
+/*
+ * stdlib.h - Process exit, memory allocation and number conversion
+ */
+
+#ifndef _STDLIB_H
+#define _STDLIB_H
+
+#include <stddef.h>
+
+#define EXIT_SUCCESS 0
+#define EXIT_FAILURE 1
+
+/**
+ * Flush stdio and end the process
+ */
+void exit(int status) __attribute__((noreturn));
+
+void *malloc(size_t size);
+void *calloc(size_t nmemb, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
+
+int atoi(const char *s);
+long strtol(const char *s, char **end, int base);
+unsigned long strtoul(const char *s, char **end, int base);
+
+#endif // _STDLIB_H
@@ -0,0 +1,22 @@
+/*
+ * sys/auxv.h - Hardware capabilities
+ */
+
+#ifndef _SYS_AUXV_H
+#define _SYS_AUXV_H
+
+#define AT_HWCAP 16
+
+// AT_HWCAP bits: one per ISA extension letter
+#define HWCAP_ISA(letter) (1UL << ((letter) - 'a'))
+#define HWCAP_ISA_F       HWCAP_ISA('f')
+#define HWCAP_ISA_D       HWCAP_ISA('d')
+#define HWCAP_ISA_V       HWCAP_ISA('v')
+
+/**
+ * Look up an auxiliary value
+ * @return The value, or 0 for types other than AT_HWCAP
+ */
+unsigned long getauxval(unsigned long type);
+
+#endif // _SYS_AUXV_H
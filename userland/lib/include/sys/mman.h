@@ -0,0 +1,33 @@
+/*
+ * sys/mman.h - Memory mappings
+ */
+
+#ifndef _SYS_MMAN_H
+#define _SYS_MMAN_H
+
+#include <sys/types.h>
+
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+#define PROT_EXEC     0x4
+
+#define MAP_SHARED    0x01
+#define MAP_PRIVATE   0x02
+#define MAP_ANONYMOUS 0x20
+
+#define MAP_FAILED    ((void *)-1)
+
+/**
+ * Map memory or a file
+ * Every page is mapped before the call returns; the kernel picks the
+ * address, so addr is only a hint.
+ * @return Address of the mapping, or MAP_FAILED
+ */
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+
+/**
+ * Unmap a page-aligned range, which may be part of a mapping
+ */
+int munmap(void *addr, size_t length);
+
+#endif // _SYS_MMAN_H
@@ -0,0 +1,29 @@
+/*
+ * sys/stat.h - File status and directories
+ */
+
+#ifndef _SYS_STAT_H
+#define _SYS_STAT_H
+
+#include <sys/types.h>
+
+// File types (st_type), the same values as d_type
+#define S_TYPE_FILE 1
+#define S_TYPE_DIR  2
+
+// File status as filled in by stat
+struct stat {
+    off_t st_size;
+    unsigned int st_type;
+    unsigned int __pad;
+};
+
+/**
+ * Look up a path
+ * @return 0 on success, -1 if it does not exist
+ */
+int stat(const char *path, struct stat *buf);
+
+int mkdir(const char *path, int mode);
+
+#endif // _SYS_STAT_H
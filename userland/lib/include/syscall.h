@@ -0,0 +1,76 @@
+/*
+ * syscall.h - Raw ThunderOS system calls
+ *
+ * The call number goes in a7 and up to six arguments in a0-a5; the result
+ * comes back in a0, with -1 meaning failure. Programs normally use the
+ * wrappers in unistd.h instead.
+ */
+
+#ifndef _SYSCALL_H
+#define _SYSCALL_H
+
+// ThunderOS syscall numbers (see include/kernel/syscall.h)
+#define SYS_EXIT        0
+#define SYS_WRITE       1
+#define SYS_READ        2
+#define SYS_GETPID      3
+#define SYS_SBRK        4
+#define SYS_SLEEP       5
+#define SYS_YIELD       6
+#define SYS_FORK        7
+#define SYS_WAIT        9
+#define SYS_GETPPID     10
+#define SYS_KILL        11
+#define SYS_GETTIME     12
+#define SYS_OPEN        13
+#define SYS_CLOSE       14
+#define SYS_LSEEK       15
+#define SYS_STAT        16
+#define SYS_MKDIR       17
+#define SYS_UNLINK      18
+#define SYS_RMDIR       19
+#define SYS_EXECVE      20
+#define SYS_FTRUNCATE   21
+#define SYS_DUP         23
+#define SYS_DUP2        24
+#define SYS_GETDENTS    25
+#define SYS_PREAD       26
+#define SYS_PWRITE      27
+#define SYS_READV       28
+#define SYS_WRITEV      29
+#define SYS_SENDFILE    31
+#define SYS_SYNC        32
+#define SYS_IOCTL       33
+#define SYS_PIPE        34
+#define SYS_MMAP        37
+#define SYS_MUNMAP      38
+#define SYS_GETHWCAP    59
+#define SYS_FSYNC       60
+
+// System call with up to six arguments
+static inline long __syscall6(long n, long a0, long a1, long a2,
+                              long a3, long a4, long a5) {
+    register long syscall_num asm("a7") = n;
+    register long arg0 asm("a0") = a0;
+    register long arg1 asm("a1") = a1;
+    register long arg2 asm("a2") = a2;
+    register long arg3 asm("a3") = a3;
+    register long arg4 asm("a4") = a4;
+    register long arg5 asm("a5") = a5;
+    
+    asm volatile("ecall"
+                 : "+r"(arg0)
+                 : "r"(syscall_num), "r"(arg1), "r"(arg2), "r"(arg3),
+                   "r"(arg4), "r"(arg5)
+                 : "memory");
+    
+    return arg0;
+}
+
+#define __syscall0(n)                   __syscall6((n), 0, 0, 0, 0, 0, 0)
+#define __syscall1(n, a)                __syscall6((n), (long)(a), 0, 0, 0, 0, 0)
+#define __syscall2(n, a, b)             __syscall6((n), (long)(a), (long)(b), 0, 0, 0, 0)
+#define __syscall3(n, a, b, c)          __syscall6((n), (long)(a), (long)(b), (long)(c), 0, 0, 0)
+#define __syscall4(n, a, b, c, d)       __syscall6((n), (long)(a), (long)(b), (long)(c), (long)(d), 0, 0)
+
+#endif // _SYSCALL_H
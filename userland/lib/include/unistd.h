@@ -0,0 +1,68 @@
+/*
+ * unistd.h - System call wrappers
+ *
+ * Each wrapper makes exactly one system call and returns its result;
+ * failures come back as -1.
+ */
+
+#ifndef _UNISTD_H
+#define _UNISTD_H
+
+#include <sys/types.h>
+
+#define STDIN_FILENO  0
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+ssize_t read(int fd, void *buf, size_t count);
+ssize_t write(int fd, const void *buf, size_t count);
+int close(int fd);
+off_t lseek(int fd, off_t offset, int whence);
+ssize_t pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
+int dup(int fd);
+int dup2(int oldfd, int newfd);
+int pipe(int fds[2]);
+int pipe2(int fds[2], int flags);      // flags: O_NONBLOCK, O_CLOEXEC
+int unlink(const char *path);
+int rmdir(const char *path);
+int ftruncate(int fd, off_t length);
+void sync(void);
+int fsync(int fd);
+int execve(const char *path, char *const argv[], char *const envp[]);
+pid_t fork(void);
+pid_t waitpid(pid_t pid, int *status, int options);
+pid_t getpid(void);
+pid_t getppid(void);
+int sched_yield(void);
+void _exit(int status) __attribute__((noreturn));
+
+/**
+ * Check whether a descriptor is the console
+ * @return 1 for the console, 0 for files, pipes and sockets
+ */
+int isatty(int fd);
+
+/**
+ * Copy up to count bytes from in_fd to out_fd inside the kernel
+ * @param offset Where to read in in_fd and updated past the data, or
+ *               NULL to read at in_fd's position
+ * @return Bytes copied, 0 at the end of in_fd, -1 on error
+ */
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+
+/**
+ * Milliseconds since boot
+ */
+unsigned long gettime(void);
+
+/**
+ * Filesystem-specific request on an open file
+ */
+int ioctl(int fd, unsigned int request, void *arg);
+
+#endif // _UNISTD_H
@@ -0,0 +1,460 @@
+/*
+ * malloc.c - Size-class heap allocator
+ *
+ * Memory comes from the kernel in 64 KiB spans, each aligned to its own
+ * size, so the span of any block is found by masking the pointer. A span
+ * is either a slab of equal blocks of one size class, or, for requests
+ * above SMALL_MAX, one large block mapped on its own and unmapped by free.
+ *
+ * Small blocks go through two layers:
+ *
+ *   cache    Per-thread free lists, one per class. malloc and free are a
+ *            list pop and push. An empty list is refilled with a batch of
+ *            blocks from the central layer; an overlong one gives a batch
+ *            back.
+ *   central  Per class, the spans that still have free blocks. A span
+ *            whose blocks have all come back is kept as the class's spare
+ *            or unmapped, so freed memory goes back to the kernel.
+ *
+ * Processes have one thread, so there is a single cache; current_cache()
+ * is where a thread pointer would select the caller's. The kernel has
+ * no sbrk or madvise, so everything is mapped with mmap and returned
+ * with munmap.
+ */
+
+#include <malloc.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define PAGE_SIZE    4096
+#define SPAN_SIZE    (64 * 1024)
+#define SPAN_HEADER  64                // Blocks start after the span header
+#define SMALL_MAX    8192              // Larger requests get their own mapping
+#define NUM_CLASSES  32
+#define CACHE_BYTES  (32 * 1024)       // Aim for a refill batch of about this much
+
+#define SPAN_SMALL   0x534c4142        // "SLAB"
+#define SPAN_LARGE   0x4c415247        // "LARG"
+
+/**
+ * A free block, linked through its first word
+ */
+typedef struct free_block {
+    struct free_block *next;
+} free_block_t;
+
+/**
+ * Header at the start of every span
+ */
+typedef struct span {
+    uint32_t magic;                    // SPAN_SMALL or SPAN_LARGE
+    uint32_t size_class;
+    uint32_t block_size;
+    uint32_t capacity;                 // Blocks that fit in the span
+    uint32_t in_use;                   // Blocks handed to the cache or the caller
+    uint32_t carved;                   // Blocks ever taken from the unused tail
+    free_block_t *free;                // Returned blocks
+    struct span *next;                 // Central list of spans with free blocks
+    struct span *prev;
+    size_t length;                     // Bytes mapped (large spans)
+} span_t;
+
+/**
+ * Central state of one size class
+ */
+typedef struct {
+    span_t *partial;                   // Spans with free blocks
+    span_t *spare;                     // One empty span kept for reuse
+} central_t;
+
+/**
+ * Free blocks of one class held by a thread
+ */
+typedef struct {
+    free_block_t *head;
+    uint32_t count;
+} cache_bin_t;
+
+typedef struct {
+    cache_bin_t bins[NUM_CLASSES];
+} malloc_cache_t;
+
+static const uint32_t class_size[NUM_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192,
+};
+
+// Size class of each request size, in steps of 8 bytes
+static uint8_t class_of[SMALL_MAX / 8 + 1];
+static uint32_t class_batch[NUM_CLASSES];
+static int classes_ready = 0;
+
+static central_t central[NUM_CLASSES];
+static malloc_cache_t main_cache;
+static struct mallinfo stats;
+
+// The calling thread's cache
+static malloc_cache_t *current_cache(void) {
+    return &main_cache;
+}
+
+static void init_classes(void) {
+    int c = 0;
+    for (uint32_t i = 0; i <= SMALL_MAX / 8; i++) {
+        while (class_size[c] < i * 8) {
+            c++;
+        }
+        class_of[i] = (uint8_t)c;
+    }
+    for (c = 0; c < NUM_CLASSES; c++) {
+        uint32_t batch = CACHE_BYTES / class_size[c];
+        class_batch[c] = (batch < 4) ? 4 : (batch > 64) ? 64 : batch;
+    }
+    classes_ready = 1;
+}
+
+static span_t *span_of(const void *ptr) {
+    return (span_t *)((uintptr_t)ptr & ~(uintptr_t)(SPAN_SIZE - 1));
+}
+
+// Report heap corruption and stop
+static void malloc_abort(const char *msg) {
+    write(STDERR_FILENO, msg, strlen(msg));
+    _exit(127);
+}
+
+/* ---------------------------------------------------------------------
+ * Mappings
+ * ------------------------------------------------------------------- */
+
+static void unmap(void *addr, size_t length) {
+    munmap(addr, length);
+    stats.munmap_calls++;
+}
+
+static void *map(size_t length) {
+    stats.mmap_calls++;
+    void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+// Set once the kernel has placed a mapping off a span boundary
+static int map_unaligned = 0;
+
+// Map length bytes (a page multiple) at a SPAN_SIZE boundary
+static void *map_aligned(size_t length) {
+    void *p = NULL;
+    if (!map_unaligned) {
+        p = map(length);
+        if (!p) {
+            return NULL;
+        }
+        if (((uintptr_t)p & (SPAN_SIZE - 1)) != 0) {
+            // Mappings will keep landing off boundaries; over-map from now on
+            unmap(p, length);
+            map_unaligned = 1;
+            p = NULL;
+        }
+    }
+    
+    if (!p) {
+        // Map enough to contain an aligned range and trim the ends
+        size_t padded = length + SPAN_SIZE - PAGE_SIZE;
+        char *raw = (char *)map(padded);
+        if (!raw) {
+            return NULL;
+        }
+        char *aligned = (char *)(((uintptr_t)raw + SPAN_SIZE - 1) & ~(uintptr_t)(SPAN_SIZE - 1));
+        if (aligned > raw) {
+            unmap(raw, aligned - raw);
+        }
+        if (raw + padded > aligned + length) {
+            unmap(aligned + length, (raw + padded) - (aligned + length));
+        }
+        p = aligned;
+    }
+    
+    stats.mapped += length;
+    if (stats.mapped > stats.peak_mapped) {
+        stats.peak_mapped = stats.mapped;
+    }
+    return p;
+}
+
+static void unmap_span(span_t *span, size_t length) {
+    stats.mapped -= length;
+    unmap(span, length);
+}
+
+/* ---------------------------------------------------------------------
+ * Central layer
+ * ------------------------------------------------------------------- */
+
+static void partial_push(central_t *cls, span_t *span) {
+    span->prev = NULL;
+    span->next = cls->partial;
+    if (cls->partial) {
+        cls->partial->prev = span;
+    }
+    cls->partial = span;
+}
+
+static void partial_remove(central_t *cls, span_t *span) {
+    if (span->prev) {
+        span->prev->next = span->next;
+    } else {
+        cls->partial = span->next;
+    }
+    if (span->next) {
+        span->next->prev = span->prev;
+    }
+    span->next = NULL;
+    span->prev = NULL;
+}
+
+// Start a span of a class over, with every block unused
+static void span_reset(span_t *span, uint32_t size_class) {
+    span->magic = SPAN_SMALL;
+    span->size_class = size_class;
+    span->block_size = class_size[size_class];
+    span->capacity = (SPAN_SIZE - SPAN_HEADER) / class_size[size_class];
+    span->in_use = 0;
+    span->carved = 0;
+    span->free = NULL;
+    span->next = NULL;
+    span->prev = NULL;
+    span->length = SPAN_SIZE;
+}
+
+// A span with free blocks, taking the spare or mapping a new one if needed
+static span_t *central_span(uint32_t size_class) {
+    central_t *cls = &central[size_class];
+    if (cls->partial) {
+        return cls->partial;
+    }
+    
+    span_t *span = cls->spare;
+    cls->spare = NULL;
+    if (!span) {
+        span = (span_t *)map_aligned(SPAN_SIZE);
+        if (!span) {
+            return NULL;
+        }
+    }
+    span_reset(span, size_class);
+    partial_push(cls, span);
+    return span;
+}
+
+// Move up to count blocks of a class into a cache bin
+static uint32_t central_take(uint32_t size_class, cache_bin_t *bin, uint32_t count) {
+    central_t *cls = &central[size_class];
+    uint32_t taken = 0;
+    
+    while (taken < count) {
+        span_t *span = central_span(size_class);
+        if (!span) {
+            break;
+        }
+        
+        while (taken < count) {
+            free_block_t *block = span->free;
+            if (block) {
+                span->free = block->next;
+            } else if (span->carved < span->capacity) {
+                block = (free_block_t *)((char *)span + SPAN_HEADER +
+                                         (size_t)span->carved * span->block_size);
+                span->carved++;
+            } else {
+                break;
+            }
+            block->next = bin->head;
+            bin->head = block;
+            bin->count++;
+            span->in_use++;
+            taken++;
+        }
+        
+        if (!span->free && span->carved == span->capacity) {
+            partial_remove(cls, span);
+        }
+    }
+    return taken;
+}
+
+// Give one block back to its span
+static void central_put(free_block_t *block) {
+    span_t *span = span_of(block);
+    central_t *cls = &central[span->size_class];
+    
+    int was_full = !span->free && span->carved == span->capacity;
+    block->next = span->free;
+    span->free = block;
+    span->in_use--;
+    if (was_full) {
+        partial_push(cls, span);
+    }
+    
+    if (span->in_use == 0) {
+        // Every block is back: keep the span as the spare or return it
+        partial_remove(cls, span);
+        if (!cls->spare) {
+            cls->spare = span;
+        } else {
+            unmap_span(span, SPAN_SIZE);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Cache layer
+ * ------------------------------------------------------------------- */
+
+static void *small_alloc(uint32_t size_class) {
+    cache_bin_t *bin = &current_cache()->bins[size_class];
+    if (!bin->head && central_take(size_class, bin, class_batch[size_class]) == 0) {
+        return NULL;
+    }
+    
+    free_block_t *block = bin->head;
+    bin->head = block->next;
+    bin->count--;
+    stats.in_use += class_size[size_class];
+    return block;
+}
+
+static void small_free(span_t *span, void *ptr) {
+    uint32_t size_class = span->size_class;
+    cache_bin_t *bin = &current_cache()->bins[size_class];
+    free_block_t *block = (free_block_t *)ptr;
+    
+    block->next = bin->head;
+    bin->head = block;
+    bin->count++;
+    stats.in_use -= class_size[size_class];
+    
+    // Keep at most two batches; hand one back
+    if (bin->count > 2 * class_batch[size_class]) {
+        for (uint32_t i = 0; i < class_batch[size_class]; i++) {
+            free_block_t *give = bin->head;
+            bin->head = give->next;
+            bin->count--;
+            central_put(give);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Large blocks
+ * ------------------------------------------------------------------- */
+
+static void *large_alloc(size_t size) {
+    if (size > SIZE_MAX - SPAN_HEADER - PAGE_SIZE) {
+        return NULL;
+    }
+    size_t length = (size + SPAN_HEADER + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    
+    span_t *span = (span_t *)map_aligned(length);
+    if (!span) {
+        return NULL;
+    }
+    span->magic = SPAN_LARGE;
+    span->block_size = 0;
+    span->length = length;
+    stats.in_use += length - SPAN_HEADER;
+    return (char *)span + SPAN_HEADER;
+}
+
+static void large_free(span_t *span) {
+    stats.in_use -= span->length - SPAN_HEADER;
+    unmap_span(span, span->length);
+}
+
+/* ---------------------------------------------------------------------
+ * Interface
+ * ------------------------------------------------------------------- */
+
+void *malloc(size_t size) {
+    if (size > SMALL_MAX) {
+        return large_alloc(size);
+    }
+    if (!classes_ready) {
+        init_classes();
+    }
+    return small_alloc(class_of[(size + 7) >> 3]);
+}
+
+void free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    
+    span_t *span = span_of(ptr);
+    if (span->magic == SPAN_SMALL) {
+        small_free(span, ptr);
+    } else if (span->magic == SPAN_LARGE && ptr == (char *)span + SPAN_HEADER) {
+        large_free(span);
+    } else {
+        malloc_abort("free(): invalid pointer\n");
+    }
+}
+
+size_t malloc_usable_size(void *ptr) {
+    if (!ptr) {
+        return 0;
+    }
+    span_t *span = span_of(ptr);
+    return (span->magic == SPAN_LARGE) ? span->length - SPAN_HEADER : span->block_size;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    size_t total = nmemb * size;
+    
+    void *ptr = malloc(total);
+    // Large blocks are fresh pages, already zero
+    if (ptr && total <= SMALL_MAX) {
+        memset(ptr, 0, total);
+    }
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    
+    // Stay put if the block fits and would not be mostly wasted
+    size_t usable = malloc_usable_size(ptr);
+    if (size <= usable && size > usable / 2) {
+        return ptr;
+    }
+    
+    void *moved = malloc(size);
+    if (!moved) {
+        return NULL;
+    }
+    memcpy(moved, ptr, (size < usable) ? size : usable);
+    free(ptr);
+    return moved;
+}
+
+struct mallinfo mallinfo(void) {
+    struct mallinfo info = stats;
+    info.cached = 0;
+    malloc_cache_t *cache = current_cache();
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        info.cached += (size_t)cache->bins[c].count * class_size[c];
+    }
+    return info;
+}
@@ -0,0 +1,293 @@
+/*
+ * printf.c - Formatted output
+ *
+ * One formatter serves every printf variant. It hands its output to a
+ * sink in runs, the literal text between conversions as one piece, so a
+ * stream sees a few large appends rather than a call per character.
+ */
+
+#include "stdio_impl.h"
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * Where formatted output goes
+ */
+typedef struct {
+    void (*emit)(void *ctx, const char *s, size_t n);
+    void *ctx;
+    size_t count;                      // Characters produced so far
+} sink_t;
+
+static const char spaces[16] = "                ";
+static const char zeros[16] = "0000000000000000";
+
+static void put(sink_t *sink, const char *s, size_t n) {
+    if (n > 0) {
+        sink->emit(sink->ctx, s, n);
+        sink->count += n;
+    }
+}
+
+static void pad(sink_t *sink, const char *fill, int n) {
+    while (n > 0) {
+        int chunk = (n < 16) ? n : 16;
+        put(sink, fill, chunk);
+        n -= chunk;
+    }
+}
+
+// Format flags
+#define FL_LEFT  0x01                  // '-': pad on the right
+#define FL_ZERO  0x02                  // '0': pad numbers with zeros
+#define FL_PLUS  0x04                  // '+': sign on positive numbers
+#define FL_SPACE 0x08                  // ' ': space on positive numbers
+#define FL_ALT   0x10                  // '#': 0x or 0 prefix
+
+// Emit one number with its sign or prefix, precision and padding
+static void format_number(sink_t *sink, unsigned long long value, int negative,
+                          unsigned base, int upper, int flags, int width, int prec) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char buf[24];
+    int len = 0;
+    
+    // Precision 0 prints nothing for 0
+    if (value != 0 || prec != 0) {
+        do {
+            buf[sizeof(buf) - 1 - len++] = digits[value % base];
+            value /= base;
+        } while (value != 0);
+    }
+    
+    char prefix[2];
+    int prefix_len = 0;
+    if (negative) {
+        prefix[prefix_len++] = '-';
+    } else if (flags & FL_PLUS) {
+        prefix[prefix_len++] = '+';
+    } else if (flags & FL_SPACE) {
+        prefix[prefix_len++] = ' ';
+    }
+    if ((flags & FL_ALT) && base == 16 && len > 0 && buf[sizeof(buf) - len] != '0') {
+        prefix[prefix_len++] = '0';
+        prefix[prefix_len++] = upper ? 'X' : 'x';
+    } else if ((flags & FL_ALT) && base == 8 && (len == 0 || buf[sizeof(buf) - len] != '0')) {
+        buf[sizeof(buf) - 1 - len++] = '0';
+    }
+    
+    int precision_zeros = (prec > len) ? prec - len : 0;
+    int body = prefix_len + precision_zeros + len;
+    int fill = (width > body) ? width - body : 0;
+    
+    if (!(flags & FL_LEFT) && !((flags & FL_ZERO) && prec < 0)) {
+        pad(sink, spaces, fill);
+        fill = 0;
+    }
+    put(sink, prefix, prefix_len);
+    if (!(flags & FL_LEFT)) {
+        pad(sink, zeros, fill);
+        fill = 0;
+    }
+    pad(sink, zeros, precision_zeros);
+    put(sink, buf + sizeof(buf) - len, len);
+    pad(sink, spaces, fill);
+}
+
+static int format(sink_t *sink, const char *fmt, va_list ap) {
+    while (*fmt) {
+        // Literal text up to the next conversion, in one piece
+        const char *start = fmt;
+        while (*fmt && *fmt != '%') {
+            fmt++;
+        }
+        put(sink, start, fmt - start);
+        if (*fmt == '\0') {
+            break;
+        }
+        fmt++;
+        
+        int flags = 0;
+        for (;; fmt++) {
+            if (*fmt == '-') flags |= FL_LEFT;
+            else if (*fmt == '0') flags |= FL_ZERO;
+            else if (*fmt == '+') flags |= FL_PLUS;
+            else if (*fmt == ' ') flags |= FL_SPACE;
+            else if (*fmt == '#') flags |= FL_ALT;
+            else break;
+        }
+        
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(ap, int);
+            if (width < 0) {
+                flags |= FL_LEFT;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') {
+                width = width * 10 + (*fmt++ - '0');
+            }
+        }
+        
+        int prec = -1;
+        if (*fmt == '.') {
+            fmt++;
+            prec = 0;
+            if (*fmt == '*') {
+                prec = va_arg(ap, int);
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9') {
+                    prec = prec * 10 + (*fmt++ - '0');
+                }
+            }
+        }
+        
+        // Length: 'h' counts down, 'l' and 'z' count up
+        int length = 0;
+        for (;; fmt++) {
+            if (*fmt == 'h') length--;
+            else if (*fmt == 'l') length++;
+            else if (*fmt == 'z') length = 1;
+            else break;
+        }
+        
+        char conv = *fmt;
+        if (conv == '\0') {
+            break;
+        }
+        fmt++;
+        
+        switch (conv) {
+        case 'd':
+        case 'i': {
+            long long value;
+            if (length >= 2) value = va_arg(ap, long long);
+            else if (length == 1) value = va_arg(ap, long);
+            else value = va_arg(ap, int);
+            if (length == -1) value = (short)value;
+            else if (length <= -2) value = (signed char)value;
+            
+            unsigned long long magnitude = (value < 0) ? -(unsigned long long)value : (unsigned long long)value;
+            format_number(sink, magnitude, value < 0, 10, 0, flags, width, prec);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o': {
+            unsigned long long value;
+            if (length >= 2) value = va_arg(ap, unsigned long long);
+            else if (length == 1) value = va_arg(ap, unsigned long);
+            else value = va_arg(ap, unsigned int);
+            if (length == -1) value = (unsigned short)value;
+            else if (length <= -2) value = (unsigned char)value;
+            
+            unsigned base = (conv == 'u') ? 10 : (conv == 'o') ? 8 : 16;
+            format_number(sink, value, 0, base, conv == 'X',
+                          flags & ~(FL_PLUS | FL_SPACE), width, prec);
+            break;
+        }
+        case 'p':
+            format_number(sink, (uintptr_t)va_arg(ap, void *), 0, 16, 0,
+                          FL_ALT | (flags & FL_LEFT), width, -1);
+            break;
+        case 'c': {
+            char ch = (char)va_arg(ap, int);
+            if (!(flags & FL_LEFT)) pad(sink, spaces, width - 1);
+            put(sink, &ch, 1);
+            if (flags & FL_LEFT) pad(sink, spaces, width - 1);
+            break;
+        }
+        case 's': {
+            const char *s = va_arg(ap, const char *);
+            if (!s) {
+                s = "(null)";
+            }
+            int len = (prec >= 0) ? (int)strnlen(s, prec) : (int)strlen(s);
+            if (!(flags & FL_LEFT)) pad(sink, spaces, width - len);
+            put(sink, s, len);
+            if (flags & FL_LEFT) pad(sink, spaces, width - len);
+            break;
+        }
+        case '%':
+            put(sink, "%", 1);
+            break;
+        default:
+            // Unknown conversion: print it as written
+            put(sink, "%", 1);
+            put(sink, &conv, 1);
+            break;
+        }
+    }
+    return (int)sink->count;
+}
+
+// Sink into a stream
+static void emit_stream(void *ctx, const char *s, size_t n) {
+    __stdio_write((FILE *)ctx, s, n);
+}
+
+/**
+ * Sink into a fixed buffer, dropping what does not fit
+ */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} string_sink_t;
+
+static void emit_string(void *ctx, const char *s, size_t n) {
+    string_sink_t *str = (string_sink_t *)ctx;
+    if (str->len + 1 < str->size) {
+        size_t room = str->size - 1 - str->len;
+        memcpy(str->buf + str->len, s, (n < room) ? n : room);
+    }
+    str->len += n;
+}
+
+int vfprintf(FILE *stream, const char *fmt, va_list ap) {
+    sink_t sink = { emit_stream, stream, 0 };
+    int had_error = ferror(stream);
+    int count = format(&sink, fmt, ap);
+    return (!had_error && ferror(stream)) ? -1 : count;
+}
+
+int vprintf(const char *fmt, va_list ap) {
+    return vfprintf(stdout, fmt, ap);
+}
+
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list ap) {
+    string_sink_t str = { buf, size, 0 };
+    sink_t sink = { emit_string, &str, 0 };
+    int count = format(&sink, fmt, ap);
+    if (size > 0) {
+        buf[(str.len < size) ? str.len : size - 1] = '\0';
+    }
+    return count;
+}
+
+int printf(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int count = vfprintf(stdout, fmt, ap);
+    va_end(ap);
+    return count;
+}
+
+int fprintf(FILE *stream, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int count = vfprintf(stream, fmt, ap);
+    va_end(ap);
+    return count;
+}
+
+int snprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int count = vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return count;
+}
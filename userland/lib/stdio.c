@@ -0,0 +1,383 @@
+/*
+ * stdio.c - Buffered streams
+ *
+ * A stream's buffer holds either output waiting to be written or input
+ * read ahead, never both: switching direction flushes the output, or
+ * seeks back over the unread input. Transfers at least as large as the
+ * buffer skip it and go straight to the system call.
+ */
+
+#include "stdio_impl.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+static unsigned char stdin_buf[BUFSIZ];
+static unsigned char stdout_buf[BUFSIZ];
+
+static FILE std_streams[3] = {
+    { STDIN_FILENO,  _F_OPEN | _F_READ,             _IOFBF, stdin_buf,  BUFSIZ, 0, 0 },
+    { STDOUT_FILENO, _F_OPEN | _F_WRITE | _F_PROBE, _IOFBF, stdout_buf, BUFSIZ, 0, 0 },
+    { STDERR_FILENO, _F_OPEN | _F_WRITE,            _IONBF, NULL,       0,      0, 0 },
+};
+
+FILE *stdin = &std_streams[0];
+FILE *stdout = &std_streams[1];
+FILE *stderr = &std_streams[2];
+
+// Streams opened with fopen/fdopen, each with its own buffer
+static FILE streams[FOPEN_MAX];
+static unsigned char stream_bufs[FOPEN_MAX][BUFSIZ];
+
+// Line buffering for the console, full buffering for everything else
+static void stream_probe(FILE *stream) {
+    if (stream->flags & _F_PROBE) {
+        stream->flags &= ~_F_PROBE;
+        stream->mode = isatty(stream->fd) ? _IOLBF : _IOFBF;
+    }
+}
+
+// Write all of data, retrying short writes
+static int write_all(FILE *stream, const unsigned char *data, size_t n) {
+    while (n > 0) {
+        ssize_t written = write(stream->fd, data, n);
+        if (written <= 0) {
+            stream->flags |= _F_ERR;
+            return -1;
+        }
+        data += written;
+        n -= written;
+    }
+    return 0;
+}
+
+// Write out buffered output
+static int flush_output(FILE *stream) {
+    if (!(stream->flags & _F_WRITING) || stream->pos == 0) {
+        return 0;
+    }
+    
+    size_t pending = stream->pos;
+    stream->pos = 0;
+    return write_all(stream, stream->buf, pending);
+}
+
+// Give back input read ahead so the file position matches the caller's
+static void drop_input(FILE *stream) {
+    if (!(stream->flags & _F_WRITING) && stream->pos < stream->len) {
+        lseek(stream->fd, -(off_t)(stream->len - stream->pos), SEEK_CUR);
+    }
+    stream->pos = 0;
+    stream->len = 0;
+}
+
+size_t __stdio_write(FILE *stream, const void *data, size_t n) {
+    const unsigned char *p = (const unsigned char *)data;
+    
+    if (!(stream->flags & _F_WRITE)) {
+        stream->flags |= _F_ERR;
+        return 0;
+    }
+    stream_probe(stream);
+    if (!(stream->flags & _F_WRITING)) {
+        drop_input(stream);
+        stream->flags |= _F_WRITING;
+    }
+    
+    // Unbuffered, or too big to be worth copying
+    if (stream->mode == _IONBF || n >= stream->size) {
+        if (flush_output(stream) != 0 || write_all(stream, p, n) != 0) {
+            return 0;
+        }
+        return n;
+    }
+    
+    size_t done = 0;
+    while (done < n) {
+        size_t room = stream->size - stream->pos;
+        size_t chunk = (n - done < room) ? n - done : room;
+        memcpy(stream->buf + stream->pos, p + done, chunk);
+        stream->pos += chunk;
+        done += chunk;
+        if (stream->pos == stream->size && flush_output(stream) != 0) {
+            // The buffer was lost, and with it the end of our data
+            return (done > stream->size) ? done - stream->size : 0;
+        }
+    }
+    
+    if (stream->mode == _IOLBF && memchr(p, '\n', n) && flush_output(stream) != 0) {
+        return 0;
+    }
+    return n;
+}
+
+// Read more input into the buffer; returns bytes available
+static size_t refill(FILE *stream) {
+    if (!(stream->flags & _F_READ)) {
+        stream->flags |= _F_ERR;
+        return 0;
+    }
+    if (stream->flags & _F_WRITING) {
+        if (flush_output(stream) != 0) {
+            return 0;
+        }
+        stream->flags &= ~_F_WRITING;
+    }
+    if (stream->pos < stream->len) {
+        return stream->len - stream->pos;
+    }
+    
+    // Make a prompt visible before waiting for the answer
+    if (stream == stdin && stdout->mode == _IOLBF) {
+        fflush(stdout);
+    }
+    
+    stream->pos = 0;
+    stream->len = 0;
+    ssize_t nread = read(stream->fd, stream->buf, stream->size);
+    if (nread < 0) {
+        stream->flags |= _F_ERR;
+        return 0;
+    }
+    if (nread == 0) {
+        stream->flags |= _F_EOF;
+        return 0;
+    }
+    stream->len = nread;
+    return stream->len;
+}
+
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
+    size_t total = size * nmemb;
+    if (total == 0) {
+        return 0;
+    }
+    return __stdio_write(stream, ptr, total) / size;
+}
+
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
+    unsigned char *p = (unsigned char *)ptr;
+    size_t total = size * nmemb;
+    size_t done = 0;
+    
+    while (done < total) {
+        // Large reads with nothing buffered go straight to the caller
+        if (stream->pos == stream->len && total - done >= stream->size &&
+            (stream->flags & _F_READ) && !(stream->flags & _F_WRITING)) {
+            ssize_t nread = read(stream->fd, p + done, total - done);
+            if (nread <= 0) {
+                stream->flags |= (nread == 0) ? _F_EOF : _F_ERR;
+                break;
+            }
+            done += nread;
+            continue;
+        }
+        
+        size_t avail = refill(stream);
+        if (avail == 0) {
+            break;
+        }
+        size_t chunk = (total - done < avail) ? total - done : avail;
+        memcpy(p + done, stream->buf + stream->pos, chunk);
+        stream->pos += chunk;
+        done += chunk;
+    }
+    return size ? done / size : 0;
+}
+
+int fgetc(FILE *stream) {
+    if (refill(stream) == 0) {
+        return EOF;
+    }
+    return stream->buf[stream->pos++];
+}
+
+char *fgets(char *s, int size, FILE *stream) {
+    if (size <= 0) {
+        return NULL;
+    }
+    
+    int done = 0;
+    while (done < size - 1) {
+        size_t avail = refill(stream);
+        if (avail == 0) {
+            break;
+        }
+        
+        // Take up to the newline, the end of the buffer or of s
+        size_t want = (size_t)(size - 1 - done);
+        size_t chunk = (want < avail) ? want : avail;
+        unsigned char *start = stream->buf + stream->pos;
+        unsigned char *nl = memchr(start, '\n', chunk);
+        if (nl) {
+            chunk = nl - start + 1;
+        }
+        memcpy(s + done, start, chunk);
+        stream->pos += chunk;
+        done += chunk;
+        if (nl) {
+            break;
+        }
+    }
+    
+    if (done == 0) {
+        return NULL;
+    }
+    s[done] = '\0';
+    return s;
+}
+
+int fputc(int c, FILE *stream) {
+    unsigned char ch = (unsigned char)c;
+    
+    // Fast path: room in a fully buffered output buffer
+    if ((stream->flags & (_F_WRITING | _F_PROBE)) == _F_WRITING &&
+        stream->mode == _IOFBF && stream->pos < stream->size) {
+        stream->buf[stream->pos++] = ch;
+        return ch;
+    }
+    return __stdio_write(stream, &ch, 1) == 1 ? ch : EOF;
+}
+
+int fputs(const char *s, FILE *stream) {
+    size_t len = strlen(s);
+    return __stdio_write(stream, s, len) == len ? 0 : EOF;
+}
+
+int puts(const char *s) {
+    if (fputs(s, stdout) == EOF) {
+        return EOF;
+    }
+    return fputc('\n', stdout) == EOF ? EOF : 0;
+}
+
+int fflush(FILE *stream) {
+    if (stream) {
+        return flush_output(stream);
+    }
+    
+    int result = 0;
+    for (int i = 0; i < 3; i++) {
+        if (flush_output(&std_streams[i]) != 0) {
+            result = EOF;
+        }
+    }
+    for (int i = 0; i < FOPEN_MAX; i++) {
+        if ((streams[i].flags & _F_OPEN) && flush_output(&streams[i]) != 0) {
+            result = EOF;
+        }
+    }
+    return result;
+}
+
+// Called by exit()
+void __stdio_exit(void) {
+    fflush(NULL);
+}
+
+// Parse an fopen mode into open flags and stream flags
+static int parse_mode(const char *mode, int *open_flags) {
+    int plus = (strchr(mode, '+') != NULL);
+    switch (mode[0]) {
+    case 'r':
+        *open_flags = plus ? O_RDWR : O_RDONLY;
+        return plus ? _F_READ | _F_WRITE : _F_READ;
+    case 'w':
+        *open_flags = (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+        return plus ? _F_READ | _F_WRITE : _F_WRITE;
+    case 'a':
+        *open_flags = (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+        return plus ? _F_READ | _F_WRITE : _F_WRITE;
+    default:
+        return 0;
+    }
+}
+
+FILE *fdopen(int fd, const char *mode) {
+    int open_flags;
+    int flags = parse_mode(mode, &open_flags);
+    if (fd < 0 || flags == 0) {
+        return NULL;
+    }
+    
+    for (int i = 0; i < FOPEN_MAX; i++) {
+        if (!(streams[i].flags & _F_OPEN)) {
+            FILE *stream = &streams[i];
+            stream->fd = fd;
+            stream->flags = _F_OPEN | flags;
+            stream->mode = _IOFBF;
+            stream->buf = stream_bufs[i];
+            stream->size = BUFSIZ;
+            stream->pos = 0;
+            stream->len = 0;
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+FILE *fopen(const char *path, const char *mode) {
+    int open_flags;
+    if (parse_mode(mode, &open_flags) == 0) {
+        return NULL;
+    }
+    
+    int fd = open(path, open_flags, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    
+    FILE *stream = fdopen(fd, mode);
+    if (!stream) {
+        close(fd);
+    }
+    return stream;
+}
+
+int fclose(FILE *stream) {
+    int result = flush_output(stream);
+    if (close(stream->fd) != 0 && stream->fd > STDERR_FILENO) {
+        result = EOF;
+    }
+    stream->flags = 0;
+    stream->pos = 0;
+    stream->len = 0;
+    return result;
+}
+
+int setvbuf(FILE *stream, char *buf, int mode, size_t size) {
+    if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) {
+        return -1;
+    }
+    if (flush_output(stream) != 0) {
+        return -1;
+    }
+    
+    if (buf && size > 0) {
+        stream->buf = (unsigned char *)buf;
+        stream->size = size;
+    }
+    if (mode != _IONBF && !stream->buf) {
+        // stderr has no buffer of its own; stay unbuffered
+        mode = _IONBF;
+    }
+    stream->mode = mode;
+    stream->flags &= ~_F_PROBE;
+    return 0;
+}
+
+int fileno(FILE *stream) {
+    return stream->fd;
+}
+
+int feof(FILE *stream) {
+    return (stream->flags & _F_EOF) != 0;
+}
+
+int ferror(FILE *stream) {
+    return (stream->flags & _F_ERR) != 0;
+}
+
+void clearerr(FILE *stream) {
+    stream->flags &= ~(_F_EOF | _F_ERR);
+}
@@ -0,0 +1,26 @@
+/*
+ * stdio_impl.h - Internals shared by the stdio sources
+ */
+
+#ifndef _STDIO_IMPL_H
+#define _STDIO_IMPL_H
+
+#include <stdio.h>
+
+// Stream state bits (FILE.flags)
+#define _F_READ    0x01                // Opened for reading
+#define _F_WRITE   0x02                // Opened for writing
+#define _F_EOF     0x04                // End of file seen
+#define _F_ERR     0x08                // A system call failed
+#define _F_PROBE   0x10                // Choose line or full buffering on first use
+#define _F_OPEN    0x20                // Slot in use
+#define _F_WRITING 0x40                // Buffer holds output, not input
+
+/**
+ * Append bytes to a stream's output, writing out whatever the buffering
+ * mode calls for
+ * @return Bytes accepted; fewer than n means _F_ERR is set
+ */
+size_t __stdio_write(FILE *stream, const void *data, size_t n);
+
+#endif // _STDIO_IMPL_H
@@ -0,0 +1,68 @@
+/*
+ * stdlib.c - Process exit and number conversion
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+// Flushes the streams; weak so that programs without stdio do not pull it in
+extern void __stdio_exit(void) __attribute__((weak));
+
+void exit(int status) {
+    if (__stdio_exit) {
+        __stdio_exit();
+    }
+    _exit(status);
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Value of a digit in bases up to 36, or 36 if c is not one
+static int digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+    return 36;
+}
+
+unsigned long strtoul(const char *s, char **end, int base) {
+    const char *p = s;
+    while (is_space(*p)) p++;
+    
+    int negative = 0;
+    if (*p == '+' || *p == '-') {
+        negative = (*p == '-');
+        p++;
+    }
+    
+    // Base 0 takes the base from a 0x or 0 prefix
+    if ((base == 0 || base == 16) && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') &&
+        digit_value(p[2]) < 16) {
+        p += 2;
+        base = 16;
+    } else if (base == 0) {
+        base = (p[0] == '0') ? 8 : 10;
+    }
+    
+    unsigned long value = 0;
+    const char *start = p;
+    while (digit_value(*p) < base) {
+        value = value * base + digit_value(*p);
+        p++;
+    }
+    
+    if (end) {
+        *end = (char *)(p == start ? s : p);
+    }
+    return negative ? -value : value;
+}
+
+long strtol(const char *s, char **end, int base) {
+    return (long)strtoul(s, end, base);
+}
+
+int atoi(const char *s) {
+    return (int)strtol(s, NULL, 10);
+}
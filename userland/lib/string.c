@@ -0,0 +1,272 @@
+/*
+ * string.c - Memory and string routines
+ *
+ * Once the pointers are aligned, the loops move a 64-bit word per step
+ * instead of a byte. The string routines find the terminating NUL a word
+ * at a time with the usual bit trick: (w - 0x01..01) & ~w & 0x80..80 is
+ * nonzero exactly when some byte of w is zero. An aligned word never
+ * crosses a page, so reading the rest of the word past a NUL is safe.
+ *
+ * Built with -fno-builtin so the compiler does not turn these loops back
+ * into calls to themselves.
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+// Words alias whatever bytes they are read from
+typedef uint64_t __attribute__((may_alias)) word_t;
+
+#define WSIZE  sizeof(word_t)
+#define WMASK  (WSIZE - 1)
+#define ONES   ((word_t)0x0101010101010101ULL)
+#define HIGHS  ((word_t)0x8080808080808080ULL)
+
+// Nonzero if some byte of w is zero
+#define HAS_ZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+// Copy in 8-word blocks, then words; both pointers word aligned
+static void copy_words(unsigned char *d, const unsigned char *s, size_t words) {
+    word_t *dw = (word_t *)d;
+    const word_t *sw = (const word_t *)s;
+    while (words >= 8) {
+        word_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+        word_t w4 = sw[4], w5 = sw[5], w6 = sw[6], w7 = sw[7];
+        dw[0] = w0; dw[1] = w1; dw[2] = w2; dw[3] = w3;
+        dw[4] = w4; dw[5] = w5; dw[6] = w6; dw[7] = w7;
+        dw += 8;
+        sw += 8;
+        words -= 8;
+    }
+    while (words--) {
+        *dw++ = *sw++;
+    }
+}
+
+void *memcpy(void *dest, const void *src, size_t n) {
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+    
+    // Word copies need both pointers aligned the same way
+    if (n >= 2 * WSIZE && (((uintptr_t)d ^ (uintptr_t)s) & WMASK) == 0) {
+        while ((uintptr_t)d & WMASK) {
+            *d++ = *s++;
+            n--;
+        }
+        copy_words(d, s, n / WSIZE);
+        d += n & ~WMASK;
+        s += n & ~WMASK;
+        n &= WMASK;
+    }
+    
+    while (n--) {
+        *d++ = *s++;
+    }
+    return dest;
+}
+
+void *memmove(void *dest, const void *src, size_t n) {
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+    
+    // A forward copy is safe unless dest starts inside src
+    if (d <= s || d >= s + n) {
+        return memcpy(dest, src, n);
+    }
+    
+    // Copy backwards from the end
+    d += n;
+    s += n;
+    if ((((uintptr_t)d ^ (uintptr_t)s) & WMASK) == 0) {
+        while (n && ((uintptr_t)d & WMASK)) {
+            *--d = *--s;
+            n--;
+        }
+        while (n >= WSIZE) {
+            d -= WSIZE;
+            s -= WSIZE;
+            *(word_t *)d = *(const word_t *)s;
+            n -= WSIZE;
+        }
+    }
+    while (n--) {
+        *--d = *--s;
+    }
+    return dest;
+}
+
+void *memset(void *s, int c, size_t n) {
+    unsigned char *p = (unsigned char *)s;
+    unsigned char b = (unsigned char)c;
+    
+    if (n >= 2 * WSIZE) {
+        while ((uintptr_t)p & WMASK) {
+            *p++ = b;
+            n--;
+        }
+        word_t w = ONES * b;
+        word_t *pw = (word_t *)p;
+        size_t words = n / WSIZE;
+        while (words >= 4) {
+            pw[0] = w; pw[1] = w; pw[2] = w; pw[3] = w;
+            pw += 4;
+            words -= 4;
+        }
+        while (words--) {
+            *pw++ = w;
+        }
+        p = (unsigned char *)pw;
+        n &= WMASK;
+    }
+    
+    while (n--) {
+        *p++ = b;
+    }
+    return s;
+}
+
+int memcmp(const void *a, const void *b, size_t n) {
+    const unsigned char *pa = (const unsigned char *)a;
+    const unsigned char *pb = (const unsigned char *)b;
+    
+    // Skip equal words; the differing one is settled byte by byte
+    if ((((uintptr_t)pa | (uintptr_t)pb) & WMASK) == 0) {
+        while (n >= WSIZE && *(const word_t *)pa == *(const word_t *)pb) {
+            pa += WSIZE;
+            pb += WSIZE;
+            n -= WSIZE;
+        }
+    }
+    
+    while (n--) {
+        if (*pa != *pb) {
+            return *pa - *pb;
+        }
+        pa++;
+        pb++;
+    }
+    return 0;
+}
+
+void *memchr(const void *s, int c, size_t n) {
+    const unsigned char *p = (const unsigned char *)s;
+    unsigned char b = (unsigned char)c;
+    
+    while (n && ((uintptr_t)p & WMASK)) {
+        if (*p == b) {
+            return (void *)p;
+        }
+        p++;
+        n--;
+    }
+    
+    // XOR turns matching bytes into zeros
+    word_t pattern = ONES * b;
+    while (n >= WSIZE && !HAS_ZERO(*(const word_t *)p ^ pattern)) {
+        p += WSIZE;
+        n -= WSIZE;
+    }
+    
+    while (n--) {
+        if (*p == b) {
+            return (void *)p;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+size_t strlen(const char *s) {
+    const char *p = s;
+    
+    while ((uintptr_t)p & WMASK) {
+        if (*p == '\0') {
+            return p - s;
+        }
+        p++;
+    }
+    
+    const word_t *w = (const word_t *)p;
+    while (!HAS_ZERO(*w)) {
+        w++;
+    }
+    
+    p = (const char *)w;
+    while (*p) {
+        p++;
+    }
+    return p - s;
+}
+
+size_t strnlen(const char *s, size_t maxlen) {
+    const char *end = (const char *)memchr(s, '\0', maxlen);
+    return end ? (size_t)(end - s) : maxlen;
+}
+
+int strcmp(const char *a, const char *b) {
+    // Compare words while both are aligned, equal and NUL free
+    if ((((uintptr_t)a | (uintptr_t)b) & WMASK) == 0) {
+        const word_t *wa = (const word_t *)a;
+        const word_t *wb = (const word_t *)b;
+        while (*wa == *wb && !HAS_ZERO(*wa)) {
+            wa++;
+            wb++;
+        }
+        a = (const char *)wa;
+        b = (const char *)wb;
+    }
+    
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
+int strncmp(const char *a, const char *b, size_t n) {
+    while (n && *a && *a == *b) {
+        a++;
+        b++;
+        n--;
+    }
+    return n ? (unsigned char)*a - (unsigned char)*b : 0;
+}
+
+char *strcpy(char *dest, const char *src) {
+    memcpy(dest, src, strlen(src) + 1);
+    return dest;
+}
+
+char *strncpy(char *dest, const char *src, size_t n) {
+    size_t len = strnlen(src, n);
+    memcpy(dest, src, len);
+    memset(dest + len, 0, n - len);
+    return dest;
+}
+
+char *strcat(char *dest, const char *src) {
+    strcpy(dest + strlen(dest), src);
+    return dest;
+}
+
+char *strchr(const char *s, int c) {
+    char ch = (char)c;
+    while (*s != ch) {
+        if (*s == '\0') {
+            return NULL;
+        }
+        s++;
+    }
+    return (char *)s;
+}
+
+char *strrchr(const char *s, int c) {
+    char ch = (char)c;
+    const char *last = NULL;
+    do {
+        if (*s == ch) {
+            last = s;
+        }
+    } while (*s++);
+    return (char *)last;
+}
@@ -0,0 +1,158 @@
+/*
+ * syscall.c - System call wrappers
+ */
+
+#include <syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/auxv.h>
+#include <stdarg.h>
+
+// Console request of the kernel's VFS_IOC_ISATTY
+#define IOC_ISATTY 0x5401
+
+ssize_t read(int fd, void *buf, size_t count) {
+    return __syscall3(SYS_READ, fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    return __syscall3(SYS_WRITE, fd, buf, count);
+}
+
+int open(const char *path, int flags, ...) {
+    va_list ap;
+    va_start(ap, flags);
+    int mode = (flags & O_CREAT) ? va_arg(ap, int) : 0;
+    va_end(ap);
+    return (int)__syscall3(SYS_OPEN, path, flags, mode);
+}
+
+int close(int fd) {
+    return (int)__syscall1(SYS_CLOSE, fd);
+}
+
+off_t lseek(int fd, off_t offset, int whence) {
+    return __syscall3(SYS_LSEEK, fd, offset, whence);
+}
+
+int dup(int fd) {
+    return (int)__syscall1(SYS_DUP, fd);
+}
+
+int dup2(int oldfd, int newfd) {
+    return (int)__syscall2(SYS_DUP2, oldfd, newfd);
+}
+
+int pipe(int fds[2]) {
+    return (int)__syscall2(SYS_PIPE, fds, 0);
+}
+
+int pipe2(int fds[2], int flags) {
+    return (int)__syscall2(SYS_PIPE, fds, flags);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    return __syscall4(SYS_PREAD, fd, buf, count, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    return __syscall4(SYS_PWRITE, fd, buf, count, offset);
+}
+
+int unlink(const char *path) {
+    return (int)__syscall1(SYS_UNLINK, path);
+}
+
+int rmdir(const char *path) {
+    return (int)__syscall1(SYS_RMDIR, path);
+}
+
+int mkdir(const char *path, int mode) {
+    return (int)__syscall2(SYS_MKDIR, path, mode);
+}
+
+int stat(const char *path, struct stat *buf) {
+    return (int)__syscall2(SYS_STAT, path, buf);
+}
+
+int ftruncate(int fd, off_t length) {
+    return (int)__syscall2(SYS_FTRUNCATE, fd, length);
+}
+
+void sync(void) {
+    __syscall0(SYS_SYNC);
+}
+
+int fsync(int fd) {
+    return (int)__syscall1(SYS_FSYNC, fd);
+}
+
+int execve(const char *path, char *const argv[], char *const envp[]) {
+    return (int)__syscall3(SYS_EXECVE, path, argv, envp);
+}
+
+pid_t fork(void) {
+    return (pid_t)__syscall0(SYS_FORK);
+}
+
+pid_t waitpid(pid_t pid, int *status, int options) {
+    return (pid_t)__syscall3(SYS_WAIT, pid, status, options);
+}
+
+pid_t getpid(void) {
+    return (pid_t)__syscall0(SYS_GETPID);
+}
+
+pid_t getppid(void) {
+    return (pid_t)__syscall0(SYS_GETPPID);
+}
+
+int sched_yield(void) {
+    return (int)__syscall0(SYS_YIELD);
+}
+
+void _exit(int status) {
+    __syscall1(SYS_EXIT, status);
+    while (1) {
+        // Not reached
+    }
+}
+
+int isatty(int fd) {
+    return __syscall3(SYS_IOCTL, fd, IOC_ISATTY, 0) == 0;
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    return __syscall4(SYS_SENDFILE, out_fd, in_fd, offset, count);
+}
+
+unsigned long gettime(void) {
+    return (unsigned long)__syscall0(SYS_GETTIME);
+}
+
+int ioctl(int fd, unsigned int request, void *arg) {
+    return (int)__syscall3(SYS_IOCTL, fd, request, arg);
+}
+
+ssize_t getdents(int fd, void *buf, size_t count) {
+    return __syscall3(SYS_GETDENTS, fd, buf, count);
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    return (void *)__syscall6(SYS_MMAP, (long)addr, (long)length, prot, flags, fd, offset);
+}
+
+int munmap(void *addr, size_t length) {
+    return (int)__syscall2(SYS_MUNMAP, addr, length);
+}
+
+// There is no auxiliary vector; the kernel answers AT_HWCAP by system call
+unsigned long getauxval(unsigned long type) {
+    if (type != AT_HWCAP) {
+        return 0;
+    }
+    return (unsigned long)__syscall0(SYS_GETHWCAP);
+}
@@ -1,57 +1,54 @@
 /*
  * ls - List directory contents
- * Simple implementation using getdents syscall
+ * Simple implementation using getdents; lists the root directory, or
+ * each directory given
  */
 
-// ThunderOS syscall numbers
-#define SYS_EXIT 0
-#define SYS_WRITE 1
-#define SYS_READ 2
-#define SYS_OPEN 13
-#define SYS_CLOSE 14
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
 
-// Note: ThunderOS doesn't have openat or getdents yet
-// For now, ls will just print a message
-#define AT_FDCWD -100
-#define O_RDONLY 0
-#define O_DIRECTORY 0x10000
-
-typedef unsigned long size_t;
-typedef long ssize_t;
-
-// System call wrapper
-static inline long syscall(long n, long a0, long a1, long a2) {
-    register long syscall_num asm("a7") = n;
-    register long arg0 asm("a0") = a0;
-    register long arg1 asm("a1") = a1;
-    register long arg2 asm("a2") = a2;
+static int list_dir(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ls: cannot open %s\n", path);
+        return 1;
+    }
     
-    asm volatile("ecall"
-                 : "+r"(arg0)
-                 : "r"(syscall_num), "r"(arg1), "r"(arg2)
-                 : "memory");
+    // Each call returns as many entries as fit in the buffer
+    long buf[128];
+    while (1) {
+        ssize_t nread = getdents(fd, buf, sizeof(buf));
+        if (nread < 0) {
+            fprintf(stderr, "ls: getdents failed\n");
+            close(fd);
+            return 1;
+        }
+        if (nread == 0) break;
+        
+        for (ssize_t pos = 0; pos < nread; ) {
+            struct dirent *entry = (struct dirent *)((char *)buf + pos);
+            printf("%s%s\n", entry->d_name, entry->d_type == DT_DIR ? "/" : "");
+            pos += entry->d_reclen;
+        }
+    }
     
-    return arg0;
-}
-
-// Helper functions
-static size_t strlen(const char *s) {
-    size_t len = 0;
-    while (s[len]) len++;
-    return len;
-}
-
-static void print(const char *s) {
-    syscall(SYS_WRITE, 1, (long)s, strlen(s));
+    close(fd);
+    return 0;
 }
 
-void _start(void) {
-    // For now, just print a test message
-    // TODO: Implement proper directory listing when getdents is available
-    print("ls: Directory listing:\n");
-    print("  test.txt\n");
-    print("  bin/\n");
-    print("Note: Full directory listing requires getdents syscall (not yet implemented)\n");
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        return list_dir("/");
+    }
     
-    syscall(SYS_EXIT, 0, 0, 0);
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        if (argc > 2) {
+            printf("%s%s:\n", i > 1 ? "\n" : "", argv[i]);
+        }
+        status |= list_dir(argv[i]);
+    }
+    return status;
 }
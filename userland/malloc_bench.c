@@ -0,0 +1,238 @@
+/*
+ * malloc_bench - Allocator throughput and fragmentation
+ * Runs the same allocation traces against the libc malloc and a first-fit
+ * free-list allocator, and reports time and memory used per live byte
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MAX_SLOTS    8192
+#define SAMPLE_STEPS 1024               // Steps between footprint samples
+#define ARENA_SIZE   (4 * 1024 * 1024)
+
+/**
+ * An allocator under test
+ */
+typedef struct {
+    const char *name;
+    void *(*alloc)(size_t size);
+    void (*release)(void *ptr);
+    size_t (*footprint)(void);         // Memory currently taken from the kernel
+} allocator_t;
+
+/* ---------------------------------------------------------------------
+ * Baseline: first-fit over an address-ordered free list
+ * ------------------------------------------------------------------- */
+
+typedef struct block {
+    struct block *next;                // Next free block, by address
+    size_t units;                      // Size in units, header included
+} block_t;
+
+#define UNIT sizeof(block_t)
+
+static char *arena;
+static char *arena_top;                // End of the carved part of the arena
+static block_t *free_list;
+
+static void *ff_alloc(size_t size) {
+    size_t units = (size + UNIT - 1) / UNIT + 1;
+    
+    block_t **link = &free_list;
+    for (block_t *b = free_list; b; link = &b->next, b = b->next) {
+        if (b->units == units) {
+            *link = b->next;
+            return b + 1;
+        }
+        if (b->units > units) {
+            // Hand out the tail, leave the head on the list
+            b->units -= units;
+            block_t *tail = b + b->units;
+            tail->units = units;
+            return tail + 1;
+        }
+    }
+    
+    if (arena_top + units * UNIT > arena + ARENA_SIZE) {
+        return NULL;
+    }
+    block_t *b = (block_t *)arena_top;
+    arena_top += units * UNIT;
+    b->units = units;
+    return b + 1;
+}
+
+static void ff_free(void *ptr) {
+    block_t *b = (block_t *)ptr - 1;
+    
+    block_t *prev = NULL;
+    block_t *next = free_list;
+    while (next && next < b) {
+        prev = next;
+        next = next->next;
+    }
+    
+    // Merge with the following and the preceding free block
+    if (next && b + b->units == next) {
+        b->units += next->units;
+        b->next = next->next;
+    } else {
+        b->next = next;
+    }
+    if (prev && prev + prev->units == b) {
+        prev->units += b->units;
+        prev->next = b->next;
+    } else if (prev) {
+        prev->next = b;
+    } else {
+        free_list = b;
+    }
+}
+
+// The carved part of the arena never shrinks, so it is also the peak
+static size_t ff_footprint(void) {
+    return arena_top - arena;
+}
+
+static void ff_reset(void) {
+    arena_top = arena;
+    free_list = NULL;
+}
+
+static size_t libc_footprint(void) {
+    return mallinfo().mapped;
+}
+
+static const allocator_t allocators[] = {
+    { "malloc",    malloc,   free,    libc_footprint },
+    { "first-fit", ff_alloc, ff_free, ff_footprint },
+};
+
+/* ---------------------------------------------------------------------
+ * Workloads
+ * ------------------------------------------------------------------- */
+
+/**
+ * A random trace: each step frees a random slot if it is full, or fills
+ * it with a block of a size drawn from the workload's distribution
+ */
+typedef struct {
+    const char *name;
+    int slots;                         // Blocks live at most
+    int steps;
+    size_t (*size)(unsigned long r);
+} workload_t;
+
+static size_t small_size(unsigned long r) {
+    return 16 + r % 241;
+}
+
+static size_t mixed_size(unsigned long r) {
+    // Mostly small, with the odd buffer of a few pages
+    if (r % 16 == 0) {
+        return 4096 + (r >> 4) % 12289;
+    }
+    return 8 + (r >> 4) % 1017;
+}
+
+static const workload_t workloads[] = {
+    { "small churn", 8000, 400000, small_size },
+    { "mixed sizes", 2000, 200000, mixed_size },
+};
+
+static unsigned long rng_state;
+
+static unsigned long rng(void) {
+    // xorshift64
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void *slot_ptr[MAX_SLOTS];
+static size_t slot_size[MAX_SLOTS];
+
+static void run(const allocator_t *a, const workload_t *w) {
+    size_t live = 0, peak_live = 0;
+    size_t base = a->footprint();     // Held over from earlier runs
+    size_t peak_used = 0;
+    int failed = 0;
+    
+    rng_state = 0x9e3779b97f4a7c15UL;
+    unsigned long start = gettime();
+    for (int step = 0; step < w->steps; step++) {
+        if (step % SAMPLE_STEPS == 0) {
+            size_t now = a->footprint();
+            if (now > base && now - base > peak_used) {
+                peak_used = now - base;
+            }
+        }
+        
+        unsigned long r = rng();
+        int i = r % w->slots;
+        if (slot_ptr[i]) {
+            a->release(slot_ptr[i]);
+            slot_ptr[i] = NULL;
+            live -= slot_size[i];
+            continue;
+        }
+        
+        size_t size = w->size(r >> 16);
+        slot_ptr[i] = a->alloc(size);
+        if (!slot_ptr[i]) {
+            failed++;
+            continue;
+        }
+        // Touch the block, as a real caller would
+        *(char *)slot_ptr[i] = 1;
+        slot_size[i] = size;
+        live += size;
+        if (live > peak_live) {
+            peak_live = live;
+        }
+    }
+    for (int i = 0; i < w->slots; i++) {
+        if (slot_ptr[i]) {
+            a->release(slot_ptr[i]);
+            slot_ptr[i] = NULL;
+        }
+    }
+    unsigned long elapsed = gettime() - start;
+    
+    size_t used = peak_used;
+    printf("%-12s %-10s %6lu ms %7lu KiB used %7lu KiB live  %lu.%02lux",
+           w->name, a->name, elapsed, (unsigned long)(used / 1024),
+           (unsigned long)(peak_live / 1024),
+           (unsigned long)(used / peak_live), (unsigned long)(used * 100 / peak_live % 100));
+    if (failed) {
+        printf("  (%d failed)", failed);
+    }
+    printf("\n");
+}
+
+int main(void) {
+    arena = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        fprintf(stderr, "malloc_bench: cannot map the baseline arena\n");
+        return 1;
+    }
+    
+    printf("workload     allocator     time      memory used     peak live  used/live\n");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++) {
+            ff_reset();
+            run(&allocators[a], &workloads[w]);
+        }
+    }
+    
+    struct mallinfo info = mallinfo();
+    printf("malloc: %lu mmap and %lu munmap calls, %lu KiB still mapped\n",
+           (unsigned long)info.mmap_calls, (unsigned long)info.munmap_calls,
+           (unsigned long)(info.mapped / 1024));
+    return 0;
+}
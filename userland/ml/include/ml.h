@@ -0,0 +1,126 @@
+/*
+ * ml.h - Neural network kernels
+ *
+ * Dense and quantized matrix multiply, convolution and the usual
+ * element-wise layers, on row-major float and int8 data. Each kernel has a
+ * RISC-V vector (RVV 1.0) version and a scalar one; the vector versions
+ * are used when the kernel reports the V extension.
+ */
+
+#ifndef _ML_H
+#define _ML_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------
+ * Implementation selection
+ * ------------------------------------------------------------------- */
+
+/**
+ * Whether the vector kernels are in use
+ *
+ * The first call asks the kernel for AT_HWCAP; nothing else needs to
+ * initialize the library.
+ */
+int ml_vector_enabled(void);
+
+/**
+ * Use the vector kernels (when the hart has V) or the scalar ones
+ * @return 1 if the vector kernels are now in use
+ */
+int ml_use_vector(int enable);
+
+/* ---------------------------------------------------------------------
+ * Matrix multiply
+ * ------------------------------------------------------------------- */
+
+/**
+ * C = A * B in single precision
+ * A is m x k, B is k x n and C is m x n; ld* are row strides in elements
+ */
+void ml_sgemm(int m, int n, int k, const float *a, int lda,
+              const float *b, int ldb, float *c, int ldc);
+
+/**
+ * C = A * B on int8 with int32 results
+ * For k up to 2^17 the sums cannot overflow
+ */
+void ml_gemm_s8(int m, int n, int k, const int8_t *a, int lda,
+                const int8_t *b, int ldb, int32_t *c, int ldc);
+
+/* ---------------------------------------------------------------------
+ * Convolution
+ * ------------------------------------------------------------------- */
+
+/**
+ * Shape of a 2-D convolution over one CHW image
+ */
+typedef struct {
+    int in_channels;
+    int height;
+    int width;
+    int out_channels;
+    int kernel_h;
+    int kernel_w;
+    int stride;
+    int pad;                           // Zero rows/columns on each side
+} ml_conv2d_t;
+
+int ml_conv2d_out_h(const ml_conv2d_t *conv);
+int ml_conv2d_out_w(const ml_conv2d_t *conv);
+
+/**
+ * Floats of scratch space ml_conv2d needs
+ */
+size_t ml_conv2d_work_size(const ml_conv2d_t *conv);
+
+/**
+ * Unfold an image into columns: row (c, ky, kx) of cols holds, for every
+ * output position, the input pixel under that kernel tap (0 in the padding)
+ */
+void ml_im2col(const ml_conv2d_t *conv, const float *in, float *cols);
+
+/**
+ * out = weights * im2col(in) + bias
+ * weights is out_channels x (in_channels * kernel_h * kernel_w), out is
+ * out_channels x out_h x out_w, bias may be NULL, and work holds
+ * ml_conv2d_work_size() floats
+ */
+void ml_conv2d(const ml_conv2d_t *conv, const float *in, const float *weights,
+               const float *bias, float *out, float *work);
+
+/* ---------------------------------------------------------------------
+ * Element-wise layers
+ * ------------------------------------------------------------------- */
+
+/**
+ * out[i] = exp(in[i] - max) / sum; in and out may be the same
+ */
+void ml_softmax(const float *in, float *out, int n);
+
+/**
+ * out[i] = (in[i] - mean) / sqrt(variance + eps) * gamma[i] + beta[i]
+ * gamma and beta may be NULL (1 and 0)
+ */
+void ml_layernorm(const float *in, float *out, int n,
+                  const float *gamma, const float *beta, float eps);
+
+/**
+ * Symmetric per-tensor quantization: out[i] = round(in[i] / scale),
+ * with scale = max|in| / 127
+ * @return scale (1 if every input is 0)
+ */
+float ml_quantize_s8(const float *in, int8_t *out, int n);
+
+/**
+ * out[i] = in[i] * scale
+ */
+void ml_dequantize_s8(const int8_t *in, float *out, int n, float scale);
+
+/**
+ * exp(x) to within 2 ulp for x in [-87.3, 88]; 0 below, exp(88) above
+ */
+float ml_expf(float x);
+
+#endif // _ML_H
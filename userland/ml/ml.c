@@ -0,0 +1,386 @@
+/*
+ * ml.c - Neural network kernels: selection and scalar versions
+ */
+
+#include "ml_impl.h"
+#include <string.h>
+#include <sys/auxv.h>
+
+static int vector_on = -1;             // -1 until the kernel has been asked
+
+int ml_vector_enabled(void) {
+    if (vector_on < 0) {
+        vector_on = (getauxval(AT_HWCAP) & HWCAP_ISA_V) != 0;
+    }
+    return vector_on;
+}
+
+int ml_use_vector(int enable) {
+    vector_on = enable && (getauxval(AT_HWCAP) & HWCAP_ISA_V) != 0;
+    return vector_on;
+}
+
+/* ---------------------------------------------------------------------
+ * Matrix multiply
+ * ------------------------------------------------------------------- */
+
+// A 4x4 block of C is kept in 16 registers for the whole k loop, so each
+// element of A and B loaded is used four times
+static void sgemm_scalar(int m, int n, int k, const float *a, int lda,
+                         const float *b, int ldb, float *c, int ldc) {
+    int i = 0;
+    for (; i + ML_GEMM_ROWS <= m; i += ML_GEMM_ROWS) {
+        const float *a0 = a + (size_t)i * lda;
+        const float *a1 = a0 + lda;
+        const float *a2 = a1 + lda;
+        const float *a3 = a2 + lda;
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            float c00 = 0, c01 = 0, c02 = 0, c03 = 0;
+            float c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+            float c20 = 0, c21 = 0, c22 = 0, c23 = 0;
+            float c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+            const float *bp = b + j;
+            for (int p = 0; p < k; p++, bp += ldb) {
+                float b0 = bp[0], b1 = bp[1], b2 = bp[2], b3 = bp[3];
+                float x = a0[p];
+                c00 += x * b0; c01 += x * b1; c02 += x * b2; c03 += x * b3;
+                x = a1[p];
+                c10 += x * b0; c11 += x * b1; c12 += x * b2; c13 += x * b3;
+                x = a2[p];
+                c20 += x * b0; c21 += x * b1; c22 += x * b2; c23 += x * b3;
+                x = a3[p];
+                c30 += x * b0; c31 += x * b1; c32 += x * b2; c33 += x * b3;
+            }
+            float *cp = c + (size_t)i * ldc + j;
+            cp[0] = c00; cp[1] = c01; cp[2] = c02; cp[3] = c03;
+            cp += ldc;
+            cp[0] = c10; cp[1] = c11; cp[2] = c12; cp[3] = c13;
+            cp += ldc;
+            cp[0] = c20; cp[1] = c21; cp[2] = c22; cp[3] = c23;
+            cp += ldc;
+            cp[0] = c30; cp[1] = c31; cp[2] = c32; cp[3] = c33;
+        }
+        // Columns left over: four rows, one column at a time
+        for (; j < n; j++) {
+            float c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+            const float *bp = b + j;
+            for (int p = 0; p < k; p++, bp += ldb) {
+                c0 += a0[p] * *bp;
+                c1 += a1[p] * *bp;
+                c2 += a2[p] * *bp;
+                c3 += a3[p] * *bp;
+            }
+            c[(size_t)i * ldc + j] = c0;
+            c[(size_t)(i + 1) * ldc + j] = c1;
+            c[(size_t)(i + 2) * ldc + j] = c2;
+            c[(size_t)(i + 3) * ldc + j] = c3;
+        }
+    }
+    // Rows left over
+    for (; i < m; i++) {
+        const float *ai = a + (size_t)i * lda;
+        for (int j = 0; j < n; j++) {
+            float sum = 0;
+            for (int p = 0; p < k; p++) {
+                sum += ai[p] * b[(size_t)p * ldb + j];
+            }
+            c[(size_t)i * ldc + j] = sum;
+        }
+    }
+}
+
+void ml_sgemm(int m, int n, int k, const float *a, int lda,
+              const float *b, int ldb, float *c, int ldc) {
+    if (ml_vector_enabled()) {
+        ml_rvv_sgemm(m, n, k, a, lda, b, ldb, c, ldc);
+    } else {
+        sgemm_scalar(m, n, k, a, lda, b, ldb, c, ldc);
+    }
+}
+
+// The same blocking as sgemm_scalar, with int32 sums
+static void gemm_s8_scalar(int m, int n, int k, const int8_t *a, int lda,
+                           const int8_t *b, int ldb, int32_t *c, int ldc) {
+    int i = 0;
+    for (; i + ML_GEMM_ROWS <= m; i += ML_GEMM_ROWS) {
+        const int8_t *a0 = a + (size_t)i * lda;
+        const int8_t *a1 = a0 + lda;
+        const int8_t *a2 = a1 + lda;
+        const int8_t *a3 = a2 + lda;
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            int32_t c00 = 0, c01 = 0, c02 = 0, c03 = 0;
+            int32_t c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+            int32_t c20 = 0, c21 = 0, c22 = 0, c23 = 0;
+            int32_t c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+            const int8_t *bp = b + j;
+            for (int p = 0; p < k; p++, bp += ldb) {
+                int32_t b0 = bp[0], b1 = bp[1], b2 = bp[2], b3 = bp[3];
+                int32_t x = a0[p];
+                c00 += x * b0; c01 += x * b1; c02 += x * b2; c03 += x * b3;
+                x = a1[p];
+                c10 += x * b0; c11 += x * b1; c12 += x * b2; c13 += x * b3;
+                x = a2[p];
+                c20 += x * b0; c21 += x * b1; c22 += x * b2; c23 += x * b3;
+                x = a3[p];
+                c30 += x * b0; c31 += x * b1; c32 += x * b2; c33 += x * b3;
+            }
+            int32_t *cp = c + (size_t)i * ldc + j;
+            cp[0] = c00; cp[1] = c01; cp[2] = c02; cp[3] = c03;
+            cp += ldc;
+            cp[0] = c10; cp[1] = c11; cp[2] = c12; cp[3] = c13;
+            cp += ldc;
+            cp[0] = c20; cp[1] = c21; cp[2] = c22; cp[3] = c23;
+            cp += ldc;
+            cp[0] = c30; cp[1] = c31; cp[2] = c32; cp[3] = c33;
+        }
+        for (; j < n; j++) {
+            int32_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+            const int8_t *bp = b + j;
+            for (int p = 0; p < k; p++, bp += ldb) {
+                c0 += a0[p] * *bp;
+                c1 += a1[p] * *bp;
+                c2 += a2[p] * *bp;
+                c3 += a3[p] * *bp;
+            }
+            c[(size_t)i * ldc + j] = c0;
+            c[(size_t)(i + 1) * ldc + j] = c1;
+            c[(size_t)(i + 2) * ldc + j] = c2;
+            c[(size_t)(i + 3) * ldc + j] = c3;
+        }
+    }
+    for (; i < m; i++) {
+        const int8_t *ai = a + (size_t)i * lda;
+        for (int j = 0; j < n; j++) {
+            int32_t sum = 0;
+            for (int p = 0; p < k; p++) {
+                sum += ai[p] * b[(size_t)p * ldb + j];
+            }
+            c[(size_t)i * ldc + j] = sum;
+        }
+    }
+}
+
+void ml_gemm_s8(int m, int n, int k, const int8_t *a, int lda,
+                const int8_t *b, int ldb, int32_t *c, int ldc) {
+    if (ml_vector_enabled()) {
+        ml_rvv_gemm_s8(m, n, k, a, lda, b, ldb, c, ldc);
+    } else {
+        gemm_s8_scalar(m, n, k, a, lda, b, ldb, c, ldc);
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Convolution
+ * ------------------------------------------------------------------- */
+
+int ml_conv2d_out_h(const ml_conv2d_t *conv) {
+    return (conv->height + 2 * conv->pad - conv->kernel_h) / conv->stride + 1;
+}
+
+int ml_conv2d_out_w(const ml_conv2d_t *conv) {
+    return (conv->width + 2 * conv->pad - conv->kernel_w) / conv->stride + 1;
+}
+
+// A 1x1 kernel with stride 1 and no padding reads the image as it is
+static int is_pointwise(const ml_conv2d_t *conv) {
+    return conv->kernel_h == 1 && conv->kernel_w == 1 && conv->stride == 1 && conv->pad == 0;
+}
+
+size_t ml_conv2d_work_size(const ml_conv2d_t *conv) {
+    if (is_pointwise(conv)) {
+        return 0;
+    }
+    return (size_t)conv->in_channels * conv->kernel_h * conv->kernel_w *
+           ml_conv2d_out_h(conv) * ml_conv2d_out_w(conv);
+}
+
+void ml_im2col(const ml_conv2d_t *conv, const float *in, float *cols) {
+    int out_h = ml_conv2d_out_h(conv);
+    int out_w = ml_conv2d_out_w(conv);
+    
+    for (int ch = 0; ch < conv->in_channels; ch++) {
+        const float *plane = in + (size_t)ch * conv->height * conv->width;
+        for (int ky = 0; ky < conv->kernel_h; ky++) {
+            for (int kx = 0; kx < conv->kernel_w; kx++) {
+                for (int y = 0; y < out_h; y++) {
+                    int iy = y * conv->stride - conv->pad + ky;
+                    if (iy < 0 || iy >= conv->height) {
+                        memset(cols, 0, (size_t)out_w * sizeof(float));
+                        cols += out_w;
+                        continue;
+                    }
+                    const float *row = plane + (size_t)iy * conv->width;
+                    for (int x = 0; x < out_w; x++) {
+                        int ix = x * conv->stride - conv->pad + kx;
+                        *cols++ = (ix >= 0 && ix < conv->width) ? row[ix] : 0.0f;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ml_conv2d(const ml_conv2d_t *conv, const float *in, const float *weights,
+               const float *bias, float *out, float *work) {
+    int taps = conv->in_channels * conv->kernel_h * conv->kernel_w;
+    int pixels = ml_conv2d_out_h(conv) * ml_conv2d_out_w(conv);
+    
+    const float *cols = in;
+    if (!is_pointwise(conv)) {
+        ml_im2col(conv, in, work);
+        cols = work;
+    }
+    ml_sgemm(conv->out_channels, pixels, taps, weights, taps, cols, pixels, out, pixels);
+    
+    if (bias) {
+        for (int oc = 0; oc < conv->out_channels; oc++) {
+            float *plane = out + (size_t)oc * pixels;
+            for (int i = 0; i < pixels; i++) {
+                plane[i] += bias[oc];
+            }
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Element-wise layers
+ * ------------------------------------------------------------------- */
+
+float ml_expf(float x) {
+    if (x < ML_EXP_MIN) {
+        return 0.0f;
+    }
+    if (x > ML_EXP_MAX) {
+        x = ML_EXP_MAX;
+    }
+    
+    float t = x * ML_LOG2E;
+    int n = (int)(t >= 0 ? t + 0.5f : t - 0.5f);
+    float r = x - n * ML_LN2_HI - n * ML_LN2_LO;
+    
+    float p = ML_EXP_P0;
+    p = p * r + ML_EXP_P1;
+    p = p * r + ML_EXP_P2;
+    p = p * r + ML_EXP_P3;
+    p = p * r + ML_EXP_P4;
+    p = p * r + ML_EXP_P5;
+    p = p * r * r + r + 1.0f;
+    
+    // 2^n, built from its exponent field
+    union { uint32_t bits; float f; } scale = { (uint32_t)(n + 127) << 23 };
+    return p * scale.f;
+}
+
+static float sqrt_f(float x) {
+#ifdef __riscv
+    float r;
+    asm("fsqrt.s %0, %1" : "=f"(r) : "f"(x));
+    return r;
+#else
+    return __builtin_sqrtf(x);
+#endif
+}
+
+void ml_softmax(const float *in, float *out, int n) {
+    if (n <= 0) {
+        return;
+    }
+    if (ml_vector_enabled()) {
+        ml_rvv_softmax(in, out, n);
+        return;
+    }
+    
+    float max = in[0];
+    for (int i = 1; i < n; i++) {
+        if (in[i] > max) {
+            max = in[i];
+        }
+    }
+    float sum = 0;
+    for (int i = 0; i < n; i++) {
+        out[i] = ml_expf(in[i] - max);
+        sum += out[i];
+    }
+    float inv = 1.0f / sum;
+    for (int i = 0; i < n; i++) {
+        out[i] *= inv;
+    }
+}
+
+void ml_layernorm(const float *in, float *out, int n,
+                  const float *gamma, const float *beta, float eps) {
+    if (n <= 0) {
+        return;
+    }
+    if (ml_vector_enabled()) {
+        ml_rvv_layernorm(in, out, n, gamma, beta, eps);
+        return;
+    }
+    
+    float sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += in[i];
+    }
+    float mean = sum / n;
+    // Second pass over the deviations: no cancellation as with sum(x^2)
+    float var = 0;
+    for (int i = 0; i < n; i++) {
+        float d = in[i] - mean;
+        var += d * d;
+    }
+    float inv = 1.0f / sqrt_f(var / n + eps);
+    for (int i = 0; i < n; i++) {
+        float y = (in[i] - mean) * inv;
+        if (gamma) {
+            y *= gamma[i];
+        }
+        if (beta) {
+            y += beta[i];
+        }
+        out[i] = y;
+    }
+}
+
+float ml_quantize_s8(const float *in, int8_t *out, int n) {
+    float max = 0;
+    if (ml_vector_enabled()) {
+        max = ml_rvv_max_abs(in, n);
+    } else {
+        for (int i = 0; i < n; i++) {
+            float a = in[i] < 0 ? -in[i] : in[i];
+            if (a > max) {
+                max = a;
+            }
+        }
+    }
+    float scale = (max > 0) ? max / 127.0f : 1.0f;
+    float inv = 1.0f / scale;
+    
+    if (ml_vector_enabled()) {
+        ml_rvv_quantize_s8(in, out, n, inv);
+        return scale;
+    }
+    for (int i = 0; i < n; i++) {
+        float v = in[i] * inv;
+        // Rounding can take max|in| a hair past 127
+        if (v > 127.0f) {
+            v = 127.0f;
+        } else if (v < -127.0f) {
+            v = -127.0f;
+        }
+        out[i] = (int8_t)(v >= 0 ? v + 0.5f : v - 0.5f);
+    }
+    return scale;
+}
+
+void ml_dequantize_s8(const int8_t *in, float *out, int n, float scale) {
+    if (ml_vector_enabled()) {
+        ml_rvv_dequantize_s8(in, out, n, scale);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        out[i] = in[i] * scale;
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * ml_impl.h - Internals shared by the scalar and vector kernels
+ */
+
+#ifndef _ML_IMPL_H
+#define _ML_IMPL_H
+
+#include <ml.h>
+
+// Rows of C computed together by the matrix multiply micro-kernels
+#define ML_GEMM_ROWS 4
+
+// exp(x) = 2^n * e^r with n = round(x / ln 2); ln 2 is split in two so
+// that x - n ln 2 stays exact (Cephes expf)
+#define ML_EXP_MIN    -87.3f             // exp is below FLT_MIN from here
+#define ML_EXP_MAX     88.0f             // 2^n stays a normal float up to here
+#define ML_LOG2E       1.44269504089f
+#define ML_LN2_HI      0.693359375f
+#define ML_LN2_LO     -2.12194440e-4f
+#define ML_EXP_P0      1.9875691500e-4f
+#define ML_EXP_P1      1.3981999507e-3f
+#define ML_EXP_P2      8.3334519073e-3f
+#define ML_EXP_P3      4.1665795894e-2f
+#define ML_EXP_P4      1.6666665459e-1f
+#define ML_EXP_P5      5.0000001201e-1f
+
+// Vector kernels (ml_rvv.c), called only when the hart has V
+void ml_rvv_sgemm(int m, int n, int k, const float *a, int lda,
+                  const float *b, int ldb, float *c, int ldc);
+void ml_rvv_gemm_s8(int m, int n, int k, const int8_t *a, int lda,
+                    const int8_t *b, int ldb, int32_t *c, int ldc);
+void ml_rvv_softmax(const float *in, float *out, int n);
+void ml_rvv_layernorm(const float *in, float *out, int n,
+                      const float *gamma, const float *beta, float eps);
+float ml_rvv_max_abs(const float *in, int n);
+void ml_rvv_quantize_s8(const float *in, int8_t *out, int n, float inv_scale);
+void ml_rvv_dequantize_s8(const int8_t *in, float *out, int n, float scale);
+
+#endif // _ML_IMPL_H
@@ -0,0 +1,230 @@
+/*
+ * ml_rvv.c - Neural network kernels: RISC-V vector (RVV 1.0) versions
+ *
+ * Built with -march=rv64gcv; ml.c calls these only when the kernel
+ * reports the V extension. Loops are strip-mined with vsetvl, so they
+ * work for any VLEN.
+ */
+
+#include "ml_impl.h"
+#include <riscv_vector.h>
+
+/* ---------------------------------------------------------------------
+ * Matrix multiply
+ * ------------------------------------------------------------------- */
+
+// ML_GEMM_ROWS rows of C by one LMUL=4 strip of columns: four
+// accumulator groups (16 registers) stay live over the k loop, and each
+// strip of B loaded feeds one multiply-add per row
+void ml_rvv_sgemm(int m, int n, int k, const float *a, int lda,
+                  const float *b, int ldb, float *c, int ldc) {
+    for (int j = 0; j < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - j);
+        int i = 0;
+        for (; i + ML_GEMM_ROWS <= m; i += ML_GEMM_ROWS) {
+            const float *a0 = a + (size_t)i * lda;
+            const float *a1 = a0 + lda;
+            const float *a2 = a1 + lda;
+            const float *a3 = a2 + lda;
+            vfloat32m4_t c0 = __riscv_vfmv_v_f_f32m4(0.0f, vl);
+            vfloat32m4_t c1 = c0, c2 = c0, c3 = c0;
+            const float *bp = b + j;
+            for (int p = 0; p < k; p++, bp += ldb) {
+                vfloat32m4_t vb = __riscv_vle32_v_f32m4(bp, vl);
+                c0 = __riscv_vfmacc_vf_f32m4(c0, a0[p], vb, vl);
+                c1 = __riscv_vfmacc_vf_f32m4(c1, a1[p], vb, vl);
+                c2 = __riscv_vfmacc_vf_f32m4(c2, a2[p], vb, vl);
+                c3 = __riscv_vfmacc_vf_f32m4(c3, a3[p], vb, vl);
+            }
+            float *cp = c + (size_t)i * ldc + j;
+            __riscv_vse32_v_f32m4(cp, c0, vl);
+            __riscv_vse32_v_f32m4(cp + ldc, c1, vl);
+            __riscv_vse32_v_f32m4(cp + 2 * (size_t)ldc, c2, vl);
+            __riscv_vse32_v_f32m4(cp + 3 * (size_t)ldc, c3, vl);
+        }
+        for (; i < m; i++) {
+            const float *ai = a + (size_t)i * lda;
+            vfloat32m4_t acc = __riscv_vfmv_v_f_f32m4(0.0f, vl);
+            const float *bp = b + j;
+            for (int p = 0; p < k; p++, bp += ldb) {
+                acc = __riscv_vfmacc_vf_f32m4(acc, ai[p], __riscv_vle32_v_f32m4(bp, vl), vl);
+            }
+            __riscv_vse32_v_f32m4(c + (size_t)i * ldc + j, acc, vl);
+        }
+        j += vl;
+    }
+}
+
+// int8 strips are widened to int16 and multiply-added into int32
+// (vwmacc); e8m1, e16m2 and e32m4 hold the same number of elements
+void ml_rvv_gemm_s8(int m, int n, int k, const int8_t *a, int lda,
+                    const int8_t *b, int ldb, int32_t *c, int ldc) {
+    for (int j = 0; j < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - j);
+        int i = 0;
+        for (; i + ML_GEMM_ROWS <= m; i += ML_GEMM_ROWS) {
+            const int8_t *a0 = a + (size_t)i * lda;
+            const int8_t *a1 = a0 + lda;
+            const int8_t *a2 = a1 + lda;
+            const int8_t *a3 = a2 + lda;
+            vint32m4_t c0 = __riscv_vmv_v_x_i32m4(0, vl);
+            vint32m4_t c1 = c0, c2 = c0, c3 = c0;
+            const int8_t *bp = b + j;
+            for (int p = 0; p < k; p++, bp += ldb) {
+                vint16m2_t vb = __riscv_vsext_vf2_i16m2(__riscv_vle8_v_i8m1(bp, vl), vl);
+                c0 = __riscv_vwmacc_vx_i32m4(c0, a0[p], vb, vl);
+                c1 = __riscv_vwmacc_vx_i32m4(c1, a1[p], vb, vl);
+                c2 = __riscv_vwmacc_vx_i32m4(c2, a2[p], vb, vl);
+                c3 = __riscv_vwmacc_vx_i32m4(c3, a3[p], vb, vl);
+            }
+            int32_t *cp = c + (size_t)i * ldc + j;
+            __riscv_vse32_v_i32m4(cp, c0, vl);
+            __riscv_vse32_v_i32m4(cp + ldc, c1, vl);
+            __riscv_vse32_v_i32m4(cp + 2 * (size_t)ldc, c2, vl);
+            __riscv_vse32_v_i32m4(cp + 3 * (size_t)ldc, c3, vl);
+        }
+        for (; i < m; i++) {
+            const int8_t *ai = a + (size_t)i * lda;
+            vint32m4_t acc = __riscv_vmv_v_x_i32m4(0, vl);
+            const int8_t *bp = b + j;
+            for (int p = 0; p < k; p++, bp += ldb) {
+                vint16m2_t vb = __riscv_vsext_vf2_i16m2(__riscv_vle8_v_i8m1(bp, vl), vl);
+                acc = __riscv_vwmacc_vx_i32m4(acc, ai[p], vb, vl);
+            }
+            __riscv_vse32_v_i32m4(c + (size_t)i * ldc + j, acc, vl);
+        }
+        j += vl;
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Element-wise layers
+ * ------------------------------------------------------------------- */
+
+// Reductions fold each strip into element 0 of an m1 register, which
+// stays correct when the last strip is shorter
+static float max_of(const float *in, int n) {
+    vfloat32m1_t acc = __riscv_vfmv_s_f_f32m1(in[0], 1);
+    for (int i = 0; i < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - i);
+        acc = __riscv_vfredmax_vs_f32m4_f32m1(__riscv_vle32_v_f32m4(in + i, vl), acc, vl);
+        i += vl;
+    }
+    return __riscv_vfmv_f_s_f32m1_f32(acc);
+}
+
+// ml_expf() on a strip, with the same range reduction and polynomial
+static vfloat32m4_t exp_strip(vfloat32m4_t x, size_t vl) {
+    vbool8_t underflow = __riscv_vmflt_vf_f32m4_b8(x, ML_EXP_MIN, vl);
+    x = __riscv_vfmin_vf_f32m4(x, ML_EXP_MAX, vl);
+    x = __riscv_vfmax_vf_f32m4(x, ML_EXP_MIN, vl);
+    
+    // n = round(x / ln 2), r = x - n ln 2
+    vint32m4_t n = __riscv_vfcvt_x_f_v_i32m4(__riscv_vfmul_vf_f32m4(x, ML_LOG2E, vl), vl);
+    vfloat32m4_t nf = __riscv_vfcvt_f_x_v_f32m4(n, vl);
+    vfloat32m4_t r = __riscv_vfnmsac_vf_f32m4(x, ML_LN2_HI, nf, vl);
+    r = __riscv_vfnmsac_vf_f32m4(r, ML_LN2_LO, nf, vl);
+    
+    vfloat32m4_t p = __riscv_vfmv_v_f_f32m4(ML_EXP_P0, vl);
+    p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), ML_EXP_P1, vl);
+    p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), ML_EXP_P2, vl);
+    p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), ML_EXP_P3, vl);
+    p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), ML_EXP_P4, vl);
+    p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), ML_EXP_P5, vl);
+    p = __riscv_vfmul_vv_f32m4(p, __riscv_vfmul_vv_f32m4(r, r, vl), vl);
+    p = __riscv_vfadd_vf_f32m4(__riscv_vfadd_vv_f32m4(p, r, vl), 1.0f, vl);
+    
+    // Times 2^n, built from its exponent field
+    vint32m4_t bits = __riscv_vsll_vx_i32m4(__riscv_vadd_vx_i32m4(n, 127, vl), 23, vl);
+    p = __riscv_vfmul_vv_f32m4(p, __riscv_vreinterpret_v_i32m4_f32m4(bits), vl);
+    return __riscv_vfmerge_vfm_f32m4(p, 0.0f, underflow, vl);
+}
+
+void ml_rvv_softmax(const float *in, float *out, int n) {
+    float max = max_of(in, n);
+    
+    vfloat32m1_t sum = __riscv_vfmv_s_f_f32m1(0.0f, 1);
+    for (int i = 0; i < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - i);
+        vfloat32m4_t x = __riscv_vfsub_vf_f32m4(__riscv_vle32_v_f32m4(in + i, vl), max, vl);
+        vfloat32m4_t e = exp_strip(x, vl);
+        __riscv_vse32_v_f32m4(out + i, e, vl);
+        sum = __riscv_vfredusum_vs_f32m4_f32m1(e, sum, vl);
+        i += vl;
+    }
+    
+    float inv = 1.0f / __riscv_vfmv_f_s_f32m1_f32(sum);
+    for (int i = 0; i < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - i);
+        __riscv_vse32_v_f32m4(out + i, __riscv_vfmul_vf_f32m4(__riscv_vle32_v_f32m4(out + i, vl), inv, vl), vl);
+        i += vl;
+    }
+}
+
+void ml_rvv_layernorm(const float *in, float *out, int n,
+                      const float *gamma, const float *beta, float eps) {
+    vfloat32m1_t sum = __riscv_vfmv_s_f_f32m1(0.0f, 1);
+    for (int i = 0; i < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - i);
+        sum = __riscv_vfredusum_vs_f32m4_f32m1(__riscv_vle32_v_f32m4(in + i, vl), sum, vl);
+        i += vl;
+    }
+    float mean = __riscv_vfmv_f_s_f32m1_f32(sum) / n;
+    
+    vfloat32m1_t var = __riscv_vfmv_s_f_f32m1(0.0f, 1);
+    for (int i = 0; i < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - i);
+        vfloat32m4_t d = __riscv_vfsub_vf_f32m4(__riscv_vle32_v_f32m4(in + i, vl), mean, vl);
+        var = __riscv_vfredusum_vs_f32m4_f32m1(__riscv_vfmul_vv_f32m4(d, d, vl), var, vl);
+        i += vl;
+    }
+    vfloat32m1_t v = __riscv_vfmv_s_f_f32m1(__riscv_vfmv_f_s_f32m1_f32(var) / n + eps, 1);
+    float inv = 1.0f / __riscv_vfmv_f_s_f32m1_f32(__riscv_vfsqrt_v_f32m1(v, 1));
+    
+    for (int i = 0; i < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - i);
+        vfloat32m4_t y = __riscv_vfsub_vf_f32m4(__riscv_vle32_v_f32m4(in + i, vl), mean, vl);
+        y = __riscv_vfmul_vf_f32m4(y, inv, vl);
+        if (gamma) {
+            y = __riscv_vfmul_vv_f32m4(y, __riscv_vle32_v_f32m4(gamma + i, vl), vl);
+        }
+        if (beta) {
+            y = __riscv_vfadd_vv_f32m4(y, __riscv_vle32_v_f32m4(beta + i, vl), vl);
+        }
+        __riscv_vse32_v_f32m4(out + i, y, vl);
+        i += vl;
+    }
+}
+
+float ml_rvv_max_abs(const float *in, int n) {
+    vfloat32m1_t acc = __riscv_vfmv_s_f_f32m1(0.0f, 1);
+    for (int i = 0; i < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - i);
+        vfloat32m4_t x = __riscv_vfabs_v_f32m4(__riscv_vle32_v_f32m4(in + i, vl), vl);
+        acc = __riscv_vfredmax_vs_f32m4_f32m1(x, acc, vl);
+        i += vl;
+    }
+    return __riscv_vfmv_f_s_f32m1_f32(acc);
+}
+
+// Clamped to +-127 as floats, so narrowing to int16 (rounding to nearest)
+// and then to int8 (truncating) cannot overflow
+void ml_rvv_quantize_s8(const float *in, int8_t *out, int n, float inv_scale) {
+    for (int i = 0; i < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - i);
+        vfloat32m4_t x = __riscv_vfmul_vf_f32m4(__riscv_vle32_v_f32m4(in + i, vl), inv_scale, vl);
+        x = __riscv_vfmin_vf_f32m4(__riscv_vfmax_vf_f32m4(x, -127.0f, vl), 127.0f, vl);
+        vint16m2_t h = __riscv_vfncvt_x_f_w_i16m2(x, vl);
+        __riscv_vse8_v_i8m1(out + i, __riscv_vncvt_x_x_w_i8m1(h, vl), vl);
+        i += vl;
+    }
+}
+
+void ml_rvv_dequantize_s8(const int8_t *in, float *out, int n, float scale) {
+    for (int i = 0; i < n; ) {
+        size_t vl = __riscv_vsetvl_e32m4(n - i);
+        vint32m4_t w = __riscv_vsext_vf4_i32m4(__riscv_vle8_v_i8m1(in + i, vl), vl);
+        __riscv_vse32_v_f32m4(out + i, __riscv_vfmul_vf_f32m4(__riscv_vfcvt_f_x_v_f32m4(w, vl), scale, vl), vl);
+        i += vl;
+    }
+}
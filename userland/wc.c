@@ -0,0 +1,56 @@
+/*
+ * wc - Count lines, words and bytes
+ * Counts stdin, e.g. at the end of "cat test.txt | wc", or each file given
+ */
+
+#include <stdio.h>
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static void count(FILE *in, const char *name) {
+    unsigned long lines = 0, words = 0, bytes = 0;
+    int in_word = 0;
+    
+    static char buf[BUFSIZ];
+    size_t nread;
+    while ((nread = fread(buf, 1, sizeof(buf), in)) > 0) {
+        bytes += nread;
+        for (size_t i = 0; i < nread; i++) {
+            if (buf[i] == '\n') lines++;
+            if (is_space(buf[i])) {
+                in_word = 0;
+            } else if (!in_word) {
+                in_word = 1;
+                words++;
+            }
+        }
+    }
+    
+    if (name) {
+        printf("%lu %lu %lu %s\n", lines, words, bytes, name);
+    } else {
+        printf("%lu %lu %lu\n", lines, words, bytes);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        count(stdin, NULL);
+        return 0;
+    }
+    
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        FILE *in = fopen(argv[i], "r");
+        if (!in) {
+            fprintf(stderr, "wc: %s: No such file or directory\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        count(in, argv[i]);
+        fclose(in);
+    }
+    return status;
+}